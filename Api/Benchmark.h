@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+
+#include "SyntheticTree.h"
+
+const DWORD BENCHMARK_DEFAULT_ITERATIONS = 5;
+
+typedef struct _BENCHMARKRESULT {
+	LPCSTR lpsName;
+	DWORD dwIterations;
+	ULONGLONG ullOperations;
+	ULONGLONG ullKeys;
+	double dElapsedSeconds;
+	LONGLONG llAllocations;
+	SIZE_T cbPeakResidentSet;
+} BENCHMARKRESULT;
+
+bool RunBenchmarks(const SYNTHETICTREEPARAMS* lpParams, DWORD dwIterations, FILE* lpOutput);
+void PrintBenchmarkResult(const BENCHMARKRESULT* lpResult, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput);
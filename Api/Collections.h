@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD ARRAY_INITIAL_CAPACITY = 16;
+
+// FNV-1a parameters shared by hash tables of paths, queries and DFA states
+const DWORD HASH_INITIAL_VALUE = 2166136261;
+const DWORD HASH_PRIME = 16777619;
+// Length of string that is hashed up to its terminator
+const DWORD HASH_TERMINATED = MAXDWORD;
+
+bool ReserveArray(void** lpArray, DWORD* lpdwCapacity, DWORD dwRequired, SIZE_T cbElement);
+DWORD HashString(DWORD dwHash, LPCWSTR lpsText, DWORD cchText, bool bIgnoreCase);
+DWORD HashWords(DWORD dwHash, const DWORD* lpdwWords, DWORD dwWordsCount);
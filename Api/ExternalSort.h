@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+
+const SIZE_T EXTERNAL_SORT_MIN_BUDGET = 64 * 1024;
+const DWORD EXTERNAL_SORT_MIN_RUN_BUFFER = 4 * 1024;
+const DWORD EXTERNAL_SORT_MAX_RUN_BUFFER = 64 * 1024;
+const DWORD EXTERNAL_SORT_ITEM_BUFFER_LENGTH = 256;
+// Heap block header, counted for every allocation of budget
+const SIZE_T EXTERNAL_SORT_ALLOCATION_OVERHEAD = 16;
+
+// Called in ascending order once per distinct item, false stops merge
+typedef bool (*SORTEDITEMPROC)(void* lpContext, LPCWSTR lpsItem);
+
+// File of run is named after base file of sorter and run id
+typedef struct _SORTRUN {
+	DWORD dwRunId;
+	DWORD dwLevel;
+	ULONGLONG ullItemsCount;
+} SORTRUN;
+
+// Reader of one run during merge, items are front coded: shared prefix length, suffix length, suffix
+typedef struct _SORTRUNREADER {
+	FILE* lpFile;
+	BYTE* lpBuffer;
+	LPWSTR lpsItem;
+	DWORD cchItem;
+	DWORD cchCapacity;
+	ULONGLONG ullItemsLeft;
+} SORTRUNREADER;
+
+typedef struct _EXTERNALSORTER {
+	SIZE_T cbBudget;
+	SIZE_T cbUsed;
+	SIZE_T cbPeakUsed;
+	DWORD cbRunBuffer;
+	LPWSTR* lpsItems;
+	DWORD dwItemsCount;
+	DWORD dwItemsCapacity;
+	DWORD dwFanIn;
+	WCHAR lpsBaseName[MAX_PATH];
+	DWORD dwNextRunId;
+	SORTRUN* lpRuns;
+	DWORD dwRunsCount;
+	DWORD dwRunsCapacity;
+	ULONGLONG ullSpilledBytes;
+} EXTERNALSORTER;
+
+bool InitExternalSorter(EXTERNALSORTER* lpSorter, SIZE_T cbBudget, LPCWSTR lpsDirectory);
+bool AddSortedItem(EXTERNALSORTER* lpSorter, LPCWSTR lpsItem, DWORD cchItem);
+bool MergeSortedItems(EXTERNALSORTER* lpSorter, SORTEDITEMPROC lpfnItem, void* lpContext);
+void FreeExternalSorter(EXTERNALSORTER* lpSorter);
+void SetResultMemoryBudget(SIZE_T cbBudget);
+SIZE_T GetResultMemoryBudget();
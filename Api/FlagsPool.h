@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Platform.h"
+
+#include "RegistryEditor.h"
+
+const DWORD FLAGS_POOL_DEFAULT_JOBS = 8;
+const DWORD FLAGS_POOL_MAX_JOBS = 64;
+const DWORD FLAGS_CACHE_BUCKETS_COUNT = 4096;
+// Keys queried after cache is full are reported from their own flags, which are freed after report
+const DWORD FLAGS_CACHE_MAX_ENTRIES = 16384;
+
+// Runs command line of child process and returns its output (free), stub replaces reg.exe
+typedef LPSTR (*RUNCHILDPROC)(void* lpContext, WCHAR* lpsCommand);
+
+typedef struct _CHILDRUNNER {
+	RUNCHILDPROC lpfnRun;
+	void* lpContext;
+} CHILDRUNNER;
+
+typedef struct _FLAGSCACHEENTRY {
+	LPWSTR lpsCommand;
+	DWORD dwHash;
+	KEYFLAG* kfFlags;
+	DWORD dwFlagsCount;
+	struct _FLAGSCACHEENTRY* lpNext;
+} FLAGSCACHEENTRY;
+
+typedef struct _FLAGSRESULT {
+	LPCWSTR lpsSubkeyPath;
+	const KEYFLAG* kfFlags;
+	DWORD dwFlagsCount;
+	bool bCached;
+	bool bOwned;
+} FLAGSRESULT;
+
+// Called in order of keys, kfFlags is NULL when query failed
+typedef void (*FLAGSRESULTPROC)(void* lpContext, DWORD dwIndex, const FLAGSRESULT* lpResult);
+
+typedef struct _FLAGSPOOL {
+	LPCWSTR lpsKeyRoot;
+	LPCWSTR* lpsSubkeyPaths;
+	DWORD dwKeysCount;
+	const CHILDRUNNER* lpRunner;
+	volatile LONG lNextKey;
+	FLAGSRESULT* lpResults;
+	bool* lpbCompleted;
+	SRWLOCK srwLock;
+	CONDITION_VARIABLE cvCompleted;
+} FLAGSPOOL;
+
+const CHILDRUNNER* GetRegExeRunner();
+bool QueryKeyFlags(LPCWSTR lpsKeyRoot, LPCWSTR* lpsSubkeyPaths, DWORD dwKeysCount, DWORD dwJobsCount,
+	const CHILDRUNNER* lpRunner, FLAGSRESULTPROC lpfnResult, void* lpContext);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Platform.h"
+
+// Pattern fits one machine word of bit-parallel algorithm
+const DWORD FUZZY_MAX_PATTERN_LENGTH = 64;
+const DWORD FUZZY_ASCII_COUNT = 128;
+const DWORD FUZZY_FOLD_TABLE_SIZE = 0x10000;
+
+typedef struct _FUZZYPATTERN {
+	DWORD dwLength;
+	ULONGLONG ullAsciiMasks[FUZZY_ASCII_COUNT];
+	DWORD dwOtherCount;
+	WCHAR wcOtherChars[FUZZY_MAX_PATTERN_LENGTH];
+	ULONGLONG ullOtherMasks[FUZZY_MAX_PATTERN_LENGTH];
+} FUZZYPATTERN;
+
+WCHAR FoldChar(WCHAR wcChar);
+bool CompileFuzzyPattern(LPCWSTR lpsPattern, FUZZYPATTERN* lpPattern);
+DWORD GetFuzzyDistance(const FUZZYPATTERN* lpPattern, LPCWSTR lpsText, DWORD dwTextLength, DWORD dwMaxDistance);
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD HISTORY_MAGIC = 0x54534852;			// "RHST"
+const DWORD HISTORY_RECORD_MAGIC = 0x4E534852;	// "RHSN"
+const DWORD HISTORY_VERSION = 1;
+const DWORD HISTORY_MAX_PATH_LENGTH = 32768;
+const DWORD HISTORY_MAX_VALUE_NAME_LENGTH = 16384;
+// Value name buffer starts at common length and grows up to the maximum
+const DWORD HISTORY_VALUE_NAME_LENGTH = 256;
+// Base snapshot is written at least once a day of hourly snapshots
+const DWORD HISTORY_REBASE_INTERVAL = 24;
+// Deltas are replayed until they outgrow base or this size, whichever is larger
+const DWORD HISTORY_MIN_REBASE_SIZE = 64 * 1024;
+
+const DWORD HISTORY_RECORD_BASE = 0;
+const DWORD HISTORY_RECORD_DELTA = 1;
+
+const BYTE HISTORY_OP_KEY_ADDED = 1;
+const BYTE HISTORY_OP_KEY_REMOVED = 2;
+const BYTE HISTORY_OP_VALUE_SET = 3;
+const BYTE HISTORY_OP_VALUE_REMOVED = 4;
+
+// Entry of history.idx, delta without changes has no file
+typedef struct _HISTORYRECORD {
+	ULONGLONG ullTimestamp;
+	DWORD dwSequence;
+	DWORD dwKind;
+	DWORD dwPathsCount;
+	DWORD dwEntriesCount;
+	ULONGLONG cbSize;
+} HISTORYRECORD;
+
+// Record file: header, entries sorted by path id, then changes of every entry
+typedef struct _HISTORYRECORDHEADER {
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD dwKind;
+	DWORD dwEntriesCount;
+} HISTORYRECORDHEADER;
+
+typedef struct _HISTORYENTRY {
+	DWORD dwPathId;
+	DWORD dwOffset;
+	DWORD cbSize;
+} HISTORYENTRY;
+
+typedef struct _HISTORYVALUE {
+	LPWSTR lpsName;
+	DWORD dwType;
+	DWORD cbData;
+	BYTE* lpData;
+} HISTORYVALUE;
+
+typedef struct _HISTORYKEY {
+	HISTORYVALUE* lpValues;
+	DWORD dwValuesCount;
+	DWORD dwValuesCapacity;
+} HISTORYKEY;
+
+// Keys indexed by path id, NULL if key does not exist or is not part of query
+typedef struct _HISTORYSTATE {
+	HISTORYKEY** lpKeys;
+	DWORD dwKeysCount;
+} HISTORYSTATE;
+
+// Interned key paths relative to root of history, id is position
+typedef struct _PATHTABLE {
+	LPWSTR* lpsPaths;
+	DWORD dwCount;
+	DWORD dwCapacity;
+	DWORD* lpdwSlots;
+	DWORD dwSlotsCount;
+	DWORD dwSavedCount;
+} PATHTABLE;
+
+typedef struct _HISTORYSTORE {
+	CHAR lpsDirectory[MAX_PATH];
+	LPWSTR lpsRootPath;
+	PATHTABLE ptPaths;
+	HISTORYRECORD* lpRecords;
+	DWORD dwRecordsCount;
+	DWORD dwRecordsCapacity;
+} HISTORYSTORE;
+
+// Value is NULL for key added and key removed operations
+typedef void (*HISTORYCHANGEPROC)(void* lpContext, DWORD dwPathId, BYTE bOperation, const HISTORYVALUE* lpValue);
+
+bool OpenHistoryStore(LPCSTR lpsDirectory, LPCWSTR lpsRootPath, HISTORYSTORE* lpStore);
+void CloseHistoryStore(HISTORYSTORE* lpStore);
+bool TakeHistorySnapshot(HISTORYSTORE* lpStore, HKEY hKey, ULONGLONG ullTimestamp, HISTORYRECORD* lpRecord);
+const HISTORYRECORD* FindHistoryRecord(const HISTORYSTORE* lpStore, ULONGLONG ullTimestamp);
+bool ReconstructHistory(const HISTORYSTORE* lpStore, const HISTORYRECORD* lpRecord, LPCWSTR lpsSubkeyPath, HISTORYSTATE* lpState);
+void FreeHistoryState(HISTORYSTATE* lpState);
+bool CaptureHistoryState(PATHTABLE* lpPaths, HKEY hKey, HISTORYSTATE* lpState);
+void CompareHistoryStates(const HISTORYSTATE* lpPrevious, const HISTORYSTATE* lpCurrent, HISTORYCHANGEPROC lpfnChange, void* lpContext);
+bool WatchHistoryChanges(HKEY hKey, DWORD dwRounds, PATHTABLE* lpPaths, HISTORYCHANGEPROC lpfnChange, void* lpContext);
+void FreePathTable(PATHTABLE* lpPaths);
+LPCWSTR GetHistoryPath(const HISTORYSTORE* lpStore, DWORD dwPathId);
+bool ParseHistoryTime(LPCSTR lpsTime, ULONGLONG* lpullTimestamp);
+void FormatHistoryTime(ULONGLONG ullTimestamp, LPSTR lpsTime, DWORD cchTime);
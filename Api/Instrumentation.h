@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+
+// Define REGISTRY_EDITOR_STATS in project settings to compile instrumentation in
+// (Debug configurations only, Release builds keep registry calls untimed)
+
+typedef enum _REGSTATCALL {
+	STAT_OPEN_KEY,
+	STAT_CLOSE_KEY,
+	STAT_ENUM_KEY,
+	STAT_ENUM_VALUE,
+	STAT_QUERY_INFO_KEY,
+	STAT_QUERY_VALUE,
+	STAT_CALLS_COUNT
+} REGSTATCALL;
+
+const DWORD STAT_HISTOGRAM_BUCKETS = 32;
+
+typedef struct _REGSTATS {
+	ULONGLONG ullCallsCount[STAT_CALLS_COUNT];
+	ULONGLONG ullCallsTime[STAT_CALLS_COUNT];
+	ULONGLONG ullCallsHistogram[STAT_CALLS_COUNT][STAT_HISTOGRAM_BUCKETS];
+	ULONGLONG ullAllocations;
+	ULONGLONG ullBytesAllocated;
+	ULONGLONG ullKeysVisited;
+	ULONGLONG ullOutputBytes;
+	DWORD dwMaxDepth;
+	DWORD dwCurrentDepth;
+} REGSTATS;
+
+#ifdef REGISTRY_EDITOR_STATS
+
+void EnableStats(bool bEnabled);
+bool IsStatsEnabled();
+REGSTATS* GetThreadStats();
+ULONGLONG BeginStatCall();
+void EndStatCall(REGSTATCALL rscCall, ULONGLONG ullStart);
+void CollectStats(REGSTATS* lpTotal);
+void PrintStats(FILE* lpOutput, bool bJson);
+
+#define STAT_CALL_BEGIN() ULONGLONG ullStatCallStart = BeginStatCall()
+#define STAT_CALL_END(rscCall) EndStatCall(rscCall, ullStatCallStart)
+#define STAT_ADD(field, value) (GetThreadStats()->field += (value))
+#define STAT_ALLOC(cbSize) (GetThreadStats()->ullAllocations++, GetThreadStats()->ullBytesAllocated += (cbSize))
+#define STAT_ENTER_LEVEL() \
+	do { \
+		REGSTATS* lpStatLevel = GetThreadStats(); \
+		if (++lpStatLevel->dwCurrentDepth > lpStatLevel->dwMaxDepth) lpStatLevel->dwMaxDepth = lpStatLevel->dwCurrentDepth; \
+	} while (0)
+#define STAT_LEAVE_LEVEL() (GetThreadStats()->dwCurrentDepth--)
+
+#else
+
+#define STAT_CALL_BEGIN() ((void)0)
+#define STAT_CALL_END(rscCall) ((void)0)
+#define STAT_ADD(field, value) ((void)0)
+#define STAT_ALLOC(cbSize) ((void)0)
+#define STAT_ENTER_LEVEL() ((void)0)
+#define STAT_LEAVE_LEVEL() ((void)0)
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Platform.h"
+
+// One wait slot is taken by wake event of watcher thread
+const DWORD KEY_CACHE_MAX_KEYS = MAXIMUM_WAIT_OBJECTS - 1;
+const DWORD KEY_CACHE_BUCKETS_COUNT = 1024;
+const DWORD KEY_CACHE_MAX_LISTS = 65536;
+
+typedef struct _ENUMCACHEENTRY {
+	LPWSTR lpsKeyPath;
+	DWORD dwHash;
+	LPWSTR* lpsNames;
+	DWORD dwNamesCount;
+	struct _ENUMCACHEENTRY* lpNext;
+} ENUMCACHEENTRY;
+
+typedef struct _CACHEDKEY {
+	HKEY hKeyRoot;
+	LPWSTR lpsKeyPath;
+	HKEY hKey;
+	HANDLE hChangeEvent;
+	bool bWatched;
+	DWORD dwGeneration;
+	DWORD dwListsCount;
+	ENUMCACHEENTRY** lpBuckets;
+} CACHEDKEY;
+
+bool EnableKeyCache();
+void DisableKeyCache();
+bool IsKeyCacheEnabled();
+bool OpenCachedRegKey(HKEY hKeyRoot, LPCWSTR lpsKeyPath, PHKEY phkResult);
+bool CloseCachedRegKey(HKEY hKey);
+LPWSTR* LookupEnumCache(HKEY hKey, LPCWSTR lpsKeyPath, DWORD* lpdwNamesCount, DWORD* lpdwGeneration);
+void StoreEnumCache(HKEY hKey, LPCWSTR lpsKeyPath, LPWSTR* lpsNames, DWORD dwNamesCount, DWORD dwGeneration);
+void InvalidateKeyCache(HKEY hKeyRoot, LPCWSTR lpsKeyPath);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD OUTPUT_BUFFER_INITIAL_SIZE = 4096;
+// Stdout text is collected and written once this size is reached
+const DWORD OUTPUT_FLUSH_SIZE = 65536;
+// Formatted lines up to this length do not allocate
+const DWORD OUTPUT_INLINE_TEXT_LENGTH = 512;
+
+const DWORD OUTPUT_FORMAT_TEXT = 0;
+const DWORD OUTPUT_FORMAT_NDJSON = 1;
+const DWORD OUTPUT_FORMAT_CSV = 2;
+
+typedef struct _OUTPUTBUFFER {
+	LPSTR lpsData;
+	DWORD cbSize;
+	DWORD cbCapacity;
+} OUTPUTBUFFER;
+
+// Field of structured record, text is given either as wide string or as UTF-8 string
+typedef struct _OUTPUTFIELD {
+	LPCSTR lpsName;
+	LPCWSTR lpsText;
+	LPCSTR lpsUtf8Text;
+} OUTPUTFIELD;
+
+void SetThreadOutput(OUTPUTBUFFER* lpBuffer);
+bool AppendOutput(OUTPUTBUFFER* lpBuffer, LPCSTR lpsData, DWORD cbData);
+void FreeOutputBuffer(OUTPUTBUFFER* lpBuffer);
+int OutputPrintf(LPCSTR lpsFormat, ...);
+int OutputWPrintf(LPCWSTR lpsFormat, ...);
+bool ParseOutputFormat(LPCSTR lpsFormatName, DWORD* lpdwFormat);
+void SetOutputFormat(DWORD dwFormat);
+DWORD GetOutputFormat();
+void BeginOutputRecords();
+int OutputRecord(const OUTPUTFIELD* lpFields, DWORD dwFieldsCount);
+bool FlushOutput();
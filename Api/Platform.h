@@ -0,0 +1,381 @@
+#pragma once
+
+// Windows builds use Windows headers as they are. Other platforms get the part of Windows API
+// used by modules that do not need Windows: types, synchronization, threads, time and files
+// are implemented with POSIX, registry and child processes fail with ERROR_NOT_SUPPORTED.
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <wchar.h>
+#include <pthread.h>
+
+#define WINAPI
+#define CALLBACK
+#define VOID void
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+typedef int LONG;
+typedef unsigned int ULONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef long long LONG64;
+typedef unsigned long long ULONG64;
+typedef unsigned long long DWORD64;
+typedef wchar_t WCHAR;
+typedef char CHAR;
+typedef CHAR* LPSTR;
+typedef const CHAR* LPCSTR;
+typedef WCHAR* LPWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef BYTE* LPBYTE;
+typedef DWORD* LPDWORD;
+typedef LONG* PLONG;
+typedef size_t SIZE_T;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef ULONG_PTR DWORD_PTR;
+typedef LONG LSTATUS;
+typedef LONG_PTR LRESULT;
+typedef ULONG REGSAM;
+typedef void* HANDLE;
+typedef HANDLE HLOCAL;
+typedef struct HKEY__* HKEY;
+typedef HKEY* PHKEY;
+
+typedef struct _FILETIME {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef union _LARGE_INTEGER {
+	struct {
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef union _ULARGE_INTEGER {
+	struct {
+		DWORD LowPart;
+		DWORD HighPart;
+	};
+	ULONGLONG QuadPart;
+} ULARGE_INTEGER;
+
+typedef struct _SECURITY_ATTRIBUTES {
+	DWORD nLength;
+	LPVOID lpSecurityDescriptor;
+	BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+typedef struct _STARTUPINFOW {
+	DWORD cb;
+	LPWSTR lpReserved;
+	LPWSTR lpDesktop;
+	LPWSTR lpTitle;
+	DWORD dwX;
+	DWORD dwY;
+	DWORD dwXSize;
+	DWORD dwYSize;
+	DWORD dwXCountChars;
+	DWORD dwYCountChars;
+	DWORD dwFillAttribute;
+	DWORD dwFlags;
+	WORD wShowWindow;
+	WORD cbReserved2;
+	LPBYTE lpReserved2;
+	HANDLE hStdInput;
+	HANDLE hStdOutput;
+	HANDLE hStdError;
+} STARTUPINFO;
+
+typedef struct _PROCESS_INFORMATION {
+	HANDLE hProcess;
+	HANDLE hThread;
+	DWORD dwProcessId;
+	DWORD dwThreadId;
+} PROCESS_INFORMATION;
+
+typedef struct _SYSTEM_INFO {
+	DWORD dwPageSize;
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+typedef struct _PROCESS_MEMORY_COUNTERS {
+	DWORD cb;
+	SIZE_T PeakWorkingSetSize;
+	SIZE_T WorkingSetSize;
+} PROCESS_MEMORY_COUNTERS;
+
+typedef pthread_rwlock_t SRWLOCK, *PSRWLOCK;
+#define SRWLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+
+typedef struct _CONDITION_VARIABLE {
+	pthread_mutex_t mtxWait;
+	pthread_cond_t cndWait;
+} CONDITION_VARIABLE, *PCONDITION_VARIABLE;
+#define CONDITION_VARIABLE_INIT { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER }
+#define CONDITION_VARIABLE_LOCKMODE_SHARED 0x1
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID lpParameter);
+
+#define TRUE 1
+#define FALSE 0
+#define MAXDWORD 0xFFFFFFFF
+#define MAXWORD 0xFFFF
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFF
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+
+#define HKEY_CLASSES_ROOT ((HKEY)(ULONG_PTR)0x80000000)
+#define HKEY_CURRENT_USER ((HKEY)(ULONG_PTR)0x80000001)
+#define HKEY_LOCAL_MACHINE ((HKEY)(ULONG_PTR)0x80000002)
+#define HKEY_USERS ((HKEY)(ULONG_PTR)0x80000003)
+#define HKEY_CURRENT_CONFIG ((HKEY)(ULONG_PTR)0x80000005)
+
+#define REG_NONE 0
+#define REG_SZ 1
+#define REG_EXPAND_SZ 2
+#define REG_BINARY 3
+#define REG_DWORD 4
+#define REG_DWORD_LITTLE_ENDIAN 4
+#define REG_DWORD_BIG_ENDIAN 5
+#define REG_LINK 6
+#define REG_MULTI_SZ 7
+#define REG_RESOURCE_LIST 8
+#define REG_FULL_RESOURCE_DESCRIPTOR 9
+#define REG_RESOURCE_REQUIREMENTS_LIST 10
+#define REG_QWORD 11
+#define REG_QWORD_LITTLE_ENDIAN 11
+
+#define KEY_QUERY_VALUE 0x0001
+#define KEY_SET_VALUE 0x0002
+#define KEY_CREATE_SUB_KEY 0x0004
+#define KEY_ENUMERATE_SUB_KEYS 0x0008
+#define KEY_NOTIFY 0x0010
+#define KEY_READ 0x20019
+#define KEY_WRITE 0x20006
+#define KEY_ALL_ACCESS 0xF003F
+#define REG_OPTION_NON_VOLATILE 0
+#define REG_CREATED_NEW_KEY 1
+#define REG_OPENED_EXISTING_KEY 2
+#define REG_NOTIFY_CHANGE_NAME 0x1
+#define REG_NOTIFY_CHANGE_ATTRIBUTES 0x2
+#define REG_NOTIFY_CHANGE_LAST_SET 0x4
+#define REG_NOTIFY_CHANGE_SECURITY 0x8
+#define REG_NOTIFY_THREAD_AGNOSTIC 0x10000000
+
+#define ERROR_SUCCESS 0
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_INVALID_DATA 13
+#define ERROR_NOT_SUPPORTED 50
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_ALREADY_EXISTS 183
+#define ERROR_MORE_DATA 234
+#define ERROR_NO_MORE_ITEMS 259
+#define ERROR_TIMEOUT 1460
+
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xFFFFFFFF
+#define MAXIMUM_WAIT_OBJECTS 64
+
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 0x1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x4
+#define MOVEFILE_REPLACE_EXISTING 0x1
+#define HANDLE_FLAG_INHERIT 0x1
+#define STARTF_USESTDHANDLES 0x100
+#define CREATE_NO_WINDOW 0x08000000
+
+#define CP_ACP 0
+#define CP_UTF8 65001
+#define MB_ERR_INVALID_CHARS 0x8
+
+#define THREAD_PRIORITY_LOWEST -2
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_MODE_BACKGROUND_BEGIN 0x10000
+#define THREAD_MODE_BACKGROUND_END 0x20000
+
+#define _TRUNCATE ((size_t)-1)
+
+#define ZeroMemory(lpDestination, cbLength) memset((lpDestination), 0, (cbLength))
+#define CopyMemory(lpDestination, lpSource, cbLength) memcpy((lpDestination), (lpSource), (cbLength))
+#define MemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define _strdup strdup
+#define _wcsdup wcsdup
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+#define _wcsicmp wcscasecmp
+#define _wcsnicmp wcsncasecmp
+#define _strtoui64 strtoull
+#define strtok_s strtok_r
+#define wcstok_s wcstok
+#define lstrlen(lpsText) ((int)wcslen(lpsText))
+#define lstrlenW(lpsText) ((int)wcslen(lpsText))
+#define lstrcmp wcscmp
+#define lstrcmpi wcscasecmp
+#define sscanf_s sscanf
+
+// Interlocked functions are full barriers as on Windows
+inline LONG InterlockedIncrement(LONG volatile* lpAddend) { return __atomic_add_fetch(lpAddend, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(LONG volatile* lpAddend) { return __atomic_sub_fetch(lpAddend, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(LONG volatile* lpTarget, LONG lValue) { return __atomic_exchange_n(lpTarget, lValue, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(LONG volatile* lpAddend, LONG lValue) { return __atomic_fetch_add(lpAddend, lValue, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedCompareExchange(LONG volatile* lpDestination, LONG lExchange, LONG lComparand)
+{
+	__atomic_compare_exchange_n(lpDestination, &lComparand, lExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return lComparand;
+}
+inline LONG64 InterlockedIncrement64(LONG64 volatile* lpAddend) { return __atomic_add_fetch(lpAddend, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedDecrement64(LONG64 volatile* lpAddend) { return __atomic_sub_fetch(lpAddend, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchange64(LONG64 volatile* lpTarget, LONG64 llValue) { return __atomic_exchange_n(lpTarget, llValue, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchangeAdd64(LONG64 volatile* lpAddend, LONG64 llValue) { return __atomic_fetch_add(lpAddend, llValue, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedCompareExchange64(LONG64 volatile* lpDestination, LONG64 llExchange, LONG64 llComparand)
+{
+	__atomic_compare_exchange_n(lpDestination, &llComparand, llExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return llComparand;
+}
+inline PVOID InterlockedExchangePointer(PVOID volatile* lpTarget, PVOID lpValue) { return __atomic_exchange_n(lpTarget, lpValue, __ATOMIC_SEQ_CST); }
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile* lpDestination, PVOID lpExchange, PVOID lpComparand)
+{
+	__atomic_compare_exchange_n(lpDestination, &lpComparand, lpExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return lpComparand;
+}
+
+inline unsigned char _BitScanForward(unsigned long* lpdwIndex, unsigned long dwMask)
+{
+	if (dwMask == 0)
+	{
+		return 0;
+	}
+
+	*lpdwIndex = (unsigned long)__builtin_ctzl(dwMask);
+	return 1;
+}
+
+inline unsigned char _BitScanReverse(unsigned long* lpdwIndex, unsigned long dwMask)
+{
+	if (dwMask == 0)
+	{
+		return 0;
+	}
+
+	*lpdwIndex = (unsigned long)(sizeof(unsigned long) * 8 - 1 - __builtin_clzl(dwMask));
+	return 1;
+}
+
+inline void YieldProcessor()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// Secure CRT functions with MSVC argument order, errors are reported by result as there
+int strcpy_s(char* lpsDestination, size_t cchDestination, const char* lpsSource);
+int wcscpy_s(wchar_t* lpsDestination, size_t cchDestination, const wchar_t* lpsSource);
+int wcscat_s(wchar_t* lpsDestination, size_t cchDestination, const wchar_t* lpsSource);
+int sprintf_s(char* lpsDestination, size_t cchDestination, const char* lpsFormat, ...);
+int _snprintf_s(char* lpsDestination, size_t cchDestination, size_t cchCount, const char* lpsFormat, ...);
+int vsprintf_s(char* lpsDestination, size_t cchDestination, const char* lpsFormat, va_list vlArguments);
+int vswprintf_s(wchar_t* lpsDestination, size_t cchDestination, const wchar_t* lpsFormat, va_list vlArguments);
+int _vscprintf(const char* lpsFormat, va_list vlArguments);
+int _vscwprintf(const wchar_t* lpsFormat, va_list vlArguments);
+int fopen_s(FILE** lplpFile, const char* lpsFileName, const char* lpsMode);
+int _wfopen_s(FILE** lplpFile, const wchar_t* lpsFileName, const wchar_t* lpsMode);
+
+BOOL CloseHandle(HANDLE hObject);
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpAttributes, SIZE_T cbStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpdwThreadId);
+HANDLE CreateEvent(LPSECURITY_ATTRIBUTES lpAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpsName);
+BOOL SetEvent(HANDLE hEvent);
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+DWORD WaitForMultipleObjects(DWORD dwCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds);
+HANDLE GetCurrentThread();
+HANDLE GetCurrentProcess();
+DWORD GetCurrentThreadId();
+DWORD GetCurrentProcessId();
+BOOL SetThreadPriority(HANDLE hThread, int iPriority);
+void Sleep(DWORD dwMilliseconds);
+BOOL SwitchToThread();
+
+void InitializeSRWLock(PSRWLOCK lpLock);
+void AcquireSRWLockExclusive(PSRWLOCK lpLock);
+void ReleaseSRWLockExclusive(PSRWLOCK lpLock);
+void AcquireSRWLockShared(PSRWLOCK lpLock);
+void ReleaseSRWLockShared(PSRWLOCK lpLock);
+void InitializeConditionVariable(PCONDITION_VARIABLE lpCondition);
+BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE lpCondition, PSRWLOCK lpLock, DWORD dwMilliseconds, ULONG ulFlags);
+void WakeAllConditionVariable(PCONDITION_VARIABLE lpCondition);
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* lpCounter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* lpFrequency);
+ULONGLONG GetTickCount64();
+LONG CompareFileTime(const FILETIME* lpFirst, const FILETIME* lpSecond);
+BOOL GetProcessTimes(HANDLE hProcess, LPFILETIME lpCreationTime, LPFILETIME lpExitTime, LPFILETIME lpKernelTime, LPFILETIME lpUserTime);
+void GetSystemInfo(LPSYSTEM_INFO lpSystemInfo);
+BOOL GetProcessMemoryInfo(HANDLE hProcess, PROCESS_MEMORY_COUNTERS* lpCounters, DWORD cbCounters);
+
+HANDLE CreateFileA(LPCSTR lpsFileName, DWORD dwAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpAttributes, DWORD dwDisposition, DWORD dwFlags, HANDLE hTemplate);
+BOOL GetFileSizeEx(HANDLE hFile, LARGE_INTEGER* lpFileSize);
+HANDLE CreateFileMapping(HANDLE hFile, LPSECURITY_ATTRIBUTES lpAttributes, DWORD dwProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpsName);
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwAccess, DWORD dwOffsetHigh, DWORD dwOffsetLow, SIZE_T cbSize);
+BOOL UnmapViewOfFile(LPCVOID lpBase);
+BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD cbToRead, LPDWORD lpcbRead, void* lpOverlapped);
+BOOL DeleteFile(LPCWSTR lpsFileName);
+BOOL DeleteFileA(LPCSTR lpsFileName);
+BOOL MoveFileExA(LPCSTR lpsExistingFileName, LPCSTR lpsNewFileName, DWORD dwFlags);
+DWORD GetTempPath(DWORD cchBuffer, LPWSTR lpsBuffer);
+DWORD GetTempPathA(DWORD cchBuffer, LPSTR lpsBuffer);
+unsigned int GetTempFileName(LPCWSTR lpsPath, LPCWSTR lpsPrefix, unsigned int uUnique, LPWSTR lpsTempFileName);
+unsigned int GetTempFileNameA(LPCSTR lpsPath, LPCSTR lpsPrefix, unsigned int uUnique, LPSTR lpsTempFileName);
+
+int MultiByteToWideChar(unsigned int uCodePage, DWORD dwFlags, LPCSTR lpsSource, int cbSource, LPWSTR lpsDestination, int cchDestination);
+int WideCharToMultiByte(unsigned int uCodePage, DWORD dwFlags, LPCWSTR lpsSource, int cchSource, LPSTR lpsDestination, int cbDestination, LPCSTR lpsDefaultChar, BOOL* lpbUsedDefaultChar);
+DWORD CharLowerBuffW(LPWSTR lpsText, DWORD cchText);
+#define CharLowerBuff CharLowerBuffW
+
+// There is no registry and no reg.exe, Windows registry backend and child processes fail with ERROR_NOT_SUPPORTED
+LSTATUS RegOpenKeyEx(HKEY hKey, LPCWSTR lpSubKey, DWORD dwOptions, REGSAM samDesired, PHKEY phkResult);
+LSTATUS RegCreateKeyEx(HKEY hKey, LPCWSTR lpSubKey, DWORD dwReserved, LPWSTR lpClass, DWORD dwOptions, REGSAM samDesired, LPSECURITY_ATTRIBUTES lpAttributes, PHKEY phkResult, LPDWORD lpdwDisposition);
+LSTATUS RegCloseKey(HKEY hKey);
+LSTATUS RegEnumKeyEx(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, LPDWORD lpReserved, LPWSTR lpClass, LPDWORD lpcchClass, PFILETIME lpftLastWriteTime);
+LSTATUS RegEnumValue(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpReserved, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData);
+LSTATUS RegQueryInfoKey(HKEY hKey, LPWSTR lpClass, LPDWORD lpcchClass, LPDWORD lpReserved, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcMaxClassLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, LPDWORD lpcbSecurityDescriptor, PFILETIME lpftLastWriteTime);
+LSTATUS RegQueryValueEx(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpReserved, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData);
+LSTATUS RegSetKeyValue(HKEY hKey, LPCWSTR lpSubKey, LPCWSTR lpValueName, DWORD dwType, LPCVOID lpData, DWORD cbData);
+LSTATUS RegNotifyChangeKeyValue(HKEY hKey, BOOL bWatchSubtree, DWORD dwNotifyFilter, HANDLE hEvent, BOOL bAsynchronous);
+BOOL CreatePipe(HANDLE* lphReadPipe, HANDLE* lphWritePipe, LPSECURITY_ATTRIBUTES lpAttributes, DWORD cbSize);
+BOOL SetHandleInformation(HANDLE hObject, DWORD dwMask, DWORD dwFlags);
+BOOL CreateProcess(LPCWSTR lpsApplicationName, LPWSTR lpsCommandLine, LPSECURITY_ATTRIBUTES lpProcessAttributes, LPSECURITY_ATTRIBUTES lpThreadAttributes, BOOL bInheritHandles, DWORD dwCreationFlags, LPVOID lpEnvironment, LPCWSTR lpsCurrentDirectory, STARTUPINFO* lpStartupInfo, PROCESS_INFORMATION* lpProcessInformation);
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+
+const DWORD PROGRESS_DEFAULT_INTERVAL = 1000;
+// Random descents shared by top-level branches in proportion to their subkeys
+const DWORD PROGRESS_DEFAULT_SAMPLES_COUNT = 256;
+const DWORD PROGRESS_MAX_SAMPLE_DEPTH = 512;
+// Visited keys are published to reporter in batches
+const DWORD PROGRESS_BATCH_SIZE = 64;
+const ULONGLONG PROGRESS_SAMPLE_SEED = 0x9E3779B97F4A7C15;
+
+typedef struct _PROGRESSPARAMS {
+	DWORD dwInterval;
+	DWORD dwSamplesCount;
+	FILE* lpOutput;
+	LPCSTR lpsStatusFileName;
+} PROGRESSPARAMS;
+
+// Walk size estimated by reporter while walk goes on and refined when top-level branches are done
+typedef struct _PROGRESSESTIMATE {
+	ULONGLONG ullRootKeysCount;
+	double* lpdBranchKeys;
+	DWORD dwBranchesCount;
+	double dTotalBranchKeys;
+} PROGRESSESTIMATE;
+
+void GetDefaultProgressParams(PROGRESSPARAMS* lpParams);
+bool EstimateWalkSize(HKEY hKey, DWORD dwSamplesCount, PROGRESSESTIMATE* lpEstimate);
+ULONGLONG RefineWalkSize(const PROGRESSESTIMATE* lpEstimate, ULONGLONG ullVisitedKeys, ULONGLONG ullCompletedKeys, double dCompletedEstimate);
+void FreeProgressEstimate(PROGRESSESTIMATE* lpEstimate);
+bool EnableProgress(const PROGRESSPARAMS* lpParams);
+void DisableProgress();
+void BeginProgressWalk(HKEY hKey);
+void BeginProgressBranch(DWORD dwBranchIndex);
+void EndProgressBranch();
+void AdvanceProgress(DWORD dwKeysCount);
+void FlushProgress();
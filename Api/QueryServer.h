@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Platform.h"
+
+#include "Output.h"
+
+const DWORD QUERY_PIPE_BUFFER_SIZE = 65536;
+const DWORD QUERY_MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+const DWORD QUERY_MAX_ARGUMENTS = 64;
+const DWORD QUERY_MAX_RESULT_LENGTH = 256;
+const DWORD QUERY_CONNECT_TIMEOUT = 5000;
+const char QUERY_TOO_MANY_ARGUMENTS[] = "Too many arguments!";
+
+typedef LPCSTR (*QUERYPROC)(char** argv, int argc);
+
+typedef struct _QUERYCONNECTION {
+	HANDLE hPipe;
+	QUERYPROC lpfnProcess;
+} QUERYCONNECTION;
+
+// Server accepting clients on background thread until it is stopped
+typedef struct _QUERYSERVER {
+	WCHAR lpsPipeName[MAX_PATH];
+	QUERYPROC lpfnProcess;
+	HANDLE hFirstPipe;
+	HANDLE hThread;
+	volatile bool bStopping;
+} QUERYSERVER;
+
+bool RunQueryServer(LPCSTR lpsName, QUERYPROC lpfnProcess);
+bool StartQueryServer(LPCSTR lpsName, QUERYPROC lpfnProcess, QUERYSERVER* lpServer);
+void StopQueryServer(QUERYSERVER* lpServer);
+bool SendQuery(LPCSTR lpsName, char** argv, int argc, OUTPUTBUFFER* lpOutput, LPSTR lpsResult, DWORD cchResult);
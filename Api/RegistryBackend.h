@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Platform.h"
+
+typedef LSTATUS (*OPENKEYPROC)(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult);
+typedef LSTATUS (*CLOSEKEYPROC)(HKEY hKey);
+typedef LSTATUS (*ENUMKEYPROC)(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, PFILETIME lpftLastWriteTime);
+typedef LSTATUS (*ENUMVALUEPROC)(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData);
+typedef LSTATUS (*QUERYINFOKEYPROC)(HKEY hKey, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, PFILETIME lpftLastWriteTime);
+typedef LSTATUS (*QUERYVALUEPROC)(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData);
+
+typedef struct _REGBACKEND {
+	LPCSTR lpsName;
+	OPENKEYPROC lpfnOpenKey;
+	CLOSEKEYPROC lpfnCloseKey;
+	ENUMKEYPROC lpfnEnumKey;
+	ENUMVALUEPROC lpfnEnumValue;
+	QUERYINFOKEYPROC lpfnQueryInfoKey;
+	QUERYVALUEPROC lpfnQueryValue;
+} REGBACKEND;
+
+const REGBACKEND* GetWin32Backend();
+const REGBACKEND* GetRegBackend();
+void SetRegBackend(const REGBACKEND* lpBackend);
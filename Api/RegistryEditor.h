@@ -1,26 +1,40 @@
 #pragma once
 
-#include <windows.h>
+#include "Platform.h"
 #include <iostream>
 
 const DWORD MAX_KEY_NAME_LENGTH = 4096;
 const DWORD KEY_FLAGS_COUNT = 3;
+const DWORD MAX_KEY_PATH_LENGTH = 32768;
 
 typedef struct _KEYFLAG {
 	LPSTR lpsFlagName;
 	LPSTR lpsFlagValue;
 } KEYFLAG;
 
+// Called for every key of walked subtree, false stops walk
+typedef bool (*KEYVISITPROC)(void* lpContext, LPCWSTR lpsKeyPath, DWORD cchKeyPath);
+
 bool OpenRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult);
+LRESULT OpenRegKeyStatus(HKEY hKeyRoot, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult);
 bool CreateRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey);
 bool CloseRegKey(HKEY hKey);
+LRESULT EnumRegKey(HKEY hKey, DWORD dwIndex, LPWSTR lpsSubKeyName, DWORD* lpdwNameSize, PFILETIME lpftLastWriteTime);
+LRESULT EnumRegValue(HKEY hKey, DWORD dwIndex, LPWSTR lpsValueName, DWORD* lpdwNameSize, DWORD* lpdwType, BYTE* lpData, DWORD* lpcbData);
+bool QueryRegKeyInfo(HKEY hKey, DWORD* lpdwSubKeysCount, DWORD* lpdwValuesCount, DWORD* lpcbMaxValueSize, PFILETIME lpftLastWriteTime);
+bool QueryRegValue(HKEY hKey, LPCWSTR lpsValueName, DWORD* lpdwType, BYTE* lpData, DWORD* lpcbData);
 bool SetRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, LPCWSTR lpParamName, DWORD dwParamType, LPCVOID lpData, DWORD cbData);
 bool GetRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, LPCWSTR lpParamName, DWORD* dwParamType, BYTE* lpData, DWORD* cbData);
 LPWSTR* AddElementsToLPWSTRArray(LPWSTR* lpsSourceArray, DWORD dwSourceArrayCount, LPWSTR* lpsAdditionArray, DWORD dwAdditionArrayCount);
 LPWSTR CreateFullName(LPWSTR lpsKeyPath, LPWSTR lpsSubKeyName);
 LPWSTR* SearchOneLevel(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultSize);
+LPWSTR* SearchRecursive(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultCount);
 LPWSTR* SearchKeyInList(LPWSTR* lpsKeyNamesList, DWORD dwKeyNamesCount, LPWSTR lpsSearchedKey, DWORD* lpdwFoundKeysCount);
 LPWSTR* SearchKey(HKEY hKey, LPCWSTR lpsSearchedKey, DWORD* lpdwFoundKeysCount);
+bool IsSearchedKey(LPCWSTR lpsKeyPath, LPCWSTR lpsSearchedKey, DWORD dwSearchedKeyLength);
+bool WalkKeys(HKEY hKey, KEYVISITPROC lpfnVisit, void* lpContext);
+LPWSTR* SearchKeyFuzzyInList(LPWSTR* lpsKeyNamesList, DWORD dwKeyNamesCount, LPCWSTR lpsPattern, DWORD dwMaxDistance, DWORD* lpdwFoundKeysCount, DWORD** lpdwDistances);
+LPWSTR* SearchKeyFuzzy(HKEY hKey, LPCWSTR lpsPattern, DWORD dwMaxDistance, DWORD* lpdwFoundKeysCount, DWORD** lpdwDistances);
 LPSTR ExecuteRegExe(WCHAR* lpsCommand);
 KEYFLAG* GetInitializedFlags(DWORD* dwFlagsCount);
 bool ParseRegExeOutput(LPSTR lpsCommandOutput, KEYFLAG* kfFlags, DWORD dwKeyCount);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Platform.h"
+
+#include "RegistryBackend.h"
+#include "ReplayTrace.h"
+
+bool StartRegRecording(LPCSTR lpsFileName);
+bool StopRegRecording();
+bool LoadRegReplay(LPCSTR lpsFileName, bool bReplayLatency);
+const REGBACKEND* GetReplayBackend();
+LPCWSTR GetReplayRootName(HKEY hKey);
+HKEY GetReplayUnknownRoot();
+ULONGLONG GetReplayMissesCount();
+void FreeRegReplay();
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Platform.h"
+
+// Trace file is header followed by records, numbers are LEB128 varints, strings are UTF-8 size and bytes.
+// Key record defines next key id as path relative to parent key (root keys have no parent),
+// call records reference key ids and carry status, returned results and latency in 100 ns units.
+// Data of string values is UTF-16LE whatever wchar_t size of recording platform is.
+const DWORD REPLAY_MAGIC = 0x31505252;
+const DWORD REPLAY_VERSION = 1;
+const DWORD REPLAY_NO_KEY = MAXDWORD;
+const DWORD REPLAY_FLUSH_SIZE = 65536;
+const DWORD REPLAY_MAX_INDEX = 1 << 24;
+const DWORD REPLAY_MAX_NUMBER_SIZE = 10;
+// Subkeys, longest subkey name, values, longest value name and largest value data
+const DWORD REPLAY_KEY_COUNTERS_COUNT = 5;
+const WCHAR REPLAY_UNKNOWN_ROOT_NAME[] = L"?";
+
+const BYTE REPLAY_RECORD_KEY = 1;
+const BYTE REPLAY_RECORD_OPEN = 2;
+const BYTE REPLAY_RECORD_ENUM_KEY = 3;
+const BYTE REPLAY_RECORD_ENUM_VALUE = 4;
+const BYTE REPLAY_RECORD_QUERY_INFO = 5;
+const BYTE REPLAY_RECORD_QUERY_VALUE = 6;
+
+// Outputs present in value record, caller may have asked only for some of them
+const BYTE REPLAY_HAS_NAME = 1;
+const BYTE REPLAY_HAS_TYPE = 2;
+const BYTE REPLAY_HAS_SIZE = 4;
+const BYTE REPLAY_HAS_DATA = 8;
+
+// Statuses are Win32 error codes of recorded calls, these two decide which outputs follow
+const LONG REPLAY_STATUS_SUCCESS = 0;
+const LONG REPLAY_STATUS_MORE_DATA = 234;
+
+// Latencies and last write times are stored in 100 ns units like FILETIME
+const ULONGLONG REPLAY_UNITS_PER_SECOND = 10000000;
+const ULONGLONG REPLAY_UNITS_PER_MICROSECOND = 10;
+
+typedef struct _REPLAYSUBKEY {
+	bool bRecorded;
+	LONG lStatus;
+	LPWSTR lpsName;
+	DWORD cchName;
+	ULONGLONG ullLastWriteTime;
+	ULONGLONG ullLatency;
+} REPLAYSUBKEY;
+
+typedef struct _REPLAYVALUE {
+	bool bRecorded;
+	LONG lStatus;
+	BYTE bFlags;
+	LPWSTR lpsName;
+	DWORD cchName;
+	DWORD dwType;
+	DWORD cbData;
+	BYTE* lpData;
+	ULONGLONG ullLatency;
+} REPLAYVALUE;
+
+typedef struct _REPLAYKEY {
+	DWORD dwParent;
+	LPWSTR lpsPath;
+	bool bOpened;
+	LONG lOpenStatus;
+	ULONGLONG ullOpenLatency;
+	bool bInfo;
+	LONG lInfoStatus;
+	DWORD dwSubKeysCount;
+	DWORD dwMaxSubKeyLength;
+	DWORD dwValuesCount;
+	DWORD dwMaxValueNameLength;
+	DWORD cbMaxValueSize;
+	ULONGLONG ullLastWriteTime;
+	ULONGLONG ullInfoLatency;
+	REPLAYSUBKEY* lpSubKeys;
+	DWORD dwSubKeysCapacity;
+	REPLAYVALUE* lpValues;
+	DWORD dwValuesCapacity;
+	REPLAYVALUE* lpQueriedValues;
+	DWORD dwQueriedCount;
+	DWORD dwQueriedCapacity;
+} REPLAYKEY;
+
+// Key ids by parent id and relative path (case insensitive), open addressing
+typedef struct _REPLAYPATHS {
+	REPLAYKEY* lpKeys;
+	DWORD dwKeysCount;
+	DWORD dwKeysCapacity;
+	DWORD* lpdwSlots;
+	DWORD dwSlotsCount;
+} REPLAYPATHS;
+
+DWORD FindReplayPath(const REPLAYPATHS* lpPaths, DWORD dwParent, LPCWSTR lpsPath);
+DWORD AddReplayPath(REPLAYPATHS* lpPaths, DWORD dwParent, LPCWSTR lpsPath);
+void FreeReplayPaths(REPLAYPATHS* lpPaths);
+const REPLAYVALUE* FindReplayQueriedValue(const REPLAYKEY* lpKey, LPCWSTR lpsName);
+bool IsReplayStringType(DWORD dwType);
+BYTE* NarrowReplayData(const BYTE* lpData, DWORD cbData, DWORD* lpcbNarrowData);
+bool ReadReplayTrace(const BYTE* lpbData, SIZE_T cbSize, REPLAYPATHS* lpPaths);
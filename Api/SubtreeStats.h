@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD STATS_DEFAULT_TOP_COUNT = 10;
+const DWORD STATS_MAX_THREADS = 64;
+const DWORD STATS_FANOUT_BUCKETS = 18;
+const DWORD STATS_MAX_PATH_LENGTH = 32768;
+const DWORD STATS_MAX_VALUE_NAME_LENGTH = 16384;
+
+typedef struct _SUBTREETOTALS {
+	ULONGLONG ullKeysCount;
+	ULONGLONG ullValuesCount;
+	ULONGLONG ullDataBytes;
+	DWORD dwMaxDepth;
+	FILETIME ftNewestWrite;
+} SUBTREETOTALS;
+
+typedef struct _BRANCHTOTALS {
+	LPWSTR lpsKeyPath;
+	SUBTREETOTALS stTotals;
+} BRANCHTOTALS;
+
+typedef struct _SUBTREESTATS {
+	SUBTREETOTALS stTotals;
+	ULONGLONG ullFanOutHistogram[STATS_FANOUT_BUCKETS];
+	ULONGLONG ullUnreadableKeys;
+	BRANCHTOTALS* lpTopBranches;
+	DWORD dwTopCount;
+	DWORD dwThreadsCount;
+} SUBTREESTATS;
+
+typedef struct _STATSWALKER {
+	WCHAR lpsPath[STATS_MAX_PATH_LENGTH];
+	WCHAR lpsValueName[STATS_MAX_VALUE_NAME_LENGTH];
+	ULONGLONG ullFanOutHistogram[STATS_FANOUT_BUCKETS];
+	ULONGLONG ullUnreadableKeys;
+	DWORD dwTopCount;
+	DWORD dwHeapCount;
+	BRANCHTOTALS* lpHeap;
+} STATSWALKER;
+
+typedef struct _STATSBRANCHES {
+	HKEY hKeyRoot;
+	LPWSTR* lpsNames;
+	DWORD dwNamesCount;
+	SUBTREETOTALS* lpTotals;
+	volatile LONG lNextBranch;
+} STATSBRANCHES;
+
+typedef struct _STATSWORKER {
+	STATSBRANCHES* lpBranches;
+	STATSWALKER* lpWalker;
+} STATSWORKER;
+
+bool CollectSubtreeStats(HKEY hKey, DWORD dwTopCount, SUBTREESTATS* lpStats);
+void FreeSubtreeStats(SUBTREESTATS* lpStats);
+void GetFanOutBucketRange(DWORD dwBucket, DWORD* lpdwFirst, DWORD* lpdwLast);
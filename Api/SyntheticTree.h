@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Platform.h"
+
+#include "RegistryBackend.h"
+
+const DWORD SYNTHETIC_NAME_ALPHABET_SIZE = 36;
+
+typedef struct _SYNTHETICTREEPARAMS {
+	DWORD dwFanOut;
+	DWORD dwDepth;
+	DWORD dwMinNameLength;
+	DWORD dwMaxNameLength;
+	DWORD dwValuesPerKey;
+	DWORD dwSeed;
+} SYNTHETICTREEPARAMS;
+
+typedef struct _SYNTHETICKEY {
+	LPWSTR lpsName;
+	DWORD dwNameLength;
+	struct _SYNTHETICKEY* lpSubKeys;
+	DWORD dwSubKeysCount;
+	DWORD dwValuesCount;
+	FILETIME ftLastWriteTime;
+} SYNTHETICKEY;
+
+void GetDefaultSyntheticTreeParams(SYNTHETICTREEPARAMS* lpParams);
+SYNTHETICKEY* GenerateSyntheticTree(const SYNTHETICTREEPARAMS* lpParams, DWORD* lpdwKeysCount);
+void FreeSyntheticTree(SYNTHETICKEY* lpRoot);
+HKEY GetSyntheticKeyHandle(SYNTHETICKEY* lpKey);
+const REGBACKEND* GetSyntheticBackend();
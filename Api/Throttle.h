@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+
+const DWORD THROTTLE_DEFAULT_BATCH_SIZE = 64;
+const DWORD THROTTLE_DEFAULT_PROGRESS_INTERVAL = 1000;
+const DWORD THROTTLE_BURST_MILLISECONDS = 100;
+
+typedef ULONGLONG (*GETTIMEPROC)(void* lpContext);
+typedef void (*SLEEPPROC)(void* lpContext, ULONGLONG ullMicroseconds);
+
+// Wall and CPU time in microseconds, replaced by simulated clock to check pacing
+typedef struct _THROTTLECLOCK {
+	GETTIMEPROC lpfnGetTime;
+	GETTIMEPROC lpfnGetCpuTime;
+	SLEEPPROC lpfnSleep;
+	void* lpContext;
+} THROTTLECLOCK;
+
+typedef struct _SIMULATEDCLOCK {
+	ULONGLONG ullTime;
+	ULONGLONG ullCpuTime;
+	ULONGLONG ullSleptTime;
+} SIMULATEDCLOCK;
+
+typedef struct _THROTTLEPARAMS {
+	DWORD dwKeysPerSecond;
+	DWORD dwCpuPercent;
+	DWORD dwBatchSize;
+	DWORD dwProgressInterval;
+	FILE* lpProgress;
+} THROTTLEPARAMS;
+
+typedef struct _THROTTLESTATE {
+	THROTTLEPARAMS tpParams;
+	THROTTLECLOCK tcClock;
+	double dKeyTokens;
+	double dCpuTokens;
+	ULONGLONG ullStartTime;
+	ULONGLONG ullLastTime;
+	ULONGLONG ullLastCpuTime;
+	ULONGLONG ullLastProgressTime;
+	ULONGLONG ullKeysCount;
+	ULONGLONG ullDelayedTime;
+} THROTTLESTATE;
+
+void GetDefaultThrottleParams(THROTTLEPARAMS* lpParams);
+const THROTTLECLOCK* GetSystemClock();
+void InitSimulatedClock(SIMULATEDCLOCK* lpSimulatedClock, THROTTLECLOCK* lpClock);
+void AdvanceSimulatedClock(SIMULATEDCLOCK* lpSimulatedClock, ULONGLONG ullMicroseconds, ULONGLONG ullCpuMicroseconds);
+void InitThrottle(THROTTLESTATE* lpState, const THROTTLEPARAMS* lpParams, const THROTTLECLOCK* lpClock);
+ULONGLONG ConsumeThrottleBudget(THROTTLESTATE* lpState, DWORD dwKeysCount);
+bool EnableThrottle(const THROTTLEPARAMS* lpParams);
+void DisableThrottle();
+void ThrottleKeys(DWORD dwKeysCount);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD TRACE_RING_CAPACITY = 16384;
+const DWORD TRACE_ARGUMENT_LENGTH = 64;
+const DWORD TRACE_DEFAULT_SUBTREE_THRESHOLD = 1000;
+
+typedef struct _TRACEEVENT {
+	LPCSTR lpsName;
+	LPCSTR lpsCategory;
+	ULONGLONG ullStart;
+	ULONGLONG ullDuration;
+	LONG lStatus;
+	WCHAR lpsArgument[TRACE_ARGUMENT_LENGTH];
+} TRACEEVENT;
+
+// Ring belongs to its thread until the thread exits, flusher waits while lWriting is set
+typedef struct _TRACERING {
+	DWORD dwThreadId;
+	DWORD dwSession;
+	volatile LONG lWriting;
+	volatile LONG lReleased;
+	volatile LONGLONG llWrittenCount;
+	struct _TRACERING* lpNext;
+	TRACEEVENT teEvents[TRACE_RING_CAPACITY];
+} TRACERING;
+
+bool StartTrace(LPCSTR lpsFileName, DWORD dwSubtreeThreshold);
+bool IsTraceEnabled();
+DWORD GetTraceSubtreeThreshold();
+ULONGLONG BeginTraceSpan();
+void EndTraceSpan(LPCSTR lpsName, LPCSTR lpsCategory, ULONGLONG ullStart, LPCWSTR lpsArgument);
+void EndTraceSpanStatus(LPCSTR lpsName, LPCSTR lpsCategory, ULONGLONG ullStart, LPCWSTR lpsArgument, LONG lStatus);
+bool FlushTrace();
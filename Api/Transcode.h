@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Platform.h"
+
+// Conversions do not write terminating null, invalid sequences become U+FFFD
+const DWORD TRANSCODE_ERROR = MAXDWORD;
+const DWORD TRANSCODE_MAX_UTF8_PER_UTF16 = 3;
+const WCHAR TRANSCODE_REPLACEMENT_CHAR = 0xFFFD;
+
+// Conversion storage reused between calls, it only grows
+typedef struct _TRANSCODEBUFFER {
+	LPWSTR lpsWide;
+	DWORD cchWideCapacity;
+	LPSTR lpsUtf8;
+	DWORD cbUtf8Capacity;
+} TRANSCODEBUFFER;
+
+DWORD Utf8ToUtf16(LPCSTR lpsSource, DWORD cbSource, LPWSTR lpsDestination, DWORD cchDestination);
+DWORD Utf16ToUtf8(LPCWSTR lpsSource, DWORD cchSource, LPSTR lpsDestination, DWORD cbDestination);
+LPCWSTR WidenUtf8(TRANSCODEBUFFER* lpBuffer, LPCSTR lpsSource, DWORD cbSource, DWORD* lpcchResult);
+LPCSTR NarrowToUtf8(TRANSCODEBUFFER* lpBuffer, LPCWSTR lpsSource, DWORD cchSource, DWORD* lpcbResult);
+void FreeTranscodeBuffer(TRANSCODEBUFFER* lpBuffer);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD VALUE_INLINE_BUFFER_SIZE = 512;
+const DWORD VALUE_TYPES_COUNT = 8;
+
+typedef struct _REGVALUEBUFFER {
+	BYTE* lpData;
+	DWORD cbCapacity;
+	DWORD cbData;
+	BYTE abInline[VALUE_INLINE_BUFFER_SIZE];
+} REGVALUEBUFFER;
+
+typedef bool (*ENCODEVALUEPROC)(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer);
+typedef bool (*DECODEVALUEPROC)(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput);
+
+typedef struct _REGVALUECODEC {
+	DWORD dwType;
+	LPCSTR lpsTypeName;
+	ENCODEVALUEPROC lpfnEncode;
+	DECODEVALUEPROC lpfnDecode;
+} REGVALUECODEC;
+
+/// <summary>
+///		Compile-time traits of registry value type: text to registry data and back
+/// </summary>
+template <DWORD dwType>
+struct RegValueTraits;
+
+#define DECLARE_REG_VALUE_TRAITS(dwType) \
+	template <> \
+	struct RegValueTraits<dwType> { \
+		static const LPCSTR lpsTypeName; \
+		static bool Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer); \
+		static bool Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput); \
+	};
+
+DECLARE_REG_VALUE_TRAITS(REG_SZ)
+DECLARE_REG_VALUE_TRAITS(REG_EXPAND_SZ)
+DECLARE_REG_VALUE_TRAITS(REG_MULTI_SZ)
+DECLARE_REG_VALUE_TRAITS(REG_DWORD)
+DECLARE_REG_VALUE_TRAITS(REG_DWORD_BIG_ENDIAN)
+DECLARE_REG_VALUE_TRAITS(REG_QWORD)
+DECLARE_REG_VALUE_TRAITS(REG_BINARY)
+DECLARE_REG_VALUE_TRAITS(REG_LINK)
+
+#undef DECLARE_REG_VALUE_TRAITS
+
+void InitValueBuffer(REGVALUEBUFFER* lpBuffer, BYTE* lpStorage, DWORD cbStorage);
+DWORD GetEncodedValueSizeLimit(LPCSTR lpsValue);
+const REGVALUECODEC* GetValueCodec(DWORD dwType);
+const REGVALUECODEC* GetValueCodecByName(LPCSTR lpsTypeName);
+bool EncodeRegValue(DWORD dwType, LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer);
+bool DecodeRegValue(DWORD dwType, const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput);
+bool WidenString(LPCSTR lpsSource, LPWSTR lpsDestination, DWORD cchDestination);
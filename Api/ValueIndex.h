@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Platform.h"
+
+const DWORD VALUE_INDEX_MAGIC = 0x58495652; // "RVIX"
+const DWORD VALUE_INDEX_VERSION = 1;
+const DWORD VALUE_INDEX_MAX_PATH_LENGTH = 32768;
+const DWORD VALUE_INDEX_MAX_VALUE_NAME_LENGTH = 16384;
+const DWORD VALUE_INDEX_INITIAL_TRIGRAMS = 65536;
+
+// File image: header, trigram table (sorted), value entries, UTF-16 strings, postings.
+// Postings of trigram are ascending value ids, delta and varint encoded.
+typedef struct _VALUEINDEXHEADER {
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DWORD dwValuesCount;
+	DWORD dwTrigramsCount;
+	DWORD dwStringsLength;
+	DWORD dwReserved;
+	ULONGLONG ullTrigramsOffset;
+	ULONGLONG ullEntriesOffset;
+	ULONGLONG ullStringsOffset;
+	ULONGLONG ullPostingsOffset;
+	ULONGLONG ullPostingsSize;
+	ULONGLONG ullFileSize;
+} VALUEINDEXHEADER;
+
+typedef struct _VALUEINDEXTRIGRAM {
+	ULONGLONG ullTrigram;
+	ULONGLONG ullPostingsOffset;
+	DWORD dwPostingsCount;
+	DWORD cbPostings;
+} VALUEINDEXTRIGRAM;
+
+// Offsets and lengths are in characters of strings pool, strings are terminated
+typedef struct _VALUEINDEXENTRY {
+	DWORD dwKeyPathOffset;
+	DWORD dwValueNameOffset;
+	DWORD dwDataOffset;
+	DWORD dwDataLength;
+	DWORD dwType;
+} VALUEINDEXENTRY;
+
+typedef struct _VALUEINDEXIMAGE {
+	BYTE* lpData;
+	SIZE_T cbData;
+} VALUEINDEXIMAGE;
+
+typedef struct _VALUEINDEX {
+	HANDLE hFile;
+	HANDLE hMapping;
+	const BYTE* lpBase;
+	const VALUEINDEXHEADER* lpHeader;
+	const VALUEINDEXTRIGRAM* lpTrigrams;
+	const VALUEINDEXENTRY* lpEntries;
+	LPCWSTR lpsStrings;
+	const BYTE* lpPostings;
+} VALUEINDEX;
+
+typedef struct _TRIGRAMPOSTINGS {
+	ULONGLONG ullTrigram;
+	DWORD dwLastValueId;
+	DWORD dwPostingsCount;
+	BYTE* lpPostings;
+	DWORD cbPostings;
+	DWORD cbCapacity;
+} TRIGRAMPOSTINGS;
+
+typedef struct _VALUEINDEXBUILDER {
+	WCHAR lpsPath[VALUE_INDEX_MAX_PATH_LENGTH];
+	WCHAR lpsValueName[VALUE_INDEX_MAX_VALUE_NAME_LENGTH];
+	BYTE* lpData;
+	DWORD cbDataCapacity;
+	TRIGRAMPOSTINGS* lpTrigrams;
+	DWORD dwTrigramsCapacity;
+	DWORD dwTrigramsCount;
+	VALUEINDEXENTRY* lpEntries;
+	DWORD dwEntriesCount;
+	DWORD dwEntriesCapacity;
+	LPWSTR lpsStrings;
+	DWORD dwStringsLength;
+	DWORD dwStringsCapacity;
+	bool bFailed;
+} VALUEINDEXBUILDER;
+
+bool BuildValueIndex(HKEY hKey, VALUEINDEXIMAGE* lpImage);
+bool SaveValueIndex(const VALUEINDEXIMAGE* lpImage, LPCSTR lpsFileName);
+void FreeValueIndexImage(VALUEINDEXIMAGE* lpImage);
+bool AttachValueIndex(const BYTE* lpData, SIZE_T cbData, VALUEINDEX* lpIndex);
+bool OpenValueIndex(LPCSTR lpsFileName, VALUEINDEX* lpIndex);
+void CloseValueIndex(VALUEINDEX* lpIndex);
+DWORD* SearchValueIndex(const VALUEINDEX* lpIndex, LPCWSTR lpsText, DWORD* lpdwFoundCount);
+LPCWSTR GetValueIndexString(const VALUEINDEX* lpIndex, DWORD dwOffset);
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+
+#include "Transcode.h"
+
+// Rule file, one rule per line, first matching rule wins, '#' starts comment:
+//     ignore  **\Explorer\**
+//     alert   **\CurrentVersion\**  Run*  file:autorun.log
+// Key pattern matches whole key path: '*' and '?' stay inside one key name, '**' crosses '\'.
+// Value pattern (default '*') matches value name, key added and removed events have empty name.
+// Sink is console (default), stderr or file:NAME.
+const DWORD WATCH_MAX_RULE_LENGTH = 1024;
+const DWORD WATCH_MAX_DFA_STATES = 4096;
+const DWORD WATCH_NO_RULE = MAXDWORD;
+const DWORD WATCH_ASCII_COUNT = 128;
+
+const BYTE WATCH_TOKEN_ROOT = 0;
+const BYTE WATCH_TOKEN_CHAR = 1;
+const BYTE WATCH_TOKEN_NAME_CHAR = 2;
+const BYTE WATCH_TOKEN_ANY_CHAR = 3;
+const BYTE WATCH_TOKEN_NAME_STAR = 4;
+const BYTE WATCH_TOKEN_STAR = 5;
+
+// Character classes: every other character, '\', key and value name separator, then pattern characters
+const WORD WATCH_CLASS_OTHER = 0;
+const WORD WATCH_CLASS_BACKSLASH = 1;
+const WORD WATCH_CLASS_SEPARATOR = 2;
+const WORD WATCH_FIRST_CHAR_CLASS = 3;
+
+const DWORD WATCH_SINK_CONSOLE = 0;
+const DWORD WATCH_SINK_STDERR = 1;
+const DWORD WATCH_SINK_FILE = 2;
+
+// Node of trie shared by all patterns, rules with common prefix share nodes
+typedef struct _WATCHNODE {
+	BYTE bToken;
+	WORD wClass;
+	DWORD dwFirstChild;
+	DWORD dwNextSibling;
+	DWORD dwRule;
+} WATCHNODE;
+
+typedef struct _WATCHRULE {
+	bool bIgnore;
+	DWORD dwSink;
+	DWORD dwLine;
+	ULONGLONG ullMatchedCount;
+} WATCHRULE;
+
+typedef struct _WATCHSINK {
+	DWORD dwKind;
+	LPSTR lpsName;
+	FILE* lpFile;
+	ULONGLONG ullEventsCount;
+} WATCHSINK;
+
+// State of lazily built DFA: set of trie nodes and first rule accepted in it
+typedef struct _WATCHSTATE {
+	DWORD dwNodesOffset;
+	DWORD dwNodesCount;
+	DWORD dwHash;
+	DWORD dwRule;
+} WATCHSTATE;
+
+typedef struct _WATCHRULESET {
+	WATCHNODE* lpNodes;
+	DWORD dwNodesCount;
+	DWORD dwNodesCapacity;
+	WATCHRULE* lpRules;
+	DWORD dwRulesCount;
+	DWORD dwRulesCapacity;
+	WATCHSINK* lpSinks;
+	DWORD dwSinksCount;
+	DWORD dwSinksCapacity;
+	WORD wAsciiClasses[WATCH_ASCII_COUNT];
+	WCHAR* lpwcOtherChars;			// Sorted, for binary search
+	WORD* lpwOtherClasses;
+	DWORD dwOtherCount;
+	DWORD dwOtherCapacity;
+	DWORD dwClassesCount;
+	WATCHSTATE* lpStates;
+	DWORD dwStatesCount;
+	DWORD* lpdwTransitions;
+	DWORD* lpdwStateNodes;
+	DWORD dwStateNodesCount;
+	DWORD dwStateNodesCapacity;
+	DWORD* lpdwStateSlots;
+	DWORD dwStartState;
+	DWORD* lpdwNodeMarks;
+	DWORD dwMarkGeneration;
+	DWORD* lpdwScratch;
+	DWORD dwScratchCapacity;
+	ULONGLONG ullFlushesCount;
+	TRANSCODEBUFFER tbEvent;
+} WATCHRULESET;
+
+void InitWatchRules(WATCHRULESET* lpRuleSet);
+bool AddWatchRule(WATCHRULESET* lpRuleSet, bool bIgnore, LPCWSTR lpsKeyPattern, LPCWSTR lpsValuePattern, LPCSTR lpsSink, DWORD dwLine);
+bool LoadWatchRules(LPCSTR lpsFileName, WATCHRULESET* lpRuleSet, DWORD* lpdwErrorLine);
+DWORD MatchWatchRules(WATCHRULESET* lpRuleSet, LPCWSTR lpsKeyPath, LPCWSTR lpsValueName);
+bool RouteWatchEvent(WATCHRULESET* lpRuleSet, DWORD dwRule, LPCWSTR lpsEvent);
+void FreeWatchRules(WATCHRULESET* lpRuleSet);
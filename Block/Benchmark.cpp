@@ -0,0 +1,1103 @@
+#include "../Api/Platform.h"
+#ifdef _WIN32
+#include <psapi.h>
+#endif
+#include <stdio.h>
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
+#include "../Api/RegistryEditor.h"
+#include "../Api/ValueCodec.h"
+#include "../Api/Benchmark.h"
+#include "../Api/ValueIndex.h"
+#include "../Api/Throttle.h"
+#include "../Api/ExternalSort.h"
+#include "../Api/Transcode.h"
+#include "../Api/Output.h"
+#ifdef _WIN32
+#include "../Api/QueryServer.h"
+#endif
+#include "../Api/FlagsPool.h"
+#include "../Api/RegistryReplay.h"
+#include "../Api/Progress.h"
+
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+
+const char BENCHMARK_REG_EXE_OUTPUT[] =
+	"\r\nHKEY_LOCAL_MACHINE\\SOFTWARE\\Test_key\r\n"
+	"\tREG_KEY_DONT_VIRTUALIZE: CLEAR\r\n"
+	"\tREG_KEY_DONT_SILENT_FAIL: SET\r\n"
+	"\tREG_KEY_RECURSE_FLAG: CLEAR\r\n"
+	"\r\nThe operation completed successfully.\r\n";
+const DWORD BENCHMARK_VALUE_TEXT_LENGTH = 256;
+const DWORD BENCHMARK_QUERIES_PER_ITERATION = 4;
+const DWORD BENCHMARK_PIPE_NAME_LENGTH = 64;
+const DWORD BENCHMARK_FLAGS_KEYS_COUNT = 512;
+const DWORD BENCHMARK_FLAGS_JOBS_COUNT = 4;
+const DWORD BENCHMARK_CHILD_MILLISECONDS = 1;
+const WCHAR BENCHMARK_FLAGS_KEY_ROOT[] = L"HKEY_CURRENT_USER\\RegistryEditorBenchmark";
+// Keys per second and CPU percent paced by throttle benchmark (0 is no limit)
+const DWORD BENCHMARK_THROTTLE_BUDGETS[][2] = { { 2000, 0 }, { 20000, 0 }, { 0, 5 }, { 0, 20 }, { 5000, 25 } };
+const DWORD BENCHMARK_THROTTLE_BUDGETS_COUNT = sizeof(BENCHMARK_THROTTLE_BUDGETS) / sizeof(BENCHMARK_THROTTLE_BUDGETS[0]);
+
+#ifdef _WIN32
+// Tree served by pipe benchmark, query processor has no context argument
+static HKEY g_hQueryBenchmarkRoot = NULL;
+#endif
+
+#ifdef _DEBUG
+static volatile LONGLONG g_llAllocations = 0;
+
+/// <summary>
+///		Count heap allocations made by CRT (debug CRT only)
+/// </summary>
+/// 
+/// <returns>int</returns>
+static int AllocationHook(int iAllocType, void* lpUserData, size_t cbSize, int iBlockType, long lRequestNumber, const unsigned char* lpsFileName, int iLineNumber)
+{
+	if ((iAllocType == _HOOK_ALLOC) || (iAllocType == _HOOK_REALLOC))
+	{
+		g_llAllocations++;
+	}
+
+	return TRUE;
+}
+#endif
+
+/// <summary>
+///		Get allocations made so far (-1 if release CRT can not count them)
+/// </summary>
+/// 
+/// <returns>LONGLONG</returns>
+static LONGLONG GetAllocationsCount()
+{
+#ifdef _DEBUG
+	return g_llAllocations;
+#else
+	return -1;
+#endif
+}
+
+/// <summary>
+///		Get peak working set of process
+/// </summary>
+/// 
+/// <returns>SIZE_T</returns>
+static SIZE_T GetPeakResidentSet()
+{
+	PROCESS_MEMORY_COUNTERS pmcCounters;
+	ZeroMemory(&pmcCounters, sizeof(pmcCounters));
+	pmcCounters.cb = sizeof(pmcCounters);
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmcCounters, sizeof(pmcCounters)))
+	{
+		return 0;
+	}
+
+	return pmcCounters.PeakWorkingSetSize;
+}
+
+/// <summary>
+///		Get timestamp in seconds
+/// </summary>
+/// 
+/// <returns>double</returns>
+static double GetTimestamp()
+{
+	LARGE_INTEGER liFrequency, liCounter;
+	QueryPerformanceFrequency(&liFrequency);
+	QueryPerformanceCounter(&liCounter);
+
+	return (double)liCounter.QuadPart / (double)liFrequency.QuadPart;
+}
+
+/// <summary>
+///		Release array of strings
+/// </summary>
+/// 
+/// <param name="lpsArray">Array</param>
+/// <param name="dwCount">Array count</param>
+/// 
+/// <returns>void</returns>
+static void FreeLPWSTRArray(LPWSTR* lpsArray, DWORD dwCount)
+{
+	if (lpsArray == NULL)
+	{
+		return;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwCount; dwIndex++)
+	{
+		free(lpsArray[dwIndex]);
+	}
+
+	free(lpsArray);
+}
+
+/// <summary>
+///		Start measurement
+/// </summary>
+/// 
+/// <param name="lpResult">Benchmark result</param>
+/// <param name="lpsName">Benchmark name</param>
+/// <param name="dwIterations">Iterations count</param>
+/// 
+/// <returns>double (start timestamp)</returns>
+static double BeginBenchmark(BENCHMARKRESULT* lpResult, LPCSTR lpsName, DWORD dwIterations)
+{
+	ZeroMemory(lpResult, sizeof(BENCHMARKRESULT));
+	lpResult->lpsName = lpsName;
+	lpResult->dwIterations = dwIterations;
+	lpResult->llAllocations = GetAllocationsCount();
+
+	return GetTimestamp();
+}
+
+/// <summary>
+///		Finish measurement and print result
+/// </summary>
+/// 
+/// <param name="lpResult">Benchmark result</param>
+/// <param name="dStartTime">Start timestamp</param>
+/// <param name="lpParams">Tree parameters</param>
+/// <param name="lpOutput">Output stream</param>
+/// 
+/// <returns>void</returns>
+static void EndBenchmark(BENCHMARKRESULT* lpResult, double dStartTime, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	lpResult->dElapsedSeconds = GetTimestamp() - dStartTime;
+
+	LONGLONG llAllocations = GetAllocationsCount();
+	lpResult->llAllocations = (llAllocations < 0) ? -1 : llAllocations - lpResult->llAllocations;
+	lpResult->cbPeakResidentSet = GetPeakResidentSet();
+
+	PrintBenchmarkResult(lpResult, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Print benchmark result as one JSON line
+/// </summary>
+/// 
+/// <param name="lpResult">Benchmark result</param>
+/// <param name="lpParams">Tree parameters</param>
+/// <param name="lpOutput">Output stream</param>
+/// 
+/// <returns>void</returns>
+void PrintBenchmarkResult(const BENCHMARKRESULT* lpResult, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	double dNsPerOperation = (lpResult->ullOperations == 0) ? 0.0 : lpResult->dElapsedSeconds * 1e9 / (double)lpResult->ullOperations;
+	double dKeysPerSecond = (lpResult->dElapsedSeconds <= 0.0) ? 0.0 : (double)lpResult->ullKeys / lpResult->dElapsedSeconds;
+
+	fprintf(lpOutput, "{\"benchmark\":\"%s\",\"fan_out\":%u,\"depth\":%u,\"min_name_length\":%u,\"max_name_length\":%u,"
+		"\"values_per_key\":%u,\"seed\":%u,\"iterations\":%u,\"operations\":%llu,\"ns_per_op\":%.1f,",
+		lpResult->lpsName, lpParams->dwFanOut, lpParams->dwDepth, lpParams->dwMinNameLength, lpParams->dwMaxNameLength,
+		lpParams->dwValuesPerKey, lpParams->dwSeed, lpResult->dwIterations, lpResult->ullOperations, dNsPerOperation);
+
+	if (lpResult->ullKeys == 0)
+	{
+		fprintf(lpOutput, "\"keys_per_sec\":null,");
+	}
+	else
+	{
+		fprintf(lpOutput, "\"keys_per_sec\":%.0f,", dKeysPerSecond);
+	}
+
+	if (lpResult->llAllocations < 0)
+	{
+		fprintf(lpOutput, "\"allocations\":null,");
+	}
+	else
+	{
+		fprintf(lpOutput, "\"allocations\":%lld,", lpResult->llAllocations);
+	}
+
+	fprintf(lpOutput, "\"peak_rss_bytes\":%llu}\n", (ULONGLONG)lpResult->cbPeakResidentSet);
+}
+
+/// <summary>
+///		Measure CreateFullName on every key path of tree
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkCreateFullName(LPWSTR* lpsKeyNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "CreateFullName", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			free(CreateFullName(lpsKeyNames[dwKeyIndex], const_cast<LPWSTR>(L"Subkey")));
+		}
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwKeysCount;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure SearchOneLevel on every key of tree
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkSearchOneLevel(HKEY hRoot, LPWSTR* lpsKeyNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "SearchOneLevel", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			DWORD dwLevelCount = 0;
+			FreeLPWSTRArray(SearchOneLevel(hRoot, lpsKeyNames[dwKeyIndex], &dwLevelCount), dwLevelCount);
+			brResult.ullKeys += dwLevelCount;
+		}
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwKeysCount;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure SearchRecursive over whole tree
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkSearchRecursive(HKEY hRoot, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "SearchRecursive", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		DWORD dwKeysCount = 0;
+		FreeLPWSTRArray(SearchRecursive(hRoot, L"", &dwKeysCount), dwKeysCount);
+		brResult.ullKeys += dwKeysCount;
+	}
+
+	brResult.ullOperations = dwIterations;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure sampling estimate of --progress
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkProgressEstimate(HKEY hRoot, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "ProgressEstimate", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		PROGRESSESTIMATE peEstimate;
+		if (EstimateWalkSize(hRoot, PROGRESS_DEFAULT_SAMPLES_COUNT, &peEstimate))
+		{
+			brResult.ullKeys += peEstimate.ullRootKeysCount;
+			FreeProgressEstimate(&peEstimate);
+		}
+		brResult.ullOperations++;
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure SearchKeyInList over list of all keys
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkSearchKeyInList(LPWSTR* lpsKeyNames, DWORD dwKeysCount, LPWSTR lpsSearchedKey, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "SearchKeyInList", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		// Found names belong to lpsKeyNames, only array is released
+		DWORD dwFoundCount = 0;
+		free(SearchKeyInList(lpsKeyNames, dwKeysCount, lpsSearchedKey, &dwFoundCount));
+		brResult.ullKeys += dwKeysCount;
+	}
+
+	brResult.ullOperations = dwIterations;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure SearchKeyFuzzyInList over list of all keys, to compare with exact SearchKeyInList
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkSearchKeyFuzzyInList(LPWSTR* lpsKeyNames, DWORD dwKeysCount, LPWSTR lpsSearchedKey, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	const DWORD dwMaxDistance = 2;
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "SearchKeyFuzzyInList", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		DWORD dwFoundCount = 0;
+		DWORD* lpdwDistances = NULL;
+		free(SearchKeyFuzzyInList(lpsKeyNames, dwKeysCount, lpsSearchedKey, dwMaxDistance, &dwFoundCount, &lpdwDistances));
+		free(lpdwDistances);
+		brResult.ullKeys += dwKeysCount;
+	}
+
+	brResult.ullOperations = dwIterations;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Stub of reg.exe child: answers with typical output after child process time
+/// </summary>
+/// 
+/// <returns>LPSTR</returns>
+static LPSTR RunStubChild(void* lpContext, WCHAR* lpsCommand)
+{
+	// Child process takes a while, so other workers get to run theirs meanwhile
+	Sleep(BENCHMARK_CHILD_MILLISECONDS);
+	return _strdup(BENCHMARK_REG_EXE_OUTPUT);
+}
+
+/// <summary>
+///		Count reported key
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void CountFlagsResult(void* lpContext, DWORD dwIndex, const FLAGSRESULT* lpResult)
+{
+	(*(ULONGLONG*)lpContext)++;
+}
+
+/// <summary>
+///		Measure flags pool with stub children, first pass runs children and later passes are answered by cache
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkFlagsPool(LPWSTR* lpsKeyNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	CHILDRUNNER crRunner = { RunStubChild, NULL };
+	DWORD dwQueriedCount = (dwKeysCount < BENCHMARK_FLAGS_KEYS_COUNT) ? dwKeysCount : BENCHMARK_FLAGS_KEYS_COUNT;
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "FlagsPool", dwIterations + 1);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations + 1; dwIteration++)
+	{
+		QueryKeyFlags(BENCHMARK_FLAGS_KEY_ROOT, (LPCWSTR*)lpsKeyNames, dwQueriedCount, BENCHMARK_FLAGS_JOBS_COUNT, &crRunner, CountFlagsResult, &brResult.ullOperations);
+		brResult.ullKeys += dwQueriedCount;
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure ParseRegExeOutput on typical reg.exe output
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkParseRegExeOutput(DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	const DWORD dwParsesPerIteration = 10000;
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "ParseRegExeOutput", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwParseIndex = 0; dwParseIndex < dwParsesPerIteration; dwParseIndex++)
+		{
+			DWORD dwFlagsCount;
+			KEYFLAG* kfFlags = GetInitializedFlags(&dwFlagsCount);
+			if (kfFlags == NULL)
+			{
+				continue;
+			}
+
+			ParseRegExeOutput(const_cast<LPSTR>(BENCHMARK_REG_EXE_OUTPUT), kfFlags, dwFlagsCount);
+
+			for (DWORD dwFlagIndex = 0; dwFlagIndex < dwFlagsCount; dwFlagIndex++)
+			{
+				free(kfFlags[dwFlagIndex].lpsFlagValue);
+			}
+			free(kfFlags);
+		}
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwParsesPerIteration;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure end-to-end SEARCH_KEY (traversal and filtering)
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkSearchKey(HKEY hRoot, DWORD dwTreeKeysCount, LPWSTR lpsSearchedKey, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "SEARCH_KEY", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		DWORD dwFoundCount = 0;
+		FreeLPWSTRArray(SearchKey(hRoot, lpsSearchedKey, &dwFoundCount), dwFoundCount);
+		brResult.ullKeys += dwTreeKeysCount;
+	}
+
+	brResult.ullOperations = dwIterations;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure import path: values in text format encoded to registry data
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkImport(LPWSTR* lpsKeyNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	CHAR lpsValueText[BENCHMARK_VALUE_TEXT_LENGTH];
+	REGVALUEBUFFER rvbValue;
+	double dStartTime = BeginBenchmark(&brResult, "import", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			for (DWORD dwValueIndex = 0; dwValueIndex < lpParams->dwValuesPerKey; dwValueIndex++)
+			{
+				DWORD dwType = (dwValueIndex % 2 == 0) ? REG_SZ : REG_DWORD;
+
+				if (dwType == REG_SZ)
+				{
+					_snprintf_s(lpsValueText, BENCHMARK_VALUE_TEXT_LENGTH, _TRUNCATE, "C:\\Program Files\\%ls\\%u", lpsKeyNames[dwKeyIndex], dwValueIndex);
+				}
+				else
+				{
+					_snprintf_s(lpsValueText, BENCHMARK_VALUE_TEXT_LENGTH, _TRUNCATE, "%u", dwKeyIndex);
+				}
+
+				InitValueBuffer(&rvbValue, NULL, 0);
+				EncodeRegValue(dwType, lpsValueText, &rvbValue);
+				brResult.ullOperations++;
+			}
+		}
+
+		brResult.ullKeys += dwKeysCount;
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure export path: every value of every key read and decoded to text
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkExport(HKEY hRoot, LPWSTR* lpsKeyNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	WCHAR lpsValueName[MAX_KEY_NAME_LENGTH];
+	CHAR lpsValueText[VALUE_INLINE_BUFFER_SIZE * 3];
+	REGVALUEBUFFER rvbValue;
+	double dStartTime = BeginBenchmark(&brResult, "export", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			HKEY hKey;
+			if (!OpenRegKey(hRoot, lpsKeyNames[dwKeyIndex], KEY_QUERY_VALUE, &hKey))
+			{
+				continue;
+			}
+
+			InitValueBuffer(&rvbValue, NULL, 0);
+			for (DWORD dwValueIndex = 0; ; dwValueIndex++)
+			{
+				DWORD dwNameSize = MAX_KEY_NAME_LENGTH;
+				DWORD dwType;
+				rvbValue.cbData = rvbValue.cbCapacity;
+
+				if (EnumRegValue(hKey, dwValueIndex, lpsValueName, &dwNameSize, &dwType, rvbValue.lpData, &rvbValue.cbData) != ERROR_SUCCESS)
+				{
+					break;
+				}
+
+				DecodeRegValue(dwType, rvbValue.lpData, rvbValue.cbData, lpsValueText, sizeof(lpsValueText));
+				brResult.ullOperations++;
+			}
+
+			CloseRegKey(hKey);
+		}
+
+		brResult.ullKeys += dwKeysCount;
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure building of trigram index over string values
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkValueIndexBuild(HKEY hRoot, DWORD dwTreeKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "ValueIndexBuild", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		VALUEINDEXIMAGE viiImage;
+		if (BuildValueIndex(hRoot, &viiImage))
+		{
+			brResult.ullOperations += ((const VALUEINDEXHEADER*)viiImage.lpData)->dwValuesCount;
+			FreeValueIndexImage(&viiImage);
+		}
+		brResult.ullKeys += dwTreeKeysCount;
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure substring lookups in trigram index
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkValueIndexSearch(HKEY hRoot, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	const DWORD dwQueriesPerIteration = 1000;
+	LPCWSTR lpsQueries[] = { L"Files\\1", L"program files\\3", L"\\2", L"absent text" };
+	const DWORD dwQueriesCount = sizeof(lpsQueries) / sizeof(lpsQueries[0]);
+
+	VALUEINDEXIMAGE viiImage;
+	VALUEINDEX viIndex;
+	if (!BuildValueIndex(hRoot, &viiImage))
+	{
+		return;
+	}
+	if (!AttachValueIndex(viiImage.lpData, viiImage.cbData, &viIndex))
+	{
+		FreeValueIndexImage(&viiImage);
+		return;
+	}
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "ValueIndexSearch", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwQueryIndex = 0; dwQueryIndex < dwQueriesPerIteration; dwQueryIndex++)
+		{
+			DWORD dwFoundCount = 0;
+			free(SearchValueIndex(&viIndex, lpsQueries[dwQueryIndex % dwQueriesCount], &dwFoundCount));
+		}
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwQueriesPerIteration;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+
+	CloseValueIndex(&viIndex);
+	FreeValueIndexImage(&viiImage);
+}
+
+/// <summary>
+///		Measure token bucket pacing of --budget on simulated clock, walk of tree costs 1 us per key
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkThrottle(DWORD dwTreeKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "Throttle", dwIterations);
+
+	for (DWORD dwBudgetIndex = 0; dwBudgetIndex < BENCHMARK_THROTTLE_BUDGETS_COUNT; dwBudgetIndex++)
+	{
+		SIMULATEDCLOCK scTime;
+		THROTTLECLOCK tcClock;
+		THROTTLEPARAMS tpParams;
+		THROTTLESTATE tsState;
+
+		InitSimulatedClock(&scTime, &tcClock);
+		GetDefaultThrottleParams(&tpParams);
+		tpParams.dwKeysPerSecond = BENCHMARK_THROTTLE_BUDGETS[dwBudgetIndex][0];
+		tpParams.dwCpuPercent = BENCHMARK_THROTTLE_BUDGETS[dwBudgetIndex][1];
+		InitThrottle(&tsState, &tpParams, &tcClock);
+
+		for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+		{
+			for (DWORD dwKeysCount = 0; dwKeysCount < dwTreeKeysCount; dwKeysCount += tpParams.dwBatchSize)
+			{
+				AdvanceSimulatedClock(&scTime, tpParams.dwBatchSize, tpParams.dwBatchSize);
+				tcClock.lpfnSleep(tcClock.lpContext, ConsumeThrottleBudget(&tsState, tpParams.dwBatchSize));
+				brResult.ullOperations++;
+			}
+			brResult.ullKeys += dwTreeKeysCount;
+		}
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Count merged item
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool CountSortedItem(void* lpContext, LPCWSTR lpsItem)
+{
+	(*(ULONGLONG*)lpContext)++;
+	return true;
+}
+
+/// <summary>
+///		Record walk of synthetic tree and measure walks served from recording
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkReplay(HKEY hRoot, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	CHAR lpsTempPath[MAX_PATH];
+	CHAR lpsFileName[MAX_PATH];
+	if ((GetTempPathA(MAX_PATH, lpsTempPath) == 0) || (GetTempFileNameA(lpsTempPath, "rrp", 0, lpsFileName) == 0))
+	{
+		return;
+	}
+
+	// Recording wraps synthetic backend, tree root is recorded as unknown root
+	bool bLoaded = StartRegRecording(lpsFileName);
+	if (bLoaded)
+	{
+		DWORD dwRecordedCount = 0;
+		FreeLPWSTRArray(SearchRecursive(hRoot, L"", &dwRecordedCount), dwRecordedCount);
+		bLoaded = StopRegRecording() && LoadRegReplay(lpsFileName, false);
+	}
+	DeleteFileA(lpsFileName);
+
+	HKEY hReplayRoot = bLoaded ? GetReplayUnknownRoot() : NULL;
+	if (hReplayRoot == NULL)
+	{
+		FreeRegReplay();
+		return;
+	}
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "Replay", dwIterations);
+	SetRegBackend(GetReplayBackend());
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		DWORD dwReplayedCount = 0;
+		FreeLPWSTRArray(SearchRecursive(hReplayRoot, L"", &dwReplayedCount), dwReplayedCount);
+
+		brResult.ullKeys += dwReplayedCount;
+		brResult.ullOperations++;
+	}
+
+	SetRegBackend(GetSyntheticBackend());
+	FreeRegReplay();
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Measure sorting of key list within smallest memory budget, so runs are spilled and merged
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkExternalSort(LPWSTR* lpsKeyNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "ExternalSort", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		EXTERNALSORTER esSorter;
+		if (!InitExternalSorter(&esSorter, EXTERNAL_SORT_MIN_BUDGET, NULL))
+		{
+			break;
+		}
+
+		bool bResult = true;
+		for (DWORD dwKeyIndex = 0; bResult && (dwKeyIndex < dwKeysCount); dwKeyIndex++)
+		{
+			bResult = AddSortedItem(&esSorter, lpsKeyNames[dwKeyIndex], lstrlen(lpsKeyNames[dwKeyIndex]));
+		}
+
+		if (bResult)
+		{
+			MergeSortedItems(&esSorter, CountSortedItem, &brResult.ullOperations);
+		}
+
+		FreeExternalSorter(&esSorter);
+		brResult.ullKeys += dwKeysCount;
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+/// <summary>
+///		Copy key list with name characters spread over Latin, Cyrillic, CJK and supplementary plane scripts
+/// </summary>
+/// 
+/// <returns>LPWSTR* (NULL if no memory)</returns>
+static LPWSTR* CreateMixedScriptNames(LPWSTR* lpsKeyNames, DWORD dwKeysCount)
+{
+	LPWSTR* lpsMixedNames = (LPWSTR*)calloc(dwKeysCount, sizeof(LPWSTR));
+
+	for (DWORD dwKeyIndex = 0; (lpsMixedNames != NULL) && (dwKeyIndex < dwKeysCount); dwKeyIndex++)
+	{
+		LPCWSTR lpsName = lpsKeyNames[dwKeyIndex];
+		DWORD cchName = lstrlen(lpsName);
+		LPWSTR lpsMixedName = (LPWSTR)calloc(cchName * 2 + 1, sizeof(WCHAR));
+
+		if (lpsMixedName == NULL)
+		{
+			FreeLPWSTRArray(lpsMixedNames, dwKeyIndex);
+			return NULL;
+		}
+
+		DWORD cchMixed = 0;
+		for (DWORD dwIndex = 0; dwIndex < cchName; dwIndex++)
+		{
+			WCHAR wcChar = lpsName[dwIndex];
+
+			if ((wcChar == L'\\') || (wcChar % 4 == 0))
+			{
+				lpsMixedName[cchMixed++] = wcChar;
+			}
+			else if (wcChar % 4 == 1)
+			{
+				lpsMixedName[cchMixed++] = (WCHAR)(0x0410 + wcChar % 32);
+			}
+			else if (wcChar % 4 == 2)
+			{
+				lpsMixedName[cchMixed++] = (WCHAR)(0x4E00 + wcChar);
+			}
+			else
+			{
+				// U+1F300 block as surrogate pair
+				lpsMixedName[cchMixed++] = (WCHAR)0xD83C;
+				lpsMixedName[cchMixed++] = (WCHAR)(0xDF00 + wcChar % 64);
+			}
+		}
+
+		lpsMixedNames[dwKeyIndex] = lpsMixedName;
+	}
+
+	return lpsMixedNames;
+}
+
+/// <summary>
+///		Measure UTF-16 to UTF-8 conversion of mixed script names, own transcoder or Win32 one
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkTranscodeToUtf8(LPWSTR* lpsMixedNames, DWORD dwKeysCount, bool bWin32, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	TRANSCODEBUFFER tbBuffer;
+	ZeroMemory(&tbBuffer, sizeof(TRANSCODEBUFFER));
+
+	// Buffer is sized for longest name before measurement so both variants write into same storage
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+	{
+		NarrowToUtf8(&tbBuffer, lpsMixedNames[dwKeyIndex], MAXDWORD, NULL);
+	}
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, bWin32 ? "WideCharToMultiByte" : "TranscodeToUtf8", dwIterations);
+
+	for (DWORD dwIteration = 0; (tbBuffer.lpsUtf8 != NULL) && (dwIteration < dwIterations); dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			DWORD cbResult = 0;
+			if (bWin32)
+			{
+				cbResult = (DWORD)WideCharToMultiByte(CP_UTF8, 0, lpsMixedNames[dwKeyIndex], -1, tbBuffer.lpsUtf8, tbBuffer.cbUtf8Capacity, NULL, NULL);
+			}
+			else
+			{
+				NarrowToUtf8(&tbBuffer, lpsMixedNames[dwKeyIndex], MAXDWORD, &cbResult);
+			}
+			brResult.ullKeys += (cbResult != 0) ? 1 : 0;
+		}
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwKeysCount;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+	FreeTranscodeBuffer(&tbBuffer);
+}
+
+/// <summary>
+///		Measure UTF-8 to UTF-16 conversion of mixed script names, own transcoder or Win32 one
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkTranscodeToUtf16(LPWSTR* lpsMixedNames, DWORD dwKeysCount, bool bWin32, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	LPSTR* lpsUtf8Names = (LPSTR*)calloc(dwKeysCount, sizeof(LPSTR));
+	TRANSCODEBUFFER tbBuffer;
+	ZeroMemory(&tbBuffer, sizeof(TRANSCODEBUFFER));
+
+	bool bResult = (lpsUtf8Names != NULL);
+	for (DWORD dwKeyIndex = 0; bResult && (dwKeyIndex < dwKeysCount); dwKeyIndex++)
+	{
+		LPCSTR lpsUtf8Name = NarrowToUtf8(&tbBuffer, lpsMixedNames[dwKeyIndex], MAXDWORD, NULL);
+		lpsUtf8Names[dwKeyIndex] = (lpsUtf8Name == NULL) ? NULL : _strdup(lpsUtf8Name);
+		bResult = (lpsUtf8Names[dwKeyIndex] != NULL);
+	}
+
+	// Buffer is sized for longest name before measurement so both variants write into same storage
+	for (DWORD dwKeyIndex = 0; bResult && (dwKeyIndex < dwKeysCount); dwKeyIndex++)
+	{
+		bResult = (WidenUtf8(&tbBuffer, lpsUtf8Names[dwKeyIndex], MAXDWORD, NULL) != NULL);
+	}
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, bWin32 ? "MultiByteToWideChar" : "TranscodeToUtf16", dwIterations);
+
+	for (DWORD dwIteration = 0; bResult && (dwIteration < dwIterations); dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			DWORD cchResult = 0;
+			if (bWin32)
+			{
+				cchResult = (DWORD)MultiByteToWideChar(CP_UTF8, 0, lpsUtf8Names[dwKeyIndex], -1, tbBuffer.lpsWide, tbBuffer.cchWideCapacity);
+			}
+			else
+			{
+				WidenUtf8(&tbBuffer, lpsUtf8Names[dwKeyIndex], MAXDWORD, &cchResult);
+			}
+			brResult.ullKeys += (cchResult != 0) ? 1 : 0;
+		}
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwKeysCount;
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+
+	for (DWORD dwKeyIndex = 0; (lpsUtf8Names != NULL) && (dwKeyIndex < dwKeysCount); dwKeyIndex++)
+	{
+		free(lpsUtf8Names[dwKeyIndex]);
+	}
+	free(lpsUtf8Names);
+	FreeTranscodeBuffer(&tbBuffer);
+}
+
+/// <summary>
+///		Measure NDJSON records of mixed script names written into captured output
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkOutputRecords(LPWSTR* lpsMixedNames, DWORD dwKeysCount, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	OUTPUTBUFFER obCapture;
+	ZeroMemory(&obCapture, sizeof(OUTPUTBUFFER));
+	DWORD dwPreviousFormat = GetOutputFormat();
+
+	SetThreadOutput(&obCapture);
+	SetOutputFormat(OUTPUT_FORMAT_NDJSON);
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "OutputRecords", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+		{
+			const OUTPUTFIELD ofFields[] = {
+				{ "index", NULL, "0" },
+				{ "key", lpsMixedNames[dwKeyIndex], NULL }
+			};
+			brResult.ullKeys += (OutputRecord(ofFields, sizeof(ofFields) / sizeof(ofFields[0])) > 0) ? 1 : 0;
+		}
+
+		// Captured text is dropped as stdout writer would do
+		obCapture.cbSize = 0;
+	}
+
+	brResult.ullOperations = (ULONGLONG)dwIterations * dwKeysCount;
+
+	SetOutputFormat(dwPreviousFormat);
+	SetThreadOutput(NULL);
+	FreeOutputBuffer(&obCapture);
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+}
+
+// Query server uses named pipes
+#ifdef _WIN32
+/// <summary>
+///		Answer LIST request of pipe benchmark with all key paths of served tree
+/// </summary>
+/// 
+/// <param name="argv">Program name, command name and its arguments</param>
+/// <param name="argc">Arguments count</param>
+/// 
+/// <returns>LPCSTR (NULL if command is unknown)</returns>
+static LPCSTR ProcessBenchmarkQuery(char** argv, int argc)
+{
+	if ((argc < 2) || (strcmp(argv[1], "LIST") != 0))
+	{
+		return NULL;
+	}
+
+	DWORD dwKeysCount = 0;
+	LPWSTR* lpsKeyNames = SearchRecursive(g_hQueryBenchmarkRoot, L"", &dwKeysCount);
+	if (lpsKeyNames == NULL)
+	{
+		return "Error!";
+	}
+
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+	{
+		OutputWPrintf(L"%ls\n", lpsKeyNames[dwKeyIndex]);
+	}
+
+	FreeLPWSTRArray(lpsKeyNames, dwKeysCount);
+	return "Ok!";
+}
+
+/// <summary>
+///		Measure framed queries sent over named pipe to server started on unique pipe
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void BenchmarkQueryPipe(HKEY hRoot, DWORD dwIterations, const SYNTHETICTREEPARAMS* lpParams, FILE* lpOutput)
+{
+	CHAR lpsPipeName[BENCHMARK_PIPE_NAME_LENGTH];
+	sprintf_s(lpsPipeName, BENCHMARK_PIPE_NAME_LENGTH, "RegistryEditorBenchmark%u", GetCurrentProcessId());
+
+	QUERYSERVER qsServer;
+	g_hQueryBenchmarkRoot = hRoot;
+	if (!StartQueryServer(lpsPipeName, ProcessBenchmarkQuery, &qsServer))
+	{
+		return;
+	}
+
+	char lpsCommand[] = "LIST";
+	char* argv[] = { lpsCommand };
+	OUTPUTBUFFER obResponse;
+	ZeroMemory(&obResponse, sizeof(OUTPUTBUFFER));
+	CHAR lpsResult[QUERY_MAX_RESULT_LENGTH];
+
+	BENCHMARKRESULT brResult;
+	double dStartTime = BeginBenchmark(&brResult, "QueryPipe", dwIterations);
+
+	for (DWORD dwIteration = 0; dwIteration < dwIterations; dwIteration++)
+	{
+		for (DWORD dwQueryIndex = 0; dwQueryIndex < BENCHMARK_QUERIES_PER_ITERATION; dwQueryIndex++)
+		{
+			if (!SendQuery(lpsPipeName, argv, 1, &obResponse, lpsResult, QUERY_MAX_RESULT_LENGTH))
+			{
+				continue;
+			}
+
+			for (DWORD dwOffset = 0; dwOffset < obResponse.cbSize; dwOffset++)
+			{
+				brResult.ullKeys += (obResponse.lpsData[dwOffset] == '\n') ? 1 : 0;
+			}
+
+			brResult.ullOperations++;
+		}
+	}
+
+	EndBenchmark(&brResult, dStartTime, lpParams, lpOutput);
+
+	StopQueryServer(&qsServer);
+	FreeOutputBuffer(&obResponse);
+}
+#endif
+
+/// <summary>
+///		Run all benchmarks against generated in-memory tree and print JSON lines
+/// </summary>
+/// 
+/// <param name="lpParams">Tree parameters</param>
+/// <param name="dwIterations">Iterations count</param>
+/// <param name="lpOutput">Output stream</param>
+/// 
+/// <returns>bool</returns>
+bool RunBenchmarks(const SYNTHETICTREEPARAMS* lpParams, DWORD dwIterations, FILE* lpOutput)
+{
+	if ((lpParams == NULL) || (dwIterations == 0) || (lpOutput == NULL))
+	{
+		return false;
+	}
+
+	DWORD dwTreeKeysCount;
+	SYNTHETICKEY* lpRoot = GenerateSyntheticTree(lpParams, &dwTreeKeysCount);
+	if (lpRoot == NULL)
+	{
+		return false;
+	}
+
+#ifdef _DEBUG
+	_CRT_ALLOC_HOOK lpfnPreviousHook = _CrtSetAllocHook(AllocationHook);
+#endif
+
+	SetRegBackend(GetSyntheticBackend());
+	HKEY hRoot = GetSyntheticKeyHandle(lpRoot);
+
+	// Key list shared by list based benchmarks
+	DWORD dwKeysCount = 0;
+	LPWSTR* lpsKeyNames = SearchRecursive(hRoot, L"", &dwKeysCount);
+	bool bResult = (lpsKeyNames != NULL) && (dwKeysCount != 0);
+
+	if (bResult)
+	{
+		// Deepest key generated last is searched, so the whole list has to be scanned
+		LPWSTR lpsSearchedKey = wcsrchr(lpsKeyNames[dwKeysCount - 1], L'\\');
+		lpsSearchedKey = (lpsSearchedKey == NULL) ? lpsKeyNames[dwKeysCount - 1] : lpsSearchedKey + 1;
+
+		BenchmarkCreateFullName(lpsKeyNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkSearchOneLevel(hRoot, lpsKeyNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkSearchRecursive(hRoot, dwIterations, lpParams, lpOutput);
+		BenchmarkProgressEstimate(hRoot, dwIterations, lpParams, lpOutput);
+		BenchmarkSearchKeyInList(lpsKeyNames, dwKeysCount, lpsSearchedKey, dwIterations, lpParams, lpOutput);
+		BenchmarkSearchKeyFuzzyInList(lpsKeyNames, dwKeysCount, lpsSearchedKey, dwIterations, lpParams, lpOutput);
+		BenchmarkParseRegExeOutput(dwIterations, lpParams, lpOutput);
+		BenchmarkFlagsPool(lpsKeyNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkSearchKey(hRoot, dwTreeKeysCount, lpsSearchedKey, dwIterations, lpParams, lpOutput);
+		BenchmarkImport(lpsKeyNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkExport(hRoot, lpsKeyNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkValueIndexBuild(hRoot, dwTreeKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkValueIndexSearch(hRoot, dwIterations, lpParams, lpOutput);
+		BenchmarkThrottle(dwTreeKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkExternalSort(lpsKeyNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		BenchmarkReplay(hRoot, dwIterations, lpParams, lpOutput);
+#ifdef _WIN32
+		BenchmarkQueryPipe(hRoot, dwIterations, lpParams, lpOutput);
+#endif
+
+		LPWSTR* lpsMixedNames = CreateMixedScriptNames(lpsKeyNames, dwKeysCount);
+		if (lpsMixedNames != NULL)
+		{
+			BenchmarkTranscodeToUtf8(lpsMixedNames, dwKeysCount, false, dwIterations, lpParams, lpOutput);
+			BenchmarkTranscodeToUtf8(lpsMixedNames, dwKeysCount, true, dwIterations, lpParams, lpOutput);
+			BenchmarkTranscodeToUtf16(lpsMixedNames, dwKeysCount, false, dwIterations, lpParams, lpOutput);
+			BenchmarkTranscodeToUtf16(lpsMixedNames, dwKeysCount, true, dwIterations, lpParams, lpOutput);
+			BenchmarkOutputRecords(lpsMixedNames, dwKeysCount, dwIterations, lpParams, lpOutput);
+		}
+		FreeLPWSTRArray(lpsMixedNames, dwKeysCount);
+	}
+
+	FreeLPWSTRArray(lpsKeyNames, dwKeysCount);
+	SetRegBackend(NULL);
+
+#ifdef _DEBUG
+	_CrtSetAllocHook(lpfnPreviousHook);
+#endif
+
+	FreeSyntheticTree(lpRoot);
+	return bResult;
+}
@@ -0,0 +1,89 @@
+#include "../Api/Platform.h"
+
+#include "../Api/Collections.h"
+#include "../Api/FuzzyMatch.h"
+#include "../Api/Instrumentation.h"
+
+/// <summary>
+///		Make sure array can hold required elements count, capacity grows twice
+///		and new elements are zeroed
+/// </summary>
+///
+/// <param name="lpArray">Array (may be NULL)</param>
+/// <param name="lpdwCapacity">Capacity in elements</param>
+/// <param name="dwRequired">Required elements count</param>
+/// <param name="cbElement">Element size</param>
+///
+/// <returns>bool</returns>
+bool ReserveArray(void** lpArray, DWORD* lpdwCapacity, DWORD dwRequired, SIZE_T cbElement)
+{
+	if (dwRequired <= *lpdwCapacity)
+	{
+		return true;
+	}
+
+	ULONGLONG ullNewCapacity = (*lpdwCapacity == 0) ? ARRAY_INITIAL_CAPACITY : *lpdwCapacity;
+	while (ullNewCapacity < dwRequired)
+	{
+		ullNewCapacity *= 2;
+	}
+
+	// Size of array must fit SIZE_T of 32-bit build too
+	if ((ullNewCapacity > MAXDWORD) || (ullNewCapacity > (SIZE_T)-1 / cbElement))
+	{
+		return false;
+	}
+
+	BYTE* lpNewArray = (BYTE*)realloc(*lpArray, (SIZE_T)ullNewCapacity * cbElement);
+	if (lpNewArray == NULL)
+	{
+		return false;
+	}
+
+	STAT_ALLOC((SIZE_T)ullNewCapacity * cbElement);
+	ZeroMemory(lpNewArray + *lpdwCapacity * cbElement, (SIZE_T)(ullNewCapacity - *lpdwCapacity) * cbElement);
+	*lpArray = lpNewArray;
+	*lpdwCapacity = (DWORD)ullNewCapacity;
+
+	return true;
+}
+
+/// <summary>
+///		Continue FNV-1a hash with characters of string
+/// </summary>
+///
+/// <param name="dwHash">HASH_INITIAL_VALUE or hash of preceding data</param>
+/// <param name="lpsText">String</param>
+/// <param name="cchText">Characters count (HASH_TERMINATED to stop at terminator)</param>
+/// <param name="bIgnoreCase">Hash case folded characters</param>
+///
+/// <returns>DWORD</returns>
+DWORD HashString(DWORD dwHash, LPCWSTR lpsText, DWORD cchText, bool bIgnoreCase)
+{
+	for (DWORD dwIndex = 0; (dwIndex < cchText) && (lpsText[dwIndex] != L'\0'); dwIndex++)
+	{
+		WCHAR wcChar = bIgnoreCase ? FoldChar(lpsText[dwIndex]) : lpsText[dwIndex];
+		dwHash = (dwHash ^ (DWORD)wcChar) * HASH_PRIME;
+	}
+
+	return dwHash;
+}
+
+/// <summary>
+///		Continue FNV-1a hash with words
+/// </summary>
+///
+/// <param name="dwHash">HASH_INITIAL_VALUE or hash of preceding data</param>
+/// <param name="lpdwWords">Words</param>
+/// <param name="dwWordsCount">Words count</param>
+///
+/// <returns>DWORD</returns>
+DWORD HashWords(DWORD dwHash, const DWORD* lpdwWords, DWORD dwWordsCount)
+{
+	for (DWORD dwIndex = 0; dwIndex < dwWordsCount; dwIndex++)
+	{
+		dwHash = (dwHash ^ lpdwWords[dwIndex]) * HASH_PRIME;
+	}
+
+	return dwHash;
+}
@@ -0,0 +1,766 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/ExternalSort.h"
+#include "../Api/Trace.h"
+
+static SIZE_T g_cbResultMemoryBudget = 0;
+
+typedef bool (*MERGEDITEMPROC)(void* lpContext, LPCWSTR lpsItem, DWORD cchItem, DWORD cchShared);
+
+typedef struct _SORTRUNWRITER {
+	FILE* lpFile;
+	ULONGLONG ullItemsCount;
+	ULONGLONG cbWritten;
+} SORTRUNWRITER;
+
+typedef struct _SORTEDITEMSINK {
+	SORTEDITEMPROC lpfnItem;
+	void* lpContext;
+} SORTEDITEMSINK;
+
+/// <summary>
+///		Take memory from budget
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void ChargeBudget(EXTERNALSORTER* lpSorter, SIZE_T cbSize)
+{
+	lpSorter->cbUsed += cbSize + EXTERNAL_SORT_ALLOCATION_OVERHEAD;
+	if (lpSorter->cbUsed > lpSorter->cbPeakUsed)
+	{
+		lpSorter->cbPeakUsed = lpSorter->cbUsed;
+	}
+}
+
+/// <summary>
+///		Give memory back to budget
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void ReleaseBudget(EXTERNALSORTER* lpSorter, SIZE_T cbSize)
+{
+	lpSorter->cbUsed -= cbSize + EXTERNAL_SORT_ALLOCATION_OVERHEAD;
+}
+
+/// <summary>
+///		Compare items for qsort
+/// </summary>
+/// 
+/// <returns>int</returns>
+static int CompareItems(const void* lpFirst, const void* lpSecond)
+{
+	return wcscmp(*(const LPCWSTR*)lpFirst, *(const LPCWSTR*)lpSecond);
+}
+
+/// <summary>
+///		Get length of common prefix
+/// </summary>
+/// 
+/// <returns>DWORD</returns>
+static DWORD GetSharedLength(LPCWSTR lpsFirst, LPCWSTR lpsSecond)
+{
+	DWORD cchShared = 0;
+	while ((lpsFirst[cchShared] != L'\0') && (lpsFirst[cchShared] == lpsSecond[cchShared]))
+	{
+		cchShared++;
+	}
+
+	return cchShared;
+}
+
+/// <summary>
+///		Get file name of run
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void GetRunFileName(const EXTERNALSORTER* lpSorter, DWORD dwRunId, LPWSTR lpsFileName)
+{
+	swprintf(lpsFileName, MAX_PATH, L"%ls.%u", lpSorter->lpsBaseName, dwRunId);
+}
+
+/// <summary>
+///		Write number by 7 bits, high bit marks that more bytes follow
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void WriteVarint(SORTRUNWRITER* lpWriter, DWORD dwValue)
+{
+	while (dwValue >= 0x80)
+	{
+		fputc((int)(dwValue & 0x7F) | 0x80, lpWriter->lpFile);
+		lpWriter->cbWritten++;
+		dwValue >>= 7;
+	}
+	fputc((int)dwValue, lpWriter->lpFile);
+	lpWriter->cbWritten++;
+}
+
+/// <summary>
+///		Read number written by WriteVarint
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool ReadVarint(FILE* lpFile, DWORD* lpdwValue)
+{
+	DWORD dwValue = 0;
+
+	for (DWORD dwShift = 0; dwShift < 32; dwShift += 7)
+	{
+		int iByte = fgetc(lpFile);
+		if (iByte == EOF)
+		{
+			return false;
+		}
+
+		dwValue |= (DWORD)(iByte & 0x7F) << dwShift;
+		if ((iByte & 0x80) == 0)
+		{
+			*lpdwValue = dwValue;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+///		Append item to run, only part not shared with previous item is stored
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool WriteRunItem(void* lpContext, LPCWSTR lpsItem, DWORD cchItem, DWORD cchShared)
+{
+	SORTRUNWRITER* lpWriter = (SORTRUNWRITER*)lpContext;
+
+	WriteVarint(lpWriter, cchShared);
+	WriteVarint(lpWriter, cchItem - cchShared);
+	lpWriter->cbWritten += (cchItem - cchShared) * sizeof(WCHAR);
+	lpWriter->ullItemsCount++;
+
+	return fwrite(lpsItem + cchShared, sizeof(WCHAR), cchItem - cchShared, lpWriter->lpFile) == cchItem - cchShared;
+}
+
+/// <summary>
+///		Pass merged item to caller
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool EmitSortedItem(void* lpContext, LPCWSTR lpsItem, DWORD cchItem, DWORD cchShared)
+{
+	SORTEDITEMSINK* lpSink = (SORTEDITEMSINK*)lpContext;
+
+	return lpSink->lpfnItem(lpSink->lpContext, lpsItem);
+}
+
+/// <summary>
+///		Open run file with buffer taken from budget
+/// </summary>
+/// 
+/// <returns>FILE* (NULL if failed)</returns>
+static FILE* OpenRunFile(EXTERNALSORTER* lpSorter, DWORD dwRunId, LPCWSTR lpsMode, BYTE** lpBuffer)
+{
+	WCHAR lpsFileName[MAX_PATH];
+	GetRunFileName(lpSorter, dwRunId, lpsFileName);
+
+	FILE* lpFile;
+	if (_wfopen_s(&lpFile, lpsFileName, lpsMode) != 0)
+	{
+		return NULL;
+	}
+
+	*lpBuffer = (BYTE*)malloc(lpSorter->cbRunBuffer);
+	if (*lpBuffer == NULL)
+	{
+		fclose(lpFile);
+		return NULL;
+	}
+
+	ChargeBudget(lpSorter, lpSorter->cbRunBuffer);
+	setvbuf(lpFile, (char*)*lpBuffer, _IOFBF, lpSorter->cbRunBuffer);
+
+	return lpFile;
+}
+
+/// <summary>
+///		Close run file and release its buffer
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool CloseRunFile(EXTERNALSORTER* lpSorter, FILE* lpFile, BYTE* lpBuffer)
+{
+	bool bResult = fclose(lpFile) == 0;
+
+	free(lpBuffer);
+	ReleaseBudget(lpSorter, lpSorter->cbRunBuffer);
+
+	return bResult;
+}
+
+/// <summary>
+///		Remember new run
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool AppendRun(EXTERNALSORTER* lpSorter, DWORD dwRunId, DWORD dwLevel, ULONGLONG ullItemsCount)
+{
+	if (lpSorter->dwRunsCount == lpSorter->dwRunsCapacity)
+	{
+		DWORD dwCapacity = (lpSorter->dwRunsCapacity == 0) ? lpSorter->dwFanIn : lpSorter->dwRunsCapacity * 2;
+		SORTRUN* lpRuns = (SORTRUN*)realloc(lpSorter->lpRuns, dwCapacity * sizeof(SORTRUN));
+
+		if (lpRuns == NULL)
+		{
+			return false;
+		}
+
+		if (lpSorter->lpRuns != NULL)
+		{
+			ReleaseBudget(lpSorter, lpSorter->dwRunsCapacity * sizeof(SORTRUN));
+		}
+		ChargeBudget(lpSorter, dwCapacity * sizeof(SORTRUN));
+
+		lpSorter->lpRuns = lpRuns;
+		lpSorter->dwRunsCapacity = dwCapacity;
+	}
+
+	lpSorter->lpRuns[lpSorter->dwRunsCount].dwRunId = dwRunId;
+	lpSorter->lpRuns[lpSorter->dwRunsCount].dwLevel = dwLevel;
+	lpSorter->lpRuns[lpSorter->dwRunsCount].ullItemsCount = ullItemsCount;
+	lpSorter->dwRunsCount++;
+
+	return true;
+}
+
+/// <summary>
+///		Read next item of run, it is rebuilt from prefix of previous item
+/// </summary>
+/// 
+/// <returns>bool (false at end of run or on error)</returns>
+static bool AdvanceRunReader(EXTERNALSORTER* lpSorter, SORTRUNREADER* lpReader)
+{
+	if (lpReader->ullItemsLeft == 0)
+	{
+		return false;
+	}
+
+	DWORD cchShared, cchSuffix;
+	if (!ReadVarint(lpReader->lpFile, &cchShared) || !ReadVarint(lpReader->lpFile, &cchSuffix) || (cchShared > lpReader->cchItem))
+	{
+		return false;
+	}
+
+	if (cchShared + cchSuffix + 1 > lpReader->cchCapacity)
+	{
+		DWORD cchCapacity = cchShared + cchSuffix + 1;
+		LPWSTR lpsItem = (LPWSTR)realloc(lpReader->lpsItem, cchCapacity * sizeof(WCHAR));
+
+		if (lpsItem == NULL)
+		{
+			return false;
+		}
+
+		ReleaseBudget(lpSorter, lpReader->cchCapacity * sizeof(WCHAR));
+		ChargeBudget(lpSorter, cchCapacity * sizeof(WCHAR));
+		lpReader->lpsItem = lpsItem;
+		lpReader->cchCapacity = cchCapacity;
+	}
+
+	if (fread(lpReader->lpsItem + cchShared, sizeof(WCHAR), cchSuffix, lpReader->lpFile) != cchSuffix)
+	{
+		return false;
+	}
+
+	lpReader->cchItem = cchShared + cchSuffix;
+	lpReader->lpsItem[lpReader->cchItem] = L'\0';
+	lpReader->ullItemsLeft--;
+
+	return true;
+}
+
+/// <summary>
+///		Restore heap order of readers from given position down
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void SiftDownReaders(SORTRUNREADER** lpHeap, DWORD dwHeapSize, DWORD dwIndex)
+{
+	for (;;)
+	{
+		DWORD dwSmallest = dwIndex;
+		DWORD dwLeft = dwIndex * 2 + 1;
+		DWORD dwRight = dwLeft + 1;
+
+		if ((dwLeft < dwHeapSize) && (wcscmp(lpHeap[dwLeft]->lpsItem, lpHeap[dwSmallest]->lpsItem) < 0))
+		{
+			dwSmallest = dwLeft;
+		}
+		if ((dwRight < dwHeapSize) && (wcscmp(lpHeap[dwRight]->lpsItem, lpHeap[dwSmallest]->lpsItem) < 0))
+		{
+			dwSmallest = dwRight;
+		}
+		if (dwSmallest == dwIndex)
+		{
+			return;
+		}
+
+		SORTRUNREADER* lpReader = lpHeap[dwIndex];
+		lpHeap[dwIndex] = lpHeap[dwSmallest];
+		lpHeap[dwSmallest] = lpReader;
+		dwIndex = dwSmallest;
+	}
+}
+
+/// <summary>
+///		K-way merge of runs, equal items are passed once
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool MergeRuns(EXTERNALSORTER* lpSorter, const SORTRUN* lpRuns, DWORD dwRunsCount, MERGEDITEMPROC lpfnItem, void* lpContext)
+{
+	SORTRUNREADER* lpReaders = (SORTRUNREADER*)calloc(dwRunsCount, sizeof(SORTRUNREADER));
+	SORTRUNREADER** lpHeap = (SORTRUNREADER**)calloc(dwRunsCount, sizeof(SORTRUNREADER*));
+	LPWSTR lpsLast = (LPWSTR)calloc(EXTERNAL_SORT_ITEM_BUFFER_LENGTH, sizeof(WCHAR));
+	DWORD cchLastCapacity = EXTERNAL_SORT_ITEM_BUFFER_LENGTH;
+	DWORD cchLast = 0;
+	bool bHasLast = false;
+	bool bResult = (lpReaders != NULL) && (lpHeap != NULL) && (lpsLast != NULL);
+
+	if (bResult)
+	{
+		ChargeBudget(lpSorter, dwRunsCount * (sizeof(SORTRUNREADER) + sizeof(SORTRUNREADER*)));
+		ChargeBudget(lpSorter, cchLastCapacity * sizeof(WCHAR));
+	}
+
+	// Open all runs and read their first items
+	DWORD dwHeapSize = 0;
+	for (DWORD dwIndex = 0; bResult && (dwIndex < dwRunsCount); dwIndex++)
+	{
+		SORTRUNREADER* lpReader = &lpReaders[dwIndex];
+		lpReader->lpFile = OpenRunFile(lpSorter, lpRuns[dwIndex].dwRunId, L"rb", &lpReader->lpBuffer);
+		lpReader->lpsItem = (LPWSTR)calloc(EXTERNAL_SORT_ITEM_BUFFER_LENGTH, sizeof(WCHAR));
+		lpReader->ullItemsLeft = lpRuns[dwIndex].ullItemsCount;
+
+		if (lpReader->lpsItem != NULL)
+		{
+			lpReader->cchCapacity = EXTERNAL_SORT_ITEM_BUFFER_LENGTH;
+			ChargeBudget(lpSorter, lpReader->cchCapacity * sizeof(WCHAR));
+		}
+
+		bResult = (lpReader->lpFile != NULL) && (lpReader->lpsItem != NULL);
+		if (bResult && AdvanceRunReader(lpSorter, lpReader))
+		{
+			lpHeap[dwHeapSize++] = lpReader;
+		}
+	}
+
+	for (DWORD dwIndex = dwHeapSize / 2; bResult && (dwIndex-- > 0); )
+	{
+		SiftDownReaders(lpHeap, dwHeapSize, dwIndex);
+	}
+
+	while (bResult && (dwHeapSize != 0))
+	{
+		SORTRUNREADER* lpReader = lpHeap[0];
+		DWORD cchShared = bHasLast ? GetSharedLength(lpsLast, lpReader->lpsItem) : 0;
+
+		// Runs are deduplicated, but same item may be in several runs
+		if (!bHasLast || (cchShared != cchLast) || (cchShared != lpReader->cchItem))
+		{
+			bResult = lpfnItem(lpContext, lpReader->lpsItem, lpReader->cchItem, cchShared);
+
+			if (lpReader->cchItem + 1 > cchLastCapacity)
+			{
+				LPWSTR lpsGrown = (LPWSTR)realloc(lpsLast, (lpReader->cchItem + 1) * sizeof(WCHAR));
+				if (lpsGrown == NULL)
+				{
+					bResult = false;
+					break;
+				}
+
+				ReleaseBudget(lpSorter, cchLastCapacity * sizeof(WCHAR));
+				ChargeBudget(lpSorter, (lpReader->cchItem + 1) * sizeof(WCHAR));
+				lpsLast = lpsGrown;
+				cchLastCapacity = lpReader->cchItem + 1;
+			}
+
+			memcpy(lpsLast + cchShared, lpReader->lpsItem + cchShared, (lpReader->cchItem - cchShared + 1) * sizeof(WCHAR));
+			cchLast = lpReader->cchItem;
+			bHasLast = true;
+		}
+
+		if (!AdvanceRunReader(lpSorter, lpReader))
+		{
+			// Run must end exactly after its items
+			bResult = bResult && (lpReader->ullItemsLeft == 0);
+			lpHeap[0] = lpHeap[--dwHeapSize];
+		}
+		SiftDownReaders(lpHeap, dwHeapSize, 0);
+	}
+
+	for (DWORD dwIndex = 0; (lpReaders != NULL) && (dwIndex < dwRunsCount); dwIndex++)
+	{
+		if (lpReaders[dwIndex].lpFile != NULL)
+		{
+			CloseRunFile(lpSorter, lpReaders[dwIndex].lpFile, lpReaders[dwIndex].lpBuffer);
+		}
+		if (lpReaders[dwIndex].lpsItem != NULL)
+		{
+			free(lpReaders[dwIndex].lpsItem);
+			ReleaseBudget(lpSorter, lpReaders[dwIndex].cchCapacity * sizeof(WCHAR));
+		}
+	}
+
+	if ((lpReaders != NULL) && (lpHeap != NULL) && (lpsLast != NULL))
+	{
+		ReleaseBudget(lpSorter, dwRunsCount * (sizeof(SORTRUNREADER) + sizeof(SORTRUNREADER*)));
+		ReleaseBudget(lpSorter, cchLastCapacity * sizeof(WCHAR));
+	}
+
+	free(lpReaders);
+	free(lpHeap);
+	free(lpsLast);
+
+	return bResult;
+}
+
+/// <summary>
+///		Delete files of runs and forget them
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void DeleteRuns(EXTERNALSORTER* lpSorter, DWORD dwFirstRun, DWORD dwRunsCount)
+{
+	WCHAR lpsFileName[MAX_PATH];
+
+	for (DWORD dwIndex = dwFirstRun; dwIndex < dwFirstRun + dwRunsCount; dwIndex++)
+	{
+		GetRunFileName(lpSorter, lpSorter->lpRuns[dwIndex].dwRunId, lpsFileName);
+		DeleteFile(lpsFileName);
+	}
+
+	memmove(&lpSorter->lpRuns[dwFirstRun], &lpSorter->lpRuns[dwFirstRun + dwRunsCount],
+		(lpSorter->dwRunsCount - dwFirstRun - dwRunsCount) * sizeof(SORTRUN));
+	lpSorter->dwRunsCount -= dwRunsCount;
+}
+
+/// <summary>
+///		Replace several runs by one merged run
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool CompactRuns(EXTERNALSORTER* lpSorter, DWORD dwFirstRun, DWORD dwRunsCount, DWORD dwLevel)
+{
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	DWORD dwRunId = lpSorter->dwNextRunId++;
+	BYTE* lpBuffer;
+	SORTRUNWRITER srwWriter;
+	ZeroMemory(&srwWriter, sizeof(SORTRUNWRITER));
+
+	srwWriter.lpFile = OpenRunFile(lpSorter, dwRunId, L"wb", &lpBuffer);
+	if (srwWriter.lpFile == NULL)
+	{
+		return false;
+	}
+
+	bool bResult = MergeRuns(lpSorter, &lpSorter->lpRuns[dwFirstRun], dwRunsCount, WriteRunItem, &srwWriter);
+	bResult = CloseRunFile(lpSorter, srwWriter.lpFile, lpBuffer) && bResult;
+
+	DeleteRuns(lpSorter, dwFirstRun, dwRunsCount);
+	bResult = bResult && AppendRun(lpSorter, dwRunId, dwLevel, srwWriter.ullItemsCount);
+	lpSorter->ullSpilledBytes += srwWriter.cbWritten;
+
+	EndTraceSpan("merge runs", "sort", ullTraceStart, NULL);
+
+	return bResult;
+}
+
+/// <summary>
+///		Write sorted items held in memory as new run and free them
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool SpillItems(EXTERNALSORTER* lpSorter)
+{
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	DWORD dwRunId = lpSorter->dwNextRunId++;
+	BYTE* lpBuffer;
+	SORTRUNWRITER srwWriter;
+	ZeroMemory(&srwWriter, sizeof(SORTRUNWRITER));
+
+	srwWriter.lpFile = OpenRunFile(lpSorter, dwRunId, L"wb", &lpBuffer);
+	if (srwWriter.lpFile == NULL)
+	{
+		return false;
+	}
+
+	qsort(lpSorter->lpsItems, lpSorter->dwItemsCount, sizeof(LPWSTR), CompareItems);
+
+	bool bResult = true;
+	DWORD cchPrevious = 0;
+
+	for (DWORD dwIndex = 0; dwIndex < lpSorter->dwItemsCount; dwIndex++)
+	{
+		LPWSTR lpsItem = lpSorter->lpsItems[dwIndex];
+		DWORD cchItem = lstrlen(lpsItem);
+		DWORD cchShared = (dwIndex == 0) ? 0 : GetSharedLength(lpSorter->lpsItems[dwIndex - 1], lpsItem);
+
+		if ((dwIndex == 0) || (cchShared != cchPrevious) || (cchShared != cchItem))
+		{
+			bResult = bResult && WriteRunItem(&srwWriter, lpsItem, cchItem, cchShared);
+		}
+		cchPrevious = cchItem;
+	}
+
+	bResult = CloseRunFile(lpSorter, srwWriter.lpFile, lpBuffer) && bResult;
+
+	for (DWORD dwIndex = 0; dwIndex < lpSorter->dwItemsCount; dwIndex++)
+	{
+		ReleaseBudget(lpSorter, (lstrlen(lpSorter->lpsItems[dwIndex]) + 1) * sizeof(WCHAR));
+		free(lpSorter->lpsItems[dwIndex]);
+	}
+	lpSorter->dwItemsCount = 0;
+
+	bResult = bResult && AppendRun(lpSorter, dwRunId, 0, srwWriter.ullItemsCount);
+	lpSorter->ullSpilledBytes += srwWriter.cbWritten;
+
+	// Tiered merging: fan-in runs of one level become one run of next level,
+	// so count of runs grows with logarithm of items count
+	while (bResult && (lpSorter->dwRunsCount >= lpSorter->dwFanIn))
+	{
+		DWORD dwLevel = lpSorter->lpRuns[lpSorter->dwRunsCount - 1].dwLevel;
+		DWORD dwSameLevelCount = 0;
+
+		while ((dwSameLevelCount < lpSorter->dwRunsCount) && (lpSorter->lpRuns[lpSorter->dwRunsCount - 1 - dwSameLevelCount].dwLevel == dwLevel))
+		{
+			dwSameLevelCount++;
+		}
+
+		if (dwSameLevelCount < lpSorter->dwFanIn)
+		{
+			break;
+		}
+
+		bResult = CompactRuns(lpSorter, lpSorter->dwRunsCount - dwSameLevelCount, dwSameLevelCount, dwLevel + 1);
+	}
+
+	EndTraceSpan("spill", "sort", ullTraceStart, NULL);
+
+	return bResult;
+}
+
+/// <summary>
+///		Initialize sorter which keeps memory usage under budget by spilling to temporary directory
+/// </summary>
+/// 
+/// <param name="lpSorter">Sorter</param>
+/// <param name="cbBudget">Memory budget (bytes)</param>
+/// <param name="lpsDirectory">Directory for runs (NULL for temporary directory)</param>
+/// 
+/// <returns>bool</returns>
+bool InitExternalSorter(EXTERNALSORTER* lpSorter, SIZE_T cbBudget, LPCWSTR lpsDirectory)
+{
+	ZeroMemory(lpSorter, sizeof(EXTERNALSORTER));
+	lpSorter->cbBudget = (cbBudget < EXTERNAL_SORT_MIN_BUDGET) ? EXTERNAL_SORT_MIN_BUDGET : cbBudget;
+
+	lpSorter->cbRunBuffer = (DWORD)(lpSorter->cbBudget / 16);
+	if (lpSorter->cbRunBuffer < EXTERNAL_SORT_MIN_RUN_BUFFER)
+	{
+		lpSorter->cbRunBuffer = EXTERNAL_SORT_MIN_RUN_BUFFER;
+	}
+	if (lpSorter->cbRunBuffer > EXTERNAL_SORT_MAX_RUN_BUFFER)
+	{
+		lpSorter->cbRunBuffer = EXTERNAL_SORT_MAX_RUN_BUFFER;
+	}
+
+	// Merge holds output buffer, last item and buffers of every merged run
+	SIZE_T cbPerRun = lpSorter->cbRunBuffer + EXTERNAL_SORT_ITEM_BUFFER_LENGTH * sizeof(WCHAR) +
+		sizeof(SORTRUNREADER) + sizeof(SORTRUNREADER*) + sizeof(SORTRUN) * 2 + EXTERNAL_SORT_ALLOCATION_OVERHEAD * 4;
+	SIZE_T cbMergeReserve = lpSorter->cbRunBuffer * 2 + EXTERNAL_SORT_ITEM_BUFFER_LENGTH * sizeof(WCHAR) + EXTERNAL_SORT_ALLOCATION_OVERHEAD * 8;
+	lpSorter->dwFanIn = (DWORD)((lpSorter->cbBudget - cbMergeReserve) / cbPerRun);
+	if (lpSorter->dwFanIn < 2)
+	{
+		lpSorter->dwFanIn = 2;
+	}
+
+	WCHAR lpsTempPath[MAX_PATH];
+	if (lpsDirectory == NULL)
+	{
+		if (GetTempPath(MAX_PATH, lpsTempPath) == 0)
+		{
+			return false;
+		}
+		lpsDirectory = lpsTempPath;
+	}
+
+	// Empty file reserves unique name, runs are named after it
+	if (GetTempFileName(lpsDirectory, L"rsr", 0, lpSorter->lpsBaseName) == 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Add item, items held in memory are spilled to run when budget is reached
+/// </summary>
+/// 
+/// <param name="lpSorter">Sorter</param>
+/// <param name="lpsItem">Item</param>
+/// <param name="cchItem">Item length</param>
+/// 
+/// <returns>bool</returns>
+bool AddSortedItem(EXTERNALSORTER* lpSorter, LPCWSTR lpsItem, DWORD cchItem)
+{
+	SIZE_T cbItem = (cchItem + 1) * sizeof(WCHAR);
+	SIZE_T cbGrowth = (lpSorter->dwItemsCount == lpSorter->dwItemsCapacity) ? lpSorter->dwItemsCapacity * sizeof(LPWSTR) : 0;
+
+	// Buffer of run file is reserved, spill needs it
+	if ((lpSorter->dwItemsCount != 0) &&
+		(lpSorter->cbUsed + cbItem + cbGrowth + EXTERNAL_SORT_ALLOCATION_OVERHEAD * 2 + lpSorter->cbRunBuffer > lpSorter->cbBudget))
+	{
+		if (!SpillItems(lpSorter))
+		{
+			return false;
+		}
+	}
+
+	if (lpSorter->dwItemsCount == lpSorter->dwItemsCapacity)
+	{
+		DWORD dwCapacity = (lpSorter->dwItemsCapacity == 0) ? 256 : lpSorter->dwItemsCapacity * 2;
+		LPWSTR* lpsItems = (LPWSTR*)realloc(lpSorter->lpsItems, dwCapacity * sizeof(LPWSTR));
+
+		if (lpsItems == NULL)
+		{
+			return false;
+		}
+
+		if (lpSorter->lpsItems != NULL)
+		{
+			ReleaseBudget(lpSorter, lpSorter->dwItemsCapacity * sizeof(LPWSTR));
+		}
+		ChargeBudget(lpSorter, dwCapacity * sizeof(LPWSTR));
+
+		lpSorter->lpsItems = lpsItems;
+		lpSorter->dwItemsCapacity = dwCapacity;
+	}
+
+	LPWSTR lpsCopy = (LPWSTR)malloc(cbItem);
+	if (lpsCopy == NULL)
+	{
+		return false;
+	}
+
+	memcpy(lpsCopy, lpsItem, cchItem * sizeof(WCHAR));
+	lpsCopy[cchItem] = L'\0';
+	ChargeBudget(lpSorter, cbItem);
+	lpSorter->lpsItems[lpSorter->dwItemsCount++] = lpsCopy;
+
+	return true;
+}
+
+/// <summary>
+///		Pass all added items in ascending order without duplicates.
+///		Items that fit in budget are sorted in memory, otherwise runs are merged.
+/// </summary>
+/// 
+/// <param name="lpSorter">Sorter</param>
+/// <param name="lpfnItem">Called for every item</param>
+/// <param name="lpContext">Passed to lpfnItem</param>
+/// 
+/// <returns>bool</returns>
+bool MergeSortedItems(EXTERNALSORTER* lpSorter, SORTEDITEMPROC lpfnItem, void* lpContext)
+{
+	if (lpSorter->dwRunsCount == 0)
+	{
+		qsort(lpSorter->lpsItems, lpSorter->dwItemsCount, sizeof(LPWSTR), CompareItems);
+
+		for (DWORD dwIndex = 0; dwIndex < lpSorter->dwItemsCount; dwIndex++)
+		{
+			if (((dwIndex == 0) || (wcscmp(lpSorter->lpsItems[dwIndex - 1], lpSorter->lpsItems[dwIndex]) != 0)) &&
+				!lpfnItem(lpContext, lpSorter->lpsItems[dwIndex]))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Rest of items is spilled too, so merge gets whole budget
+	if ((lpSorter->dwItemsCount != 0) && !SpillItems(lpSorter))
+	{
+		return false;
+	}
+
+	while (lpSorter->dwRunsCount > lpSorter->dwFanIn)
+	{
+		if (!CompactRuns(lpSorter, 0, lpSorter->dwFanIn, lpSorter->lpRuns[lpSorter->dwFanIn - 1].dwLevel + 1))
+		{
+			return false;
+		}
+	}
+
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	SORTEDITEMSINK sisSink;
+	sisSink.lpfnItem = lpfnItem;
+	sisSink.lpContext = lpContext;
+
+	bool bResult = MergeRuns(lpSorter, lpSorter->lpRuns, lpSorter->dwRunsCount, EmitSortedItem, &sisSink);
+	EndTraceSpan("merge", "sort", ullTraceStart, NULL);
+
+	return bResult;
+}
+
+/// <summary>
+///		Free items and delete runs
+/// </summary>
+/// 
+/// <param name="lpSorter">Sorter</param>
+/// 
+/// <returns>void</returns>
+void FreeExternalSorter(EXTERNALSORTER* lpSorter)
+{
+	for (DWORD dwIndex = 0; dwIndex < lpSorter->dwItemsCount; dwIndex++)
+	{
+		free(lpSorter->lpsItems[dwIndex]);
+	}
+	free(lpSorter->lpsItems);
+
+	if (lpSorter->lpRuns != NULL)
+	{
+		DeleteRuns(lpSorter, 0, lpSorter->dwRunsCount);
+		free(lpSorter->lpRuns);
+	}
+
+	if (lpSorter->lpsBaseName[0] != L'\0')
+	{
+		DeleteFile(lpSorter->lpsBaseName);
+	}
+
+	ZeroMemory(lpSorter, sizeof(EXTERNALSORTER));
+}
+
+/// <summary>
+///		Set memory budget of commands that collect results (0 for no limit)
+/// </summary>
+/// 
+/// <param name="cbBudget">Memory budget (bytes)</param>
+/// 
+/// <returns>void</returns>
+void SetResultMemoryBudget(SIZE_T cbBudget)
+{
+	g_cbResultMemoryBudget = cbBudget;
+}
+
+/// <summary>
+///		Get memory budget of commands that collect results
+/// </summary>
+/// 
+/// <returns>SIZE_T (0 for no limit)</returns>
+SIZE_T GetResultMemoryBudget()
+{
+	return g_cbResultMemoryBudget;
+}
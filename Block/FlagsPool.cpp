@@ -0,0 +1,331 @@
+#include "../Api/Platform.h"
+#include <stdlib.h>
+
+#include "../Api/FlagsPool.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Collections.h"
+
+static SRWLOCK g_srwFlagsCache = SRWLOCK_INIT;
+static FLAGSCACHEENTRY** g_lpFlagsBuckets = NULL;
+static DWORD g_dwFlagsCacheCount = 0;
+
+/// <summary>
+///		Run reg.exe
+/// </summary>
+/// 
+/// <returns>LPSTR</returns>
+static LPSTR RunRegExe(void* lpContext, WCHAR* lpsCommand)
+{
+	return ExecuteRegExe(lpsCommand);
+}
+
+static const CHILDRUNNER g_crRegExeRunner = {
+	RunRegExe,
+	NULL,
+};
+
+/// <summary>
+///		Find flags of key queried before
+/// </summary>
+/// 
+/// <returns>FLAGSCACHEENTRY* (NULL if key was not queried)</returns>
+static FLAGSCACHEENTRY* LookupFlagsCache(LPCWSTR lpsCommand, DWORD dwHash)
+{
+	FLAGSCACHEENTRY* lpResult = NULL;
+
+	AcquireSRWLockShared(&g_srwFlagsCache);
+
+	if (g_lpFlagsBuckets != NULL)
+	{
+		for (FLAGSCACHEENTRY* lpEntry = g_lpFlagsBuckets[dwHash % FLAGS_CACHE_BUCKETS_COUNT]; lpEntry != NULL; lpEntry = lpEntry->lpNext)
+		{
+			if ((lpEntry->dwHash == dwHash) && (lstrcmpi(lpEntry->lpsCommand, lpsCommand) == 0))
+			{
+				lpResult = lpEntry;
+				break;
+			}
+		}
+	}
+
+	ReleaseSRWLockShared(&g_srwFlagsCache);
+
+	return lpResult;
+}
+
+/// <summary>
+///		Free flag values
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void FreeFlags(KEYFLAG* kfFlags, DWORD dwFlagsCount)
+{
+	for (DWORD dwIndex = 0; dwIndex < dwFlagsCount; dwIndex++)
+	{
+		free(kfFlags[dwIndex].lpsFlagValue);
+	}
+	free(kfFlags);
+}
+
+/// <summary>
+///		Keep parsed flags for lifetime of process, entries are never removed so results may point to them.
+///		Cache stops growing at FLAGS_CACHE_MAX_ENTRIES, then flags stay with caller.
+/// </summary>
+/// 
+/// <returns>FLAGSCACHEENTRY* (entry added by other thread wins, NULL if cache is full or no memory)</returns>
+static FLAGSCACHEENTRY* StoreFlagsCache(LPCWSTR lpsCommand, DWORD dwHash, KEYFLAG* kfFlags, DWORD dwFlagsCount)
+{
+	FLAGSCACHEENTRY* lpResult = NULL;
+
+	AcquireSRWLockExclusive(&g_srwFlagsCache);
+
+	if (g_lpFlagsBuckets == NULL)
+	{
+		g_lpFlagsBuckets = (FLAGSCACHEENTRY**)calloc(FLAGS_CACHE_BUCKETS_COUNT, sizeof(FLAGSCACHEENTRY*));
+		STAT_ALLOC(FLAGS_CACHE_BUCKETS_COUNT * sizeof(FLAGSCACHEENTRY*));
+	}
+
+	if (g_lpFlagsBuckets != NULL)
+	{
+		FLAGSCACHEENTRY** lpBucket = &g_lpFlagsBuckets[dwHash % FLAGS_CACHE_BUCKETS_COUNT];
+
+		for (FLAGSCACHEENTRY* lpEntry = *lpBucket; lpEntry != NULL; lpEntry = lpEntry->lpNext)
+		{
+			if ((lpEntry->dwHash == dwHash) && (lstrcmpi(lpEntry->lpsCommand, lpsCommand) == 0))
+			{
+				lpResult = lpEntry;
+				break;
+			}
+		}
+
+		if ((lpResult == NULL) && (g_dwFlagsCacheCount < FLAGS_CACHE_MAX_ENTRIES))
+		{
+			lpResult = (FLAGSCACHEENTRY*)calloc(1, sizeof(FLAGSCACHEENTRY));
+			LPWSTR lpsCommandCopy = _wcsdup(lpsCommand);
+
+			if ((lpResult == NULL) || (lpsCommandCopy == NULL))
+			{
+				free(lpResult);
+				free(lpsCommandCopy);
+				lpResult = NULL;
+			}
+			else
+			{
+				STAT_ALLOC(sizeof(FLAGSCACHEENTRY));
+				lpResult->lpsCommand = lpsCommandCopy;
+				lpResult->dwHash = dwHash;
+				lpResult->kfFlags = kfFlags;
+				lpResult->dwFlagsCount = dwFlagsCount;
+				lpResult->lpNext = *lpBucket;
+				*lpBucket = lpResult;
+				g_dwFlagsCacheCount++;
+			}
+		}
+		else if (lpResult != NULL)
+		{
+			// Same key was stored by other thread
+			FreeFlags(kfFlags, dwFlagsCount);
+		}
+	}
+
+	ReleaseSRWLockExclusive(&g_srwFlagsCache);
+
+	return lpResult;
+}
+
+/// <summary>
+///		Get flags of one key from cache or from child process
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void QueryOneKeyFlags(FLAGSPOOL* lpPool, FLAGSRESULT* lpResult)
+{
+	WCHAR* lpsCommand = CreateFlagsQuery(lpPool->lpsKeyRoot, lpResult->lpsSubkeyPath);
+	if (lpsCommand == NULL)
+	{
+		return;
+	}
+
+	DWORD dwHash = HashString(HASH_INITIAL_VALUE, lpsCommand, HASH_TERMINATED, true);
+	FLAGSCACHEENTRY* lpEntry = LookupFlagsCache(lpsCommand, dwHash);
+
+	if (lpEntry != NULL)
+	{
+		lpResult->bCached = true;
+	}
+	else
+	{
+		LPSTR lpsRegExeOutput = lpPool->lpRunner->lpfnRun(lpPool->lpRunner->lpContext, lpsCommand);
+		DWORD dwFlagsCount;
+		KEYFLAG* kfFlags = GetInitializedFlags(&dwFlagsCount);
+
+		if ((kfFlags != NULL) && ParseRegExeOutput(lpsRegExeOutput, kfFlags, dwFlagsCount))
+		{
+			lpEntry = StoreFlagsCache(lpsCommand, dwHash, kfFlags, dwFlagsCount);
+
+			if (lpEntry == NULL)
+			{
+				lpResult->kfFlags = kfFlags;
+				lpResult->dwFlagsCount = dwFlagsCount;
+				lpResult->bOwned = true;
+			}
+		}
+		else if (kfFlags != NULL)
+		{
+			// Failed queries are not cached, key may appear later
+			FreeFlags(kfFlags, dwFlagsCount);
+		}
+
+		free(lpsRegExeOutput);
+	}
+
+	if (lpEntry != NULL)
+	{
+		lpResult->kfFlags = lpEntry->kfFlags;
+		lpResult->dwFlagsCount = lpEntry->dwFlagsCount;
+	}
+
+	free(lpsCommand);
+}
+
+/// <summary>
+///		Worker of pool, takes next key until all keys are taken
+/// </summary>
+/// 
+/// <returns>DWORD</returns>
+static DWORD WINAPI RunFlagsQueries(LPVOID lpParameter)
+{
+	FLAGSPOOL* lpPool = (FLAGSPOOL*)lpParameter;
+
+	for (;;)
+	{
+		DWORD dwIndex = (DWORD)InterlockedIncrement(&lpPool->lNextKey) - 1;
+		if (dwIndex >= lpPool->dwKeysCount)
+		{
+			break;
+		}
+
+		QueryOneKeyFlags(lpPool, &lpPool->lpResults[dwIndex]);
+
+		AcquireSRWLockExclusive(&lpPool->srwLock);
+		lpPool->lpbCompleted[dwIndex] = true;
+		ReleaseSRWLockExclusive(&lpPool->srwLock);
+		WakeAllConditionVariable(&lpPool->cvCompleted);
+	}
+
+	return 0;
+}
+
+/// <summary>
+///		Get runner of reg.exe child processes
+/// </summary>
+/// 
+/// <returns>const CHILDRUNNER*</returns>
+const CHILDRUNNER* GetRegExeRunner()
+{
+	return &g_crRegExeRunner;
+}
+
+/// <summary>
+///		Query flags of many keys by pool of concurrent child processes.
+///		Results are reported in order of keys as soon as all previous keys are done.
+/// </summary>
+/// 
+/// <param name="lpsKeyRoot">Hkey root path</param>
+/// <param name="lpsSubkeyPaths">Keys paths in hkey</param>
+/// <param name="dwKeysCount">Keys count</param>
+/// <param name="dwJobsCount">Child processes running at once</param>
+/// <param name="lpRunner">Runner of child processes (NULL for reg.exe)</param>
+/// <param name="lpfnResult">Called for every key</param>
+/// <param name="lpContext">Passed to lpfnResult</param>
+/// 
+/// <returns>bool</returns>
+bool QueryKeyFlags(LPCWSTR lpsKeyRoot, LPCWSTR* lpsSubkeyPaths, DWORD dwKeysCount, DWORD dwJobsCount,
+	const CHILDRUNNER* lpRunner, FLAGSRESULTPROC lpfnResult, void* lpContext)
+{
+	if ((lpsKeyRoot == NULL) || (lpsSubkeyPaths == NULL) || (dwKeysCount == 0) || (lpfnResult == NULL))
+	{
+		return false;
+	}
+
+	if ((dwJobsCount == 0) || (dwJobsCount > FLAGS_POOL_MAX_JOBS))
+	{
+		dwJobsCount = FLAGS_POOL_DEFAULT_JOBS;
+	}
+	if (dwJobsCount > dwKeysCount)
+	{
+		dwJobsCount = dwKeysCount;
+	}
+
+	FLAGSPOOL fpPool;
+	ZeroMemory(&fpPool, sizeof(FLAGSPOOL));
+	fpPool.lpsKeyRoot = lpsKeyRoot;
+	fpPool.lpsSubkeyPaths = lpsSubkeyPaths;
+	fpPool.dwKeysCount = dwKeysCount;
+	fpPool.lpRunner = (lpRunner == NULL) ? &g_crRegExeRunner : lpRunner;
+	fpPool.lpResults = (FLAGSRESULT*)calloc(dwKeysCount, sizeof(FLAGSRESULT));
+	fpPool.lpbCompleted = (bool*)calloc(dwKeysCount, sizeof(bool));
+	InitializeSRWLock(&fpPool.srwLock);
+	InitializeConditionVariable(&fpPool.cvCompleted);
+
+	if ((fpPool.lpResults == NULL) || (fpPool.lpbCompleted == NULL))
+	{
+		free(fpPool.lpResults);
+		free(fpPool.lpbCompleted);
+		return false;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwKeysCount; dwIndex++)
+	{
+		fpPool.lpResults[dwIndex].lpsSubkeyPath = lpsSubkeyPaths[dwIndex];
+	}
+
+	// Every worker keeps one child process running, so pool size is threads count
+	HANDLE hThreads[FLAGS_POOL_MAX_JOBS];
+	DWORD dwStartedCount = 0;
+
+	for (DWORD dwIndex = 0; dwIndex < dwJobsCount; dwIndex++)
+	{
+		hThreads[dwStartedCount] = CreateThread(NULL, 0, RunFlagsQueries, &fpPool, 0, NULL);
+		if (hThreads[dwStartedCount] != NULL)
+		{
+			dwStartedCount++;
+		}
+	}
+
+	// No threads, queries are run one by one
+	if (dwStartedCount == 0)
+	{
+		RunFlagsQueries(&fpPool);
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwKeysCount; dwIndex++)
+	{
+		AcquireSRWLockExclusive(&fpPool.srwLock);
+		while (!fpPool.lpbCompleted[dwIndex])
+		{
+			SleepConditionVariableSRW(&fpPool.cvCompleted, &fpPool.srwLock, INFINITE, 0);
+		}
+		ReleaseSRWLockExclusive(&fpPool.srwLock);
+
+		lpfnResult(lpContext, dwIndex, &fpPool.lpResults[dwIndex]);
+
+		if (fpPool.lpResults[dwIndex].bOwned)
+		{
+			FreeFlags((KEYFLAG*)fpPool.lpResults[dwIndex].kfFlags, fpPool.lpResults[dwIndex].dwFlagsCount);
+		}
+	}
+
+	if (dwStartedCount != 0)
+	{
+		WaitForMultipleObjects(dwStartedCount, hThreads, TRUE, INFINITE);
+	}
+	for (DWORD dwIndex = 0; dwIndex < dwStartedCount; dwIndex++)
+	{
+		CloseHandle(hThreads[dwIndex]);
+	}
+
+	free(fpPool.lpResults);
+	free(fpPool.lpbCompleted);
+
+	return true;
+}
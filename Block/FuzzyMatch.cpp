@@ -0,0 +1,178 @@
+#include "../Api/Platform.h"
+
+#include "../Api/FuzzyMatch.h"
+
+// Lower case of every BMP code unit, built by one CharLowerBuffW call on first use
+struct FOLDTABLE {
+	WCHAR wcFolded[FUZZY_FOLD_TABLE_SIZE];
+
+	FOLDTABLE();
+};
+
+FOLDTABLE::FOLDTABLE()
+{
+	for (DWORD dwIndex = 0; dwIndex < FUZZY_FOLD_TABLE_SIZE; dwIndex++)
+	{
+		wcFolded[dwIndex] = (WCHAR)dwIndex;
+	}
+
+	CharLowerBuffW(wcFolded, FUZZY_FOLD_TABLE_SIZE);
+}
+
+/// <summary>
+///		Case fold UTF-16 code unit, ASCII directly and the rest of BMP from table
+/// </summary>
+/// 
+/// <param name="wcChar">Character</param>
+/// 
+/// <returns>WCHAR</returns>
+WCHAR FoldChar(WCHAR wcChar)
+{
+	if (wcChar < FUZZY_ASCII_COUNT)
+	{
+		return ((wcChar >= L'A') && (wcChar <= L'Z')) ? (WCHAR)(wcChar + (L'a' - L'A')) : wcChar;
+	}
+
+	static const FOLDTABLE ftTable;
+	if ((DWORD)wcChar < FUZZY_FOLD_TABLE_SIZE)
+	{
+		return ftTable.wcFolded[wcChar];
+	}
+
+	// Only 32-bit WCHAR has code points past BMP
+	CharLowerBuffW(&wcChar, 1);
+
+	return wcChar;
+}
+
+/// <summary>
+///		Get match mask of pattern positions equal to character
+/// </summary>
+/// 
+/// <param name="lpPattern">Compiled pattern</param>
+/// <param name="wcChar">Folded character</param>
+/// 
+/// <returns>ULONGLONG</returns>
+static ULONGLONG GetCharMask(const FUZZYPATTERN* lpPattern, WCHAR wcChar)
+{
+	if (wcChar < FUZZY_ASCII_COUNT)
+	{
+		return lpPattern->ullAsciiMasks[wcChar];
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < lpPattern->dwOtherCount; dwIndex++)
+	{
+		if (lpPattern->wcOtherChars[dwIndex] == wcChar)
+		{
+			return lpPattern->ullOtherMasks[dwIndex];
+		}
+	}
+
+	return 0;
+}
+
+/// <summary>
+///		Build match masks of case folded pattern
+/// </summary>
+/// 
+/// <param name="lpsPattern">Pattern (1..64 characters)</param>
+/// <param name="lpPattern">Compiled pattern</param>
+/// 
+/// <returns>bool</returns>
+bool CompileFuzzyPattern(LPCWSTR lpsPattern, FUZZYPATTERN* lpPattern)
+{
+	DWORD dwLength = (lpsPattern == NULL) ? 0 : lstrlen(lpsPattern);
+	if ((dwLength == 0) || (dwLength > FUZZY_MAX_PATTERN_LENGTH))
+	{
+		return false;
+	}
+
+	ZeroMemory(lpPattern, sizeof(FUZZYPATTERN));
+	lpPattern->dwLength = dwLength;
+
+	for (DWORD dwPosition = 0; dwPosition < dwLength; dwPosition++)
+	{
+		WCHAR wcChar = FoldChar(lpsPattern[dwPosition]);
+		ULONGLONG ullBit = 1ULL << dwPosition;
+
+		if (wcChar < FUZZY_ASCII_COUNT)
+		{
+			lpPattern->ullAsciiMasks[wcChar] |= ullBit;
+			continue;
+		}
+
+		// Few distinct non-ASCII characters are kept in short list
+		DWORD dwIndex = 0;
+		while ((dwIndex < lpPattern->dwOtherCount) && (lpPattern->wcOtherChars[dwIndex] != wcChar))
+		{
+			dwIndex++;
+		}
+
+		if (dwIndex == lpPattern->dwOtherCount)
+		{
+			lpPattern->wcOtherChars[dwIndex] = wcChar;
+			lpPattern->dwOtherCount++;
+		}
+		lpPattern->ullOtherMasks[dwIndex] |= ullBit;
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Edit distance between pattern and whole text (Myers' bit-vector algorithm in Hyyro's formulation)
+/// </summary>
+/// 
+/// <param name="lpPattern">Compiled pattern</param>
+/// <param name="lpsText">Text</param>
+/// <param name="dwTextLength">Text length</param>
+/// <param name="dwMaxDistance">Largest distance of interest</param>
+/// 
+/// <returns>DWORD (dwMaxDistance + 1 if distance is larger)</returns>
+DWORD GetFuzzyDistance(const FUZZYPATTERN* lpPattern, LPCWSTR lpsText, DWORD dwTextLength, DWORD dwMaxDistance)
+{
+	DWORD dwPatternLength = lpPattern->dwLength;
+
+	// Distance is at least difference of lengths
+	if ((dwTextLength > dwPatternLength + dwMaxDistance) || (dwPatternLength > dwTextLength + dwMaxDistance))
+	{
+		return dwMaxDistance + 1;
+	}
+
+	ULONGLONG ullLastBit = 1ULL << (dwPatternLength - 1);
+	ULONGLONG ullPositiveVertical = ~0ULL;
+	ULONGLONG ullNegativeVertical = 0;
+	DWORD dwScore = dwPatternLength;
+
+	for (DWORD dwPosition = 0; dwPosition < dwTextLength; dwPosition++)
+	{
+		ULONGLONG ullEqual = GetCharMask(lpPattern, FoldChar(lpsText[dwPosition]));
+		ULONGLONG ullVertical = ullEqual | ullNegativeVertical;
+		ULONGLONG ullHorizontal = (((ullEqual & ullPositiveVertical) + ullPositiveVertical) ^ ullPositiveVertical) | ullEqual;
+		ULONGLONG ullPositiveHorizontal = ullNegativeVertical | ~(ullHorizontal | ullPositiveVertical);
+		ULONGLONG ullNegativeHorizontal = ullPositiveVertical & ullHorizontal;
+
+		if (ullPositiveHorizontal & ullLastBit)
+		{
+			dwScore++;
+		}
+		else if (ullNegativeHorizontal & ullLastBit)
+		{
+			dwScore--;
+		}
+
+		// First row grows by one per text character as whole text must match
+		ullPositiveHorizontal = (ullPositiveHorizontal << 1) | 1;
+		ullNegativeHorizontal <<= 1;
+		ullPositiveVertical = ullNegativeHorizontal | ~(ullVertical | ullPositiveHorizontal);
+		ullNegativeVertical = ullPositiveHorizontal & ullVertical;
+
+		// Score drops at most by one per remaining character
+		if (dwScore > dwMaxDistance + (dwTextLength - dwPosition - 1))
+		{
+			return dwMaxDistance + 1;
+		}
+	}
+
+	return (dwScore > dwMaxDistance) ? dwMaxDistance + 1 : dwScore;
+}
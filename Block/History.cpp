@@ -0,0 +1,1696 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/History.h"
+#include "../Api/RegistryEditor.h"
+#include "../Api/Output.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Throttle.h"
+#include "../Api/Progress.h"
+#include "../Api/Trace.h"
+#include "../Api/Collections.h"
+
+typedef struct _HISTORYCAPTURE {
+	PATHTABLE* lpPaths;
+	HISTORYSTATE* lpState;
+	LPWSTR lpsPath;
+	LPWSTR lpsValueName;
+	DWORD cchValueNameCapacity;
+	BYTE* lpData;
+	DWORD cbDataCapacity;
+	bool bValuesOnly;
+	bool bListKeys;
+	DWORD* lpdwPathIds;
+	DWORD dwPathIdsCount;
+	DWORD dwPathIdsCapacity;
+	bool bFailed;
+} HISTORYCAPTURE;
+
+typedef struct _HISTORYWRITER {
+	OUTPUTBUFFER obChanges;
+	HISTORYENTRY* lpEntries;
+	DWORD dwEntriesCount;
+	DWORD dwEntriesCapacity;
+	bool bFailed;
+} HISTORYWRITER;
+
+// Direct subkey of watched key with notification of its own, so change below it is captured
+// without the rest of the subtree. Path ids of its keys in watched state are sorted.
+typedef struct _HISTORYBRANCH {
+	HKEY hKey;
+	DWORD dwPathId;
+	DWORD dwEvent;
+	DWORD* lpdwPathIds;
+	DWORD dwPathIdsCount;
+	DWORD dwPathIdsCapacity;
+} HISTORYBRANCH;
+
+typedef struct _HISTORYWATCH {
+	HKEY hKey;
+	HISTORYSTATE hsState;
+	HISTORYCAPTURE hcCapture;
+	HISTORYBRANCH* lpBranches;
+	DWORD dwBranchesCount;
+	DWORD dwBranchesCapacity;
+	// Event 0 is of watched key itself, branches share the others
+	HANDLE hEvents[MAXIMUM_WAIT_OBJECTS];
+	DWORD dwEventsCount;
+	DWORD dwWaitCount;
+	HISTORYCHANGEPROC lpfnChange;
+	void* lpContext;
+} HISTORYWATCH;
+
+/// <summary>
+///		Build name of file in history directory
+/// </summary>
+///
+/// <returns>void</returns>
+static void GetHistoryFileName(const HISTORYSTORE* lpStore, LPCSTR lpsName, LPSTR lpsFileName)
+{
+	sprintf_s(lpsFileName, MAX_PATH, "%s\\%s", lpStore->lpsDirectory, lpsName);
+}
+
+/// <summary>
+///		Build name of record file
+/// </summary>
+///
+/// <returns>void</returns>
+static void GetRecordFileName(const HISTORYSTORE* lpStore, DWORD dwSequence, LPSTR lpsFileName)
+{
+	sprintf_s(lpsFileName, MAX_PATH, "%s\\%08lu.snap", lpStore->lpsDirectory, dwSequence);
+}
+
+/// <summary>
+///		Put path id into open addressing table
+/// </summary>
+///
+/// <returns>void</returns>
+static void InsertPathSlot(PATHTABLE* lpPaths, DWORD dwPathId)
+{
+	LPCWSTR lpsPath = lpPaths->lpsPaths[dwPathId];
+	DWORD dwSlot = HashString(HASH_INITIAL_VALUE, lpsPath, HASH_TERMINATED, false) & (lpPaths->dwSlotsCount - 1);
+
+	while (lpPaths->lpdwSlots[dwSlot] != 0)
+	{
+		dwSlot = (dwSlot + 1) & (lpPaths->dwSlotsCount - 1);
+	}
+
+	// Zero marks empty slot, so ids are stored plus one
+	lpPaths->lpdwSlots[dwSlot] = dwPathId + 1;
+}
+
+/// <summary>
+///		Get id of path, new paths get next id
+/// </summary>
+///
+/// <returns>DWORD (MAXDWORD if no memory)</returns>
+static DWORD InternPath(PATHTABLE* lpPaths, LPCWSTR lpsPath, DWORD dwLength)
+{
+	// Table is kept at most half full
+	if ((lpPaths->dwCount + 1) * 2 > lpPaths->dwSlotsCount)
+	{
+		DWORD dwSlotsCount = (lpPaths->dwSlotsCount == 0) ? 1024 : lpPaths->dwSlotsCount * 2;
+		DWORD* lpdwSlots = (DWORD*)calloc(dwSlotsCount, sizeof(DWORD));
+
+		if (lpdwSlots == NULL)
+		{
+			return MAXDWORD;
+		}
+
+		free(lpPaths->lpdwSlots);
+		lpPaths->lpdwSlots = lpdwSlots;
+		lpPaths->dwSlotsCount = dwSlotsCount;
+
+		for (DWORD dwPathId = 0; dwPathId < lpPaths->dwCount; dwPathId++)
+		{
+			InsertPathSlot(lpPaths, dwPathId);
+		}
+	}
+
+	for (DWORD dwSlot = HashString(HASH_INITIAL_VALUE, lpsPath, dwLength, false) & (lpPaths->dwSlotsCount - 1); lpPaths->lpdwSlots[dwSlot] != 0;
+		dwSlot = (dwSlot + 1) & (lpPaths->dwSlotsCount - 1))
+	{
+		LPCWSTR lpsInterned = lpPaths->lpsPaths[lpPaths->lpdwSlots[dwSlot] - 1];
+		if ((wcsncmp(lpsInterned, lpsPath, dwLength) == 0) && (lpsInterned[dwLength] == L'\0'))
+		{
+			return lpPaths->lpdwSlots[dwSlot] - 1;
+		}
+	}
+
+	if (!ReserveArray((void**)&lpPaths->lpsPaths, &lpPaths->dwCapacity, lpPaths->dwCount + 1, sizeof(LPWSTR)))
+	{
+		return MAXDWORD;
+	}
+
+	LPWSTR lpsCopy = (LPWSTR)malloc((dwLength + 1) * sizeof(WCHAR));
+	if (lpsCopy == NULL)
+	{
+		return MAXDWORD;
+	}
+
+	memcpy(lpsCopy, lpsPath, dwLength * sizeof(WCHAR));
+	lpsCopy[dwLength] = L'\0';
+	lpPaths->lpsPaths[lpPaths->dwCount] = lpsCopy;
+	InsertPathSlot(lpPaths, lpPaths->dwCount);
+
+	return lpPaths->dwCount++;
+}
+
+/// <summary>
+///		Load interned paths saved by previous snapshots
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool LoadPaths(HISTORYSTORE* lpStore)
+{
+	CHAR lpsFileName[MAX_PATH];
+	GetHistoryFileName(lpStore, "paths.dat", lpsFileName);
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "rb") != 0)
+	{
+		return true;
+	}
+
+	LPWSTR lpsPath = (LPWSTR)malloc(HISTORY_MAX_PATH_LENGTH * sizeof(WCHAR));
+	DWORD dwLength;
+	bool bResult = lpsPath != NULL;
+
+	while (bResult && (fread(&dwLength, sizeof(DWORD), 1, lpFile) == 1))
+	{
+		bResult = (dwLength < HISTORY_MAX_PATH_LENGTH) &&
+			(fread(lpsPath, sizeof(WCHAR), dwLength, lpFile) == dwLength) &&
+			(InternPath(&lpStore->ptPaths, lpsPath, dwLength) != MAXDWORD);
+	}
+
+	free(lpsPath);
+	fclose(lpFile);
+	lpStore->ptPaths.dwSavedCount = lpStore->ptPaths.dwCount;
+
+	return bResult;
+}
+
+/// <summary>
+///		Append paths interned since last save
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool SavePaths(HISTORYSTORE* lpStore)
+{
+	PATHTABLE* lpPaths = &lpStore->ptPaths;
+	if (lpPaths->dwSavedCount == lpPaths->dwCount)
+	{
+		return true;
+	}
+
+	CHAR lpsFileName[MAX_PATH];
+	GetHistoryFileName(lpStore, "paths.dat", lpsFileName);
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "ab") != 0)
+	{
+		return false;
+	}
+
+	bool bResult = true;
+	for (DWORD dwPathId = lpPaths->dwSavedCount; bResult && (dwPathId < lpPaths->dwCount); dwPathId++)
+	{
+		DWORD dwLength = lstrlen(lpPaths->lpsPaths[dwPathId]);
+		bResult = (fwrite(&dwLength, sizeof(DWORD), 1, lpFile) == 1) &&
+			(fwrite(lpPaths->lpsPaths[dwPathId], sizeof(WCHAR), dwLength, lpFile) == dwLength);
+	}
+
+	bResult = (fclose(lpFile) == 0) && bResult;
+	if (bResult)
+	{
+		lpPaths->dwSavedCount = lpPaths->dwCount;
+	}
+
+	return bResult;
+}
+
+/// <summary>
+///		Free values of key
+/// </summary>
+///
+/// <returns>void</returns>
+static void FreeHistoryKey(HISTORYKEY* lpKey)
+{
+	if (lpKey == NULL)
+	{
+		return;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < lpKey->dwValuesCount; dwIndex++)
+	{
+		free(lpKey->lpValues[dwIndex].lpsName);
+		free(lpKey->lpValues[dwIndex].lpData);
+	}
+	free(lpKey->lpValues);
+	free(lpKey);
+}
+
+/// <summary>
+///		Make sure state can hold key with given path id
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReserveStateKeys(HISTORYSTATE* lpState, DWORD dwKeysCount)
+{
+	if (dwKeysCount <= lpState->dwKeysCount)
+	{
+		return true;
+	}
+
+	HISTORYKEY** lpKeys = (HISTORYKEY**)realloc(lpState->lpKeys, dwKeysCount * sizeof(HISTORYKEY*));
+	if (lpKeys == NULL)
+	{
+		return false;
+	}
+
+	ZeroMemory(lpKeys + lpState->dwKeysCount, (dwKeysCount - lpState->dwKeysCount) * sizeof(HISTORYKEY*));
+	lpState->lpKeys = lpKeys;
+	lpState->dwKeysCount = dwKeysCount;
+
+	return true;
+}
+
+/// <summary>
+///		Get key of state, it is created if it does not exist
+/// </summary>
+///
+/// <returns>HISTORYKEY* (NULL if no memory)</returns>
+static HISTORYKEY* EnsureHistoryKey(HISTORYSTATE* lpState, DWORD dwPathId)
+{
+	if (!ReserveStateKeys(lpState, dwPathId + 1))
+	{
+		return NULL;
+	}
+
+	if (lpState->lpKeys[dwPathId] == NULL)
+	{
+		lpState->lpKeys[dwPathId] = (HISTORYKEY*)calloc(1, sizeof(HISTORYKEY));
+	}
+
+	return lpState->lpKeys[dwPathId];
+}
+
+/// <summary>
+///		Find value of key by name
+/// </summary>
+///
+/// <returns>HISTORYVALUE* (NULL if key has no such value)</returns>
+static HISTORYVALUE* FindHistoryValue(HISTORYKEY* lpKey, LPCWSTR lpsName, DWORD dwNameLength)
+{
+	for (DWORD dwIndex = 0; dwIndex < lpKey->dwValuesCount; dwIndex++)
+	{
+		LPCWSTR lpsValueName = lpKey->lpValues[dwIndex].lpsName;
+		if ((wcsncmp(lpsValueName, lpsName, dwNameLength) == 0) && (lpsValueName[dwNameLength] == L'\0'))
+		{
+			return &lpKey->lpValues[dwIndex];
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Add value to key or replace its data
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool SetHistoryValue(HISTORYKEY* lpKey, LPCWSTR lpsName, DWORD dwNameLength, DWORD dwType, const BYTE* lpData, DWORD cbData)
+{
+	BYTE* lpDataCopy = (BYTE*)malloc((cbData == 0) ? 1 : cbData);
+	if (lpDataCopy == NULL)
+	{
+		return false;
+	}
+	memcpy(lpDataCopy, lpData, cbData);
+
+	HISTORYVALUE* lpValue = FindHistoryValue(lpKey, lpsName, dwNameLength);
+	if (lpValue == NULL)
+	{
+		LPWSTR lpsNameCopy = (LPWSTR)malloc((dwNameLength + 1) * sizeof(WCHAR));
+
+		if ((lpsNameCopy == NULL) ||
+			!ReserveArray((void**)&lpKey->lpValues, &lpKey->dwValuesCapacity, lpKey->dwValuesCount + 1, sizeof(HISTORYVALUE)))
+		{
+			free(lpsNameCopy);
+			free(lpDataCopy);
+			return false;
+		}
+
+		memcpy(lpsNameCopy, lpsName, dwNameLength * sizeof(WCHAR));
+		lpsNameCopy[dwNameLength] = L'\0';
+
+		lpValue = &lpKey->lpValues[lpKey->dwValuesCount++];
+		lpValue->lpsName = lpsNameCopy;
+		lpValue->lpData = NULL;
+	}
+
+	free(lpValue->lpData);
+	lpValue->dwType = dwType;
+	lpValue->cbData = cbData;
+	lpValue->lpData = lpDataCopy;
+
+	return true;
+}
+
+/// <summary>
+///		Remove value of key
+/// </summary>
+///
+/// <returns>void</returns>
+static void RemoveHistoryValue(HISTORYKEY* lpKey, LPCWSTR lpsName, DWORD dwNameLength)
+{
+	HISTORYVALUE* lpValue = FindHistoryValue(lpKey, lpsName, dwNameLength);
+	if (lpValue == NULL)
+	{
+		return;
+	}
+
+	free(lpValue->lpsName);
+	free(lpValue->lpData);
+	*lpValue = lpKey->lpValues[--lpKey->dwValuesCount];
+}
+
+/// <summary>
+///		qsort callback, values by name
+/// </summary>
+///
+/// <returns>int</returns>
+static int CompareHistoryValues(const void* lpFirst, const void* lpSecond)
+{
+	return wcscmp(((const HISTORYVALUE*)lpFirst)->lpsName, ((const HISTORYVALUE*)lpSecond)->lpsName);
+}
+
+/// <summary>
+///		qsort callback, path ids
+/// </summary>
+///
+/// <returns>int</returns>
+static int CompareHistoryPathIds(const void* lpFirst, const void* lpSecond)
+{
+	DWORD dwFirst = *(const DWORD*)lpFirst;
+	DWORD dwSecond = *(const DWORD*)lpSecond;
+
+	return (dwFirst < dwSecond) ? -1 : ((dwFirst > dwSecond) ? 1 : 0);
+}
+
+/// <summary>
+///		Sort values of key by name
+/// </summary>
+///
+/// <returns>void</returns>
+static void SortHistoryKeyValues(HISTORYKEY* lpKey)
+{
+	if ((lpKey != NULL) && (lpKey->dwValuesCount > 1))
+	{
+		qsort(lpKey->lpValues, lpKey->dwValuesCount, sizeof(HISTORYVALUE), CompareHistoryValues);
+	}
+}
+
+/// <summary>
+///		Sort values of every key by name, so states can be compared key by key
+/// </summary>
+///
+/// <returns>void</returns>
+static void SortHistoryValues(HISTORYSTATE* lpState)
+{
+	for (DWORD dwPathId = 0; dwPathId < lpState->dwKeysCount; dwPathId++)
+	{
+		SortHistoryKeyValues(lpState->lpKeys[dwPathId]);
+	}
+}
+
+/// <summary>
+///		Make data buffer of capture hold at least given size
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool GrowCaptureData(HISTORYCAPTURE* lpCapture, DWORD cbRequired)
+{
+	if (cbRequired <= lpCapture->cbDataCapacity)
+	{
+		return true;
+	}
+
+	BYTE* lpData = (BYTE*)realloc(lpCapture->lpData, cbRequired);
+	if (lpData == NULL)
+	{
+		return false;
+	}
+
+	lpCapture->lpData = lpData;
+	lpCapture->cbDataCapacity = cbRequired;
+	return true;
+}
+
+/// <summary>
+///		Make value name buffer of capture hold given length, names never exceed HISTORY_MAX_VALUE_NAME_LENGTH
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool GrowCaptureValueName(HISTORYCAPTURE* lpCapture, DWORD cchRequired)
+{
+	if (cchRequired > HISTORY_MAX_VALUE_NAME_LENGTH)
+	{
+		if (lpCapture->cchValueNameCapacity >= HISTORY_MAX_VALUE_NAME_LENGTH)
+		{
+			return false;
+		}
+		cchRequired = HISTORY_MAX_VALUE_NAME_LENGTH;
+	}
+
+	LPWSTR lpsValueName = (LPWSTR)realloc(lpCapture->lpsValueName, cchRequired * sizeof(WCHAR));
+	if (lpsValueName == NULL)
+	{
+		return false;
+	}
+
+	lpCapture->lpsValueName = lpsValueName;
+	lpCapture->cchValueNameCapacity = cchRequired;
+	return true;
+}
+
+/// <summary>
+///		Allocate path and value name buffers of capture
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool InitHistoryCapture(HISTORYCAPTURE* lpCapture, PATHTABLE* lpPaths, HISTORYSTATE* lpState)
+{
+	ZeroMemory(lpCapture, sizeof(HISTORYCAPTURE));
+	lpCapture->lpPaths = lpPaths;
+	lpCapture->lpState = lpState;
+	lpCapture->lpsPath = (LPWSTR)calloc(HISTORY_MAX_PATH_LENGTH, sizeof(WCHAR));
+
+	return (lpCapture->lpsPath != NULL) && GrowCaptureValueName(lpCapture, HISTORY_VALUE_NAME_LENGTH);
+}
+
+/// <summary>
+///		Free buffers of capture
+/// </summary>
+///
+/// <returns>void</returns>
+static void FreeHistoryCapture(HISTORYCAPTURE* lpCapture)
+{
+	free(lpCapture->lpsPath);
+	free(lpCapture->lpsValueName);
+	free(lpCapture->lpData);
+	free(lpCapture->lpdwPathIds);
+
+	ZeroMemory(lpCapture, sizeof(HISTORYCAPTURE));
+}
+
+/// <summary>
+///		Read values of key and walk its subkeys
+/// </summary>
+///
+/// <returns>void</returns>
+static void CaptureKey(HISTORYCAPTURE* lpCapture, HKEY hKey, DWORD dwPathLength)
+{
+	DWORD dwPathId = InternPath(lpCapture->lpPaths, lpCapture->lpsPath, dwPathLength);
+	HISTORYKEY* lpKey = (dwPathId == MAXDWORD) ? NULL : EnsureHistoryKey(lpCapture->lpState, dwPathId);
+	DWORD dwSubKeysCount, dwValuesCount, cbMaxValueSize;
+
+	if (lpCapture->bListKeys && (lpKey != NULL))
+	{
+		if (!ReserveArray((void**)&lpCapture->lpdwPathIds, &lpCapture->dwPathIdsCapacity, lpCapture->dwPathIdsCount + 1, sizeof(DWORD)))
+		{
+			lpCapture->bFailed = true;
+			return;
+		}
+		lpCapture->lpdwPathIds[lpCapture->dwPathIdsCount++] = dwPathId;
+	}
+
+	// Key left without values would be recorded as removal of all of them
+	if ((lpKey == NULL) || !QueryRegKeyInfo(hKey, &dwSubKeysCount, &dwValuesCount, &cbMaxValueSize, NULL) ||
+		!GrowCaptureData(lpCapture, cbMaxValueSize))
+	{
+		lpCapture->bFailed = true;
+		return;
+	}
+
+	for (DWORD dwIndex = 0; (dwIndex < dwValuesCount) && !lpCapture->bFailed; dwIndex++)
+	{
+		DWORD dwNameSize = lpCapture->cchValueNameCapacity;
+		DWORD dwType;
+		DWORD cbData = lpCapture->cbDataCapacity;
+		LRESULT error = EnumRegValue(hKey, dwIndex, lpCapture->lpsValueName, &dwNameSize, &dwType, lpCapture->lpData, &cbData);
+
+		// Value grew since key was queried or its name is longer than buffer, call tells only required data size
+		if (error == ERROR_MORE_DATA)
+		{
+			bool bNameShort = (cbData <= lpCapture->cbDataCapacity);
+			lpCapture->bFailed = !GrowCaptureData(lpCapture, cbData) ||
+				(bNameShort && !GrowCaptureValueName(lpCapture, lpCapture->cchValueNameCapacity * 2));
+			dwIndex--;
+			continue;
+		}
+
+		// Values removed since key was queried
+		if (error == ERROR_NO_MORE_ITEMS)
+		{
+			break;
+		}
+
+		lpCapture->bFailed = (error != ERROR_SUCCESS) ||
+			!SetHistoryValue(lpKey, lpCapture->lpsValueName, dwNameSize, dwType, lpCapture->lpData, cbData);
+	}
+
+	if (lpCapture->bValuesOnly)
+	{
+		return;
+	}
+
+	LPWSTR lpsSubKeyName = lpCapture->lpsPath + dwPathLength + ((dwPathLength == 0) ? 0 : 1);
+	DWORD cchAvailable = HISTORY_MAX_PATH_LENGTH - (DWORD)(lpsSubKeyName - lpCapture->lpsPath);
+
+	for (DWORD dwIndex = 0; (dwIndex < dwSubKeysCount) && (cchAvailable > 1) && !lpCapture->bFailed; dwIndex++)
+	{
+		DWORD dwNameSize = cchAvailable;
+		LRESULT error = EnumRegKey(hKey, dwIndex, lpsSubKeyName, &dwNameSize, NULL);
+
+		if (error == ERROR_NO_MORE_ITEMS)
+		{
+			break;
+		}
+
+		// Skipped subkey would be recorded as removed with all its subtree
+		if (error != ERROR_SUCCESS)
+		{
+			lpCapture->bFailed = true;
+			break;
+		}
+
+		STAT_ADD(ullKeysVisited, 1);
+		ThrottleKeys(1);
+		AdvanceProgress(1);
+		if (dwPathLength != 0)
+		{
+			lpCapture->lpsPath[dwPathLength] = L'\\';
+		}
+
+		// Subkey removed after it was listed is really gone, one that cannot be read is not
+		HKEY hSubKey;
+		error = OpenRegKeyStatus(hKey, lpsSubKeyName, KEY_READ, &hSubKey);
+		lpCapture->bFailed = (error != ERROR_SUCCESS) && (error != ERROR_FILE_NOT_FOUND);
+
+		if (error == ERROR_SUCCESS)
+		{
+			if (dwPathLength == 0)
+			{
+				BeginProgressBranch(dwIndex);
+			}
+
+			CaptureKey(lpCapture, hSubKey, (DWORD)(lpsSubKeyName - lpCapture->lpsPath) + dwNameSize);
+			CloseRegKey(hSubKey);
+
+			if (dwPathLength == 0)
+			{
+				EndProgressBranch();
+			}
+		}
+	}
+}
+
+/// <summary>
+///		Append bytes to changes of current entry
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteChange(HISTORYWRITER* lpWriter, const void* lpData, DWORD cbData)
+{
+	lpWriter->bFailed = lpWriter->bFailed || !AppendOutput(&lpWriter->obChanges, (LPCSTR)lpData, cbData);
+}
+
+/// <summary>
+///		Append value change: name and for set operation type and data
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteValueChange(HISTORYWRITER* lpWriter, BYTE bOperation, const HISTORYVALUE* lpValue)
+{
+	DWORD dwNameLength = lstrlen(lpValue->lpsName);
+
+	WriteChange(lpWriter, &dwNameLength, sizeof(DWORD));
+	WriteChange(lpWriter, lpValue->lpsName, dwNameLength * sizeof(WCHAR));
+
+	if (bOperation == HISTORY_OP_VALUE_SET)
+	{
+		WriteChange(lpWriter, &lpValue->dwType, sizeof(DWORD));
+		WriteChange(lpWriter, &lpValue->cbData, sizeof(DWORD));
+		WriteChange(lpWriter, lpValue->lpData, lpValue->cbData);
+	}
+}
+
+/// <summary>
+///		Report changes turning previous key into current one, NULL means key does not exist
+/// </summary>
+///
+/// <returns>void</returns>
+static void CompareHistoryKeys(DWORD dwPathId, const HISTORYKEY* lpPrevious, const HISTORYKEY* lpCurrent, HISTORYCHANGEPROC lpfnChange, void* lpContext)
+{
+	if (lpCurrent == NULL)
+	{
+		lpfnChange(lpContext, dwPathId, HISTORY_OP_KEY_REMOVED, NULL);
+		return;
+	}
+
+	if (lpPrevious == NULL)
+	{
+		lpfnChange(lpContext, dwPathId, HISTORY_OP_KEY_ADDED, NULL);
+	}
+
+	// Values of both keys are sorted by name, so they are merged
+	DWORD dwPreviousIndex = 0, dwCurrentIndex = 0;
+	DWORD dwPreviousCount = (lpPrevious == NULL) ? 0 : lpPrevious->dwValuesCount;
+
+	while ((dwPreviousIndex < dwPreviousCount) || (dwCurrentIndex < lpCurrent->dwValuesCount))
+	{
+		const HISTORYVALUE* lpOld = (dwPreviousIndex < dwPreviousCount) ? &lpPrevious->lpValues[dwPreviousIndex] : NULL;
+		const HISTORYVALUE* lpNew = (dwCurrentIndex < lpCurrent->dwValuesCount) ? &lpCurrent->lpValues[dwCurrentIndex] : NULL;
+		int iOrder = (lpOld == NULL) ? 1 : ((lpNew == NULL) ? -1 : wcscmp(lpOld->lpsName, lpNew->lpsName));
+
+		if (iOrder < 0)
+		{
+			lpfnChange(lpContext, dwPathId, HISTORY_OP_VALUE_REMOVED, lpOld);
+			dwPreviousIndex++;
+		}
+		else if (iOrder > 0)
+		{
+			lpfnChange(lpContext, dwPathId, HISTORY_OP_VALUE_SET, lpNew);
+			dwCurrentIndex++;
+		}
+		else
+		{
+			if ((lpOld->dwType != lpNew->dwType) || (lpOld->cbData != lpNew->cbData) || (memcmp(lpOld->lpData, lpNew->lpData, lpNew->cbData) != 0))
+			{
+				lpfnChange(lpContext, dwPathId, HISTORY_OP_VALUE_SET, lpNew);
+			}
+			dwPreviousIndex++;
+			dwCurrentIndex++;
+		}
+	}
+}
+
+/// <summary>
+///		Append change to entry of its key, changes of one key are reported together
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteHistoryChange(void* lpContext, DWORD dwPathId, BYTE bOperation, const HISTORYVALUE* lpValue)
+{
+	HISTORYWRITER* lpWriter = (HISTORYWRITER*)lpContext;
+	if (lpWriter->bFailed)
+	{
+		return;
+	}
+
+	if ((lpWriter->dwEntriesCount == 0) || (lpWriter->lpEntries[lpWriter->dwEntriesCount - 1].dwPathId != dwPathId))
+	{
+		if (!ReserveArray((void**)&lpWriter->lpEntries, &lpWriter->dwEntriesCapacity, lpWriter->dwEntriesCount + 1, sizeof(HISTORYENTRY)))
+		{
+			lpWriter->bFailed = true;
+			return;
+		}
+
+		lpWriter->lpEntries[lpWriter->dwEntriesCount].dwPathId = dwPathId;
+		lpWriter->lpEntries[lpWriter->dwEntriesCount].dwOffset = lpWriter->obChanges.cbSize;
+		lpWriter->dwEntriesCount++;
+	}
+
+	WriteChange(lpWriter, &bOperation, sizeof(BYTE));
+	if (lpValue != NULL)
+	{
+		WriteValueChange(lpWriter, bOperation, lpValue);
+	}
+
+	HISTORYENTRY* lpEntry = &lpWriter->lpEntries[lpWriter->dwEntriesCount - 1];
+	lpEntry->cbSize = lpWriter->obChanges.cbSize - lpEntry->dwOffset;
+}
+
+/// <summary>
+///		Write record file: header, entries and changes
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool SaveRecordFile(const HISTORYSTORE* lpStore, DWORD dwSequence, DWORD dwKind, const HISTORYWRITER* lpWriter, ULONGLONG* lpcbSize)
+{
+	CHAR lpsFileName[MAX_PATH];
+	GetRecordFileName(lpStore, dwSequence, lpsFileName);
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "wb") != 0)
+	{
+		return false;
+	}
+
+	HISTORYRECORDHEADER hrhHeader;
+	hrhHeader.dwMagic = HISTORY_RECORD_MAGIC;
+	hrhHeader.dwVersion = HISTORY_VERSION;
+	hrhHeader.dwKind = dwKind;
+	hrhHeader.dwEntriesCount = lpWriter->dwEntriesCount;
+
+	bool bResult = (fwrite(&hrhHeader, sizeof(HISTORYRECORDHEADER), 1, lpFile) == 1) &&
+		(fwrite(lpWriter->lpEntries, sizeof(HISTORYENTRY), lpWriter->dwEntriesCount, lpFile) == lpWriter->dwEntriesCount) &&
+		(fwrite(lpWriter->obChanges.lpsData, 1, lpWriter->obChanges.cbSize, lpFile) == lpWriter->obChanges.cbSize);
+	bResult = (fclose(lpFile) == 0) && bResult;
+
+	*lpcbSize = sizeof(HISTORYRECORDHEADER) + (ULONGLONG)lpWriter->dwEntriesCount * sizeof(HISTORYENTRY) + lpWriter->obChanges.cbSize;
+
+	return bResult;
+}
+
+/// <summary>
+///		Apply changes of one entry to key of state
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ApplyChanges(HISTORYSTATE* lpState, DWORD dwPathId, const BYTE* lpChanges, DWORD cbChanges)
+{
+	const BYTE* lpPosition = lpChanges;
+	const BYTE* lpEnd = lpChanges + cbChanges;
+
+	while (lpPosition < lpEnd)
+	{
+		BYTE bOperation = *lpPosition++;
+
+		if (bOperation == HISTORY_OP_KEY_REMOVED)
+		{
+			if (dwPathId < lpState->dwKeysCount)
+			{
+				FreeHistoryKey(lpState->lpKeys[dwPathId]);
+				lpState->lpKeys[dwPathId] = NULL;
+			}
+			continue;
+		}
+
+		HISTORYKEY* lpKey = EnsureHistoryKey(lpState, dwPathId);
+		if (lpKey == NULL)
+		{
+			return false;
+		}
+
+		if (bOperation == HISTORY_OP_KEY_ADDED)
+		{
+			continue;
+		}
+
+		DWORD dwNameLength;
+		if ((lpEnd - lpPosition < (ptrdiff_t)sizeof(DWORD)) || ((bOperation != HISTORY_OP_VALUE_SET) && (bOperation != HISTORY_OP_VALUE_REMOVED)))
+		{
+			return false;
+		}
+		memcpy(&dwNameLength, lpPosition, sizeof(DWORD));
+		lpPosition += sizeof(DWORD);
+
+		if ((ULONGLONG)(lpEnd - lpPosition) < (ULONGLONG)dwNameLength * sizeof(WCHAR))
+		{
+			return false;
+		}
+
+		// Name is not aligned in file, it is copied before use
+		LPWSTR lpsName = (LPWSTR)malloc((dwNameLength + 1) * sizeof(WCHAR));
+		if (lpsName == NULL)
+		{
+			return false;
+		}
+		memcpy(lpsName, lpPosition, dwNameLength * sizeof(WCHAR));
+		lpsName[dwNameLength] = L'\0';
+		lpPosition += dwNameLength * sizeof(WCHAR);
+
+		bool bResult = true;
+		if (bOperation == HISTORY_OP_VALUE_REMOVED)
+		{
+			RemoveHistoryValue(lpKey, lpsName, dwNameLength);
+		}
+		else
+		{
+			DWORD dwType, cbData;
+			bResult = (lpEnd - lpPosition >= (ptrdiff_t)(2 * sizeof(DWORD)));
+
+			if (bResult)
+			{
+				memcpy(&dwType, lpPosition, sizeof(DWORD));
+				memcpy(&cbData, lpPosition + sizeof(DWORD), sizeof(DWORD));
+				lpPosition += 2 * sizeof(DWORD);
+				bResult = ((ULONGLONG)(lpEnd - lpPosition) >= cbData) && SetHistoryValue(lpKey, lpsName, dwNameLength, dwType, lpPosition, cbData);
+				lpPosition += cbData;
+			}
+		}
+
+		free(lpsName);
+		if (!bResult)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Apply entries of record file whose paths are selected, other entries are not read
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ApplyRecord(const HISTORYSTORE* lpStore, const HISTORYRECORD* lpRecord, const bool* lpbSelected, HISTORYSTATE* lpState)
+{
+	if (lpRecord->dwEntriesCount == 0)
+	{
+		return true;
+	}
+
+	CHAR lpsFileName[MAX_PATH];
+	GetRecordFileName(lpStore, lpRecord->dwSequence, lpsFileName);
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "rb") != 0)
+	{
+		return false;
+	}
+
+	HISTORYRECORDHEADER hrhHeader;
+	HISTORYENTRY* lpEntries = NULL;
+	bool bResult = (fread(&hrhHeader, sizeof(HISTORYRECORDHEADER), 1, lpFile) == 1) &&
+		(hrhHeader.dwMagic == HISTORY_RECORD_MAGIC) && (hrhHeader.dwVersion == HISTORY_VERSION) &&
+		(hrhHeader.dwEntriesCount == lpRecord->dwEntriesCount);
+
+	if (bResult)
+	{
+		lpEntries = (HISTORYENTRY*)malloc(hrhHeader.dwEntriesCount * sizeof(HISTORYENTRY));
+		bResult = (lpEntries != NULL) && (fread(lpEntries, sizeof(HISTORYENTRY), hrhHeader.dwEntriesCount, lpFile) == hrhHeader.dwEntriesCount);
+	}
+
+	long lChangesOffset = (long)(sizeof(HISTORYRECORDHEADER) + hrhHeader.dwEntriesCount * sizeof(HISTORYENTRY));
+	BYTE* lpChanges = NULL;
+	DWORD cbChangesCapacity = 0;
+
+	for (DWORD dwIndex = 0; bResult && (dwIndex < hrhHeader.dwEntriesCount); dwIndex++)
+	{
+		const HISTORYENTRY* lpEntry = &lpEntries[dwIndex];
+		if ((lpEntry->dwPathId >= lpStore->ptPaths.dwCount) || !lpbSelected[lpEntry->dwPathId])
+		{
+			continue;
+		}
+
+		bResult = ReserveArray((void**)&lpChanges, &cbChangesCapacity, lpEntry->cbSize, sizeof(BYTE)) &&
+			(fseek(lpFile, lChangesOffset + (long)lpEntry->dwOffset, SEEK_SET) == 0) &&
+			(fread(lpChanges, 1, lpEntry->cbSize, lpFile) == lpEntry->cbSize) &&
+			ApplyChanges(lpState, lpEntry->dwPathId, lpChanges, lpEntry->cbSize);
+	}
+
+	free(lpChanges);
+	free(lpEntries);
+	fclose(lpFile);
+
+	return bResult;
+}
+
+/// <summary>
+///		Close keys of branches, their events are signaled by it and drained
+/// </summary>
+///
+/// <returns>void</returns>
+static void CloseHistoryBranches(HISTORYWATCH* lpWatch)
+{
+	for (DWORD dwIndex = 0; dwIndex < lpWatch->dwBranchesCount; dwIndex++)
+	{
+		CloseRegKey(lpWatch->lpBranches[dwIndex].hKey);
+		free(lpWatch->lpBranches[dwIndex].lpdwPathIds);
+	}
+	lpWatch->dwBranchesCount = 0;
+
+	for (DWORD dwEvent = 1; dwEvent < lpWatch->dwEventsCount; dwEvent++)
+	{
+		WaitForSingleObject(lpWatch->hEvents[dwEvent], 0);
+	}
+}
+
+/// <summary>
+///		Capture subtree of branch into state of capture, branch takes list of its keys
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool CaptureHistoryBranch(HISTORYCAPTURE* lpCapture, HISTORYBRANCH* lpBranch)
+{
+	LPCWSTR lpsName = lpCapture->lpPaths->lpsPaths[lpBranch->dwPathId];
+	DWORD dwNameLength = lstrlen(lpsName);
+	wcscpy_s(lpCapture->lpsPath, HISTORY_MAX_PATH_LENGTH, lpsName);
+
+	lpCapture->bListKeys = true;
+	lpCapture->dwPathIdsCount = 0;
+	STAT_ADD(ullKeysVisited, 1);
+	ThrottleKeys(1);
+	CaptureKey(lpCapture, lpBranch->hKey, dwNameLength);
+	lpCapture->bListKeys = false;
+
+	if (lpCapture->bFailed)
+	{
+		return false;
+	}
+
+	qsort(lpCapture->lpdwPathIds, lpCapture->dwPathIdsCount, sizeof(DWORD), CompareHistoryPathIds);
+
+	// Lists are swapped, so capture keeps previous keys of branch
+	DWORD* lpdwPathIds = lpBranch->lpdwPathIds;
+	DWORD dwPathIdsCount = lpBranch->dwPathIdsCount;
+	DWORD dwPathIdsCapacity = lpBranch->dwPathIdsCapacity;
+	lpBranch->lpdwPathIds = lpCapture->lpdwPathIds;
+	lpBranch->dwPathIdsCount = lpCapture->dwPathIdsCount;
+	lpBranch->dwPathIdsCapacity = lpCapture->dwPathIdsCapacity;
+	lpCapture->lpdwPathIds = lpdwPathIds;
+	lpCapture->dwPathIdsCount = dwPathIdsCount;
+	lpCapture->dwPathIdsCapacity = dwPathIdsCapacity;
+
+	return true;
+}
+
+/// <summary>
+///		Arm notifications of watched key and its direct subkeys, then capture whole subtree
+///		branch by branch. Used at start and when subkeys or values of watched key change.
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool RescanHistoryWatch(HISTORYWATCH* lpWatch, bool bReport)
+{
+	HISTORYCAPTURE* lpCapture = &lpWatch->hcCapture;
+	CloseHistoryBranches(lpWatch);
+
+	if (RegNotifyChangeKeyValue(lpWatch->hKey, FALSE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, lpWatch->hEvents[0], TRUE) != ERROR_SUCCESS)
+	{
+		return false;
+	}
+
+	bool bResult = true;
+	for (DWORD dwIndex = 0; bResult; dwIndex++)
+	{
+		DWORD dwNameSize = HISTORY_MAX_PATH_LENGTH;
+		LRESULT error = EnumRegKey(lpWatch->hKey, dwIndex, lpCapture->lpsPath, &dwNameSize, NULL);
+		if (error == ERROR_NO_MORE_ITEMS)
+		{
+			break;
+		}
+
+		HISTORYBRANCH hbBranch;
+		ZeroMemory(&hbBranch, sizeof(HISTORYBRANCH));
+		hbBranch.dwPathId = (error == ERROR_SUCCESS) ? InternPath(lpCapture->lpPaths, lpCapture->lpsPath, dwNameSize) : MAXDWORD;
+		hbBranch.dwEvent = 1 + lpWatch->dwBranchesCount % (MAXIMUM_WAIT_OBJECTS - 1);
+		bResult = (hbBranch.dwPathId != MAXDWORD);
+
+		// Subkey removed after it was listed is reported by notification of watched key
+		if (bResult)
+		{
+			error = OpenRegKeyStatus(lpWatch->hKey, lpCapture->lpsPath, KEY_READ | KEY_NOTIFY, &hbBranch.hKey);
+			hbBranch.hKey = (error == ERROR_SUCCESS) ? hbBranch.hKey : NULL;
+			if (error == ERROR_FILE_NOT_FOUND)
+			{
+				continue;
+			}
+			bResult = (error == ERROR_SUCCESS);
+		}
+
+		if (bResult && (hbBranch.dwEvent == lpWatch->dwEventsCount))
+		{
+			lpWatch->hEvents[hbBranch.dwEvent] = CreateEvent(NULL, FALSE, FALSE, NULL);
+			lpWatch->dwEventsCount += (lpWatch->hEvents[hbBranch.dwEvent] != NULL) ? 1 : 0;
+			bResult = (lpWatch->hEvents[hbBranch.dwEvent] != NULL);
+		}
+
+		bResult = bResult &&
+			(RegNotifyChangeKeyValue(hbBranch.hKey, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, lpWatch->hEvents[hbBranch.dwEvent], TRUE) == ERROR_SUCCESS) &&
+			ReserveArray((void**)&lpWatch->lpBranches, &lpWatch->dwBranchesCapacity, lpWatch->dwBranchesCount + 1, sizeof(HISTORYBRANCH));
+
+		if (bResult)
+		{
+			lpWatch->lpBranches[lpWatch->dwBranchesCount++] = hbBranch;
+		}
+		else if (hbBranch.hKey != NULL)
+		{
+			CloseRegKey(hbBranch.hKey);
+		}
+	}
+
+	lpWatch->dwWaitCount = 1 + ((lpWatch->dwBranchesCount < MAXIMUM_WAIT_OBJECTS - 1) ? lpWatch->dwBranchesCount : MAXIMUM_WAIT_OBJECTS - 1);
+
+	// Values of watched key, then every branch with list of its keys
+	HISTORYSTATE hsCurrent;
+	ZeroMemory(&hsCurrent, sizeof(HISTORYSTATE));
+	lpCapture->lpState = &hsCurrent;
+	lpCapture->bFailed = !bResult;
+
+	if (bResult)
+	{
+		BeginProgressWalk(lpWatch->hKey);
+		lpCapture->lpsPath[0] = L'\0';
+		lpCapture->bValuesOnly = true;
+		CaptureKey(lpCapture, lpWatch->hKey, 0);
+		lpCapture->bValuesOnly = false;
+	}
+
+	for (DWORD dwIndex = 0; !lpCapture->bFailed && (dwIndex < lpWatch->dwBranchesCount); dwIndex++)
+	{
+		BeginProgressBranch(dwIndex);
+		AdvanceProgress(1);
+		CaptureHistoryBranch(lpCapture, &lpWatch->lpBranches[dwIndex]);
+		EndProgressBranch();
+	}
+
+	bResult = !lpCapture->bFailed;
+	if (bResult)
+	{
+		SortHistoryValues(&hsCurrent);
+		if (bReport)
+		{
+			CompareHistoryStates(&lpWatch->hsState, &hsCurrent, lpWatch->lpfnChange, lpWatch->lpContext);
+		}
+
+		FreeHistoryState(&lpWatch->hsState);
+		lpWatch->hsState = hsCurrent;
+	}
+	else
+	{
+		FreeHistoryState(&hsCurrent);
+	}
+
+	return bResult;
+}
+
+/// <summary>
+///		Capture branch again and report changes of its keys only
+/// </summary>
+///
+/// <returns>bool (false if branch cannot be read, state is left as it was)</returns>
+static bool RecaptureHistoryBranch(HISTORYWATCH* lpWatch, HISTORYBRANCH* lpBranch)
+{
+	HISTORYCAPTURE* lpCapture = &lpWatch->hcCapture;
+	HISTORYSTATE* lpState = &lpWatch->hsState;
+
+	// Keys of branch are taken out of state, capture creates them anew
+	DWORD dwOldCount = lpBranch->dwPathIdsCount;
+	HISTORYKEY** lpOldKeys = (HISTORYKEY**)malloc((dwOldCount + 1) * sizeof(HISTORYKEY*));
+	if (lpOldKeys == NULL)
+	{
+		return false;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwOldCount; dwIndex++)
+	{
+		lpOldKeys[dwIndex] = lpState->lpKeys[lpBranch->lpdwPathIds[dwIndex]];
+		lpState->lpKeys[lpBranch->lpdwPathIds[dwIndex]] = NULL;
+	}
+
+	lpCapture->lpState = lpState;
+	lpCapture->bFailed = false;
+
+	if (!CaptureHistoryBranch(lpCapture, lpBranch))
+	{
+		for (DWORD dwIndex = 0; dwIndex < lpCapture->dwPathIdsCount; dwIndex++)
+		{
+			FreeHistoryKey(lpState->lpKeys[lpCapture->lpdwPathIds[dwIndex]]);
+			lpState->lpKeys[lpCapture->lpdwPathIds[dwIndex]] = NULL;
+		}
+		for (DWORD dwIndex = 0; dwIndex < dwOldCount; dwIndex++)
+		{
+			lpState->lpKeys[lpBranch->lpdwPathIds[dwIndex]] = lpOldKeys[dwIndex];
+		}
+
+		free(lpOldKeys);
+		return false;
+	}
+
+	// Both lists are sorted, so changes are reported in path id order like for whole state
+	const DWORD* lpdwOldIds = lpCapture->lpdwPathIds;
+	const DWORD* lpdwNewIds = lpBranch->lpdwPathIds;
+	DWORD dwOldIndex = 0, dwNewIndex = 0;
+
+	while ((dwOldIndex < dwOldCount) || (dwNewIndex < lpBranch->dwPathIdsCount))
+	{
+		DWORD dwOldId = (dwOldIndex < dwOldCount) ? lpdwOldIds[dwOldIndex] : MAXDWORD;
+		DWORD dwNewId = (dwNewIndex < lpBranch->dwPathIdsCount) ? lpdwNewIds[dwNewIndex] : MAXDWORD;
+		DWORD dwPathId = (dwOldId < dwNewId) ? dwOldId : dwNewId;
+		const HISTORYKEY* lpOld = (dwOldId == dwPathId) ? lpOldKeys[dwOldIndex++] : NULL;
+		HISTORYKEY* lpNew = NULL;
+
+		if (dwNewId == dwPathId)
+		{
+			lpNew = lpState->lpKeys[dwPathId];
+			SortHistoryKeyValues(lpNew);
+			dwNewIndex++;
+		}
+
+		CompareHistoryKeys(dwPathId, lpOld, lpNew, lpWatch->lpfnChange, lpWatch->lpContext);
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwOldCount; dwIndex++)
+	{
+		FreeHistoryKey(lpOldKeys[dwIndex]);
+	}
+	free(lpOldKeys);
+
+	return true;
+}
+
+/// <summary>
+///		Arm notification of every branch sharing signaled event again and capture those branches
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool RecaptureHistoryBranches(HISTORYWATCH* lpWatch, DWORD dwEvent)
+{
+	for (DWORD dwIndex = 0; dwIndex < lpWatch->dwBranchesCount; dwIndex++)
+	{
+		HISTORYBRANCH* lpBranch = &lpWatch->lpBranches[dwIndex];
+		if ((lpBranch->dwEvent == dwEvent) &&
+			((RegNotifyChangeKeyValue(lpBranch->hKey, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, lpWatch->hEvents[dwEvent], TRUE) != ERROR_SUCCESS) ||
+			!RecaptureHistoryBranch(lpWatch, lpBranch)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Close branches and events of watch and free its state
+/// </summary>
+///
+/// <returns>void</returns>
+static void FreeHistoryWatch(HISTORYWATCH* lpWatch)
+{
+	CloseHistoryBranches(lpWatch);
+	free(lpWatch->lpBranches);
+
+	for (DWORD dwEvent = 0; dwEvent < lpWatch->dwEventsCount; dwEvent++)
+	{
+		CloseHandle(lpWatch->hEvents[dwEvent]);
+	}
+
+	FreeHistoryState(&lpWatch->hsState);
+	FreeHistoryCapture(&lpWatch->hcCapture);
+}
+
+/// <summary>
+///		Open history directory, it is created with empty index when it does not exist
+/// </summary>
+///
+/// <param name="lpsDirectory">History directory</param>
+/// <param name="lpsRootPath">Snapshot root, it must match root of existing history (NULL to accept any)</param>
+/// <param name="lpStore">History store</param>
+///
+/// <returns>bool</returns>
+bool OpenHistoryStore(LPCSTR lpsDirectory, LPCWSTR lpsRootPath, HISTORYSTORE* lpStore)
+{
+	ZeroMemory(lpStore, sizeof(HISTORYSTORE));
+	if ((lpsDirectory == NULL) || (strcpy_s(lpStore->lpsDirectory, MAX_PATH - 16, lpsDirectory) != 0))
+	{
+		return false;
+	}
+
+	CHAR lpsFileName[MAX_PATH];
+	GetHistoryFileName(lpStore, "history.idx", lpsFileName);
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "rb") != 0)
+	{
+		// New history needs root to be recorded
+		if (lpsRootPath == NULL)
+		{
+			return false;
+		}
+
+		CreateDirectoryA(lpsDirectory, NULL);
+		if (fopen_s(&lpFile, lpsFileName, "wb") != 0)
+		{
+			return false;
+		}
+
+		DWORD dwHeader[3] = { HISTORY_MAGIC, HISTORY_VERSION, (DWORD)lstrlen(lpsRootPath) };
+		bool bResult = (fwrite(dwHeader, sizeof(DWORD), 3, lpFile) == 3) &&
+			(fwrite(lpsRootPath, sizeof(WCHAR), dwHeader[2], lpFile) == dwHeader[2]);
+		bResult = (fclose(lpFile) == 0) && bResult;
+
+		lpStore->lpsRootPath = _wcsdup(lpsRootPath);
+		return bResult && (lpStore->lpsRootPath != NULL);
+	}
+
+	DWORD dwHeader[3];
+	bool bResult = (fread(dwHeader, sizeof(DWORD), 3, lpFile) == 3) &&
+		(dwHeader[0] == HISTORY_MAGIC) && (dwHeader[1] == HISTORY_VERSION) && (dwHeader[2] < HISTORY_MAX_PATH_LENGTH);
+
+	if (bResult)
+	{
+		lpStore->lpsRootPath = (LPWSTR)calloc(dwHeader[2] + 1, sizeof(WCHAR));
+		bResult = (lpStore->lpsRootPath != NULL) && (fread(lpStore->lpsRootPath, sizeof(WCHAR), dwHeader[2], lpFile) == dwHeader[2]);
+	}
+
+	HISTORYRECORD hrRecord;
+	while (bResult && (fread(&hrRecord, sizeof(HISTORYRECORD), 1, lpFile) == 1))
+	{
+		bResult = ReserveArray((void**)&lpStore->lpRecords, &lpStore->dwRecordsCapacity, lpStore->dwRecordsCount + 1, sizeof(HISTORYRECORD));
+		if (bResult)
+		{
+			lpStore->lpRecords[lpStore->dwRecordsCount++] = hrRecord;
+		}
+	}
+
+	fclose(lpFile);
+
+	bResult = bResult && ((lpsRootPath == NULL) || (lstrcmpi(lpsRootPath, lpStore->lpsRootPath) == 0)) && LoadPaths(lpStore);
+	if (!bResult)
+	{
+		CloseHistoryStore(lpStore);
+	}
+
+	return bResult;
+}
+
+/// <summary>
+///		Free history store
+/// </summary>
+///
+/// <param name="lpStore">History store</param>
+///
+/// <returns>void</returns>
+void CloseHistoryStore(HISTORYSTORE* lpStore)
+{
+	FreePathTable(&lpStore->ptPaths);
+	free(lpStore->lpRecords);
+	free(lpStore->lpsRootPath);
+
+	ZeroMemory(lpStore, sizeof(HISTORYSTORE));
+}
+
+/// <summary>
+///		Read keys and values of subtree, paths are interned relative to its root
+/// </summary>
+///
+/// <param name="lpPaths">Path table</param>
+/// <param name="hKey">Root of subtree</param>
+/// <param name="lpState">Keys of subtree, values sorted by name</param>
+///
+/// <returns>bool</returns>
+bool CaptureHistoryState(PATHTABLE* lpPaths, HKEY hKey, HISTORYSTATE* lpState)
+{
+	HISTORYCAPTURE hcCapture;
+	ZeroMemory(lpState, sizeof(HISTORYSTATE));
+
+	bool bResult = InitHistoryCapture(&hcCapture, lpPaths, lpState);
+	if (bResult)
+	{
+		BeginProgressWalk(hKey);
+		CaptureKey(&hcCapture, hKey, 0);
+		SortHistoryValues(lpState);
+		bResult = !hcCapture.bFailed;
+	}
+
+	FreeHistoryCapture(&hcCapture);
+
+	if (!bResult)
+	{
+		FreeHistoryState(lpState);
+	}
+
+	return bResult;
+}
+
+/// <summary>
+///		Report changes turning previous state into current one, keys in path id order
+/// </summary>
+///
+/// <param name="lpPrevious">Previous state</param>
+/// <param name="lpCurrent">Current state</param>
+/// <param name="lpfnChange">Called for every change, value is NULL for key changes</param>
+/// <param name="lpContext">Callback context</param>
+///
+/// <returns>void</returns>
+void CompareHistoryStates(const HISTORYSTATE* lpPrevious, const HISTORYSTATE* lpCurrent, HISTORYCHANGEPROC lpfnChange, void* lpContext)
+{
+	DWORD dwKeysCount = (lpPrevious->dwKeysCount > lpCurrent->dwKeysCount) ? lpPrevious->dwKeysCount : lpCurrent->dwKeysCount;
+
+	for (DWORD dwPathId = 0; dwPathId < dwKeysCount; dwPathId++)
+	{
+		const HISTORYKEY* lpOld = (dwPathId < lpPrevious->dwKeysCount) ? lpPrevious->lpKeys[dwPathId] : NULL;
+		const HISTORYKEY* lpNew = (dwPathId < lpCurrent->dwKeysCount) ? lpCurrent->lpKeys[dwPathId] : NULL;
+
+		if ((lpOld != NULL) || (lpNew != NULL))
+		{
+			CompareHistoryKeys(dwPathId, lpOld, lpNew, lpfnChange, lpContext);
+		}
+	}
+}
+
+/// <summary>
+///		Report changes of subtree as they happen. Every direct subkey of watched key has notification
+///		of its own, so only the subkey whose notification fired is captured and compared again;
+///		its whole subtree is read, cost of round grows with size of that branch. Change of watched key
+///		itself (its values or list of subkeys) captures whole subtree. Branches share at most
+///		MAXIMUM_WAIT_OBJECTS - 1 events, all branches of signaled event are captured.
+///		Notification is armed before every capture, so changes made while subtree is read are reported in next round.
+/// </summary>
+///
+/// <param name="hKey">Root of subtree, opened with KEY_NOTIFY</param>
+/// <param name="dwRounds">Notifications to wait for (0 for no limit)</param>
+/// <param name="lpPaths">Path table</param>
+/// <param name="lpfnChange">Called for every change, value is NULL for key changes</param>
+/// <param name="lpContext">Callback context</param>
+///
+/// <returns>bool</returns>
+bool WatchHistoryChanges(HKEY hKey, DWORD dwRounds, PATHTABLE* lpPaths, HISTORYCHANGEPROC lpfnChange, void* lpContext)
+{
+	HISTORYWATCH hwWatch;
+	ZeroMemory(&hwWatch, sizeof(HISTORYWATCH));
+	hwWatch.hKey = hKey;
+	hwWatch.lpfnChange = lpfnChange;
+	hwWatch.lpContext = lpContext;
+	hwWatch.hEvents[0] = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hwWatch.dwEventsCount = (hwWatch.hEvents[0] != NULL) ? 1 : 0;
+
+	bool bResult = (hwWatch.dwEventsCount != 0) && InitHistoryCapture(&hwWatch.hcCapture, lpPaths, &hwWatch.hsState) &&
+		RescanHistoryWatch(&hwWatch, false);
+
+	for (DWORD dwRound = 0; bResult && ((dwRounds == 0) || (dwRound < dwRounds)); dwRound++)
+	{
+		DWORD dwEvent = WaitForMultipleObjects(hwWatch.dwWaitCount, hwWatch.hEvents, FALSE, INFINITE) - WAIT_OBJECT_0;
+		if (dwEvent >= hwWatch.dwWaitCount)
+		{
+			bResult = false;
+			break;
+		}
+
+		// Branch that cannot be read any more was usually removed, whole subtree is captured to find out
+		bResult = ((dwEvent != 0) && RecaptureHistoryBranches(&hwWatch, dwEvent)) || RescanHistoryWatch(&hwWatch, true);
+	}
+
+	FreeHistoryWatch(&hwWatch);
+
+	return bResult;
+}
+
+/// <summary>
+///		Free path table
+/// </summary>
+///
+/// <param name="lpPaths">Path table</param>
+///
+/// <returns>void</returns>
+void FreePathTable(PATHTABLE* lpPaths)
+{
+	for (DWORD dwPathId = 0; dwPathId < lpPaths->dwCount; dwPathId++)
+	{
+		free(lpPaths->lpsPaths[dwPathId]);
+	}
+	free(lpPaths->lpsPaths);
+	free(lpPaths->lpdwSlots);
+
+	ZeroMemory(lpPaths, sizeof(PATHTABLE));
+}
+
+/// <summary>
+///		Record current state of subtree. Only changes since previous snapshot are written,
+///		full base is written for first snapshot and when deltas since last base grow too long or too large.
+/// </summary>
+///
+/// <param name="lpStore">History store</param>
+/// <param name="hKey">Root of recorded subtree</param>
+/// <param name="ullTimestamp">Time of snapshot (FILETIME)</param>
+/// <param name="lpRecord">Written record</param>
+///
+/// <returns>bool</returns>
+bool TakeHistorySnapshot(HISTORYSTORE* lpStore, HKEY hKey, ULONGLONG ullTimestamp, HISTORYRECORD* lpRecord)
+{
+	if ((lpStore->dwRecordsCount != 0) && (ullTimestamp <= lpStore->lpRecords[lpStore->dwRecordsCount - 1].ullTimestamp))
+	{
+		return false;
+	}
+
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+
+	// State of last snapshot is the one changes are computed against
+	HISTORYSTATE hsPrevious;
+	ZeroMemory(&hsPrevious, sizeof(HISTORYSTATE));
+	bool bResult = (lpStore->dwRecordsCount == 0) ||
+		ReconstructHistory(lpStore, &lpStore->lpRecords[lpStore->dwRecordsCount - 1], L"", &hsPrevious);
+
+	HISTORYSTATE hsCurrent;
+	ZeroMemory(&hsCurrent, sizeof(HISTORYSTATE));
+	bResult = bResult && CaptureHistoryState(&lpStore->ptPaths, hKey, &hsCurrent);
+
+	// Deltas since last base
+	DWORD dwDeltasCount = 0;
+	ULONGLONG cbDeltas = 0, cbBase = 0;
+	for (DWORD dwIndex = lpStore->dwRecordsCount; dwIndex-- > 0; )
+	{
+		if (lpStore->lpRecords[dwIndex].dwKind == HISTORY_RECORD_BASE)
+		{
+			cbBase = lpStore->lpRecords[dwIndex].cbSize;
+			break;
+		}
+		dwDeltasCount++;
+		cbDeltas += lpStore->lpRecords[dwIndex].cbSize;
+	}
+
+	HISTORYWRITER hwWriter;
+	HISTORYSTATE hsEmpty;
+	ZeroMemory(&hwWriter, sizeof(HISTORYWRITER));
+	ZeroMemory(&hsEmpty, sizeof(HISTORYSTATE));
+	DWORD dwKind = HISTORY_RECORD_DELTA;
+
+	if (bResult && (lpStore->dwRecordsCount != 0) && (dwDeltasCount < HISTORY_REBASE_INTERVAL))
+	{
+		CompareHistoryStates(&hsPrevious, &hsCurrent, WriteHistoryChange, &hwWriter);
+	}
+
+	// Replaying chain must stay cheaper than reading new base
+	// Small or empty base is not worth rewriting for every delta
+	ULONGLONG cbRebase = (cbBase > HISTORY_MIN_REBASE_SIZE) ? cbBase : HISTORY_MIN_REBASE_SIZE;
+	if (bResult && ((lpStore->dwRecordsCount == 0) || (dwDeltasCount >= HISTORY_REBASE_INTERVAL) || (cbDeltas + hwWriter.obChanges.cbSize > cbRebase)))
+	{
+		FreeOutputBuffer(&hwWriter.obChanges);
+		hwWriter.dwEntriesCount = 0;
+		dwKind = HISTORY_RECORD_BASE;
+		CompareHistoryStates(&hsEmpty, &hsCurrent, WriteHistoryChange, &hwWriter);
+	}
+
+	HISTORYRECORD hrRecord;
+	ZeroMemory(&hrRecord, sizeof(HISTORYRECORD));
+	hrRecord.ullTimestamp = ullTimestamp;
+	hrRecord.dwSequence = (lpStore->dwRecordsCount == 0) ? 0 : lpStore->lpRecords[lpStore->dwRecordsCount - 1].dwSequence + 1;
+	hrRecord.dwKind = dwKind;
+	hrRecord.dwPathsCount = lpStore->ptPaths.dwCount;
+	hrRecord.dwEntriesCount = hwWriter.dwEntriesCount;
+
+	// Order keeps store consistent after crash: paths, then record file, then index entry
+	bResult = bResult && !hwWriter.bFailed && SavePaths(lpStore) &&
+		((hwWriter.dwEntriesCount == 0) || SaveRecordFile(lpStore, hrRecord.dwSequence, dwKind, &hwWriter, &hrRecord.cbSize));
+
+	if (bResult)
+	{
+		CHAR lpsFileName[MAX_PATH];
+		GetHistoryFileName(lpStore, "history.idx", lpsFileName);
+
+		FILE* lpFile;
+		bResult = fopen_s(&lpFile, lpsFileName, "ab") == 0;
+		if (bResult)
+		{
+			bResult = fwrite(&hrRecord, sizeof(HISTORYRECORD), 1, lpFile) == 1;
+			bResult = (fclose(lpFile) == 0) && bResult;
+		}
+	}
+
+	if (bResult)
+	{
+		bResult = ReserveArray((void**)&lpStore->lpRecords, &lpStore->dwRecordsCapacity, lpStore->dwRecordsCount + 1, sizeof(HISTORYRECORD));
+		if (bResult)
+		{
+			lpStore->lpRecords[lpStore->dwRecordsCount++] = hrRecord;
+			*lpRecord = hrRecord;
+		}
+	}
+
+	FreeOutputBuffer(&hwWriter.obChanges);
+	free(hwWriter.lpEntries);
+	FreeHistoryState(&hsPrevious);
+	FreeHistoryState(&hsCurrent);
+
+	EndTraceSpan("snapshot", "history", ullTraceStart, NULL);
+
+	return bResult;
+}
+
+/// <summary>
+///		Find last snapshot taken at or before given time
+/// </summary>
+///
+/// <param name="lpStore">History store</param>
+/// <param name="ullTimestamp">Time (FILETIME)</param>
+///
+/// <returns>const HISTORYRECORD* (NULL if history starts later)</returns>
+const HISTORYRECORD* FindHistoryRecord(const HISTORYSTORE* lpStore, ULONGLONG ullTimestamp)
+{
+	// Records are appended in time order
+	DWORD dwLow = 0, dwHigh = lpStore->dwRecordsCount;
+	while (dwLow < dwHigh)
+	{
+		DWORD dwMiddle = dwLow + (dwHigh - dwLow) / 2;
+		if (lpStore->lpRecords[dwMiddle].ullTimestamp <= ullTimestamp)
+		{
+			dwLow = dwMiddle + 1;
+		}
+		else
+		{
+			dwHigh = dwMiddle;
+		}
+	}
+
+	return (dwLow == 0) ? NULL : &lpStore->lpRecords[dwLow - 1];
+}
+
+/// <summary>
+///		Rebuild subtree as it was at snapshot: nearest base and following deltas are applied,
+///		only entries of keys inside subtree are read
+/// </summary>
+///
+/// <param name="lpStore">History store</param>
+/// <param name="lpRecord">Snapshot</param>
+/// <param name="lpsSubkeyPath">Subtree relative to root of history (empty for whole history)</param>
+/// <param name="lpState">Keys of subtree</param>
+///
+/// <returns>bool</returns>
+bool ReconstructHistory(const HISTORYSTORE* lpStore, const HISTORYRECORD* lpRecord, LPCWSTR lpsSubkeyPath, HISTORYSTATE* lpState)
+{
+	ZeroMemory(lpState, sizeof(HISTORYSTATE));
+	if ((lpRecord == NULL) || (lpsSubkeyPath == NULL))
+	{
+		return false;
+	}
+
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	DWORD dwLast = (DWORD)(lpRecord - lpStore->lpRecords);
+	DWORD dwFirst = dwLast;
+	while ((dwFirst > 0) && (lpStore->lpRecords[dwFirst].dwKind != HISTORY_RECORD_BASE))
+	{
+		dwFirst--;
+	}
+
+	// Subtree is the key itself and keys below it
+	DWORD dwSubkeyPathLength = lstrlen(lpsSubkeyPath);
+	bool* lpbSelected = (bool*)calloc(lpStore->ptPaths.dwCount + 1, sizeof(bool));
+	bool bResult = (lpbSelected != NULL) && ReserveStateKeys(lpState, lpStore->ptPaths.dwCount);
+
+	for (DWORD dwPathId = 0; bResult && (dwPathId < lpStore->ptPaths.dwCount); dwPathId++)
+	{
+		LPCWSTR lpsPath = lpStore->ptPaths.lpsPaths[dwPathId];
+		lpbSelected[dwPathId] = (dwSubkeyPathLength == 0) ||
+			((_wcsnicmp(lpsPath, lpsSubkeyPath, dwSubkeyPathLength) == 0) &&
+			((lpsPath[dwSubkeyPathLength] == L'\0') || (lpsPath[dwSubkeyPathLength] == L'\\')));
+	}
+
+	for (DWORD dwIndex = dwFirst; bResult && (dwIndex <= dwLast); dwIndex++)
+	{
+		bResult = ApplyRecord(lpStore, &lpStore->lpRecords[dwIndex], lpbSelected, lpState);
+	}
+
+	free(lpbSelected);
+
+	if (bResult)
+	{
+		SortHistoryValues(lpState);
+	}
+	else
+	{
+		FreeHistoryState(lpState);
+	}
+
+	EndTraceSpan("reconstruct", "history", ullTraceStart, lpsSubkeyPath);
+
+	return bResult;
+}
+
+/// <summary>
+///		Free keys of state
+/// </summary>
+///
+/// <param name="lpState">State</param>
+///
+/// <returns>void</returns>
+void FreeHistoryState(HISTORYSTATE* lpState)
+{
+	for (DWORD dwPathId = 0; dwPathId < lpState->dwKeysCount; dwPathId++)
+	{
+		FreeHistoryKey(lpState->lpKeys[dwPathId]);
+	}
+	free(lpState->lpKeys);
+
+	ZeroMemory(lpState, sizeof(HISTORYSTATE));
+}
+
+/// <summary>
+///		Get interned path
+/// </summary>
+///
+/// <param name="lpStore">History store</param>
+/// <param name="dwPathId">Path id</param>
+///
+/// <returns>LPCWSTR</returns>
+LPCWSTR GetHistoryPath(const HISTORYSTORE* lpStore, DWORD dwPathId)
+{
+	return (dwPathId < lpStore->ptPaths.dwCount) ? lpStore->ptPaths.lpsPaths[dwPathId] : NULL;
+}
+
+/// <summary>
+///		Parse UTC time like 2024-05-01T13:00:00 (seconds may be omitted)
+/// </summary>
+///
+/// <param name="lpsTime">Time string</param>
+/// <param name="lpullTimestamp">Time (FILETIME)</param>
+///
+/// <returns>bool</returns>
+bool ParseHistoryTime(LPCSTR lpsTime, ULONGLONG* lpullTimestamp)
+{
+	SYSTEMTIME stTime;
+	ZeroMemory(&stTime, sizeof(SYSTEMTIME));
+
+	int iFields = sscanf_s(lpsTime, "%hu-%hu-%huT%hu:%hu:%hu",
+		&stTime.wYear, &stTime.wMonth, &stTime.wDay, &stTime.wHour, &stTime.wMinute, &stTime.wSecond);
+
+	FILETIME ftTime;
+	if (((iFields != 5) && (iFields != 6)) || !SystemTimeToFileTime(&stTime, &ftTime))
+	{
+		return false;
+	}
+
+	*lpullTimestamp = ((ULONGLONG)ftTime.dwHighDateTime << 32) | ftTime.dwLowDateTime;
+
+	return true;
+}
+
+/// <summary>
+///		Format time as UTC string accepted by ParseHistoryTime
+/// </summary>
+///
+/// <param name="ullTimestamp">Time (FILETIME)</param>
+/// <param name="lpsTime">Time string</param>
+/// <param name="cchTime">Time string capacity</param>
+///
+/// <returns>void</returns>
+void FormatHistoryTime(ULONGLONG ullTimestamp, LPSTR lpsTime, DWORD cchTime)
+{
+	FILETIME ftTime;
+	SYSTEMTIME stTime;
+	ftTime.dwLowDateTime = (DWORD)ullTimestamp;
+	ftTime.dwHighDateTime = (DWORD)(ullTimestamp >> 32);
+
+	if (!FileTimeToSystemTime(&ftTime, &stTime))
+	{
+		ZeroMemory(&stTime, sizeof(SYSTEMTIME));
+	}
+
+	sprintf_s(lpsTime, cchTime, "%04u-%02u-%02uT%02u:%02u:%02u",
+		stTime.wYear, stTime.wMonth, stTime.wDay, stTime.wHour, stTime.wMinute, stTime.wSecond);
+}
@@ -0,0 +1,309 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/Instrumentation.h"
+
+#ifdef REGISTRY_EDITOR_STATS
+
+static const LPCSTR g_lpsStatCallNames[STAT_CALLS_COUNT] = {
+	"RegOpenKeyEx",
+	"RegCloseKey",
+	"RegEnumKeyEx",
+	"RegEnumValue",
+	"RegQueryInfoKey",
+	"RegQueryValueEx",
+};
+
+static SRWLOCK g_srwStatsLock = SRWLOCK_INIT;
+static REGSTATS g_rsFinishedThreadsStats;
+static volatile bool g_bStatsEnabled = false;
+static double g_dNanosecondsPerTick = 0.0;
+
+/// <summary>
+///		Add counters of one accumulator to another
+/// </summary>
+/// 
+/// <param name="lpTotal">Destination</param>
+/// <param name="lpStats">Source</param>
+/// 
+/// <returns>void</returns>
+static void MergeStats(REGSTATS* lpTotal, const REGSTATS* lpStats)
+{
+	for (DWORD dwCall = 0; dwCall < STAT_CALLS_COUNT; dwCall++)
+	{
+		lpTotal->ullCallsCount[dwCall] += lpStats->ullCallsCount[dwCall];
+		lpTotal->ullCallsTime[dwCall] += lpStats->ullCallsTime[dwCall];
+
+		for (DWORD dwBucket = 0; dwBucket < STAT_HISTOGRAM_BUCKETS; dwBucket++)
+		{
+			lpTotal->ullCallsHistogram[dwCall][dwBucket] += lpStats->ullCallsHistogram[dwCall][dwBucket];
+		}
+	}
+
+	lpTotal->ullAllocations += lpStats->ullAllocations;
+	lpTotal->ullBytesAllocated += lpStats->ullBytesAllocated;
+	lpTotal->ullKeysVisited += lpStats->ullKeysVisited;
+	lpTotal->ullOutputBytes += lpStats->ullOutputBytes;
+
+	if (lpStats->dwMaxDepth > lpTotal->dwMaxDepth)
+	{
+		lpTotal->dwMaxDepth = lpStats->dwMaxDepth;
+	}
+}
+
+// Per-thread accumulator, registered while its thread lives so that statistics
+// printed while pool threads are parked still include their counters
+struct THREADSTATS {
+	REGSTATS rsStats;
+	THREADSTATS* lpPrevious;
+	THREADSTATS* lpNext;
+
+	THREADSTATS();
+	~THREADSTATS();
+};
+
+static THREADSTATS* g_lpLiveThreadsStats = NULL;
+
+THREADSTATS::THREADSTATS()
+{
+	ZeroMemory(&rsStats, sizeof(REGSTATS));
+	lpPrevious = NULL;
+
+	AcquireSRWLockExclusive(&g_srwStatsLock);
+	lpNext = g_lpLiveThreadsStats;
+	if (lpNext != NULL)
+	{
+		lpNext->lpPrevious = this;
+	}
+
+	g_lpLiveThreadsStats = this;
+	ReleaseSRWLockExclusive(&g_srwStatsLock);
+}
+
+THREADSTATS::~THREADSTATS()
+{
+	AcquireSRWLockExclusive(&g_srwStatsLock);
+	if (lpPrevious != NULL)
+	{
+		lpPrevious->lpNext = lpNext;
+	}
+	else
+	{
+		g_lpLiveThreadsStats = lpNext;
+	}
+
+	if (lpNext != NULL)
+	{
+		lpNext->lpPrevious = lpPrevious;
+	}
+
+	MergeStats(&g_rsFinishedThreadsStats, &rsStats);
+	ReleaseSRWLockExclusive(&g_srwStatsLock);
+}
+
+static thread_local THREADSTATS t_tsStats;
+
+/// <summary>
+///		Turn timing of registry calls on or off
+/// </summary>
+/// 
+/// <param name="bEnabled">Enable timing</param>
+/// 
+/// <returns>void</returns>
+void EnableStats(bool bEnabled)
+{
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+
+	g_dNanosecondsPerTick = 1e9 / (double)liFrequency.QuadPart;
+	g_bStatsEnabled = bEnabled;
+}
+
+/// <summary>
+///		Check if timing of registry calls is on
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool IsStatsEnabled()
+{
+	return g_bStatsEnabled;
+}
+
+/// <summary>
+///		Get accumulator of current thread
+/// </summary>
+/// 
+/// <returns>REGSTATS*</returns>
+REGSTATS* GetThreadStats()
+{
+	return &t_tsStats.rsStats;
+}
+
+/// <summary>
+///		Start timing of registry call
+/// </summary>
+/// 
+/// <returns>ULONGLONG (0 if timing is off)</returns>
+ULONGLONG BeginStatCall()
+{
+	if (!g_bStatsEnabled)
+	{
+		return 0;
+	}
+
+	LARGE_INTEGER liCounter;
+	QueryPerformanceCounter(&liCounter);
+
+	return liCounter.QuadPart;
+}
+
+/// <summary>
+///		Count registry call and add its duration to histogram
+/// </summary>
+/// 
+/// <param name="rscCall">Registry call</param>
+/// <param name="ullStart">Value returned by BeginStatCall</param>
+/// 
+/// <returns>void</returns>
+void EndStatCall(REGSTATCALL rscCall, ULONGLONG ullStart)
+{
+	REGSTATS* lpStats = &t_tsStats.rsStats;
+	lpStats->ullCallsCount[rscCall]++;
+
+	if (ullStart == 0)
+	{
+		return;
+	}
+
+	LARGE_INTEGER liCounter;
+	QueryPerformanceCounter(&liCounter);
+
+	ULONGLONG ullTicks = liCounter.QuadPart - ullStart;
+	ULONGLONG ullNanoseconds = (ULONGLONG)((double)ullTicks * g_dNanosecondsPerTick);
+	lpStats->ullCallsTime[rscCall] += ullNanoseconds;
+
+	// Bucket N holds calls that took less than 2^(N+1) ns
+	DWORD dwBucket = 0;
+	while ((ullNanoseconds >>= 1) != 0 && (dwBucket < STAT_HISTOGRAM_BUCKETS - 1))
+	{
+		dwBucket++;
+	}
+
+	lpStats->ullCallsHistogram[rscCall][dwBucket]++;
+}
+
+/// <summary>
+///		Sum accumulators of finished threads and all live threads,
+///		counters of threads that are still walking are a snapshot
+/// </summary>
+/// 
+/// <param name="lpTotal">Result</param>
+/// 
+/// <returns>void</returns>
+void CollectStats(REGSTATS* lpTotal)
+{
+	ZeroMemory(lpTotal, sizeof(REGSTATS));
+
+	// Touch accumulator of current thread so that it is registered
+	GetThreadStats();
+
+	AcquireSRWLockShared(&g_srwStatsLock);
+	MergeStats(lpTotal, &g_rsFinishedThreadsStats);
+	for (const THREADSTATS* lpThreadStats = g_lpLiveThreadsStats; lpThreadStats != NULL; lpThreadStats = lpThreadStats->lpNext)
+	{
+		MergeStats(lpTotal, &lpThreadStats->rsStats);
+	}
+
+	ReleaseSRWLockShared(&g_srwStatsLock);
+}
+
+/// <summary>
+///		Get upper bound of call duration for percentile
+/// </summary>
+/// 
+/// <param name="lpHistogram">Call histogram</param>
+/// <param name="ullCallsCount">Calls count</param>
+/// <param name="dPercentile">Percentile (0..1)</param>
+/// 
+/// <returns>ULONGLONG (ns)</returns>
+static ULONGLONG GetPercentileBound(const ULONGLONG* lpHistogram, ULONGLONG ullCallsCount, double dPercentile)
+{
+	ULONGLONG ullThreshold = (ULONGLONG)((double)ullCallsCount * dPercentile);
+	ULONGLONG ullSeen = 0;
+
+	for (DWORD dwBucket = 0; dwBucket < STAT_HISTOGRAM_BUCKETS; dwBucket++)
+	{
+		ullSeen += lpHistogram[dwBucket];
+		if (ullSeen > ullThreshold)
+		{
+			return 2ull << dwBucket;
+		}
+	}
+
+	return 2ull << (STAT_HISTOGRAM_BUCKETS - 1);
+}
+
+/// <summary>
+///		Print collected statistics as text summary or JSON
+/// </summary>
+/// 
+/// <param name="lpOutput">Output stream</param>
+/// <param name="bJson">Print JSON</param>
+/// 
+/// <returns>void</returns>
+void PrintStats(FILE* lpOutput, bool bJson)
+{
+	REGSTATS rsTotal;
+	CollectStats(&rsTotal);
+
+	if (bJson)
+	{
+		fprintf(lpOutput, "{\"calls\":{");
+		for (DWORD dwCall = 0; dwCall < STAT_CALLS_COUNT; dwCall++)
+		{
+			fprintf(lpOutput, "%s\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"histogram_ns\":[",
+				(dwCall == 0) ? "" : ",", g_lpsStatCallNames[dwCall], rsTotal.ullCallsCount[dwCall], rsTotal.ullCallsTime[dwCall]);
+
+			bool bFirstBucket = true;
+			for (DWORD dwBucket = 0; dwBucket < STAT_HISTOGRAM_BUCKETS; dwBucket++)
+			{
+				if (rsTotal.ullCallsHistogram[dwCall][dwBucket] != 0)
+				{
+					fprintf(lpOutput, "%s[%llu,%llu]", bFirstBucket ? "" : ",", 2ull << dwBucket, rsTotal.ullCallsHistogram[dwCall][dwBucket]);
+					bFirstBucket = false;
+				}
+			}
+
+			fprintf(lpOutput, "]}");
+		}
+
+		fprintf(lpOutput, "},\"keys_visited\":%llu,\"max_depth\":%u,\"allocations\":%llu,\"bytes_allocated\":%llu,\"output_bytes\":%llu}\n",
+			rsTotal.ullKeysVisited, rsTotal.dwMaxDepth, rsTotal.ullAllocations, rsTotal.ullBytesAllocated, rsTotal.ullOutputBytes);
+		return;
+	}
+
+	fprintf(lpOutput, "Statistics:\n");
+	for (DWORD dwCall = 0; dwCall < STAT_CALLS_COUNT; dwCall++)
+	{
+		ULONGLONG ullCallsCount = rsTotal.ullCallsCount[dwCall];
+		if (ullCallsCount == 0)
+		{
+			continue;
+		}
+
+		fprintf(lpOutput, "  %-16s calls: %llu  total: %.3f ms  avg: %.0f ns  p50 < %llu ns  p99 < %llu ns\n",
+			g_lpsStatCallNames[dwCall],
+			ullCallsCount,
+			rsTotal.ullCallsTime[dwCall] / 1e6,
+			(double)rsTotal.ullCallsTime[dwCall] / (double)ullCallsCount,
+			GetPercentileBound(rsTotal.ullCallsHistogram[dwCall], ullCallsCount, 0.50),
+			GetPercentileBound(rsTotal.ullCallsHistogram[dwCall], ullCallsCount, 0.99));
+	}
+
+	fprintf(lpOutput, "  Keys visited: %llu\n", rsTotal.ullKeysVisited);
+	fprintf(lpOutput, "  Max depth: %u\n", rsTotal.dwMaxDepth);
+	fprintf(lpOutput, "  Allocations: %llu (%llu bytes)\n", rsTotal.ullAllocations, rsTotal.ullBytesAllocated);
+	fprintf(lpOutput, "  Output bytes: %llu\n", rsTotal.ullOutputBytes);
+}
+
+#endif
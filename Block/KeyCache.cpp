@@ -0,0 +1,486 @@
+#include "../Api/Platform.h"
+
+#include "../Api/KeyCache.h"
+#include "../Api/RegistryEditor.h"
+#include "../Api/RegistryBackend.h"
+#include "../Api/Collections.h"
+#include "../Api/Instrumentation.h"
+
+static SRWLOCK g_srwKeyCache = SRWLOCK_INIT;
+static CACHEDKEY g_ckKeys[KEY_CACHE_MAX_KEYS];
+static DWORD g_dwKeysCount = 0;
+static volatile bool g_bKeyCacheEnabled = false;
+static volatile bool g_bStopWatcher = false;
+static HANDLE g_hWakeEvent = NULL;
+static HANDLE g_hWatcherThread = NULL;
+
+/// <summary>
+///		Release list of names
+/// </summary>
+/// 
+/// <param name="lpsNames">Names</param>
+/// <param name="dwNamesCount">Names count</param>
+/// 
+/// <returns>void</returns>
+static void FreeNames(LPWSTR* lpsNames, DWORD dwNamesCount)
+{
+	for (DWORD dwIndex = 0; dwIndex < dwNamesCount; dwIndex++)
+	{
+		free(lpsNames[dwIndex]);
+	}
+	free(lpsNames);
+}
+
+/// <summary>
+///		Deep copy of list of names, every name is allocated separately as callers free them one by one
+/// </summary>
+/// 
+/// <param name="lpsNames">Names</param>
+/// <param name="dwNamesCount">Names count</param>
+/// 
+/// <returns>LPWSTR*</returns>
+static LPWSTR* CopyNames(LPWSTR* lpsNames, DWORD dwNamesCount)
+{
+	LPWSTR* lpsCopy = (LPWSTR*)calloc(dwNamesCount + 1, sizeof(LPWSTR));
+	if (lpsCopy == NULL)
+	{
+		return NULL;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwNamesCount; dwIndex++)
+	{
+		lpsCopy[dwIndex] = _wcsdup(lpsNames[dwIndex]);
+
+		if (lpsCopy[dwIndex] == NULL)
+		{
+			FreeNames(lpsCopy, dwIndex);
+			return NULL;
+		}
+
+		STAT_ALLOC((lstrlen(lpsNames[dwIndex]) + 1) * sizeof(WCHAR));
+	}
+
+	return lpsCopy;
+}
+
+/// <summary>
+///		Find cached key by its handle, lock must be held
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// 
+/// <returns>CACHEDKEY* (NULL if key is not cached)</returns>
+static CACHEDKEY* FindCachedKey(HKEY hKey)
+{
+	for (DWORD dwIndex = 0; dwIndex < g_dwKeysCount; dwIndex++)
+	{
+		if (g_ckKeys[dwIndex].hKey == hKey)
+		{
+			return &g_ckKeys[dwIndex];
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Drop all enumeration lists of key, exclusive lock must be held
+/// </summary>
+/// 
+/// <param name="lpKey">Cached key</param>
+/// 
+/// <returns>void</returns>
+static void InvalidateCachedKey(CACHEDKEY* lpKey)
+{
+	for (DWORD dwBucket = 0; dwBucket < KEY_CACHE_BUCKETS_COUNT; dwBucket++)
+	{
+		ENUMCACHEENTRY* lpEntry = lpKey->lpBuckets[dwBucket];
+		while (lpEntry != NULL)
+		{
+			ENUMCACHEENTRY* lpNext = lpEntry->lpNext;
+			FreeNames(lpEntry->lpsNames, lpEntry->dwNamesCount);
+			free(lpEntry->lpsKeyPath);
+			free(lpEntry);
+			lpEntry = lpNext;
+		}
+		lpKey->lpBuckets[dwBucket] = NULL;
+	}
+
+	lpKey->dwListsCount = 0;
+	lpKey->dwGeneration++;
+}
+
+/// <summary>
+///		Check if path is key itself or lies in its subtree
+/// </summary>
+/// 
+/// <param name="lpsKeyPath">Path of cached key</param>
+/// <param name="lpsPath">Checked path</param>
+/// 
+/// <returns>bool</returns>
+static bool IsPathInKey(LPCWSTR lpsKeyPath, LPCWSTR lpsPath)
+{
+	size_t cchKeyPath = wcslen(lpsKeyPath);
+
+	return (cchKeyPath == 0) ||
+		((_wcsnicmp(lpsKeyPath, lpsPath, cchKeyPath) == 0) && ((lpsPath[cchKeyPath] == L'\0') || (lpsPath[cchKeyPath] == L'\\')));
+}
+
+/// <summary>
+///		Request change notification of whole subtree of key
+/// </summary>
+/// 
+/// <param name="lpKey">Cached key</param>
+/// 
+/// <returns>void</returns>
+static void ArmChangeNotification(CACHEDKEY* lpKey)
+{
+	// Keys of other backends are not real handles and never change
+	lpKey->bWatched = (GetRegBackend() == GetWin32Backend()) &&
+		(RegNotifyChangeKeyValue(lpKey->hKey, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+			lpKey->hChangeEvent, TRUE) == ERROR_SUCCESS);
+}
+
+/// <summary>
+///		Watcher thread: arms notifications and invalidates keys that changed
+/// </summary>
+/// 
+/// <param name="lpParameter">Not used</param>
+/// 
+/// <returns>DWORD</returns>
+static DWORD WINAPI WatchCachedKeys(LPVOID lpParameter)
+{
+	HANDLE hEvents[MAXIMUM_WAIT_OBJECTS];
+	DWORD dwArmedCount = 0;
+
+	// Asynchronous notifications are cancelled when requesting thread exits, so all of them are requested here
+	hEvents[0] = g_hWakeEvent;
+	while (!g_bStopWatcher)
+	{
+		AcquireSRWLockExclusive(&g_srwKeyCache);
+		for (; dwArmedCount < g_dwKeysCount; dwArmedCount++)
+		{
+			ArmChangeNotification(&g_ckKeys[dwArmedCount]);
+			hEvents[dwArmedCount + 1] = g_ckKeys[dwArmedCount].hChangeEvent;
+		}
+		ReleaseSRWLockExclusive(&g_srwKeyCache);
+
+		DWORD dwWaitResult = WaitForMultipleObjects(dwArmedCount + 1, hEvents, FALSE, INFINITE);
+		if (dwWaitResult == WAIT_FAILED)
+		{
+			break;
+		}
+
+		if ((dwWaitResult > WAIT_OBJECT_0) && (dwWaitResult <= WAIT_OBJECT_0 + dwArmedCount))
+		{
+			// Re-arm before dropping lists, so change made meanwhile is not lost
+			CACHEDKEY* lpKey = &g_ckKeys[dwWaitResult - WAIT_OBJECT_0 - 1];
+
+			AcquireSRWLockExclusive(&g_srwKeyCache);
+			ArmChangeNotification(lpKey);
+			InvalidateCachedKey(lpKey);
+			ReleaseSRWLockExclusive(&g_srwKeyCache);
+		}
+	}
+
+	return 0;
+}
+
+/// <summary>
+///		Keep opened keys and their enumeration lists between requests
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool EnableKeyCache()
+{
+	if (g_bKeyCacheEnabled)
+	{
+		return true;
+	}
+
+	g_hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (g_hWakeEvent == NULL)
+	{
+		return false;
+	}
+
+	g_bStopWatcher = false;
+	g_hWatcherThread = CreateThread(NULL, 0, WatchCachedKeys, NULL, 0, NULL);
+	if (g_hWatcherThread == NULL)
+	{
+		CloseHandle(g_hWakeEvent);
+		g_hWakeEvent = NULL;
+		return false;
+	}
+
+	g_bKeyCacheEnabled = true;
+
+	return true;
+}
+
+/// <summary>
+///		Stop watcher thread, close cached keys and release lists
+/// </summary>
+/// 
+/// <returns>void</returns>
+void DisableKeyCache()
+{
+	if (!g_bKeyCacheEnabled)
+	{
+		return;
+	}
+
+	g_bKeyCacheEnabled = false;
+	g_bStopWatcher = true;
+	SetEvent(g_hWakeEvent);
+	WaitForSingleObject(g_hWatcherThread, INFINITE);
+
+	AcquireSRWLockExclusive(&g_srwKeyCache);
+	for (DWORD dwIndex = 0; dwIndex < g_dwKeysCount; dwIndex++)
+	{
+		InvalidateCachedKey(&g_ckKeys[dwIndex]);
+		free(g_ckKeys[dwIndex].lpBuckets);
+		free(g_ckKeys[dwIndex].lpsKeyPath);
+		CloseHandle(g_ckKeys[dwIndex].hChangeEvent);
+		CloseRegKey(g_ckKeys[dwIndex].hKey);
+	}
+	g_dwKeysCount = 0;
+	ReleaseSRWLockExclusive(&g_srwKeyCache);
+
+	CloseHandle(g_hWatcherThread);
+	CloseHandle(g_hWakeEvent);
+	g_hWatcherThread = NULL;
+	g_hWakeEvent = NULL;
+}
+
+/// <summary>
+///		Check if keys are cached
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool IsKeyCacheEnabled()
+{
+	return g_bKeyCacheEnabled;
+}
+
+/// <summary>
+///		Open key for reading, reuse handle if key was opened before
+/// </summary>
+/// 
+/// <param name="hKeyRoot">Hkey root path</param>
+/// <param name="lpsKeyPath">Path to key in hkey</param>
+/// <param name="phkResult">Opened key, release it with CloseCachedRegKey</param>
+/// 
+/// <returns>bool</returns>
+bool OpenCachedRegKey(HKEY hKeyRoot, LPCWSTR lpsKeyPath, PHKEY phkResult)
+{
+	if (!g_bKeyCacheEnabled)
+	{
+		return OpenRegKey(hKeyRoot, lpsKeyPath, KEY_READ, phkResult);
+	}
+
+	if (lpsKeyPath == NULL)
+	{
+		return false;
+	}
+
+	AcquireSRWLockExclusive(&g_srwKeyCache);
+
+	bool bResult = false;
+	for (DWORD dwIndex = 0; (dwIndex < g_dwKeysCount) && !bResult; dwIndex++)
+	{
+		if ((g_ckKeys[dwIndex].hKeyRoot == hKeyRoot) && (_wcsicmp(g_ckKeys[dwIndex].lpsKeyPath, lpsKeyPath) == 0))
+		{
+			*phkResult = g_ckKeys[dwIndex].hKey;
+			bResult = true;
+		}
+	}
+
+	if (!bResult && OpenRegKey(hKeyRoot, lpsKeyPath, KEY_READ, phkResult))
+	{
+		bResult = true;
+
+		// Key stays uncached when there is no free wait slot, CloseCachedRegKey closes it then
+		if (g_dwKeysCount < KEY_CACHE_MAX_KEYS)
+		{
+			CACHEDKEY* lpKey = &g_ckKeys[g_dwKeysCount];
+			ZeroMemory(lpKey, sizeof(CACHEDKEY));
+			lpKey->hKeyRoot = hKeyRoot;
+			lpKey->hKey = *phkResult;
+			lpKey->lpsKeyPath = _wcsdup(lpsKeyPath);
+			lpKey->hChangeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+			lpKey->lpBuckets = (ENUMCACHEENTRY**)calloc(KEY_CACHE_BUCKETS_COUNT, sizeof(ENUMCACHEENTRY*));
+
+			if ((lpKey->lpsKeyPath != NULL) && (lpKey->hChangeEvent != NULL) && (lpKey->lpBuckets != NULL))
+			{
+				g_dwKeysCount++;
+				SetEvent(g_hWakeEvent);
+			}
+			else
+			{
+				free(lpKey->lpsKeyPath);
+				free(lpKey->lpBuckets);
+				if (lpKey->hChangeEvent != NULL)
+				{
+					CloseHandle(lpKey->hChangeEvent);
+				}
+			}
+		}
+	}
+
+	ReleaseSRWLockExclusive(&g_srwKeyCache);
+
+	return bResult;
+}
+
+/// <summary>
+///		Close key unless it is cached
+/// </summary>
+/// 
+/// <param name="hKey">Key opened by OpenCachedRegKey</param>
+/// 
+/// <returns>bool</returns>
+bool CloseCachedRegKey(HKEY hKey)
+{
+	AcquireSRWLockShared(&g_srwKeyCache);
+	bool bCached = g_bKeyCacheEnabled && (FindCachedKey(hKey) != NULL);
+	ReleaseSRWLockShared(&g_srwKeyCache);
+
+	return bCached || CloseRegKey(hKey);
+}
+
+/// <summary>
+///		Get copy of cached subkeys list
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpsKeyPath">Path relative to opened key</param>
+/// <param name="lpdwNamesCount">Names count</param>
+/// <param name="lpdwGeneration">Generation to pass to StoreEnumCache on miss</param>
+/// 
+/// <returns>LPWSTR* (NULL on miss)</returns>
+LPWSTR* LookupEnumCache(HKEY hKey, LPCWSTR lpsKeyPath, DWORD* lpdwNamesCount, DWORD* lpdwGeneration)
+{
+	*lpdwGeneration = 0;
+	if (!g_bKeyCacheEnabled)
+	{
+		return NULL;
+	}
+
+	DWORD dwHash = HashString(HASH_INITIAL_VALUE, lpsKeyPath, HASH_TERMINATED, false);
+	LPWSTR* lpsResult = NULL;
+
+	AcquireSRWLockShared(&g_srwKeyCache);
+
+	CACHEDKEY* lpKey = FindCachedKey(hKey);
+	if ((lpKey != NULL) && lpKey->bWatched)
+	{
+		*lpdwGeneration = lpKey->dwGeneration;
+
+		for (ENUMCACHEENTRY* lpEntry = lpKey->lpBuckets[dwHash % KEY_CACHE_BUCKETS_COUNT]; lpEntry != NULL; lpEntry = lpEntry->lpNext)
+		{
+			if ((lpEntry->dwHash == dwHash) && (wcscmp(lpEntry->lpsKeyPath, lpsKeyPath) == 0))
+			{
+				lpsResult = CopyNames(lpEntry->lpsNames, lpEntry->dwNamesCount);
+				*lpdwNamesCount = lpEntry->dwNamesCount;
+				break;
+			}
+		}
+	}
+
+	ReleaseSRWLockShared(&g_srwKeyCache);
+
+	return lpsResult;
+}
+
+/// <summary>
+///		Remember subkeys list, it is dropped if key changed since lookup
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpsKeyPath">Path relative to opened key</param>
+/// <param name="lpsNames">Names (copied)</param>
+/// <param name="dwNamesCount">Names count</param>
+/// <param name="dwGeneration">Generation returned by LookupEnumCache</param>
+/// 
+/// <returns>void</returns>
+void StoreEnumCache(HKEY hKey, LPCWSTR lpsKeyPath, LPWSTR* lpsNames, DWORD dwNamesCount, DWORD dwGeneration)
+{
+	if (!g_bKeyCacheEnabled)
+	{
+		return;
+	}
+
+	DWORD dwHash = HashString(HASH_INITIAL_VALUE, lpsKeyPath, HASH_TERMINATED, false);
+
+	AcquireSRWLockExclusive(&g_srwKeyCache);
+
+	CACHEDKEY* lpKey = FindCachedKey(hKey);
+	if ((lpKey != NULL) && lpKey->bWatched && (lpKey->dwGeneration == dwGeneration) && (lpKey->dwListsCount < KEY_CACHE_MAX_LISTS))
+	{
+		ENUMCACHEENTRY** lpBucket = &lpKey->lpBuckets[dwHash % KEY_CACHE_BUCKETS_COUNT];
+
+		// Other request may have stored the same list meanwhile
+		bool bFound = false;
+		for (ENUMCACHEENTRY* lpEntry = *lpBucket; (lpEntry != NULL) && !bFound; lpEntry = lpEntry->lpNext)
+		{
+			bFound = (lpEntry->dwHash == dwHash) && (wcscmp(lpEntry->lpsKeyPath, lpsKeyPath) == 0);
+		}
+
+		ENUMCACHEENTRY* lpEntry = bFound ? NULL : (ENUMCACHEENTRY*)calloc(1, sizeof(ENUMCACHEENTRY));
+		if (lpEntry != NULL)
+		{
+			lpEntry->lpsKeyPath = _wcsdup(lpsKeyPath);
+			lpEntry->lpsNames = CopyNames(lpsNames, dwNamesCount);
+
+			if ((lpEntry->lpsKeyPath != NULL) && (lpEntry->lpsNames != NULL))
+			{
+				lpEntry->dwHash = dwHash;
+				lpEntry->dwNamesCount = dwNamesCount;
+				lpEntry->lpNext = *lpBucket;
+				*lpBucket = lpEntry;
+				lpKey->dwListsCount++;
+			}
+			else
+			{
+				free(lpEntry->lpsKeyPath);
+				if (lpEntry->lpsNames != NULL)
+				{
+					FreeNames(lpEntry->lpsNames, dwNamesCount);
+				}
+				free(lpEntry);
+			}
+		}
+	}
+
+	ReleaseSRWLockExclusive(&g_srwKeyCache);
+}
+
+/// <summary>
+///		Drop lists of cached keys that contain written key. Called by writer before it replies,
+///		so next read of the same client does not wait for change notification of watcher thread
+/// </summary>
+/// 
+/// <param name="hKeyRoot">Hkey root path</param>
+/// <param name="lpsKeyPath">Path of written key in hkey</param>
+/// 
+/// <returns>void</returns>
+void InvalidateKeyCache(HKEY hKeyRoot, LPCWSTR lpsKeyPath)
+{
+	if (!g_bKeyCacheEnabled || (lpsKeyPath == NULL))
+	{
+		return;
+	}
+
+	AcquireSRWLockExclusive(&g_srwKeyCache);
+
+	for (DWORD dwIndex = 0; dwIndex < g_dwKeysCount; dwIndex++)
+	{
+		if ((g_ckKeys[dwIndex].hKeyRoot == hKeyRoot) && IsPathInKey(g_ckKeys[dwIndex].lpsKeyPath, lpsKeyPath))
+		{
+			InvalidateCachedKey(&g_ckKeys[dwIndex]);
+		}
+	}
+
+	ReleaseSRWLockExclusive(&g_srwKeyCache);
+}
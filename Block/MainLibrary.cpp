@@ -1,7 +1,15 @@
-#include <windows.h>
+#include "../Api/Platform.h"
 #include <iostream>
 
 #include "../Api/RegistryEditor.h"
+#include "../Api/RegistryBackend.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Trace.h"
+#include "../Api/KeyCache.h"
+#include "../Api/FuzzyMatch.h"
+#include "../Api/Throttle.h"
+#include "../Api/Progress.h"
+#include "../Api/Collections.h"
 
 /// <summary>
 ///		Create a new key in registry
@@ -22,9 +30,16 @@ bool CreateRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey)
 	DWORD dwDisposition;
 
 	// Create key
+	ULONGLONG ullTraceStart = BeginTraceSpan();
 	LRESULT error = RegCreateKeyEx(hKeyRoot, lpSubKey, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_READ, NULL, &hKey, &dwDisposition);
+	EndTraceSpanStatus("RegCreateKeyEx", "write", ullTraceStart, lpSubKey, (LONG)error);
 
-	CloseRegKey(hKey);
+	// Writes always go to Windows registry, whatever backend is used for reading
+	if (error == ERROR_SUCCESS)
+	{
+		RegCloseKey(hKey);
+		InvalidateKeyCache(hKeyRoot, lpSubKey);
+	}
 
 	return (error == ERROR_SUCCESS) && (dwDisposition == REG_CREATED_NEW_KEY);
 }
@@ -40,15 +55,33 @@ bool CreateRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey)
 /// 
 /// <returns>bool</returns>
 bool OpenRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult)
+{
+	return OpenRegKeyStatus(hKeyRoot, lpSubKey, samDesired, phkResult) == ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Open key, error tells missing key from one that cannot be read
+/// </summary>
+/// 
+/// <param name="hKeyRoot">Hkey root path</param>
+/// <param name="lpSubKey">Path to key in hkey</param>
+/// <param name="samDesired"></param>
+/// <param name="phkResult"></param>
+/// 
+/// <returns>LRESULT</returns>
+LRESULT OpenRegKeyStatus(HKEY hKeyRoot, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult)
 {
 	if (lpSubKey == NULL)
 	{
-		return false;
+		return ERROR_INVALID_PARAMETER;
 	}
 
 	// Open key
-	LRESULT error = RegOpenKeyEx(hKeyRoot, lpSubKey, 0, samDesired, phkResult);
-	return error == ERROR_SUCCESS;
+	STAT_CALL_BEGIN();
+	LRESULT error = GetRegBackend()->lpfnOpenKey(hKeyRoot, lpSubKey, samDesired, phkResult);
+	STAT_CALL_END(STAT_OPEN_KEY);
+
+	return error;
 }
 
 /// <summary>
@@ -60,7 +93,91 @@ bool OpenRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkRes
 /// <returns>bool</returns>
 bool CloseRegKey(HKEY hKey)
 {
-	LRESULT error = RegCloseKey(hKey);
+	STAT_CALL_BEGIN();
+	LRESULT error = GetRegBackend()->lpfnCloseKey(hKey);
+	STAT_CALL_END(STAT_CLOSE_KEY);
+
+	return error == ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get subkey name by index
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="dwIndex">Subkey index</param>
+/// <param name="lpsSubKeyName">Subkey name</param>
+/// <param name="lpdwNameSize">Subkey name buffer length / subkey name length</param>
+/// <param name="lpftLastWriteTime">Last write time (may be NULL)</param>
+/// 
+/// <returns>LRESULT (ERROR_NO_MORE_ITEMS after last subkey)</returns>
+LRESULT EnumRegKey(HKEY hKey, DWORD dwIndex, LPWSTR lpsSubKeyName, DWORD* lpdwNameSize, PFILETIME lpftLastWriteTime)
+{
+	STAT_CALL_BEGIN();
+	LRESULT error = GetRegBackend()->lpfnEnumKey(hKey, dwIndex, lpsSubKeyName, lpdwNameSize, lpftLastWriteTime);
+	STAT_CALL_END(STAT_ENUM_KEY);
+
+	return error;
+}
+
+/// <summary>
+///		Get value of opened key by index
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="dwIndex">Value index</param>
+/// <param name="lpsValueName">Value name</param>
+/// <param name="lpdwNameSize">Value name buffer length / value name length</param>
+/// <param name="lpdwType">Value type (may be NULL)</param>
+/// <param name="lpData">Value data (may be NULL)</param>
+/// <param name="lpcbData">Value data size (may be NULL)</param>
+/// 
+/// <returns>LRESULT (ERROR_NO_MORE_ITEMS after last value)</returns>
+LRESULT EnumRegValue(HKEY hKey, DWORD dwIndex, LPWSTR lpsValueName, DWORD* lpdwNameSize, DWORD* lpdwType, BYTE* lpData, DWORD* lpcbData)
+{
+	STAT_CALL_BEGIN();
+	LRESULT error = GetRegBackend()->lpfnEnumValue(hKey, dwIndex, lpsValueName, lpdwNameSize, lpdwType, lpData, lpcbData);
+	STAT_CALL_END(STAT_ENUM_VALUE);
+
+	return error;
+}
+
+/// <summary>
+///		Get counters of opened key
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpdwSubKeysCount">Subkeys count (may be NULL)</param>
+/// <param name="lpdwValuesCount">Values count (may be NULL)</param>
+/// <param name="lpcbMaxValueSize">Largest value data size (may be NULL)</param>
+/// <param name="lpftLastWriteTime">Last write time (may be NULL)</param>
+/// 
+/// <returns>bool</returns>
+bool QueryRegKeyInfo(HKEY hKey, DWORD* lpdwSubKeysCount, DWORD* lpdwValuesCount, DWORD* lpcbMaxValueSize, PFILETIME lpftLastWriteTime)
+{
+	STAT_CALL_BEGIN();
+	LRESULT error = GetRegBackend()->lpfnQueryInfoKey(hKey, lpdwSubKeysCount, NULL, lpdwValuesCount, NULL, lpcbMaxValueSize, lpftLastWriteTime);
+	STAT_CALL_END(STAT_QUERY_INFO_KEY);
+
+	return error == ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get value of opened key by name
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpsValueName">Value name</param>
+/// <param name="lpdwType">Value type (may be NULL)</param>
+/// <param name="lpData">Value data (may be NULL)</param>
+/// <param name="lpcbData">Value data size (required size if buffer is too small)</param>
+/// 
+/// <returns>bool</returns>
+bool QueryRegValue(HKEY hKey, LPCWSTR lpsValueName, DWORD* lpdwType, BYTE* lpData, DWORD* lpcbData)
+{
+	STAT_CALL_BEGIN();
+	LRESULT error = GetRegBackend()->lpfnQueryValue(hKey, lpsValueName, lpdwType, lpData, lpcbData);
+	STAT_CALL_END(STAT_QUERY_VALUE);
 
 	return error == ERROR_SUCCESS;
 }
@@ -84,18 +201,54 @@ bool SetRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, LPCWSTR lpParamName, DWORD dwPar
 		return false;
 	}
 
-	// Open key root in KEY_WRITE mode
+	// Open key root in KEY_WRITE mode, failed open is traced as failed write
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	HKEY hKey;
+	LRESULT error = RegOpenKeyEx(hKeyRoot, L"", 0, KEY_WRITE, &hKey);
+
+	// Set value of key parameter, missing key is created so cached subkey lists are dropped before reply
+	if (error == ERROR_SUCCESS)
+	{
+		error = RegSetKeyValue(hKey, lpSubKey, lpParamName, dwParamType, lpData, cbData);
+		RegCloseKey(hKey);
+		InvalidateKeyCache(hKeyRoot, lpSubKey);
+	}
+
+	EndTraceSpanStatus("RegSetKeyValue", "write", ullTraceStart, lpSubKey, (LONG)error);
+
+	return error == ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get one of key parameters from registry
+/// </summary>
+/// 
+/// <param name="hKeyRoot">Hkey root path</param>
+/// <param name="lpSubKey">Key path in hkey</param>
+/// <param name="lpParamName">Value name</param>
+/// <param name="dwParamType">Value type</param>
+/// <param name="lpData">Value</param>
+/// <param name="cbData">Value size (required size if buffer is too small)</param>
+/// 
+/// <returns>bool</returns>
+bool GetRegKey(HKEY hKeyRoot, LPCWSTR lpSubKey, LPCWSTR lpParamName, DWORD* dwParamType, BYTE* lpData, DWORD* cbData)
+{
+	if ((lpParamName == NULL) || (lpSubKey == NULL) || (cbData == NULL))
+	{
+		return false;
+	}
+
 	HKEY hKey;
-	if (!OpenRegKey(hKeyRoot, L"", KEY_WRITE, &hKey))
+	if (!OpenRegKey(hKeyRoot, lpSubKey, KEY_QUERY_VALUE, &hKey))
 	{
 		return false;
 	}
 
-	// Set value of key parameter
-	LRESULT error = RegSetKeyValue(hKey, lpSubKey, lpParamName, dwParamType, lpData, cbData);
+	// Data is returned as stored, REG_EXPAND_SZ is not expanded
+	bool bResult = QueryRegValue(hKey, lpParamName, dwParamType, lpData, cbData);
 	CloseRegKey(hKey);
 
-	return error == ERROR_SUCCESS;
+	return bResult;
 }
 
 /// <summary>
@@ -121,6 +274,7 @@ LPWSTR* AddElementsToLPWSTRArray(LPWSTR* lpsSourceArray, DWORD dwSourceArrayCoun
 	}
 
 	LPWSTR* lpsResultArray = (LPWSTR*)realloc(lpsSourceArray, (dwSourceArrayCount + dwAdditionArrayCount) * sizeof(LPWSTR));
+	STAT_ALLOC((dwSourceArrayCount + dwAdditionArrayCount) * sizeof(LPWSTR));
 	if (lpsResultArray == NULL)
 	{
 		return NULL;
@@ -150,6 +304,7 @@ LPWSTR CreateFullName(LPWSTR lpsKeyPath, LPWSTR lpsSubKeyName)
 	LPWSTR newKeyPath;
 
 	// Merge two strings
+	STAT_ALLOC((newPathLength + 1) * sizeof(WCHAR));
 	if (oldPathLength == 0)
 	{
 		newKeyPath = (LPWSTR)calloc(newPathLength + 1, sizeof(WCHAR));
@@ -190,6 +345,17 @@ LPWSTR* SearchOneLevel(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultSize)
 		return NULL;
 	}
 
+	// Warm list is reused while key is not changed (query server), its names count as visited keys
+	DWORD dwGeneration;
+	LPWSTR* lpsCachedNames = LookupEnumCache(hKeyRoot, lpsKeyPath, lpdwResultSize, &dwGeneration);
+	if (lpsCachedNames != NULL)
+	{
+		STAT_ADD(ullKeysVisited, *lpdwResultSize);
+		ThrottleKeys(*lpdwResultSize);
+		AdvanceProgress(*lpdwResultSize);
+		return lpsCachedNames;
+	}
+
 	// Enumerate keys in current folder
 	HKEY hKey;
 	if (!OpenRegKey(hKeyRoot, lpsKeyPath, KEY_ENUMERATE_SUB_KEYS, &hKey))
@@ -208,10 +374,13 @@ LPWSTR* SearchOneLevel(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultSize)
 	for (int dwIndex = 0; error != ERROR_NO_MORE_ITEMS; dwIndex++)
 	{
 		dwNameSize = MAX_KEY_NAME_LENGTH;
-		error = RegEnumKeyEx(hKey, dwIndex, lpsSubKeyName, &dwNameSize, NULL, NULL, NULL, NULL);
+		error = EnumRegKey(hKey, dwIndex, lpsSubKeyName, &dwNameSize, NULL);
 
 		if (error == ERROR_SUCCESS)
 		{
+			STAT_ADD(ullKeysVisited, 1);
+			ThrottleKeys(1);
+			AdvanceProgress(1);
 			lpsFullName = CreateFullName(const_cast<LPWSTR>(lpsKeyPath), lpsSubKeyName);
 
 			if (lpsFullName != NULL)
@@ -234,6 +403,7 @@ LPWSTR* SearchOneLevel(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultSize)
 	free(lpsSubKeyName);
 	CloseRegKey(hKey);
 	*lpdwResultSize = dwNamesCount;
+	StoreEnumCache(hKeyRoot, lpsKeyPath, lpsResultSubkeyNames, dwNamesCount, dwGeneration);
 
 	return lpsResultSubkeyNames;
 }
@@ -249,11 +419,19 @@ LPWSTR* SearchOneLevel(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultSize)
 /// <returns>LPWSTR*</returns>
 LPWSTR* SearchRecursive(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultCount)
 {
+	ULONGLONG ullTraceStart = BeginTraceSpan();
 	LPWSTR* lpsSubresult;
 	LPWSTR* lpsGeneralSubresult = (LPWSTR*)calloc(0, sizeof(LPWSTR));
 
 	DWORD dwKeyNamesCount, dwSubresultCount, dwGeneralSubresultCount = 0;
 
+	// Walk starts at empty path, its first level keys are top-level branches of progress
+	bool bTopLevel = (lpsKeyPath != NULL) && (lpsKeyPath[0] == L'\0');
+	if (bTopLevel)
+	{
+		BeginProgressWalk(hKeyRoot);
+	}
+
 	// Format elements in first level
 	LPWSTR* lpsKeyNamesList = SearchOneLevel(hKeyRoot, lpsKeyPath, &dwKeyNamesCount);
 	LPWSTR* lpsBuffer;
@@ -263,11 +441,26 @@ LPWSTR* SearchRecursive(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultCoun
 		return NULL;
 	}
 
-	// Recursive call
+	// Recursive call, depth counts levels that have subkeys
+	if (dwKeyNamesCount != 0)
+	{
+		STAT_ENTER_LEVEL();
+	}
+
 	for (DWORD dwElemIndex = 0; dwElemIndex < dwKeyNamesCount; dwElemIndex++)
 	{
+		if (bTopLevel)
+		{
+			BeginProgressBranch(dwElemIndex);
+		}
+
 		lpsSubresult = SearchRecursive(hKeyRoot, lpsKeyNamesList[dwElemIndex], &dwSubresultCount);
 
+		if (bTopLevel)
+		{
+			EndProgressBranch();
+		}
+
 		if (lpsSubresult != NULL)
 		{
 			lpsBuffer = AddElementsToLPWSTRArray(lpsGeneralSubresult, 
@@ -285,18 +478,45 @@ LPWSTR* SearchRecursive(HKEY hKeyRoot, LPCWSTR lpsKeyPath, DWORD* lpdwResultCoun
 		}
 	}
 
+	if (dwKeyNamesCount != 0)
+	{
+		STAT_LEAVE_LEVEL();
+	}
+
 	lpsBuffer = AddElementsToLPWSTRArray(lpsKeyNamesList, dwKeyNamesCount, lpsGeneralSubresult, dwGeneralSubresultCount);
 
 	if (lpsBuffer != NULL)
 	{
 		*lpdwResultCount = dwKeyNamesCount + dwGeneralSubresultCount;
-		return lpsBuffer;
 	}
 	else
 	{
 		*lpdwResultCount = dwKeyNamesCount;
-		return lpsBuffer;
 	}
+
+	// Only large subtrees are recorded, small ones would flood the trace
+	if (*lpdwResultCount >= GetTraceSubtreeThreshold())
+	{
+		EndTraceSpan("subtree", "traversal", ullTraceStart, lpsKeyPath);
+	}
+
+	return lpsBuffer;
+}
+
+/// <summary>
+///		Check if key path contains searched name followed by end of path or separator
+/// </summary>
+/// 
+/// <param name="lpsKeyPath">Key path</param>
+/// <param name="lpsSearchedKey">Searched key name</param>
+/// <param name="dwSearchedKeyLength">Searched key name length</param>
+/// 
+/// <returns>bool</returns>
+bool IsSearchedKey(LPCWSTR lpsKeyPath, LPCWSTR lpsSearchedKey, DWORD dwSearchedKeyLength)
+{
+	LPCWSTR lpsTemp = wcsstr(lpsKeyPath, lpsSearchedKey);
+
+	return (lpsTemp != NULL) && ((lpsTemp[dwSearchedKeyLength] == L'\0') || (lpsTemp[dwSearchedKeyLength] == L'\\'));
 }
 
 /// <summary>
@@ -318,16 +538,15 @@ LPWSTR* SearchKeyInList(LPWSTR* lpsKeyNamesList, DWORD dwKeyNamesCount, LPWSTR l
 
 	DWORD dwResultCount = 0;
 	LPWSTR* lpsResult = (LPWSTR*)calloc(dwResultCount, sizeof(LPWSTR)), *lpsBuffer;
-	WCHAR* lpsTemp;
 
 	// Find necessary element
 	if (lpsResult != NULL)
 	{
+		DWORD dwKeyNameLength = lstrlen(lpsSearchedKey);
+
 		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeyNamesCount; dwKeyIndex++)
 		{
-			DWORD dwKeyNameLength = lstrlen(lpsSearchedKey);
-
-			if (((lpsTemp = wcsstr(lpsKeyNamesList[dwKeyIndex], lpsSearchedKey)) != NULL) && ((lpsTemp[dwKeyNameLength] == L'\0') || (lpsTemp[dwKeyNameLength] == L'\\')))
+			if (IsSearchedKey(lpsKeyNamesList[dwKeyIndex], lpsSearchedKey, dwKeyNameLength))
 			{
 				lpsBuffer = AddElementsToLPWSTRArray(lpsResult, dwResultCount, &(lpsKeyNamesList[dwKeyIndex]), 1);
 
@@ -344,6 +563,33 @@ LPWSTR* SearchKeyInList(LPWSTR* lpsKeyNamesList, DWORD dwKeyNamesCount, LPWSTR l
 	return lpsResult;
 }
 
+/// <summary>
+///		Release list of all names except found ones (found list keeps order of full list)
+/// </summary>
+/// 
+/// <param name="lpsAllKeyNamesList">Full list</param>
+/// <param name="dwAllKeysCount">Full list count</param>
+/// <param name="lpsFoundKeyNamesList">Found names (may be NULL)</param>
+/// <param name="dwFoundKeysCount">Found names count</param>
+/// 
+/// <returns>void</returns>
+static void FreeUnmatchedNames(LPWSTR* lpsAllKeyNamesList, DWORD dwAllKeysCount, LPWSTR* lpsFoundKeyNamesList, DWORD dwFoundKeysCount)
+{
+	DWORD dwFoundIndex = 0;
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwAllKeysCount; dwKeyIndex++)
+	{
+		if ((lpsFoundKeyNamesList != NULL) && (dwFoundIndex < dwFoundKeysCount) && (lpsFoundKeyNamesList[dwFoundIndex] == lpsAllKeyNamesList[dwKeyIndex]))
+		{
+			dwFoundIndex++;
+		}
+		else
+		{
+			free(lpsAllKeyNamesList[dwKeyIndex]);
+		}
+	}
+	free(lpsAllKeyNamesList);
+}
+
 /// <summary>
 ///		Search key function
 /// </summary>
@@ -370,16 +616,338 @@ LPWSTR* SearchKey(HKEY hKey, LPCWSTR lpsSearchedKey, DWORD* lpdwFoundKeysCount)
 	}
 	
 	// Find necessary key in list
+	DWORD dwFoundKeysCount = 0;
 	LPWSTR* lpsFoundKeyNamesList = SearchKeyInList(lpsAllKeyNamesList, 
 		dwSearchResultCount, 
 		const_cast<LPWSTR>(lpsSearchedKey), 
-		&dwSearchResultCount);
+		&dwFoundKeysCount);
+
+	// Found names are shared with the full list, release the rest of it
+	FreeUnmatchedNames(lpsAllKeyNamesList, dwSearchResultCount, lpsFoundKeyNamesList, dwFoundKeysCount);
 
-	*lpdwFoundKeysCount = dwSearchResultCount;
+	*lpdwFoundKeysCount = dwFoundKeysCount;
 
 	return lpsFoundKeyNamesList;
 }
 
+/// <summary>
+///		Get edit distance between pattern and own name of key (last path segment)
+/// </summary>
+/// 
+/// <param name="lpPattern">Compiled pattern</param>
+/// <param name="lpsKeyPath">Key path</param>
+/// <param name="cchKeyPath">Key path length</param>
+/// <param name="dwMaxDistance">Largest accepted edit distance</param>
+/// 
+/// <returns>DWORD (greater than dwMaxDistance if key does not match)</returns>
+static DWORD GetKeyFuzzyDistance(const FUZZYPATTERN* lpPattern, LPCWSTR lpsKeyPath, DWORD cchKeyPath, DWORD dwMaxDistance)
+{
+	LPCWSTR lpsSegment = wcsrchr(lpsKeyPath, L'\\');
+	lpsSegment = (lpsSegment == NULL) ? lpsKeyPath : lpsSegment + 1;
+
+	return GetFuzzyDistance(lpPattern, lpsSegment, cchKeyPath - (DWORD)(lpsSegment - lpsKeyPath), dwMaxDistance);
+}
+
+/// <summary>
+///		Find keys whose own name is within edit distance of pattern
+/// </summary>
+/// 
+/// <param name="lpsKeyNamesList">Input list</param>
+/// <param name="dwKeyNamesCount">Names count</param>
+/// <param name="lpsPattern">Pattern (up to 64 characters, case insensitive)</param>
+/// <param name="dwMaxDistance">Largest accepted edit distance</param>
+/// <param name="lpdwFoundKeysCount">Keys count</param>
+/// <param name="lpdwDistances">Distance of every found key</param>
+/// 
+/// <returns>LPWSTR* (names are shared with input list, order is kept)</returns>
+LPWSTR* SearchKeyFuzzyInList(LPWSTR* lpsKeyNamesList, DWORD dwKeyNamesCount, LPCWSTR lpsPattern, DWORD dwMaxDistance, DWORD* lpdwFoundKeysCount, DWORD** lpdwDistances)
+{
+	FUZZYPATTERN fpPattern;
+	if ((lpsKeyNamesList == NULL) || !CompileFuzzyPattern(lpsPattern, &fpPattern))
+	{
+		return NULL;
+	}
+
+	// Every key is the last segment of exactly one path, so each segment is scored once
+	LPWSTR* lpsResult = (LPWSTR*)calloc(dwKeyNamesCount + 1, sizeof(LPWSTR));
+	DWORD* lpdwResultDistances = (DWORD*)calloc(dwKeyNamesCount + 1, sizeof(DWORD));
+	DWORD dwResultCount = 0;
+
+	if ((lpsResult == NULL) || (lpdwResultDistances == NULL))
+	{
+		free(lpsResult);
+		free(lpdwResultDistances);
+		return NULL;
+	}
+
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeyNamesCount; dwKeyIndex++)
+	{
+		DWORD dwDistance = GetKeyFuzzyDistance(&fpPattern, lpsKeyNamesList[dwKeyIndex], lstrlen(lpsKeyNamesList[dwKeyIndex]), dwMaxDistance);
+		if (dwDistance <= dwMaxDistance)
+		{
+			lpsResult[dwResultCount] = lpsKeyNamesList[dwKeyIndex];
+			lpdwResultDistances[dwResultCount] = dwDistance;
+			dwResultCount++;
+		}
+	}
+
+	*lpdwFoundKeysCount = dwResultCount;
+	*lpdwDistances = lpdwResultDistances;
+
+	return lpsResult;
+}
+
+/// <summary>
+///		Order found keys by distance, keys with equal distance keep their order
+/// </summary>
+/// 
+/// <param name="lpsKeyNamesList">Found keys</param>
+/// <param name="lpdwDistances">Distances</param>
+/// <param name="dwKeysCount">Keys count</param>
+/// <param name="dwMaxDistance">Largest distance</param>
+/// 
+/// <returns>bool</returns>
+static bool RankFuzzyMatches(LPWSTR* lpsKeyNamesList, DWORD* lpdwDistances, DWORD dwKeysCount, DWORD dwMaxDistance)
+{
+	// Distances are small, so counting sort is used
+	DWORD* lpdwOffsets = (DWORD*)calloc(dwMaxDistance + 2, sizeof(DWORD));
+	LPWSTR* lpsSorted = (LPWSTR*)calloc(dwKeysCount + 1, sizeof(LPWSTR));
+
+	if ((lpdwOffsets == NULL) || (lpsSorted == NULL))
+	{
+		free(lpdwOffsets);
+		free(lpsSorted);
+		return false;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwKeysCount; dwIndex++)
+	{
+		lpdwOffsets[lpdwDistances[dwIndex] + 1]++;
+	}
+	for (DWORD dwDistance = 1; dwDistance <= dwMaxDistance + 1; dwDistance++)
+	{
+		lpdwOffsets[dwDistance] += lpdwOffsets[dwDistance - 1];
+	}
+	for (DWORD dwIndex = 0; dwIndex < dwKeysCount; dwIndex++)
+	{
+		lpsSorted[lpdwOffsets[lpdwDistances[dwIndex]]++] = lpsKeyNamesList[dwIndex];
+	}
+
+	// Offsets now point to ends of groups
+	memcpy(lpsKeyNamesList, lpsSorted, dwKeysCount * sizeof(LPWSTR));
+	for (DWORD dwDistance = 0, dwIndex = 0; dwDistance <= dwMaxDistance; dwDistance++)
+	{
+		for (; dwIndex < lpdwOffsets[dwDistance]; dwIndex++)
+		{
+			lpdwDistances[dwIndex] = dwDistance;
+		}
+	}
+
+	free(lpdwOffsets);
+	free(lpsSorted);
+
+	return true;
+}
+
+// State of typo tolerant search, only matching keys are copied
+typedef struct _FUZZYSEARCH {
+	FUZZYPATTERN fpPattern;
+	DWORD dwMaxDistance;
+	LPWSTR* lpsFoundKeys;
+	DWORD* lpdwDistances;
+	DWORD dwFoundCount;
+	DWORD dwKeysCapacity;
+	DWORD dwDistancesCapacity;
+} FUZZYSEARCH;
+
+/// <summary>
+///		Score walked key and keep its copy when it matches
+/// </summary>
+/// 
+/// <returns>bool (false if out of memory)</returns>
+static bool CollectFuzzyMatch(void* lpContext, LPCWSTR lpsKeyPath, DWORD cchKeyPath)
+{
+	FUZZYSEARCH* lpSearch = (FUZZYSEARCH*)lpContext;
+
+	DWORD dwDistance = GetKeyFuzzyDistance(&lpSearch->fpPattern, lpsKeyPath, cchKeyPath, lpSearch->dwMaxDistance);
+	if (dwDistance > lpSearch->dwMaxDistance)
+	{
+		return true;
+	}
+
+	// Result keeps room for terminating NULL as other search results do
+	if (!ReserveArray((void**)&lpSearch->lpsFoundKeys, &lpSearch->dwKeysCapacity, lpSearch->dwFoundCount + 2, sizeof(LPWSTR)) ||
+		!ReserveArray((void**)&lpSearch->lpdwDistances, &lpSearch->dwDistancesCapacity, lpSearch->dwFoundCount + 1, sizeof(DWORD)))
+	{
+		return false;
+	}
+
+	LPWSTR lpsKeyCopy = (LPWSTR)malloc((cchKeyPath + 1) * sizeof(WCHAR));
+	if (lpsKeyCopy == NULL)
+	{
+		return false;
+	}
+
+	memcpy(lpsKeyCopy, lpsKeyPath, cchKeyPath * sizeof(WCHAR));
+	lpsKeyCopy[cchKeyPath] = L'\0';
+	STAT_ALLOC((cchKeyPath + 1) * sizeof(WCHAR));
+
+	lpSearch->lpsFoundKeys[lpSearch->dwFoundCount] = lpsKeyCopy;
+	lpSearch->lpdwDistances[lpSearch->dwFoundCount] = dwDistance;
+	lpSearch->dwFoundCount++;
+	lpSearch->lpsFoundKeys[lpSearch->dwFoundCount] = NULL;
+
+	return true;
+}
+
+/// <summary>
+///		Typo tolerant search key function, keys are scored while subtree is walked
+///		so names that do not match are never collected
+/// </summary>
+/// 
+/// <param name="hKey">Hkey root path</param>
+/// <param name="lpsPattern">Searched key name</param>
+/// <param name="dwMaxDistance">Largest accepted edit distance</param>
+/// <param name="lpdwFoundKeysCount">Found keys count</param>
+/// <param name="lpdwDistances">Distance of every found key</param>
+/// 
+/// <returns>LPWSTR* (closest keys first)</returns>
+LPWSTR* SearchKeyFuzzy(HKEY hKey, LPCWSTR lpsPattern, DWORD dwMaxDistance, DWORD* lpdwFoundKeysCount, DWORD** lpdwDistances)
+{
+	if ((lpsPattern == NULL) || (lstrlen(lpsPattern) == 0) || (lpdwFoundKeysCount == NULL) || (lpdwDistances == NULL))
+	{
+		return NULL;
+	}
+
+	FUZZYSEARCH fsSearch;
+	ZeroMemory(&fsSearch, sizeof(FUZZYSEARCH));
+	fsSearch.dwMaxDistance = dwMaxDistance;
+
+	if (!CompileFuzzyPattern(lpsPattern, &fsSearch.fpPattern))
+	{
+		return NULL;
+	}
+
+	// Result is terminated by NULL, so it is allocated even if nothing matches
+	bool bResult = ReserveArray((void**)&fsSearch.lpsFoundKeys, &fsSearch.dwKeysCapacity, 1, sizeof(LPWSTR)) &&
+		ReserveArray((void**)&fsSearch.lpdwDistances, &fsSearch.dwDistancesCapacity, 1, sizeof(DWORD)) &&
+		WalkKeys(hKey, CollectFuzzyMatch, &fsSearch);
+	if (!bResult)
+	{
+		for (DWORD dwIndex = 0; dwIndex < fsSearch.dwFoundCount; dwIndex++)
+		{
+			free(fsSearch.lpsFoundKeys[dwIndex]);
+		}
+		free(fsSearch.lpsFoundKeys);
+		free(fsSearch.lpdwDistances);
+		return NULL;
+	}
+
+	RankFuzzyMatches(fsSearch.lpsFoundKeys, fsSearch.lpdwDistances, fsSearch.dwFoundCount, dwMaxDistance);
+
+	*lpdwFoundKeysCount = fsSearch.dwFoundCount;
+	*lpdwDistances = fsSearch.lpdwDistances;
+
+	return fsSearch.lpsFoundKeys;
+}
+
+/// <summary>
+///		Visit keys of one level and their subtrees, path buffer is shared by all levels
+/// </summary>
+/// 
+/// <returns>bool (false if walk was stopped)</returns>
+static bool WalkKeyLevel(HKEY hKey, LPWSTR lpsKeyPath, DWORD cchKeyPath, KEYVISITPROC lpfnVisit, void* lpContext)
+{
+	// Subkey name is written right after path of parent
+	DWORD cchPrefix = (cchKeyPath == 0) ? 0 : cchKeyPath + 1;
+	if (cchPrefix + MAX_KEY_NAME_LENGTH > MAX_KEY_PATH_LENGTH)
+	{
+		return true;
+	}
+
+	if (cchKeyPath != 0)
+	{
+		lpsKeyPath[cchKeyPath] = L'\\';
+	}
+
+	bool bResult = true;
+	for (DWORD dwIndex = 0; bResult; dwIndex++)
+	{
+		DWORD dwNameSize = MAX_KEY_NAME_LENGTH;
+		if (EnumRegKey(hKey, dwIndex, lpsKeyPath + cchPrefix, &dwNameSize, NULL) != ERROR_SUCCESS)
+		{
+			break;
+		}
+
+		STAT_ADD(ullKeysVisited, 1);
+		ThrottleKeys(1);
+		AdvanceProgress(1);
+
+		DWORD cchSubkeyPath = cchPrefix + dwNameSize;
+		bResult = lpfnVisit(lpContext, lpsKeyPath, cchSubkeyPath);
+
+		HKEY hSubkey;
+		if (bResult && OpenRegKey(hKey, lpsKeyPath + cchPrefix, KEY_ENUMERATE_SUB_KEYS, &hSubkey))
+		{
+			if (cchKeyPath == 0)
+			{
+				BeginProgressBranch(dwIndex);
+			}
+
+			bResult = WalkKeyLevel(hSubkey, lpsKeyPath, cchSubkeyPath, lpfnVisit, lpContext);
+			CloseRegKey(hSubkey);
+
+			if (cchKeyPath == 0)
+			{
+				EndProgressBranch();
+			}
+		}
+
+		// Deeper levels overwrote separator and name
+		if (cchKeyPath != 0)
+		{
+			lpsKeyPath[cchKeyPath] = L'\\';
+		}
+	}
+
+	lpsKeyPath[cchKeyPath] = L'\0';
+
+	return bResult;
+}
+
+/// <summary>
+///		Visit every key of subtree in depth-first order without collecting them,
+///		memory use does not depend on subtree size
+/// </summary>
+/// 
+/// <param name="hKey">Root of subtree</param>
+/// <param name="lpfnVisit">Called with path of every key relative to root</param>
+/// <param name="lpContext">Passed to lpfnVisit</param>
+/// 
+/// <returns>bool (false if walk was stopped)</returns>
+bool WalkKeys(HKEY hKey, KEYVISITPROC lpfnVisit, void* lpContext)
+{
+	if (lpfnVisit == NULL)
+	{
+		return false;
+	}
+
+	LPWSTR lpsKeyPath = (LPWSTR)calloc(MAX_KEY_PATH_LENGTH, sizeof(WCHAR));
+	if (lpsKeyPath == NULL)
+	{
+		return false;
+	}
+
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	BeginProgressWalk(hKey);
+	bool bResult = WalkKeyLevel(hKey, lpsKeyPath, 0, lpfnVisit, lpContext);
+	EndTraceSpan("walk", "traversal", ullTraceStart, NULL);
+
+	free(lpsKeyPath);
+
+	return bResult;
+}
+
 /// <summary>
 ///		Execute query
 /// </summary>
@@ -389,6 +957,10 @@ LPWSTR* SearchKey(HKEY hKey, LPCWSTR lpsSearchedKey, DWORD* lpdwFoundKeysCount)
 /// <returns>LPSTR</returns>
 LPSTR ExecuteRegExe(WCHAR* lpsCommand)
 {
+	// Pipe handles of one child must not leak into child started at the same time by other thread,
+	// otherwise the pipe is not closed when the first child exits
+	static SRWLOCK srwCreateProcess = SRWLOCK_INIT;
+
 	HANDLE hReadPipe, hWritePipe;
 
 	// Set the bInheritHandle flag so pipe handles are inherited.
@@ -399,57 +971,84 @@ LPSTR ExecuteRegExe(WCHAR* lpsCommand)
 
 	LPSTR lpsResult = NULL;
 
-	// Create a pipe for the child process's STDOUT. 
+	AcquireSRWLockExclusive(&srwCreateProcess);
 
-	if (CreatePipe(&hReadPipe, &hWritePipe, &saAttributes, 0))
+	// Create a pipe for the child process's STDOUT, only write end is inherited.
+	if (!CreatePipe(&hReadPipe, &hWritePipe, &saAttributes, 0))
 	{
-		// Create a child process that uses the previously created pipes for STDIN and STDOUT.
-		STARTUPINFO siConsole;
-		PROCESS_INFORMATION piInfo;
+		ReleaseSRWLockExclusive(&srwCreateProcess);
+		return NULL;
+	}
+	SetHandleInformation(hReadPipe, HANDLE_FLAG_INHERIT, 0);
 
-		// Set up members of the PROCESS_INFORMATION structure. 
-		ZeroMemory(&piInfo, sizeof(PROCESS_INFORMATION));
+	// Create a child process that uses the previously created pipe for STDOUT and STDERR.
+	STARTUPINFO siConsole;
+	PROCESS_INFORMATION piInfo;
 
-		// Set up members of the STARTUPINFO structure. 
-		// This structure specifies the STDIN and STDOUT handles for redirection.
-		ZeroMemory(&siConsole, sizeof(STARTUPINFO));
-		siConsole.cb = sizeof(STARTUPINFO);
-		siConsole.hStdOutput = hWritePipe;
-		siConsole.hStdError = hWritePipe;
-		siConsole.hStdInput = hReadPipe;
-		siConsole.dwFlags |= STARTF_USESTDHANDLES;
-		
-		// Create the child process. 
-		if (CreateProcess(NULL, lpsCommand, NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &siConsole, &piInfo))
-		{
-			const DWORD dwBufLength = 4096;
-			LPSTR lpsBuffer = (LPSTR)calloc(dwBufLength, sizeof(CHAR));
-			DWORD dwReadCount;
+	// Set up members of the PROCESS_INFORMATION structure. 
+	ZeroMemory(&piInfo, sizeof(PROCESS_INFORMATION));
+
+	// Set up members of the STARTUPINFO structure. 
+	// This structure specifies the STDIN and STDOUT handles for redirection.
+	ZeroMemory(&siConsole, sizeof(STARTUPINFO));
+	siConsole.cb = sizeof(STARTUPINFO);
+	siConsole.hStdOutput = hWritePipe;
+	siConsole.hStdError = hWritePipe;
+	siConsole.hStdInput = NULL;
+	siConsole.dwFlags |= STARTF_USESTDHANDLES;
+
+	// Create the child process. 
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	bool bStarted = CreateProcess(NULL, lpsCommand, NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &siConsole, &piInfo) != FALSE;
 
-			WaitForSingleObject(piInfo.hProcess, INFINITE);
+	// Child has its own copy of write end, pipe is closed when it exits
+	CloseHandle(hWritePipe);
+	ReleaseSRWLockExclusive(&srwCreateProcess);
 
-			if (ReadFile(hReadPipe, lpsBuffer, (dwBufLength - 1) * sizeof(CHAR), &dwReadCount, NULL))
+	if (bStarted)
+	{
+		// Read while child runs, so it never blocks on full pipe
+		DWORD cbCapacity = 4096;
+		DWORD cbSize = 0;
+		DWORD dwReadCount;
+		LPSTR lpsBuffer = (LPSTR)malloc(cbCapacity);
+
+		while (lpsBuffer != NULL)
+		{
+			if (cbCapacity - cbSize < 2)
 			{
-				lpsBuffer[dwReadCount / sizeof(CHAR)] = '\0';
-				lpsResult = lpsBuffer;
+				LPSTR lpsGrown = (LPSTR)realloc(lpsBuffer, cbCapacity * 2);
+				if (lpsGrown == NULL)
+				{
+					free(lpsBuffer);
+					lpsBuffer = NULL;
+					break;
+				}
+				lpsBuffer = lpsGrown;
+				cbCapacity *= 2;
 			}
-			else
+
+			// Broken pipe means all output was read
+			if (!ReadFile(hReadPipe, lpsBuffer + cbSize, cbCapacity - cbSize - 1, &dwReadCount, NULL) || (dwReadCount == 0))
 			{
-				free(lpsBuffer);
+				lpsBuffer[cbSize] = '\0';
+				lpsResult = lpsBuffer;
+				break;
 			}
-
-			// Close handles to the child process and its primary thread.
-			// Some applications might keep these handles to monitor the status
-			// of the child process, for example. 
-			CloseHandle(piInfo.hThread);
-			CloseHandle(piInfo.hProcess);
+			cbSize += dwReadCount;
 		}
 
-		// Close handles to the stdin and stdout pipes no longer needed by the child process.
-		CloseHandle(hReadPipe);
-		CloseHandle(hWritePipe);
+		WaitForSingleObject(piInfo.hProcess, INFINITE);
+
+		// Close handles to the child process and its primary thread.
+		CloseHandle(piInfo.hThread);
+		CloseHandle(piInfo.hProcess);
 	}
 
+	EndTraceSpan("reg.exe", "process", ullTraceStart, lpsCommand);
+
+	CloseHandle(hReadPipe);
+
 	return lpsResult;
 }
 
@@ -469,17 +1068,24 @@ LPWSTR CreateFlagsQuery(LPCWSTR lpsKeyRoot, LPCWSTR lpsSubkeyPath)
 
 	LPWSTR lpsKey = (LPWSTR)calloc(dwNewPathLength + 1, sizeof(WCHAR));
 
-	if (lpsKey != NULL)
+	if (lpsKey == NULL)
 	{
-		wcscpy_s(lpsKey, dwNewPathLength + 1, lpsKeyRoot);
-		wcscat_s(lpsKey, dwNewPathLength + 1, L"\\");
-		wcscat_s(lpsKey, dwNewPathLength + 1, lpsSubkeyPath);
+		return NULL;
 	}
 
-	DWORD dwQueryLength = lstrlen(lpsKey) + lstrlen(L"REG FLAGS  QUERY");
+	wcscpy_s(lpsKey, dwNewPathLength + 1, lpsKeyRoot);
+	wcscat_s(lpsKey, dwNewPathLength + 1, L"\\");
+	wcscat_s(lpsKey, dwNewPathLength + 1, lpsSubkeyPath);
+
+	// Key names may contain spaces
+	DWORD dwQueryLength = lstrlen(lpsKey) + lstrlen(L"REG FLAGS \"\" QUERY");
 	LPWSTR lpsResult = (LPWSTR)calloc(dwQueryLength + 1, sizeof(WCHAR));
-	swprintf(lpsResult, dwQueryLength + 1, L"REG FLAGS %s QUERY", lpsKey);
-	
+	if (lpsResult != NULL)
+	{
+		swprintf(lpsResult, dwQueryLength + 1, L"REG FLAGS \"%ls\" QUERY", lpsKey);
+	}
+	free(lpsKey);
+
 	return lpsResult;
 }
 
@@ -529,6 +1135,11 @@ bool ParseRegExeOutput(LPSTR lpsCommandOutput, KEYFLAG* kfFlags, DWORD dwKeyCoun
 	DWORD dwCommandOutputLength = strlen(lpsCommandOutput);
 	LPSTR lpsCommandOutputCopy = (LPSTR)calloc(dwCommandOutputLength + 1, sizeof(char));
 
+	if (lpsCommandOutputCopy == NULL)
+	{
+		return false;
+	}
+
 	DWORD dwValueLength;
 
 	for (DWORD dwkeyIndex = 0; dwkeyIndex < dwKeyCount; ++dwkeyIndex)
@@ -538,6 +1149,7 @@ bool ParseRegExeOutput(LPSTR lpsCommandOutput, KEYFLAG* kfFlags, DWORD dwKeyCoun
 
 		if (lpsKeyPos == NULL)
 		{
+			free(lpsCommandOutputCopy);
 			return false;
 		}
 		else
@@ -547,6 +1159,7 @@ bool ParseRegExeOutput(LPSTR lpsCommandOutput, KEYFLAG* kfFlags, DWORD dwKeyCoun
 
 			if (lpsKeyValuePos == NULL)
 			{
+				free(lpsCommandOutputCopy);
 				return false;
 			}
 			else
@@ -556,6 +1169,7 @@ bool ParseRegExeOutput(LPSTR lpsCommandOutput, KEYFLAG* kfFlags, DWORD dwKeyCoun
 
 				if (lpsBuffer == NULL)
 				{
+					free(lpsCommandOutputCopy);
 					return false;
 				}
 				else
@@ -591,7 +1205,7 @@ bool NotifyChange(HKEY hKeyRoot, LPCWSTR lpsSubkeyPath, bool bWatchSubtree)
 	}
 
 	// Observe registry changes
-	bool bResult = RegNotifyChangeKeyValue(hKeyRoot, bWatchSubtree, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+	bool bResult = RegNotifyChangeKeyValue(hKey, bWatchSubtree, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
 		NULL, FALSE) == ERROR_SUCCESS;
 
 	// Close key
@@ -0,0 +1,442 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "../Api/Output.h"
+#include "../Api/Transcode.h"
+
+// Commands print to stdout unless current thread captures output (query server)
+static thread_local OUTPUTBUFFER* t_lpOutputBuffer = NULL;
+static thread_local bool t_bHeaderWritten = false;
+
+// All output is UTF-8, stdout text of all threads is collected and written in large blocks
+static OUTPUTBUFFER g_obStdout = { NULL, 0, 0 };
+static SRWLOCK g_srwStdoutLock = SRWLOCK_INIT;
+static DWORD g_dwOutputFormat = OUTPUT_FORMAT_TEXT;
+
+/// <summary>
+///		Capture output of current thread into buffer
+/// </summary>
+/// 
+/// <param name="lpBuffer">Buffer (NULL restores stdout)</param>
+/// 
+/// <returns>void</returns>
+void SetThreadOutput(OUTPUTBUFFER* lpBuffer)
+{
+	t_lpOutputBuffer = lpBuffer;
+}
+
+/// <summary>
+///		Append bytes to buffer, growing it twice when full
+/// </summary>
+/// 
+/// <param name="lpBuffer">Buffer</param>
+/// <param name="lpsData">Bytes</param>
+/// <param name="cbData">Bytes count</param>
+/// 
+/// <returns>bool</returns>
+bool AppendOutput(OUTPUTBUFFER* lpBuffer, LPCSTR lpsData, DWORD cbData)
+{
+	if (lpBuffer->cbSize + cbData > lpBuffer->cbCapacity)
+	{
+		DWORD cbNewCapacity = (lpBuffer->cbCapacity == 0) ? OUTPUT_BUFFER_INITIAL_SIZE : lpBuffer->cbCapacity;
+		while (cbNewCapacity < lpBuffer->cbSize + cbData)
+		{
+			cbNewCapacity *= 2;
+		}
+
+		LPSTR lpsNewData = (LPSTR)realloc(lpBuffer->lpsData, cbNewCapacity);
+		if (lpsNewData == NULL)
+		{
+			return false;
+		}
+
+		lpBuffer->lpsData = lpsNewData;
+		lpBuffer->cbCapacity = cbNewCapacity;
+	}
+
+	memcpy(lpBuffer->lpsData + lpBuffer->cbSize, lpsData, cbData);
+	lpBuffer->cbSize += cbData;
+
+	return true;
+}
+
+/// <summary>
+///		Release buffer memory
+/// </summary>
+/// 
+/// <param name="lpBuffer">Buffer</param>
+/// 
+/// <returns>void</returns>
+void FreeOutputBuffer(OUTPUTBUFFER* lpBuffer)
+{
+	free(lpBuffer->lpsData);
+	ZeroMemory(lpBuffer, sizeof(OUTPUTBUFFER));
+}
+
+/// <summary>
+///		Write collected stdout text, stdout lock is held by caller
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool WriteStdout()
+{
+	bool bResult = (g_obStdout.cbSize == 0) || (fwrite(g_obStdout.lpsData, sizeof(CHAR), g_obStdout.cbSize, stdout) == g_obStdout.cbSize);
+	g_obStdout.cbSize = 0;
+
+	return (fflush(stdout) == 0) && bResult;
+}
+
+/// <summary>
+///		Append text to buffer of current thread or to collected stdout text
+/// </summary>
+/// 
+/// <param name="lpsText">UTF-8 text</param>
+/// <param name="cbText">Text size</param>
+/// 
+/// <returns>bool</returns>
+static bool WriteOutput(LPCSTR lpsText, DWORD cbText)
+{
+	if (t_lpOutputBuffer != NULL)
+	{
+		return AppendOutput(t_lpOutputBuffer, lpsText, cbText);
+	}
+
+	AcquireSRWLockExclusive(&g_srwStdoutLock);
+	bool bResult = AppendOutput(&g_obStdout, lpsText, cbText) && ((g_obStdout.cbSize < OUTPUT_FLUSH_SIZE) || WriteStdout());
+	ReleaseSRWLockExclusive(&g_srwStdoutLock);
+
+	return bResult;
+}
+
+/// <summary>
+///		Write collected stdout text
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool FlushOutput()
+{
+	AcquireSRWLockExclusive(&g_srwStdoutLock);
+	bool bResult = WriteStdout();
+	ReleaseSRWLockExclusive(&g_srwStdoutLock);
+
+	return bResult;
+}
+
+/// <summary>
+///		printf to stdout or to buffer of current thread
+/// </summary>
+/// 
+/// <param name="lpsFormat">Format</param>
+/// 
+/// <returns>int (characters written, negative on failure)</returns>
+int OutputPrintf(LPCSTR lpsFormat, ...)
+{
+	va_list vlArguments;
+	va_start(vlArguments, lpsFormat);
+
+	va_list vlCopy;
+	va_copy(vlCopy, vlArguments);
+	int iWritten = _vscprintf(lpsFormat, vlCopy);
+	va_end(vlCopy);
+
+	// Short lines are formatted on stack
+	CHAR lpsInlineText[OUTPUT_INLINE_TEXT_LENGTH];
+	LPSTR lpsText = (iWritten < 0) ? NULL :
+		((iWritten < (int)OUTPUT_INLINE_TEXT_LENGTH) ? lpsInlineText : (LPSTR)calloc(iWritten + 1, sizeof(CHAR)));
+
+	if (lpsText == NULL)
+	{
+		iWritten = -1;
+	}
+	else
+	{
+		vsprintf_s(lpsText, iWritten + 1, lpsFormat, vlArguments);
+		if (!WriteOutput(lpsText, iWritten))
+		{
+			iWritten = -1;
+		}
+
+		if (lpsText != lpsInlineText)
+		{
+			free(lpsText);
+		}
+	}
+
+	va_end(vlArguments);
+	return iWritten;
+}
+
+/// <summary>
+///		wprintf to stdout or to buffer of current thread (as UTF-8 text)
+/// </summary>
+/// 
+/// <param name="lpsFormat">Format</param>
+/// 
+/// <returns>int (characters written, negative on failure)</returns>
+int OutputWPrintf(LPCWSTR lpsFormat, ...)
+{
+	va_list vlArguments;
+	va_start(vlArguments, lpsFormat);
+
+	va_list vlCopy;
+	va_copy(vlCopy, vlArguments);
+	int iWritten = _vscwprintf(lpsFormat, vlCopy);
+	va_end(vlCopy);
+
+	// Short lines are formatted and converted on stack
+	WCHAR lpsInlineText[OUTPUT_INLINE_TEXT_LENGTH];
+	CHAR lpsInlineUtf8Text[OUTPUT_INLINE_TEXT_LENGTH * TRANSCODE_MAX_UTF8_PER_UTF16];
+	bool bInline = (iWritten >= 0) && (iWritten < (int)OUTPUT_INLINE_TEXT_LENGTH);
+
+	LPWSTR lpsText = bInline ? lpsInlineText : ((iWritten < 0) ? NULL : (LPWSTR)calloc(iWritten + 1, sizeof(WCHAR)));
+	LPSTR lpsUtf8Text = bInline ? lpsInlineUtf8Text : ((lpsText == NULL) ? NULL : (LPSTR)calloc((SIZE_T)iWritten * TRANSCODE_MAX_UTF8_PER_UTF16 + 1, sizeof(CHAR)));
+
+	if (lpsUtf8Text == NULL)
+	{
+		iWritten = -1;
+	}
+	else
+	{
+		vswprintf_s(lpsText, iWritten + 1, lpsFormat, vlArguments);
+
+		DWORD cbUtf8Text = Utf16ToUtf8(lpsText, iWritten, lpsUtf8Text, (DWORD)iWritten * TRANSCODE_MAX_UTF8_PER_UTF16);
+		if ((cbUtf8Text == TRANSCODE_ERROR) || !WriteOutput(lpsUtf8Text, cbUtf8Text))
+		{
+			iWritten = -1;
+		}
+	}
+
+	if (!bInline)
+	{
+		free(lpsUtf8Text);
+		free(lpsText);
+	}
+
+	va_end(vlArguments);
+	return iWritten;
+}
+
+/// <summary>
+///		Get output format by name
+/// </summary>
+/// 
+/// <param name="lpsFormatName">text, ndjson or csv</param>
+/// <param name="lpdwFormat">Format (OUTPUT_FORMAT_*)</param>
+/// 
+/// <returns>bool</returns>
+bool ParseOutputFormat(LPCSTR lpsFormatName, DWORD* lpdwFormat)
+{
+	const LPCSTR lpsFormatNames[] = { "text", "ndjson", "csv" };
+
+	for (DWORD dwFormat = 0; dwFormat < sizeof(lpsFormatNames) / sizeof(lpsFormatNames[0]); dwFormat++)
+	{
+		if (_stricmp(lpsFormatName, lpsFormatNames[dwFormat]) == 0)
+		{
+			*lpdwFormat = dwFormat;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+///		Select format of structured records
+/// </summary>
+/// 
+/// <param name="dwFormat">Format (OUTPUT_FORMAT_*)</param>
+/// 
+/// <returns>void</returns>
+void SetOutputFormat(DWORD dwFormat)
+{
+	g_dwOutputFormat = dwFormat;
+}
+
+/// <summary>
+///		Get format of structured records
+/// </summary>
+/// 
+/// <returns>DWORD (OUTPUT_FORMAT_*)</returns>
+DWORD GetOutputFormat()
+{
+	return g_dwOutputFormat;
+}
+
+/// <summary>
+///		Start records of new command, CSV header is written again before first record
+/// </summary>
+/// 
+/// <returns>void</returns>
+void BeginOutputRecords()
+{
+	t_bHeaderWritten = false;
+}
+
+/// <summary>
+///		Append UTF-8 text escaped for output format
+/// </summary>
+/// 
+/// <param name="lpTarget">Buffer</param>
+/// <param name="lpsText">UTF-8 text</param>
+/// <param name="cbText">Text size</param>
+/// 
+/// <returns>bool</returns>
+static bool AppendEscapedText(OUTPUTBUFFER* lpTarget, LPCSTR lpsText, DWORD cbText)
+{
+	DWORD dwRunStart = 0;
+	bool bResult = true;
+
+	for (DWORD dwIndex = 0; bResult && (dwIndex < cbText); dwIndex++)
+	{
+		BYTE bChar = (BYTE)lpsText[dwIndex];
+		CHAR lpsEscape[8];
+		int cbEscape = 0;
+
+		if ((g_dwOutputFormat == OUTPUT_FORMAT_NDJSON) && ((bChar == '"') || (bChar == '\\')))
+		{
+			lpsEscape[0] = '\\';
+			lpsEscape[1] = (CHAR)bChar;
+			cbEscape = 2;
+		}
+		else if ((g_dwOutputFormat == OUTPUT_FORMAT_NDJSON) && (bChar < 0x20))
+		{
+			cbEscape = sprintf_s(lpsEscape, sizeof(lpsEscape), "\\u%04x", bChar);
+		}
+		else if ((g_dwOutputFormat == OUTPUT_FORMAT_CSV) && (bChar == '"'))
+		{
+			lpsEscape[0] = '"';
+			lpsEscape[1] = '"';
+			cbEscape = 2;
+		}
+
+		if (cbEscape != 0)
+		{
+			bResult = AppendOutput(lpTarget, lpsText + dwRunStart, dwIndex - dwRunStart) && AppendOutput(lpTarget, lpsEscape, cbEscape);
+			dwRunStart = dwIndex + 1;
+		}
+	}
+
+	return bResult && AppendOutput(lpTarget, lpsText + dwRunStart, cbText - dwRunStart);
+}
+
+/// <summary>
+///		Append field text, wide text is converted in parts on stack
+/// </summary>
+/// 
+/// <param name="lpTarget">Buffer</param>
+/// <param name="lpsText">Wide text (NULL if UTF-8 text is given)</param>
+/// <param name="lpsUtf8Text">UTF-8 text</param>
+/// 
+/// <returns>bool</returns>
+static bool AppendFieldText(OUTPUTBUFFER* lpTarget, LPCWSTR lpsText, LPCSTR lpsUtf8Text)
+{
+	// CSV fields with separators, quotes or line breaks are quoted
+	bool bQuoted = (g_dwOutputFormat == OUTPUT_FORMAT_NDJSON) ||
+		((g_dwOutputFormat == OUTPUT_FORMAT_CSV) && ((lpsText != NULL) ? (wcspbrk(lpsText, L",\"\r\n") != NULL) : (strpbrk(lpsUtf8Text, ",\"\r\n") != NULL)));
+	bool bResult = !bQuoted || AppendOutput(lpTarget, "\"", 1);
+
+	if (lpsText == NULL)
+	{
+		bResult = bResult && AppendEscapedText(lpTarget, lpsUtf8Text, (DWORD)strlen(lpsUtf8Text));
+	}
+	else
+	{
+		CHAR lpsPart[OUTPUT_INLINE_TEXT_LENGTH * TRANSCODE_MAX_UTF8_PER_UTF16];
+		DWORD cchText = (DWORD)wcslen(lpsText);
+
+		for (DWORD dwPosition = 0; bResult && (dwPosition < cchText); )
+		{
+			DWORD cchPart = (cchText - dwPosition < OUTPUT_INLINE_TEXT_LENGTH) ? cchText - dwPosition : OUTPUT_INLINE_TEXT_LENGTH;
+
+			// Surrogate pair is not split between parts
+			WCHAR wcLast = lpsText[dwPosition + cchPart - 1];
+			if ((dwPosition + cchPart < cchText) && (wcLast >= 0xD800) && (wcLast <= 0xDBFF))
+			{
+				cchPart--;
+			}
+
+			DWORD cbPart = Utf16ToUtf8(lpsText + dwPosition, cchPart, lpsPart, sizeof(lpsPart));
+			bResult = (cbPart != TRANSCODE_ERROR) && AppendEscapedText(lpTarget, lpsPart, cbPart);
+			dwPosition += cchPart;
+		}
+	}
+
+	return bResult && (!bQuoted || AppendOutput(lpTarget, "\"", 1));
+}
+
+/// <summary>
+///		Write one record: JSON object per line, CSV row after header or tab separated text
+/// </summary>
+/// 
+/// <param name="lpFields">Fields</param>
+/// <param name="dwFieldsCount">Fields count</param>
+/// 
+/// <returns>int (bytes written, negative on failure)</returns>
+int OutputRecord(const OUTPUTFIELD* lpFields, DWORD dwFieldsCount)
+{
+	// Whole record is appended under one lock so records of threads do not interleave
+	OUTPUTBUFFER* lpTarget = t_lpOutputBuffer;
+	if (lpTarget == NULL)
+	{
+		AcquireSRWLockExclusive(&g_srwStdoutLock);
+		lpTarget = &g_obStdout;
+	}
+
+	DWORD cbStart = lpTarget->cbSize;
+	LPCSTR lpsSeparator = (g_dwOutputFormat == OUTPUT_FORMAT_TEXT) ? "\t" : ",";
+	bool bResult = true;
+
+	if ((g_dwOutputFormat == OUTPUT_FORMAT_CSV) && !t_bHeaderWritten)
+	{
+		for (DWORD dwIndex = 0; dwIndex < dwFieldsCount; dwIndex++)
+		{
+			bResult = bResult && ((dwIndex == 0) || AppendOutput(lpTarget, lpsSeparator, 1)) && AppendFieldText(lpTarget, NULL, lpFields[dwIndex].lpsName);
+		}
+
+		bResult = bResult && AppendOutput(lpTarget, "\n", 1);
+		t_bHeaderWritten = bResult;
+	}
+
+	bResult = bResult && ((g_dwOutputFormat != OUTPUT_FORMAT_NDJSON) || AppendOutput(lpTarget, "{", 1));
+
+	for (DWORD dwIndex = 0; bResult && (dwIndex < dwFieldsCount); dwIndex++)
+	{
+		const OUTPUTFIELD* lpField = &lpFields[dwIndex];
+
+		bResult = ((dwIndex == 0) || AppendOutput(lpTarget, lpsSeparator, 1)) &&
+			((g_dwOutputFormat != OUTPUT_FORMAT_NDJSON) || (AppendFieldText(lpTarget, NULL, lpField->lpsName) && AppendOutput(lpTarget, ":", 1)));
+
+		// Missing text is null in JSON and empty elsewhere
+		if ((lpField->lpsText == NULL) && (lpField->lpsUtf8Text == NULL))
+		{
+			bResult = bResult && ((g_dwOutputFormat != OUTPUT_FORMAT_NDJSON) || AppendOutput(lpTarget, "null", 4));
+		}
+		else
+		{
+			bResult = bResult && AppendFieldText(lpTarget, lpField->lpsText, lpField->lpsUtf8Text);
+		}
+	}
+
+	bResult = bResult && ((g_dwOutputFormat != OUTPUT_FORMAT_NDJSON) || AppendOutput(lpTarget, "}", 1)) && AppendOutput(lpTarget, "\n", 1);
+
+	// Partial record is dropped
+	if (!bResult)
+	{
+		lpTarget->cbSize = cbStart;
+	}
+
+	int iWritten = bResult ? (int)(lpTarget->cbSize - cbStart) : -1;
+
+	if (lpTarget == &g_obStdout)
+	{
+		if (bResult && (g_obStdout.cbSize >= OUTPUT_FLUSH_SIZE) && !WriteStdout())
+		{
+			iWritten = -1;
+		}
+
+		ReleaseSRWLockExclusive(&g_srwStdoutLock);
+	}
+
+	return iWritten;
+}
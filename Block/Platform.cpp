@@ -0,0 +1,1542 @@
+#include "../Api/Platform.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <wctype.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Difference between 1601-01-01 (FILETIME epoch) and 1970-01-01 in 100 ns units
+const ULONGLONG PLATFORM_FILETIME_UNIX_EPOCH = 116444736000000000ULL;
+const DWORD PLATFORM_PRINTF_INITIAL_LENGTH = 256;
+
+enum PLATFORMOBJECTTYPE
+{
+	OBJECT_THREAD = 1,
+	OBJECT_EVENT,
+	OBJECT_FILE,
+	OBJECT_MAPPING
+};
+
+// Kernel object behind HANDLE, threads and events are signaled under one process-wide mutex
+typedef struct _PLATFORMOBJECT {
+	DWORD dwType;
+	LONG lReferencesCount;
+	bool bSignaled;
+	bool bManualReset;
+	int iFile;
+	LPTHREAD_START_ROUTINE lpStartAddress;
+	LPVOID lpParameter;
+} PLATFORMOBJECT;
+
+// Mapped view, UnmapViewOfFile only gets view address and munmap also needs its length
+typedef struct _PLATFORMVIEW {
+	LPVOID lpBase;
+	SIZE_T cbLength;
+	struct _PLATFORMVIEW* lpNext;
+} PLATFORMVIEW;
+
+static pthread_mutex_t g_mtxObjects = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cndObjects;
+static pthread_once_t g_poObjects = PTHREAD_ONCE_INIT;
+static PLATFORMVIEW* g_lpViews = NULL;
+
+// Pseudo handles, like on Windows they are never closed
+static PLATFORMOBJECT g_poCurrentProcess = { 0, 1, false, false, -1, NULL, NULL };
+static PLATFORMOBJECT g_poCurrentThread = { 0, 1, false, false, -1, NULL, NULL };
+
+/// <summary>
+///		Create condition of kernel objects on monotonic clock, so timed waits do not
+///		depend on system time changes
+/// </summary>
+static void InitObjectsCondition()
+{
+	pthread_condattr_t caAttributes;
+	pthread_condattr_init(&caAttributes);
+	pthread_condattr_setclock(&caAttributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&g_cndObjects, &caAttributes);
+	pthread_condattr_destroy(&caAttributes);
+}
+
+/// <summary>
+///		Allocate kernel object with one reference
+/// </summary>
+///
+/// <param name="dwType">Object type</param>
+///
+/// <returns>PLATFORMOBJECT* or NULL</returns>
+static PLATFORMOBJECT* CreateObject(DWORD dwType)
+{
+	pthread_once(&g_poObjects, InitObjectsCondition);
+
+	PLATFORMOBJECT* lpObject = (PLATFORMOBJECT*)calloc(1, sizeof(PLATFORMOBJECT));
+	if (lpObject != NULL)
+	{
+		lpObject->dwType = dwType;
+		lpObject->lReferencesCount = 1;
+		lpObject->iFile = -1;
+	}
+
+	return lpObject;
+}
+
+/// <summary>
+///		Drop reference of kernel object, last reference closes its file and frees it
+/// </summary>
+///
+/// <param name="lpObject">Object</param>
+static void ReleaseObject(PLATFORMOBJECT* lpObject)
+{
+	if (InterlockedDecrement(&lpObject->lReferencesCount) == 0)
+	{
+		if (lpObject->iFile >= 0)
+		{
+			close(lpObject->iFile);
+		}
+
+		free(lpObject);
+	}
+}
+
+/// <summary>
+///		Convert time span of 100 ns units to FILETIME
+/// </summary>
+///
+/// <param name="ullTime">Time span</param>
+/// <param name="lpFileTime">Result</param>
+static void StoreFileTime(ULONGLONG ullTime, LPFILETIME lpFileTime)
+{
+	lpFileTime->dwLowDateTime = (DWORD)ullTime;
+	lpFileTime->dwHighDateTime = (DWORD)(ullTime >> 32);
+}
+
+/// <summary>
+///		Convert timeval to 100 ns units
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+static ULONGLONG TimevalToFileTime(const struct timeval* lpTime)
+{
+	return (ULONGLONG)lpTime->tv_sec * 10000000ULL + (ULONGLONG)lpTime->tv_usec * 10ULL;
+}
+
+/// <summary>
+///		Read monotonic clock in nanoseconds
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+static ULONGLONG GetMonotonicNanoseconds()
+{
+	struct timespec tsNow;
+	clock_gettime(CLOCK_MONOTONIC, &tsNow);
+
+	return (ULONGLONG)tsNow.tv_sec * 1000000000ULL + (ULONGLONG)tsNow.tv_nsec;
+}
+
+/// <summary>
+///		Convert UTF-16 or UTF-32 wide string to UTF-8 file name for POSIX calls
+/// </summary>
+///
+/// <param name="lpsSource">Wide string</param>
+/// <param name="lpsDestination">Destination</param>
+/// <param name="cbDestination">Destination size in bytes</param>
+///
+/// <returns>bool</returns>
+static bool NarrowFileName(LPCWSTR lpsSource, LPSTR lpsDestination, int cbDestination)
+{
+	return WideCharToMultiByte(CP_UTF8, 0, lpsSource, -1, lpsDestination, cbDestination, NULL, NULL) > 0;
+}
+
+/// <summary>
+///		Thread entry point of CreateThread, signals thread handle when routine returns
+/// </summary>
+///
+/// <param name="lpParameter">Thread object</param>
+///
+/// <returns>void*</returns>
+static void* RunThreadObject(void* lpParameter)
+{
+	PLATFORMOBJECT* lpThread = (PLATFORMOBJECT*)lpParameter;
+	lpThread->lpStartAddress(lpThread->lpParameter);
+
+	pthread_mutex_lock(&g_mtxObjects);
+	lpThread->bSignaled = true;
+	pthread_cond_broadcast(&g_cndObjects);
+	pthread_mutex_unlock(&g_mtxObjects);
+
+	ReleaseObject(lpThread);
+
+	return NULL;
+}
+
+/// <summary>
+///		Start detached thread, handle is signaled when thread routine returns
+/// </summary>
+///
+/// <returns>HANDLE or NULL</returns>
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpAttributes, SIZE_T cbStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpdwThreadId)
+{
+	PLATFORMOBJECT* lpThread = CreateObject(OBJECT_THREAD);
+	if (lpThread == NULL)
+	{
+		return NULL;
+	}
+
+	lpThread->lpStartAddress = lpStartAddress;
+	lpThread->lpParameter = lpParameter;
+
+	// Running thread holds its own reference
+	lpThread->lReferencesCount = 2;
+
+	pthread_attr_t paAttributes;
+	pthread_attr_init(&paAttributes);
+	pthread_attr_setdetachstate(&paAttributes, PTHREAD_CREATE_DETACHED);
+	if (cbStackSize != 0)
+	{
+		pthread_attr_setstacksize(&paAttributes, cbStackSize);
+	}
+
+	pthread_t ptThread;
+	int iError = pthread_create(&ptThread, &paAttributes, RunThreadObject, lpThread);
+	pthread_attr_destroy(&paAttributes);
+
+	if (iError != 0)
+	{
+		free(lpThread);
+		return NULL;
+	}
+
+	if (lpdwThreadId != NULL)
+	{
+		*lpdwThreadId = 0;
+	}
+
+	return lpThread;
+}
+
+/// <summary>
+///		Create unnamed event
+/// </summary>
+///
+/// <returns>HANDLE or NULL</returns>
+HANDLE CreateEvent(LPSECURITY_ATTRIBUTES lpAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpsName)
+{
+	PLATFORMOBJECT* lpEvent = CreateObject(OBJECT_EVENT);
+	if (lpEvent != NULL)
+	{
+		lpEvent->bManualReset = bManualReset;
+		lpEvent->bSignaled = bInitialState;
+	}
+
+	return lpEvent;
+}
+
+/// <summary>
+///		Signal event and wake waiters
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL SetEvent(HANDLE hEvent)
+{
+	PLATFORMOBJECT* lpEvent = (PLATFORMOBJECT*)hEvent;
+	if ((lpEvent == NULL) || (lpEvent->dwType != OBJECT_EVENT))
+	{
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&g_mtxObjects);
+	lpEvent->bSignaled = true;
+	pthread_cond_broadcast(&g_cndObjects);
+	pthread_mutex_unlock(&g_mtxObjects);
+
+	return TRUE;
+}
+
+/// <summary>
+///		Close handle of any kernel object
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL CloseHandle(HANDLE hObject)
+{
+	if ((hObject == NULL) || (hObject == INVALID_HANDLE_VALUE))
+	{
+		return FALSE;
+	}
+
+	if ((hObject != &g_poCurrentProcess) && (hObject != &g_poCurrentThread))
+	{
+		ReleaseObject((PLATFORMOBJECT*)hObject);
+	}
+
+	return TRUE;
+}
+
+/// <summary>
+///		Check wait condition with objects mutex held, satisfied wait resets auto-reset events
+/// </summary>
+///
+/// <param name="dwCount">Handles count</param>
+/// <param name="lpHandles">Handles</param>
+/// <param name="bWaitAll">All handles must be signaled</param>
+///
+/// <returns>Index of signaled handle, dwCount for all handles or MAXDWORD if wait is not satisfied</returns>
+static DWORD TryWaitObjects(DWORD dwCount, const HANDLE* lpHandles, BOOL bWaitAll)
+{
+	for (DWORD dwIndex = 0; dwIndex < dwCount; dwIndex++)
+	{
+		PLATFORMOBJECT* lpObject = (PLATFORMOBJECT*)lpHandles[dwIndex];
+		if (!bWaitAll && lpObject->bSignaled)
+		{
+			if ((lpObject->dwType == OBJECT_EVENT) && !lpObject->bManualReset)
+			{
+				lpObject->bSignaled = false;
+			}
+
+			return dwIndex;
+		}
+
+		if (bWaitAll && !lpObject->bSignaled)
+		{
+			return MAXDWORD;
+		}
+	}
+
+	if (!bWaitAll)
+	{
+		return MAXDWORD;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwCount; dwIndex++)
+	{
+		PLATFORMOBJECT* lpObject = (PLATFORMOBJECT*)lpHandles[dwIndex];
+		if ((lpObject->dwType == OBJECT_EVENT) && !lpObject->bManualReset)
+		{
+			lpObject->bSignaled = false;
+		}
+	}
+
+	return dwCount;
+}
+
+/// <summary>
+///		Wait until one or all of threads and events are signaled
+/// </summary>
+///
+/// <returns>WAIT_OBJECT_0 + index, WAIT_TIMEOUT or WAIT_FAILED</returns>
+DWORD WaitForMultipleObjects(DWORD dwCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds)
+{
+	if ((dwCount == 0) || (dwCount > MAXIMUM_WAIT_OBJECTS))
+	{
+		return WAIT_FAILED;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < dwCount; dwIndex++)
+	{
+		PLATFORMOBJECT* lpObject = (PLATFORMOBJECT*)lpHandles[dwIndex];
+		if ((lpObject == NULL) || ((lpObject->dwType != OBJECT_THREAD) && (lpObject->dwType != OBJECT_EVENT)))
+		{
+			return WAIT_FAILED;
+		}
+	}
+
+	struct timespec tsDeadline;
+	if (dwMilliseconds != INFINITE)
+	{
+		ULONGLONG ullDeadline = GetMonotonicNanoseconds() + (ULONGLONG)dwMilliseconds * 1000000ULL;
+		tsDeadline.tv_sec = (time_t)(ullDeadline / 1000000000ULL);
+		tsDeadline.tv_nsec = (long)(ullDeadline % 1000000000ULL);
+	}
+
+	pthread_once(&g_poObjects, InitObjectsCondition);
+	pthread_mutex_lock(&g_mtxObjects);
+
+	DWORD dwResult = TryWaitObjects(dwCount, lpHandles, bWaitAll);
+	while (dwResult == MAXDWORD)
+	{
+		if (dwMilliseconds == INFINITE)
+		{
+			pthread_cond_wait(&g_cndObjects, &g_mtxObjects);
+		}
+		else if (pthread_cond_timedwait(&g_cndObjects, &g_mtxObjects, &tsDeadline) == ETIMEDOUT)
+		{
+			dwResult = TryWaitObjects(dwCount, lpHandles, bWaitAll);
+			break;
+		}
+
+		dwResult = TryWaitObjects(dwCount, lpHandles, bWaitAll);
+	}
+
+	pthread_mutex_unlock(&g_mtxObjects);
+
+	if (dwResult == MAXDWORD)
+	{
+		return WAIT_TIMEOUT;
+	}
+
+	return WAIT_OBJECT_0 + (bWaitAll ? 0 : dwResult);
+}
+
+/// <summary>
+///		Wait until thread or event is signaled
+/// </summary>
+///
+/// <returns>WAIT_OBJECT_0, WAIT_TIMEOUT or WAIT_FAILED</returns>
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+	return WaitForMultipleObjects(1, &hHandle, TRUE, dwMilliseconds);
+}
+
+/// <summary>
+///		Get pseudo handle of current thread
+/// </summary>
+///
+/// <returns>HANDLE</returns>
+HANDLE GetCurrentThread()
+{
+	return &g_poCurrentThread;
+}
+
+/// <summary>
+///		Get pseudo handle of current process
+/// </summary>
+///
+/// <returns>HANDLE</returns>
+HANDLE GetCurrentProcess()
+{
+	return &g_poCurrentProcess;
+}
+
+/// <summary>
+///		Get kernel id of current thread
+/// </summary>
+///
+/// <returns>DWORD</returns>
+DWORD GetCurrentThreadId()
+{
+#ifdef SYS_gettid
+	return (DWORD)syscall(SYS_gettid);
+#else
+	return (DWORD)(ULONG_PTR)pthread_self();
+#endif
+}
+
+/// <summary>
+///		Get id of current process
+/// </summary>
+///
+/// <returns>DWORD</returns>
+DWORD GetCurrentProcessId()
+{
+	return (DWORD)getpid();
+}
+
+/// <summary>
+///		Thread priority is left to scheduler, background mode only affects I/O priority on Windows
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL SetThreadPriority(HANDLE hThread, int iPriority)
+{
+	return TRUE;
+}
+
+/// <summary>
+///		Suspend current thread
+/// </summary>
+///
+/// <param name="dwMilliseconds">Delay</param>
+void Sleep(DWORD dwMilliseconds)
+{
+	struct timespec tsDelay;
+	tsDelay.tv_sec = (time_t)(dwMilliseconds / 1000);
+	tsDelay.tv_nsec = (long)(dwMilliseconds % 1000) * 1000000L;
+
+	while ((nanosleep(&tsDelay, &tsDelay) != 0) && (errno == EINTR))
+	{
+	}
+}
+
+/// <summary>
+///		Give rest of time slice to other ready thread
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL SwitchToThread()
+{
+	return sched_yield() == 0;
+}
+
+/// <summary>
+///		Initialize slim reader/writer lock
+/// </summary>
+void InitializeSRWLock(PSRWLOCK lpLock)
+{
+	pthread_rwlock_init(lpLock, NULL);
+}
+
+/// <summary>
+///		Acquire slim reader/writer lock for writing
+/// </summary>
+void AcquireSRWLockExclusive(PSRWLOCK lpLock)
+{
+	pthread_rwlock_wrlock(lpLock);
+}
+
+/// <summary>
+///		Release slim reader/writer lock acquired for writing
+/// </summary>
+void ReleaseSRWLockExclusive(PSRWLOCK lpLock)
+{
+	pthread_rwlock_unlock(lpLock);
+}
+
+/// <summary>
+///		Acquire slim reader/writer lock for reading
+/// </summary>
+void AcquireSRWLockShared(PSRWLOCK lpLock)
+{
+	pthread_rwlock_rdlock(lpLock);
+}
+
+/// <summary>
+///		Release slim reader/writer lock acquired for reading
+/// </summary>
+void ReleaseSRWLockShared(PSRWLOCK lpLock)
+{
+	pthread_rwlock_unlock(lpLock);
+}
+
+/// <summary>
+///		Initialize condition variable
+/// </summary>
+void InitializeConditionVariable(PCONDITION_VARIABLE lpCondition)
+{
+	pthread_mutex_init(&lpCondition->mtxWait, NULL);
+	pthread_cond_init(&lpCondition->cndWait, NULL);
+}
+
+/// <summary>
+///		Release lock and wait for condition variable, wait mutex is taken before lock is released,
+///		so wake of thread that changed state under lock is never lost
+/// </summary>
+///
+/// <param name="lpCondition">Condition variable</param>
+/// <param name="lpLock">Lock held by caller</param>
+/// <param name="dwMilliseconds">Timeout</param>
+/// <param name="ulFlags">CONDITION_VARIABLE_LOCKMODE_SHARED if lock is held for reading</param>
+///
+/// <returns>FALSE on timeout</returns>
+BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE lpCondition, PSRWLOCK lpLock, DWORD dwMilliseconds, ULONG ulFlags)
+{
+	int iError = 0;
+
+	pthread_mutex_lock(&lpCondition->mtxWait);
+	pthread_rwlock_unlock(lpLock);
+
+	if (dwMilliseconds == INFINITE)
+	{
+		pthread_cond_wait(&lpCondition->cndWait, &lpCondition->mtxWait);
+	}
+	else
+	{
+		struct timespec tsDeadline;
+		clock_gettime(CLOCK_REALTIME, &tsDeadline);
+		ULONGLONG ullNanoseconds = (ULONGLONG)tsDeadline.tv_nsec + (ULONGLONG)dwMilliseconds * 1000000ULL;
+		tsDeadline.tv_sec += (time_t)(ullNanoseconds / 1000000000ULL);
+		tsDeadline.tv_nsec = (long)(ullNanoseconds % 1000000000ULL);
+
+		iError = pthread_cond_timedwait(&lpCondition->cndWait, &lpCondition->mtxWait, &tsDeadline);
+	}
+
+	pthread_mutex_unlock(&lpCondition->mtxWait);
+
+	if (ulFlags & CONDITION_VARIABLE_LOCKMODE_SHARED)
+	{
+		pthread_rwlock_rdlock(lpLock);
+	}
+	else
+	{
+		pthread_rwlock_wrlock(lpLock);
+	}
+
+	return iError == 0;
+}
+
+/// <summary>
+///		Wake all threads waiting for condition variable
+/// </summary>
+void WakeAllConditionVariable(PCONDITION_VARIABLE lpCondition)
+{
+	pthread_mutex_lock(&lpCondition->mtxWait);
+	pthread_cond_broadcast(&lpCondition->cndWait);
+	pthread_mutex_unlock(&lpCondition->mtxWait);
+}
+
+/// <summary>
+///		Read monotonic clock, ticks are nanoseconds
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL QueryPerformanceCounter(LARGE_INTEGER* lpCounter)
+{
+	lpCounter->QuadPart = (LONGLONG)GetMonotonicNanoseconds();
+	return TRUE;
+}
+
+/// <summary>
+///		Get ticks per second of QueryPerformanceCounter
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* lpFrequency)
+{
+	lpFrequency->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+/// <summary>
+///		Get milliseconds of monotonic clock
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+ULONGLONG GetTickCount64()
+{
+	return GetMonotonicNanoseconds() / 1000000ULL;
+}
+
+/// <summary>
+///		Compare two file times
+/// </summary>
+///
+/// <returns>-1, 0 or 1</returns>
+LONG CompareFileTime(const FILETIME* lpFirst, const FILETIME* lpSecond)
+{
+	ULONGLONG ullFirst = ((ULONGLONG)lpFirst->dwHighDateTime << 32) | lpFirst->dwLowDateTime;
+	ULONGLONG ullSecond = ((ULONGLONG)lpSecond->dwHighDateTime << 32) | lpSecond->dwLowDateTime;
+
+	return (ullFirst < ullSecond) ? -1 : ((ullFirst > ullSecond) ? 1 : 0);
+}
+
+/// <summary>
+///		Get CPU time of current process, creation and exit times are not tracked
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL GetProcessTimes(HANDLE hProcess, LPFILETIME lpCreationTime, LPFILETIME lpExitTime, LPFILETIME lpKernelTime, LPFILETIME lpUserTime)
+{
+	struct rusage ruUsage;
+	if ((hProcess != &g_poCurrentProcess) || (getrusage(RUSAGE_SELF, &ruUsage) != 0))
+	{
+		return FALSE;
+	}
+
+	StoreFileTime(0, lpCreationTime);
+	StoreFileTime(0, lpExitTime);
+	StoreFileTime(TimevalToFileTime(&ruUsage.ru_stime), lpKernelTime);
+	StoreFileTime(TimevalToFileTime(&ruUsage.ru_utime), lpUserTime);
+
+	return TRUE;
+}
+
+/// <summary>
+///		Get page size and online processors count
+/// </summary>
+void GetSystemInfo(LPSYSTEM_INFO lpSystemInfo)
+{
+	long lProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+	long lPageSize = sysconf(_SC_PAGESIZE);
+
+	lpSystemInfo->dwNumberOfProcessors = (lProcessors > 0) ? (DWORD)lProcessors : 1;
+	lpSystemInfo->dwPageSize = (lPageSize > 0) ? (DWORD)lPageSize : 4096;
+}
+
+/// <summary>
+///		Get peak resident set of current process, current resident set is not tracked
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL GetProcessMemoryInfo(HANDLE hProcess, PROCESS_MEMORY_COUNTERS* lpCounters, DWORD cbCounters)
+{
+	struct rusage ruUsage;
+	if ((hProcess != &g_poCurrentProcess) || (cbCounters < sizeof(PROCESS_MEMORY_COUNTERS)) || (getrusage(RUSAGE_SELF, &ruUsage) != 0))
+	{
+		return FALSE;
+	}
+
+	// ru_maxrss is in kilobytes on Linux
+	lpCounters->cb = sizeof(PROCESS_MEMORY_COUNTERS);
+	lpCounters->PeakWorkingSetSize = (SIZE_T)ruUsage.ru_maxrss * 1024;
+	lpCounters->WorkingSetSize = lpCounters->PeakWorkingSetSize;
+
+	return TRUE;
+}
+
+/// <summary>
+///		Open file, only reading of existing file and creation of new file are supported
+/// </summary>
+///
+/// <returns>HANDLE or INVALID_HANDLE_VALUE</returns>
+HANDLE CreateFileA(LPCSTR lpsFileName, DWORD dwAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpAttributes, DWORD dwDisposition, DWORD dwFlags, HANDLE hTemplate)
+{
+	int iFlags = ((dwAccess & GENERIC_WRITE) ? ((dwAccess & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY) | O_CLOEXEC;
+	if (dwDisposition == CREATE_ALWAYS)
+	{
+		iFlags |= O_CREAT | O_TRUNC;
+	}
+
+	PLATFORMOBJECT* lpFile = CreateObject(OBJECT_FILE);
+	if (lpFile == NULL)
+	{
+		return INVALID_HANDLE_VALUE;
+	}
+
+	lpFile->iFile = open(lpsFileName, iFlags, 0644);
+	if (lpFile->iFile < 0)
+	{
+		ReleaseObject(lpFile);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	return lpFile;
+}
+
+/// <summary>
+///		Get size of open file
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL GetFileSizeEx(HANDLE hFile, LARGE_INTEGER* lpFileSize)
+{
+	PLATFORMOBJECT* lpFile = (PLATFORMOBJECT*)hFile;
+	struct stat stStatus;
+	if ((lpFile->dwType != OBJECT_FILE) || (fstat(lpFile->iFile, &stStatus) != 0))
+	{
+		return FALSE;
+	}
+
+	lpFileSize->QuadPart = (LONGLONG)stStatus.st_size;
+	return TRUE;
+}
+
+/// <summary>
+///		Create read-only mapping object of whole file, mapping keeps its own descriptor
+/// </summary>
+///
+/// <returns>HANDLE or NULL</returns>
+HANDLE CreateFileMapping(HANDLE hFile, LPSECURITY_ATTRIBUTES lpAttributes, DWORD dwProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpsName)
+{
+	PLATFORMOBJECT* lpFile = (PLATFORMOBJECT*)hFile;
+	if ((lpFile == INVALID_HANDLE_VALUE) || (lpFile->dwType != OBJECT_FILE) || (dwProtect != PAGE_READONLY))
+	{
+		return NULL;
+	}
+
+	PLATFORMOBJECT* lpMapping = CreateObject(OBJECT_MAPPING);
+	if (lpMapping == NULL)
+	{
+		return NULL;
+	}
+
+	lpMapping->iFile = fcntl(lpFile->iFile, F_DUPFD_CLOEXEC, 0);
+	if (lpMapping->iFile < 0)
+	{
+		ReleaseObject(lpMapping);
+		return NULL;
+	}
+
+	return lpMapping;
+}
+
+/// <summary>
+///		Map read-only view of file mapping
+/// </summary>
+///
+/// <returns>View address or NULL</returns>
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwAccess, DWORD dwOffsetHigh, DWORD dwOffsetLow, SIZE_T cbSize)
+{
+	PLATFORMOBJECT* lpMapping = (PLATFORMOBJECT*)hMapping;
+	struct stat stStatus;
+	if ((lpMapping == NULL) || (lpMapping->dwType != OBJECT_MAPPING) || (fstat(lpMapping->iFile, &stStatus) != 0))
+	{
+		return NULL;
+	}
+
+	off_t oOffset = (off_t)(((ULONGLONG)dwOffsetHigh << 32) | dwOffsetLow);
+	SIZE_T cbLength = (cbSize != 0) ? cbSize : (SIZE_T)(stStatus.st_size - oOffset);
+
+	PLATFORMVIEW* lpView = (PLATFORMVIEW*)malloc(sizeof(PLATFORMVIEW));
+	if ((lpView == NULL) || (cbLength == 0))
+	{
+		free(lpView);
+		return NULL;
+	}
+
+	lpView->lpBase = mmap(NULL, cbLength, PROT_READ, MAP_PRIVATE, lpMapping->iFile, oOffset);
+	if (lpView->lpBase == MAP_FAILED)
+	{
+		free(lpView);
+		return NULL;
+	}
+
+	lpView->cbLength = cbLength;
+
+	pthread_mutex_lock(&g_mtxObjects);
+	lpView->lpNext = g_lpViews;
+	g_lpViews = lpView;
+	pthread_mutex_unlock(&g_mtxObjects);
+
+	return lpView->lpBase;
+}
+
+/// <summary>
+///		Unmap view returned by MapViewOfFile
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL UnmapViewOfFile(LPCVOID lpBase)
+{
+	PLATFORMVIEW* lpView = NULL;
+
+	pthread_mutex_lock(&g_mtxObjects);
+	for (PLATFORMVIEW** lplpView = &g_lpViews; *lplpView != NULL; lplpView = &(*lplpView)->lpNext)
+	{
+		if ((*lplpView)->lpBase == lpBase)
+		{
+			lpView = *lplpView;
+			*lplpView = lpView->lpNext;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_mtxObjects);
+
+	if (lpView == NULL)
+	{
+		return FALSE;
+	}
+
+	munmap(lpView->lpBase, lpView->cbLength);
+	free(lpView);
+
+	return TRUE;
+}
+
+/// <summary>
+///		Read from open file
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD cbToRead, LPDWORD lpcbRead, void* lpOverlapped)
+{
+	PLATFORMOBJECT* lpFile = (PLATFORMOBJECT*)hFile;
+	if ((lpFile == NULL) || (lpFile == INVALID_HANDLE_VALUE) || (lpFile->dwType != OBJECT_FILE))
+	{
+		return FALSE;
+	}
+
+	ssize_t cbRead;
+	do
+	{
+		cbRead = read(lpFile->iFile, lpBuffer, cbToRead);
+	} while ((cbRead < 0) && (errno == EINTR));
+
+	*lpcbRead = (cbRead < 0) ? 0 : (DWORD)cbRead;
+	return cbRead >= 0;
+}
+
+/// <summary>
+///		Delete file with wide name
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL DeleteFile(LPCWSTR lpsFileName)
+{
+	char lpsNarrowName[MAX_PATH * 4];
+	return NarrowFileName(lpsFileName, lpsNarrowName, sizeof(lpsNarrowName)) && (unlink(lpsNarrowName) == 0);
+}
+
+/// <summary>
+///		Delete file
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL DeleteFileA(LPCSTR lpsFileName)
+{
+	return unlink(lpsFileName) == 0;
+}
+
+/// <summary>
+///		Rename file, rename always replaces existing file
+/// </summary>
+///
+/// <returns>BOOL</returns>
+BOOL MoveFileExA(LPCSTR lpsExistingFileName, LPCSTR lpsNewFileName, DWORD dwFlags)
+{
+	if (!(dwFlags & MOVEFILE_REPLACE_EXISTING) && (access(lpsNewFileName, F_OK) == 0))
+	{
+		return FALSE;
+	}
+
+	return rename(lpsExistingFileName, lpsNewFileName) == 0;
+}
+
+/// <summary>
+///		Get directory for temporary files with trailing separator
+/// </summary>
+///
+/// <param name="cchBuffer">Buffer size in characters</param>
+/// <param name="lpsBuffer">Buffer</param>
+///
+/// <returns>Path length, required buffer size if buffer is too small</returns>
+DWORD GetTempPathA(DWORD cchBuffer, LPSTR lpsBuffer)
+{
+	const char* lpsDirectory = getenv("TMPDIR");
+	if ((lpsDirectory == NULL) || (lpsDirectory[0] == '\0'))
+	{
+		lpsDirectory = "/tmp";
+	}
+
+	size_t cchDirectory = strlen(lpsDirectory);
+	bool bSeparator = lpsDirectory[cchDirectory - 1] != '/';
+	size_t cchPath = cchDirectory + (bSeparator ? 1 : 0);
+	if (cchPath + 1 > cchBuffer)
+	{
+		return (DWORD)(cchPath + 1);
+	}
+
+	memcpy(lpsBuffer, lpsDirectory, cchDirectory);
+	if (bSeparator)
+	{
+		lpsBuffer[cchDirectory] = '/';
+	}
+
+	lpsBuffer[cchPath] = '\0';
+	return (DWORD)cchPath;
+}
+
+/// <summary>
+///		Get directory for temporary files with trailing separator as wide string
+/// </summary>
+///
+/// <returns>Path length, 0 on failure</returns>
+DWORD GetTempPath(DWORD cchBuffer, LPWSTR lpsBuffer)
+{
+	char lpsPath[MAX_PATH];
+	DWORD cchPath = GetTempPathA(MAX_PATH, lpsPath);
+	if ((cchPath == 0) || (cchPath >= MAX_PATH))
+	{
+		return 0;
+	}
+
+	int cchWide = MultiByteToWideChar(CP_UTF8, 0, lpsPath, -1, lpsBuffer, (int)cchBuffer);
+	return (cchWide > 0) ? (DWORD)(cchWide - 1) : 0;
+}
+
+/// <summary>
+///		Create empty temporary file with unique name, like GetTempFileName with uUnique of 0
+/// </summary>
+///
+/// <param name="lpsPath">Directory</param>
+/// <param name="lpsPrefix">Name prefix (first 3 characters are used)</param>
+/// <param name="uUnique">Must be 0</param>
+/// <param name="lpsTempFileName">Created file name, buffer of MAX_PATH characters</param>
+///
+/// <returns>Nonzero on success</returns>
+unsigned int GetTempFileNameA(LPCSTR lpsPath, LPCSTR lpsPrefix, unsigned int uUnique, LPSTR lpsTempFileName)
+{
+	if (uUnique != 0)
+	{
+		return 0;
+	}
+
+	char lpsTemplate[MAX_PATH];
+	int cchTemplate = snprintf(lpsTemplate, MAX_PATH, "%s%s%.3sXXXXXX.tmp", lpsPath,
+		((lpsPath[0] != '\0') && (lpsPath[strlen(lpsPath) - 1] != '/')) ? "/" : "", lpsPrefix);
+	if ((cchTemplate < 0) || (cchTemplate >= MAX_PATH))
+	{
+		return 0;
+	}
+
+	int iFile = mkstemps(lpsTemplate, 4);
+	if (iFile < 0)
+	{
+		return 0;
+	}
+
+	close(iFile);
+	memcpy(lpsTempFileName, lpsTemplate, (size_t)cchTemplate + 1);
+
+	return 1;
+}
+
+/// <summary>
+///		Create empty temporary file with unique wide name
+/// </summary>
+///
+/// <returns>Nonzero on success</returns>
+unsigned int GetTempFileName(LPCWSTR lpsPath, LPCWSTR lpsPrefix, unsigned int uUnique, LPWSTR lpsTempFileName)
+{
+	char lpsNarrowPath[MAX_PATH], lpsNarrowPrefix[16], lpsNarrowName[MAX_PATH];
+	if (!NarrowFileName(lpsPath, lpsNarrowPath, MAX_PATH) || !NarrowFileName(lpsPrefix, lpsNarrowPrefix, sizeof(lpsNarrowPrefix)) ||
+		(GetTempFileNameA(lpsNarrowPath, lpsNarrowPrefix, uUnique, lpsNarrowName) == 0))
+	{
+		return 0;
+	}
+
+	if (MultiByteToWideChar(CP_UTF8, 0, lpsNarrowName, -1, lpsTempFileName, MAX_PATH) == 0)
+	{
+		unlink(lpsNarrowName);
+		return 0;
+	}
+
+	return 1;
+}
+
+/// <summary>
+///		Decode UTF-8 to wide characters (UTF-16 or UTF-32 depending on wchar_t size),
+///		only CP_UTF8 and CP_ACP (treated as UTF-8) code pages are supported
+/// </summary>
+///
+/// <param name="cbSource">Source bytes count, -1 to include terminator</param>
+/// <param name="cchDestination">Destination characters count, 0 to calculate required size</param>
+///
+/// <returns>Characters written or required, 0 on failure</returns>
+int MultiByteToWideChar(unsigned int uCodePage, DWORD dwFlags, LPCSTR lpsSource, int cbSource, LPWSTR lpsDestination, int cchDestination)
+{
+	const unsigned char* lpbSource = (const unsigned char*)lpsSource;
+	size_t cbLength = (cbSource < 0) ? strlen(lpsSource) + 1 : (size_t)cbSource;
+	size_t cchWritten = 0;
+
+	for (size_t cbPosition = 0; cbPosition < cbLength;)
+	{
+		unsigned char bLead = lpbSource[cbPosition];
+		DWORD dwCodePoint = 0xFFFD, cbSequence = 1, dwMinimum = 0;
+
+		if (bLead < 0x80)
+		{
+			dwCodePoint = bLead;
+		}
+		else if ((bLead & 0xE0) == 0xC0)
+		{
+			cbSequence = 2;
+			dwCodePoint = bLead & 0x1F;
+			dwMinimum = 0x80;
+		}
+		else if ((bLead & 0xF0) == 0xE0)
+		{
+			cbSequence = 3;
+			dwCodePoint = bLead & 0x0F;
+			dwMinimum = 0x800;
+		}
+		else if ((bLead & 0xF8) == 0xF0)
+		{
+			cbSequence = 4;
+			dwCodePoint = bLead & 0x07;
+			dwMinimum = 0x10000;
+		}
+		else
+		{
+			cbSequence = 0;
+		}
+
+		bool bValid = (cbSequence != 0) && (cbPosition + cbSequence <= cbLength);
+		for (DWORD dwIndex = 1; bValid && (dwIndex < cbSequence); dwIndex++)
+		{
+			unsigned char bNext = lpbSource[cbPosition + dwIndex];
+			bValid = (bNext & 0xC0) == 0x80;
+			dwCodePoint = (dwCodePoint << 6) | (bNext & 0x3F);
+		}
+
+		bValid = bValid && (dwCodePoint >= dwMinimum) && (dwCodePoint <= 0x10FFFF) && ((dwCodePoint < 0xD800) || (dwCodePoint > 0xDFFF));
+		if (!bValid)
+		{
+			if (dwFlags & MB_ERR_INVALID_CHARS)
+			{
+				return 0;
+			}
+
+			dwCodePoint = 0xFFFD;
+			cbSequence = 1;
+		}
+
+		cbPosition += cbSequence;
+
+		size_t cchCharacter = ((sizeof(WCHAR) == 2) && (dwCodePoint >= 0x10000)) ? 2 : 1;
+		if (cchDestination != 0)
+		{
+			if (cchWritten + cchCharacter > (size_t)cchDestination)
+			{
+				return 0;
+			}
+
+			if (cchCharacter == 2)
+			{
+				lpsDestination[cchWritten] = (WCHAR)(0xD800 + ((dwCodePoint - 0x10000) >> 10));
+				lpsDestination[cchWritten + 1] = (WCHAR)(0xDC00 + ((dwCodePoint - 0x10000) & 0x3FF));
+			}
+			else
+			{
+				lpsDestination[cchWritten] = (WCHAR)dwCodePoint;
+			}
+		}
+
+		cchWritten += cchCharacter;
+	}
+
+	return (cchWritten > 0x7FFFFFFF) ? 0 : (int)cchWritten;
+}
+
+/// <summary>
+///		Encode wide characters as UTF-8, unpaired surrogates become replacement character
+/// </summary>
+///
+/// <param name="cchSource">Source characters count, -1 to include terminator</param>
+/// <param name="cbDestination">Destination bytes count, 0 to calculate required size</param>
+///
+/// <returns>Bytes written or required, 0 on failure</returns>
+int WideCharToMultiByte(unsigned int uCodePage, DWORD dwFlags, LPCWSTR lpsSource, int cchSource, LPSTR lpsDestination, int cbDestination, LPCSTR lpsDefaultChar, BOOL* lpbUsedDefaultChar)
+{
+	size_t cchLength = (cchSource < 0) ? wcslen(lpsSource) + 1 : (size_t)cchSource;
+	size_t cbWritten = 0;
+
+	for (size_t cchPosition = 0; cchPosition < cchLength; cchPosition++)
+	{
+		DWORD dwCodePoint = (DWORD)lpsSource[cchPosition];
+		if ((dwCodePoint >= 0xD800) && (dwCodePoint <= 0xDBFF) && (cchPosition + 1 < cchLength) &&
+			((DWORD)lpsSource[cchPosition + 1] >= 0xDC00) && ((DWORD)lpsSource[cchPosition + 1] <= 0xDFFF))
+		{
+			dwCodePoint = 0x10000 + ((dwCodePoint - 0xD800) << 10) + ((DWORD)lpsSource[cchPosition + 1] - 0xDC00);
+			cchPosition++;
+		}
+		else if (((dwCodePoint >= 0xD800) && (dwCodePoint <= 0xDFFF)) || (dwCodePoint > 0x10FFFF))
+		{
+			dwCodePoint = 0xFFFD;
+		}
+
+		unsigned char lpbSequence[4];
+		size_t cbSequence;
+		if (dwCodePoint < 0x80)
+		{
+			lpbSequence[0] = (unsigned char)dwCodePoint;
+			cbSequence = 1;
+		}
+		else if (dwCodePoint < 0x800)
+		{
+			lpbSequence[0] = (unsigned char)(0xC0 | (dwCodePoint >> 6));
+			lpbSequence[1] = (unsigned char)(0x80 | (dwCodePoint & 0x3F));
+			cbSequence = 2;
+		}
+		else if (dwCodePoint < 0x10000)
+		{
+			lpbSequence[0] = (unsigned char)(0xE0 | (dwCodePoint >> 12));
+			lpbSequence[1] = (unsigned char)(0x80 | ((dwCodePoint >> 6) & 0x3F));
+			lpbSequence[2] = (unsigned char)(0x80 | (dwCodePoint & 0x3F));
+			cbSequence = 3;
+		}
+		else
+		{
+			lpbSequence[0] = (unsigned char)(0xF0 | (dwCodePoint >> 18));
+			lpbSequence[1] = (unsigned char)(0x80 | ((dwCodePoint >> 12) & 0x3F));
+			lpbSequence[2] = (unsigned char)(0x80 | ((dwCodePoint >> 6) & 0x3F));
+			lpbSequence[3] = (unsigned char)(0x80 | (dwCodePoint & 0x3F));
+			cbSequence = 4;
+		}
+
+		if (cbDestination != 0)
+		{
+			if (cbWritten + cbSequence > (size_t)cbDestination)
+			{
+				return 0;
+			}
+
+			memcpy(lpsDestination + cbWritten, lpbSequence, cbSequence);
+		}
+
+		cbWritten += cbSequence;
+	}
+
+	if (lpbUsedDefaultChar != NULL)
+	{
+		*lpbUsedDefaultChar = FALSE;
+	}
+
+	return (cbWritten > 0x7FFFFFFF) ? 0 : (int)cbWritten;
+}
+
+/// <summary>
+///		Convert characters to lower case in place
+/// </summary>
+///
+/// <returns>Characters count</returns>
+DWORD CharLowerBuffW(LPWSTR lpsText, DWORD cchText)
+{
+	for (DWORD dwIndex = 0; dwIndex < cchText; dwIndex++)
+	{
+		lpsText[dwIndex] = (WCHAR)towlower((wint_t)lpsText[dwIndex]);
+	}
+
+	return cchText;
+}
+
+/// <summary>
+///		Copy string, empty destination and ERANGE if it does not fit
+/// </summary>
+///
+/// <returns>0 or error code</returns>
+int strcpy_s(char* lpsDestination, size_t cchDestination, const char* lpsSource)
+{
+	size_t cchSource = strlen(lpsSource);
+	if (cchSource >= cchDestination)
+	{
+		if (cchDestination != 0)
+		{
+			lpsDestination[0] = '\0';
+		}
+
+		return ERANGE;
+	}
+
+	memcpy(lpsDestination, lpsSource, cchSource + 1);
+	return 0;
+}
+
+/// <summary>
+///		Copy wide string, empty destination and ERANGE if it does not fit
+/// </summary>
+///
+/// <returns>0 or error code</returns>
+int wcscpy_s(wchar_t* lpsDestination, size_t cchDestination, const wchar_t* lpsSource)
+{
+	size_t cchSource = wcslen(lpsSource);
+	if (cchSource >= cchDestination)
+	{
+		if (cchDestination != 0)
+		{
+			lpsDestination[0] = L'\0';
+		}
+
+		return ERANGE;
+	}
+
+	wmemcpy(lpsDestination, lpsSource, cchSource + 1);
+	return 0;
+}
+
+/// <summary>
+///		Append wide string, empty destination and ERANGE if result does not fit
+/// </summary>
+///
+/// <returns>0 or error code</returns>
+int wcscat_s(wchar_t* lpsDestination, size_t cchDestination, const wchar_t* lpsSource)
+{
+	size_t cchExisting = wcsnlen(lpsDestination, cchDestination);
+	if (cchExisting == cchDestination)
+	{
+		return EINVAL;
+	}
+
+	int iError = wcscpy_s(lpsDestination + cchExisting, cchDestination - cchExisting, lpsSource);
+	if (iError != 0)
+	{
+		lpsDestination[0] = L'\0';
+	}
+
+	return iError;
+}
+
+/// <summary>
+///		Format string, empty destination and -1 if result does not fit
+/// </summary>
+///
+/// <returns>Characters written or -1</returns>
+int vsprintf_s(char* lpsDestination, size_t cchDestination, const char* lpsFormat, va_list vlArguments)
+{
+	int cchWritten = vsnprintf(lpsDestination, cchDestination, lpsFormat, vlArguments);
+	if ((cchWritten < 0) || ((size_t)cchWritten >= cchDestination))
+	{
+		if (cchDestination != 0)
+		{
+			lpsDestination[0] = '\0';
+		}
+
+		return -1;
+	}
+
+	return cchWritten;
+}
+
+/// <summary>
+///		Format string, empty destination and -1 if result does not fit
+/// </summary>
+///
+/// <returns>Characters written or -1</returns>
+int sprintf_s(char* lpsDestination, size_t cchDestination, const char* lpsFormat, ...)
+{
+	va_list vlArguments;
+	va_start(vlArguments, lpsFormat);
+	int cchWritten = vsprintf_s(lpsDestination, cchDestination, lpsFormat, vlArguments);
+	va_end(vlArguments);
+
+	return cchWritten;
+}
+
+/// <summary>
+///		Format string, with _TRUNCATE result is cut to destination and -1 is returned
+/// </summary>
+///
+/// <returns>Characters written or -1</returns>
+int _snprintf_s(char* lpsDestination, size_t cchDestination, size_t cchCount, const char* lpsFormat, ...)
+{
+	if (cchDestination == 0)
+	{
+		return -1;
+	}
+
+	size_t cchLimit = (cchCount == _TRUNCATE) ? cchDestination : ((cchCount + 1 < cchDestination) ? cchCount + 1 : cchDestination);
+
+	va_list vlArguments;
+	va_start(vlArguments, lpsFormat);
+	int cchWritten = vsnprintf(lpsDestination, cchLimit, lpsFormat, vlArguments);
+	va_end(vlArguments);
+
+	if ((cchWritten < 0) || ((size_t)cchWritten >= cchLimit))
+	{
+		if (cchCount != _TRUNCATE)
+		{
+			lpsDestination[0] = '\0';
+		}
+
+		return -1;
+	}
+
+	return cchWritten;
+}
+
+/// <summary>
+///		Format wide string, empty destination and -1 if result does not fit
+/// </summary>
+///
+/// <returns>Characters written or -1</returns>
+int vswprintf_s(wchar_t* lpsDestination, size_t cchDestination, const wchar_t* lpsFormat, va_list vlArguments)
+{
+	int cchWritten = vswprintf(lpsDestination, cchDestination, lpsFormat, vlArguments);
+	if (cchWritten < 0)
+	{
+		if (cchDestination != 0)
+		{
+			lpsDestination[0] = L'\0';
+		}
+
+		return -1;
+	}
+
+	return cchWritten;
+}
+
+/// <summary>
+///		Count characters of formatted string
+/// </summary>
+///
+/// <returns>Characters count or -1</returns>
+int _vscprintf(const char* lpsFormat, va_list vlArguments)
+{
+	va_list vlCopy;
+	va_copy(vlCopy, vlArguments);
+	int cchFormatted = vsnprintf(NULL, 0, lpsFormat, vlCopy);
+	va_end(vlCopy);
+
+	return cchFormatted;
+}
+
+/// <summary>
+///		Count characters of formatted wide string, vswprintf cannot measure without buffer
+///		so formatting is repeated with growing buffer
+/// </summary>
+///
+/// <returns>Characters count or -1</returns>
+int _vscwprintf(const wchar_t* lpsFormat, va_list vlArguments)
+{
+	int cchFormatted = -1;
+	size_t cchBuffer = PLATFORM_PRINTF_INITIAL_LENGTH;
+
+	while (cchBuffer <= 0x10000000)
+	{
+		wchar_t* lpsBuffer = (wchar_t*)malloc(cchBuffer * sizeof(wchar_t));
+		if (lpsBuffer == NULL)
+		{
+			return -1;
+		}
+
+		va_list vlCopy;
+		va_copy(vlCopy, vlArguments);
+		cchFormatted = vswprintf(lpsBuffer, cchBuffer, lpsFormat, vlCopy);
+		va_end(vlCopy);
+		free(lpsBuffer);
+
+		if (cchFormatted >= 0)
+		{
+			break;
+		}
+
+		cchBuffer *= 2;
+	}
+
+	return cchFormatted;
+}
+
+/// <summary>
+///		Open file
+/// </summary>
+///
+/// <returns>0 or errno</returns>
+int fopen_s(FILE** lplpFile, const char* lpsFileName, const char* lpsMode)
+{
+	*lplpFile = fopen(lpsFileName, lpsMode);
+	return (*lplpFile == NULL) ? errno : 0;
+}
+
+/// <summary>
+///		Open file with wide name and mode
+/// </summary>
+///
+/// <returns>0 or errno</returns>
+int _wfopen_s(FILE** lplpFile, const wchar_t* lpsFileName, const wchar_t* lpsMode)
+{
+	char lpsNarrowName[MAX_PATH * 4], lpsNarrowMode[16];
+	if (!NarrowFileName(lpsFileName, lpsNarrowName, sizeof(lpsNarrowName)) || !NarrowFileName(lpsMode, lpsNarrowMode, sizeof(lpsNarrowMode)))
+	{
+		*lplpFile = NULL;
+		return EINVAL;
+	}
+
+	return fopen_s(lplpFile, lpsNarrowName, lpsNarrowMode);
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegOpenKeyEx(HKEY hKey, LPCWSTR lpSubKey, DWORD dwOptions, REGSAM samDesired, PHKEY phkResult)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegCreateKeyEx(HKEY hKey, LPCWSTR lpSubKey, DWORD dwReserved, LPWSTR lpClass, DWORD dwOptions, REGSAM samDesired, LPSECURITY_ATTRIBUTES lpAttributes, PHKEY phkResult, LPDWORD lpdwDisposition)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry, so no key can be open
+/// </summary>
+///
+/// <returns>ERROR_INVALID_HANDLE</returns>
+LSTATUS RegCloseKey(HKEY hKey)
+{
+	return ERROR_INVALID_HANDLE;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegEnumKeyEx(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, LPDWORD lpReserved, LPWSTR lpClass, LPDWORD lpcchClass, PFILETIME lpftLastWriteTime)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegEnumValue(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpReserved, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegQueryInfoKey(HKEY hKey, LPWSTR lpClass, LPDWORD lpcchClass, LPDWORD lpReserved, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcMaxClassLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, LPDWORD lpcbSecurityDescriptor, PFILETIME lpftLastWriteTime)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegQueryValueEx(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpReserved, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegSetKeyValue(HKEY hKey, LPCWSTR lpSubKey, LPCWSTR lpValueName, DWORD dwType, LPCVOID lpData, DWORD cbData)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		There is no registry
+/// </summary>
+///
+/// <returns>ERROR_NOT_SUPPORTED</returns>
+LSTATUS RegNotifyChangeKeyValue(HKEY hKey, BOOL bWatchSubtree, DWORD dwNotifyFilter, HANDLE hEvent, BOOL bAsynchronous)
+{
+	return ERROR_NOT_SUPPORTED;
+}
+
+/// <summary>
+///		Pipes are only used to read output of reg.exe, which does not exist here
+/// </summary>
+///
+/// <returns>FALSE</returns>
+BOOL CreatePipe(HANDLE* lphReadPipe, HANDLE* lphWritePipe, LPSECURITY_ATTRIBUTES lpAttributes, DWORD cbSize)
+{
+	return FALSE;
+}
+
+/// <summary>
+///		Handles are never inherited, child processes are not supported
+/// </summary>
+///
+/// <returns>FALSE</returns>
+BOOL SetHandleInformation(HANDLE hObject, DWORD dwMask, DWORD dwFlags)
+{
+	return FALSE;
+}
+
+/// <summary>
+///		There is no reg.exe to run
+/// </summary>
+///
+/// <returns>FALSE</returns>
+BOOL CreateProcess(LPCWSTR lpsApplicationName, LPWSTR lpsCommandLine, LPSECURITY_ATTRIBUTES lpProcessAttributes, LPSECURITY_ATTRIBUTES lpThreadAttributes, BOOL bInheritHandles, DWORD dwCreationFlags, LPVOID lpEnvironment, LPCWSTR lpsCurrentDirectory, STARTUPINFO* lpStartupInfo, PROCESS_INFORMATION* lpProcessInformation)
+{
+	return FALSE;
+}
+
+#endif
@@ -0,0 +1,683 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/Progress.h"
+#include "../Api/RegistryEditor.h"
+
+// Weight of newest interval in keys per second
+const double PROGRESS_RATE_SMOOTHING = 0.3;
+// Share of estimate that completed branches must outweigh before they correct it
+const double PROGRESS_CORRECTION_PRIOR = 0.1;
+// Percent shown while walk is not finished
+const double PROGRESS_MAX_RUNNING_PERCENT = 99.9;
+
+typedef struct _PROGRESSSNAPSHOT {
+	ULONGLONG ullVisitedKeys;
+	ULONGLONG ullEstimatedKeys;
+	double dPercent;
+	double dKeysPerSecond;
+	double dEtaSeconds;
+	double dElapsedSeconds;
+	bool bEstimated;
+	bool bDone;
+} PROGRESSSNAPSHOT;
+
+static volatile bool g_bProgressEnabled = false;
+static PROGRESSPARAMS g_ppProgress;
+static HANDLE g_hReporterThread = NULL;
+static HANDLE g_hStopReporterEvent = NULL;
+static HANDLE g_hWalkStartedEvent = NULL;
+static ULONGLONG g_ullProgressStartTime = 0;
+
+// 0 - walk not started, 1 - estimating, 2 - estimate is ready
+static volatile LONG g_lWalkState = 0;
+static PROGRESSESTIMATE g_peWalk;
+// Handle of walk root opened for reporter, which estimates while walk goes on
+static HKEY g_hEstimatedKey = NULL;
+
+// Counters written by walking threads and read by reporter
+static volatile LONG64 g_llVisitedKeys = 0;
+static volatile LONG64 g_llCompletedKeys = 0;
+// Top-level branches walked to the end, their estimates are summed once estimate is ready
+static volatile LONG* volatile g_lpbCompletedBranches = NULL;
+static DWORD g_dwBranchSlotsCount = 0;
+
+// Keys are published in batches, branch size is counted by thread that walks it
+static thread_local DWORD t_dwPendingKeys = 0;
+static thread_local ULONGLONG t_ullThreadKeys = 0;
+static thread_local ULONGLONG t_ullBranchStart = 0;
+static thread_local DWORD t_dwBranchIndex = 0;
+static thread_local bool t_bInBranch = false;
+
+/// <summary>
+///		Get default settings: report to stderr every second
+/// </summary>
+///
+/// <param name="lpParams">Settings</param>
+///
+/// <returns>void</returns>
+void GetDefaultProgressParams(PROGRESSPARAMS* lpParams)
+{
+	ZeroMemory(lpParams, sizeof(PROGRESSPARAMS));
+	lpParams->dwInterval = PROGRESS_DEFAULT_INTERVAL;
+	lpParams->dwSamplesCount = PROGRESS_DEFAULT_SAMPLES_COUNT;
+	lpParams->lpOutput = stderr;
+}
+
+/// <summary>
+///		Next pseudo random number (xorshift), fixed seed makes replayed walks ask for same keys
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+static ULONGLONG NextSampleRandom(ULONGLONG* lpullState)
+{
+	*lpullState ^= *lpullState << 13;
+	*lpullState ^= *lpullState >> 7;
+	*lpullState ^= *lpullState << 17;
+
+	return *lpullState;
+}
+
+/// <summary>
+///		Estimate descendants count by one random descent (Knuth estimator):
+///		every level adds product of subkey counts on the way down
+/// </summary>
+///
+/// <param name="hKey">Opened key</param>
+/// <param name="lpsName">Name buffer of MAX_KEY_NAME_LENGTH characters</param>
+/// <param name="lpullRandom">Random state</param>
+///
+/// <returns>double</returns>
+static double SampleDescendants(HKEY hKey, LPWSTR lpsName, ULONGLONG* lpullRandom)
+{
+	double dWeight = 1.0;
+	double dKeys = 0.0;
+	HKEY hCurrent = hKey;
+
+	for (DWORD dwDepth = 0; dwDepth < PROGRESS_MAX_SAMPLE_DEPTH; dwDepth++)
+	{
+		DWORD dwSubKeysCount;
+		if (!QueryRegKeyInfo(hCurrent, &dwSubKeysCount, NULL, NULL, NULL) || (dwSubKeysCount == 0))
+		{
+			break;
+		}
+
+		dWeight *= dwSubKeysCount;
+		dKeys += dWeight;
+
+		HKEY hNext;
+		DWORD dwNameSize = MAX_KEY_NAME_LENGTH;
+		if ((EnumRegKey(hCurrent, (DWORD)(NextSampleRandom(lpullRandom) % dwSubKeysCount), lpsName, &dwNameSize, NULL) != ERROR_SUCCESS) ||
+			!OpenRegKey(hCurrent, lpsName, KEY_READ, &hNext))
+		{
+			break;
+		}
+
+		if (hCurrent != hKey)
+		{
+			CloseRegKey(hCurrent);
+		}
+		hCurrent = hNext;
+	}
+
+	if (hCurrent != hKey)
+	{
+		CloseRegKey(hCurrent);
+	}
+
+	return dKeys;
+}
+
+/// <summary>
+///		Estimate keys count of subtree: first two levels are counted exactly,
+///		deeper levels of every top-level branch are sampled by random descents
+/// </summary>
+///
+/// <param name="hKey">Opened subtree root</param>
+/// <param name="dwSamplesCount">Descents shared by branches in proportion to their subkeys</param>
+/// <param name="lpEstimate">Estimate, release with FreeProgressEstimate</param>
+///
+/// <returns>bool</returns>
+bool EstimateWalkSize(HKEY hKey, DWORD dwSamplesCount, PROGRESSESTIMATE* lpEstimate)
+{
+	ZeroMemory(lpEstimate, sizeof(PROGRESSESTIMATE));
+
+	DWORD dwRootKeysCount;
+	if (!QueryRegKeyInfo(hKey, &dwRootKeysCount, NULL, NULL, NULL))
+	{
+		return false;
+	}
+
+	lpEstimate->ullRootKeysCount = dwRootKeysCount;
+	lpEstimate->lpdBranchKeys = (double*)calloc(dwRootKeysCount + 1, sizeof(double));
+	DWORD* lpdwBranchSubKeys = (DWORD*)calloc(dwRootKeysCount + 1, sizeof(DWORD));
+	LPWSTR lpsName = (LPWSTR)calloc(MAX_KEY_NAME_LENGTH, sizeof(WCHAR));
+
+	if ((lpEstimate->lpdBranchKeys == NULL) || (lpdwBranchSubKeys == NULL) || (lpsName == NULL))
+	{
+		free(lpdwBranchSubKeys);
+		free(lpsName);
+		FreeProgressEstimate(lpEstimate);
+		return false;
+	}
+
+	// Second level is counted exactly, its size tells how many descents each branch gets
+	ULONGLONG ullSecondLevelCount = 0;
+	for (DWORD dwIndex = 0; dwIndex < dwRootKeysCount; dwIndex++)
+	{
+		HKEY hBranch;
+		DWORD dwNameSize = MAX_KEY_NAME_LENGTH;
+		if (EnumRegKey(hKey, dwIndex, lpsName, &dwNameSize, NULL) != ERROR_SUCCESS)
+		{
+			break;
+		}
+
+		lpEstimate->dwBranchesCount++;
+		if (OpenRegKey(hKey, lpsName, KEY_READ, &hBranch))
+		{
+			QueryRegKeyInfo(hBranch, &lpdwBranchSubKeys[dwIndex], NULL, NULL, NULL);
+			CloseRegKey(hBranch);
+		}
+
+		ullSecondLevelCount += lpdwBranchSubKeys[dwIndex];
+	}
+
+	ULONGLONG ullRandom = PROGRESS_SAMPLE_SEED;
+	for (DWORD dwIndex = 0; dwIndex < lpEstimate->dwBranchesCount; dwIndex++)
+	{
+		if (lpdwBranchSubKeys[dwIndex] == 0)
+		{
+			continue;
+		}
+
+		HKEY hBranch;
+		DWORD dwNameSize = MAX_KEY_NAME_LENGTH;
+		if ((EnumRegKey(hKey, dwIndex, lpsName, &dwNameSize, NULL) != ERROR_SUCCESS) || !OpenRegKey(hKey, lpsName, KEY_READ, &hBranch))
+		{
+			lpEstimate->lpdBranchKeys[dwIndex] = lpdwBranchSubKeys[dwIndex];
+			continue;
+		}
+
+		// Every branch with subkeys gets at least one descent
+		DWORD dwBranchSamples = (DWORD)((dwSamplesCount * (ULONGLONG)lpdwBranchSubKeys[dwIndex] + ullSecondLevelCount - 1) / ullSecondLevelCount);
+		if (dwBranchSamples == 0)
+		{
+			dwBranchSamples = 1;
+		}
+
+		double dKeys = 0.0;
+		for (DWORD dwSample = 0; dwSample < dwBranchSamples; dwSample++)
+		{
+			dKeys += SampleDescendants(hBranch, lpsName, &ullRandom);
+		}
+
+		CloseRegKey(hBranch);
+		lpEstimate->lpdBranchKeys[dwIndex] = dKeys / dwBranchSamples;
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < lpEstimate->dwBranchesCount; dwIndex++)
+	{
+		lpEstimate->dTotalBranchKeys += lpEstimate->lpdBranchKeys[dwIndex];
+	}
+
+	free(lpdwBranchSubKeys);
+	free(lpsName);
+
+	return true;
+}
+
+/// <summary>
+///		Refine walk size: completed branches replace their estimates by real counts
+///		and scale estimates of branches left by how far off the completed ones were
+/// </summary>
+///
+/// <param name="lpEstimate">Estimate made before walk</param>
+/// <param name="ullVisitedKeys">Keys visited so far</param>
+/// <param name="ullCompletedKeys">Keys below completed top-level branches</param>
+/// <param name="dCompletedEstimate">Estimate of keys below completed top-level branches</param>
+///
+/// <returns>ULONGLONG</returns>
+ULONGLONG RefineWalkSize(const PROGRESSESTIMATE* lpEstimate, ULONGLONG ullVisitedKeys, ULONGLONG ullCompletedKeys, double dCompletedEstimate)
+{
+	double dPrior = lpEstimate->dTotalBranchKeys * PROGRESS_CORRECTION_PRIOR + 1.0;
+	double dCorrection = (ullCompletedKeys + dPrior) / (dCompletedEstimate + dPrior);
+
+	double dRemaining = (lpEstimate->dTotalBranchKeys - dCompletedEstimate) * dCorrection;
+	if (dRemaining < 0.0)
+	{
+		dRemaining = 0.0;
+	}
+
+	// Branches being walked may already be larger than their estimates
+	double dInFlight = (double)ullVisitedKeys - (double)lpEstimate->ullRootKeysCount - (double)ullCompletedKeys;
+	if (dInFlight > dRemaining)
+	{
+		dRemaining = dInFlight;
+	}
+
+	ULONGLONG ullTotal = lpEstimate->ullRootKeysCount + ullCompletedKeys + (ULONGLONG)(dRemaining + 0.5);
+
+	return (ullTotal < ullVisitedKeys) ? ullVisitedKeys : ullTotal;
+}
+
+/// <summary>
+///		Release estimate
+/// </summary>
+///
+/// <param name="lpEstimate">Estimate</param>
+///
+/// <returns>void</returns>
+void FreeProgressEstimate(PROGRESSESTIMATE* lpEstimate)
+{
+	free(lpEstimate->lpdBranchKeys);
+	ZeroMemory(lpEstimate, sizeof(PROGRESSESTIMATE));
+}
+
+/// <summary>
+///		Turn counters into percent, rate and remaining time
+/// </summary>
+///
+/// <param name="dKeysPerSecond">Smoothed rate</param>
+/// <param name="bDone">Walk is finished, visited keys are total</param>
+/// <param name="lpSnapshot">Result</param>
+///
+/// <returns>void</returns>
+static void TakeProgressSnapshot(double dKeysPerSecond, bool bDone, PROGRESSSNAPSHOT* lpSnapshot)
+{
+	ZeroMemory(lpSnapshot, sizeof(PROGRESSSNAPSHOT));
+	lpSnapshot->ullVisitedKeys = (ULONGLONG)g_llVisitedKeys;
+	lpSnapshot->dKeysPerSecond = dKeysPerSecond;
+	lpSnapshot->dElapsedSeconds = (GetTickCount64() - g_ullProgressStartTime) / 1000.0;
+	lpSnapshot->dEtaSeconds = -1.0;
+	lpSnapshot->bDone = bDone;
+	lpSnapshot->bEstimated = g_lWalkState == 2;
+
+	if (!lpSnapshot->bEstimated)
+	{
+		return;
+	}
+
+	double dCompletedEstimate = 0.0;
+	for (DWORD dwIndex = 0; (g_lpbCompletedBranches != NULL) && (dwIndex < g_dwBranchSlotsCount) && (dwIndex < g_peWalk.dwBranchesCount); dwIndex++)
+	{
+		dCompletedEstimate += g_lpbCompletedBranches[dwIndex] ? g_peWalk.lpdBranchKeys[dwIndex] : 0.0;
+	}
+
+	lpSnapshot->ullEstimatedKeys = RefineWalkSize(&g_peWalk, lpSnapshot->ullVisitedKeys, (ULONGLONG)g_llCompletedKeys, dCompletedEstimate);
+	lpSnapshot->dPercent = (lpSnapshot->ullEstimatedKeys == 0) ? 0.0 : 100.0 * lpSnapshot->ullVisitedKeys / lpSnapshot->ullEstimatedKeys;
+
+	if (bDone)
+	{
+		lpSnapshot->dPercent = 100.0;
+		lpSnapshot->dEtaSeconds = 0.0;
+		return;
+	}
+
+	if (lpSnapshot->dPercent > PROGRESS_MAX_RUNNING_PERCENT)
+	{
+		lpSnapshot->dPercent = PROGRESS_MAX_RUNNING_PERCENT;
+	}
+
+	if (dKeysPerSecond > 0.0)
+	{
+		lpSnapshot->dEtaSeconds = (lpSnapshot->ullEstimatedKeys - lpSnapshot->ullVisitedKeys) / dKeysPerSecond;
+	}
+}
+
+/// <summary>
+///		Replace status file by current progress, readers never see half written file
+/// </summary>
+///
+/// <param name="lpSnapshot">Progress</param>
+///
+/// <returns>void</returns>
+static void WriteProgressStatus(const PROGRESSSNAPSHOT* lpSnapshot)
+{
+	CHAR lpsTempFileName[MAX_PATH];
+	if (sprintf_s(lpsTempFileName, MAX_PATH, "%s.tmp", g_ppProgress.lpsStatusFileName) < 0)
+	{
+		return;
+	}
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsTempFileName, "w") != 0)
+	{
+		return;
+	}
+
+	fprintf(lpFile, "{\"keys\":%llu,\"estimated_keys\":%llu,\"percent\":%.1f,\"keys_per_second\":%.0f,\"eta_seconds\":%.1f,\"elapsed_seconds\":%.1f,\"done\":%s}\n",
+		lpSnapshot->ullVisitedKeys,
+		lpSnapshot->ullEstimatedKeys,
+		lpSnapshot->dPercent,
+		lpSnapshot->dKeysPerSecond,
+		lpSnapshot->dEtaSeconds,
+		lpSnapshot->dElapsedSeconds,
+		lpSnapshot->bDone ? "true" : "false");
+
+	if (fclose(lpFile) == 0)
+	{
+		MoveFileExA(lpsTempFileName, g_ppProgress.lpsStatusFileName, MOVEFILE_REPLACE_EXISTING);
+	}
+}
+
+/// <summary>
+///		Print progress line and update status file
+/// </summary>
+///
+/// <param name="lpSnapshot">Progress</param>
+///
+/// <returns>void</returns>
+static void ReportProgressSnapshot(const PROGRESSSNAPSHOT* lpSnapshot)
+{
+	if (g_ppProgress.lpsStatusFileName != NULL)
+	{
+		WriteProgressStatus(lpSnapshot);
+	}
+
+	if (g_ppProgress.lpOutput == NULL)
+	{
+		return;
+	}
+
+	if (lpSnapshot->bDone)
+	{
+		fprintf(g_ppProgress.lpOutput, "Progress: done, %llu keys in %.1f s (%.0f keys/s)",
+			lpSnapshot->ullVisitedKeys,
+			lpSnapshot->dElapsedSeconds,
+			(lpSnapshot->dElapsedSeconds > 0.0) ? lpSnapshot->ullVisitedKeys / lpSnapshot->dElapsedSeconds : 0.0);
+
+		if (lpSnapshot->bEstimated)
+		{
+			fprintf(g_ppProgress.lpOutput, ", first estimate %.0f keys", g_peWalk.ullRootKeysCount + g_peWalk.dTotalBranchKeys);
+		}
+
+		fprintf(g_ppProgress.lpOutput, "\n");
+	}
+	else if (!lpSnapshot->bEstimated)
+	{
+		fprintf(g_ppProgress.lpOutput, "Progress: %llu keys, %.0f keys/s\n", lpSnapshot->ullVisitedKeys, lpSnapshot->dKeysPerSecond);
+	}
+	else if (lpSnapshot->dEtaSeconds < 0.0)
+	{
+		fprintf(g_ppProgress.lpOutput, "Progress: %.1f%%, %llu of ~%llu keys, %.0f keys/s\n",
+			lpSnapshot->dPercent, lpSnapshot->ullVisitedKeys, lpSnapshot->ullEstimatedKeys, lpSnapshot->dKeysPerSecond);
+	}
+	else
+	{
+		ULONGLONG ullEta = (ULONGLONG)(lpSnapshot->dEtaSeconds + 0.5);
+		fprintf(g_ppProgress.lpOutput, "Progress: %.1f%%, %llu of ~%llu keys, %.0f keys/s, ETA %llu:%02llu:%02llu\n",
+			lpSnapshot->dPercent, lpSnapshot->ullVisitedKeys, lpSnapshot->ullEstimatedKeys, lpSnapshot->dKeysPerSecond,
+			ullEta / 3600, ullEta / 60 % 60, ullEta % 60);
+	}
+
+	fflush(g_ppProgress.lpOutput);
+}
+
+/// <summary>
+///		Estimate walk started by BeginProgressWalk, runs on reporter thread
+/// </summary>
+///
+/// <returns>void</returns>
+static void EstimateStartedWalk()
+{
+	if (EstimateWalkSize(g_hEstimatedKey, g_ppProgress.dwSamplesCount, &g_peWalk))
+	{
+		InterlockedExchange(&g_lWalkState, 2);
+	}
+
+	CloseRegKey(g_hEstimatedKey);
+	g_hEstimatedKey = NULL;
+}
+
+/// <summary>
+///		Reporter thread: estimates walk size and reads counters once per interval, walking threads never wait for it
+/// </summary>
+///
+/// <param name="lpParameter">Not used</param>
+///
+/// <returns>DWORD</returns>
+static DWORD WINAPI ReportProgress(LPVOID lpParameter)
+{
+	ULONGLONG ullLastTime = GetTickCount64();
+	ULONGLONG ullLastKeys = 0;
+	double dKeysPerSecond = 0.0;
+
+	HANDLE hEvents[] = { g_hStopReporterEvent, g_hWalkStartedEvent };
+
+	for (;;)
+	{
+		DWORD dwWaitResult = WaitForMultipleObjects(2, hEvents, FALSE, g_ppProgress.dwInterval);
+		if (dwWaitResult == WAIT_OBJECT_0 + 1)
+		{
+			EstimateStartedWalk();
+			continue;
+		}
+		if (dwWaitResult != WAIT_TIMEOUT)
+		{
+			break;
+		}
+
+		ULONGLONG ullTime = GetTickCount64();
+		ULONGLONG ullKeys = (ULONGLONG)g_llVisitedKeys;
+
+		// Nothing to report before walk starts
+		if ((ullKeys == 0) && (g_lWalkState == 0))
+		{
+			ullLastTime = ullTime;
+			continue;
+		}
+
+		if (ullTime > ullLastTime)
+		{
+			double dIntervalRate = (ullKeys - ullLastKeys) * 1000.0 / (ullTime - ullLastTime);
+			dKeysPerSecond = (ullLastKeys == 0) ? dIntervalRate : PROGRESS_RATE_SMOOTHING * dIntervalRate + (1.0 - PROGRESS_RATE_SMOOTHING) * dKeysPerSecond;
+		}
+
+		ullLastTime = ullTime;
+		ullLastKeys = ullKeys;
+
+		PROGRESSSNAPSHOT psSnapshot;
+		TakeProgressSnapshot(dKeysPerSecond, false, &psSnapshot);
+		ReportProgressSnapshot(&psSnapshot);
+	}
+
+	return 0;
+}
+
+/// <summary>
+///		Start reporting progress of traversals
+/// </summary>
+///
+/// <param name="lpParams">Settings</param>
+///
+/// <returns>bool</returns>
+bool EnableProgress(const PROGRESSPARAMS* lpParams)
+{
+	if ((lpParams == NULL) || (lpParams->dwInterval == 0) || g_bProgressEnabled ||
+		((lpParams->lpOutput == NULL) && (lpParams->lpsStatusFileName == NULL)))
+	{
+		return false;
+	}
+
+	g_ppProgress = *lpParams;
+	g_ullProgressStartTime = GetTickCount64();
+	g_lWalkState = 0;
+	g_llVisitedKeys = 0;
+	g_llCompletedKeys = 0;
+
+	g_hStopReporterEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_hWalkStartedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	g_bProgressEnabled = (g_hStopReporterEvent != NULL) && (g_hWalkStartedEvent != NULL);
+	g_hReporterThread = g_bProgressEnabled ? CreateThread(NULL, 0, ReportProgress, NULL, 0, NULL) : NULL;
+	if (g_hReporterThread == NULL)
+	{
+		g_bProgressEnabled = false;
+		if (g_hStopReporterEvent != NULL)
+		{
+			CloseHandle(g_hStopReporterEvent);
+		}
+		if (g_hWalkStartedEvent != NULL)
+		{
+			CloseHandle(g_hWalkStartedEvent);
+		}
+		g_hStopReporterEvent = NULL;
+		g_hWalkStartedEvent = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Stop reporter and print final counts, called by thread that ran command
+/// </summary>
+///
+/// <returns>void</returns>
+void DisableProgress()
+{
+	if (!g_bProgressEnabled)
+	{
+		return;
+	}
+
+	FlushProgress();
+	t_bInBranch = false;
+	g_bProgressEnabled = false;
+
+	SetEvent(g_hStopReporterEvent);
+	WaitForSingleObject(g_hReporterThread, INFINITE);
+	CloseHandle(g_hReporterThread);
+	CloseHandle(g_hStopReporterEvent);
+	CloseHandle(g_hWalkStartedEvent);
+	g_hReporterThread = NULL;
+	g_hStopReporterEvent = NULL;
+	g_hWalkStartedEvent = NULL;
+
+	// Walk ended before reporter got to its estimate
+	if (g_hEstimatedKey != NULL)
+	{
+		CloseRegKey(g_hEstimatedKey);
+		g_hEstimatedKey = NULL;
+	}
+
+	PROGRESSSNAPSHOT psSnapshot;
+	TakeProgressSnapshot(0.0, true, &psSnapshot);
+	ReportProgressSnapshot(&psSnapshot);
+
+	FreeProgressEstimate(&g_peWalk);
+	free((void*)g_lpbCompletedBranches);
+	g_lpbCompletedBranches = NULL;
+	g_dwBranchSlotsCount = 0;
+	g_lWalkState = 0;
+}
+
+/// <summary>
+///		Hand walk over to reporter for estimate, only first walk of command is estimated.
+///		Reporter gets its own handle, so walk starts at once and caller may close hKey before estimate is done.
+/// </summary>
+///
+/// <param name="hKey">Opened root of walk</param>
+///
+/// <returns>void</returns>
+void BeginProgressWalk(HKEY hKey)
+{
+	if (!g_bProgressEnabled || (InterlockedCompareExchange(&g_lWalkState, 1, 0) != 0))
+	{
+		return;
+	}
+
+	DWORD dwRootKeysCount;
+	if (QueryRegKeyInfo(hKey, &dwRootKeysCount, NULL, NULL, NULL))
+	{
+		LONG* lpbCompletedBranches = (LONG*)calloc(dwRootKeysCount + 1, sizeof(LONG));
+		g_dwBranchSlotsCount = (lpbCompletedBranches == NULL) ? 0 : dwRootKeysCount;
+		g_lpbCompletedBranches = lpbCompletedBranches;
+	}
+
+	if (OpenRegKey(hKey, L"", KEY_READ, &g_hEstimatedKey))
+	{
+		SetEvent(g_hWalkStartedEvent);
+	}
+}
+
+/// <summary>
+///		Mark start of walk below top-level key, called by thread that walks it
+/// </summary>
+///
+/// <param name="dwBranchIndex">Index of top-level key</param>
+///
+/// <returns>void</returns>
+void BeginProgressBranch(DWORD dwBranchIndex)
+{
+	if (!g_bProgressEnabled || (g_lWalkState == 0))
+	{
+		return;
+	}
+
+	t_bInBranch = true;
+	t_dwBranchIndex = dwBranchIndex;
+	t_ullBranchStart = t_ullThreadKeys;
+}
+
+/// <summary>
+///		Mark end of walk below top-level key, its real size replaces its estimate
+/// </summary>
+///
+/// <returns>void</returns>
+void EndProgressBranch()
+{
+	FlushProgress();
+
+	if (!t_bInBranch)
+	{
+		return;
+	}
+
+	t_bInBranch = false;
+
+	if ((g_lpbCompletedBranches != NULL) && (t_dwBranchIndex < g_dwBranchSlotsCount))
+	{
+		InterlockedExchange(&g_lpbCompletedBranches[t_dwBranchIndex], TRUE);
+	}
+	InterlockedExchangeAdd64(&g_llCompletedKeys, (LONG64)(t_ullThreadKeys - t_ullBranchStart));
+}
+
+/// <summary>
+///		Publish keys counted by calling thread, walker threads call it before they exit
+/// </summary>
+///
+/// <returns>void</returns>
+void FlushProgress()
+{
+	if (t_dwPendingKeys != 0)
+	{
+		InterlockedExchangeAdd64(&g_llVisitedKeys, t_dwPendingKeys);
+		t_dwPendingKeys = 0;
+	}
+}
+
+/// <summary>
+///		Count visited keys, reporter sees them once per batch
+/// </summary>
+///
+/// <param name="dwKeysCount">Keys visited</param>
+///
+/// <returns>void</returns>
+void AdvanceProgress(DWORD dwKeysCount)
+{
+	if (!g_bProgressEnabled)
+	{
+		return;
+	}
+
+	t_ullThreadKeys += dwKeysCount;
+	t_dwPendingKeys += dwKeysCount;
+
+	if (t_dwPendingKeys >= PROGRESS_BATCH_SIZE)
+	{
+		InterlockedExchangeAdd64(&g_llVisitedKeys, t_dwPendingKeys);
+		t_dwPendingKeys = 0;
+	}
+}
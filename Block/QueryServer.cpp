@@ -0,0 +1,413 @@
+#include "../Api/Platform.h"
+
+#include "../Api/QueryServer.h"
+#include "../Api/Transcode.h"
+
+// Every message is DWORD payload size followed by payload.
+// Request payload is arguments, each terminated by '\0', starting with command name.
+// Response is two messages: captured output and result string with '\0' (empty if command is unknown).
+// Request with more than QUERY_MAX_ARGUMENTS arguments is not run, its result is QUERY_TOO_MANY_ARGUMENTS.
+
+/// <summary>
+///		Build \\.\pipe\<name>
+/// </summary>
+/// 
+/// <param name="lpsName">Pipe name</param>
+/// <param name="lpsPipeName">Full pipe name</param>
+/// 
+/// <returns>bool</returns>
+static bool GetQueryPipeName(LPCSTR lpsName, LPWSTR lpsPipeName)
+{
+	const WCHAR PIPE_PREFIX[] = L"\\\\.\\pipe\\";
+	const DWORD dwPrefixLength = sizeof(PIPE_PREFIX) / sizeof(WCHAR) - 1;
+
+	wcscpy_s(lpsPipeName, MAX_PATH, PIPE_PREFIX);
+
+	DWORD cchName = Utf8ToUtf16(lpsName, (DWORD)strlen(lpsName), lpsPipeName + dwPrefixLength, MAX_PATH - dwPrefixLength - 1);
+	if (cchName == TRANSCODE_ERROR)
+	{
+		return false;
+	}
+
+	lpsPipeName[dwPrefixLength + cchName] = L'\0';
+	return true;
+}
+
+/// <summary>
+///		Read exactly requested bytes count
+/// </summary>
+/// 
+/// <param name="hPipe">Pipe</param>
+/// <param name="lpBuffer">Buffer</param>
+/// <param name="cbBuffer">Bytes count</param>
+/// 
+/// <returns>bool</returns>
+static bool ReadPipe(HANDLE hPipe, LPVOID lpBuffer, DWORD cbBuffer)
+{
+	DWORD cbRead;
+	for (DWORD cbTotal = 0; cbTotal < cbBuffer; cbTotal += cbRead)
+	{
+		if (!ReadFile(hPipe, (BYTE*)lpBuffer + cbTotal, cbBuffer - cbTotal, &cbRead, NULL) || (cbRead == 0))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Write size prefixed message
+/// </summary>
+/// 
+/// <param name="hPipe">Pipe</param>
+/// <param name="lpData">Payload</param>
+/// <param name="cbData">Payload size</param>
+/// 
+/// <returns>bool</returns>
+static bool WriteMessage(HANDLE hPipe, LPCVOID lpData, DWORD cbData)
+{
+	DWORD cbWritten;
+
+	return WriteFile(hPipe, &cbData, sizeof(DWORD), &cbWritten, NULL) && (cbWritten == sizeof(DWORD)) &&
+		((cbData == 0) || (WriteFile(hPipe, lpData, cbData, &cbWritten, NULL) && (cbWritten == cbData)));
+}
+
+/// <summary>
+///		Read size prefixed message, buffer is reused between messages
+/// </summary>
+/// 
+/// <param name="hPipe">Pipe</param>
+/// <param name="lpMessage">Message buffer</param>
+/// 
+/// <returns>bool</returns>
+static bool ReadMessage(HANDLE hPipe, OUTPUTBUFFER* lpMessage)
+{
+	DWORD cbData;
+	if (!ReadPipe(hPipe, &cbData, sizeof(DWORD)) || (cbData > QUERY_MAX_MESSAGE_SIZE))
+	{
+		return false;
+	}
+
+	if (cbData > lpMessage->cbCapacity)
+	{
+		LPSTR lpsNewData = (LPSTR)realloc(lpMessage->lpsData, cbData);
+		if (lpsNewData == NULL)
+		{
+			return false;
+		}
+
+		lpMessage->lpsData = lpsNewData;
+		lpMessage->cbCapacity = cbData;
+	}
+
+	lpMessage->cbSize = cbData;
+
+	return ReadPipe(hPipe, lpMessage->lpsData, cbData);
+}
+
+/// <summary>
+///		Serve requests of one client until it disconnects (thread pool callback)
+/// </summary>
+/// 
+/// <param name="lpInstance">Callback instance</param>
+/// <param name="lpContext">QUERYCONNECTION</param>
+/// 
+/// <returns>void</returns>
+static VOID CALLBACK ServeConnection(PTP_CALLBACK_INSTANCE lpInstance, PVOID lpContext)
+{
+	QUERYCONNECTION* lpConnection = (QUERYCONNECTION*)lpContext;
+	OUTPUTBUFFER obRequest = { 0 };
+	OUTPUTBUFFER obResponse = { 0 };
+
+	while (ReadMessage(lpConnection->hPipe, &obRequest))
+	{
+		// Arguments must be terminated, argv[0] is program name as in command line
+		if ((obRequest.cbSize == 0) || (obRequest.lpsData[obRequest.cbSize - 1] != '\0'))
+		{
+			break;
+		}
+
+		char* argv[QUERY_MAX_ARGUMENTS + 1];
+		char lpsProgramName[] = "RegistryEditor";
+		int argc = 1;
+
+		argv[0] = lpsProgramName;
+		for (DWORD dwOffset = 0; dwOffset < obRequest.cbSize; argc++)
+		{
+			LPSTR lpsArgument = obRequest.lpsData + dwOffset;
+			if (argc <= QUERY_MAX_ARGUMENTS)
+			{
+				argv[argc] = lpsArgument;
+			}
+			dwOffset += (DWORD)strlen(lpsArgument) + 1;
+		}
+
+		// Command is not run with part of its arguments
+		obResponse.cbSize = 0;
+		LPCSTR lpsResult = QUERY_TOO_MANY_ARGUMENTS;
+		if (argc <= QUERY_MAX_ARGUMENTS + 1)
+		{
+			SetThreadOutput(&obResponse);
+			lpsResult = lpConnection->lpfnProcess(argv, argc);
+			SetThreadOutput(NULL);
+		}
+
+		if (!WriteMessage(lpConnection->hPipe, obResponse.lpsData, obResponse.cbSize) ||
+			!WriteMessage(lpConnection->hPipe, lpsResult, (lpsResult == NULL) ? 0 : (DWORD)strlen(lpsResult) + 1))
+		{
+			break;
+		}
+	}
+
+	FlushFileBuffers(lpConnection->hPipe);
+	DisconnectNamedPipe(lpConnection->hPipe);
+	CloseHandle(lpConnection->hPipe);
+
+	FreeOutputBuffer(&obRequest);
+	FreeOutputBuffer(&obResponse);
+	free(lpConnection);
+}
+
+/// <summary>
+///		Create instance of named pipe
+/// </summary>
+/// 
+/// <param name="lpsPipeName">Full pipe name</param>
+/// 
+/// <returns>HANDLE (INVALID_HANDLE_VALUE on failure)</returns>
+static HANDLE CreateQueryPipe(LPCWSTR lpsPipeName)
+{
+	return CreateNamedPipe(lpsPipeName,
+		PIPE_ACCESS_DUPLEX,
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+		PIPE_UNLIMITED_INSTANCES,
+		QUERY_PIPE_BUFFER_SIZE,
+		QUERY_PIPE_BUFFER_SIZE,
+		0,
+		NULL);
+}
+
+/// <summary>
+///		Accept clients of named pipe and serve them from thread pool until stop is requested
+/// </summary>
+/// 
+/// <param name="lpsPipeName">Full pipe name</param>
+/// <param name="hPipe">Already created instance (INVALID_HANDLE_VALUE to create one)</param>
+/// <param name="lpfnProcess">Request processor</param>
+/// <param name="lpbStopping">Stop flag (may be NULL)</param>
+/// 
+/// <returns>bool (false if pipe can not be created)</returns>
+static bool AcceptQueryClients(LPCWSTR lpsPipeName, HANDLE hPipe, QUERYPROC lpfnProcess, volatile bool* lpbStopping)
+{
+	for (;;)
+	{
+		if (hPipe == INVALID_HANDLE_VALUE)
+		{
+			hPipe = CreateQueryPipe(lpsPipeName);
+		}
+
+		if (hPipe == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		if (!ConnectNamedPipe(hPipe, NULL) && (GetLastError() != ERROR_PIPE_CONNECTED))
+		{
+			CloseHandle(hPipe);
+			hPipe = INVALID_HANDLE_VALUE;
+			continue;
+		}
+
+		// StopQueryServer connects itself to wake the accepting thread up
+		if ((lpbStopping != NULL) && *lpbStopping)
+		{
+			DisconnectNamedPipe(hPipe);
+			CloseHandle(hPipe);
+			return true;
+		}
+
+		// Next instance is created right away, so clients are not refused while this one is served
+		QUERYCONNECTION* lpConnection = (QUERYCONNECTION*)calloc(1, sizeof(QUERYCONNECTION));
+		if (lpConnection != NULL)
+		{
+			lpConnection->hPipe = hPipe;
+			lpConnection->lpfnProcess = lpfnProcess;
+		}
+
+		if ((lpConnection == NULL) || !TrySubmitThreadpoolCallback(ServeConnection, lpConnection, NULL))
+		{
+			DisconnectNamedPipe(hPipe);
+			CloseHandle(hPipe);
+			free(lpConnection);
+		}
+
+		hPipe = INVALID_HANDLE_VALUE;
+	}
+}
+
+/// <summary>
+///		Accept clients of named pipe and serve them from thread pool, returns only on failure
+/// </summary>
+/// 
+/// <param name="lpsName">Pipe name (without \\.\pipe\)</param>
+/// <param name="lpfnProcess">Request processor</param>
+/// 
+/// <returns>bool</returns>
+bool RunQueryServer(LPCSTR lpsName, QUERYPROC lpfnProcess)
+{
+	WCHAR lpsPipeName[MAX_PATH];
+	if ((lpsName == NULL) || (lpfnProcess == NULL) || !GetQueryPipeName(lpsName, lpsPipeName))
+	{
+		return false;
+	}
+
+	return AcceptQueryClients(lpsPipeName, INVALID_HANDLE_VALUE, lpfnProcess, NULL);
+}
+
+/// <summary>
+///		Accepting thread of started server
+/// </summary>
+/// 
+/// <param name="lpParameter">QUERYSERVER</param>
+/// 
+/// <returns>DWORD</returns>
+static DWORD WINAPI RunStartedQueryServer(LPVOID lpParameter)
+{
+	QUERYSERVER* lpServer = (QUERYSERVER*)lpParameter;
+
+	return AcceptQueryClients(lpServer->lpsPipeName, lpServer->hFirstPipe, lpServer->lpfnProcess, &lpServer->bStopping) ? 0 : 1;
+}
+
+/// <summary>
+///		Start server on background thread, pipe exists when function returns so clients can connect right away
+/// </summary>
+/// 
+/// <param name="lpsName">Pipe name (without \\.\pipe\)</param>
+/// <param name="lpfnProcess">Request processor</param>
+/// <param name="lpServer">Started server (must stay valid until StopQueryServer)</param>
+/// 
+/// <returns>bool</returns>
+bool StartQueryServer(LPCSTR lpsName, QUERYPROC lpfnProcess, QUERYSERVER* lpServer)
+{
+	ZeroMemory(lpServer, sizeof(QUERYSERVER));
+	if ((lpsName == NULL) || (lpfnProcess == NULL) || !GetQueryPipeName(lpsName, lpServer->lpsPipeName))
+	{
+		return false;
+	}
+
+	lpServer->lpfnProcess = lpfnProcess;
+	lpServer->hFirstPipe = CreateQueryPipe(lpServer->lpsPipeName);
+	if (lpServer->hFirstPipe == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	lpServer->hThread = CreateThread(NULL, 0, RunStartedQueryServer, lpServer, 0, NULL);
+	if (lpServer->hThread == NULL)
+	{
+		CloseHandle(lpServer->hFirstPipe);
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Stop accepting clients and wait for accepting thread, connections being served finish on their own
+/// </summary>
+/// 
+/// <param name="lpServer">Started server</param>
+/// 
+/// <returns>void</returns>
+void StopQueryServer(QUERYSERVER* lpServer)
+{
+	if (lpServer->hThread == NULL)
+	{
+		return;
+	}
+
+	lpServer->bStopping = true;
+
+	// Accepting thread waits for client, so it is woken up by connecting to it
+	HANDLE hPipe = CreateFile(lpServer->lpsPipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	while ((hPipe == INVALID_HANDLE_VALUE) && (GetLastError() == ERROR_PIPE_BUSY) && WaitNamedPipe(lpServer->lpsPipeName, QUERY_CONNECT_TIMEOUT))
+	{
+		hPipe = CreateFile(lpServer->lpsPipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	}
+
+	if (hPipe != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hPipe);
+	}
+
+	WaitForSingleObject(lpServer->hThread, INFINITE);
+	CloseHandle(lpServer->hThread);
+	lpServer->hThread = NULL;
+}
+
+/// <summary>
+///		Send request to query server and wait for response
+/// </summary>
+/// 
+/// <param name="lpsName">Pipe name (without \\.\pipe\)</param>
+/// <param name="argv">Command name and its arguments</param>
+/// <param name="argc">Arguments count</param>
+/// <param name="lpOutput">Command output</param>
+/// <param name="lpsResult">Command result (empty if server did not recognize command)</param>
+/// <param name="cchResult">Result buffer length</param>
+/// 
+/// <returns>bool</returns>
+bool SendQuery(LPCSTR lpsName, char** argv, int argc, OUTPUTBUFFER* lpOutput, LPSTR lpsResult, DWORD cchResult)
+{
+	WCHAR lpsPipeName[MAX_PATH];
+	if ((lpsName == NULL) || (argc < 1) || (argc > (int)QUERY_MAX_ARGUMENTS) || !GetQueryPipeName(lpsName, lpsPipeName))
+	{
+		return false;
+	}
+
+	// All instances may be busy with other clients
+	HANDLE hPipe;
+	for (;;)
+	{
+		hPipe = CreateFile(lpsPipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+		if (hPipe != INVALID_HANDLE_VALUE)
+		{
+			break;
+		}
+
+		if ((GetLastError() != ERROR_PIPE_BUSY) || !WaitNamedPipe(lpsPipeName, QUERY_CONNECT_TIMEOUT))
+		{
+			return false;
+		}
+	}
+
+	OUTPUTBUFFER obRequest = { 0 };
+	OUTPUTBUFFER obResult = { 0 };
+	bool bResult = true;
+
+	for (int iIndex = 0; (iIndex < argc) && bResult; iIndex++)
+	{
+		bResult = AppendOutput(&obRequest, argv[iIndex], (DWORD)strlen(argv[iIndex]) + 1);
+	}
+
+	bResult = bResult &&
+		WriteMessage(hPipe, obRequest.lpsData, obRequest.cbSize) &&
+		ReadMessage(hPipe, lpOutput) &&
+		ReadMessage(hPipe, &obResult);
+
+	if (bResult)
+	{
+		lpsResult[0] = '\0';
+		if ((obResult.cbSize != 0) && (obResult.lpsData[obResult.cbSize - 1] == '\0'))
+		{
+			strncpy_s(lpsResult, cchResult, obResult.lpsData, _TRUNCATE);
+		}
+	}
+
+	FreeOutputBuffer(&obRequest);
+	FreeOutputBuffer(&obResult);
+	CloseHandle(hPipe);
+
+	return bResult;
+}
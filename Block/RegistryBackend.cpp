@@ -0,0 +1,142 @@
+#include "../Api/Platform.h"
+
+#include "../Api/RegistryBackend.h"
+
+/// <summary>
+///		Open key with RegOpenKeyEx
+/// </summary>
+/// 
+/// <param name="hKey">Parent key</param>
+/// <param name="lpSubKey">Path to key in parent key</param>
+/// <param name="samDesired">Access rights</param>
+/// <param name="phkResult">Opened key</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS Win32OpenKey(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult)
+{
+	return RegOpenKeyEx(hKey, lpSubKey, 0, samDesired, phkResult);
+}
+
+/// <summary>
+///		Close key with RegCloseKey
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS Win32CloseKey(HKEY hKey)
+{
+	return RegCloseKey(hKey);
+}
+
+/// <summary>
+///		Get subkey name by index with RegEnumKeyEx
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="dwIndex">Subkey index</param>
+/// <param name="lpName">Subkey name</param>
+/// <param name="lpcchName">Subkey name buffer length / subkey name length</param>
+/// <param name="lpftLastWriteTime">Last write time (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS Win32EnumKey(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, PFILETIME lpftLastWriteTime)
+{
+	return RegEnumKeyEx(hKey, dwIndex, lpName, lpcchName, NULL, NULL, NULL, lpftLastWriteTime);
+}
+
+/// <summary>
+///		Get value by index with RegEnumValue
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="dwIndex">Value index</param>
+/// <param name="lpValueName">Value name</param>
+/// <param name="lpcchValueName">Value name buffer length / value name length</param>
+/// <param name="lpType">Value type (may be NULL)</param>
+/// <param name="lpData">Value data (may be NULL)</param>
+/// <param name="lpcbData">Value data size (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS Win32EnumValue(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	return RegEnumValue(hKey, dwIndex, lpValueName, lpcchValueName, NULL, lpType, lpData, lpcbData);
+}
+
+/// <summary>
+///		Get key counters with RegQueryInfoKey
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpcSubKeys">Subkeys count</param>
+/// <param name="lpcMaxSubKeyLen">Longest subkey name length</param>
+/// <param name="lpcValues">Values count</param>
+/// <param name="lpcMaxValueNameLen">Longest value name length</param>
+/// <param name="lpcbMaxValueLen">Largest value data size</param>
+/// <param name="lpftLastWriteTime">Last write time</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS Win32QueryInfoKey(HKEY hKey, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, PFILETIME lpftLastWriteTime)
+{
+	return RegQueryInfoKey(hKey, NULL, NULL, NULL, lpcSubKeys, lpcMaxSubKeyLen, NULL, lpcValues, lpcMaxValueNameLen, lpcbMaxValueLen, NULL, lpftLastWriteTime);
+}
+
+/// <summary>
+///		Get value by name with RegQueryValueEx
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpValueName">Value name</param>
+/// <param name="lpType">Value type (may be NULL)</param>
+/// <param name="lpData">Value data (may be NULL)</param>
+/// <param name="lpcbData">Value data size (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS Win32QueryValue(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	return RegQueryValueEx(hKey, lpValueName, NULL, lpType, lpData, lpcbData);
+}
+
+static const REGBACKEND g_rbWin32Backend = {
+	"win32",
+	Win32OpenKey,
+	Win32CloseKey,
+	Win32EnumKey,
+	Win32EnumValue,
+	Win32QueryInfoKey,
+	Win32QueryValue,
+};
+
+static const REGBACKEND* g_lpCurrentBackend = &g_rbWin32Backend;
+
+/// <summary>
+///		Get backend that calls Windows registry
+/// </summary>
+/// 
+/// <returns>const REGBACKEND*</returns>
+const REGBACKEND* GetWin32Backend()
+{
+	return &g_rbWin32Backend;
+}
+
+/// <summary>
+///		Get backend used by registry read functions
+/// </summary>
+/// 
+/// <returns>const REGBACKEND*</returns>
+const REGBACKEND* GetRegBackend()
+{
+	return g_lpCurrentBackend;
+}
+
+/// <summary>
+///		Replace backend used by registry read functions
+/// </summary>
+/// 
+/// <param name="lpBackend">New backend (NULL restores Windows registry)</param>
+/// 
+/// <returns>void</returns>
+void SetRegBackend(const REGBACKEND* lpBackend)
+{
+	g_lpCurrentBackend = (lpBackend == NULL) ? &g_rbWin32Backend : lpBackend;
+}
@@ -0,0 +1,541 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/RegistryReplay.h"
+#include "../Api/Output.h"
+#include "../Api/Transcode.h"
+#include "../Api/Instrumentation.h"
+
+const DWORD RECORD_INITIAL_HANDLES_COUNT = 1024;
+
+// Handle opened while recording and id of its key
+typedef struct _RECORDEDHANDLE {
+	HKEY hKey;
+	DWORD dwKey;
+} RECORDEDHANDLE;
+
+static LONGLONG g_llRecordFrequency = 0;
+
+static SRWLOCK g_srwRecordLock = SRWLOCK_INIT;
+static FILE* g_lpRecordFile = NULL;
+static const REGBACKEND* g_lpRecordedBackend = NULL;
+static OUTPUTBUFFER g_obRecord = { NULL, 0, 0 };
+static REPLAYPATHS g_rpRecordPaths;
+static RECORDEDHANDLE* g_lpRecordedHandles = NULL;
+static DWORD g_dwRecordedHandlesCount = 0;
+static DWORD g_dwRecordedHandlesCapacity = 0;
+static TRANSCODEBUFFER g_tbRecord;
+static bool g_bRecordFailed = false;
+
+/// <summary>
+///		Get performance counter value
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+static ULONGLONG GetRecordTimestamp()
+{
+	LARGE_INTEGER liCounter;
+	QueryPerformanceCounter(&liCounter);
+
+	return liCounter.QuadPart;
+}
+
+/// <summary>
+///		Get time passed since timestamp in 100 ns units
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+static ULONGLONG GetRecordLatency(ULONGLONG ullStart)
+{
+	return (ULONGLONG)((double)(GetRecordTimestamp() - ullStart) * REPLAY_UNITS_PER_SECOND / (double)g_llRecordFrequency);
+}
+
+/// <summary>
+///		Get 64-bit value of file time
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+static ULONGLONG GetRecordFileTime(const FILETIME* lpftTime)
+{
+	return ((ULONGLONG)lpftTime->dwHighDateTime << 32) | lpftTime->dwLowDateTime;
+}
+
+/// <summary>
+///		Append LEB128 number to recording, recording lock is held by caller
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteReplayNumber(ULONGLONG ullValue)
+{
+	CHAR lpsNumber[REPLAY_MAX_NUMBER_SIZE];
+	DWORD cbNumber = 0;
+
+	do
+	{
+		BYTE bPart = (BYTE)(ullValue & 0x7F);
+		ullValue >>= 7;
+		lpsNumber[cbNumber++] = (CHAR)((ullValue != 0) ? (bPart | 0x80) : bPart);
+	} while (ullValue != 0);
+
+	g_bRecordFailed = !AppendOutput(&g_obRecord, lpsNumber, cbNumber) || g_bRecordFailed;
+}
+
+/// <summary>
+///		Append size and bytes to recording, recording lock is held by caller
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteReplayBytes(const BYTE* lpData, DWORD cbData)
+{
+	WriteReplayNumber(cbData);
+	g_bRecordFailed = !AppendOutput(&g_obRecord, (LPCSTR)lpData, cbData) || g_bRecordFailed;
+}
+
+/// <summary>
+///		Append string as UTF-8 to recording, recording lock is held by caller
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteReplayString(LPCWSTR lpsText, DWORD cchText)
+{
+	DWORD cbText = 0;
+	LPCSTR lpsUtf8Text = NarrowToUtf8(&g_tbRecord, lpsText, cchText, &cbText);
+
+	g_bRecordFailed = (lpsUtf8Text == NULL) || g_bRecordFailed;
+	WriteReplayBytes((const BYTE*)lpsUtf8Text, (lpsUtf8Text == NULL) ? 0 : cbText);
+}
+
+/// <summary>
+///		Write recorded calls to file once enough of them are collected, recording lock is held by caller
+/// </summary>
+///
+/// <param name="bForce">Write whatever is collected</param>
+///
+/// <returns>void</returns>
+static void FlushReplayRecords(bool bForce)
+{
+	if ((g_obRecord.cbSize != 0) && (bForce || (g_obRecord.cbSize >= REPLAY_FLUSH_SIZE)))
+	{
+		g_bRecordFailed = (fwrite(g_obRecord.lpsData, 1, g_obRecord.cbSize, g_lpRecordFile) != g_obRecord.cbSize) || g_bRecordFailed;
+		g_obRecord.cbSize = 0;
+	}
+}
+
+/// <summary>
+///		Get id of key, new key is written to recording before first call referencing it
+/// </summary>
+///
+/// <param name="dwParent">Parent key id (REPLAY_NO_KEY for root keys)</param>
+/// <param name="lpsPath">Relative path</param>
+///
+/// <returns>DWORD (key id, REPLAY_NO_KEY if no memory)</returns>
+static DWORD InternRecordedPath(DWORD dwParent, LPCWSTR lpsPath)
+{
+	DWORD dwKey = FindReplayPath(&g_rpRecordPaths, dwParent, lpsPath);
+	if (dwKey != REPLAY_NO_KEY)
+	{
+		return dwKey;
+	}
+
+	dwKey = AddReplayPath(&g_rpRecordPaths, dwParent, lpsPath);
+	if (dwKey == REPLAY_NO_KEY)
+	{
+		g_bRecordFailed = true;
+		return REPLAY_NO_KEY;
+	}
+
+	// Parent is stored plus one, so root keys have zero
+	WriteReplayNumber(REPLAY_RECORD_KEY);
+	WriteReplayNumber((DWORD)(dwParent + 1));
+	WriteReplayString(lpsPath, lstrlen(lpsPath));
+
+	return dwKey;
+}
+
+/// <summary>
+///		Remember key opened by handle, handle reused after close is overwritten by its next open
+/// </summary>
+///
+/// <returns>void</returns>
+static void SetRecordedHandle(HKEY hKey, DWORD dwKey)
+{
+	if ((g_dwRecordedHandlesCount + 1) * 2 > g_dwRecordedHandlesCapacity)
+	{
+		DWORD dwNewCapacity = (g_dwRecordedHandlesCapacity == 0) ? RECORD_INITIAL_HANDLES_COUNT : g_dwRecordedHandlesCapacity * 2;
+		RECORDEDHANDLE* lpNewHandles = (RECORDEDHANDLE*)calloc(dwNewCapacity, sizeof(RECORDEDHANDLE));
+		if (lpNewHandles == NULL)
+		{
+			g_bRecordFailed = true;
+			return;
+		}
+
+		STAT_ALLOC(dwNewCapacity * sizeof(RECORDEDHANDLE));
+
+		for (DWORD dwIndex = 0; dwIndex < g_dwRecordedHandlesCapacity; dwIndex++)
+		{
+			if (g_lpRecordedHandles[dwIndex].hKey != NULL)
+			{
+				DWORD dwSlot = (DWORD)(((ULONG_PTR)g_lpRecordedHandles[dwIndex].hKey >> 2) * 2654435761u) & (dwNewCapacity - 1);
+				while (lpNewHandles[dwSlot].hKey != NULL)
+				{
+					dwSlot = (dwSlot + 1) & (dwNewCapacity - 1);
+				}
+				lpNewHandles[dwSlot] = g_lpRecordedHandles[dwIndex];
+			}
+		}
+
+		free(g_lpRecordedHandles);
+		g_lpRecordedHandles = lpNewHandles;
+		g_dwRecordedHandlesCapacity = dwNewCapacity;
+	}
+
+	DWORD dwSlot = (DWORD)(((ULONG_PTR)hKey >> 2) * 2654435761u) & (g_dwRecordedHandlesCapacity - 1);
+	while ((g_lpRecordedHandles[dwSlot].hKey != NULL) && (g_lpRecordedHandles[dwSlot].hKey != hKey))
+	{
+		dwSlot = (dwSlot + 1) & (g_dwRecordedHandlesCapacity - 1);
+	}
+
+	g_dwRecordedHandlesCount += (g_lpRecordedHandles[dwSlot].hKey == NULL) ? 1 : 0;
+	g_lpRecordedHandles[dwSlot].hKey = hKey;
+	g_lpRecordedHandles[dwSlot].dwKey = dwKey;
+}
+
+/// <summary>
+///		Get id of key behind handle, handles not opened while recording become unknown root
+/// </summary>
+///
+/// <returns>DWORD</returns>
+static DWORD GetRecordedKey(HKEY hKey)
+{
+	LPCWSTR lpsRootName = GetReplayRootName(hKey);
+	if (lpsRootName != NULL)
+	{
+		return InternRecordedPath(REPLAY_NO_KEY, lpsRootName);
+	}
+
+	for (DWORD dwSlot = (DWORD)(((ULONG_PTR)hKey >> 2) * 2654435761u) & (g_dwRecordedHandlesCapacity - 1);
+		(g_dwRecordedHandlesCapacity != 0) && (g_lpRecordedHandles[dwSlot].hKey != NULL);
+		dwSlot = (dwSlot + 1) & (g_dwRecordedHandlesCapacity - 1))
+	{
+		if (g_lpRecordedHandles[dwSlot].hKey == hKey)
+		{
+			return g_lpRecordedHandles[dwSlot].dwKey;
+		}
+	}
+
+	return InternRecordedPath(REPLAY_NO_KEY, REPLAY_UNKNOWN_ROOT_NAME);
+}
+
+/// <summary>
+///		Append outputs of value call, caller passed only some of them
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteReplayValue(LSTATUS lStatus, ULONGLONG ullLatency, LPCWSTR lpsName, DWORD cchName, const DWORD* lpdwType, const BYTE* lpData, const DWORD* lpcbData)
+{
+	bool bReturned = (lStatus == ERROR_SUCCESS) || (lStatus == ERROR_MORE_DATA);
+	BYTE bFlags = ((lpsName != NULL) ? REPLAY_HAS_NAME : 0) |
+		((bReturned && (lpdwType != NULL)) ? REPLAY_HAS_TYPE : 0) |
+		((bReturned && (lpcbData != NULL)) ? REPLAY_HAS_SIZE : 0) |
+		(((lStatus == ERROR_SUCCESS) && (lpData != NULL) && (lpcbData != NULL)) ? REPLAY_HAS_DATA : 0);
+
+	WriteReplayNumber((DWORD)lStatus);
+	WriteReplayNumber(ullLatency);
+	WriteReplayNumber(bFlags);
+
+	if (bFlags & REPLAY_HAS_NAME)
+	{
+		WriteReplayString(lpsName, cchName);
+	}
+	if (bFlags & REPLAY_HAS_TYPE)
+	{
+		WriteReplayNumber(*lpdwType);
+	}
+
+	// Trace keeps string data as UTF-16LE, wider wchar_t is narrowed
+	bool bNarrow = (sizeof(WCHAR) != 2) && (bFlags & REPLAY_HAS_TYPE) && IsReplayStringType(*lpdwType);
+
+	if ((bFlags & REPLAY_HAS_DATA) && bNarrow)
+	{
+		DWORD cbNarrowData = 0;
+		BYTE* lpNarrowData = NarrowReplayData(lpData, *lpcbData, &cbNarrowData);
+
+		g_bRecordFailed = (lpNarrowData == NULL) || g_bRecordFailed;
+		WriteReplayBytes(lpNarrowData, cbNarrowData);
+		free(lpNarrowData);
+	}
+	else if (bFlags & REPLAY_HAS_DATA)
+	{
+		WriteReplayBytes(lpData, *lpcbData);
+	}
+	else if (bFlags & REPLAY_HAS_SIZE)
+	{
+		WriteReplayNumber(bNarrow ? *lpcbData / sizeof(WCHAR) * 2 : *lpcbData);
+	}
+}
+
+/// <summary>
+///		Open key and record key id of new handle
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS RecordOpenKey(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult)
+{
+	ULONGLONG ullStart = GetRecordTimestamp();
+	LSTATUS lStatus = g_lpRecordedBackend->lpfnOpenKey(hKey, lpSubKey, samDesired, phkResult);
+	ULONGLONG ullLatency = GetRecordLatency(ullStart);
+
+	AcquireSRWLockExclusive(&g_srwRecordLock);
+
+	// Empty path opens the same key, some backends even return the same handle for it
+	DWORD dwParent = GetRecordedKey(hKey);
+	DWORD dwKey = ((lpSubKey == NULL) || (lpSubKey[0] == L'\0')) ? dwParent : InternRecordedPath(dwParent, lpSubKey);
+	if (lStatus == ERROR_SUCCESS)
+	{
+		SetRecordedHandle(*phkResult, dwKey);
+	}
+
+	WriteReplayNumber(REPLAY_RECORD_OPEN);
+	WriteReplayNumber(dwKey);
+	WriteReplayNumber((DWORD)lStatus);
+	WriteReplayNumber(ullLatency);
+	FlushReplayRecords(false);
+
+	ReleaseSRWLockExclusive(&g_srwRecordLock);
+
+	return lStatus;
+}
+
+/// <summary>
+///		Close key, closing is not recorded
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS RecordCloseKey(HKEY hKey)
+{
+	return g_lpRecordedBackend->lpfnCloseKey(hKey);
+}
+
+/// <summary>
+///		Get subkey name by index and record it with last write time
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS RecordEnumKey(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, PFILETIME lpftLastWriteTime)
+{
+	FILETIME ftLastWriteTime = { 0, 0 };
+
+	ULONGLONG ullStart = GetRecordTimestamp();
+	LSTATUS lStatus = g_lpRecordedBackend->lpfnEnumKey(hKey, dwIndex, lpName, lpcchName, &ftLastWriteTime);
+	ULONGLONG ullLatency = GetRecordLatency(ullStart);
+
+	if ((lStatus == ERROR_SUCCESS) && (lpftLastWriteTime != NULL))
+	{
+		*lpftLastWriteTime = ftLastWriteTime;
+	}
+
+	AcquireSRWLockExclusive(&g_srwRecordLock);
+
+	WriteReplayNumber(REPLAY_RECORD_ENUM_KEY);
+	WriteReplayNumber(GetRecordedKey(hKey));
+	WriteReplayNumber(dwIndex);
+	WriteReplayNumber((DWORD)lStatus);
+	WriteReplayNumber(ullLatency);
+
+	if (lStatus == ERROR_SUCCESS)
+	{
+		WriteReplayString(lpName, *lpcchName);
+		WriteReplayNumber(GetRecordFileTime(&ftLastWriteTime));
+	}
+
+	FlushReplayRecords(false);
+
+	ReleaseSRWLockExclusive(&g_srwRecordLock);
+
+	return lStatus;
+}
+
+/// <summary>
+///		Get value by index and record outputs caller asked for
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS RecordEnumValue(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	// Type is recorded even if caller did not ask for it, replay needs it to convert string data
+	DWORD dwType = REG_NONE;
+	LPDWORD lpRecordedType = (lpType != NULL) ? lpType : &dwType;
+
+	ULONGLONG ullStart = GetRecordTimestamp();
+	LSTATUS lStatus = g_lpRecordedBackend->lpfnEnumValue(hKey, dwIndex, lpValueName, lpcchValueName, lpRecordedType, lpData, lpcbData);
+	ULONGLONG ullLatency = GetRecordLatency(ullStart);
+
+	AcquireSRWLockExclusive(&g_srwRecordLock);
+
+	WriteReplayNumber(REPLAY_RECORD_ENUM_VALUE);
+	WriteReplayNumber(GetRecordedKey(hKey));
+	WriteReplayNumber(dwIndex);
+	WriteReplayValue(lStatus, ullLatency, ((lStatus == ERROR_SUCCESS) && (lpcchValueName != NULL)) ? lpValueName : NULL,
+		(lpcchValueName == NULL) ? 0 : *lpcchValueName, lpRecordedType, lpData, lpcbData);
+	FlushReplayRecords(false);
+
+	ReleaseSRWLockExclusive(&g_srwRecordLock);
+
+	return lStatus;
+}
+
+/// <summary>
+///		Get key counters, all of them are recorded whatever caller asked for
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS RecordQueryInfoKey(HKEY hKey, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, PFILETIME lpftLastWriteTime)
+{
+	DWORD dwCounters[REPLAY_KEY_COUNTERS_COUNT] = { 0, 0, 0, 0, 0 };
+	FILETIME ftLastWriteTime = { 0, 0 };
+
+	ULONGLONG ullStart = GetRecordTimestamp();
+	LSTATUS lStatus = g_lpRecordedBackend->lpfnQueryInfoKey(hKey, &dwCounters[0], &dwCounters[1], &dwCounters[2], &dwCounters[3], &dwCounters[4], &ftLastWriteTime);
+	ULONGLONG ullLatency = GetRecordLatency(ullStart);
+
+	LPDWORD lpdwOutputs[REPLAY_KEY_COUNTERS_COUNT] = { lpcSubKeys, lpcMaxSubKeyLen, lpcValues, lpcMaxValueNameLen, lpcbMaxValueLen };
+	for (DWORD dwIndex = 0; (lStatus == ERROR_SUCCESS) && (dwIndex < REPLAY_KEY_COUNTERS_COUNT); dwIndex++)
+	{
+		if (lpdwOutputs[dwIndex] != NULL)
+		{
+			*lpdwOutputs[dwIndex] = dwCounters[dwIndex];
+		}
+	}
+
+	if ((lStatus == ERROR_SUCCESS) && (lpftLastWriteTime != NULL))
+	{
+		*lpftLastWriteTime = ftLastWriteTime;
+	}
+
+	AcquireSRWLockExclusive(&g_srwRecordLock);
+
+	WriteReplayNumber(REPLAY_RECORD_QUERY_INFO);
+	WriteReplayNumber(GetRecordedKey(hKey));
+	WriteReplayNumber((DWORD)lStatus);
+	WriteReplayNumber(ullLatency);
+
+	for (DWORD dwIndex = 0; (lStatus == ERROR_SUCCESS) && (dwIndex < REPLAY_KEY_COUNTERS_COUNT); dwIndex++)
+	{
+		WriteReplayNumber(dwCounters[dwIndex]);
+	}
+
+	if (lStatus == ERROR_SUCCESS)
+	{
+		WriteReplayNumber(GetRecordFileTime(&ftLastWriteTime));
+	}
+
+	FlushReplayRecords(false);
+
+	ReleaseSRWLockExclusive(&g_srwRecordLock);
+
+	return lStatus;
+}
+
+/// <summary>
+///		Get value by name and record outputs caller asked for
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS RecordQueryValue(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	DWORD dwType = REG_NONE;
+	LPDWORD lpRecordedType = (lpType != NULL) ? lpType : &dwType;
+
+	ULONGLONG ullStart = GetRecordTimestamp();
+	LSTATUS lStatus = g_lpRecordedBackend->lpfnQueryValue(hKey, lpValueName, lpRecordedType, lpData, lpcbData);
+	ULONGLONG ullLatency = GetRecordLatency(ullStart);
+
+	// NULL name is default value as empty name is
+	LPCWSTR lpsName = (lpValueName == NULL) ? L"" : lpValueName;
+
+	AcquireSRWLockExclusive(&g_srwRecordLock);
+
+	WriteReplayNumber(REPLAY_RECORD_QUERY_VALUE);
+	WriteReplayNumber(GetRecordedKey(hKey));
+	WriteReplayValue(lStatus, ullLatency, lpsName, lstrlen(lpsName), lpRecordedType, lpData, lpcbData);
+	FlushReplayRecords(false);
+
+	ReleaseSRWLockExclusive(&g_srwRecordLock);
+
+	return lStatus;
+}
+
+static const REGBACKEND g_rbRecordBackend = {
+	"record",
+	RecordOpenKey,
+	RecordCloseKey,
+	RecordEnumKey,
+	RecordEnumValue,
+	RecordQueryInfoKey,
+	RecordQueryValue,
+};
+
+/// <summary>
+///		Record registry calls made through current backend until StopRegRecording
+/// </summary>
+///
+/// <param name="lpsFileName">Trace file</param>
+///
+/// <returns>bool</returns>
+bool StartRegRecording(LPCSTR lpsFileName)
+{
+	if ((g_lpRecordFile != NULL) || (fopen_s(&g_lpRecordFile, lpsFileName, "wb") != 0))
+	{
+		return false;
+	}
+
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	g_llRecordFrequency = liFrequency.QuadPart;
+
+	ZeroMemory(&g_rpRecordPaths, sizeof(REPLAYPATHS));
+	ZeroMemory(&g_tbRecord, sizeof(TRANSCODEBUFFER));
+	g_bRecordFailed = false;
+
+	WriteReplayNumber(REPLAY_MAGIC);
+	WriteReplayNumber(REPLAY_VERSION);
+
+	g_lpRecordedBackend = GetRegBackend();
+	SetRegBackend(&g_rbRecordBackend);
+
+	return true;
+}
+
+/// <summary>
+///		Restore recorded backend and write rest of recording
+/// </summary>
+///
+/// <returns>bool</returns>
+bool StopRegRecording()
+{
+	if (g_lpRecordFile == NULL)
+	{
+		return false;
+	}
+
+	SetRegBackend(g_lpRecordedBackend);
+
+	AcquireSRWLockExclusive(&g_srwRecordLock);
+
+	FlushReplayRecords(true);
+	bool bResult = (fclose(g_lpRecordFile) == 0) && !g_bRecordFailed;
+	g_lpRecordFile = NULL;
+
+	FreeOutputBuffer(&g_obRecord);
+	FreeReplayPaths(&g_rpRecordPaths);
+	FreeTranscodeBuffer(&g_tbRecord);
+	free(g_lpRecordedHandles);
+	g_lpRecordedHandles = NULL;
+	g_dwRecordedHandlesCount = 0;
+	g_dwRecordedHandlesCapacity = 0;
+
+	ReleaseSRWLockExclusive(&g_srwRecordLock);
+
+	return bResult;
+}
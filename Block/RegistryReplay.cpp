@@ -0,0 +1,439 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/RegistryReplay.h"
+#include "../Api/Throttle.h"
+
+const ULONGLONG REPLAY_SLEEP_THRESHOLD_MICROSECONDS = 2000;
+
+static const HKEY g_hRootKeys[] = { HKEY_CLASSES_ROOT, HKEY_CURRENT_USER, HKEY_LOCAL_MACHINE, HKEY_USERS, HKEY_CURRENT_CONFIG };
+static const LPCWSTR g_lpsRootNames[] = { L"HKEY_CLASSES_ROOT", L"HKEY_CURRENT_USER", L"HKEY_LOCAL_MACHINE", L"HKEY_USERS", L"HKEY_CURRENT_CONFIG" };
+const DWORD REPLAY_ROOT_KEYS_COUNT = sizeof(g_hRootKeys) / sizeof(g_hRootKeys[0]);
+
+static REPLAYPATHS g_rpReplayPaths;
+static bool g_bReplayLatency = false;
+static volatile LONG64 g_llReplayMisses = 0;
+
+/// <summary>
+///		Get name root key is recorded with
+/// </summary>
+///
+/// <param name="hKey">Key handle</param>
+///
+/// <returns>LPCWSTR (NULL if handle is not root key)</returns>
+LPCWSTR GetReplayRootName(HKEY hKey)
+{
+	for (DWORD dwRoot = 0; dwRoot < REPLAY_ROOT_KEYS_COUNT; dwRoot++)
+	{
+		if (hKey == g_hRootKeys[dwRoot])
+		{
+			return g_lpsRootNames[dwRoot];
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Split trace time into file time
+/// </summary>
+///
+/// <returns>void</returns>
+static void SetReplayFileTime(PFILETIME lpftTime, ULONGLONG ullTime)
+{
+	lpftTime->dwLowDateTime = (DWORD)ullTime;
+	lpftTime->dwHighDateTime = (DWORD)(ullTime >> 32);
+}
+
+/// <summary>
+///		Load recorded calls, replay backend serves them until FreeRegReplay
+/// </summary>
+///
+/// <param name="lpsFileName">Trace file</param>
+/// <param name="bReplayLatency">Make every call take as long as recorded one</param>
+///
+/// <returns>bool</returns>
+bool LoadRegReplay(LPCSTR lpsFileName, bool bReplayLatency)
+{
+	FreeRegReplay();
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "rb") != 0)
+	{
+		return false;
+	}
+
+	LONG lFileSize = -1;
+	if (fseek(lpFile, 0, SEEK_END) == 0)
+	{
+		lFileSize = ftell(lpFile);
+	}
+
+	BYTE* lpbData = (lFileSize <= 0) ? NULL : (BYTE*)malloc(lFileSize);
+	bool bResult = (lpbData != NULL) && (fseek(lpFile, 0, SEEK_SET) == 0) && (fread(lpbData, 1, lFileSize, lpFile) == (size_t)lFileSize);
+	fclose(lpFile);
+
+	bResult = bResult && ReadReplayTrace(lpbData, (SIZE_T)lFileSize, &g_rpReplayPaths);
+	free(lpbData);
+
+	if (!bResult)
+	{
+		FreeRegReplay();
+		return false;
+	}
+
+	g_bReplayLatency = bReplayLatency;
+
+	return true;
+}
+
+/// <summary>
+///		Count call that was not recorded, replay returns failure for it
+/// </summary>
+///
+/// <returns>LSTATUS (passed status)</returns>
+static LSTATUS MissReplayCall(LSTATUS lStatus)
+{
+	InterlockedIncrement64(&g_llReplayMisses);
+	return lStatus;
+}
+
+/// <summary>
+///		Wait as long as recorded call took, long waits sleep and last millisecond is spun
+/// </summary>
+///
+/// <returns>void</returns>
+static void WaitReplayLatency(ULONGLONG ullLatency)
+{
+	ULONGLONG ullMicroseconds = ullLatency / REPLAY_UNITS_PER_MICROSECOND;
+	if (!g_bReplayLatency || (ullMicroseconds == 0))
+	{
+		return;
+	}
+
+	const THROTTLECLOCK* lpClock = GetSystemClock();
+	ULONGLONG ullEnd = lpClock->lpfnGetTime(lpClock->lpContext) + ullMicroseconds;
+
+	if (ullMicroseconds >= REPLAY_SLEEP_THRESHOLD_MICROSECONDS)
+	{
+		lpClock->lpfnSleep(lpClock->lpContext, ullMicroseconds - 1000);
+	}
+
+	while (lpClock->lpfnGetTime(lpClock->lpContext) < ullEnd)
+	{
+		YieldProcessor();
+	}
+}
+
+/// <summary>
+///		Get key of root or replay handle
+/// </summary>
+///
+/// <returns>REPLAYKEY* (NULL if handle was not opened by replay)</returns>
+static REPLAYKEY* ResolveReplayKey(HKEY hKey)
+{
+	LPCWSTR lpsRootName = GetReplayRootName(hKey);
+	if (lpsRootName != NULL)
+	{
+		DWORD dwKey = FindReplayPath(&g_rpReplayPaths, REPLAY_NO_KEY, lpsRootName);
+		return (dwKey == REPLAY_NO_KEY) ? NULL : &g_rpReplayPaths.lpKeys[dwKey];
+	}
+
+	// Replay handles point into key table
+	ULONG_PTR ulHandle = (ULONG_PTR)hKey;
+	ULONG_PTR ulFirst = (ULONG_PTR)g_rpReplayPaths.lpKeys;
+
+	if ((ulHandle < ulFirst) || (ulHandle >= ulFirst + g_rpReplayPaths.dwKeysCount * sizeof(REPLAYKEY)) || ((ulHandle - ulFirst) % sizeof(REPLAYKEY) != 0))
+	{
+		return NULL;
+	}
+
+	return (REPLAYKEY*)hKey;
+}
+
+/// <summary>
+///		Serve recorded value outputs, caller may ask for different ones than recorded
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ServeReplayValue(const REPLAYVALUE* lpValue, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	WaitReplayLatency(lpValue->ullLatency);
+
+	if ((lpValue->lStatus != ERROR_SUCCESS) && (lpValue->lStatus != ERROR_MORE_DATA))
+	{
+		return lpValue->lStatus;
+	}
+
+	if (lpValueName != NULL)
+	{
+		if (!(lpValue->bFlags & REPLAY_HAS_NAME))
+		{
+			return MissReplayCall(lpValue->lStatus);
+		}
+
+		if (*lpcchValueName <= lpValue->cchName)
+		{
+			return ERROR_MORE_DATA;
+		}
+
+		memcpy(lpValueName, lpValue->lpsName, (lpValue->cchName + 1) * sizeof(WCHAR));
+		*lpcchValueName = lpValue->cchName;
+	}
+
+	if (lpType != NULL)
+	{
+		if (!(lpValue->bFlags & REPLAY_HAS_TYPE))
+		{
+			return MissReplayCall(lpValue->lStatus);
+		}
+
+		*lpType = lpValue->dwType;
+	}
+
+	LSTATUS lStatus = ERROR_SUCCESS;
+
+	if (lpcbData != NULL)
+	{
+		if (!(lpValue->bFlags & REPLAY_HAS_SIZE))
+		{
+			return MissReplayCall(lpValue->lStatus);
+		}
+
+		if ((lpData != NULL) && (*lpcbData < lpValue->cbData))
+		{
+			lStatus = ERROR_MORE_DATA;
+		}
+		else if (lpData != NULL)
+		{
+			if (!(lpValue->bFlags & REPLAY_HAS_DATA))
+			{
+				return MissReplayCall(lpValue->lStatus);
+			}
+
+			memcpy(lpData, lpValue->lpData, lpValue->cbData);
+		}
+
+		*lpcbData = lpValue->cbData;
+	}
+
+	return lStatus;
+}
+
+/// <summary>
+///		Open key as recorded for same parent and path
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ReplayOpenKey(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult)
+{
+	REPLAYKEY* lpParent = ResolveReplayKey(hKey);
+	DWORD dwParent = (lpParent == NULL) ? REPLAY_NO_KEY : (DWORD)(lpParent - g_rpReplayPaths.lpKeys);
+	DWORD dwKey = ((dwParent == REPLAY_NO_KEY) || (lpSubKey == NULL) || (lpSubKey[0] == L'\0')) ? dwParent : FindReplayPath(&g_rpReplayPaths, dwParent, lpSubKey);
+
+	if ((dwKey == REPLAY_NO_KEY) || !g_rpReplayPaths.lpKeys[dwKey].bOpened)
+	{
+		return MissReplayCall(ERROR_FILE_NOT_FOUND);
+	}
+
+	REPLAYKEY* lpKey = &g_rpReplayPaths.lpKeys[dwKey];
+	WaitReplayLatency(lpKey->ullOpenLatency);
+
+	if (lpKey->lOpenStatus == ERROR_SUCCESS)
+	{
+		*phkResult = (HKEY)lpKey;
+	}
+
+	return lpKey->lOpenStatus;
+}
+
+/// <summary>
+///		Close replay handle
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ReplayCloseKey(HKEY hKey)
+{
+	return (ResolveReplayKey(hKey) == NULL) ? ERROR_INVALID_HANDLE : ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get recorded subkey name by index
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ReplayEnumKey(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, PFILETIME lpftLastWriteTime)
+{
+	REPLAYKEY* lpKey = ResolveReplayKey(hKey);
+	if (lpKey == NULL)
+	{
+		return MissReplayCall(ERROR_INVALID_HANDLE);
+	}
+
+	// Index past recorded subkeys count ends enumeration even if that call was not recorded
+	if ((dwIndex >= lpKey->dwSubKeysCapacity) || !lpKey->lpSubKeys[dwIndex].bRecorded)
+	{
+		return (lpKey->bInfo && (lpKey->lInfoStatus == ERROR_SUCCESS) && (dwIndex >= lpKey->dwSubKeysCount)) ?
+			ERROR_NO_MORE_ITEMS : MissReplayCall(ERROR_NO_MORE_ITEMS);
+	}
+
+	const REPLAYSUBKEY* lpSubKey = &lpKey->lpSubKeys[dwIndex];
+	WaitReplayLatency(lpSubKey->ullLatency);
+
+	if (lpSubKey->lStatus != ERROR_SUCCESS)
+	{
+		return lpSubKey->lStatus;
+	}
+
+	if (*lpcchName <= lpSubKey->cchName)
+	{
+		return ERROR_MORE_DATA;
+	}
+
+	memcpy(lpName, lpSubKey->lpsName, (lpSubKey->cchName + 1) * sizeof(WCHAR));
+	*lpcchName = lpSubKey->cchName;
+
+	if (lpftLastWriteTime != NULL)
+	{
+		SetReplayFileTime(lpftLastWriteTime, lpSubKey->ullLastWriteTime);
+	}
+
+	return ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get recorded value by index
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ReplayEnumValue(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	REPLAYKEY* lpKey = ResolveReplayKey(hKey);
+	if (lpKey == NULL)
+	{
+		return MissReplayCall(ERROR_INVALID_HANDLE);
+	}
+
+	if ((dwIndex >= lpKey->dwValuesCapacity) || !lpKey->lpValues[dwIndex].bRecorded)
+	{
+		return (lpKey->bInfo && (lpKey->lInfoStatus == ERROR_SUCCESS) && (dwIndex >= lpKey->dwValuesCount)) ?
+			ERROR_NO_MORE_ITEMS : MissReplayCall(ERROR_NO_MORE_ITEMS);
+	}
+
+	return ServeReplayValue(&lpKey->lpValues[dwIndex], lpValueName, lpcchValueName, lpType, lpData, lpcbData);
+}
+
+/// <summary>
+///		Get recorded key counters
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ReplayQueryInfoKey(HKEY hKey, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, PFILETIME lpftLastWriteTime)
+{
+	REPLAYKEY* lpKey = ResolveReplayKey(hKey);
+	if ((lpKey == NULL) || !lpKey->bInfo)
+	{
+		return MissReplayCall((lpKey == NULL) ? ERROR_INVALID_HANDLE : ERROR_FILE_NOT_FOUND);
+	}
+
+	WaitReplayLatency(lpKey->ullInfoLatency);
+
+	if (lpKey->lInfoStatus != ERROR_SUCCESS)
+	{
+		return lpKey->lInfoStatus;
+	}
+
+	const DWORD dwCounters[REPLAY_KEY_COUNTERS_COUNT] = { lpKey->dwSubKeysCount, lpKey->dwMaxSubKeyLength, lpKey->dwValuesCount, lpKey->dwMaxValueNameLength, lpKey->cbMaxValueSize };
+	LPDWORD lpdwOutputs[REPLAY_KEY_COUNTERS_COUNT] = { lpcSubKeys, lpcMaxSubKeyLen, lpcValues, lpcMaxValueNameLen, lpcbMaxValueLen };
+
+	for (DWORD dwIndex = 0; dwIndex < REPLAY_KEY_COUNTERS_COUNT; dwIndex++)
+	{
+		if (lpdwOutputs[dwIndex] != NULL)
+		{
+			*lpdwOutputs[dwIndex] = dwCounters[dwIndex];
+		}
+	}
+
+	if (lpftLastWriteTime != NULL)
+	{
+		SetReplayFileTime(lpftLastWriteTime, lpKey->ullLastWriteTime);
+	}
+
+	return ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get recorded value by name
+/// </summary>
+///
+/// <returns>LSTATUS</returns>
+static LSTATUS ReplayQueryValue(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	REPLAYKEY* lpKey = ResolveReplayKey(hKey);
+	if (lpKey == NULL)
+	{
+		return MissReplayCall(ERROR_INVALID_HANDLE);
+	}
+
+	const REPLAYVALUE* lpQueried = FindReplayQueriedValue(lpKey, lpValueName);
+	if (lpQueried == NULL)
+	{
+		return MissReplayCall(ERROR_FILE_NOT_FOUND);
+	}
+
+	return ServeReplayValue(lpQueried, NULL, NULL, lpType, lpData, lpcbData);
+}
+
+static const REGBACKEND g_rbReplayBackend = {
+	"replay",
+	ReplayOpenKey,
+	ReplayCloseKey,
+	ReplayEnumKey,
+	ReplayEnumValue,
+	ReplayQueryInfoKey,
+	ReplayQueryValue,
+};
+
+/// <summary>
+///		Get backend that serves loaded recording
+/// </summary>
+///
+/// <returns>const REGBACKEND*</returns>
+const REGBACKEND* GetReplayBackend()
+{
+	return &g_rbReplayBackend;
+}
+
+/// <summary>
+///		Get handle of root recorded for handles that were not opened while recording (like keys of synthetic tree)
+/// </summary>
+///
+/// <returns>HKEY (NULL if recording has no such root)</returns>
+HKEY GetReplayUnknownRoot()
+{
+	DWORD dwKey = FindReplayPath(&g_rpReplayPaths, REPLAY_NO_KEY, REPLAY_UNKNOWN_ROOT_NAME);
+	return (dwKey == REPLAY_NO_KEY) ? NULL : (HKEY)&g_rpReplayPaths.lpKeys[dwKey];
+}
+
+/// <summary>
+///		Get count of calls that were not found in recording
+/// </summary>
+///
+/// <returns>ULONGLONG</returns>
+ULONGLONG GetReplayMissesCount()
+{
+	return (ULONGLONG)g_llReplayMisses;
+}
+
+/// <summary>
+///		Free loaded recording
+/// </summary>
+///
+/// <returns>void</returns>
+void FreeRegReplay()
+{
+	FreeReplayPaths(&g_rpReplayPaths);
+	g_llReplayMisses = 0;
+	g_bReplayLatency = false;
+}
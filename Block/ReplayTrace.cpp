@@ -0,0 +1,712 @@
+#include "../Api/Platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Api/ReplayTrace.h"
+#include "../Api/Transcode.h"
+#include "../Api/FuzzyMatch.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Collections.h"
+
+const DWORD REPLAY_INITIAL_SLOTS_COUNT = 1024;
+
+typedef struct _REPLAYREADER {
+	const BYTE* lpbData;
+	SIZE_T cbSize;
+	SIZE_T cbPosition;
+} REPLAYREADER;
+
+/// <summary>
+///		Hash of key path, paths are case insensitive
+/// </summary>
+///
+/// <returns>DWORD</returns>
+static DWORD HashReplayPath(DWORD dwParent, LPCWSTR lpsPath)
+{
+	return HashString(HASH_INITIAL_VALUE ^ dwParent, lpsPath, HASH_TERMINATED, true);
+}
+
+/// <summary>
+///		Compare names folded the same way as they are hashed
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool EqualReplayNames(LPCWSTR lpsFirst, LPCWSTR lpsSecond)
+{
+	for (; (*lpsFirst != L'\0') && (*lpsSecond != L'\0'); lpsFirst++, lpsSecond++)
+	{
+		if ((*lpsFirst != *lpsSecond) && (FoldChar(*lpsFirst) != FoldChar(*lpsSecond)))
+		{
+			return false;
+		}
+	}
+
+	return *lpsFirst == *lpsSecond;
+}
+
+/// <summary>
+///		Find key by parent and path relative to it
+/// </summary>
+///
+/// <param name="lpPaths">Key table</param>
+/// <param name="dwParent">Parent key id (REPLAY_NO_KEY for root keys)</param>
+/// <param name="lpsPath">Relative path</param>
+///
+/// <returns>DWORD (key id, REPLAY_NO_KEY if key is unknown)</returns>
+DWORD FindReplayPath(const REPLAYPATHS* lpPaths, DWORD dwParent, LPCWSTR lpsPath)
+{
+	if (lpPaths->dwSlotsCount == 0)
+	{
+		return REPLAY_NO_KEY;
+	}
+
+	for (DWORD dwSlot = HashReplayPath(dwParent, lpsPath) & (lpPaths->dwSlotsCount - 1); ; dwSlot = (dwSlot + 1) & (lpPaths->dwSlotsCount - 1))
+	{
+		DWORD dwKey = lpPaths->lpdwSlots[dwSlot];
+		if (dwKey == REPLAY_NO_KEY)
+		{
+			return REPLAY_NO_KEY;
+		}
+
+		if ((lpPaths->lpKeys[dwKey].dwParent == dwParent) && EqualReplayNames(lpPaths->lpKeys[dwKey].lpsPath, lpsPath))
+		{
+			return dwKey;
+		}
+	}
+}
+
+/// <summary>
+///		Add key missing in table, slots are doubled when half full
+/// </summary>
+///
+/// <param name="lpPaths">Key table</param>
+/// <param name="dwParent">Parent key id (REPLAY_NO_KEY for root keys)</param>
+/// <param name="lpsPath">Relative path</param>
+///
+/// <returns>DWORD (key id, REPLAY_NO_KEY if no memory)</returns>
+DWORD AddReplayPath(REPLAYPATHS* lpPaths, DWORD dwParent, LPCWSTR lpsPath)
+{
+	if (!ReserveArray((void**)&lpPaths->lpKeys, &lpPaths->dwKeysCapacity, lpPaths->dwKeysCount + 1, sizeof(REPLAYKEY)))
+	{
+		return REPLAY_NO_KEY;
+	}
+
+	if ((lpPaths->dwKeysCount + 1) * 2 > lpPaths->dwSlotsCount)
+	{
+		DWORD dwNewSlotsCount = (lpPaths->dwSlotsCount == 0) ? REPLAY_INITIAL_SLOTS_COUNT : lpPaths->dwSlotsCount * 2;
+		DWORD* lpdwNewSlots = (DWORD*)malloc(dwNewSlotsCount * sizeof(DWORD));
+		if (lpdwNewSlots == NULL)
+		{
+			return REPLAY_NO_KEY;
+		}
+
+		STAT_ALLOC(dwNewSlotsCount * sizeof(DWORD));
+		memset(lpdwNewSlots, 0xFF, dwNewSlotsCount * sizeof(DWORD));
+
+		for (DWORD dwKey = 0; dwKey < lpPaths->dwKeysCount; dwKey++)
+		{
+			DWORD dwSlot = HashReplayPath(lpPaths->lpKeys[dwKey].dwParent, lpPaths->lpKeys[dwKey].lpsPath) & (dwNewSlotsCount - 1);
+			while (lpdwNewSlots[dwSlot] != REPLAY_NO_KEY)
+			{
+				dwSlot = (dwSlot + 1) & (dwNewSlotsCount - 1);
+			}
+			lpdwNewSlots[dwSlot] = dwKey;
+		}
+
+		free(lpPaths->lpdwSlots);
+		lpPaths->lpdwSlots = lpdwNewSlots;
+		lpPaths->dwSlotsCount = dwNewSlotsCount;
+	}
+
+	LPWSTR lpsPathCopy = _wcsdup(lpsPath);
+	if (lpsPathCopy == NULL)
+	{
+		return REPLAY_NO_KEY;
+	}
+
+	DWORD dwKey = lpPaths->dwKeysCount++;
+	REPLAYKEY* lpKey = &lpPaths->lpKeys[dwKey];
+	ZeroMemory(lpKey, sizeof(REPLAYKEY));
+	lpKey->dwParent = dwParent;
+	lpKey->lpsPath = lpsPathCopy;
+
+	DWORD dwSlot = HashReplayPath(dwParent, lpsPath) & (lpPaths->dwSlotsCount - 1);
+	while (lpPaths->lpdwSlots[dwSlot] != REPLAY_NO_KEY)
+	{
+		dwSlot = (dwSlot + 1) & (lpPaths->dwSlotsCount - 1);
+	}
+	lpPaths->lpdwSlots[dwSlot] = dwKey;
+
+	return dwKey;
+}
+
+/// <summary>
+///		Free value responses
+/// </summary>
+///
+/// <returns>void</returns>
+static void FreeReplayValues(REPLAYVALUE* lpValues, DWORD dwValuesCount)
+{
+	for (DWORD dwIndex = 0; dwIndex < dwValuesCount; dwIndex++)
+	{
+		free(lpValues[dwIndex].lpsName);
+		free(lpValues[dwIndex].lpData);
+	}
+
+	free(lpValues);
+}
+
+/// <summary>
+///		Free key table with recorded responses
+/// </summary>
+///
+/// <param name="lpPaths">Key table</param>
+///
+/// <returns>void</returns>
+void FreeReplayPaths(REPLAYPATHS* lpPaths)
+{
+	for (DWORD dwKey = 0; dwKey < lpPaths->dwKeysCount; dwKey++)
+	{
+		REPLAYKEY* lpKey = &lpPaths->lpKeys[dwKey];
+
+		for (DWORD dwIndex = 0; dwIndex < lpKey->dwSubKeysCapacity; dwIndex++)
+		{
+			free(lpKey->lpSubKeys[dwIndex].lpsName);
+		}
+
+		free(lpKey->lpSubKeys);
+		FreeReplayValues(lpKey->lpValues, lpKey->dwValuesCapacity);
+		FreeReplayValues(lpKey->lpQueriedValues, lpKey->dwQueriedCount);
+		free(lpKey->lpsPath);
+	}
+
+	free(lpPaths->lpKeys);
+	free(lpPaths->lpdwSlots);
+	ZeroMemory(lpPaths, sizeof(REPLAYPATHS));
+}
+
+/// <summary>
+///		Find value queried by name, NULL name is default value as empty name is
+/// </summary>
+///
+/// <returns>const REPLAYVALUE* (NULL if value was not queried)</returns>
+const REPLAYVALUE* FindReplayQueriedValue(const REPLAYKEY* lpKey, LPCWSTR lpsName)
+{
+	LPCWSTR lpsQueriedName = (lpsName == NULL) ? L"" : lpsName;
+
+	for (DWORD dwQueried = 0; dwQueried < lpKey->dwQueriedCount; dwQueried++)
+	{
+		if (EqualReplayNames(lpKey->lpQueriedValues[dwQueried].lpsName, lpsQueriedName))
+		{
+			return &lpKey->lpQueriedValues[dwQueried];
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Check if value data is text stored as UTF-16LE in trace
+/// </summary>
+///
+/// <returns>bool</returns>
+bool IsReplayStringType(DWORD dwType)
+{
+	return (dwType == REG_SZ) || (dwType == REG_EXPAND_SZ) || (dwType == REG_MULTI_SZ) || (dwType == REG_LINK);
+}
+
+/// <summary>
+///		Convert wide string data to UTF-16LE of trace, characters above BMP become surrogate pairs.
+///		Only called where wchar_t is wider than UTF-16 code unit
+/// </summary>
+///
+/// <param name="lpData">Data of string value</param>
+/// <param name="cbData">Data size</param>
+/// <param name="lpcbNarrowData">Size of converted data</param>
+///
+/// <returns>BYTE* (free after use, NULL if no memory)</returns>
+BYTE* NarrowReplayData(const BYTE* lpData, DWORD cbData, DWORD* lpcbNarrowData)
+{
+	DWORD cchData = cbData / sizeof(WCHAR);
+	BYTE* lpNarrowData = (BYTE*)malloc((SIZE_T)cchData * 4 + 1);
+	if (lpNarrowData == NULL)
+	{
+		return NULL;
+	}
+
+	DWORD cbNarrowData = 0;
+	for (DWORD dwIndex = 0; dwIndex < cchData; dwIndex++)
+	{
+		WCHAR wcChar;
+		memcpy(&wcChar, lpData + dwIndex * sizeof(WCHAR), sizeof(WCHAR));
+
+		DWORD dwCodePoint = (DWORD)wcChar;
+		WORD wUnits[2] = { (WORD)dwCodePoint, 0 };
+		DWORD dwUnitsCount = 1;
+
+		if ((dwCodePoint > 0xFFFF) && (dwCodePoint <= 0x10FFFF))
+		{
+			wUnits[0] = (WORD)(0xD800 + ((dwCodePoint - 0x10000) >> 10));
+			wUnits[1] = (WORD)(0xDC00 + ((dwCodePoint - 0x10000) & 0x3FF));
+			dwUnitsCount = 2;
+		}
+		else if (dwCodePoint > 0xFFFF)
+		{
+			wUnits[0] = 0xFFFD;
+		}
+
+		for (DWORD dwUnit = 0; dwUnit < dwUnitsCount; dwUnit++)
+		{
+			lpNarrowData[cbNarrowData++] = (BYTE)(wUnits[dwUnit] & 0xFF);
+			lpNarrowData[cbNarrowData++] = (BYTE)(wUnits[dwUnit] >> 8);
+		}
+	}
+
+	*lpcbNarrowData = cbNarrowData;
+	return lpNarrowData;
+}
+
+/// <summary>
+///		Convert UTF-16LE string data of trace to wide characters in place of value data,
+///		size recorded without data is scaled by code units only
+/// </summary>
+///
+/// <param name="lpValue">Value read from trace</param>
+///
+/// <returns>bool</returns>
+static bool WidenReplayValue(REPLAYVALUE* lpValue)
+{
+	if ((sizeof(WCHAR) == 2) || !(lpValue->bFlags & REPLAY_HAS_TYPE) || !IsReplayStringType(lpValue->dwType))
+	{
+		return true;
+	}
+
+	if (!(lpValue->bFlags & REPLAY_HAS_DATA))
+	{
+		lpValue->cbData = lpValue->cbData / 2 * sizeof(WCHAR);
+		return true;
+	}
+
+	DWORD cchUnits = lpValue->cbData / 2;
+	WCHAR* lpsWide = (WCHAR*)malloc(((SIZE_T)cchUnits + 1) * sizeof(WCHAR));
+	if (lpsWide == NULL)
+	{
+		return false;
+	}
+
+	DWORD cchWide = 0;
+	for (DWORD dwIndex = 0; dwIndex < cchUnits; dwIndex++)
+	{
+		DWORD dwUnit = lpValue->lpData[dwIndex * 2] | ((DWORD)lpValue->lpData[dwIndex * 2 + 1] << 8);
+
+		if ((dwUnit >= 0xD800) && (dwUnit <= 0xDBFF) && (dwIndex + 1 < cchUnits))
+		{
+			DWORD dwNext = lpValue->lpData[dwIndex * 2 + 2] | ((DWORD)lpValue->lpData[dwIndex * 2 + 3] << 8);
+			if ((dwNext >= 0xDC00) && (dwNext <= 0xDFFF))
+			{
+				dwUnit = 0x10000 + ((dwUnit - 0xD800) << 10) + (dwNext - 0xDC00);
+				dwIndex++;
+			}
+		}
+
+		lpsWide[cchWide++] = (WCHAR)dwUnit;
+	}
+
+	free(lpValue->lpData);
+	lpValue->lpData = (BYTE*)lpsWide;
+	lpValue->cbData = cchWide * sizeof(WCHAR);
+
+	return true;
+}
+
+/// <summary>
+///		Read LEB128 number
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReadReplayNumber(REPLAYREADER* lpReader, ULONGLONG* lpullValue)
+{
+	ULONGLONG ullValue = 0;
+
+	for (DWORD dwShift = 0; dwShift < REPLAY_MAX_NUMBER_SIZE * 7; dwShift += 7)
+	{
+		if (lpReader->cbPosition >= lpReader->cbSize)
+		{
+			return false;
+		}
+
+		BYTE bPart = lpReader->lpbData[lpReader->cbPosition++];
+		ullValue |= (ULONGLONG)(bPart & 0x7F) << dwShift;
+
+		if ((bPart & 0x80) == 0)
+		{
+			*lpullValue = ullValue;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+///		Read LEB128 number that fits DWORD
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReadReplayDword(REPLAYREADER* lpReader, DWORD* lpdwValue)
+{
+	ULONGLONG ullValue;
+	if (!ReadReplayNumber(lpReader, &ullValue) || (ullValue > MAXDWORD))
+	{
+		return false;
+	}
+
+	*lpdwValue = (DWORD)ullValue;
+	return true;
+}
+
+/// <summary>
+///		Read size and bytes into new buffer
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReadReplayBytes(REPLAYREADER* lpReader, BYTE** lplpData, DWORD* lpcbData)
+{
+	DWORD cbData;
+	if (!ReadReplayDword(lpReader, &cbData) || (cbData > lpReader->cbSize - lpReader->cbPosition))
+	{
+		return false;
+	}
+
+	*lplpData = (BYTE*)malloc((cbData == 0) ? 1 : cbData);
+	if (*lplpData == NULL)
+	{
+		return false;
+	}
+
+	memcpy(*lplpData, lpReader->lpbData + lpReader->cbPosition, cbData);
+	lpReader->cbPosition += cbData;
+	*lpcbData = cbData;
+
+	return true;
+}
+
+/// <summary>
+///		Read UTF-8 string into new null terminated wide string
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReadReplayString(REPLAYREADER* lpReader, LPWSTR* lpsText, DWORD* lpcchText)
+{
+	DWORD cbText;
+	if (!ReadReplayDword(lpReader, &cbText) || (cbText > lpReader->cbSize - lpReader->cbPosition))
+	{
+		return false;
+	}
+
+	*lpsText = (LPWSTR)malloc(((SIZE_T)cbText + 1) * sizeof(WCHAR));
+	if (*lpsText == NULL)
+	{
+		return false;
+	}
+
+	*lpcchText = Utf8ToUtf16((LPCSTR)lpReader->lpbData + lpReader->cbPosition, cbText, *lpsText, cbText);
+	(*lpsText)[*lpcchText] = L'\0';
+	lpReader->cbPosition += cbText;
+
+	return true;
+}
+
+/// <summary>
+///		Read key id referenced by call record
+/// </summary>
+///
+/// <returns>REPLAYKEY* (NULL if id is not defined)</returns>
+static REPLAYKEY* ReadReplayKey(REPLAYREADER* lpReader, REPLAYPATHS* lpPaths)
+{
+	DWORD dwKey;
+	if (!ReadReplayDword(lpReader, &dwKey) || (dwKey >= lpPaths->dwKeysCount))
+	{
+		return NULL;
+	}
+
+	return &lpPaths->lpKeys[dwKey];
+}
+
+/// <summary>
+///		Read outputs of value call
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReadReplayValue(REPLAYREADER* lpReader, REPLAYVALUE* lpValue)
+{
+	ZeroMemory(lpValue, sizeof(REPLAYVALUE));
+	lpValue->bRecorded = true;
+
+	DWORD dwStatus = 0, dwFlags = 0;
+	bool bResult = ReadReplayDword(lpReader, &dwStatus) &&
+		ReadReplayNumber(lpReader, &lpValue->ullLatency) &&
+		ReadReplayDword(lpReader, &dwFlags);
+
+	lpValue->lStatus = (LONG)dwStatus;
+	lpValue->bFlags = (BYTE)dwFlags;
+
+	bResult = bResult && (!(dwFlags & REPLAY_HAS_NAME) || ReadReplayString(lpReader, &lpValue->lpsName, &lpValue->cchName));
+	bResult = bResult && (!(dwFlags & REPLAY_HAS_TYPE) || ReadReplayDword(lpReader, &lpValue->dwType));
+
+	if (dwFlags & REPLAY_HAS_DATA)
+	{
+		bResult = bResult && ReadReplayBytes(lpReader, &lpValue->lpData, &lpValue->cbData);
+	}
+	else if (dwFlags & REPLAY_HAS_SIZE)
+	{
+		bResult = bResult && ReadReplayDword(lpReader, &lpValue->cbData);
+	}
+
+	return bResult && WidenReplayValue(lpValue);
+}
+
+/// <summary>
+///		Keep value response, response with data replaces one recorded without it
+/// </summary>
+///
+/// <returns>void</returns>
+static void StoreReplayValue(REPLAYVALUE* lpSlot, REPLAYVALUE* lpValue)
+{
+	if (!lpSlot->bRecorded || ((lpValue->bFlags & REPLAY_HAS_DATA) && !(lpSlot->bFlags & REPLAY_HAS_DATA)))
+	{
+		free(lpSlot->lpsName);
+		free(lpSlot->lpData);
+		*lpSlot = *lpValue;
+	}
+	else
+	{
+		free(lpValue->lpsName);
+		free(lpValue->lpData);
+	}
+}
+
+/// <summary>
+///		Read one record into key table
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool ReadReplayRecord(REPLAYREADER* lpReader, REPLAYPATHS* lpPaths)
+{
+	DWORD dwRecord, dwStatus, dwIndex;
+	ULONGLONG ullLatency, ullTime;
+	REPLAYKEY* lpKey;
+
+	if (!ReadReplayDword(lpReader, &dwRecord))
+	{
+		return false;
+	}
+
+	if (dwRecord == REPLAY_RECORD_KEY)
+	{
+		DWORD dwParent, cchPath;
+		LPWSTR lpsPath;
+
+		if (!ReadReplayDword(lpReader, &dwParent) || !ReadReplayString(lpReader, &lpsPath, &cchPath))
+		{
+			return false;
+		}
+
+		dwParent--;
+		bool bResult = ((dwParent == REPLAY_NO_KEY) || (dwParent < lpPaths->dwKeysCount)) &&
+			(FindReplayPath(lpPaths, dwParent, lpsPath) == REPLAY_NO_KEY) &&
+			(AddReplayPath(lpPaths, dwParent, lpsPath) != REPLAY_NO_KEY);
+		free(lpsPath);
+
+		return bResult;
+	}
+
+	if (dwRecord == REPLAY_RECORD_OPEN)
+	{
+		if (((lpKey = ReadReplayKey(lpReader, lpPaths)) == NULL) || !ReadReplayDword(lpReader, &dwStatus) || !ReadReplayNumber(lpReader, &ullLatency))
+		{
+			return false;
+		}
+
+		if (!lpKey->bOpened)
+		{
+			lpKey->bOpened = true;
+			lpKey->lOpenStatus = (LONG)dwStatus;
+			lpKey->ullOpenLatency = ullLatency;
+		}
+
+		return true;
+	}
+
+	if (dwRecord == REPLAY_RECORD_ENUM_KEY)
+	{
+		REPLAYSUBKEY rsSubKey;
+		ZeroMemory(&rsSubKey, sizeof(REPLAYSUBKEY));
+
+		if (((lpKey = ReadReplayKey(lpReader, lpPaths)) == NULL) || !ReadReplayDword(lpReader, &dwIndex) ||
+			!ReadReplayDword(lpReader, &dwStatus) || !ReadReplayNumber(lpReader, &rsSubKey.ullLatency))
+		{
+			return false;
+		}
+
+		rsSubKey.bRecorded = true;
+		rsSubKey.lStatus = (LONG)dwStatus;
+
+		if ((rsSubKey.lStatus == REPLAY_STATUS_SUCCESS) &&
+			(!ReadReplayString(lpReader, &rsSubKey.lpsName, &rsSubKey.cchName) || !ReadReplayNumber(lpReader, &rsSubKey.ullLastWriteTime)))
+		{
+			free(rsSubKey.lpsName);
+			return false;
+		}
+
+		if ((dwIndex >= REPLAY_MAX_INDEX) || !ReserveArray((void**)&lpKey->lpSubKeys, &lpKey->dwSubKeysCapacity, dwIndex + 1, sizeof(REPLAYSUBKEY)))
+		{
+			free(rsSubKey.lpsName);
+			return false;
+		}
+
+		if (lpKey->lpSubKeys[dwIndex].bRecorded)
+		{
+			free(rsSubKey.lpsName);
+		}
+		else
+		{
+			lpKey->lpSubKeys[dwIndex] = rsSubKey;
+		}
+
+		return true;
+	}
+
+	if (dwRecord == REPLAY_RECORD_ENUM_VALUE)
+	{
+		REPLAYVALUE rvValue;
+
+		if (((lpKey = ReadReplayKey(lpReader, lpPaths)) == NULL) || !ReadReplayDword(lpReader, &dwIndex))
+		{
+			return false;
+		}
+
+		if (!ReadReplayValue(lpReader, &rvValue) || (dwIndex >= REPLAY_MAX_INDEX) ||
+			!ReserveArray((void**)&lpKey->lpValues, &lpKey->dwValuesCapacity, dwIndex + 1, sizeof(REPLAYVALUE)))
+		{
+			free(rvValue.lpsName);
+			free(rvValue.lpData);
+			return false;
+		}
+
+		StoreReplayValue(&lpKey->lpValues[dwIndex], &rvValue);
+
+		return true;
+	}
+
+	if (dwRecord == REPLAY_RECORD_QUERY_INFO)
+	{
+		DWORD dwCounters[REPLAY_KEY_COUNTERS_COUNT];
+
+		if (((lpKey = ReadReplayKey(lpReader, lpPaths)) == NULL) || !ReadReplayDword(lpReader, &dwStatus) || !ReadReplayNumber(lpReader, &ullLatency))
+		{
+			return false;
+		}
+
+		bool bSucceeded = (LONG)dwStatus == REPLAY_STATUS_SUCCESS;
+		for (DWORD dwCounter = 0; bSucceeded && (dwCounter < REPLAY_KEY_COUNTERS_COUNT); dwCounter++)
+		{
+			if (!ReadReplayDword(lpReader, &dwCounters[dwCounter]))
+			{
+				return false;
+			}
+		}
+
+		if (bSucceeded && !ReadReplayNumber(lpReader, &ullTime))
+		{
+			return false;
+		}
+
+		if (!lpKey->bInfo)
+		{
+			lpKey->bInfo = true;
+			lpKey->lInfoStatus = (LONG)dwStatus;
+			lpKey->ullInfoLatency = ullLatency;
+
+			if (bSucceeded)
+			{
+				lpKey->dwSubKeysCount = dwCounters[0];
+				lpKey->dwMaxSubKeyLength = dwCounters[1];
+				lpKey->dwValuesCount = dwCounters[2];
+				lpKey->dwMaxValueNameLength = dwCounters[3];
+				lpKey->cbMaxValueSize = dwCounters[4];
+				lpKey->ullLastWriteTime = ullTime;
+			}
+		}
+
+		return true;
+	}
+
+	if (dwRecord == REPLAY_RECORD_QUERY_VALUE)
+	{
+		REPLAYVALUE rvValue;
+
+		if ((lpKey = ReadReplayKey(lpReader, lpPaths)) == NULL)
+		{
+			return false;
+		}
+
+		if (!ReadReplayValue(lpReader, &rvValue) || !(rvValue.bFlags & REPLAY_HAS_NAME))
+		{
+			free(rvValue.lpsName);
+			free(rvValue.lpData);
+			return false;
+		}
+
+		REPLAYVALUE* lpQueried = (REPLAYVALUE*)FindReplayQueriedValue(lpKey, rvValue.lpsName);
+		if (lpQueried != NULL)
+		{
+			StoreReplayValue(lpQueried, &rvValue);
+			return true;
+		}
+
+		if ((lpKey->dwQueriedCount >= REPLAY_MAX_INDEX) ||
+			!ReserveArray((void**)&lpKey->lpQueriedValues, &lpKey->dwQueriedCapacity, lpKey->dwQueriedCount + 1, sizeof(REPLAYVALUE)))
+		{
+			free(rvValue.lpsName);
+			free(rvValue.lpData);
+			return false;
+		}
+
+		lpKey->lpQueriedValues[lpKey->dwQueriedCount++] = rvValue;
+
+		return true;
+	}
+
+	return false;
+}
+
+/// <summary>
+///		Read whole trace into empty key table, table is freed if trace is malformed
+/// </summary>
+///
+/// <param name="lpbData">Trace file contents</param>
+/// <param name="cbSize">Trace size</param>
+/// <param name="lpPaths">Key table</param>
+///
+/// <returns>bool</returns>
+bool ReadReplayTrace(const BYTE* lpbData, SIZE_T cbSize, REPLAYPATHS* lpPaths)
+{
+	REPLAYREADER rrReader = { lpbData, cbSize, 0 };
+	ULONGLONG ullMagic, ullVersion;
+
+	bool bResult = (lpbData != NULL) && ReadReplayNumber(&rrReader, &ullMagic) && (ullMagic == REPLAY_MAGIC) &&
+		ReadReplayNumber(&rrReader, &ullVersion) && (ullVersion == REPLAY_VERSION);
+
+	while (bResult && (rrReader.cbPosition < rrReader.cbSize))
+	{
+		bResult = ReadReplayRecord(&rrReader, lpPaths);
+	}
+
+	if (!bResult)
+	{
+		FreeReplayPaths(lpPaths);
+	}
+
+	return bResult;
+}
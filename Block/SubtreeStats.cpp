@@ -0,0 +1,521 @@
+#include "../Api/Platform.h"
+#include <stdlib.h>
+
+#include "../Api/SubtreeStats.h"
+#include "../Api/RegistryEditor.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Throttle.h"
+#include "../Api/Progress.h"
+
+/// <summary>
+///		Compare branches: more value data first, then more keys
+/// </summary>
+/// 
+/// <param name="lpFirst">First totals</param>
+/// <param name="lpSecond">Second totals</param>
+/// 
+/// <returns>bool (true if first branch is heavier)</returns>
+static bool IsHeavier(const SUBTREETOTALS* lpFirst, const SUBTREETOTALS* lpSecond)
+{
+	if (lpFirst->ullDataBytes != lpSecond->ullDataBytes)
+	{
+		return lpFirst->ullDataBytes > lpSecond->ullDataBytes;
+	}
+
+	return lpFirst->ullKeysCount > lpSecond->ullKeysCount;
+}
+
+/// <summary>
+///		qsort callback, heaviest branches first
+/// </summary>
+/// 
+/// <returns>int</returns>
+static int CompareBranches(const void* lpFirst, const void* lpSecond)
+{
+	const SUBTREETOTALS* lpFirstTotals = &((const BRANCHTOTALS*)lpFirst)->stTotals;
+	const SUBTREETOTALS* lpSecondTotals = &((const BRANCHTOTALS*)lpSecond)->stTotals;
+
+	return IsHeavier(lpFirstTotals, lpSecondTotals) ? -1 : (IsHeavier(lpSecondTotals, lpFirstTotals) ? 1 : 0);
+}
+
+/// <summary>
+///		Add totals of subkey to totals of its parent
+/// </summary>
+/// 
+/// <param name="lpParent">Parent totals</param>
+/// <param name="lpChild">Subkey totals</param>
+/// 
+/// <returns>void</returns>
+static void MergeTotals(SUBTREETOTALS* lpParent, const SUBTREETOTALS* lpChild)
+{
+	lpParent->ullKeysCount += lpChild->ullKeysCount;
+	lpParent->ullValuesCount += lpChild->ullValuesCount;
+	lpParent->ullDataBytes += lpChild->ullDataBytes;
+
+	if (lpChild->dwMaxDepth + 1 > lpParent->dwMaxDepth)
+	{
+		lpParent->dwMaxDepth = lpChild->dwMaxDepth + 1;
+	}
+	if (CompareFileTime(&lpChild->ftNewestWrite, &lpParent->ftNewestWrite) > 0)
+	{
+		lpParent->ftNewestWrite = lpChild->ftNewestWrite;
+	}
+}
+
+/// <summary>
+///		Get subkeys counts of histogram bucket: 0, 1, 2-3, 4-7, ...
+/// </summary>
+/// 
+/// <param name="dwBucket">Bucket index</param>
+/// <param name="lpdwFirst">Smallest count</param>
+/// <param name="lpdwLast">Largest count</param>
+/// 
+/// <returns>void</returns>
+void GetFanOutBucketRange(DWORD dwBucket, DWORD* lpdwFirst, DWORD* lpdwLast)
+{
+	*lpdwFirst = (dwBucket == 0) ? 0 : (1UL << (dwBucket - 1));
+	*lpdwLast = (dwBucket == 0) ? 0 : ((dwBucket == STATS_FANOUT_BUCKETS - 1) ? MAXDWORD : (1UL << dwBucket) - 1);
+}
+
+/// <summary>
+///		Count key in fan-out histogram
+/// </summary>
+/// 
+/// <param name="lpWalker">Walker</param>
+/// <param name="dwSubKeysCount">Subkeys count of key</param>
+/// 
+/// <returns>void</returns>
+static void CountFanOut(STATSWALKER* lpWalker, DWORD dwSubKeysCount)
+{
+	DWORD dwBucket = 0;
+	while ((dwSubKeysCount != 0) && (dwBucket < STATS_FANOUT_BUCKETS - 1))
+	{
+		dwSubKeysCount >>= 1;
+		dwBucket++;
+	}
+
+	lpWalker->ullFanOutHistogram[dwBucket]++;
+}
+
+/// <summary>
+///		Put branch to min-heap of heaviest branches, heap takes ownership of path
+/// </summary>
+/// 
+/// <param name="lpWalker">Walker</param>
+/// <param name="lpsKeyPath">Branch path (released if branch is too light)</param>
+/// <param name="lpTotals">Branch totals</param>
+/// 
+/// <returns>void</returns>
+static void PushBranch(STATSWALKER* lpWalker, LPWSTR lpsKeyPath, const SUBTREETOTALS* lpTotals)
+{
+	BRANCHTOTALS* lpHeap = lpWalker->lpHeap;
+	DWORD dwIndex;
+
+	if (lpsKeyPath == NULL)
+	{
+		return;
+	}
+
+	if (lpWalker->dwHeapCount < lpWalker->dwTopCount)
+	{
+		// Sift up from new leaf
+		dwIndex = lpWalker->dwHeapCount++;
+		while ((dwIndex > 0) && IsHeavier(&lpHeap[(dwIndex - 1) / 2].stTotals, lpTotals))
+		{
+			lpHeap[dwIndex] = lpHeap[(dwIndex - 1) / 2];
+			dwIndex = (dwIndex - 1) / 2;
+		}
+	}
+	else if ((lpWalker->dwHeapCount != 0) && IsHeavier(lpTotals, &lpHeap[0].stTotals))
+	{
+		// Replace lightest branch and sift down
+		free(lpHeap[0].lpsKeyPath);
+		dwIndex = 0;
+		for (;;)
+		{
+			DWORD dwChild = dwIndex * 2 + 1;
+			if (dwChild >= lpWalker->dwHeapCount)
+			{
+				break;
+			}
+			if ((dwChild + 1 < lpWalker->dwHeapCount) && IsHeavier(&lpHeap[dwChild].stTotals, &lpHeap[dwChild + 1].stTotals))
+			{
+				dwChild++;
+			}
+			if (!IsHeavier(lpTotals, &lpHeap[dwChild].stTotals))
+			{
+				break;
+			}
+
+			lpHeap[dwIndex] = lpHeap[dwChild];
+			dwIndex = dwChild;
+		}
+	}
+	else
+	{
+		free(lpsKeyPath);
+		return;
+	}
+
+	lpHeap[dwIndex].lpsKeyPath = lpsKeyPath;
+	lpHeap[dwIndex].stTotals = *lpTotals;
+}
+
+/// <summary>
+///		Offer key at current walker path as one of heaviest branches
+/// </summary>
+/// 
+/// <param name="lpWalker">Walker</param>
+/// <param name="lpTotals">Subtree totals of key</param>
+/// 
+/// <returns>void</returns>
+static void OfferBranch(STATSWALKER* lpWalker, const SUBTREETOTALS* lpTotals)
+{
+	// Path is copied only when branch gets into heap
+	if ((lpWalker->dwHeapCount < lpWalker->dwTopCount) ||
+		((lpWalker->dwHeapCount != 0) && IsHeavier(lpTotals, &lpWalker->lpHeap[0].stTotals)))
+	{
+		PushBranch(lpWalker, _wcsdup(lpWalker->lpsPath), lpTotals);
+	}
+}
+
+/// <summary>
+///		Get totals of key itself: counters from RegQueryInfoKey, data sizes without reading data
+/// </summary>
+/// 
+/// <param name="lpWalker">Walker</param>
+/// <param name="hKey">Opened key</param>
+/// <param name="lpdwSubKeysCount">Subkeys count</param>
+/// <param name="lpTotals">Key totals</param>
+/// 
+/// <returns>bool</returns>
+static bool ReadKeyTotals(STATSWALKER* lpWalker, HKEY hKey, DWORD* lpdwSubKeysCount, SUBTREETOTALS* lpTotals)
+{
+	DWORD dwValuesCount;
+
+	ZeroMemory(lpTotals, sizeof(SUBTREETOTALS));
+	lpTotals->ullKeysCount = 1;
+	*lpdwSubKeysCount = 0;
+
+	if (!QueryRegKeyInfo(hKey, lpdwSubKeysCount, &dwValuesCount, NULL, &lpTotals->ftNewestWrite))
+	{
+		return false;
+	}
+
+	lpTotals->ullValuesCount = dwValuesCount;
+	for (DWORD dwIndex = 0; dwIndex < dwValuesCount; dwIndex++)
+	{
+		DWORD dwNameSize = STATS_MAX_VALUE_NAME_LENGTH;
+		DWORD cbData = 0;
+
+		if (EnumRegValue(hKey, dwIndex, lpWalker->lpsValueName, &dwNameSize, NULL, NULL, &cbData) == ERROR_SUCCESS)
+		{
+			lpTotals->ullDataBytes += cbData;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Aggregate subtree bottom-up, subkey names are enumerated straight into walker path
+/// </summary>
+/// 
+/// <param name="lpWalker">Walker (path holds key path)</param>
+/// <param name="hKey">Opened key</param>
+/// <param name="dwPathLength">Key path length</param>
+/// <param name="lpTotals">Subtree totals</param>
+/// 
+/// <returns>void</returns>
+static void WalkSubtree(STATSWALKER* lpWalker, HKEY hKey, DWORD dwPathLength, SUBTREETOTALS* lpTotals)
+{
+	DWORD dwSubKeysCount;
+	if (!ReadKeyTotals(lpWalker, hKey, &dwSubKeysCount, lpTotals))
+	{
+		lpWalker->ullUnreadableKeys++;
+	}
+
+	CountFanOut(lpWalker, dwSubKeysCount);
+
+	LPWSTR lpsSubKeyName = lpWalker->lpsPath + dwPathLength + 1;
+	DWORD cchAvailable = STATS_MAX_PATH_LENGTH - dwPathLength - 1;
+
+	for (DWORD dwIndex = 0; (dwIndex < dwSubKeysCount) && (cchAvailable > 1); dwIndex++)
+	{
+		DWORD dwNameSize = cchAvailable;
+		LRESULT error = EnumRegKey(hKey, dwIndex, lpsSubKeyName, &dwNameSize, NULL);
+
+		if (error == ERROR_NO_MORE_ITEMS)
+		{
+			break;
+		}
+		if (error != ERROR_SUCCESS)
+		{
+			continue;
+		}
+
+		STAT_ADD(ullKeysVisited, 1);
+		ThrottleKeys(1);
+		AdvanceProgress(1);
+		lpWalker->lpsPath[dwPathLength] = L'\\';
+
+		SUBTREETOTALS stSubKeyTotals;
+		HKEY hSubKey;
+
+		if (OpenRegKey(hKey, lpsSubKeyName, KEY_READ, &hSubKey))
+		{
+			WalkSubtree(lpWalker, hSubKey, dwPathLength + 1 + dwNameSize, &stSubKeyTotals);
+			CloseRegKey(hSubKey);
+		}
+		else
+		{
+			ZeroMemory(&stSubKeyTotals, sizeof(SUBTREETOTALS));
+			stSubKeyTotals.ullKeysCount = 1;
+			lpWalker->ullUnreadableKeys++;
+		}
+
+		MergeTotals(lpTotals, &stSubKeyTotals);
+	}
+
+	// Subkeys overwrote the tail of path
+	lpWalker->lpsPath[dwPathLength] = L'\0';
+	OfferBranch(lpWalker, lpTotals);
+}
+
+/// <summary>
+///		Worker thread: takes top-level branches one by one until none is left
+/// </summary>
+/// 
+/// <param name="lpParameter">STATSWORKER</param>
+/// 
+/// <returns>DWORD</returns>
+static DWORD WINAPI WalkBranches(LPVOID lpParameter)
+{
+	STATSWORKER* lpWorker = (STATSWORKER*)lpParameter;
+	STATSBRANCHES* lpBranches = lpWorker->lpBranches;
+	STATSWALKER* lpWalker = lpWorker->lpWalker;
+
+	for (;;)
+	{
+		LONG lBranch = InterlockedIncrement(&lpBranches->lNextBranch) - 1;
+		if (lBranch >= (LONG)lpBranches->dwNamesCount)
+		{
+			break;
+		}
+
+		LPWSTR lpsName = lpBranches->lpsNames[lBranch];
+		SUBTREETOTALS* lpTotals = &lpBranches->lpTotals[lBranch];
+		HKEY hSubKey;
+
+		wcscpy_s(lpWalker->lpsPath, STATS_MAX_PATH_LENGTH, lpsName);
+		if (OpenRegKey(lpBranches->hKeyRoot, lpsName, KEY_READ, &hSubKey))
+		{
+			BeginProgressBranch((DWORD)lBranch);
+			WalkSubtree(lpWalker, hSubKey, lstrlen(lpsName), lpTotals);
+			CloseRegKey(hSubKey);
+			EndProgressBranch();
+		}
+		else
+		{
+			lpTotals->ullKeysCount = 1;
+			lpWalker->ullUnreadableKeys++;
+		}
+	}
+
+	// Keys counted outside of branches are still pending
+	FlushProgress();
+
+	return 0;
+}
+
+/// <summary>
+///		Create walker with heap for heaviest branches
+/// </summary>
+/// 
+/// <param name="dwTopCount">Heaviest branches count</param>
+/// 
+/// <returns>STATSWALKER*</returns>
+static STATSWALKER* CreateWalker(DWORD dwTopCount)
+{
+	STATSWALKER* lpWalker = (STATSWALKER*)calloc(1, sizeof(STATSWALKER));
+	if (lpWalker == NULL)
+	{
+		return NULL;
+	}
+
+	lpWalker->dwTopCount = dwTopCount;
+	lpWalker->lpHeap = (BRANCHTOTALS*)calloc(dwTopCount + 1, sizeof(BRANCHTOTALS));
+	if (lpWalker->lpHeap == NULL)
+	{
+		free(lpWalker);
+		return NULL;
+	}
+
+	return lpWalker;
+}
+
+/// <summary>
+///		Collect size statistics of subtree, top-level branches are walked in parallel
+/// </summary>
+/// 
+/// <param name="hKey">Opened subtree root</param>
+/// <param name="dwTopCount">Heaviest branches count</param>
+/// <param name="lpStats">Statistics, release with FreeSubtreeStats</param>
+/// 
+/// <returns>bool</returns>
+bool CollectSubtreeStats(HKEY hKey, DWORD dwTopCount, SUBTREESTATS* lpStats)
+{
+	ZeroMemory(lpStats, sizeof(SUBTREESTATS));
+
+	STATSWALKER* lpRootWalker = CreateWalker(dwTopCount);
+	if (lpRootWalker == NULL)
+	{
+		return false;
+	}
+
+	BeginProgressWalk(hKey);
+
+	DWORD dwSubKeysCount;
+	if (!ReadKeyTotals(lpRootWalker, hKey, &dwSubKeysCount, &lpStats->stTotals))
+	{
+		free(lpRootWalker->lpHeap);
+		free(lpRootWalker);
+		return false;
+	}
+
+	CountFanOut(lpRootWalker, dwSubKeysCount);
+
+	// Names of top-level branches, counter is used to size list
+	STATSBRANCHES sbBranches;
+	ZeroMemory(&sbBranches, sizeof(STATSBRANCHES));
+	sbBranches.hKeyRoot = hKey;
+	sbBranches.lpsNames = (LPWSTR*)calloc(dwSubKeysCount + 1, sizeof(LPWSTR));
+	sbBranches.lpTotals = (SUBTREETOTALS*)calloc(dwSubKeysCount + 1, sizeof(SUBTREETOTALS));
+
+	bool bResult = (sbBranches.lpsNames != NULL) && (sbBranches.lpTotals != NULL);
+	for (DWORD dwIndex = 0; bResult && (dwIndex < dwSubKeysCount); dwIndex++)
+	{
+		DWORD dwNameSize = STATS_MAX_PATH_LENGTH;
+		if (EnumRegKey(hKey, dwIndex, lpRootWalker->lpsPath, &dwNameSize, NULL) != ERROR_SUCCESS)
+		{
+			break;
+		}
+
+		STAT_ADD(ullKeysVisited, 1);
+		ThrottleKeys(1);
+		AdvanceProgress(1);
+		sbBranches.lpsNames[sbBranches.dwNamesCount] = _wcsdup(lpRootWalker->lpsPath);
+		bResult = sbBranches.lpsNames[sbBranches.dwNamesCount] != NULL;
+		sbBranches.dwNamesCount += bResult ? 1 : 0;
+	}
+
+	// Current thread is one of workers
+	SYSTEM_INFO siSystemInfo;
+	GetSystemInfo(&siSystemInfo);
+
+	DWORD dwThreadsCount = siSystemInfo.dwNumberOfProcessors;
+	if (dwThreadsCount > STATS_MAX_THREADS)
+	{
+		dwThreadsCount = STATS_MAX_THREADS;
+	}
+	if (dwThreadsCount > sbBranches.dwNamesCount)
+	{
+		dwThreadsCount = (sbBranches.dwNamesCount == 0) ? 1 : sbBranches.dwNamesCount;
+	}
+	STATSWORKER swWorkers[STATS_MAX_THREADS];
+	HANDLE hThreads[STATS_MAX_THREADS];
+	DWORD dwStartedCount = 0;
+
+	ZeroMemory(swWorkers, sizeof(swWorkers));
+	swWorkers[0].lpWalker = lpRootWalker;
+	for (DWORD dwIndex = 0; bResult && (dwIndex < dwThreadsCount); dwIndex++)
+	{
+		swWorkers[dwIndex].lpBranches = &sbBranches;
+		if (dwIndex == 0)
+		{
+			continue;
+		}
+
+		// Branches of thread that failed to start are taken by others
+		swWorkers[dwIndex].lpWalker = CreateWalker(dwTopCount);
+		if (swWorkers[dwIndex].lpWalker != NULL)
+		{
+			hThreads[dwStartedCount] = CreateThread(NULL, 0, WalkBranches, &swWorkers[dwIndex], 0, NULL);
+			dwStartedCount += (hThreads[dwStartedCount] != NULL) ? 1 : 0;
+		}
+	}
+
+	if (bResult)
+	{
+		WalkBranches(&swWorkers[0]);
+	}
+	if (dwStartedCount != 0)
+	{
+		WaitForMultipleObjects(dwStartedCount, hThreads, TRUE, INFINITE);
+	}
+	for (DWORD dwIndex = 0; dwIndex < dwStartedCount; dwIndex++)
+	{
+		CloseHandle(hThreads[dwIndex]);
+	}
+
+	for (DWORD dwIndex = 0; dwIndex < sbBranches.dwNamesCount; dwIndex++)
+	{
+		MergeTotals(&lpStats->stTotals, &sbBranches.lpTotals[dwIndex]);
+		free(sbBranches.lpsNames[dwIndex]);
+	}
+	free(sbBranches.lpsNames);
+	free(sbBranches.lpTotals);
+
+	// Merge walkers: counters are summed, heaps are poured into the first one
+	for (DWORD dwIndex = 0; dwIndex < dwThreadsCount; dwIndex++)
+	{
+		STATSWALKER* lpWalker = swWorkers[dwIndex].lpWalker;
+		if (lpWalker == NULL)
+		{
+			continue;
+		}
+
+		for (DWORD dwBucket = 0; dwBucket < STATS_FANOUT_BUCKETS; dwBucket++)
+		{
+			lpStats->ullFanOutHistogram[dwBucket] += lpWalker->ullFanOutHistogram[dwBucket];
+		}
+		lpStats->ullUnreadableKeys += lpWalker->ullUnreadableKeys;
+
+		if (lpWalker != lpRootWalker)
+		{
+			for (DWORD dwHeapIndex = 0; dwHeapIndex < lpWalker->dwHeapCount; dwHeapIndex++)
+			{
+				PushBranch(lpRootWalker, lpWalker->lpHeap[dwHeapIndex].lpsKeyPath, &lpWalker->lpHeap[dwHeapIndex].stTotals);
+			}
+
+			free(lpWalker->lpHeap);
+			free(lpWalker);
+		}
+	}
+
+	qsort(lpRootWalker->lpHeap, lpRootWalker->dwHeapCount, sizeof(BRANCHTOTALS), CompareBranches);
+	lpStats->lpTopBranches = lpRootWalker->lpHeap;
+	lpStats->dwTopCount = lpRootWalker->dwHeapCount;
+	lpStats->dwThreadsCount = dwStartedCount + 1;
+	free(lpRootWalker);
+
+	return bResult;
+}
+
+/// <summary>
+///		Release heaviest branches list
+/// </summary>
+/// 
+/// <param name="lpStats">Statistics</param>
+/// 
+/// <returns>void</returns>
+void FreeSubtreeStats(SUBTREESTATS* lpStats)
+{
+	for (DWORD dwIndex = 0; dwIndex < lpStats->dwTopCount; dwIndex++)
+	{
+		free(lpStats->lpTopBranches[dwIndex].lpsKeyPath);
+	}
+
+	free(lpStats->lpTopBranches);
+	ZeroMemory(lpStats, sizeof(SUBTREESTATS));
+}
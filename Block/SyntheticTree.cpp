@@ -0,0 +1,519 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/SyntheticTree.h"
+
+const WCHAR SYNTHETIC_NAME_ALPHABET[] = L"abcdefghijklmnopqrstuvwxyz0123456789";
+const WCHAR SYNTHETIC_VALUE_PREFIX[] = L"Value";
+const DWORD SYNTHETIC_VALUE_NAME_LENGTH = 16;
+const DWORD SYNTHETIC_VALUE_DATA_LENGTH = 128;
+
+// 2020-01-01 00:00:00 UTC in FILETIME units
+const ULONGLONG SYNTHETIC_BASE_WRITE_TIME = 132223104000000000ull;
+const ULONGLONG SYNTHETIC_WRITE_TIME_SPREAD = 10000000ull * 60 * 60 * 24 * 365;
+
+/// <summary>
+///		Get next pseudo random number (xorshift32), same seed gives same tree
+/// </summary>
+/// 
+/// <param name="lpdwState">Generator state</param>
+/// 
+/// <returns>DWORD</returns>
+static DWORD NextRandom(DWORD* lpdwState)
+{
+	DWORD dwValue = *lpdwState;
+	dwValue ^= dwValue << 13;
+	dwValue ^= dwValue >> 17;
+	dwValue ^= dwValue << 5;
+	*lpdwState = dwValue;
+
+	return dwValue;
+}
+
+/// <summary>
+///		Fill default generator parameters (about 37 thousand keys)
+/// </summary>
+/// 
+/// <param name="lpParams">Generator parameters</param>
+/// 
+/// <returns>void</returns>
+void GetDefaultSyntheticTreeParams(SYNTHETICTREEPARAMS* lpParams)
+{
+	lpParams->dwFanOut = 8;
+	lpParams->dwDepth = 5;
+	lpParams->dwMinNameLength = 4;
+	lpParams->dwMaxNameLength = 16;
+	lpParams->dwValuesPerKey = 4;
+	lpParams->dwSeed = 1;
+}
+
+/// <summary>
+///		Generate subkeys of key down to necessary depth
+/// </summary>
+/// 
+/// <param name="lpKey">Key</param>
+/// <param name="lpParams">Generator parameters</param>
+/// <param name="dwLevel">Key level</param>
+/// <param name="lpdwState">Generator state</param>
+/// <param name="lpdwKeysCount">Generated keys count</param>
+/// 
+/// <returns>bool</returns>
+static bool GenerateSubKeys(SYNTHETICKEY* lpKey, const SYNTHETICTREEPARAMS* lpParams, DWORD dwLevel, DWORD* lpdwState, DWORD* lpdwKeysCount)
+{
+	if (dwLevel >= lpParams->dwDepth)
+	{
+		return true;
+	}
+
+	lpKey->lpSubKeys = (SYNTHETICKEY*)calloc(lpParams->dwFanOut, sizeof(SYNTHETICKEY));
+	if (lpKey->lpSubKeys == NULL)
+	{
+		return false;
+	}
+
+	DWORD dwNameLengthSpread = lpParams->dwMaxNameLength - lpParams->dwMinNameLength + 1;
+
+	for (DWORD dwSubKeyIndex = 0; dwSubKeyIndex < lpParams->dwFanOut; dwSubKeyIndex++)
+	{
+		SYNTHETICKEY* lpSubKey = &lpKey->lpSubKeys[dwSubKeyIndex];
+		DWORD dwNameLength = lpParams->dwMinNameLength + NextRandom(lpdwState) % dwNameLengthSpread;
+
+		lpSubKey->lpsName = (LPWSTR)calloc(dwNameLength + 1, sizeof(WCHAR));
+		if (lpSubKey->lpsName == NULL)
+		{
+			return false;
+		}
+
+		for (DWORD dwCharIndex = 0; dwCharIndex < dwNameLength; dwCharIndex++)
+		{
+			lpSubKey->lpsName[dwCharIndex] = SYNTHETIC_NAME_ALPHABET[NextRandom(lpdwState) % SYNTHETIC_NAME_ALPHABET_SIZE];
+		}
+
+		ULARGE_INTEGER uiWriteTime;
+		uiWriteTime.QuadPart = SYNTHETIC_BASE_WRITE_TIME + ((ULONGLONG)NextRandom(lpdwState) * 10000000ull) % SYNTHETIC_WRITE_TIME_SPREAD;
+
+		lpSubKey->dwNameLength = dwNameLength;
+		lpSubKey->dwValuesCount = lpParams->dwValuesPerKey;
+		lpSubKey->ftLastWriteTime.dwLowDateTime = uiWriteTime.LowPart;
+		lpSubKey->ftLastWriteTime.dwHighDateTime = uiWriteTime.HighPart;
+		lpKey->dwSubKeysCount++;
+		(*lpdwKeysCount)++;
+
+		if (!GenerateSubKeys(lpSubKey, lpParams, dwLevel + 1, lpdwState, lpdwKeysCount))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Release subkeys of key
+/// </summary>
+/// 
+/// <param name="lpKey">Key</param>
+/// 
+/// <returns>void</returns>
+static void FreeSubKeys(SYNTHETICKEY* lpKey)
+{
+	for (DWORD dwSubKeyIndex = 0; dwSubKeyIndex < lpKey->dwSubKeysCount; dwSubKeyIndex++)
+	{
+		FreeSubKeys(&lpKey->lpSubKeys[dwSubKeyIndex]);
+		free(lpKey->lpSubKeys[dwSubKeyIndex].lpsName);
+	}
+
+	free(lpKey->lpSubKeys);
+}
+
+/// <summary>
+///		Generate deterministic in-memory key tree
+/// </summary>
+/// 
+/// <param name="lpParams">Generator parameters</param>
+/// <param name="lpdwKeysCount">Generated keys count (without root)</param>
+/// 
+/// <returns>SYNTHETICKEY*</returns>
+SYNTHETICKEY* GenerateSyntheticTree(const SYNTHETICTREEPARAMS* lpParams, DWORD* lpdwKeysCount)
+{
+	if ((lpParams == NULL) || (lpdwKeysCount == NULL) || (lpParams->dwMinNameLength == 0) ||
+		(lpParams->dwMaxNameLength < lpParams->dwMinNameLength))
+	{
+		return NULL;
+	}
+
+	SYNTHETICKEY* lpRoot = (SYNTHETICKEY*)calloc(1, sizeof(SYNTHETICKEY));
+	if (lpRoot == NULL)
+	{
+		return NULL;
+	}
+
+	// Zero state would make xorshift return zeros forever
+	DWORD dwState = (lpParams->dwSeed == 0) ? 1 : lpParams->dwSeed;
+	*lpdwKeysCount = 0;
+	lpRoot->dwValuesCount = lpParams->dwValuesPerKey;
+
+	if (!GenerateSubKeys(lpRoot, lpParams, 0, &dwState, lpdwKeysCount))
+	{
+		FreeSyntheticTree(lpRoot);
+		return NULL;
+	}
+
+	return lpRoot;
+}
+
+/// <summary>
+///		Release in-memory key tree
+/// </summary>
+/// 
+/// <param name="lpRoot">Root key</param>
+/// 
+/// <returns>void</returns>
+void FreeSyntheticTree(SYNTHETICKEY* lpRoot)
+{
+	if (lpRoot == NULL)
+	{
+		return;
+	}
+
+	FreeSubKeys(lpRoot);
+	free(lpRoot);
+}
+
+/// <summary>
+///		Get handle of in-memory key to pass to registry functions
+/// </summary>
+/// 
+/// <param name="lpKey">Key</param>
+/// 
+/// <returns>HKEY</returns>
+HKEY GetSyntheticKeyHandle(SYNTHETICKEY* lpKey)
+{
+	return (HKEY)lpKey;
+}
+
+/// <summary>
+///		Build name and data of generated value (even values are REG_SZ, odd ones are REG_DWORD)
+/// </summary>
+/// 
+/// <param name="lpKey">Key</param>
+/// <param name="dwIndex">Value index</param>
+/// <param name="lpsValueName">Value name</param>
+/// <param name="lpsData">REG_SZ data</param>
+/// 
+/// <returns>DWORD (value type)</returns>
+static DWORD BuildSyntheticValue(SYNTHETICKEY* lpKey, DWORD dwIndex, LPWSTR lpsValueName, LPWSTR lpsData)
+{
+	swprintf(lpsValueName, SYNTHETIC_VALUE_NAME_LENGTH, L"%ls%u", SYNTHETIC_VALUE_PREFIX, dwIndex);
+	swprintf(lpsData, SYNTHETIC_VALUE_DATA_LENGTH, L"C:\\Program Files\\%.64ls\\%u", (lpKey->lpsName == NULL) ? L"" : lpKey->lpsName, dwIndex);
+
+	return (dwIndex % 2 == 0) ? REG_SZ : REG_DWORD;
+}
+
+/// <summary>
+///		Copy generated value data to caller buffer
+/// </summary>
+/// 
+/// <param name="dwType">Value type</param>
+/// <param name="dwIndex">Value index</param>
+/// <param name="lpsData">REG_SZ data</param>
+/// <param name="lpData">Caller buffer (may be NULL)</param>
+/// <param name="lpcbData">Caller buffer size / data size (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS CopySyntheticValueData(DWORD dwType, DWORD dwIndex, LPCWSTR lpsData, LPBYTE lpData, LPDWORD lpcbData)
+{
+	if (lpcbData == NULL)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	DWORD cbRequired = (dwType == REG_SZ) ? (lstrlen(lpsData) + 1) * sizeof(WCHAR) : sizeof(DWORD);
+	DWORD cbAvailable = *lpcbData;
+	*lpcbData = cbRequired;
+
+	if (lpData == NULL)
+	{
+		return ERROR_SUCCESS;
+	}
+	if (cbAvailable < cbRequired)
+	{
+		return ERROR_MORE_DATA;
+	}
+
+	if (dwType == REG_SZ)
+	{
+		memcpy(lpData, lpsData, cbRequired);
+	}
+	else
+	{
+		memcpy(lpData, &dwIndex, sizeof(DWORD));
+	}
+
+	return ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Open in-memory key by path
+/// </summary>
+/// 
+/// <param name="hKey">Parent key</param>
+/// <param name="lpSubKey">Path to key in parent key</param>
+/// <param name="samDesired">Access rights (ignored)</param>
+/// <param name="phkResult">Opened key</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS SyntheticOpenKey(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired, PHKEY phkResult)
+{
+	SYNTHETICKEY* lpKey = (SYNTHETICKEY*)hKey;
+	if ((lpKey == NULL) || (lpSubKey == NULL) || (phkResult == NULL))
+	{
+		return ERROR_INVALID_HANDLE;
+	}
+
+	LPCWSTR lpsSegment = lpSubKey;
+	while (*lpsSegment != L'\0')
+	{
+		LPCWSTR lpsSegmentEnd = wcschr(lpsSegment, L'\\');
+		DWORD dwSegmentLength = (lpsSegmentEnd == NULL) ? lstrlen(lpsSegment) : (DWORD)(lpsSegmentEnd - lpsSegment);
+		SYNTHETICKEY* lpFoundKey = NULL;
+
+		for (DWORD dwSubKeyIndex = 0; dwSubKeyIndex < lpKey->dwSubKeysCount; dwSubKeyIndex++)
+		{
+			SYNTHETICKEY* lpSubKey = &lpKey->lpSubKeys[dwSubKeyIndex];
+			if ((lpSubKey->dwNameLength == dwSegmentLength) && (_wcsnicmp(lpSubKey->lpsName, lpsSegment, dwSegmentLength) == 0))
+			{
+				lpFoundKey = lpSubKey;
+				break;
+			}
+		}
+
+		if (lpFoundKey == NULL)
+		{
+			return ERROR_FILE_NOT_FOUND;
+		}
+
+		lpKey = lpFoundKey;
+		lpsSegment = (lpsSegmentEnd == NULL) ? lpsSegment + dwSegmentLength : lpsSegmentEnd + 1;
+	}
+
+	*phkResult = (HKEY)lpKey;
+	return ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Close in-memory key (nothing to release)
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS SyntheticCloseKey(HKEY hKey)
+{
+	return (hKey == NULL) ? ERROR_INVALID_HANDLE : ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get in-memory subkey name by index
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="dwIndex">Subkey index</param>
+/// <param name="lpName">Subkey name</param>
+/// <param name="lpcchName">Subkey name buffer length / subkey name length</param>
+/// <param name="lpftLastWriteTime">Last write time (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS SyntheticEnumKey(HKEY hKey, DWORD dwIndex, LPWSTR lpName, LPDWORD lpcchName, PFILETIME lpftLastWriteTime)
+{
+	SYNTHETICKEY* lpKey = (SYNTHETICKEY*)hKey;
+	if (lpKey == NULL)
+	{
+		return ERROR_INVALID_HANDLE;
+	}
+	if (dwIndex >= lpKey->dwSubKeysCount)
+	{
+		return ERROR_NO_MORE_ITEMS;
+	}
+
+	SYNTHETICKEY* lpSubKey = &lpKey->lpSubKeys[dwIndex];
+	if (*lpcchName <= lpSubKey->dwNameLength)
+	{
+		return ERROR_MORE_DATA;
+	}
+
+	memcpy(lpName, lpSubKey->lpsName, (lpSubKey->dwNameLength + 1) * sizeof(WCHAR));
+	*lpcchName = lpSubKey->dwNameLength;
+
+	if (lpftLastWriteTime != NULL)
+	{
+		*lpftLastWriteTime = lpSubKey->ftLastWriteTime;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get in-memory value by index
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="dwIndex">Value index</param>
+/// <param name="lpValueName">Value name</param>
+/// <param name="lpcchValueName">Value name buffer length / value name length</param>
+/// <param name="lpType">Value type (may be NULL)</param>
+/// <param name="lpData">Value data (may be NULL)</param>
+/// <param name="lpcbData">Value data size (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS SyntheticEnumValue(HKEY hKey, DWORD dwIndex, LPWSTR lpValueName, LPDWORD lpcchValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	SYNTHETICKEY* lpKey = (SYNTHETICKEY*)hKey;
+	if (lpKey == NULL)
+	{
+		return ERROR_INVALID_HANDLE;
+	}
+	if (dwIndex >= lpKey->dwValuesCount)
+	{
+		return ERROR_NO_MORE_ITEMS;
+	}
+
+	WCHAR lpsValueName[SYNTHETIC_VALUE_NAME_LENGTH];
+	WCHAR lpsData[SYNTHETIC_VALUE_DATA_LENGTH];
+	DWORD dwType = BuildSyntheticValue(lpKey, dwIndex, lpsValueName, lpsData);
+	DWORD dwNameLength = lstrlen(lpsValueName);
+
+	if (*lpcchValueName <= dwNameLength)
+	{
+		return ERROR_MORE_DATA;
+	}
+
+	memcpy(lpValueName, lpsValueName, (dwNameLength + 1) * sizeof(WCHAR));
+	*lpcchValueName = dwNameLength;
+
+	if (lpType != NULL)
+	{
+		*lpType = dwType;
+	}
+
+	return CopySyntheticValueData(dwType, dwIndex, lpsData, lpData, lpcbData);
+}
+
+/// <summary>
+///		Get in-memory key counters
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpcSubKeys">Subkeys count</param>
+/// <param name="lpcMaxSubKeyLen">Longest subkey name length</param>
+/// <param name="lpcValues">Values count</param>
+/// <param name="lpcMaxValueNameLen">Longest value name length</param>
+/// <param name="lpcbMaxValueLen">Largest value data size</param>
+/// <param name="lpftLastWriteTime">Last write time</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS SyntheticQueryInfoKey(HKEY hKey, LPDWORD lpcSubKeys, LPDWORD lpcMaxSubKeyLen, LPDWORD lpcValues, LPDWORD lpcMaxValueNameLen, LPDWORD lpcbMaxValueLen, PFILETIME lpftLastWriteTime)
+{
+	SYNTHETICKEY* lpKey = (SYNTHETICKEY*)hKey;
+	if (lpKey == NULL)
+	{
+		return ERROR_INVALID_HANDLE;
+	}
+
+	if (lpcSubKeys != NULL)
+	{
+		*lpcSubKeys = lpKey->dwSubKeysCount;
+	}
+	if (lpcMaxSubKeyLen != NULL)
+	{
+		*lpcMaxSubKeyLen = 0;
+		for (DWORD dwSubKeyIndex = 0; dwSubKeyIndex < lpKey->dwSubKeysCount; dwSubKeyIndex++)
+		{
+			if (lpKey->lpSubKeys[dwSubKeyIndex].dwNameLength > *lpcMaxSubKeyLen)
+			{
+				*lpcMaxSubKeyLen = lpKey->lpSubKeys[dwSubKeyIndex].dwNameLength;
+			}
+		}
+	}
+	if (lpcValues != NULL)
+	{
+		*lpcValues = lpKey->dwValuesCount;
+	}
+	if (lpcMaxValueNameLen != NULL)
+	{
+		*lpcMaxValueNameLen = SYNTHETIC_VALUE_NAME_LENGTH - 1;
+	}
+	if (lpcbMaxValueLen != NULL)
+	{
+		*lpcbMaxValueLen = SYNTHETIC_VALUE_DATA_LENGTH * sizeof(WCHAR);
+	}
+	if (lpftLastWriteTime != NULL)
+	{
+		*lpftLastWriteTime = lpKey->ftLastWriteTime;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+/// <summary>
+///		Get in-memory value by name
+/// </summary>
+/// 
+/// <param name="hKey">Opened key</param>
+/// <param name="lpValueName">Value name</param>
+/// <param name="lpType">Value type (may be NULL)</param>
+/// <param name="lpData">Value data (may be NULL)</param>
+/// <param name="lpcbData">Value data size (may be NULL)</param>
+/// 
+/// <returns>LSTATUS</returns>
+static LSTATUS SyntheticQueryValue(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData)
+{
+	SYNTHETICKEY* lpKey = (SYNTHETICKEY*)hKey;
+	DWORD dwPrefixLength = lstrlen(SYNTHETIC_VALUE_PREFIX);
+
+	if (lpKey == NULL)
+	{
+		return ERROR_INVALID_HANDLE;
+	}
+	if ((lpValueName == NULL) || (wcsncmp(lpValueName, SYNTHETIC_VALUE_PREFIX, dwPrefixLength) != 0))
+	{
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	DWORD dwIndex = wcstoul(lpValueName + dwPrefixLength, NULL, 10);
+	if (dwIndex >= lpKey->dwValuesCount)
+	{
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	WCHAR lpsValueName[SYNTHETIC_VALUE_NAME_LENGTH];
+	WCHAR lpsData[SYNTHETIC_VALUE_DATA_LENGTH];
+	DWORD dwType = BuildSyntheticValue(lpKey, dwIndex, lpsValueName, lpsData);
+
+	if (lpType != NULL)
+	{
+		*lpType = dwType;
+	}
+
+	return CopySyntheticValueData(dwType, dwIndex, lpsData, lpData, lpcbData);
+}
+
+static const REGBACKEND g_rbSyntheticBackend = {
+	"synthetic",
+	SyntheticOpenKey,
+	SyntheticCloseKey,
+	SyntheticEnumKey,
+	SyntheticEnumValue,
+	SyntheticQueryInfoKey,
+	SyntheticQueryValue,
+};
+
+/// <summary>
+///		Get backend that serves in-memory trees made by GenerateSyntheticTree
+/// </summary>
+/// 
+/// <returns>const REGBACKEND*</returns>
+const REGBACKEND* GetSyntheticBackend()
+{
+	return &g_rbSyntheticBackend;
+}
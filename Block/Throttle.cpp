@@ -0,0 +1,345 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/Throttle.h"
+
+static SRWLOCK g_srwThrottle = SRWLOCK_INIT;
+static THROTTLESTATE g_tsThrottle;
+static volatile bool g_bThrottleEnabled = false;
+
+// Keys are paced in batches, so lock is taken once per batch
+static thread_local DWORD t_dwPendingKeys = 0;
+static thread_local bool t_bBackgroundMode = false;
+
+/// <summary>
+///		Get wall time from performance counter
+/// </summary>
+/// 
+/// <returns>ULONGLONG (microseconds)</returns>
+static ULONGLONG GetCounterTime(void* lpContext)
+{
+	LARGE_INTEGER liCounter, liFrequency;
+	QueryPerformanceCounter(&liCounter);
+	QueryPerformanceFrequency(&liFrequency);
+
+	return (ULONGLONG)((double)liCounter.QuadPart * 1e6 / (double)liFrequency.QuadPart);
+}
+
+/// <summary>
+///		Get CPU time (kernel and user) of all threads of process
+/// </summary>
+/// 
+/// <returns>ULONGLONG (microseconds)</returns>
+static ULONGLONG GetProcessCpuTime(void* lpContext)
+{
+	FILETIME ftCreation, ftExit, ftKernel, ftUser;
+	if (!GetProcessTimes(GetCurrentProcess(), &ftCreation, &ftExit, &ftKernel, &ftUser))
+	{
+		return 0;
+	}
+
+	ULONGLONG ullKernel = ((ULONGLONG)ftKernel.dwHighDateTime << 32) | ftKernel.dwLowDateTime;
+	ULONGLONG ullUser = ((ULONGLONG)ftUser.dwHighDateTime << 32) | ftUser.dwLowDateTime;
+
+	// FILETIME counts 100 ns intervals
+	return (ullKernel + ullUser) / 10;
+}
+
+/// <summary>
+///		Sleep with millisecond resolution, zero gives rest of time slice away
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void CounterSleep(void* lpContext, ULONGLONG ullMicroseconds)
+{
+	if (ullMicroseconds < 1000)
+	{
+		SwitchToThread();
+	}
+	else
+	{
+		Sleep((DWORD)(ullMicroseconds / 1000));
+	}
+}
+
+static const THROTTLECLOCK g_tcSystemClock = {
+	GetCounterTime,
+	GetProcessCpuTime,
+	CounterSleep,
+	NULL,
+};
+
+/// <summary>
+///		Simulated wall time
+/// </summary>
+/// 
+/// <returns>ULONGLONG (microseconds)</returns>
+static ULONGLONG GetSimulatedTime(void* lpContext)
+{
+	return ((SIMULATEDCLOCK*)lpContext)->ullTime;
+}
+
+/// <summary>
+///		Simulated CPU time
+/// </summary>
+/// 
+/// <returns>ULONGLONG (microseconds)</returns>
+static ULONGLONG GetSimulatedCpuTime(void* lpContext)
+{
+	return ((SIMULATEDCLOCK*)lpContext)->ullCpuTime;
+}
+
+/// <summary>
+///		Simulated sleep only moves wall time
+/// </summary>
+/// 
+/// <returns>void</returns>
+static void SimulatedSleep(void* lpContext, ULONGLONG ullMicroseconds)
+{
+	SIMULATEDCLOCK* lpSimulatedClock = (SIMULATEDCLOCK*)lpContext;
+
+	lpSimulatedClock->ullTime += ullMicroseconds;
+	lpSimulatedClock->ullSleptTime += ullMicroseconds;
+}
+
+/// <summary>
+///		Get default throttle settings (no budget, progress to stderr once a second)
+/// </summary>
+/// 
+/// <param name="lpParams">Settings</param>
+/// 
+/// <returns>void</returns>
+void GetDefaultThrottleParams(THROTTLEPARAMS* lpParams)
+{
+	ZeroMemory(lpParams, sizeof(THROTTLEPARAMS));
+	lpParams->dwBatchSize = THROTTLE_DEFAULT_BATCH_SIZE;
+	lpParams->dwProgressInterval = THROTTLE_DEFAULT_PROGRESS_INTERVAL;
+	lpParams->lpProgress = stderr;
+}
+
+/// <summary>
+///		Get clock of performance counter, process times and Sleep
+/// </summary>
+/// 
+/// <returns>const THROTTLECLOCK*</returns>
+const THROTTLECLOCK* GetSystemClock()
+{
+	return &g_tcSystemClock;
+}
+
+/// <summary>
+///		Make clock driven by hand: sleeps move wall time, work is added by AdvanceSimulatedClock
+/// </summary>
+/// 
+/// <param name="lpSimulatedClock">Simulated time</param>
+/// <param name="lpClock">Clock reading simulated time</param>
+/// 
+/// <returns>void</returns>
+void InitSimulatedClock(SIMULATEDCLOCK* lpSimulatedClock, THROTTLECLOCK* lpClock)
+{
+	ZeroMemory(lpSimulatedClock, sizeof(SIMULATEDCLOCK));
+	lpClock->lpfnGetTime = GetSimulatedTime;
+	lpClock->lpfnGetCpuTime = GetSimulatedCpuTime;
+	lpClock->lpfnSleep = SimulatedSleep;
+	lpClock->lpContext = lpSimulatedClock;
+}
+
+/// <summary>
+///		Simulate work
+/// </summary>
+/// 
+/// <param name="lpSimulatedClock">Simulated time</param>
+/// <param name="ullMicroseconds">Wall time spent</param>
+/// <param name="ullCpuMicroseconds">CPU time spent</param>
+/// 
+/// <returns>void</returns>
+void AdvanceSimulatedClock(SIMULATEDCLOCK* lpSimulatedClock, ULONGLONG ullMicroseconds, ULONGLONG ullCpuMicroseconds)
+{
+	lpSimulatedClock->ullTime += ullMicroseconds;
+	lpSimulatedClock->ullCpuTime += ullCpuMicroseconds;
+}
+
+/// <summary>
+///		Reset token buckets, both start empty so the first batch is already paced
+/// </summary>
+/// 
+/// <param name="lpState">Throttle state</param>
+/// <param name="lpParams">Settings</param>
+/// <param name="lpClock">Clock (NULL for system clock)</param>
+/// 
+/// <returns>void</returns>
+void InitThrottle(THROTTLESTATE* lpState, const THROTTLEPARAMS* lpParams, const THROTTLECLOCK* lpClock)
+{
+	ZeroMemory(lpState, sizeof(THROTTLESTATE));
+	lpState->tpParams = *lpParams;
+	lpState->tcClock = (lpClock == NULL) ? g_tcSystemClock : *lpClock;
+
+	if (lpState->tpParams.dwBatchSize == 0)
+	{
+		lpState->tpParams.dwBatchSize = 1;
+	}
+
+	lpState->ullStartTime = lpState->tcClock.lpfnGetTime(lpState->tcClock.lpContext);
+	lpState->ullLastTime = lpState->ullStartTime;
+	lpState->ullLastProgressTime = lpState->ullStartTime;
+	lpState->ullLastCpuTime = lpState->tcClock.lpfnGetCpuTime(lpState->tcClock.lpContext);
+}
+
+/// <summary>
+///		Take keys and CPU time spent since last call from token buckets
+/// </summary>
+/// 
+/// <param name="lpState">Throttle state</param>
+/// <param name="dwKeysCount">Keys processed since last call</param>
+/// 
+/// <returns>ULONGLONG (microseconds to wait until budget is back to zero)</returns>
+ULONGLONG ConsumeThrottleBudget(THROTTLESTATE* lpState, DWORD dwKeysCount)
+{
+	const THROTTLECLOCK* lpClock = &lpState->tcClock;
+	ULONGLONG ullTime = lpClock->lpfnGetTime(lpClock->lpContext);
+	ULONGLONG ullCpuTime = lpClock->lpfnGetCpuTime(lpClock->lpContext);
+	double dElapsed = (ullTime > lpState->ullLastTime) ? (double)(ullTime - lpState->ullLastTime) : 0.0;
+	double dDelay = 0.0;
+
+	lpState->ullLastTime = ullTime;
+	lpState->ullKeysCount += dwKeysCount;
+
+	// Buckets refill with wall time, burst is limited to a fraction of second.
+	// Debt is not limited: waiting of other threads repays it.
+	if (lpState->tpParams.dwKeysPerSecond != 0)
+	{
+		double dRate = lpState->tpParams.dwKeysPerSecond / 1e6;
+		double dCapacity = lpState->tpParams.dwKeysPerSecond * (THROTTLE_BURST_MILLISECONDS / 1000.0);
+		if (dCapacity < lpState->tpParams.dwBatchSize)
+		{
+			dCapacity = lpState->tpParams.dwBatchSize;
+		}
+
+		lpState->dKeyTokens += dElapsed * dRate;
+		if (lpState->dKeyTokens > dCapacity)
+		{
+			lpState->dKeyTokens = dCapacity;
+		}
+
+		lpState->dKeyTokens -= dwKeysCount;
+		if (lpState->dKeyTokens < 0.0)
+		{
+			dDelay = -lpState->dKeyTokens / dRate;
+		}
+	}
+
+	if (lpState->tpParams.dwCpuPercent != 0)
+	{
+		double dShare = lpState->tpParams.dwCpuPercent / 100.0;
+		double dCapacity = THROTTLE_BURST_MILLISECONDS * 1000.0 * dShare;
+		double dCpuSpent = (ullCpuTime > lpState->ullLastCpuTime) ? (double)(ullCpuTime - lpState->ullLastCpuTime) : 0.0;
+
+		lpState->dCpuTokens += dElapsed * dShare;
+		if (lpState->dCpuTokens > dCapacity)
+		{
+			lpState->dCpuTokens = dCapacity;
+		}
+
+		lpState->dCpuTokens -= dCpuSpent;
+		if ((lpState->dCpuTokens < 0.0) && (-lpState->dCpuTokens / dShare > dDelay))
+		{
+			dDelay = -lpState->dCpuTokens / dShare;
+		}
+	}
+
+	lpState->ullLastCpuTime = ullCpuTime;
+	lpState->ullDelayedTime += (ULONGLONG)dDelay;
+
+	return (ULONGLONG)dDelay;
+}
+
+/// <summary>
+///		Pace traversals of all threads by common budget
+/// </summary>
+/// 
+/// <param name="lpParams">Settings</param>
+/// 
+/// <returns>bool</returns>
+bool EnableThrottle(const THROTTLEPARAMS* lpParams)
+{
+	if ((lpParams == NULL) || ((lpParams->dwKeysPerSecond == 0) && (lpParams->dwCpuPercent == 0)) || (lpParams->dwCpuPercent > 100))
+	{
+		return false;
+	}
+
+	AcquireSRWLockExclusive(&g_srwThrottle);
+	InitThrottle(&g_tsThrottle, lpParams, NULL);
+	g_bThrottleEnabled = true;
+	ReleaseSRWLockExclusive(&g_srwThrottle);
+
+	return true;
+}
+
+/// <summary>
+///		Stop pacing, calling thread gets its normal priority back
+/// </summary>
+/// 
+/// <returns>void</returns>
+void DisableThrottle()
+{
+	g_bThrottleEnabled = false;
+
+	if (t_bBackgroundMode)
+	{
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+		t_bBackgroundMode = false;
+	}
+}
+
+/// <summary>
+///		Count visited keys; once per batch wait for budget or yield, and report progress
+/// </summary>
+/// 
+/// <param name="dwKeysCount">Keys visited</param>
+/// 
+/// <returns>void</returns>
+void ThrottleKeys(DWORD dwKeysCount)
+{
+	if (!g_bThrottleEnabled)
+	{
+		return;
+	}
+
+	t_dwPendingKeys += dwKeysCount;
+	if (t_dwPendingKeys < g_tsThrottle.tpParams.dwBatchSize)
+	{
+		return;
+	}
+
+	// Low CPU and I/O priority for every thread that walks under budget
+	if (!t_bBackgroundMode)
+	{
+		t_bBackgroundMode = SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) != FALSE;
+	}
+
+	DWORD dwPendingKeys = t_dwPendingKeys;
+	t_dwPendingKeys = 0;
+
+	AcquireSRWLockExclusive(&g_srwThrottle);
+
+	ULONGLONG ullDelay = ConsumeThrottleBudget(&g_tsThrottle, dwPendingKeys);
+	const THROTTLEPARAMS* lpParams = &g_tsThrottle.tpParams;
+	ULONGLONG ullTime = g_tsThrottle.ullLastTime;
+
+	if ((lpParams->lpProgress != NULL) && (ullTime - g_tsThrottle.ullLastProgressTime >= lpParams->dwProgressInterval * 1000ULL))
+	{
+		double dSeconds = (ullTime - g_tsThrottle.ullStartTime) / 1e6;
+		fprintf(lpParams->lpProgress, "Scanned %llu keys in %.1f s (%.0f keys/s, %.1f s paused)\n",
+			g_tsThrottle.ullKeysCount,
+			dSeconds,
+			(dSeconds > 0.0) ? g_tsThrottle.ullKeysCount / dSeconds : 0.0,
+			g_tsThrottle.ullDelayedTime / 1e6);
+		g_tsThrottle.ullLastProgressTime = ullTime;
+	}
+
+	THROTTLECLOCK tcClock = g_tsThrottle.tcClock;
+	ReleaseSRWLockExclusive(&g_srwThrottle);
+
+	// Sleep outside of lock, the debt left in bucket delays other threads too
+	tcClock.lpfnSleep(tcClock.lpContext, ullDelay);
+}
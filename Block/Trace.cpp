@@ -0,0 +1,410 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/Trace.h"
+
+const DWORD TRACE_FILE_NAME_LENGTH = MAX_PATH;
+const DWORD TRACE_UTF8_ARGUMENT_LENGTH = TRACE_ARGUMENT_LENGTH * 3 + 1;
+
+static CHAR g_lpsTraceFileName[TRACE_FILE_NAME_LENGTH];
+static volatile bool g_bTraceEnabled = false;
+static DWORD g_dwSubtreeThreshold = TRACE_DEFAULT_SUBTREE_THRESHOLD;
+static ULONGLONG g_ullTraceStart = 0;
+static double g_dMicrosecondsPerTick = 0.0;
+
+// Rings of all threads that recorded something; prepended to by writers with compare-exchange.
+// Writers take no lock: each one marks its own ring while it records, and FlushTrace turns trace off
+// and waits for marked rings. Lock only orders StartTrace and FlushTrace
+static SRWLOCK g_srwTraceLock = SRWLOCK_INIT;
+static TRACERING* volatile g_lpTraceRings = NULL;
+// Events of previous sessions stay in rings until their thread records again
+static volatile DWORD g_dwTraceSession = 0;
+
+// Ring of thread is released when thread exits and freed by next FlushTrace
+struct TRACERINGOWNER {
+	TRACERING* lpRing;
+
+	~TRACERINGOWNER();
+};
+
+TRACERINGOWNER::~TRACERINGOWNER()
+{
+	if (lpRing != NULL)
+	{
+		InterlockedExchange(&lpRing->lReleased, 1);
+	}
+}
+
+static thread_local TRACERINGOWNER t_troTraceRing = { NULL };
+
+/// <summary>
+///		Get performance counter value
+/// </summary>
+/// 
+/// <returns>ULONGLONG</returns>
+static ULONGLONG GetTraceTimestamp()
+{
+	LARGE_INTEGER liCounter;
+	QueryPerformanceCounter(&liCounter);
+
+	return liCounter.QuadPart;
+}
+
+/// <summary>
+///		Start recording spans, they are written to file by FlushTrace
+/// </summary>
+/// 
+/// <param name="lpsFileName">Chrome trace-event JSON file</param>
+/// <param name="dwSubtreeThreshold">Subtrees with fewer keys are not recorded</param>
+/// 
+/// <returns>bool</returns>
+bool StartTrace(LPCSTR lpsFileName, DWORD dwSubtreeThreshold)
+{
+	if ((lpsFileName == NULL) || (strcpy_s(g_lpsTraceFileName, TRACE_FILE_NAME_LENGTH, lpsFileName) != 0))
+	{
+		return false;
+	}
+
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+
+	AcquireSRWLockExclusive(&g_srwTraceLock);
+	g_dMicrosecondsPerTick = 1e6 / (double)liFrequency.QuadPart;
+	g_dwSubtreeThreshold = dwSubtreeThreshold;
+	g_dwTraceSession++;
+	g_ullTraceStart = GetTraceTimestamp();
+	// Writer that sees trace on sees new session too
+	MemoryBarrier();
+	g_bTraceEnabled = true;
+	ReleaseSRWLockExclusive(&g_srwTraceLock);
+
+	return true;
+}
+
+/// <summary>
+///		Check if spans are recorded
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool IsTraceEnabled()
+{
+	return g_bTraceEnabled;
+}
+
+/// <summary>
+///		Get minimal keys count of recorded subtree
+/// </summary>
+/// 
+/// <returns>DWORD</returns>
+DWORD GetTraceSubtreeThreshold()
+{
+	return g_dwSubtreeThreshold;
+}
+
+/// <summary>
+///		Mark ring of current thread as being written, create and publish it on first use.
+///		Fails if trace is off, then flusher may be reading rings
+/// </summary>
+/// 
+/// <returns>TRACERING* (NULL if trace is off or out of memory, clear lWriting when event is recorded)</returns>
+static TRACERING* AcquireThreadTraceRing()
+{
+	TRACERING* lpRing = t_troTraceRing.lpRing;
+	if (lpRing == NULL)
+	{
+		lpRing = (TRACERING*)calloc(1, sizeof(TRACERING));
+		if (lpRing == NULL)
+		{
+			return NULL;
+		}
+
+		lpRing->dwThreadId = GetCurrentThreadId();
+		lpRing->lWriting = 1;
+
+		TRACERING* lpHead;
+		do
+		{
+			lpHead = g_lpTraceRings;
+			lpRing->lpNext = lpHead;
+		} while (InterlockedCompareExchangePointer((PVOID volatile*)&g_lpTraceRings, lpRing, lpHead) != lpHead);
+
+		t_troTraceRing.lpRing = lpRing;
+	}
+	else
+	{
+		InterlockedExchange(&lpRing->lWriting, 1);
+	}
+
+	// Flag is set before trace is checked and FlushTrace turns trace off before it checks flags,
+	// so either flusher waits for this event or this event sees trace is off
+	if (!g_bTraceEnabled)
+	{
+		InterlockedExchange(&lpRing->lWriting, 0);
+		return NULL;
+	}
+
+	if (lpRing->dwSession != g_dwTraceSession)
+	{
+		lpRing->llWrittenCount = 0;
+		lpRing->dwSession = g_dwTraceSession;
+	}
+
+	return lpRing;
+}
+
+/// <summary>
+///		Start span
+/// </summary>
+/// 
+/// <returns>ULONGLONG (0 if trace is off)</returns>
+ULONGLONG BeginTraceSpan()
+{
+	if (!g_bTraceEnabled)
+	{
+		return 0;
+	}
+
+	return GetTraceTimestamp();
+}
+
+/// <summary>
+///		Record finished span in ring of current thread (oldest spans are overwritten)
+/// </summary>
+/// 
+/// <param name="lpsName">Span name (must stay valid until FlushTrace)</param>
+/// <param name="lpsCategory">Span category (must stay valid until FlushTrace)</param>
+/// <param name="ullStart">Value returned by BeginTraceSpan</param>
+/// <param name="lpsArgument">Key path or command line (may be NULL, long ones keep their tail)</param>
+/// 
+/// <returns>void</returns>
+void EndTraceSpan(LPCSTR lpsName, LPCSTR lpsCategory, ULONGLONG ullStart, LPCWSTR lpsArgument)
+{
+	EndTraceSpanStatus(lpsName, lpsCategory, ullStart, lpsArgument, ERROR_SUCCESS);
+}
+
+/// <summary>
+///		Record finished span with result of traced call
+/// </summary>
+/// 
+/// <param name="lpsName">Span name (must stay valid until FlushTrace)</param>
+/// <param name="lpsCategory">Span category (must stay valid until FlushTrace)</param>
+/// <param name="ullStart">Value returned by BeginTraceSpan</param>
+/// <param name="lpsArgument">Key path or command line (may be NULL, long ones keep their tail)</param>
+/// <param name="lStatus">Error code of traced call (ERROR_SUCCESS is not written)</param>
+/// 
+/// <returns>void</returns>
+void EndTraceSpanStatus(LPCSTR lpsName, LPCSTR lpsCategory, ULONGLONG ullStart, LPCWSTR lpsArgument, LONG lStatus)
+{
+	if ((ullStart == 0) || !g_bTraceEnabled)
+	{
+		return;
+	}
+
+	ULONGLONG ullEnd = GetTraceTimestamp();
+
+	TRACERING* lpRing = AcquireThreadTraceRing();
+	if (lpRing == NULL)
+	{
+		return;
+	}
+
+	TRACEEVENT* lpEvent = &lpRing->teEvents[lpRing->llWrittenCount % TRACE_RING_CAPACITY];
+	lpEvent->lpsName = lpsName;
+	lpEvent->lpsCategory = lpsCategory;
+	lpEvent->ullStart = ullStart;
+	lpEvent->ullDuration = ullEnd - ullStart;
+	lpEvent->lStatus = lStatus;
+
+	// Deepest part of long key path is the interesting one, it is kept after ellipsis
+	LPCWSTR lpsSource = (lpsArgument == NULL) ? L"" : lpsArgument;
+	SIZE_T cchSource = wcslen(lpsSource);
+	if (cchSource < TRACE_ARGUMENT_LENGTH)
+	{
+		wcscpy_s(lpEvent->lpsArgument, TRACE_ARGUMENT_LENGTH, lpsSource);
+	}
+	else
+	{
+		// Tail must not start with second half of surrogate pair
+		LPCWSTR lpsTail = lpsSource + cchSource - (TRACE_ARGUMENT_LENGTH - 2);
+		if ((*lpsTail >= 0xDC00) && (*lpsTail <= 0xDFFF))
+		{
+			lpsTail++;
+		}
+
+		lpEvent->lpsArgument[0] = L'\x2026';
+		wcscpy_s(lpEvent->lpsArgument + 1, TRACE_ARGUMENT_LENGTH - 1, lpsTail);
+	}
+
+	// Only owning thread writes, counter is published after the event is complete
+	MemoryBarrier();
+	lpRing->llWrittenCount++;
+	InterlockedExchange(&lpRing->lWriting, 0);
+}
+
+/// <summary>
+///		Write UTF-8 string as JSON string literal
+/// </summary>
+/// 
+/// <param name="lpFile">Output file</param>
+/// <param name="lpsValue">UTF-8 string</param>
+/// 
+/// <returns>void</returns>
+static void WriteJsonUtf8String(FILE* lpFile, LPCSTR lpsValue)
+{
+	fputc('"', lpFile);
+	for (LPCSTR lpsChar = lpsValue; *lpsChar != '\0'; lpsChar++)
+	{
+		if ((*lpsChar == '"') || (*lpsChar == '\\'))
+		{
+			fputc('\\', lpFile);
+			fputc(*lpsChar, lpFile);
+		}
+		else if ((unsigned char)*lpsChar < 0x20)
+		{
+			fprintf(lpFile, "\\u%04x", (unsigned char)*lpsChar);
+		}
+		else
+		{
+			fputc(*lpsChar, lpFile);
+		}
+	}
+	fputc('"', lpFile);
+}
+
+/// <summary>
+///		Write string as JSON string literal
+/// </summary>
+/// 
+/// <param name="lpFile">Output file</param>
+/// <param name="lpsValue">Wide string</param>
+/// 
+/// <returns>void</returns>
+static void WriteJsonString(FILE* lpFile, LPCWSTR lpsValue)
+{
+	CHAR lpsUtf8[TRACE_UTF8_ARGUMENT_LENGTH];
+	if (WideCharToMultiByte(CP_UTF8, 0, lpsValue, -1, lpsUtf8, TRACE_UTF8_ARGUMENT_LENGTH, NULL, NULL) == 0)
+	{
+		lpsUtf8[0] = '\0';
+	}
+
+	WriteJsonUtf8String(lpFile, lpsUtf8);
+}
+
+/// <summary>
+///		Free rings of exited threads, put rings of live threads back to list
+/// </summary>
+/// 
+/// <param name="lpRings">Rings taken from list</param>
+/// 
+/// <returns>void</returns>
+static void ReturnTraceRings(TRACERING* lpRings)
+{
+	TRACERING* lpKept = NULL;
+	TRACERING* lpKeptTail = NULL;
+
+	while (lpRings != NULL)
+	{
+		TRACERING* lpNext = lpRings->lpNext;
+		if (lpRings->lReleased != 0)
+		{
+			free(lpRings);
+		}
+		else
+		{
+			lpRings->lpNext = lpKept;
+			lpKept = lpRings;
+			lpKeptTail = (lpKeptTail == NULL) ? lpRings : lpKeptTail;
+		}
+		lpRings = lpNext;
+	}
+
+	if (lpKept == NULL)
+	{
+		return;
+	}
+
+	// Threads could publish new rings meanwhile
+	TRACERING* lpHead;
+	do
+	{
+		lpHead = g_lpTraceRings;
+		lpKeptTail->lpNext = lpHead;
+	} while (InterlockedCompareExchangePointer((PVOID volatile*)&g_lpTraceRings, lpKept, lpHead) != lpHead);
+}
+
+/// <summary>
+///		Stop recording, write rings of all threads to trace file in Chrome trace-event format
+///		and free rings of exited threads
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool FlushTrace()
+{
+	if (!g_bTraceEnabled)
+	{
+		return true;
+	}
+
+	AcquireSRWLockExclusive(&g_srwTraceLock);
+	g_bTraceEnabled = false;
+	MemoryBarrier();
+
+	// Writers that are recording a span are waited for, later ones see trace is off
+	TRACERING* lpRings = (TRACERING*)InterlockedExchangePointer((PVOID volatile*)&g_lpTraceRings, NULL);
+	for (TRACERING* lpRing = lpRings; lpRing != NULL; lpRing = lpRing->lpNext)
+	{
+		while (lpRing->lWriting != 0)
+		{
+			YieldProcessor();
+		}
+	}
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, g_lpsTraceFileName, "w") != 0)
+	{
+		ReturnTraceRings(lpRings);
+		ReleaseSRWLockExclusive(&g_srwTraceLock);
+		return false;
+	}
+
+	DWORD dwProcessId = GetCurrentProcessId();
+	bool bFirstEvent = true;
+
+	fprintf(lpFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (TRACERING* lpRing = lpRings; lpRing != NULL; lpRing = lpRing->lpNext)
+	{
+		// Ring not written in this session holds only events already flushed
+		LONGLONG llWrittenCount = (lpRing->dwSession == g_dwTraceSession) ? lpRing->llWrittenCount : 0;
+		LONGLONG llFirst = (llWrittenCount > TRACE_RING_CAPACITY) ? llWrittenCount - TRACE_RING_CAPACITY : 0;
+
+		for (LONGLONG llIndex = llFirst; llIndex < llWrittenCount; llIndex++)
+		{
+			const TRACEEVENT* lpEvent = &lpRing->teEvents[llIndex % TRACE_RING_CAPACITY];
+
+			fprintf(lpFile, "%s\n{\"name\":", bFirstEvent ? "" : ",");
+			WriteJsonUtf8String(lpFile, lpEvent->lpsName);
+			fprintf(lpFile, ",\"cat\":");
+			WriteJsonUtf8String(lpFile, lpEvent->lpsCategory);
+			fprintf(lpFile, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"detail\":",
+				(double)(lpEvent->ullStart - g_ullTraceStart) * g_dMicrosecondsPerTick,
+				(double)lpEvent->ullDuration * g_dMicrosecondsPerTick,
+				dwProcessId,
+				lpRing->dwThreadId);
+			WriteJsonString(lpFile, lpEvent->lpsArgument);
+			if (lpEvent->lStatus != ERROR_SUCCESS)
+			{
+				fprintf(lpFile, ",\"status\":%ld", (long)lpEvent->lStatus);
+			}
+			fprintf(lpFile, "}}");
+
+			bFirstEvent = false;
+		}
+	}
+
+	fprintf(lpFile, "\n]}\n");
+	ReturnTraceRings(lpRings);
+	ReleaseSRWLockExclusive(&g_srwTraceLock);
+
+	return fclose(lpFile) == 0;
+}
@@ -0,0 +1,316 @@
+#include "../Api/Platform.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "../Api/Transcode.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Collections.h"
+
+// x86 and x64 builds always have SSE2, other targets and 32-bit wchar_t use scalar loops only
+#if (defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)) && (WCHAR_MAX == 0xFFFF)
+#define TRANSCODE_SSE2
+#include <emmintrin.h>
+#endif
+
+/// <summary>
+///		Decode one UTF-8 sequence, invalid byte is consumed alone and decoded as replacement character
+/// </summary>
+///
+/// <param name="lpbSource">Sequence start</param>
+/// <param name="cbAvailable">Bytes left in source</param>
+/// <param name="lpcbUsed">Bytes consumed</param>
+///
+/// <returns>DWORD (code point)</returns>
+static DWORD DecodeUtf8Sequence(const BYTE* lpbSource, DWORD cbAvailable, DWORD* lpcbUsed)
+{
+	BYTE bLead = lpbSource[0];
+	DWORD dwLength, dwCodePoint, dwMinimum;
+
+	*lpcbUsed = 1;
+	if (bLead < 0x80)
+	{
+		return bLead;
+	}
+
+	if ((bLead & 0xE0) == 0xC0)
+	{
+		dwLength = 2;
+		dwCodePoint = bLead & 0x1F;
+		dwMinimum = 0x80;
+	}
+	else if ((bLead & 0xF0) == 0xE0)
+	{
+		dwLength = 3;
+		dwCodePoint = bLead & 0x0F;
+		dwMinimum = 0x800;
+	}
+	else if ((bLead & 0xF8) == 0xF0)
+	{
+		dwLength = 4;
+		dwCodePoint = bLead & 0x07;
+		dwMinimum = 0x10000;
+	}
+	else
+	{
+		return TRANSCODE_REPLACEMENT_CHAR;
+	}
+
+	if (dwLength > cbAvailable)
+	{
+		return TRANSCODE_REPLACEMENT_CHAR;
+	}
+
+	for (DWORD dwIndex = 1; dwIndex < dwLength; dwIndex++)
+	{
+		if ((lpbSource[dwIndex] & 0xC0) != 0x80)
+		{
+			return TRANSCODE_REPLACEMENT_CHAR;
+		}
+		dwCodePoint = (dwCodePoint << 6) | (lpbSource[dwIndex] & 0x3F);
+	}
+
+	// Overlong forms, encoded surrogates and values above Unicode range are not valid
+	if ((dwCodePoint < dwMinimum) || (dwCodePoint > 0x10FFFF) || ((dwCodePoint >= 0xD800) && (dwCodePoint <= 0xDFFF)))
+	{
+		return TRANSCODE_REPLACEMENT_CHAR;
+	}
+
+	*lpcbUsed = dwLength;
+
+	return dwCodePoint;
+}
+
+/// <summary>
+///		Convert UTF-8 to UTF-16, ASCII runs are widened 16 bytes at a time
+/// </summary>
+///
+/// <param name="lpsSource">UTF-8 text</param>
+/// <param name="cbSource">Text size in bytes</param>
+/// <param name="lpsDestination">Destination buffer (at most one character per source byte is written)</param>
+/// <param name="cchDestination">Destination buffer length in characters</param>
+///
+/// <returns>DWORD (characters written, TRANSCODE_ERROR if destination is too small)</returns>
+DWORD Utf8ToUtf16(LPCSTR lpsSource, DWORD cbSource, LPWSTR lpsDestination, DWORD cchDestination)
+{
+	const BYTE* lpbSource = (const BYTE*)lpsSource;
+	DWORD dwPosition = 0, cchWritten = 0;
+
+	while (dwPosition < cbSource)
+	{
+#ifdef TRANSCODE_SSE2
+		if ((cbSource - dwPosition >= 16) && (cchDestination - cchWritten >= 16))
+		{
+			__m128i xmmBytes = _mm_loadu_si128((const __m128i*)(lpbSource + dwPosition));
+			int iNonAscii = _mm_movemask_epi8(xmmBytes);
+
+			if (iNonAscii == 0)
+			{
+				_mm_storeu_si128((__m128i*)(lpsDestination + cchWritten), _mm_unpacklo_epi8(xmmBytes, _mm_setzero_si128()));
+				_mm_storeu_si128((__m128i*)(lpsDestination + cchWritten + 8), _mm_unpackhi_epi8(xmmBytes, _mm_setzero_si128()));
+				dwPosition += 16;
+				cchWritten += 16;
+				continue;
+			}
+
+			// ASCII before first multibyte sequence is copied directly
+			unsigned long ulAsciiCount;
+			_BitScanForward(&ulAsciiCount, (unsigned long)iNonAscii);
+			for (DWORD dwIndex = 0; dwIndex < ulAsciiCount; dwIndex++)
+			{
+				lpsDestination[cchWritten++] = lpbSource[dwPosition++];
+			}
+		}
+#endif
+
+		DWORD cbUsed;
+		DWORD dwCodePoint = DecodeUtf8Sequence(lpbSource + dwPosition, cbSource - dwPosition, &cbUsed);
+		DWORD cchRequired = (dwCodePoint >= 0x10000) ? 2 : 1;
+
+		if (cchDestination - cchWritten < cchRequired)
+		{
+			return TRANSCODE_ERROR;
+		}
+
+		if (cchRequired == 2)
+		{
+			dwCodePoint -= 0x10000;
+			lpsDestination[cchWritten++] = (WCHAR)(0xD800 + (dwCodePoint >> 10));
+			lpsDestination[cchWritten++] = (WCHAR)(0xDC00 + (dwCodePoint & 0x3FF));
+		}
+		else
+		{
+			lpsDestination[cchWritten++] = (WCHAR)dwCodePoint;
+		}
+
+		dwPosition += cbUsed;
+	}
+
+	return cchWritten;
+}
+
+/// <summary>
+///		Convert UTF-16 to UTF-8, ASCII runs are narrowed 8 characters at a time
+/// </summary>
+///
+/// <param name="lpsSource">UTF-16 text</param>
+/// <param name="cchSource">Text length in characters</param>
+/// <param name="lpsDestination">Destination buffer (at most three bytes per source character are written)</param>
+/// <param name="cbDestination">Destination buffer size in bytes</param>
+///
+/// <returns>DWORD (bytes written, TRANSCODE_ERROR if destination is too small)</returns>
+DWORD Utf16ToUtf8(LPCWSTR lpsSource, DWORD cchSource, LPSTR lpsDestination, DWORD cbDestination)
+{
+	BYTE* lpbDestination = (BYTE*)lpsDestination;
+	DWORD dwPosition = 0, cbWritten = 0;
+
+#ifdef TRANSCODE_SSE2
+	const __m128i xmmNonAsciiMask = _mm_set1_epi16((short)0xFF80);
+#endif
+
+	while (dwPosition < cchSource)
+	{
+#ifdef TRANSCODE_SSE2
+		if ((cchSource - dwPosition >= 8) && (cbDestination - cbWritten >= 8))
+		{
+			__m128i xmmChars = _mm_loadu_si128((const __m128i*)(lpsSource + dwPosition));
+			__m128i xmmAscii = _mm_cmpeq_epi16(_mm_and_si128(xmmChars, xmmNonAsciiMask), _mm_setzero_si128());
+
+			if (_mm_movemask_epi8(xmmAscii) == 0xFFFF)
+			{
+				_mm_storel_epi64((__m128i*)(lpbDestination + cbWritten), _mm_packus_epi16(xmmChars, xmmChars));
+				dwPosition += 8;
+				cbWritten += 8;
+				continue;
+			}
+		}
+#endif
+
+		DWORD dwCodePoint = lpsSource[dwPosition++];
+
+		// Unpaired surrogates can not be encoded
+		if ((dwCodePoint >= 0xD800) && (dwCodePoint <= 0xDBFF) && (dwPosition < cchSource) &&
+			(lpsSource[dwPosition] >= 0xDC00) && (lpsSource[dwPosition] <= 0xDFFF))
+		{
+			dwCodePoint = 0x10000 + ((dwCodePoint - 0xD800) << 10) + (lpsSource[dwPosition++] - 0xDC00);
+		}
+		else if ((dwCodePoint >= 0xD800) && (dwCodePoint <= 0xDFFF))
+		{
+			dwCodePoint = TRANSCODE_REPLACEMENT_CHAR;
+		}
+
+		DWORD cbRequired = (dwCodePoint < 0x80) ? 1 : ((dwCodePoint < 0x800) ? 2 : ((dwCodePoint < 0x10000) ? 3 : 4));
+		if (cbDestination - cbWritten < cbRequired)
+		{
+			return TRANSCODE_ERROR;
+		}
+
+		if (cbRequired == 1)
+		{
+			lpbDestination[cbWritten++] = (BYTE)dwCodePoint;
+		}
+		else if (cbRequired == 2)
+		{
+			lpbDestination[cbWritten++] = (BYTE)(0xC0 | (dwCodePoint >> 6));
+			lpbDestination[cbWritten++] = (BYTE)(0x80 | (dwCodePoint & 0x3F));
+		}
+		else if (cbRequired == 3)
+		{
+			lpbDestination[cbWritten++] = (BYTE)(0xE0 | (dwCodePoint >> 12));
+			lpbDestination[cbWritten++] = (BYTE)(0x80 | ((dwCodePoint >> 6) & 0x3F));
+			lpbDestination[cbWritten++] = (BYTE)(0x80 | (dwCodePoint & 0x3F));
+		}
+		else
+		{
+			lpbDestination[cbWritten++] = (BYTE)(0xF0 | (dwCodePoint >> 18));
+			lpbDestination[cbWritten++] = (BYTE)(0x80 | ((dwCodePoint >> 12) & 0x3F));
+			lpbDestination[cbWritten++] = (BYTE)(0x80 | ((dwCodePoint >> 6) & 0x3F));
+			lpbDestination[cbWritten++] = (BYTE)(0x80 | (dwCodePoint & 0x3F));
+		}
+	}
+
+	return cbWritten;
+}
+
+/// <summary>
+///		Convert UTF-8 to null terminated UTF-16 in reusable buffer
+/// </summary>
+///
+/// <param name="lpBuffer">Conversion buffer</param>
+/// <param name="lpsSource">UTF-8 text</param>
+/// <param name="cbSource">Text size in bytes (MAXDWORD for null terminated text)</param>
+/// <param name="lpcchResult">Characters written without terminating null (may be NULL)</param>
+///
+/// <returns>LPCWSTR (valid until next conversion into buffer, NULL if no memory)</returns>
+LPCWSTR WidenUtf8(TRANSCODEBUFFER* lpBuffer, LPCSTR lpsSource, DWORD cbSource, DWORD* lpcchResult)
+{
+	if (cbSource == MAXDWORD)
+	{
+		cbSource = (DWORD)strlen(lpsSource);
+	}
+
+	if ((cbSource == MAXDWORD) || !ReserveArray((void**)&lpBuffer->lpsWide, &lpBuffer->cchWideCapacity, cbSource + 1, sizeof(WCHAR)))
+	{
+		return NULL;
+	}
+
+	DWORD cchWritten = Utf8ToUtf16(lpsSource, cbSource, lpBuffer->lpsWide, lpBuffer->cchWideCapacity - 1);
+	lpBuffer->lpsWide[cchWritten] = L'\0';
+
+	if (lpcchResult != NULL)
+	{
+		*lpcchResult = cchWritten;
+	}
+
+	return lpBuffer->lpsWide;
+}
+
+/// <summary>
+///		Convert UTF-16 to null terminated UTF-8 in reusable buffer
+/// </summary>
+///
+/// <param name="lpBuffer">Conversion buffer</param>
+/// <param name="lpsSource">UTF-16 text</param>
+/// <param name="cchSource">Text length in characters (MAXDWORD for null terminated text)</param>
+/// <param name="lpcbResult">Bytes written without terminating null (may be NULL)</param>
+///
+/// <returns>LPCSTR (valid until next conversion into buffer, NULL if no memory)</returns>
+LPCSTR NarrowToUtf8(TRANSCODEBUFFER* lpBuffer, LPCWSTR lpsSource, DWORD cchSource, DWORD* lpcbResult)
+{
+	if (cchSource == MAXDWORD)
+	{
+		cchSource = (DWORD)wcslen(lpsSource);
+	}
+
+	if ((cchSource >= (MAXDWORD - 1) / TRANSCODE_MAX_UTF8_PER_UTF16) ||
+		!ReserveArray((void**)&lpBuffer->lpsUtf8, &lpBuffer->cbUtf8Capacity, cchSource * TRANSCODE_MAX_UTF8_PER_UTF16 + 1, sizeof(CHAR)))
+	{
+		return NULL;
+	}
+
+	DWORD cbWritten = Utf16ToUtf8(lpsSource, cchSource, lpBuffer->lpsUtf8, lpBuffer->cbUtf8Capacity - 1);
+	lpBuffer->lpsUtf8[cbWritten] = '\0';
+
+	if (lpcbResult != NULL)
+	{
+		*lpcbResult = cbWritten;
+	}
+
+	return lpBuffer->lpsUtf8;
+}
+
+/// <summary>
+///		Release conversion buffer
+/// </summary>
+///
+/// <param name="lpBuffer">Conversion buffer</param>
+///
+/// <returns>void</returns>
+void FreeTranscodeBuffer(TRANSCODEBUFFER* lpBuffer)
+{
+	free(lpBuffer->lpsWide);
+	free(lpBuffer->lpsUtf8);
+	ZeroMemory(lpBuffer, sizeof(TRANSCODEBUFFER));
+}
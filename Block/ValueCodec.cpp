@@ -0,0 +1,669 @@
+#include "../Api/Platform.h"
+#include <errno.h>
+#include <stdlib.h>
+
+#include "../Api/ValueCodec.h"
+#include "../Api/Transcode.h"
+
+const char MULTI_SZ_SEPARATOR[] = "\\0";
+const DWORD MULTI_SZ_SEPARATOR_LENGTH = 2;
+
+/// <summary>
+///		Attach storage to value buffer
+/// </summary>
+/// 
+/// <param name="lpBuffer">Value buffer</param>
+/// <param name="lpStorage">Caller storage (NULL to use inline storage)</param>
+/// <param name="cbStorage">Caller storage size</param>
+/// 
+/// <returns>void</returns>
+void InitValueBuffer(REGVALUEBUFFER* lpBuffer, BYTE* lpStorage, DWORD cbStorage)
+{
+	if ((lpStorage == NULL) || (cbStorage == 0))
+	{
+		lpBuffer->lpData = lpBuffer->abInline;
+		lpBuffer->cbCapacity = VALUE_INLINE_BUFFER_SIZE;
+	}
+	else
+	{
+		lpBuffer->lpData = lpStorage;
+		lpBuffer->cbCapacity = cbStorage;
+	}
+
+	lpBuffer->cbData = 0;
+}
+
+/// <summary>
+///		Get size that encoded data of value text can not exceed for any type:
+///		strings take at most one wide character per UTF-8 byte plus terminators,
+///		binary takes half of text and numbers take at most 8 bytes
+/// </summary>
+/// 
+/// <param name="lpsValue">Value in string format</param>
+/// 
+/// <returns>DWORD (0 if text is too long to encode)</returns>
+DWORD GetEncodedValueSizeLimit(LPCSTR lpsValue)
+{
+	SIZE_T cchValue = strlen(lpsValue);
+	if (cchValue >= MAXDWORD / sizeof(WCHAR) - 2)
+	{
+		return 0;
+	}
+
+	DWORD cbLimit = (DWORD)(cchValue + 2) * sizeof(WCHAR);
+	return (cbLimit < sizeof(ULONGLONG)) ? sizeof(ULONGLONG) : cbLimit;
+}
+
+/// <summary>
+///		Convert UTF-8 string to wide string in caller storage
+/// </summary>
+/// 
+/// <param name="lpsSource">Source string</param>
+/// <param name="lpsDestination">Destination buffer</param>
+/// <param name="cchDestination">Destination buffer length in characters</param>
+/// 
+/// <returns>bool</returns>
+bool WidenString(LPCSTR lpsSource, LPWSTR lpsDestination, DWORD cchDestination)
+{
+	if ((lpsSource == NULL) || (lpsDestination == NULL) || (cchDestination == 0))
+	{
+		return false;
+	}
+
+	DWORD cchWritten = Utf8ToUtf16(lpsSource, (DWORD)strlen(lpsSource), lpsDestination, cchDestination - 1);
+	if (cchWritten == TRANSCODE_ERROR)
+	{
+		return false;
+	}
+
+	lpsDestination[cchWritten] = L'\0';
+	return true;
+}
+
+/// <summary>
+///		Parse unsigned number (decimal, or hex behind 0x) with overflow check
+/// </summary>
+/// 
+/// <param name="lpsValue">Number in string format</param>
+/// <param name="ullMaxValue">Upper bound</param>
+/// <param name="lpullResult">Parsed number</param>
+/// 
+/// <returns>bool</returns>
+static bool ParseUnsigned(LPCSTR lpsValue, ULONGLONG ullMaxValue, ULONGLONG* lpullResult)
+{
+	while ((*lpsValue == ' ') || (*lpsValue == '\t'))
+	{
+		lpsValue++;
+	}
+
+	// Leading zero is not octal, "010" is ten as typed
+	int iBase = 10;
+	if ((lpsValue[0] == '0') && ((lpsValue[1] == 'x') || (lpsValue[1] == 'X')))
+	{
+		iBase = 16;
+		lpsValue += 2;
+	}
+
+	// strtoull would skip spaces, accept sign (negating "-1" into a huge value) and second 0x, so only digits are let through
+	size_t cchDigits = strspn(lpsValue, (iBase == 16) ? "0123456789abcdefABCDEF" : "0123456789");
+	if ((cchDigits == 0) || (lpsValue[cchDigits] != '\0'))
+	{
+		return false;
+	}
+
+	errno = 0;
+	ULONGLONG ullValue = strtoull(lpsValue, NULL, iBase);
+
+	if ((errno == ERANGE) || (ullValue > ullMaxValue))
+	{
+		return false;
+	}
+
+	*lpullResult = ullValue;
+	return true;
+}
+
+/// <summary>
+///		Encode UTF-8 string as wide string
+/// </summary>
+/// 
+/// <param name="lpsValue">Value in string format</param>
+/// <param name="lpBuffer">Value buffer</param>
+/// <param name="bTerminate">Keep terminating null in data</param>
+/// 
+/// <returns>bool</returns>
+static bool EncodeString(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer, bool bTerminate)
+{
+	LPWSTR lpsData = (LPWSTR)lpBuffer->lpData;
+	DWORD cchCapacity = lpBuffer->cbCapacity / sizeof(WCHAR);
+	if (cchCapacity == 0)
+	{
+		return false;
+	}
+
+	DWORD cchWritten = Utf8ToUtf16(lpsValue, (DWORD)strlen(lpsValue), lpsData, cchCapacity - 1);
+	if (cchWritten == TRANSCODE_ERROR)
+	{
+		return false;
+	}
+
+	lpsData[cchWritten] = L'\0';
+	lpBuffer->cbData = (bTerminate ? cchWritten + 1 : cchWritten) * sizeof(WCHAR);
+	return true;
+}
+
+/// <summary>
+///		Decode wide string to UTF-8 string
+/// </summary>
+/// 
+/// <param name="lpData">Value data</param>
+/// <param name="cbData">Value data size</param>
+/// <param name="lpsOutput">Output buffer</param>
+/// <param name="cchOutput">Output buffer length</param>
+/// 
+/// <returns>bool</returns>
+static bool DecodeString(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	LPCWSTR lpsValue = (LPCWSTR)lpData;
+	int cchValue = cbData / sizeof(WCHAR);
+
+	// Stored strings may or may not carry the terminating null
+	while ((cchValue > 0) && (lpsValue[cchValue - 1] == L'\0'))
+	{
+		cchValue--;
+	}
+
+	if (cchOutput == 0)
+	{
+		return false;
+	}
+
+	if (cchValue == 0)
+	{
+		lpsOutput[0] = '\0';
+		return true;
+	}
+
+	DWORD cbWritten = Utf16ToUtf8(lpsValue, cchValue, lpsOutput, cchOutput - 1);
+	if (cbWritten == TRANSCODE_ERROR)
+	{
+		return false;
+	}
+
+	lpsOutput[cbWritten] = '\0';
+	return true;
+}
+
+/// <summary>
+///		Encode unsigned number in little or big endian byte order
+/// </summary>
+/// 
+/// <param name="lpsValue">Value in string format</param>
+/// <param name="lpBuffer">Value buffer</param>
+/// <param name="cbSize">Number size in bytes</param>
+/// <param name="bBigEndian">Byte order</param>
+/// 
+/// <returns>bool</returns>
+static bool EncodeNumber(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer, DWORD cbSize, bool bBigEndian)
+{
+	ULONGLONG ullValue;
+	ULONGLONG ullMaxValue = (cbSize == sizeof(DWORD)) ? 0xFFFFFFFFull : 0xFFFFFFFFFFFFFFFFull;
+
+	if ((lpBuffer->cbCapacity < cbSize) || !ParseUnsigned(lpsValue, ullMaxValue, &ullValue))
+	{
+		return false;
+	}
+
+	for (DWORD dwByteIndex = 0; dwByteIndex < cbSize; dwByteIndex++)
+	{
+		DWORD dwShift = (bBigEndian ? cbSize - 1 - dwByteIndex : dwByteIndex) * 8;
+		lpBuffer->lpData[dwByteIndex] = (BYTE)(ullValue >> dwShift);
+	}
+
+	lpBuffer->cbData = cbSize;
+	return true;
+}
+
+/// <summary>
+///		Decode unsigned number in little or big endian byte order
+/// </summary>
+/// 
+/// <param name="lpData">Value data</param>
+/// <param name="cbData">Value data size</param>
+/// <param name="lpsOutput">Output buffer</param>
+/// <param name="cchOutput">Output buffer length</param>
+/// <param name="cbSize">Number size in bytes</param>
+/// <param name="bBigEndian">Byte order</param>
+/// 
+/// <returns>bool</returns>
+static bool DecodeNumber(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput, DWORD cbSize, bool bBigEndian)
+{
+	if (cbData != cbSize)
+	{
+		return false;
+	}
+
+	ULONGLONG ullValue = 0;
+	for (DWORD dwByteIndex = 0; dwByteIndex < cbSize; dwByteIndex++)
+	{
+		DWORD dwShift = (bBigEndian ? cbSize - 1 - dwByteIndex : dwByteIndex) * 8;
+		ullValue |= (ULONGLONG)lpData[dwByteIndex] << dwShift;
+	}
+
+	int cchWritten = _snprintf_s(lpsOutput, cchOutput, _TRUNCATE, "%llu", ullValue);
+	return cchWritten >= 0;
+}
+
+/// <summary>
+///		Get value of hex digit
+/// </summary>
+/// 
+/// <param name="cDigit">Hex digit</param>
+/// 
+/// <returns>int (-1 if not a hex digit)</returns>
+static int GetHexDigitValue(CHAR cDigit)
+{
+	if ((cDigit >= '0') && (cDigit <= '9'))
+	{
+		return cDigit - '0';
+	}
+	if ((cDigit >= 'a') && (cDigit <= 'f'))
+	{
+		return cDigit - 'a' + 10;
+	}
+	if ((cDigit >= 'A') && (cDigit <= 'F'))
+	{
+		return cDigit - 'A' + 10;
+	}
+
+	return -1;
+}
+
+const LPCSTR RegValueTraits<REG_SZ>::lpsTypeName = "REG_SZ";
+
+bool RegValueTraits<REG_SZ>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	return EncodeString(lpsValue, lpBuffer, true);
+}
+
+bool RegValueTraits<REG_SZ>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	return DecodeString(lpData, cbData, lpsOutput, cchOutput);
+}
+
+const LPCSTR RegValueTraits<REG_EXPAND_SZ>::lpsTypeName = "REG_EXPAND_SZ";
+
+bool RegValueTraits<REG_EXPAND_SZ>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	return EncodeString(lpsValue, lpBuffer, true);
+}
+
+bool RegValueTraits<REG_EXPAND_SZ>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	return DecodeString(lpData, cbData, lpsOutput, cchOutput);
+}
+
+const LPCSTR RegValueTraits<REG_LINK>::lpsTypeName = "REG_LINK";
+
+bool RegValueTraits<REG_LINK>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	// Symbolic link targets are stored without terminating null
+	return EncodeString(lpsValue, lpBuffer, false);
+}
+
+bool RegValueTraits<REG_LINK>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	return DecodeString(lpData, cbData, lpsOutput, cchOutput);
+}
+
+const LPCSTR RegValueTraits<REG_MULTI_SZ>::lpsTypeName = "REG_MULTI_SZ";
+
+/// <summary>
+///		Encode strings separated by "\0" (as reg.exe does) as double null terminated list
+/// </summary>
+/// 
+/// <param name="lpsValue">Value in string format</param>
+/// <param name="lpBuffer">Value buffer</param>
+/// 
+/// <returns>bool</returns>
+bool RegValueTraits<REG_MULTI_SZ>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	LPWSTR lpsResult = (LPWSTR)lpBuffer->lpData;
+	DWORD cchCapacity = lpBuffer->cbCapacity / sizeof(WCHAR);
+	DWORD cchUsed = 0;
+	LPCSTR lpsPart = lpsValue;
+
+	while (true)
+	{
+		LPCSTR lpsSeparator = strstr(lpsPart, MULTI_SZ_SEPARATOR);
+		int cbPart = (lpsSeparator == NULL) ? (int)strlen(lpsPart) : (int)(lpsSeparator - lpsPart);
+
+		// Reserve room for the part terminator and the list terminator
+		if (cchUsed + 2 > cchCapacity)
+		{
+			return false;
+		}
+
+		if (cbPart > 0)
+		{
+			// Part needs at least one character, conversion result is added only when it was written
+			DWORD cchAvailable = cchCapacity - cchUsed - 2;
+			if (cchAvailable == 0)
+			{
+				return false;
+			}
+
+			DWORD cchWritten = Utf8ToUtf16(lpsPart, cbPart, lpsResult + cchUsed, cchAvailable);
+			if ((cchWritten == TRANSCODE_ERROR) || (cchWritten > cchAvailable))
+			{
+				return false;
+			}
+
+			cchUsed += cchWritten;
+		}
+
+		lpsResult[cchUsed++] = L'\0';
+
+		if (lpsSeparator == NULL)
+		{
+			break;
+		}
+
+		lpsPart = lpsSeparator + MULTI_SZ_SEPARATOR_LENGTH;
+	}
+
+	lpsResult[cchUsed++] = L'\0';
+	lpBuffer->cbData = cchUsed * sizeof(WCHAR);
+
+	return true;
+}
+
+/// <summary>
+///		Decode double null terminated list to strings separated by "\0"
+/// </summary>
+/// 
+/// <param name="lpData">Value data</param>
+/// <param name="cbData">Value data size</param>
+/// <param name="lpsOutput">Output buffer</param>
+/// <param name="cchOutput">Output buffer length</param>
+/// 
+/// <returns>bool</returns>
+bool RegValueTraits<REG_MULTI_SZ>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	LPCWSTR lpsValue = (LPCWSTR)lpData;
+	DWORD cchValue = cbData / sizeof(WCHAR);
+	DWORD cchUsed = 0;
+
+	if (cchOutput == 0)
+	{
+		return false;
+	}
+
+	lpsOutput[0] = '\0';
+
+	for (DWORD dwPartStart = 0; (dwPartStart < cchValue) && (lpsValue[dwPartStart] != L'\0'); )
+	{
+		DWORD dwPartEnd = dwPartStart;
+		while ((dwPartEnd < cchValue) && (lpsValue[dwPartEnd] != L'\0'))
+		{
+			dwPartEnd++;
+		}
+
+		if (dwPartStart != 0)
+		{
+			if (cchUsed + MULTI_SZ_SEPARATOR_LENGTH >= cchOutput)
+			{
+				return false;
+			}
+
+			memcpy(lpsOutput + cchUsed, MULTI_SZ_SEPARATOR, MULTI_SZ_SEPARATOR_LENGTH);
+			cchUsed += MULTI_SZ_SEPARATOR_LENGTH;
+		}
+
+		DWORD cbWritten = Utf16ToUtf8(lpsValue + dwPartStart, dwPartEnd - dwPartStart, lpsOutput + cchUsed, cchOutput - cchUsed - 1);
+		if (cbWritten == TRANSCODE_ERROR)
+		{
+			return false;
+		}
+
+		cchUsed += cbWritten;
+		dwPartStart = dwPartEnd + 1;
+	}
+
+	lpsOutput[cchUsed] = '\0';
+	return true;
+}
+
+const LPCSTR RegValueTraits<REG_DWORD>::lpsTypeName = "REG_DWORD";
+
+bool RegValueTraits<REG_DWORD>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	return EncodeNumber(lpsValue, lpBuffer, sizeof(DWORD), false);
+}
+
+bool RegValueTraits<REG_DWORD>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	return DecodeNumber(lpData, cbData, lpsOutput, cchOutput, sizeof(DWORD), false);
+}
+
+const LPCSTR RegValueTraits<REG_DWORD_BIG_ENDIAN>::lpsTypeName = "REG_DWORD_BIG_ENDIAN";
+
+bool RegValueTraits<REG_DWORD_BIG_ENDIAN>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	return EncodeNumber(lpsValue, lpBuffer, sizeof(DWORD), true);
+}
+
+bool RegValueTraits<REG_DWORD_BIG_ENDIAN>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	return DecodeNumber(lpData, cbData, lpsOutput, cchOutput, sizeof(DWORD), true);
+}
+
+const LPCSTR RegValueTraits<REG_QWORD>::lpsTypeName = "REG_QWORD";
+
+bool RegValueTraits<REG_QWORD>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	return EncodeNumber(lpsValue, lpBuffer, sizeof(ULONGLONG), false);
+}
+
+bool RegValueTraits<REG_QWORD>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	return DecodeNumber(lpData, cbData, lpsOutput, cchOutput, sizeof(ULONGLONG), false);
+}
+
+const LPCSTR RegValueTraits<REG_BINARY>::lpsTypeName = "REG_BINARY";
+
+/// <summary>
+///		Encode hex string ("0A1B2C", "0a 1b 2c" or "0a,1b,2c") as bytes
+/// </summary>
+/// 
+/// <param name="lpsValue">Value in string format</param>
+/// <param name="lpBuffer">Value buffer</param>
+/// 
+/// <returns>bool</returns>
+bool RegValueTraits<REG_BINARY>::Encode(LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	DWORD cbUsed = 0;
+	int iHighDigit = -1;
+
+	for (LPCSTR lpsDigit = lpsValue; *lpsDigit != '\0'; lpsDigit++)
+	{
+		if ((*lpsDigit == ' ') || (*lpsDigit == ',') || (*lpsDigit == '\t'))
+		{
+			// Separators are allowed only between whole bytes
+			if (iHighDigit != -1)
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		int iDigit = GetHexDigitValue(*lpsDigit);
+		if (iDigit == -1)
+		{
+			return false;
+		}
+
+		if (iHighDigit == -1)
+		{
+			iHighDigit = iDigit;
+		}
+		else
+		{
+			if (cbUsed == lpBuffer->cbCapacity)
+			{
+				return false;
+			}
+
+			lpBuffer->lpData[cbUsed++] = (BYTE)((iHighDigit << 4) | iDigit);
+			iHighDigit = -1;
+		}
+	}
+
+	if (iHighDigit != -1)
+	{
+		return false;
+	}
+
+	lpBuffer->cbData = cbUsed;
+	return true;
+}
+
+/// <summary>
+///		Decode bytes as space separated hex string
+/// </summary>
+/// 
+/// <param name="lpData">Value data</param>
+/// <param name="cbData">Value data size</param>
+/// <param name="lpsOutput">Output buffer</param>
+/// <param name="cchOutput">Output buffer length</param>
+/// 
+/// <returns>bool</returns>
+bool RegValueTraits<REG_BINARY>::Decode(const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	const char lpsHexDigits[] = "0123456789abcdef";
+
+	if ((cchOutput == 0) || ((cbData != 0) && (cbData * 3 > cchOutput)))
+	{
+		return false;
+	}
+
+	DWORD cchUsed = 0;
+	for (DWORD dwByteIndex = 0; dwByteIndex < cbData; dwByteIndex++)
+	{
+		if (dwByteIndex != 0)
+		{
+			lpsOutput[cchUsed++] = ' ';
+		}
+
+		lpsOutput[cchUsed++] = lpsHexDigits[lpData[dwByteIndex] >> 4];
+		lpsOutput[cchUsed++] = lpsHexDigits[lpData[dwByteIndex] & 0x0F];
+	}
+
+	lpsOutput[cchUsed] = '\0';
+	return true;
+}
+
+#define REG_VALUE_CODEC(dwType) \
+	{ dwType, RegValueTraits<dwType>::lpsTypeName, RegValueTraits<dwType>::Encode, RegValueTraits<dwType>::Decode }
+
+static const REGVALUECODEC g_rvcValueCodecs[VALUE_TYPES_COUNT] = {
+	REG_VALUE_CODEC(REG_SZ),
+	REG_VALUE_CODEC(REG_EXPAND_SZ),
+	REG_VALUE_CODEC(REG_MULTI_SZ),
+	REG_VALUE_CODEC(REG_DWORD),
+	REG_VALUE_CODEC(REG_DWORD_BIG_ENDIAN),
+	REG_VALUE_CODEC(REG_QWORD),
+	REG_VALUE_CODEC(REG_BINARY),
+	REG_VALUE_CODEC(REG_LINK),
+};
+
+#undef REG_VALUE_CODEC
+
+/// <summary>
+///		Get codec of registry value type
+/// </summary>
+/// 
+/// <param name="dwType">Value type</param>
+/// 
+/// <returns>const REGVALUECODEC* (NULL if type is not supported)</returns>
+const REGVALUECODEC* GetValueCodec(DWORD dwType)
+{
+	for (DWORD dwCodecIndex = 0; dwCodecIndex < VALUE_TYPES_COUNT; dwCodecIndex++)
+	{
+		if (g_rvcValueCodecs[dwCodecIndex].dwType == dwType)
+		{
+			return &g_rvcValueCodecs[dwCodecIndex];
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Get codec of registry value type by type name
+/// </summary>
+/// 
+/// <param name="lpsTypeName">Type in string format</param>
+/// 
+/// <returns>const REGVALUECODEC* (NULL if type is not supported)</returns>
+const REGVALUECODEC* GetValueCodecByName(LPCSTR lpsTypeName)
+{
+	if (lpsTypeName == NULL)
+	{
+		return NULL;
+	}
+
+	for (DWORD dwCodecIndex = 0; dwCodecIndex < VALUE_TYPES_COUNT; dwCodecIndex++)
+	{
+		if (strcmp(g_rvcValueCodecs[dwCodecIndex].lpsTypeName, lpsTypeName) == 0)
+		{
+			return &g_rvcValueCodecs[dwCodecIndex];
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Convert value in string format to registry data
+/// </summary>
+/// 
+/// <param name="dwType">Value type</param>
+/// <param name="lpsValue">Value in string format</param>
+/// <param name="lpBuffer">Initialized value buffer</param>
+/// 
+/// <returns>bool</returns>
+bool EncodeRegValue(DWORD dwType, LPCSTR lpsValue, REGVALUEBUFFER* lpBuffer)
+{
+	const REGVALUECODEC* lpCodec = GetValueCodec(dwType);
+	if ((lpCodec == NULL) || (lpsValue == NULL) || (lpBuffer == NULL))
+	{
+		return false;
+	}
+
+	lpBuffer->cbData = 0;
+	return lpCodec->lpfnEncode(lpsValue, lpBuffer);
+}
+
+/// <summary>
+///		Convert registry data to value in string format
+/// </summary>
+/// 
+/// <param name="dwType">Value type</param>
+/// <param name="lpData">Value data</param>
+/// <param name="cbData">Value data size</param>
+/// <param name="lpsOutput">Output buffer</param>
+/// <param name="cchOutput">Output buffer length</param>
+/// 
+/// <returns>bool</returns>
+bool DecodeRegValue(DWORD dwType, const BYTE* lpData, DWORD cbData, LPSTR lpsOutput, DWORD cchOutput)
+{
+	const REGVALUECODEC* lpCodec = GetValueCodec(dwType);
+	if ((lpCodec == NULL) || ((lpData == NULL) && (cbData != 0)) || (lpsOutput == NULL))
+	{
+		return false;
+	}
+
+	return lpCodec->lpfnDecode(lpData, cbData, lpsOutput, cchOutput);
+}
@@ -0,0 +1,872 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/ValueIndex.h"
+#include "../Api/FuzzyMatch.h"
+#include "../Api/RegistryEditor.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Throttle.h"
+#include "../Api/Progress.h"
+#include "../Api/Collections.h"
+
+/// <summary>
+///		Append terminated string to strings pool
+/// </summary>
+/// 
+/// <param name="lpBuilder">Builder</param>
+/// <param name="lpsString">String</param>
+/// <param name="dwLength">String length</param>
+/// 
+/// <returns>DWORD (offset in pool, MAXDWORD on failure)</returns>
+static DWORD AppendString(VALUEINDEXBUILDER* lpBuilder, LPCWSTR lpsString, DWORD dwLength)
+{
+	DWORD dwOffset = lpBuilder->dwStringsLength;
+	if ((dwLength >= MAXDWORD - dwOffset - 1) ||
+		!ReserveArray((void**)&lpBuilder->lpsStrings, &lpBuilder->dwStringsCapacity, dwOffset + dwLength + 1, sizeof(WCHAR)))
+	{
+		lpBuilder->bFailed = true;
+		return MAXDWORD;
+	}
+
+	memcpy(lpBuilder->lpsStrings + dwOffset, lpsString, dwLength * sizeof(WCHAR));
+	lpBuilder->lpsStrings[dwOffset + dwLength] = L'\0';
+	lpBuilder->dwStringsLength += dwLength + 1;
+
+	return dwOffset;
+}
+
+/// <summary>
+///		Hash table slot of trigram
+/// </summary>
+/// 
+/// <returns>DWORD</returns>
+static DWORD GetTrigramSlot(ULONGLONG ullTrigram, DWORD dwCapacity)
+{
+	return (DWORD)((ullTrigram * 0x9E3779B97F4A7C15ULL) >> 32) & (dwCapacity - 1);
+}
+
+/// <summary>
+///		Find postings of trigram, add empty ones if trigram is new (open addressing, capacity is power of two)
+/// </summary>
+/// 
+/// <param name="lpBuilder">Builder</param>
+/// <param name="ullTrigram">Trigram</param>
+/// 
+/// <returns>TRIGRAMPOSTINGS* (NULL on failure)</returns>
+static TRIGRAMPOSTINGS* FindTrigramPostings(VALUEINDEXBUILDER* lpBuilder, ULONGLONG ullTrigram)
+{
+	// Table is kept at most half full
+	if ((lpBuilder->dwTrigramsCount + 1) * 2 > lpBuilder->dwTrigramsCapacity)
+	{
+		DWORD dwNewCapacity = (lpBuilder->dwTrigramsCapacity == 0) ? VALUE_INDEX_INITIAL_TRIGRAMS : lpBuilder->dwTrigramsCapacity * 2;
+		TRIGRAMPOSTINGS* lpNewTrigrams = (TRIGRAMPOSTINGS*)calloc(dwNewCapacity, sizeof(TRIGRAMPOSTINGS));
+		if (lpNewTrigrams == NULL)
+		{
+			return NULL;
+		}
+
+		for (DWORD dwIndex = 0; dwIndex < lpBuilder->dwTrigramsCapacity; dwIndex++)
+		{
+			TRIGRAMPOSTINGS* lpOld = &lpBuilder->lpTrigrams[dwIndex];
+			if (lpOld->dwPostingsCount == 0)
+			{
+				continue;
+			}
+
+			DWORD dwSlot = GetTrigramSlot(lpOld->ullTrigram, dwNewCapacity);
+			while (lpNewTrigrams[dwSlot].dwPostingsCount != 0)
+			{
+				dwSlot = (dwSlot + 1) & (dwNewCapacity - 1);
+			}
+			lpNewTrigrams[dwSlot] = *lpOld;
+		}
+
+		free(lpBuilder->lpTrigrams);
+		lpBuilder->lpTrigrams = lpNewTrigrams;
+		lpBuilder->dwTrigramsCapacity = dwNewCapacity;
+	}
+
+	// Slots with postings are used, new entry gets its first posting right away
+	DWORD dwSlot = GetTrigramSlot(ullTrigram, lpBuilder->dwTrigramsCapacity);
+	while ((lpBuilder->lpTrigrams[dwSlot].dwPostingsCount != 0) && (lpBuilder->lpTrigrams[dwSlot].ullTrigram != ullTrigram))
+	{
+		dwSlot = (dwSlot + 1) & (lpBuilder->dwTrigramsCapacity - 1);
+	}
+
+	TRIGRAMPOSTINGS* lpPostings = &lpBuilder->lpTrigrams[dwSlot];
+	if (lpPostings->dwPostingsCount == 0)
+	{
+		lpPostings->ullTrigram = ullTrigram;
+		lpBuilder->dwTrigramsCount++;
+	}
+
+	return lpPostings;
+}
+
+/// <summary>
+///		Append value id to postings as varint of delta from previous id
+/// </summary>
+/// 
+/// <param name="lpPostings">Postings</param>
+/// <param name="dwValueId">Value id (not less than previous)</param>
+/// 
+/// <returns>bool</returns>
+static bool AddPosting(TRIGRAMPOSTINGS* lpPostings, DWORD dwValueId)
+{
+	if ((lpPostings->dwPostingsCount != 0) && (lpPostings->dwLastValueId == dwValueId))
+	{
+		return true;
+	}
+
+	if (!ReserveArray((void**)&lpPostings->lpPostings, &lpPostings->cbCapacity, lpPostings->cbPostings + 5, sizeof(BYTE)))
+	{
+		return false;
+	}
+
+	DWORD dwDelta = (lpPostings->dwPostingsCount == 0) ? dwValueId : dwValueId - lpPostings->dwLastValueId;
+	while (dwDelta >= 0x80)
+	{
+		lpPostings->lpPostings[lpPostings->cbPostings++] = (BYTE)(dwDelta | 0x80);
+		dwDelta >>= 7;
+	}
+	lpPostings->lpPostings[lpPostings->cbPostings++] = (BYTE)dwDelta;
+
+	lpPostings->dwLastValueId = dwValueId;
+	lpPostings->dwPostingsCount++;
+
+	return true;
+}
+
+/// <summary>
+///		Pack three case folded characters
+/// </summary>
+/// 
+/// <returns>ULONGLONG</returns>
+static ULONGLONG MakeTrigram(WCHAR wcFirst, WCHAR wcSecond, WCHAR wcThird)
+{
+	return ((ULONGLONG)wcFirst << 32) | ((ULONGLONG)wcSecond << 16) | (ULONGLONG)wcThird;
+}
+
+/// <summary>
+///		Add all trigrams of value data to index
+/// </summary>
+/// 
+/// <param name="lpBuilder">Builder</param>
+/// <param name="dwValueId">Value id</param>
+/// <param name="lpsText">Value data</param>
+/// <param name="dwLength">Value data length</param>
+/// 
+/// <returns>void</returns>
+static void IndexValueText(VALUEINDEXBUILDER* lpBuilder, DWORD dwValueId, LPCWSTR lpsText, DWORD dwLength)
+{
+	if (dwLength < 3)
+	{
+		return;
+	}
+
+	WCHAR wcFirst = FoldChar(lpsText[0]);
+	WCHAR wcSecond = FoldChar(lpsText[1]);
+
+	for (DWORD dwPosition = 2; (dwPosition < dwLength) && !lpBuilder->bFailed; dwPosition++)
+	{
+		WCHAR wcThird = FoldChar(lpsText[dwPosition]);
+		TRIGRAMPOSTINGS* lpPostings = FindTrigramPostings(lpBuilder, MakeTrigram(wcFirst, wcSecond, wcThird));
+
+		if ((lpPostings == NULL) || !AddPosting(lpPostings, dwValueId))
+		{
+			lpBuilder->bFailed = true;
+		}
+
+		wcFirst = wcSecond;
+		wcSecond = wcThird;
+	}
+}
+
+/// <summary>
+///		Index string values of key and its subtree, subkey names are enumerated straight into builder path
+/// </summary>
+/// 
+/// <param name="lpBuilder">Builder (path holds key path)</param>
+/// <param name="hKey">Opened key</param>
+/// <param name="dwPathLength">Key path length</param>
+/// 
+/// <returns>void</returns>
+static void IndexKey(VALUEINDEXBUILDER* lpBuilder, HKEY hKey, DWORD dwPathLength)
+{
+	DWORD dwSubKeysCount, dwValuesCount, cbMaxValueSize;
+	if (!QueryRegKeyInfo(hKey, &dwSubKeysCount, &dwValuesCount, &cbMaxValueSize, NULL))
+	{
+		return;
+	}
+
+	// Room for terminating null that data may lack
+	if (!ReserveArray((void**)&lpBuilder->lpData, &lpBuilder->cbDataCapacity, cbMaxValueSize + sizeof(WCHAR), sizeof(BYTE)))
+	{
+		lpBuilder->bFailed = true;
+		return;
+	}
+
+	DWORD dwKeyPathOffset = MAXDWORD;
+	for (DWORD dwIndex = 0; (dwIndex < dwValuesCount) && !lpBuilder->bFailed; dwIndex++)
+	{
+		DWORD dwNameSize = VALUE_INDEX_MAX_VALUE_NAME_LENGTH;
+		DWORD cbData = lpBuilder->cbDataCapacity - sizeof(WCHAR);
+		DWORD dwType;
+
+		if ((EnumRegValue(hKey, dwIndex, lpBuilder->lpsValueName, &dwNameSize, &dwType, lpBuilder->lpData, &cbData) != ERROR_SUCCESS) ||
+			((dwType != REG_SZ) && (dwType != REG_EXPAND_SZ) && (dwType != REG_MULTI_SZ)))
+		{
+			continue;
+		}
+
+		// Trailing nulls are dropped, strings of REG_MULTI_SZ are separated by line breaks
+		LPWSTR lpsText = (LPWSTR)lpBuilder->lpData;
+		DWORD dwLength = cbData / sizeof(WCHAR);
+		while ((dwLength != 0) && (lpsText[dwLength - 1] == L'\0'))
+		{
+			dwLength--;
+		}
+		for (DWORD dwPosition = 0; dwPosition < dwLength; dwPosition++)
+		{
+			if (lpsText[dwPosition] == L'\0')
+			{
+				lpsText[dwPosition] = L'\n';
+			}
+		}
+
+		if (dwKeyPathOffset == MAXDWORD)
+		{
+			dwKeyPathOffset = AppendString(lpBuilder, lpBuilder->lpsPath, dwPathLength);
+		}
+
+		VALUEINDEXENTRY vieEntry;
+		vieEntry.dwKeyPathOffset = dwKeyPathOffset;
+		vieEntry.dwValueNameOffset = AppendString(lpBuilder, lpBuilder->lpsValueName, dwNameSize);
+		vieEntry.dwDataOffset = AppendString(lpBuilder, lpsText, dwLength);
+		vieEntry.dwDataLength = dwLength;
+		vieEntry.dwType = dwType;
+
+		if (lpBuilder->bFailed || (lpBuilder->dwEntriesCount == MAXDWORD) ||
+			!ReserveArray((void**)&lpBuilder->lpEntries, &lpBuilder->dwEntriesCapacity, lpBuilder->dwEntriesCount + 1, sizeof(VALUEINDEXENTRY)))
+		{
+			lpBuilder->bFailed = true;
+			return;
+		}
+
+		lpBuilder->lpEntries[lpBuilder->dwEntriesCount] = vieEntry;
+		IndexValueText(lpBuilder, lpBuilder->dwEntriesCount, lpsText, dwLength);
+		lpBuilder->dwEntriesCount++;
+	}
+
+	LPWSTR lpsSubKeyName = lpBuilder->lpsPath + dwPathLength + ((dwPathLength == 0) ? 0 : 1);
+	DWORD cchAvailable = VALUE_INDEX_MAX_PATH_LENGTH - (DWORD)(lpsSubKeyName - lpBuilder->lpsPath);
+
+	for (DWORD dwIndex = 0; (dwIndex < dwSubKeysCount) && (cchAvailable > 1) && !lpBuilder->bFailed; dwIndex++)
+	{
+		DWORD dwNameSize = cchAvailable;
+		LRESULT error = EnumRegKey(hKey, dwIndex, lpsSubKeyName, &dwNameSize, NULL);
+
+		if (error == ERROR_NO_MORE_ITEMS)
+		{
+			break;
+		}
+		if (error != ERROR_SUCCESS)
+		{
+			continue;
+		}
+
+		STAT_ADD(ullKeysVisited, 1);
+		ThrottleKeys(1);
+		AdvanceProgress(1);
+		if (dwPathLength != 0)
+		{
+			lpBuilder->lpsPath[dwPathLength] = L'\\';
+		}
+
+		HKEY hSubKey;
+		if (OpenRegKey(hKey, lpsSubKeyName, KEY_READ, &hSubKey))
+		{
+			if (dwPathLength == 0)
+			{
+				BeginProgressBranch(dwIndex);
+			}
+
+			IndexKey(lpBuilder, hSubKey, (DWORD)(lpsSubKeyName - lpBuilder->lpsPath) + dwNameSize);
+			CloseRegKey(hSubKey);
+
+			if (dwPathLength == 0)
+			{
+				EndProgressBranch();
+			}
+		}
+	}
+}
+
+/// <summary>
+///		qsort callback, trigrams ascending
+/// </summary>
+/// 
+/// <returns>int</returns>
+static int CompareTrigrams(const void* lpFirst, const void* lpSecond)
+{
+	ULONGLONG ullFirst = ((const TRIGRAMPOSTINGS*)lpFirst)->ullTrigram;
+	ULONGLONG ullSecond = ((const TRIGRAMPOSTINGS*)lpSecond)->ullTrigram;
+
+	return (ullFirst < ullSecond) ? -1 : ((ullFirst > ullSecond) ? 1 : 0);
+}
+
+/// <summary>
+///		Round offset up to 8 bytes
+/// </summary>
+/// 
+/// <returns>ULONGLONG</returns>
+static ULONGLONG AlignOffset(ULONGLONG ullOffset)
+{
+	return (ullOffset + 7) & ~7ULL;
+}
+
+/// <summary>
+///		Lay out collected values and postings as file image
+/// </summary>
+/// 
+/// <param name="lpBuilder">Builder</param>
+/// <param name="lpImage">Image</param>
+/// 
+/// <returns>bool</returns>
+static bool WriteValueIndexImage(VALUEINDEXBUILDER* lpBuilder, VALUEINDEXIMAGE* lpImage)
+{
+	// Used slots are moved to the front and sorted for binary search
+	DWORD dwTrigramsCount = 0;
+	for (DWORD dwIndex = 0; dwIndex < lpBuilder->dwTrigramsCapacity; dwIndex++)
+	{
+		if (lpBuilder->lpTrigrams[dwIndex].dwPostingsCount != 0)
+		{
+			lpBuilder->lpTrigrams[dwTrigramsCount++] = lpBuilder->lpTrigrams[dwIndex];
+		}
+	}
+	ZeroMemory(lpBuilder->lpTrigrams + dwTrigramsCount, (lpBuilder->dwTrigramsCapacity - dwTrigramsCount) * sizeof(TRIGRAMPOSTINGS));
+	qsort(lpBuilder->lpTrigrams, dwTrigramsCount, sizeof(TRIGRAMPOSTINGS), CompareTrigrams);
+
+	ULONGLONG ullPostingsSize = 0;
+	for (DWORD dwIndex = 0; dwIndex < dwTrigramsCount; dwIndex++)
+	{
+		ullPostingsSize += lpBuilder->lpTrigrams[dwIndex].cbPostings;
+	}
+
+	VALUEINDEXHEADER vihHeader;
+	ZeroMemory(&vihHeader, sizeof(VALUEINDEXHEADER));
+	vihHeader.dwMagic = VALUE_INDEX_MAGIC;
+	vihHeader.dwVersion = VALUE_INDEX_VERSION;
+	vihHeader.dwValuesCount = lpBuilder->dwEntriesCount;
+	vihHeader.dwTrigramsCount = dwTrigramsCount;
+	vihHeader.dwStringsLength = lpBuilder->dwStringsLength;
+	vihHeader.ullTrigramsOffset = AlignOffset(sizeof(VALUEINDEXHEADER));
+	vihHeader.ullEntriesOffset = AlignOffset(vihHeader.ullTrigramsOffset + (ULONGLONG)dwTrigramsCount * sizeof(VALUEINDEXTRIGRAM));
+	vihHeader.ullStringsOffset = AlignOffset(vihHeader.ullEntriesOffset + (ULONGLONG)lpBuilder->dwEntriesCount * sizeof(VALUEINDEXENTRY));
+	vihHeader.ullPostingsOffset = vihHeader.ullStringsOffset + (ULONGLONG)lpBuilder->dwStringsLength * sizeof(WCHAR);
+	vihHeader.ullPostingsSize = ullPostingsSize;
+	vihHeader.ullFileSize = vihHeader.ullPostingsOffset + ullPostingsSize;
+
+	if (vihHeader.ullFileSize > (SIZE_T)-1)
+	{
+		return false;
+	}
+
+	BYTE* lpData = (BYTE*)calloc((SIZE_T)vihHeader.ullFileSize, sizeof(BYTE));
+	if (lpData == NULL)
+	{
+		return false;
+	}
+
+	memcpy(lpData, &vihHeader, sizeof(VALUEINDEXHEADER));
+
+	VALUEINDEXTRIGRAM* lpTrigrams = (VALUEINDEXTRIGRAM*)(lpData + vihHeader.ullTrigramsOffset);
+	BYTE* lpPostings = lpData + vihHeader.ullPostingsOffset;
+	ULONGLONG ullPostingsOffset = 0;
+
+	for (DWORD dwIndex = 0; dwIndex < dwTrigramsCount; dwIndex++)
+	{
+		const TRIGRAMPOSTINGS* lpSource = &lpBuilder->lpTrigrams[dwIndex];
+
+		lpTrigrams[dwIndex].ullTrigram = lpSource->ullTrigram;
+		lpTrigrams[dwIndex].ullPostingsOffset = ullPostingsOffset;
+		lpTrigrams[dwIndex].dwPostingsCount = lpSource->dwPostingsCount;
+		lpTrigrams[dwIndex].cbPostings = lpSource->cbPostings;
+
+		memcpy(lpPostings + ullPostingsOffset, lpSource->lpPostings, lpSource->cbPostings);
+		ullPostingsOffset += lpSource->cbPostings;
+	}
+
+	if (lpBuilder->dwEntriesCount != 0)
+	{
+		memcpy(lpData + vihHeader.ullEntriesOffset, lpBuilder->lpEntries, lpBuilder->dwEntriesCount * sizeof(VALUEINDEXENTRY));
+	}
+	if (lpBuilder->dwStringsLength != 0)
+	{
+		memcpy(lpData + vihHeader.ullStringsOffset, lpBuilder->lpsStrings, lpBuilder->dwStringsLength * sizeof(WCHAR));
+	}
+
+	lpImage->lpData = lpData;
+	lpImage->cbData = (SIZE_T)vihHeader.ullFileSize;
+
+	return true;
+}
+
+/// <summary>
+///		Build trigram index of string values of subtree
+/// </summary>
+/// 
+/// <param name="hKey">Opened subtree root</param>
+/// <param name="lpImage">Index image, release with FreeValueIndexImage</param>
+/// 
+/// <returns>bool</returns>
+bool BuildValueIndex(HKEY hKey, VALUEINDEXIMAGE* lpImage)
+{
+	ZeroMemory(lpImage, sizeof(VALUEINDEXIMAGE));
+
+	VALUEINDEXBUILDER* lpBuilder = (VALUEINDEXBUILDER*)calloc(1, sizeof(VALUEINDEXBUILDER));
+	if (lpBuilder == NULL)
+	{
+		return false;
+	}
+
+	BeginProgressWalk(hKey);
+	IndexKey(lpBuilder, hKey, 0);
+	bool bResult = !lpBuilder->bFailed && WriteValueIndexImage(lpBuilder, lpImage);
+
+	for (DWORD dwIndex = 0; dwIndex < lpBuilder->dwTrigramsCapacity; dwIndex++)
+	{
+		free(lpBuilder->lpTrigrams[dwIndex].lpPostings);
+	}
+	free(lpBuilder->lpTrigrams);
+	free(lpBuilder->lpEntries);
+	free(lpBuilder->lpsStrings);
+	free(lpBuilder->lpData);
+	free(lpBuilder);
+
+	return bResult;
+}
+
+/// <summary>
+///		Write index image to file
+/// </summary>
+/// 
+/// <param name="lpImage">Index image</param>
+/// <param name="lpsFileName">File name</param>
+/// 
+/// <returns>bool</returns>
+bool SaveValueIndex(const VALUEINDEXIMAGE* lpImage, LPCSTR lpsFileName)
+{
+	FILE* lpFile;
+	if ((lpsFileName == NULL) || (fopen_s(&lpFile, lpsFileName, "wb") != 0))
+	{
+		return false;
+	}
+
+	bool bResult = fwrite(lpImage->lpData, sizeof(BYTE), lpImage->cbData, lpFile) == lpImage->cbData;
+
+	return (fclose(lpFile) == 0) && bResult;
+}
+
+/// <summary>
+///		Release index image
+/// </summary>
+/// 
+/// <param name="lpImage">Index image</param>
+/// 
+/// <returns>void</returns>
+void FreeValueIndexImage(VALUEINDEXIMAGE* lpImage)
+{
+	free(lpImage->lpData);
+	ZeroMemory(lpImage, sizeof(VALUEINDEXIMAGE));
+}
+
+/// <summary>
+///		Check index image and set pointers to its tables, image is used in place
+/// </summary>
+/// 
+/// <param name="lpData">Image (8 bytes aligned)</param>
+/// <param name="cbData">Image size</param>
+/// <param name="lpIndex">Index</param>
+/// 
+/// <returns>bool</returns>
+bool AttachValueIndex(const BYTE* lpData, SIZE_T cbData, VALUEINDEX* lpIndex)
+{
+	ZeroMemory(lpIndex, sizeof(VALUEINDEX));
+	lpIndex->hFile = INVALID_HANDLE_VALUE;
+
+	const VALUEINDEXHEADER* lpHeader = (const VALUEINDEXHEADER*)lpData;
+	if ((lpData == NULL) || (cbData < sizeof(VALUEINDEXHEADER)) ||
+		(lpHeader->dwMagic != VALUE_INDEX_MAGIC) || (lpHeader->dwVersion != VALUE_INDEX_VERSION) ||
+		(lpHeader->ullFileSize > cbData))
+	{
+		return false;
+	}
+
+	// Tables must follow each other inside image
+	ULONGLONG ullTrigramsEnd = lpHeader->ullTrigramsOffset + (ULONGLONG)lpHeader->dwTrigramsCount * sizeof(VALUEINDEXTRIGRAM);
+	ULONGLONG ullEntriesEnd = lpHeader->ullEntriesOffset + (ULONGLONG)lpHeader->dwValuesCount * sizeof(VALUEINDEXENTRY);
+	ULONGLONG ullStringsEnd = lpHeader->ullStringsOffset + (ULONGLONG)lpHeader->dwStringsLength * sizeof(WCHAR);
+
+	if ((lpHeader->ullTrigramsOffset < sizeof(VALUEINDEXHEADER)) || (lpHeader->ullTrigramsOffset % 8 != 0) ||
+		(lpHeader->ullEntriesOffset < ullTrigramsEnd) || (lpHeader->ullEntriesOffset % 8 != 0) ||
+		(lpHeader->ullStringsOffset < ullEntriesEnd) || (lpHeader->ullStringsOffset % 8 != 0) ||
+		(lpHeader->ullPostingsOffset < ullStringsEnd) ||
+		(lpHeader->ullPostingsSize > lpHeader->ullFileSize - lpHeader->ullPostingsOffset) ||
+		(lpHeader->ullPostingsOffset > lpHeader->ullFileSize))
+	{
+		return false;
+	}
+
+	// Every string is terminated, so terminated pool keeps lookups inside it
+	LPCWSTR lpsStrings = (LPCWSTR)(lpData + lpHeader->ullStringsOffset);
+	if ((lpHeader->dwStringsLength != 0) && (lpsStrings[lpHeader->dwStringsLength - 1] != L'\0'))
+	{
+		return false;
+	}
+
+	lpIndex->lpBase = lpData;
+	lpIndex->lpHeader = lpHeader;
+	lpIndex->lpTrigrams = (const VALUEINDEXTRIGRAM*)(lpData + lpHeader->ullTrigramsOffset);
+	lpIndex->lpEntries = (const VALUEINDEXENTRY*)(lpData + lpHeader->ullEntriesOffset);
+	lpIndex->lpsStrings = lpsStrings;
+	lpIndex->lpPostings = lpData + lpHeader->ullPostingsOffset;
+
+	return true;
+}
+
+/// <summary>
+///		Map index file into memory
+/// </summary>
+/// 
+/// <param name="lpsFileName">File name</param>
+/// <param name="lpIndex">Index, release with CloseValueIndex</param>
+/// 
+/// <returns>bool</returns>
+bool OpenValueIndex(LPCSTR lpsFileName, VALUEINDEX* lpIndex)
+{
+	HANDLE hFile = CreateFileA(lpsFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER liFileSize;
+	HANDLE hMapping = NULL;
+	const BYTE* lpData = NULL;
+
+	if (GetFileSizeEx(hFile, &liFileSize) && (liFileSize.QuadPart >= (LONGLONG)sizeof(VALUEINDEXHEADER)))
+	{
+		hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	if (hMapping != NULL)
+	{
+		lpData = (const BYTE*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+
+	if ((lpData == NULL) || !AttachValueIndex(lpData, (SIZE_T)liFileSize.QuadPart, lpIndex))
+	{
+		if (lpData != NULL)
+		{
+			UnmapViewOfFile(lpData);
+		}
+		if (hMapping != NULL)
+		{
+			CloseHandle(hMapping);
+		}
+		CloseHandle(hFile);
+
+		return false;
+	}
+
+	lpIndex->hFile = hFile;
+	lpIndex->hMapping = hMapping;
+
+	return true;
+}
+
+/// <summary>
+///		Unmap index file (attached images are left to their owner)
+/// </summary>
+/// 
+/// <param name="lpIndex">Index</param>
+/// 
+/// <returns>void</returns>
+void CloseValueIndex(VALUEINDEX* lpIndex)
+{
+	if (lpIndex->hMapping != NULL)
+	{
+		UnmapViewOfFile(lpIndex->lpBase);
+		CloseHandle(lpIndex->hMapping);
+	}
+	if ((lpIndex->hFile != NULL) && (lpIndex->hFile != INVALID_HANDLE_VALUE))
+	{
+		CloseHandle(lpIndex->hFile);
+	}
+
+	ZeroMemory(lpIndex, sizeof(VALUEINDEX));
+}
+
+/// <summary>
+///		Get terminated string from pool
+/// </summary>
+/// 
+/// <param name="lpIndex">Index</param>
+/// <param name="dwOffset">Offset in pool</param>
+/// 
+/// <returns>LPCWSTR (empty string if offset is out of pool)</returns>
+LPCWSTR GetValueIndexString(const VALUEINDEX* lpIndex, DWORD dwOffset)
+{
+	return (dwOffset < lpIndex->lpHeader->dwStringsLength) ? lpIndex->lpsStrings + dwOffset : L"";
+}
+
+/// <summary>
+///		Binary search of trigram
+/// </summary>
+/// 
+/// <returns>const VALUEINDEXTRIGRAM* (NULL if trigram is absent)</returns>
+static const VALUEINDEXTRIGRAM* FindIndexTrigram(const VALUEINDEX* lpIndex, ULONGLONG ullTrigram)
+{
+	DWORD dwLow = 0;
+	DWORD dwHigh = lpIndex->lpHeader->dwTrigramsCount;
+
+	while (dwLow < dwHigh)
+	{
+		DWORD dwMiddle = dwLow + (dwHigh - dwLow) / 2;
+		if (lpIndex->lpTrigrams[dwMiddle].ullTrigram < ullTrigram)
+		{
+			dwLow = dwMiddle + 1;
+		}
+		else
+		{
+			dwHigh = dwMiddle;
+		}
+	}
+
+	if ((dwLow < lpIndex->lpHeader->dwTrigramsCount) && (lpIndex->lpTrigrams[dwLow].ullTrigram == ullTrigram))
+	{
+		return &lpIndex->lpTrigrams[dwLow];
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Decode next value id of postings
+/// </summary>
+/// 
+/// <param name="lpPosition">Current position</param>
+/// <param name="lpEnd">End of postings</param>
+/// <param name="lpdwValueId">Previous value id / next value id</param>
+/// 
+/// <returns>bool</returns>
+static bool ReadPosting(const BYTE** lpPosition, const BYTE* lpEnd, DWORD* lpdwValueId)
+{
+	DWORD dwDelta = 0;
+	for (DWORD dwShift = 0; (*lpPosition < lpEnd) && (dwShift < 35); dwShift += 7)
+	{
+		BYTE bByte = *(*lpPosition)++;
+		dwDelta |= (DWORD)(bByte & 0x7F) << dwShift;
+
+		if ((bByte & 0x80) == 0)
+		{
+			*lpdwValueId += dwDelta;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+///		Keep only candidates present in postings of trigram (both lists ascending)
+/// </summary>
+/// 
+/// <param name="lpIndex">Index</param>
+/// <param name="lpTrigram">Trigram</param>
+/// <param name="lpdwCandidates">Candidates</param>
+/// <param name="dwCandidatesCount">Candidates count</param>
+/// <param name="bFirst">Candidates are empty, take whole postings</param>
+/// 
+/// <returns>DWORD (candidates count left)</returns>
+static DWORD IntersectPostings(const VALUEINDEX* lpIndex, const VALUEINDEXTRIGRAM* lpTrigram, DWORD* lpdwCandidates, DWORD dwCandidatesCount, bool bFirst)
+{
+	if ((lpTrigram->ullPostingsOffset > lpIndex->lpHeader->ullPostingsSize) ||
+		(lpTrigram->cbPostings > lpIndex->lpHeader->ullPostingsSize - lpTrigram->ullPostingsOffset))
+	{
+		return 0;
+	}
+
+	const BYTE* lpPosition = lpIndex->lpPostings + lpTrigram->ullPostingsOffset;
+	const BYTE* lpEnd = lpPosition + lpTrigram->cbPostings;
+	DWORD dwValueId = 0;
+	DWORD dwKeptCount = 0;
+
+	if (bFirst)
+	{
+		for (DWORD dwIndex = 0; (dwIndex < lpTrigram->dwPostingsCount) && (dwIndex < dwCandidatesCount); dwIndex++)
+		{
+			if (!ReadPosting(&lpPosition, lpEnd, &dwValueId))
+			{
+				break;
+			}
+			lpdwCandidates[dwKeptCount++] = dwValueId;
+		}
+
+		return dwKeptCount;
+	}
+
+	DWORD dwRead = 0;
+	bool bHasPosting = (dwRead++ < lpTrigram->dwPostingsCount) && ReadPosting(&lpPosition, lpEnd, &dwValueId);
+
+	for (DWORD dwIndex = 0; (dwIndex < dwCandidatesCount) && bHasPosting; dwIndex++)
+	{
+		while (bHasPosting && (dwValueId < lpdwCandidates[dwIndex]))
+		{
+			bHasPosting = (dwRead++ < lpTrigram->dwPostingsCount) && ReadPosting(&lpPosition, lpEnd, &dwValueId);
+		}
+
+		if (bHasPosting && (dwValueId == lpdwCandidates[dwIndex]))
+		{
+			lpdwCandidates[dwKeptCount++] = dwValueId;
+		}
+	}
+
+	return dwKeptCount;
+}
+
+/// <summary>
+///		Case insensitive substring check, pattern is already folded
+/// </summary>
+/// 
+/// <returns>bool</returns>
+static bool ContainsFolded(LPCWSTR lpsText, DWORD dwTextLength, LPCWSTR lpsPattern, DWORD dwPatternLength)
+{
+	for (DWORD dwStart = 0; dwStart + dwPatternLength <= dwTextLength; dwStart++)
+	{
+		DWORD dwMatched = 0;
+		while ((dwMatched < dwPatternLength) && (FoldChar(lpsText[dwStart + dwMatched]) == lpsPattern[dwMatched]))
+		{
+			dwMatched++;
+		}
+
+		if (dwMatched == dwPatternLength)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+///		Find values whose data contains text (case insensitive): postings of text trigrams
+///		are intersected, then remaining candidates are verified
+/// </summary>
+/// 
+/// <param name="lpIndex">Index</param>
+/// <param name="lpsText">Searched text</param>
+/// <param name="lpdwFoundCount">Found values count</param>
+/// 
+/// <returns>DWORD* (ascending value ids, NULL on failure)</returns>
+DWORD* SearchValueIndex(const VALUEINDEX* lpIndex, LPCWSTR lpsText, DWORD* lpdwFoundCount)
+{
+	DWORD dwLength = (lpsText == NULL) ? 0 : lstrlen(lpsText);
+	if (dwLength == 0)
+	{
+		return NULL;
+	}
+
+	DWORD dwValuesCount = lpIndex->lpHeader->dwValuesCount;
+	LPWSTR lpsPattern = (LPWSTR)calloc(dwLength + 1, sizeof(WCHAR));
+	const VALUEINDEXTRIGRAM** lpTrigrams = (const VALUEINDEXTRIGRAM**)calloc(dwLength, sizeof(VALUEINDEXTRIGRAM*));
+	DWORD* lpdwCandidates = NULL;
+	DWORD dwCandidatesCount = 0;
+	bool bResult = (lpsPattern != NULL) && (lpTrigrams != NULL);
+
+	for (DWORD dwPosition = 0; bResult && (dwPosition < dwLength); dwPosition++)
+	{
+		lpsPattern[dwPosition] = FoldChar(lpsText[dwPosition]);
+	}
+
+	// Short text has no trigrams, every value is candidate
+	DWORD dwTrigramsCount = 0;
+	bool bAbsent = false;
+
+	for (DWORD dwPosition = 2; bResult && (dwPosition < dwLength) && !bAbsent; dwPosition++)
+	{
+		const VALUEINDEXTRIGRAM* lpTrigram = FindIndexTrigram(lpIndex, MakeTrigram(lpsPattern[dwPosition - 2], lpsPattern[dwPosition - 1], lpsPattern[dwPosition]));
+		bAbsent = lpTrigram == NULL;
+
+		// Rarest trigram goes first, so candidates list is as short as possible
+		DWORD dwInsert = dwTrigramsCount++;
+		while ((dwInsert > 0) && !bAbsent && (lpTrigrams[dwInsert - 1]->dwPostingsCount > lpTrigram->dwPostingsCount))
+		{
+			lpTrigrams[dwInsert] = lpTrigrams[dwInsert - 1];
+			dwInsert--;
+		}
+		lpTrigrams[dwInsert] = lpTrigram;
+	}
+
+	if (bResult && !bAbsent)
+	{
+		DWORD dwCapacity = (dwTrigramsCount == 0) ? dwValuesCount : lpTrigrams[0]->dwPostingsCount;
+		lpdwCandidates = (DWORD*)calloc((SIZE_T)dwCapacity + 1, sizeof(DWORD));
+		bResult = lpdwCandidates != NULL;
+
+		if (bResult && (dwTrigramsCount == 0))
+		{
+			for (dwCandidatesCount = 0; dwCandidatesCount < dwValuesCount; dwCandidatesCount++)
+			{
+				lpdwCandidates[dwCandidatesCount] = dwCandidatesCount;
+			}
+		}
+
+		for (DWORD dwIndex = 0; bResult && (dwIndex < dwTrigramsCount) && ((dwIndex == 0) || (dwCandidatesCount != 0)); dwIndex++)
+		{
+			dwCandidatesCount = IntersectPostings(lpIndex, lpTrigrams[dwIndex], lpdwCandidates, (dwIndex == 0) ? dwCapacity : dwCandidatesCount, dwIndex == 0);
+		}
+	}
+	else if (bResult)
+	{
+		lpdwCandidates = (DWORD*)calloc(1, sizeof(DWORD));
+		bResult = lpdwCandidates != NULL;
+	}
+
+	// Trigrams only filter, text itself is checked for every candidate
+	DWORD dwFoundCount = 0;
+	for (DWORD dwIndex = 0; bResult && (dwIndex < dwCandidatesCount); dwIndex++)
+	{
+		DWORD dwValueId = lpdwCandidates[dwIndex];
+		if (dwValueId >= dwValuesCount)
+		{
+			continue;
+		}
+
+		const VALUEINDEXENTRY* lpEntry = &lpIndex->lpEntries[dwValueId];
+		if ((lpEntry->dwDataOffset >= lpIndex->lpHeader->dwStringsLength) ||
+			(lpEntry->dwDataLength >= lpIndex->lpHeader->dwStringsLength - lpEntry->dwDataOffset))
+		{
+			continue;
+		}
+
+		if (ContainsFolded(lpIndex->lpsStrings + lpEntry->dwDataOffset, lpEntry->dwDataLength, lpsPattern, dwLength))
+		{
+			lpdwCandidates[dwFoundCount++] = dwValueId;
+		}
+	}
+
+	free(lpsPattern);
+	free(lpTrigrams);
+
+	if (!bResult)
+	{
+		free(lpdwCandidates);
+		return NULL;
+	}
+
+	*lpdwFoundCount = dwFoundCount;
+
+	return lpdwCandidates;
+}
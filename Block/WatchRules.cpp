@@ -0,0 +1,809 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Api/WatchRules.h"
+#include "../Api/FuzzyMatch.h"
+#include "../Api/ValueCodec.h"
+#include "../Api/Output.h"
+#include "../Api/Transcode.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Collections.h"
+
+const DWORD WATCH_UNKNOWN_STATE = MAXDWORD;
+const DWORD WATCH_STATE_SLOTS_COUNT = WATCH_MAX_DFA_STATES * 2;
+
+/// <summary>
+///		Free lazily built DFA, it is rebuilt on next match
+/// </summary>
+///
+/// <returns>void</returns>
+static void ResetWatchDfa(WATCHRULESET* lpRuleSet)
+{
+	free(lpRuleSet->lpStates);
+	free(lpRuleSet->lpdwTransitions);
+	free(lpRuleSet->lpdwStateNodes);
+	free(lpRuleSet->lpdwStateSlots);
+	free(lpRuleSet->lpdwNodeMarks);
+	free(lpRuleSet->lpdwScratch);
+
+	lpRuleSet->lpStates = NULL;
+	lpRuleSet->dwStatesCount = 0;
+	lpRuleSet->lpdwTransitions = NULL;
+	lpRuleSet->lpdwStateNodes = NULL;
+	lpRuleSet->dwStateNodesCount = 0;
+	lpRuleSet->dwStateNodesCapacity = 0;
+	lpRuleSet->lpdwStateSlots = NULL;
+	lpRuleSet->dwStartState = WATCH_UNKNOWN_STATE;
+	lpRuleSet->lpdwNodeMarks = NULL;
+	lpRuleSet->dwMarkGeneration = 0;
+	lpRuleSet->lpdwScratch = NULL;
+	lpRuleSet->dwScratchCapacity = 0;
+}
+
+/// <summary>
+///		Find position of non-ASCII character in sorted table of pattern characters
+/// </summary>
+///
+/// <returns>DWORD (position it is at or would be inserted at)</returns>
+static DWORD FindOtherChar(const WATCHRULESET* lpRuleSet, WCHAR wcChar)
+{
+	DWORD dwLow = 0, dwHigh = lpRuleSet->dwOtherCount;
+	while (dwLow < dwHigh)
+	{
+		DWORD dwMiddle = dwLow + (dwHigh - dwLow) / 2;
+		if (lpRuleSet->lpwcOtherChars[dwMiddle] < wcChar)
+		{
+			dwLow = dwMiddle + 1;
+		}
+		else
+		{
+			dwHigh = dwMiddle;
+		}
+	}
+
+	return dwLow;
+}
+
+/// <summary>
+///		Get class of case folded character
+/// </summary>
+///
+/// <returns>WORD</returns>
+static WORD GetCharClass(const WATCHRULESET* lpRuleSet, WCHAR wcChar)
+{
+	if (wcChar < WATCH_ASCII_COUNT)
+	{
+		return lpRuleSet->wAsciiClasses[wcChar];
+	}
+
+	DWORD dwIndex = FindOtherChar(lpRuleSet, wcChar);
+	if ((dwIndex < lpRuleSet->dwOtherCount) && (lpRuleSet->lpwcOtherChars[dwIndex] == wcChar))
+	{
+		return lpRuleSet->lpwOtherClasses[dwIndex];
+	}
+
+	return WATCH_CLASS_OTHER;
+}
+
+/// <summary>
+///		Get class of pattern character, characters seen first time get own class
+/// </summary>
+///
+/// <returns>WORD (WATCH_CLASS_OTHER if no memory)</returns>
+static WORD AddCharClass(WATCHRULESET* lpRuleSet, WCHAR wcChar)
+{
+	WORD wClass = GetCharClass(lpRuleSet, wcChar);
+	if ((wClass != WATCH_CLASS_OTHER) || (lpRuleSet->dwClassesCount > MAXWORD))
+	{
+		return wClass;
+	}
+
+	wClass = (WORD)lpRuleSet->dwClassesCount;
+	if (wcChar < WATCH_ASCII_COUNT)
+	{
+		lpRuleSet->wAsciiClasses[wcChar] = wClass;
+	}
+	else
+	{
+		DWORD dwCapacity = lpRuleSet->dwOtherCapacity;
+		if (!ReserveArray((void**)&lpRuleSet->lpwcOtherChars, &dwCapacity, lpRuleSet->dwOtherCount + 1, sizeof(WCHAR)) ||
+			!ReserveArray((void**)&lpRuleSet->lpwOtherClasses, &lpRuleSet->dwOtherCapacity, lpRuleSet->dwOtherCount + 1, sizeof(WORD)))
+		{
+			return WATCH_CLASS_OTHER;
+		}
+
+		// Table stays sorted for lookup of every matched character
+		DWORD dwIndex = FindOtherChar(lpRuleSet, wcChar);
+		DWORD dwTailCount = lpRuleSet->dwOtherCount - dwIndex;
+		memmove(&lpRuleSet->lpwcOtherChars[dwIndex + 1], &lpRuleSet->lpwcOtherChars[dwIndex], dwTailCount * sizeof(WCHAR));
+		memmove(&lpRuleSet->lpwOtherClasses[dwIndex + 1], &lpRuleSet->lpwOtherClasses[dwIndex], dwTailCount * sizeof(WORD));
+
+		lpRuleSet->lpwcOtherChars[dwIndex] = wcChar;
+		lpRuleSet->lpwOtherClasses[dwIndex] = wClass;
+		lpRuleSet->dwOtherCount++;
+	}
+
+	lpRuleSet->dwClassesCount++;
+
+	return wClass;
+}
+
+/// <summary>
+///		Get child of trie node with given token, it is created if it does not exist
+/// </summary>
+///
+/// <returns>DWORD (WATCH_NO_RULE if no memory)</returns>
+static DWORD AddChildNode(WATCHRULESET* lpRuleSet, DWORD dwParent, BYTE bToken, WORD wClass)
+{
+	for (DWORD dwChild = lpRuleSet->lpNodes[dwParent].dwFirstChild; dwChild != 0; dwChild = lpRuleSet->lpNodes[dwChild].dwNextSibling)
+	{
+		if ((lpRuleSet->lpNodes[dwChild].bToken == bToken) && (lpRuleSet->lpNodes[dwChild].wClass == wClass))
+		{
+			return dwChild;
+		}
+	}
+
+	if (!ReserveArray((void**)&lpRuleSet->lpNodes, &lpRuleSet->dwNodesCapacity, lpRuleSet->dwNodesCount + 1, sizeof(WATCHNODE)))
+	{
+		return WATCH_NO_RULE;
+	}
+
+	// Root is node 0, so 0 also marks missing child and sibling
+	DWORD dwNode = lpRuleSet->dwNodesCount++;
+	lpRuleSet->lpNodes[dwNode].bToken = bToken;
+	lpRuleSet->lpNodes[dwNode].wClass = wClass;
+	lpRuleSet->lpNodes[dwNode].dwFirstChild = 0;
+	lpRuleSet->lpNodes[dwNode].dwNextSibling = lpRuleSet->lpNodes[dwParent].dwFirstChild;
+	lpRuleSet->lpNodes[dwNode].dwRule = WATCH_NO_RULE;
+	lpRuleSet->lpNodes[dwParent].dwFirstChild = dwNode;
+
+	return dwNode;
+}
+
+/// <summary>
+///		Insert pattern into trie after given node
+/// </summary>
+///
+/// <param name="lpRuleSet">Rule set</param>
+/// <param name="dwNode">Node pattern continues</param>
+/// <param name="lpsPattern">Pattern</param>
+/// <param name="bValueName">Pattern of value name, its wildcards may match '\'</param>
+///
+/// <returns>DWORD (last node of pattern, WATCH_NO_RULE if no memory)</returns>
+static DWORD AddPatternNodes(WATCHRULESET* lpRuleSet, DWORD dwNode, LPCWSTR lpsPattern, bool bValueName)
+{
+	for (DWORD dwPosition = 0; (lpsPattern[dwPosition] != L'\0') && (dwNode != WATCH_NO_RULE); dwPosition++)
+	{
+		WCHAR wcChar = lpsPattern[dwPosition];
+
+		if ((wcChar == L'*') && !bValueName && (lpsPattern[dwPosition + 1] == L'*'))
+		{
+			dwNode = AddChildNode(lpRuleSet, dwNode, WATCH_TOKEN_STAR, 0);
+			dwPosition++;
+		}
+		else if (wcChar == L'*')
+		{
+			dwNode = AddChildNode(lpRuleSet, dwNode, bValueName ? WATCH_TOKEN_STAR : WATCH_TOKEN_NAME_STAR, 0);
+		}
+		else if (wcChar == L'?')
+		{
+			dwNode = AddChildNode(lpRuleSet, dwNode, bValueName ? WATCH_TOKEN_ANY_CHAR : WATCH_TOKEN_NAME_CHAR, 0);
+		}
+		else
+		{
+			WORD wClass = (wcChar == L'\\') ? WATCH_CLASS_BACKSLASH : AddCharClass(lpRuleSet, FoldChar(wcChar));
+			dwNode = (wClass == WATCH_CLASS_OTHER) ? WATCH_NO_RULE : AddChildNode(lpRuleSet, dwNode, WATCH_TOKEN_CHAR, wClass);
+		}
+	}
+
+	return dwNode;
+}
+
+/// <summary>
+///		Find sink by name, it is opened on first use
+/// </summary>
+///
+/// <returns>DWORD (WATCH_NO_RULE if name is not valid)</returns>
+static DWORD AddWatchSink(WATCHRULESET* lpRuleSet, LPCSTR lpsSink)
+{
+	for (DWORD dwSink = 0; dwSink < lpRuleSet->dwSinksCount; dwSink++)
+	{
+		if (_stricmp(lpRuleSet->lpSinks[dwSink].lpsName, lpsSink) == 0)
+		{
+			return dwSink;
+		}
+	}
+
+	WATCHSINK wsSink;
+	ZeroMemory(&wsSink, sizeof(WATCHSINK));
+
+	if (_stricmp(lpsSink, "console") == 0)
+	{
+		wsSink.dwKind = WATCH_SINK_CONSOLE;
+	}
+	else if (_stricmp(lpsSink, "stderr") == 0)
+	{
+		wsSink.dwKind = WATCH_SINK_STDERR;
+	}
+	else if ((_strnicmp(lpsSink, "file:", 5) == 0) && (lpsSink[5] != '\0'))
+	{
+		wsSink.dwKind = WATCH_SINK_FILE;
+		if (fopen_s(&wsSink.lpFile, lpsSink + 5, "ab") != 0)
+		{
+			return WATCH_NO_RULE;
+		}
+	}
+	else
+	{
+		return WATCH_NO_RULE;
+	}
+
+	wsSink.lpsName = _strdup(lpsSink);
+	if ((wsSink.lpsName == NULL) ||
+		!ReserveArray((void**)&lpRuleSet->lpSinks, &lpRuleSet->dwSinksCapacity, lpRuleSet->dwSinksCount + 1, sizeof(WATCHSINK)))
+	{
+		free(wsSink.lpsName);
+		if (wsSink.lpFile != NULL)
+		{
+			fclose(wsSink.lpFile);
+		}
+		return WATCH_NO_RULE;
+	}
+
+	lpRuleSet->lpSinks[lpRuleSet->dwSinksCount] = wsSink;
+
+	return lpRuleSet->dwSinksCount++;
+}
+
+/// <summary>
+///		Initialize empty rule set
+/// </summary>
+///
+/// <param name="lpRuleSet">Rule set</param>
+///
+/// <returns>void</returns>
+void InitWatchRules(WATCHRULESET* lpRuleSet)
+{
+	ZeroMemory(lpRuleSet, sizeof(WATCHRULESET));
+	lpRuleSet->wAsciiClasses[L'\\'] = WATCH_CLASS_BACKSLASH;
+	lpRuleSet->dwClassesCount = WATCH_FIRST_CHAR_CLASS;
+	lpRuleSet->dwStartState = WATCH_UNKNOWN_STATE;
+}
+
+/// <summary>
+///		Add rule to rule set, rules added earlier take precedence
+/// </summary>
+///
+/// <param name="lpRuleSet">Rule set</param>
+/// <param name="bIgnore">Matched events are dropped</param>
+/// <param name="lpsKeyPattern">Pattern of key path</param>
+/// <param name="lpsValuePattern">Pattern of value name (NULL matches any)</param>
+/// <param name="lpsSink">Sink of matched events (NULL for console)</param>
+/// <param name="dwLine">Line of rule file</param>
+///
+/// <returns>bool</returns>
+bool AddWatchRule(WATCHRULESET* lpRuleSet, bool bIgnore, LPCWSTR lpsKeyPattern, LPCWSTR lpsValuePattern, LPCSTR lpsSink, DWORD dwLine)
+{
+	// Trie and classes change, so states built so far are not valid
+	ResetWatchDfa(lpRuleSet);
+
+	if (lpRuleSet->dwNodesCount == 0)
+	{
+		if (!ReserveArray((void**)&lpRuleSet->lpNodes, &lpRuleSet->dwNodesCapacity, 1, sizeof(WATCHNODE)))
+		{
+			return false;
+		}
+
+		ZeroMemory(&lpRuleSet->lpNodes[0], sizeof(WATCHNODE));
+		lpRuleSet->lpNodes[0].bToken = WATCH_TOKEN_ROOT;
+		lpRuleSet->lpNodes[0].dwRule = WATCH_NO_RULE;
+		lpRuleSet->dwNodesCount = 1;
+	}
+
+	DWORD dwSink = AddWatchSink(lpRuleSet, (lpsSink == NULL) ? "console" : lpsSink);
+	if ((dwSink == WATCH_NO_RULE) ||
+		!ReserveArray((void**)&lpRuleSet->lpRules, &lpRuleSet->dwRulesCapacity, lpRuleSet->dwRulesCount + 1, sizeof(WATCHRULE)))
+	{
+		return false;
+	}
+
+	// Key path and value name are matched as one string joined by separator class
+	DWORD dwNode = AddPatternNodes(lpRuleSet, 0, lpsKeyPattern, false);
+	if (dwNode != WATCH_NO_RULE)
+	{
+		dwNode = AddChildNode(lpRuleSet, dwNode, WATCH_TOKEN_CHAR, WATCH_CLASS_SEPARATOR);
+	}
+	if (dwNode != WATCH_NO_RULE)
+	{
+		dwNode = AddPatternNodes(lpRuleSet, dwNode, (lpsValuePattern == NULL) ? L"*" : lpsValuePattern, true);
+	}
+	if (dwNode == WATCH_NO_RULE)
+	{
+		return false;
+	}
+
+	WATCHRULE* lpRule = &lpRuleSet->lpRules[lpRuleSet->dwRulesCount];
+	lpRule->bIgnore = bIgnore;
+	lpRule->dwSink = dwSink;
+	lpRule->dwLine = dwLine;
+	lpRule->ullMatchedCount = 0;
+
+	if (lpRuleSet->lpNodes[dwNode].dwRule == WATCH_NO_RULE)
+	{
+		lpRuleSet->lpNodes[dwNode].dwRule = lpRuleSet->dwRulesCount;
+	}
+	lpRuleSet->dwRulesCount++;
+
+	return true;
+}
+
+/// <summary>
+///		Take next token of rule line, double quotes group words
+/// </summary>
+///
+/// <returns>LPSTR (NULL at end of line)</returns>
+static LPSTR NextRuleToken(LPSTR* lpsPosition)
+{
+	LPSTR lpsToken = *lpsPosition;
+	while ((*lpsToken == ' ') || (*lpsToken == '\t'))
+	{
+		lpsToken++;
+	}
+
+	if ((*lpsToken == '\0') || (*lpsToken == '#'))
+	{
+		*lpsPosition = lpsToken;
+		return NULL;
+	}
+
+	LPSTR lpsEnd = lpsToken;
+	if (*lpsToken == '"')
+	{
+		lpsToken++;
+		lpsEnd = strchr(lpsToken, '"');
+		if (lpsEnd == NULL)
+		{
+			lpsEnd = lpsToken + strlen(lpsToken);
+		}
+	}
+	else
+	{
+		while ((*lpsEnd != '\0') && (*lpsEnd != ' ') && (*lpsEnd != '\t'))
+		{
+			lpsEnd++;
+		}
+	}
+
+	*lpsPosition = (*lpsEnd == '\0') ? lpsEnd : lpsEnd + 1;
+	*lpsEnd = '\0';
+
+	return lpsToken;
+}
+
+/// <summary>
+///		Load and compile rule file
+/// </summary>
+///
+/// <param name="lpsFileName">Rule file</param>
+/// <param name="lpRuleSet">Rule set, it is initialized here</param>
+/// <param name="lpdwErrorLine">Line of first invalid rule (0 if file can not be read)</param>
+///
+/// <returns>bool</returns>
+bool LoadWatchRules(LPCSTR lpsFileName, WATCHRULESET* lpRuleSet, DWORD* lpdwErrorLine)
+{
+	InitWatchRules(lpRuleSet);
+	*lpdwErrorLine = 0;
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "r") != 0)
+	{
+		return false;
+	}
+
+	CHAR lpsLine[WATCH_MAX_RULE_LENGTH];
+	WCHAR lpsKeyPattern[WATCH_MAX_RULE_LENGTH];
+	WCHAR lpsValuePattern[WATCH_MAX_RULE_LENGTH];
+	DWORD dwLine = 0;
+	bool bResult = true;
+
+	while (bResult && (fgets(lpsLine, WATCH_MAX_RULE_LENGTH, lpFile) != NULL))
+	{
+		dwLine++;
+		lpsLine[strcspn(lpsLine, "\r\n")] = '\0';
+
+		LPSTR lpsPosition = lpsLine;
+		LPSTR lpsAction = NextRuleToken(&lpsPosition);
+		if (lpsAction == NULL)
+		{
+			continue;
+		}
+
+		LPSTR lpsKey = NextRuleToken(&lpsPosition);
+		LPSTR lpsValue = NextRuleToken(&lpsPosition);
+		LPSTR lpsSink = NextRuleToken(&lpsPosition);
+		bool bIgnore = _stricmp(lpsAction, "ignore") == 0;
+
+		bResult = (bIgnore || (_stricmp(lpsAction, "alert") == 0)) && (lpsKey != NULL) &&
+			(NextRuleToken(&lpsPosition) == NULL) && !(bIgnore && (lpsSink != NULL)) &&
+			WidenString(lpsKey, lpsKeyPattern, WATCH_MAX_RULE_LENGTH) &&
+			((lpsValue == NULL) || WidenString(lpsValue, lpsValuePattern, WATCH_MAX_RULE_LENGTH)) &&
+			AddWatchRule(lpRuleSet, bIgnore, lpsKeyPattern, (lpsValue == NULL) ? NULL : lpsValuePattern, lpsSink, dwLine);
+	}
+
+	fclose(lpFile);
+
+	if (!bResult)
+	{
+		*lpdwErrorLine = dwLine;
+		FreeWatchRules(lpRuleSet);
+	}
+
+	return bResult;
+}
+
+/// <summary>
+///		Allocate DFA of current trie
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool EnsureWatchDfa(WATCHRULESET* lpRuleSet)
+{
+	if (lpRuleSet->lpStates != NULL)
+	{
+		return true;
+	}
+
+	lpRuleSet->lpStates = (WATCHSTATE*)malloc(WATCH_MAX_DFA_STATES * sizeof(WATCHSTATE));
+	lpRuleSet->lpdwTransitions = (DWORD*)malloc((SIZE_T)WATCH_MAX_DFA_STATES * lpRuleSet->dwClassesCount * sizeof(DWORD));
+	lpRuleSet->lpdwStateSlots = (DWORD*)calloc(WATCH_STATE_SLOTS_COUNT, sizeof(DWORD));
+	lpRuleSet->lpdwNodeMarks = (DWORD*)calloc(lpRuleSet->dwNodesCount, sizeof(DWORD));
+	lpRuleSet->lpdwScratch = (DWORD*)malloc(lpRuleSet->dwNodesCount * sizeof(DWORD));
+	lpRuleSet->dwScratchCapacity = lpRuleSet->dwNodesCount;
+
+	if ((lpRuleSet->lpStates == NULL) || (lpRuleSet->lpdwTransitions == NULL) || (lpRuleSet->lpdwStateSlots == NULL) ||
+		(lpRuleSet->lpdwNodeMarks == NULL) || (lpRuleSet->lpdwScratch == NULL))
+	{
+		ResetWatchDfa(lpRuleSet);
+		return false;
+	}
+
+	STAT_ALLOC((SIZE_T)WATCH_MAX_DFA_STATES * (sizeof(WATCHSTATE) + lpRuleSet->dwClassesCount * sizeof(DWORD)));
+
+	return true;
+}
+
+/// <summary>
+///		Add node and nodes reachable from it without consuming character (wildcards matching nothing) to scratch set
+/// </summary>
+///
+/// <returns>void</returns>
+static void AddNodeClosure(WATCHRULESET* lpRuleSet, DWORD* lpdwCount, DWORD dwNode)
+{
+	if (lpRuleSet->lpdwNodeMarks[dwNode] == lpRuleSet->dwMarkGeneration)
+	{
+		return;
+	}
+
+	lpRuleSet->lpdwNodeMarks[dwNode] = lpRuleSet->dwMarkGeneration;
+	lpRuleSet->lpdwScratch[(*lpdwCount)++] = dwNode;
+
+	for (DWORD dwChild = lpRuleSet->lpNodes[dwNode].dwFirstChild; dwChild != 0; dwChild = lpRuleSet->lpNodes[dwChild].dwNextSibling)
+	{
+		BYTE bToken = lpRuleSet->lpNodes[dwChild].bToken;
+		if ((bToken == WATCH_TOKEN_NAME_STAR) || (bToken == WATCH_TOKEN_STAR))
+		{
+			AddNodeClosure(lpRuleSet, lpdwCount, dwChild);
+		}
+	}
+}
+
+/// <summary>
+///		Start new scratch set
+/// </summary>
+///
+/// <returns>void</returns>
+static void BeginNodeSet(WATCHRULESET* lpRuleSet)
+{
+	if (++lpRuleSet->dwMarkGeneration == 0)
+	{
+		ZeroMemory(lpRuleSet->lpdwNodeMarks, lpRuleSet->dwNodesCount * sizeof(DWORD));
+		lpRuleSet->dwMarkGeneration = 1;
+	}
+}
+
+/// <summary>
+///		Check if token consumes character of class
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool TokenAcceptsClass(const WATCHNODE* lpNode, WORD wClass)
+{
+	if (lpNode->bToken == WATCH_TOKEN_CHAR)
+	{
+		return lpNode->wClass == wClass;
+	}
+	if ((lpNode->bToken == WATCH_TOKEN_NAME_CHAR) || (lpNode->bToken == WATCH_TOKEN_NAME_STAR))
+	{
+		return (wClass != WATCH_CLASS_BACKSLASH) && (wClass != WATCH_CLASS_SEPARATOR);
+	}
+	if ((lpNode->bToken == WATCH_TOKEN_ANY_CHAR) || (lpNode->bToken == WATCH_TOKEN_STAR))
+	{
+		return wClass != WATCH_CLASS_SEPARATOR;
+	}
+
+	return false;
+}
+
+/// <summary>
+///		qsort callback, node ids
+/// </summary>
+///
+/// <returns>int</returns>
+static int CompareNodeIds(const void* lpFirst, const void* lpSecond)
+{
+	DWORD dwFirst = *(const DWORD*)lpFirst;
+	DWORD dwSecond = *(const DWORD*)lpSecond;
+
+	return (dwFirst < dwSecond) ? -1 : ((dwFirst > dwSecond) ? 1 : 0);
+}
+
+/// <summary>
+///		Find state of scratch set, new sets become new states. When DFA is full it is flushed
+///		and rebuilt from scratch set, so memory stays bounded for any rules and input.
+/// </summary>
+///
+/// <returns>DWORD (WATCH_UNKNOWN_STATE if no memory)</returns>
+static DWORD AddWatchState(WATCHRULESET* lpRuleSet, DWORD dwCount)
+{
+	qsort(lpRuleSet->lpdwScratch, dwCount, sizeof(DWORD), CompareNodeIds);
+
+	DWORD dwHash = HashWords(HASH_INITIAL_VALUE, lpRuleSet->lpdwScratch, dwCount);
+
+	DWORD dwSlot = dwHash & (WATCH_STATE_SLOTS_COUNT - 1);
+	for (; lpRuleSet->lpdwStateSlots[dwSlot] != 0; dwSlot = (dwSlot + 1) & (WATCH_STATE_SLOTS_COUNT - 1))
+	{
+		const WATCHSTATE* lpState = &lpRuleSet->lpStates[lpRuleSet->lpdwStateSlots[dwSlot] - 1];
+		if ((lpState->dwHash == dwHash) && (lpState->dwNodesCount == dwCount) &&
+			(memcmp(lpRuleSet->lpdwStateNodes + lpState->dwNodesOffset, lpRuleSet->lpdwScratch, dwCount * sizeof(DWORD)) == 0))
+		{
+			return lpRuleSet->lpdwStateSlots[dwSlot] - 1;
+		}
+	}
+
+	if (lpRuleSet->dwStatesCount == WATCH_MAX_DFA_STATES)
+	{
+		lpRuleSet->dwStatesCount = 0;
+		lpRuleSet->dwStateNodesCount = 0;
+		lpRuleSet->dwStartState = WATCH_UNKNOWN_STATE;
+		lpRuleSet->ullFlushesCount++;
+		ZeroMemory(lpRuleSet->lpdwStateSlots, WATCH_STATE_SLOTS_COUNT * sizeof(DWORD));
+		dwSlot = dwHash & (WATCH_STATE_SLOTS_COUNT - 1);
+	}
+
+	if (!ReserveArray((void**)&lpRuleSet->lpdwStateNodes, &lpRuleSet->dwStateNodesCapacity, lpRuleSet->dwStateNodesCount + dwCount, sizeof(DWORD)))
+	{
+		return WATCH_UNKNOWN_STATE;
+	}
+
+	DWORD dwState = lpRuleSet->dwStatesCount++;
+	WATCHSTATE* lpState = &lpRuleSet->lpStates[dwState];
+	lpState->dwNodesOffset = lpRuleSet->dwStateNodesCount;
+	lpState->dwNodesCount = dwCount;
+	lpState->dwHash = dwHash;
+	lpState->dwRule = WATCH_NO_RULE;
+
+	// Earliest rule wins, so state keeps only the lowest rule index of its nodes
+	for (DWORD dwIndex = 0; dwIndex < dwCount; dwIndex++)
+	{
+		DWORD dwRule = lpRuleSet->lpNodes[lpRuleSet->lpdwScratch[dwIndex]].dwRule;
+		if (dwRule < lpState->dwRule)
+		{
+			lpState->dwRule = dwRule;
+		}
+	}
+
+	memcpy(lpRuleSet->lpdwStateNodes + lpState->dwNodesOffset, lpRuleSet->lpdwScratch, dwCount * sizeof(DWORD));
+	lpRuleSet->dwStateNodesCount += dwCount;
+	lpRuleSet->lpdwStateSlots[dwSlot] = dwState + 1;
+
+	DWORD* lpdwTransitions = lpRuleSet->lpdwTransitions + (SIZE_T)dwState * lpRuleSet->dwClassesCount;
+	for (DWORD dwClass = 0; dwClass < lpRuleSet->dwClassesCount; dwClass++)
+	{
+		lpdwTransitions[dwClass] = WATCH_UNKNOWN_STATE;
+	}
+
+	return dwState;
+}
+
+/// <summary>
+///		Get DFA state after consuming character of class, missing transitions are built on demand
+/// </summary>
+///
+/// <returns>DWORD (WATCH_UNKNOWN_STATE if no memory)</returns>
+static DWORD StepWatchState(WATCHRULESET* lpRuleSet, DWORD dwState, WORD wClass)
+{
+	DWORD* lpdwTransition = lpRuleSet->lpdwTransitions + (SIZE_T)dwState * lpRuleSet->dwClassesCount + wClass;
+	if (*lpdwTransition != WATCH_UNKNOWN_STATE)
+	{
+		return *lpdwTransition;
+	}
+
+	DWORD dwCount = 0;
+	const WATCHSTATE* lpState = &lpRuleSet->lpStates[dwState];
+	BeginNodeSet(lpRuleSet);
+
+	for (DWORD dwIndex = 0; dwIndex < lpState->dwNodesCount; dwIndex++)
+	{
+		DWORD dwNode = lpRuleSet->lpdwStateNodes[lpState->dwNodesOffset + dwIndex];
+		const WATCHNODE* lpNode = &lpRuleSet->lpNodes[dwNode];
+
+		// Wildcards repeat, other tokens move to next node of pattern
+		if (((lpNode->bToken == WATCH_TOKEN_NAME_STAR) || (lpNode->bToken == WATCH_TOKEN_STAR)) && TokenAcceptsClass(lpNode, wClass))
+		{
+			AddNodeClosure(lpRuleSet, &dwCount, dwNode);
+		}
+
+		for (DWORD dwChild = lpNode->dwFirstChild; dwChild != 0; dwChild = lpRuleSet->lpNodes[dwChild].dwNextSibling)
+		{
+			const WATCHNODE* lpChild = &lpRuleSet->lpNodes[dwChild];
+			if ((lpChild->bToken != WATCH_TOKEN_NAME_STAR) && (lpChild->bToken != WATCH_TOKEN_STAR) && TokenAcceptsClass(lpChild, wClass))
+			{
+				AddNodeClosure(lpRuleSet, &dwCount, dwChild);
+			}
+		}
+	}
+
+	ULONGLONG ullFlushesCount = lpRuleSet->ullFlushesCount;
+	DWORD dwNextState = AddWatchState(lpRuleSet, dwCount);
+
+	// Flushed DFA does not contain source state anymore
+	if ((dwNextState != WATCH_UNKNOWN_STATE) && (ullFlushesCount == lpRuleSet->ullFlushesCount))
+	{
+		lpRuleSet->lpdwTransitions[(SIZE_T)dwState * lpRuleSet->dwClassesCount + wClass] = dwNextState;
+	}
+
+	return dwNextState;
+}
+
+/// <summary>
+///		Feed characters to DFA
+/// </summary>
+///
+/// <returns>DWORD (WATCH_UNKNOWN_STATE if no memory)</returns>
+static DWORD RunWatchDfa(WATCHRULESET* lpRuleSet, DWORD dwState, LPCWSTR lpsText)
+{
+	for (DWORD dwPosition = 0; (lpsText[dwPosition] != L'\0') && (dwState != WATCH_UNKNOWN_STATE); dwPosition++)
+	{
+		// Dead state matches nothing whatever follows
+		if (lpRuleSet->lpStates[dwState].dwNodesCount == 0)
+		{
+			break;
+		}
+
+		WCHAR wcChar = lpsText[dwPosition];
+		WORD wClass = (wcChar == L'\\') ? WATCH_CLASS_BACKSLASH : GetCharClass(lpRuleSet, FoldChar(wcChar));
+		dwState = StepWatchState(lpRuleSet, dwState, wClass);
+	}
+
+	return dwState;
+}
+
+/// <summary>
+///		Find first rule matching changed key or value. Cost depends on length of path and name only,
+///		not on number of rules.
+/// </summary>
+///
+/// <param name="lpRuleSet">Rule set</param>
+/// <param name="lpsKeyPath">Key path</param>
+/// <param name="lpsValueName">Value name (NULL for key events)</param>
+///
+/// <returns>DWORD (rule index, WATCH_NO_RULE if no rule matches)</returns>
+DWORD MatchWatchRules(WATCHRULESET* lpRuleSet, LPCWSTR lpsKeyPath, LPCWSTR lpsValueName)
+{
+	if ((lpRuleSet->dwRulesCount == 0) || !EnsureWatchDfa(lpRuleSet))
+	{
+		return WATCH_NO_RULE;
+	}
+
+	DWORD dwState = lpRuleSet->dwStartState;
+	if (dwState == WATCH_UNKNOWN_STATE)
+	{
+		DWORD dwCount = 0;
+		BeginNodeSet(lpRuleSet);
+		AddNodeClosure(lpRuleSet, &dwCount, 0);
+		dwState = AddWatchState(lpRuleSet, dwCount);
+		lpRuleSet->dwStartState = dwState;
+	}
+
+	dwState = RunWatchDfa(lpRuleSet, dwState, lpsKeyPath);
+	if ((dwState != WATCH_UNKNOWN_STATE) && (lpRuleSet->lpStates[dwState].dwNodesCount != 0))
+	{
+		dwState = StepWatchState(lpRuleSet, dwState, WATCH_CLASS_SEPARATOR);
+	}
+	if (dwState != WATCH_UNKNOWN_STATE)
+	{
+		dwState = RunWatchDfa(lpRuleSet, dwState, (lpsValueName == NULL) ? L"" : lpsValueName);
+	}
+	if (dwState == WATCH_UNKNOWN_STATE)
+	{
+		return WATCH_NO_RULE;
+	}
+
+	DWORD dwRule = lpRuleSet->lpStates[dwState].dwRule;
+	if (dwRule != WATCH_NO_RULE)
+	{
+		lpRuleSet->lpRules[dwRule].ullMatchedCount++;
+	}
+
+	return dwRule;
+}
+
+/// <summary>
+///		Write event to sink of rule, events of ignore rules are dropped
+/// </summary>
+///
+/// <param name="lpRuleSet">Rule set</param>
+/// <param name="dwRule">Matched rule</param>
+/// <param name="lpsEvent">Event text</param>
+///
+/// <returns>bool</returns>
+bool RouteWatchEvent(WATCHRULESET* lpRuleSet, DWORD dwRule, LPCWSTR lpsEvent)
+{
+	if ((dwRule >= lpRuleSet->dwRulesCount) || lpRuleSet->lpRules[dwRule].bIgnore)
+	{
+		return true;
+	}
+
+	WATCHSINK* lpSink = &lpRuleSet->lpSinks[lpRuleSet->lpRules[dwRule].dwSink];
+	lpSink->ullEventsCount++;
+
+	if (lpSink->dwKind == WATCH_SINK_CONSOLE)
+	{
+		// Events are shown as they happen, not when output buffer fills
+		int iWritten = OutputWPrintf(L"%ls\n", lpsEvent);
+		STAT_ADD(ullOutputBytes, iWritten);
+		return (iWritten >= 0) && FlushOutput();
+	}
+
+	// Log files and stderr are UTF-8 whatever console code page is
+	FILE* lpFile = (lpSink->dwKind == WATCH_SINK_STDERR) ? stderr : lpSink->lpFile;
+	DWORD cbEvent;
+	LPCSTR lpsUtf8 = NarrowToUtf8(&lpRuleSet->tbEvent, lpsEvent, MAXDWORD, &cbEvent);
+
+	return (lpsUtf8 != NULL) &&
+		(fwrite(lpsUtf8, 1, cbEvent, lpFile) == cbEvent) &&
+		(fputc('\n', lpFile) != EOF) &&
+		(fflush(lpFile) == 0);
+}
+
+/// <summary>
+///		Free rule set and close its sinks
+/// </summary>
+///
+/// <param name="lpRuleSet">Rule set</param>
+///
+/// <returns>void</returns>
+void FreeWatchRules(WATCHRULESET* lpRuleSet)
+{
+	ResetWatchDfa(lpRuleSet);
+
+	for (DWORD dwSink = 0; dwSink < lpRuleSet->dwSinksCount; dwSink++)
+	{
+		if (lpRuleSet->lpSinks[dwSink].lpFile != NULL)
+		{
+			fclose(lpRuleSet->lpSinks[dwSink].lpFile);
+		}
+		free(lpRuleSet->lpSinks[dwSink].lpsName);
+	}
+
+	free(lpRuleSet->lpSinks);
+	free(lpRuleSet->lpRules);
+	free(lpRuleSet->lpNodes);
+	free(lpRuleSet->lpwcOtherChars);
+	free(lpRuleSet->lpwOtherClasses);
+	FreeTranscodeBuffer(&lpRuleSet->tbEvent);
+
+	InitWatchRules(lpRuleSet);
+}
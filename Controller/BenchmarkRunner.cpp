@@ -0,0 +1,56 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/Benchmark.h"
+
+/// <summary>
+///		Run benchmarks against generated in-memory tree, real registry is never touched
+/// </summary>
+///
+/// <param name="argc">Arguments count</param>
+/// <param name="argv">Arguments values (fan-out, depth, min and max name length, values per key, iterations, seed)</param>
+///
+/// <returns>0 on success, 1 on failure and 2 on invalid arguments</returns>
+int main(int argc, char** argv)
+{
+	SYNTHETICTREEPARAMS stpParams;
+	GetDefaultSyntheticTreeParams(&stpParams);
+	DWORD dwIterations = BENCHMARK_DEFAULT_ITERATIONS;
+
+	// All arguments are optional and positional
+	DWORD* lpdwSettings[] = {
+		&stpParams.dwFanOut,
+		&stpParams.dwDepth,
+		&stpParams.dwMinNameLength,
+		&stpParams.dwMaxNameLength,
+		&stpParams.dwValuesPerKey,
+		&dwIterations,
+		&stpParams.dwSeed,
+	};
+	DWORD dwSettingsCount = sizeof(lpdwSettings) / sizeof(lpdwSettings[0]);
+
+	if ((DWORD)(argc - 1) > dwSettingsCount)
+	{
+		fprintf(stderr, "Usage: %s [fan-out [depth [min-name [max-name [values [iterations [seed]]]]]]]\n", argv[0]);
+		return 2;
+	}
+
+	for (int iIndex = 1; iIndex < argc; iIndex++)
+	{
+		LPSTR lpsEnd;
+		unsigned long ulValue = strtoul(argv[iIndex], &lpsEnd, 10);
+
+		if ((lpsEnd == argv[iIndex]) || (*lpsEnd != '\0') || (argv[iIndex][0] == '-') || (ulValue > MAXDWORD))
+		{
+			fprintf(stderr, "Invalid argument %s\n", argv[iIndex]);
+			return 2;
+		}
+
+		*lpdwSettings[iIndex - 1] = (DWORD)ulValue;
+	}
+
+	return RunBenchmarks(&stpParams, dwIterations, stdout) ? 0 : 1;
+}
+
+/// 8 5 4 16 4 5 1
@@ -1,24 +1,46 @@
+#include <errno.h>
+
 #include "../Api/RegistryEditor.h"
+#include "../Api/ValueCodec.h"
+#include "../Api/Instrumentation.h"
+#include "../Api/Trace.h"
+#include "../Api/Output.h"
+#include "../Api/KeyCache.h"
+#include "../Api/QueryServer.h"
+#include "../Api/FuzzyMatch.h"
+#include "../Api/SubtreeStats.h"
+#include "../Api/ValueIndex.h"
+#include "../Api/Throttle.h"
+#include "../Api/FlagsPool.h"
+#include "../Api/ExternalSort.h"
+#include "../Api/History.h"
+#include "../Api/WatchRules.h"
+#include "../Api/Transcode.h"
+#include "../Api/RegistryReplay.h"
+#include "../Api/Progress.h"
 
 const char FAIL_MESSAGE[] = "Error!\0";
 const char SUCCESS_MESSAGE[] = "Ok!\0";
+// Path of WalkKeys and item of budget search are held during whole walk, so they are taken from budget before sorter gets the rest
+const SIZE_T SEARCH_WALK_BUFFERS_SIZE = (MAX_KEY_PATH_LENGTH * 2 + 1) * sizeof(WCHAR) + EXTERNAL_SORT_ALLOCATION_OVERHEAD * 2;
+const SIZE_T SEARCH_MIN_MEMORY_BUDGET = EXTERNAL_SORT_MIN_BUDGET + SEARCH_WALK_BUFFERS_SIZE;
 
-/// <summary>
-///		Convert const char* to const wchar_t*
-/// </summary>
-/// 
-/// <param name="c">const char*</param>
-/// 
-/// <returns>const wchar_t*</returns>
-const wchar_t* GetWC(const char* c)
-{
-	const size_t cSize = strlen(c) + 1;
-	wchar_t* wc = new wchar_t[cSize];
-	size_t outSize;
-	mbstowcs_s(&outSize, wc, cSize, c, cSize - 1);
-
-	return wc;
-}
+typedef struct _GLOBALOPTIONS {
+	bool bStats;
+	bool bStatsJson;
+	LPCSTR lpsTraceFileName;
+	DWORD dwTraceThreshold;
+	THROTTLEPARAMS tpBudget;
+	SIZE_T cbMemoryBudget;
+	LPCSTR lpsFormat;
+	LPCSTR lpsRecordFileName;
+	LPCSTR lpsReplayFileName;
+	bool bReplayLatency;
+	bool bProgress;
+	PROGRESSPARAMS ppProgress;
+	LPCSTR lpsInvalidOption;
+	LPCSTR lpsInvalidValue;
+} GLOBALOPTIONS;
 
 /// <summary>
 ///		Get hkey root path
@@ -62,64 +84,13 @@ HKEY GetHkeyRoot(LPSTR lpsKey)
 /// <returns>DWORD</returns>
 DWORD GetParamType(LPSTR lpsType)
 {
-	if (strcmp(lpsType, "REG_SZ") == 0)
-	{
-		return REG_SZ;
-	}
-	if (strcmp(lpsType, "REG_BINARY") == 0)
-	{
-		return REG_BINARY;
-	}
-	if (strcmp(lpsType, "REG_DWORD") == 0)
-	{
-		return REG_DWORD;
-	}
-	if (strcmp(lpsType, "REG_LINK") == 0)
-	{
-		return REG_LINK;
-	}
-	return NULL;
-}
-
-/// <summary>
-///		Convert value of registry type to LPVOID
-/// </summary>
-/// <param name="dwParamType"></param>
-/// <param name="lpsValue"></param>
-/// <param name="dwValueSize"></param>
-/// <returns></returns>
-LPCVOID ConvertValueToLPVOID(DWORD dwParamType, LPSTR lpsValue, DWORD* dwValueSize)
-{
-	switch (dwParamType)
+	const REGVALUECODEC* lpCodec = GetValueCodecByName(lpsType);
+	if (lpCodec == NULL)
 	{
-		case REG_SZ:
-		{
-			LPVOID lpBuffer = (LPVOID)GetWC(lpsValue);
-			*dwValueSize = lstrlen(GetWC(lpsValue)) * sizeof(WCHAR);
-			return lpBuffer;
-		}
-		case REG_DWORD:
-		{
-			DWORD* lpdwValue = (DWORD*)calloc(1, sizeof(DWORD));
-			*lpdwValue = atoi(lpsValue);
-			*dwValueSize = sizeof(*lpdwValue);
-			return (LPVOID)lpdwValue;
-		}
-		case REG_BINARY:
-		{
-			LPVOID lpBuffer = (LPVOID)lpsValue;
-			*dwValueSize = strlen(lpsValue) * sizeof(char);
-			return lpBuffer;
-		}
-		case REG_LINK:
-		{
-			LPVOID lpBuffer = (LPVOID)GetWC(lpsValue);
-			*dwValueSize = lstrlen(GetWC(lpsValue)) * sizeof(WCHAR);
-			return lpBuffer;
-		}
+		return REG_NONE;
 	}
 
-	return NULL;
+	return lpCodec->dwType;
 }
 
 /// <summary>
@@ -139,8 +110,8 @@ LPCSTR AddKeyCommand(LPSTR* arguments, DWORD argumentsCount)
 
 	// Convert to necessary format
 	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
-	LPCWSTR lpsSubkeyPath = GetWC(arguments[1]);
-	if ((hKeyRoot == NULL) || (lpsSubkeyPath == NULL))
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	if ((hKeyRoot == NULL) || !WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH))
 	{
 		return FAIL_MESSAGE;
 	}
@@ -171,29 +142,259 @@ LPCSTR AddValueCommand(LPSTR* lpsArguments, DWORD dwArgumentsCount)
 		return FAIL_MESSAGE;
 	}
 
-	// Convert to necessary format
-	DWORD dwArgumentSize;
-	LPCVOID lpBuffer = ConvertValueToLPVOID(GetParamType(lpsArguments[3]), lpsArguments[4], &dwArgumentSize);
-	if (lpBuffer == NULL)
+	// Convert to necessary format, small values are encoded without heap allocations
+	HKEY hKeyRoot = GetHkeyRoot(lpsArguments[0]);
+	DWORD dwParamType = GetParamType(lpsArguments[3]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsParamName[MAX_KEY_NAME_LENGTH];
+	REGVALUEBUFFER rvbValue;
+
+	DWORD cbValueLimit = GetEncodedValueSizeLimit(lpsArguments[4]);
+	BYTE* lpValueStorage = (cbValueLimit <= VALUE_INLINE_BUFFER_SIZE) ? NULL : (BYTE*)calloc(cbValueLimit, sizeof(BYTE));
+	if ((cbValueLimit == 0) || ((cbValueLimit > VALUE_INLINE_BUFFER_SIZE) && (lpValueStorage == NULL)))
 	{
 		return FAIL_MESSAGE;
 	}
 
-	// Set new value
-	if (SetRegKey(
-		GetHkeyRoot(lpsArguments[0]), 
-		GetWC(lpsArguments[1]), 
-		GetWC(lpsArguments[2]), 
-		GetParamType(lpsArguments[3]), 
-		lpBuffer,
-		dwArgumentSize))
+	InitValueBuffer(&rvbValue, lpValueStorage, cbValueLimit);
+	bool bResult = (hKeyRoot != NULL) &&
+		WidenString(lpsArguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH) &&
+		WidenString(lpsArguments[2], lpsParamName, MAX_KEY_NAME_LENGTH) &&
+		EncodeRegValue(dwParamType, lpsArguments[4], &rvbValue) &&
+		SetRegKey(hKeyRoot, lpsSubkeyPath, lpsParamName, dwParamType, rvbValue.lpData, rvbValue.cbData);
+
+	free(lpValueStorage);
+
+	return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
+}
+
+/// <summary>
+///		View value of key
+/// </summary>
+/// 
+/// <param name="lpsArguments">Arguments values</param>
+/// <param name="dwArgumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR ViewValueCommand(LPSTR* lpsArguments, DWORD dwArgumentsCount)
+{
+	if (dwArgumentsCount < 3)
 	{
-		return SUCCESS_MESSAGE;
+		return FAIL_MESSAGE;
 	}
-	else
+
+	HKEY hKeyRoot = GetHkeyRoot(lpsArguments[0]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsParamName[MAX_KEY_NAME_LENGTH];
+
+	if ((hKeyRoot == NULL) ||
+		!WidenString(lpsArguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH) ||
+		!WidenString(lpsArguments[2], lpsParamName, MAX_KEY_NAME_LENGTH))
 	{
 		return FAIL_MESSAGE;
 	}
+
+	// Read value into inline storage, fall back to heap for large values
+	REGVALUEBUFFER rvbValue;
+	InitValueBuffer(&rvbValue, NULL, 0);
+
+	DWORD dwParamType;
+	DWORD cbData = rvbValue.cbCapacity;
+	BYTE* lpHeapData = NULL;
+
+	if (!GetRegKey(hKeyRoot, lpsSubkeyPath, lpsParamName, &dwParamType, rvbValue.lpData, &cbData))
+	{
+		if (cbData <= rvbValue.cbCapacity)
+		{
+			return FAIL_MESSAGE;
+		}
+
+		lpHeapData = (BYTE*)calloc(cbData, sizeof(BYTE));
+		if (lpHeapData == NULL)
+		{
+			return FAIL_MESSAGE;
+		}
+
+		InitValueBuffer(&rvbValue, lpHeapData, cbData);
+		if (!GetRegKey(hKeyRoot, lpsSubkeyPath, lpsParamName, &dwParamType, rvbValue.lpData, &cbData))
+		{
+			free(lpHeapData);
+			return FAIL_MESSAGE;
+		}
+	}
+
+	// Binary data takes three characters per byte
+	DWORD cchOutput = cbData * 3 + 64;
+	LPSTR lpsOutput = (LPSTR)calloc(cchOutput, sizeof(CHAR));
+	const REGVALUECODEC* lpCodec = GetValueCodec(dwParamType);
+	bool bResult = (lpsOutput != NULL) && (lpCodec != NULL) && DecodeRegValue(dwParamType, rvbValue.lpData, cbData, lpsOutput, cchOutput);
+
+	if (bResult && (GetOutputFormat() == OUTPUT_FORMAT_TEXT))
+	{
+		int iWritten = OutputPrintf("%s %s %s\n", lpsArguments[2], lpCodec->lpsTypeName, lpsOutput);
+		STAT_ADD(ullOutputBytes, iWritten);
+	}
+	else if (bResult)
+	{
+		const OUTPUTFIELD ofFields[] = {
+			{ "name", lpsParamName, NULL },
+			{ "type", NULL, lpCodec->lpsTypeName },
+			{ "data", NULL, lpsOutput }
+		};
+		int iWritten = OutputRecord(ofFields, sizeof(ofFields) / sizeof(ofFields[0]));
+		STAT_ADD(ullOutputBytes, iWritten);
+	}
+
+	free(lpsOutput);
+	free(lpHeapData);
+
+	return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
+}
+
+typedef struct _BUDGETSEARCH {
+	EXTERNALSORTER esSorter;
+	LPCWSTR lpsSearchedKey;
+	DWORD dwSearchedKeyLength;
+	FUZZYPATTERN* lpPattern;
+	DWORD dwMaxDistance;
+	LPWSTR lpsItem;
+	DWORD dwFoundCount;
+	bool bFuzzy;
+} BUDGETSEARCH;
+
+/// <summary>
+///		Add matching key to sorter, fuzzy matches are prefixed by distance so closest keys sort first
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool CollectSearchedKey(void* lpContext, LPCWSTR lpsKeyPath, DWORD cchKeyPath)
+{
+	BUDGETSEARCH* lpSearch = (BUDGETSEARCH*)lpContext;
+
+	if (!lpSearch->bFuzzy)
+	{
+		return !IsSearchedKey(lpsKeyPath, lpSearch->lpsSearchedKey, lpSearch->dwSearchedKeyLength) ||
+			AddSortedItem(&lpSearch->esSorter, lpsKeyPath, cchKeyPath);
+	}
+
+	LPCWSTR lpsSegment = wcsrchr(lpsKeyPath, L'\\');
+	lpsSegment = (lpsSegment == NULL) ? lpsKeyPath : lpsSegment + 1;
+
+	DWORD dwDistance = GetFuzzyDistance(lpSearch->lpPattern, lpsSegment, cchKeyPath - (DWORD)(lpsSegment - lpsKeyPath), lpSearch->dwMaxDistance);
+	if (dwDistance > lpSearch->dwMaxDistance)
+	{
+		return true;
+	}
+
+	lpSearch->lpsItem[0] = (WCHAR)(L'0' + dwDistance);
+	memcpy(lpSearch->lpsItem + 1, lpsKeyPath, cchKeyPath * sizeof(WCHAR));
+
+	return AddSortedItem(&lpSearch->esSorter, lpSearch->lpsItem, cchKeyPath + 1);
+}
+
+/// <summary>
+///		Print found key as text line or as record
+/// </summary>
+/// 
+/// <param name="dwIndex">Key number</param>
+/// <param name="lpsKeyPath">Key path</param>
+/// <param name="bFuzzy">Print edit distance</param>
+/// <param name="dwDistance">Edit distance</param>
+/// 
+/// <returns>void</returns>
+void PrintFoundKey(DWORD dwIndex, LPCWSTR lpsKeyPath, bool bFuzzy, DWORD dwDistance)
+{
+	int iWritten;
+
+	if (GetOutputFormat() == OUTPUT_FORMAT_TEXT)
+	{
+		iWritten = bFuzzy ?
+			OutputWPrintf(L"%d. %s (distance %u)\n", dwIndex, lpsKeyPath, dwDistance) :
+			OutputWPrintf(L"%d. %s\n", dwIndex, lpsKeyPath);
+	}
+	else
+	{
+		CHAR lpsIndex[16], lpsDistance[16];
+		sprintf_s(lpsIndex, sizeof(lpsIndex), "%lu", dwIndex);
+		sprintf_s(lpsDistance, sizeof(lpsDistance), "%lu", dwDistance);
+
+		const OUTPUTFIELD ofFields[] = {
+			{ "index", NULL, lpsIndex },
+			{ "key", lpsKeyPath, NULL },
+			{ "distance", NULL, lpsDistance }
+		};
+		iWritten = OutputRecord(ofFields, bFuzzy ? 3 : 2);
+	}
+
+	STAT_ADD(ullOutputBytes, iWritten);
+}
+
+/// <summary>
+///		Print key passed by merge
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool PrintSearchedKey(void* lpContext, LPCWSTR lpsItem)
+{
+	BUDGETSEARCH* lpSearch = (BUDGETSEARCH*)lpContext;
+
+	if (lpSearch->bFuzzy)
+	{
+		PrintFoundKey(lpSearch->dwFoundCount, lpsItem + 1, true, (DWORD)(lpsItem[0] - L'0'));
+	}
+	else
+	{
+		PrintFoundKey(lpSearch->dwFoundCount, lpsItem, false, 0);
+	}
+	lpSearch->dwFoundCount++;
+
+	return true;
+}
+
+/// <summary>
+///		Search keys without collecting whole subtree, found keys are sorted within memory budget
+/// </summary>
+/// 
+/// <param name="hKey">Searched key</param>
+/// <param name="lpsSearchedKey">Searched key name</param>
+/// <param name="bFuzzy">Typo tolerant search</param>
+/// <param name="dwMaxDistance">Largest accepted edit distance</param>
+/// 
+/// <returns>bool</returns>
+bool SearchKeyWithinBudget(HKEY hKey, LPCWSTR lpsSearchedKey, bool bFuzzy, DWORD dwMaxDistance)
+{
+	BUDGETSEARCH bsSearch;
+	FUZZYPATTERN fpPattern;
+	ZeroMemory(&bsSearch, sizeof(BUDGETSEARCH));
+	bsSearch.lpsSearchedKey = lpsSearchedKey;
+	bsSearch.dwSearchedKeyLength = lstrlen(lpsSearchedKey);
+	bsSearch.lpPattern = &fpPattern;
+	bsSearch.dwMaxDistance = dwMaxDistance;
+	bsSearch.bFuzzy = bFuzzy;
+
+	SIZE_T cbBudget = GetResultMemoryBudget();
+	SIZE_T cbSortBudget = (cbBudget > SEARCH_WALK_BUFFERS_SIZE) ? cbBudget - SEARCH_WALK_BUFFERS_SIZE : 0;
+
+	if ((bFuzzy && !CompileFuzzyPattern(lpsSearchedKey, &fpPattern)) ||
+		!InitExternalSorter(&bsSearch.esSorter, cbSortBudget, NULL))
+	{
+		return false;
+	}
+
+	bsSearch.lpsItem = (LPWSTR)calloc(MAX_KEY_PATH_LENGTH + 1, sizeof(WCHAR));
+	bool bResult = (bsSearch.lpsItem != NULL) &&
+		WalkKeys(hKey, CollectSearchedKey, &bsSearch) &&
+		MergeSortedItems(&bsSearch.esSorter, PrintSearchedKey, &bsSearch);
+
+	if (bResult && (bsSearch.dwFoundCount == 0) && (GetOutputFormat() == OUTPUT_FORMAT_TEXT))
+	{
+		OutputPrintf("No keys found!\n");
+	}
+
+	free(bsSearch.lpsItem);
+	FreeExternalSorter(&bsSearch.esSorter);
+
+	return bResult;
 }
 
 /// <summary>
@@ -211,189 +412,1652 @@ LPCSTR SearchKeyCommand(LPSTR* arguments, DWORD argumentsCount)
 		return FAIL_MESSAGE;
 	}
 
-	// Open an existing key in registry
+	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsSearchedKey[MAX_KEY_NAME_LENGTH];
+
+	if ((hKeyRoot == NULL) ||
+		!WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH) ||
+		!WidenString(arguments[2], lpsSearchedKey, MAX_KEY_NAME_LENGTH))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	// Optional typo tolerance: --fuzzy K
+	bool bFuzzy = false;
+	DWORD dwMaxDistance = 0;
+
+	// --fuzzy without K is not a plain search
+	if (argumentsCount == 4)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	if (argumentsCount >= 5)
+	{
+		LPSTR lpsEnd;
+		dwMaxDistance = strtoul(arguments[4], &lpsEnd, 10);
+		bFuzzy = true;
+
+		if ((strcmp(arguments[3], "--fuzzy") != 0) || (lpsEnd == arguments[4]) || (*lpsEnd != '\0') ||
+			(dwMaxDistance > FUZZY_MAX_PATTERN_LENGTH) || (lstrlen(lpsSearchedKey) > (int)FUZZY_MAX_PATTERN_LENGTH))
+		{
+			return FAIL_MESSAGE;
+		}
+	}
+
+	// Open an existing key in registry, query server keeps it opened between requests
 	HKEY hKey;
-	if (!OpenRegKey(GetHkeyRoot(arguments[0]), GetWC(arguments[1]), KEY_READ, &hKey))
+	if (!OpenCachedRegKey(hKeyRoot, lpsSubkeyPath, &hKey))
 	{
 		return FAIL_MESSAGE;
 	}
 
+	// Limited memory: keys are walked without collecting subtree and found ones are sorted on disk
+	if (GetResultMemoryBudget() != 0)
+	{
+		if (GetOutputFormat() == OUTPUT_FORMAT_TEXT)
+		{
+			OutputPrintf("Search result in %s\\%s\\:\n", arguments[0], arguments[1]);
+		}
+		bool bResult = SearchKeyWithinBudget(hKey, lpsSearchedKey, bFuzzy, dwMaxDistance);
+		CloseCachedRegKey(hKey);
+
+		return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
+	}
+
 	// Search necessary key
 	DWORD dwFoundKeysCount = 0;
-	LPWSTR* lpsFoundKeys = SearchKey(hKey, GetWC(arguments[2]), &dwFoundKeysCount);
+	DWORD* lpdwDistances = NULL;
+	LPWSTR* lpsFoundKeys = bFuzzy ?
+		SearchKeyFuzzy(hKey, lpsSearchedKey, dwMaxDistance, &dwFoundKeysCount, &lpdwDistances) :
+		SearchKey(hKey, lpsSearchedKey, &dwFoundKeysCount);
+	CloseCachedRegKey(hKey);
+
 	if (lpsFoundKeys == NULL)
 	{
 		return "No keys found!\n";
 	}
 
-	// Output result
-	printf("Search result in %s\\%s\\:\n", arguments[0], arguments[1]);
+	// Output result, closest keys first for fuzzy search
+	if (GetOutputFormat() == OUTPUT_FORMAT_TEXT)
+	{
+		OutputPrintf("Search result in %s\\%s\\:\n", arguments[0], arguments[1]);
+	}
+
 	for (DWORD dwIndex = 0; dwIndex < dwFoundKeysCount; dwIndex++)
 	{
-		wprintf(L"%d. %s\n", dwIndex, lpsFoundKeys[dwIndex]);
+		PrintFoundKey(dwIndex, lpsFoundKeys[dwIndex], bFuzzy, bFuzzy ? lpdwDistances[dwIndex] : 0);
+		free(lpsFoundKeys[dwIndex]);
 	}
+	free(lpsFoundKeys);
+	free(lpdwDistances);
 
 	return SUCCESS_MESSAGE;
 }
 
 /// <summary>
-///		Get flags
+///		Subtree size statistics: totals, heaviest branches and fan-out histogram
 /// </summary>
 /// 
-/// <param name="arguments">Arguments values</param>
+/// <param name="arguments">Arguments values (root, path, optional branches count)</param>
 /// <param name="argumentsCount">Arguments count</param>
 /// 
 /// <returns>LPCSTR</returns>
-LPCSTR ViewFlagsCommand(LPSTR* arguments, DWORD argumentsCount)
+LPCSTR StatsCommand(LPSTR* arguments, DWORD argumentsCount)
 {
 	if (argumentsCount < 2)
 	{
 		return FAIL_MESSAGE;
 	}
 
-	// Create query like L"REG FLAGS HKLM\\SOFTWARE\\Test_key QUERY"
-	WCHAR* lpsCommand = CreateFlagsQuery(GetWC(arguments[0]), GetWC(arguments[1]));
-	if (lpsCommand == NULL)
+	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	DWORD dwTopCount = STATS_DEFAULT_TOP_COUNT;
+
+	if ((hKeyRoot == NULL) || !WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	if (argumentsCount >= 3)
+	{
+		LPSTR lpsEnd;
+		dwTopCount = strtoul(arguments[2], &lpsEnd, 10);
+
+		if ((lpsEnd == arguments[2]) || (*lpsEnd != '\0'))
+		{
+			return FAIL_MESSAGE;
+		}
+	}
+
+	HKEY hKey;
+	if (!OpenCachedRegKey(hKeyRoot, lpsSubkeyPath, &hKey))
 	{
 		return FAIL_MESSAGE;
 	}
-	
-	// Get flags in string format
-	LPSTR lpsRegExeOutput = ExecuteRegExe(lpsCommand);
-	if (lpsRegExeOutput == NULL)
+
+	SUBTREESTATS ssStats;
+	bool bResult = CollectSubtreeStats(hKey, dwTopCount, &ssStats);
+	CloseCachedRegKey(hKey);
+
+	if (!bResult)
 	{
+		FreeSubtreeStats(&ssStats);
 		return FAIL_MESSAGE;
 	}
 
-	KEYFLAG* kfFlags = NULL;
-	DWORD dwFlagsCount;
+	SYSTEMTIME stNewestWrite;
+	FileTimeToSystemTime(&ssStats.stTotals.ftNewestWrite, &stNewestWrite);
+
+	OutputPrintf("Subtree %s\\%s\\ (%u threads):\n", arguments[0], arguments[1], ssStats.dwThreadsCount);
+	OutputPrintf("Keys: %llu  Values: %llu  Data bytes: %llu  Max depth: %u  Newest write: %04u-%02u-%02u %02u:%02u:%02u  Unreadable keys: %llu\n",
+		ssStats.stTotals.ullKeysCount,
+		ssStats.stTotals.ullValuesCount,
+		ssStats.stTotals.ullDataBytes,
+		ssStats.stTotals.dwMaxDepth,
+		stNewestWrite.wYear, stNewestWrite.wMonth, stNewestWrite.wDay,
+		stNewestWrite.wHour, stNewestWrite.wMinute, stNewestWrite.wSecond,
+		ssStats.ullUnreadableKeys);
 
-	// Initialize flags values
-	kfFlags = GetInitializedFlags(&dwFlagsCount);
-	if (kfFlags == NULL)
+	OutputPrintf("Heaviest branches:\n");
+	for (DWORD dwIndex = 0; dwIndex < ssStats.dwTopCount; dwIndex++)
 	{
-		printf("Initialization key flags failure!\n");
+		const BRANCHTOTALS* lpBranch = &ssStats.lpTopBranches[dwIndex];
+		int iWritten = OutputWPrintf(L"%u. %s  Data bytes: %llu  Keys: %llu  Values: %llu  Depth: %u\n",
+			dwIndex,
+			lpBranch->lpsKeyPath,
+			lpBranch->stTotals.ullDataBytes,
+			lpBranch->stTotals.ullKeysCount,
+			lpBranch->stTotals.ullValuesCount,
+			lpBranch->stTotals.dwMaxDepth);
+		STAT_ADD(ullOutputBytes, iWritten);
 	}
-	else
+
+	OutputPrintf("Fan-out histogram (subkeys: keys):\n");
+	for (DWORD dwBucket = 0; dwBucket < STATS_FANOUT_BUCKETS; dwBucket++)
 	{
-		// GEt final result
-		if (!ParseRegExeOutput(lpsRegExeOutput, kfFlags, dwFlagsCount))
+		DWORD dwFirst, dwLast;
+		GetFanOutBucketRange(dwBucket, &dwFirst, &dwLast);
+
+		if (ssStats.ullFanOutHistogram[dwBucket] != 0)
 		{
-			return FAIL_MESSAGE;
+			OutputPrintf("%u-%u: %llu\n", dwFirst, dwLast, ssStats.ullFanOutHistogram[dwBucket]);
 		}
 	}
 
-	// Output result
-	printf("Key flags:\n");
-	for (DWORD dwIndex = 0; dwIndex < dwFlagsCount; dwIndex++)
-	{
-		printf("%d. Flag name: %s  Flag value: %s\n", dwIndex, kfFlags[dwIndex].lpsFlagName, kfFlags[dwIndex].lpsFlagValue);
-	}
+	FreeSubtreeStats(&ssStats);
 
 	return SUCCESS_MESSAGE;
 }
 
 /// <summary>
-///		Observe registry changes
+///		Build trigram index of string values of subtree
 /// </summary>
 /// 
-/// <param name="arguments">Argumets values</param>
+/// <param name="arguments">Arguments values (root, path, index file)</param>
 /// <param name="argumentsCount">Arguments count</param>
 /// 
 /// <returns>LPCSTR</returns>
-LPCSTR NotifyCommand(LPSTR* arguments, DWORD argumentsCount)
+LPCSTR IndexBuildCommand(LPSTR* arguments, DWORD argumentsCount)
 {
-	if (argumentsCount < 2)
+	if (argumentsCount < 3)
 	{
 		return FAIL_MESSAGE;
 	}
 
-	// Get hkey name
 	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
-	if (hKeyRoot == NULL)
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+
+	if ((hKeyRoot == NULL) || !WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH))
 	{
 		return FAIL_MESSAGE;
 	}
 
-	// Start notify
-	LPCWSTR lpsSubkeyPath = GetWC(arguments[1]);
-	if (NotifyChange(hKeyRoot, lpsSubkeyPath, TRUE))
+	HKEY hKey;
+	if (!OpenCachedRegKey(hKeyRoot, lpsSubkeyPath, &hKey))
 	{
-		return SUCCESS_MESSAGE;
+		return FAIL_MESSAGE;
 	}
-	else
+
+	VALUEINDEXIMAGE viiImage;
+	bool bResult = BuildValueIndex(hKey, &viiImage);
+	CloseCachedRegKey(hKey);
+
+	if (bResult)
 	{
-		return FAIL_MESSAGE;
+		const VALUEINDEXHEADER* lpHeader = (const VALUEINDEXHEADER*)viiImage.lpData;
+		OutputPrintf("Indexed values: %u  Trigrams: %u  Size: %llu bytes\n", lpHeader->dwValuesCount, lpHeader->dwTrigramsCount, lpHeader->ullFileSize);
+
+		bResult = SaveValueIndex(&viiImage, arguments[2]);
+		FreeValueIndexImage(&viiImage);
 	}
+
+	return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
 }
 
 /// <summary>
-///		Find necessary command
+///		Find string values containing text using trigram index
 /// </summary>
 /// 
-/// <param name="argc">Arguments count</param>
-/// <param name="argv">Argumets values</param>
+/// <param name="arguments">Arguments values (index file, text)</param>
+/// <param name="argumentsCount">Arguments count</param>
 /// 
 /// <returns>LPCSTR</returns>
-LPCSTR CommandProcessor(char** argv, int argc)
+LPCSTR IndexSearchCommand(LPSTR* arguments, DWORD argumentsCount)
 {
-	if (argc < 2)
+	if (argumentsCount < 2)
 	{
 		return FAIL_MESSAGE;
 	}
 
-	if (strcmp(argv[1], "ADD_KEY") == 0)
-	{
-		return AddKeyCommand(argv + 2, argc - 2);
-	}
-	if (strcmp(argv[1], "ADD_VALUE") == 0)
-	{
-		return AddValueCommand(argv + 2, argc - 2);
-	}
-	if (strcmp(argv[1], "VIEW_FLAGS") == 0)
-	{
-		return ViewFlagsCommand(argv + 2, argc - 2);
-	}
-	if (strcmp(argv[1], "SEARCH_KEY") == 0)
+	WCHAR lpsText[MAX_KEY_NAME_LENGTH];
+	VALUEINDEX viIndex;
+
+	if (!WidenString(arguments[1], lpsText, MAX_KEY_NAME_LENGTH) || !OpenValueIndex(arguments[0], &viIndex))
 	{
-		return SearchKeyCommand(argv + 2, argc - 2);
+		return FAIL_MESSAGE;
 	}
-	if (strcmp(argv[1], "NOTIFY") == 0)
+
+	DWORD dwFoundCount = 0;
+	DWORD* lpdwFoundValues = SearchValueIndex(&viIndex, lpsText, &dwFoundCount);
+
+	if (lpdwFoundValues != NULL)
 	{
-		return NotifyCommand(argv + 2, argc - 2);
+		bool bText = (GetOutputFormat() == OUTPUT_FORMAT_TEXT);
+		if (bText)
+		{
+			OutputPrintf("Values containing \"%s\":\n", arguments[1]);
+		}
+
+		for (DWORD dwIndex = 0; dwIndex < dwFoundCount; dwIndex++)
+		{
+			const VALUEINDEXENTRY* lpEntry = &viIndex.lpEntries[lpdwFoundValues[dwIndex]];
+			LPCWSTR lpsKeyPath = GetValueIndexString(&viIndex, lpEntry->dwKeyPathOffset);
+			LPCWSTR lpsValueName = GetValueIndexString(&viIndex, lpEntry->dwValueNameOffset);
+			LPCWSTR lpsData = GetValueIndexString(&viIndex, lpEntry->dwDataOffset);
+			int iWritten;
+
+			if (bText)
+			{
+				iWritten = OutputWPrintf(L"%u. %s\\%s = %s\n", dwIndex, lpsKeyPath, lpsValueName, lpsData);
+			}
+			else
+			{
+				CHAR lpsIndex[16];
+				sprintf_s(lpsIndex, sizeof(lpsIndex), "%lu", dwIndex);
+
+				const OUTPUTFIELD ofFields[] = {
+					{ "index", NULL, lpsIndex },
+					{ "key", lpsKeyPath, NULL },
+					{ "name", lpsValueName, NULL },
+					{ "data", lpsData, NULL }
+				};
+				iWritten = OutputRecord(ofFields, sizeof(ofFields) / sizeof(ofFields[0]));
+			}
+			STAT_ADD(ullOutputBytes, iWritten);
+		}
+
+		free(lpdwFoundValues);
 	}
 
-	return NULL;
+	CloseValueIndex(&viIndex);
+
+	return (lpdwFoundValues != NULL) ? SUCCESS_MESSAGE : FAIL_MESSAGE;
 }
 
 /// <summary>
-///		Entry point
+///		Record current state of subtree in history directory
 /// </summary>
 /// 
-/// <param name="argc">Arguments count</param>
-/// <param name="argv">Argumets values</param>
+/// <param name="arguments">Arguments values (root, path, history directory, optional time)</param>
+/// <param name="argumentsCount">Arguments count</param>
 /// 
-/// <returns>int</returns>
-int main(int argc, char** argv)
+/// <returns>LPCSTR</returns>
+LPCSTR HistorySnapshotCommand(LPSTR* arguments, DWORD argumentsCount)
 {
-	LPCSTR cmdResult = CommandProcessor(argv, argc);
-
-	if (cmdResult == NULL)
+	if (argumentsCount < 3)
 	{
-		printf("%s\n", FAIL_MESSAGE);
+		return FAIL_MESSAGE;
 	}
-	else
+
+	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsRootPath[MAX_KEY_NAME_LENGTH];
+	CHAR lpsRootName[MAX_KEY_NAME_LENGTH];
+
+	// History remembers which subtree it records, other subtrees need own directory
+	if ((hKeyRoot == NULL) || !WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH) ||
+		(sprintf_s(lpsRootName, MAX_KEY_NAME_LENGTH, "%s\\%s", arguments[0], arguments[1]) < 0) ||
+		!WidenString(lpsRootName, lpsRootPath, MAX_KEY_NAME_LENGTH))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	ULONGLONG ullTimestamp;
+	if (argumentsCount > 3)
+	{
+		if (!ParseHistoryTime(arguments[3], &ullTimestamp))
+		{
+			return FAIL_MESSAGE;
+		}
+	}
+	else
+	{
+		FILETIME ftNow;
+		GetSystemTimeAsFileTime(&ftNow);
+		ullTimestamp = ((ULONGLONG)ftNow.dwHighDateTime << 32) | ftNow.dwLowDateTime;
+	}
+
+	HISTORYSTORE hsStore;
+	if (!OpenHistoryStore(arguments[2], lpsRootPath, &hsStore))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	HKEY hKey;
+	bool bResult = OpenCachedRegKey(hKeyRoot, lpsSubkeyPath, &hKey);
+
+	if (bResult)
+	{
+		HISTORYRECORD hrRecord;
+		bResult = TakeHistorySnapshot(&hsStore, hKey, ullTimestamp, &hrRecord);
+		CloseCachedRegKey(hKey);
+
+		if (bResult)
+		{
+			CHAR lpsTime[32];
+			FormatHistoryTime(hrRecord.ullTimestamp, lpsTime, 32);
+			OutputPrintf("Snapshot %lu at %s: %s, %lu keys changed, %llu bytes\n", hrRecord.dwSequence, lpsTime,
+				(hrRecord.dwKind == HISTORY_RECORD_BASE) ? "base" : "delta", hrRecord.dwEntriesCount, hrRecord.cbSize);
+		}
+	}
+
+	CloseHistoryStore(&hsStore);
+
+	return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
+}
+
+/// <summary>
+///		List snapshots of history directory
+/// </summary>
+/// 
+/// <param name="arguments">Arguments values (history directory)</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR HistoryLogCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	if (argumentsCount < 1)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	HISTORYSTORE hsStore;
+	if (!OpenHistoryStore(arguments[0], NULL, &hsStore))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	OutputWPrintf(L"History of %s\n", hsStore.lpsRootPath);
+
+	ULONGLONG cbTotal = 0;
+	for (DWORD dwIndex = 0; dwIndex < hsStore.dwRecordsCount; dwIndex++)
+	{
+		const HISTORYRECORD* lpRecord = &hsStore.lpRecords[dwIndex];
+		CHAR lpsTime[32];
+		FormatHistoryTime(lpRecord->ullTimestamp, lpsTime, 32);
+
+		int iWritten = OutputPrintf("%lu. %s %-5s %8lu keys %12llu bytes\n", lpRecord->dwSequence, lpsTime,
+			(lpRecord->dwKind == HISTORY_RECORD_BASE) ? "base" : "delta", lpRecord->dwEntriesCount, lpRecord->cbSize);
+		STAT_ADD(ullOutputBytes, iWritten);
+		cbTotal += lpRecord->cbSize;
+	}
+
+	OutputPrintf("Snapshots: %lu  Paths: %lu  Size: %llu bytes\n", hsStore.dwRecordsCount, hsStore.ptPaths.dwCount, cbTotal);
+	CloseHistoryStore(&hsStore);
+
+	return SUCCESS_MESSAGE;
+}
+
+typedef struct _HISTORYPATH {
+	LPCWSTR lpsPath;
+	DWORD dwPathId;
+} HISTORYPATH;
+
+/// <summary>
+///		qsort callback, keys by path
+/// </summary>
+/// 
+/// <returns>int</returns>
+int CompareHistoryPaths(const void* lpFirst, const void* lpSecond)
+{
+	return lstrcmpi(((const HISTORYPATH*)lpFirst)->lpsPath, ((const HISTORYPATH*)lpSecond)->lpsPath);
+}
+
+/// <summary>
+///		Print values of key as it was at snapshot
+/// </summary>
+/// 
+/// <returns>bool</returns>
+bool PrintHistoryKey(const HISTORYSTORE* lpStore, const HISTORYPATH* lpPath, const HISTORYKEY* lpKey)
+{
+	int iWritten = OutputWPrintf((lpPath->lpsPath[0] == L'\0') ? L"%s%s\n" : L"%s\\%s\n", lpStore->lpsRootPath, lpPath->lpsPath);
+	STAT_ADD(ullOutputBytes, iWritten);
+
+	for (DWORD dwIndex = 0; dwIndex < lpKey->dwValuesCount; dwIndex++)
+	{
+		const HISTORYVALUE* lpValue = &lpKey->lpValues[dwIndex];
+		const REGVALUECODEC* lpCodec = GetValueCodec(lpValue->dwType);
+
+		// Binary data takes three characters per byte
+		DWORD cchOutput = lpValue->cbData * 3 + 64;
+		LPSTR lpsOutput = (LPSTR)calloc(cchOutput, sizeof(CHAR));
+
+		if (lpsOutput == NULL)
+		{
+			return false;
+		}
+
+		if ((lpCodec != NULL) && DecodeRegValue(lpValue->dwType, lpValue->lpData, lpValue->cbData, lpsOutput, cchOutput))
+		{
+			iWritten = OutputWPrintf(L"    %s ", lpValue->lpsName);
+			iWritten += OutputPrintf("%s %s\n", lpCodec->lpsTypeName, lpsOutput);
+		}
+		else
+		{
+			iWritten = OutputWPrintf(L"    %s ", lpValue->lpsName);
+			iWritten += OutputPrintf("%lu (%lu bytes)\n", lpValue->dwType, lpValue->cbData);
+		}
+		STAT_ADD(ullOutputBytes, iWritten);
+
+		free(lpsOutput);
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Print subtree as it was at given time
+/// </summary>
+/// 
+/// <param name="arguments">Arguments values (history directory, time, optional path relative to root of history)</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR HistoryAsOfCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	if (argumentsCount < 2)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH] = L"";
+	ULONGLONG ullTimestamp;
+
+	if (!ParseHistoryTime(arguments[1], &ullTimestamp) ||
+		((argumentsCount > 2) && !WidenString(arguments[2], lpsSubkeyPath, MAX_KEY_NAME_LENGTH)))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	HISTORYSTORE hsStore;
+	if (!OpenHistoryStore(arguments[0], NULL, &hsStore))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	HISTORYSTATE hsState;
+	const HISTORYRECORD* lpRecord = FindHistoryRecord(&hsStore, ullTimestamp);
+	bool bResult = ReconstructHistory(&hsStore, lpRecord, lpsSubkeyPath, &hsState);
+
+	HISTORYPATH* lpPaths = NULL;
+	DWORD dwPathsCount = 0;
+
+	if (bResult)
+	{
+		CHAR lpsTime[32];
+		FormatHistoryTime(lpRecord->ullTimestamp, lpsTime, 32);
+		OutputPrintf("As of snapshot %lu at %s:\n", lpRecord->dwSequence, lpsTime);
+
+		lpPaths = (HISTORYPATH*)malloc((hsState.dwKeysCount + 1) * sizeof(HISTORYPATH));
+		bResult = lpPaths != NULL;
+	}
+
+	for (DWORD dwPathId = 0; bResult && (dwPathId < hsState.dwKeysCount); dwPathId++)
+	{
+		if (hsState.lpKeys[dwPathId] != NULL)
+		{
+			lpPaths[dwPathsCount].lpsPath = GetHistoryPath(&hsStore, dwPathId);
+			lpPaths[dwPathsCount].dwPathId = dwPathId;
+			dwPathsCount++;
+		}
+	}
+
+	if (bResult)
+	{
+		qsort(lpPaths, dwPathsCount, sizeof(HISTORYPATH), CompareHistoryPaths);
+	}
+
+	for (DWORD dwIndex = 0; bResult && (dwIndex < dwPathsCount); dwIndex++)
+	{
+		bResult = PrintHistoryKey(&hsStore, &lpPaths[dwIndex], hsState.lpKeys[lpPaths[dwIndex].dwPathId]);
+	}
+
+	// Subtree that did not exist at that time is not an error, it is just empty
+	if (bResult && (dwPathsCount == 0))
+	{
+		OutputPrintf("Key did not exist\n");
+	}
+
+	free(lpPaths);
+	FreeHistoryState(&hsState);
+	CloseHistoryStore(&hsStore);
+
+	return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
+}
+
+typedef struct _KEYPATHLIST {
+	LPWSTR* lpsPaths;
+	DWORD dwCount;
+	DWORD dwCapacity;
+} KEYPATHLIST;
+
+typedef struct _FLAGSTABLE {
+	bool bTable;
+	DWORD dwFailedCount;
+} FLAGSTABLE;
+
+// Flags in order reported by reg.exe, also columns of table and fields of records
+const LPCSTR FLAG_COLUMN_NAMES[] = { "REG_KEY_DONT_VIRTUALIZE", "REG_KEY_DONT_SILENT_FAIL", "REG_KEY_RECURSE_FLAG" };
+const DWORD FLAG_COLUMNS_COUNT = sizeof(FLAG_COLUMN_NAMES) / sizeof(FLAG_COLUMN_NAMES[0]);
+
+/// <summary>
+///		Add key path to list, list takes ownership of path
+/// </summary>
+/// 
+/// <param name="lpList">Key paths</param>
+/// <param name="lpsPath">Added path</param>
+/// 
+/// <returns>bool</returns>
+bool AppendKeyPath(KEYPATHLIST* lpList, LPWSTR lpsPath)
+{
+	if (lpsPath == NULL)
+	{
+		return false;
+	}
+
+	if (lpList->dwCount == lpList->dwCapacity)
+	{
+		DWORD dwCapacity = (lpList->dwCapacity == 0) ? 64 : lpList->dwCapacity * 2;
+		LPWSTR* lpsPaths = (LPWSTR*)realloc(lpList->lpsPaths, dwCapacity * sizeof(LPWSTR));
+
+		if (lpsPaths == NULL)
+		{
+			free(lpsPath);
+			return false;
+		}
+
+		lpList->lpsPaths = lpsPaths;
+		lpList->dwCapacity = dwCapacity;
+	}
+
+	lpList->lpsPaths[lpList->dwCount++] = lpsPath;
+
+	return true;
+}
+
+/// <summary>
+///		Read key paths from file, one path in hkey per line
+/// </summary>
+/// 
+/// <param name="lpsFileName">File name</param>
+/// <param name="lpList">Key paths</param>
+/// 
+/// <returns>bool</returns>
+bool ReadKeyPaths(LPCSTR lpsFileName, KEYPATHLIST* lpList)
+{
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "r") != 0)
+	{
+		return false;
+	}
+
+	CHAR lpsLine[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsPath[MAX_KEY_NAME_LENGTH];
+	bool bResult = true;
+
+	while (bResult && (fgets(lpsLine, MAX_KEY_NAME_LENGTH, lpFile) != NULL))
+	{
+		lpsLine[strcspn(lpsLine, "\r\n")] = '\0';
+
+		if (lpsLine[0] != '\0')
+		{
+			bResult = WidenString(lpsLine, lpsPath, MAX_KEY_NAME_LENGTH) && AppendKeyPath(lpList, _wcsdup(lpsPath));
+		}
+	}
+
+	fclose(lpFile);
+
+	return bResult;
+}
+
+/// <summary>
+///		Print flags of one key, called by pool in order of keys
+/// </summary>
+/// 
+/// <returns>void</returns>
+void PrintKeyFlags(void* lpContext, DWORD dwIndex, const FLAGSRESULT* lpResult)
+{
+	FLAGSTABLE* lpTable = (FLAGSTABLE*)lpContext;
+	int iWritten = 0;
+
+	if (GetOutputFormat() != OUTPUT_FORMAT_TEXT)
+	{
+		// Flags of key that could not be queried are missing
+		CHAR lpsIndex[16];
+		sprintf_s(lpsIndex, sizeof(lpsIndex), "%lu", dwIndex);
+
+		OUTPUTFIELD ofFields[FLAG_COLUMNS_COUNT + 2] = {
+			{ "index", NULL, lpsIndex },
+			{ "key", lpResult->lpsSubkeyPath, NULL }
+		};
+		for (DWORD dwFlagIndex = 0; dwFlagIndex < FLAG_COLUMNS_COUNT; dwFlagIndex++)
+		{
+			ofFields[dwFlagIndex + 2].lpsName = FLAG_COLUMN_NAMES[dwFlagIndex];
+			ofFields[dwFlagIndex + 2].lpsUtf8Text = ((lpResult->kfFlags != NULL) && (dwFlagIndex < lpResult->dwFlagsCount)) ?
+				lpResult->kfFlags[dwFlagIndex].lpsFlagValue : NULL;
+		}
+
+		lpTable->dwFailedCount += (lpResult->kfFlags == NULL) ? 1 : 0;
+		iWritten = OutputRecord(ofFields, FLAG_COLUMNS_COUNT + 2);
+	}
+	else if (lpResult->kfFlags == NULL)
+	{
+		lpTable->dwFailedCount++;
+
+		if (lpTable->bTable)
+		{
+			iWritten = OutputWPrintf(L"%-6u%-26s%-26s%-26s%s\n", dwIndex, L"?", L"?", L"?", lpResult->lpsSubkeyPath);
+		}
+	}
+	else if (lpTable->bTable)
+	{
+		iWritten = OutputWPrintf(L"%-6u", dwIndex);
+		for (DWORD dwFlagIndex = 0; dwFlagIndex < lpResult->dwFlagsCount; dwFlagIndex++)
+		{
+			iWritten += OutputPrintf("%-26s", lpResult->kfFlags[dwFlagIndex].lpsFlagValue);
+		}
+		iWritten += OutputWPrintf(L"%s\n", lpResult->lpsSubkeyPath);
+	}
+	else
+	{
+		iWritten = OutputPrintf("Key flags:\n");
+		for (DWORD dwFlagIndex = 0; dwFlagIndex < lpResult->dwFlagsCount; dwFlagIndex++)
+		{
+			iWritten += OutputPrintf("%d. Flag name: %s  Flag value: %s\n", dwFlagIndex,
+				lpResult->kfFlags[dwFlagIndex].lpsFlagName, lpResult->kfFlags[dwFlagIndex].lpsFlagValue);
+		}
+	}
+
+	STAT_ADD(ullOutputBytes, iWritten);
+}
+
+/// <summary>
+///		Get flags of one or many keys
+/// </summary>
+/// 
+/// <param name="arguments">Arguments values</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR ViewFlagsCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	if (argumentsCount < 2)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	WCHAR lpsKeyRoot[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsPath[MAX_KEY_NAME_LENGTH];
+	KEYPATHLIST kplPaths;
+	ZeroMemory(&kplPaths, sizeof(KEYPATHLIST));
+
+	// Keys are given by paths, by file (--keys FILE) or found under paths (--search NAME)
+	LPCSTR lpsSearchedKey = NULL;
+	DWORD dwJobsCount = FLAGS_POOL_DEFAULT_JOBS;
+	bool bResult = WidenString(arguments[0], lpsKeyRoot, MAX_KEY_NAME_LENGTH);
+
+	for (DWORD dwIndex = 1; bResult && (dwIndex < argumentsCount); dwIndex++)
+	{
+		if ((strcmp(arguments[dwIndex], "--jobs") == 0) && (dwIndex + 1 < argumentsCount))
+		{
+			LPSTR lpsJobs = arguments[++dwIndex];
+			LPSTR lpsEnd;
+			unsigned long ulJobsCount = strtoul(lpsJobs, &lpsEnd, 10);
+
+			// More jobs than pool runs at once are clamped, not rejected
+			bResult = (lpsEnd != lpsJobs) && (*lpsEnd == '\0') && (lpsJobs[0] != '-') && (ulJobsCount != 0);
+			dwJobsCount = (ulJobsCount > FLAGS_POOL_MAX_JOBS) ? FLAGS_POOL_MAX_JOBS : (DWORD)ulJobsCount;
+		}
+		else if ((strcmp(arguments[dwIndex], "--search") == 0) && (dwIndex + 1 < argumentsCount))
+		{
+			lpsSearchedKey = arguments[++dwIndex];
+		}
+		else if ((strcmp(arguments[dwIndex], "--keys") == 0) && (dwIndex + 1 < argumentsCount))
+		{
+			bResult = ReadKeyPaths(arguments[++dwIndex], &kplPaths);
+		}
+		else
+		{
+			bResult = WidenString(arguments[dwIndex], lpsPath, MAX_KEY_NAME_LENGTH) && AppendKeyPath(&kplPaths, _wcsdup(lpsPath));
+		}
+	}
+
+	// Replace search roots with keys found under them
+	if (bResult && (lpsSearchedKey != NULL))
+	{
+		HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
+		KEYPATHLIST kplFound;
+		ZeroMemory(&kplFound, sizeof(KEYPATHLIST));
+
+		bResult = (hKeyRoot != NULL) && WidenString(lpsSearchedKey, lpsPath, MAX_KEY_NAME_LENGTH);
+
+		for (DWORD dwIndex = 0; bResult && (dwIndex < kplPaths.dwCount); dwIndex++)
+		{
+			HKEY hKey;
+			if (!OpenCachedRegKey(hKeyRoot, kplPaths.lpsPaths[dwIndex], &hKey))
+			{
+				continue;
+			}
+
+			DWORD dwFoundKeysCount = 0;
+			LPWSTR* lpsFoundKeys = SearchKey(hKey, lpsPath, &dwFoundKeysCount);
+			CloseCachedRegKey(hKey);
+
+			for (DWORD dwFoundIndex = 0; dwFoundIndex < dwFoundKeysCount; dwFoundIndex++)
+			{
+				bResult = bResult && AppendKeyPath(&kplFound, CreateFullName(kplPaths.lpsPaths[dwIndex], lpsFoundKeys[dwFoundIndex]));
+				free(lpsFoundKeys[dwFoundIndex]);
+			}
+			free(lpsFoundKeys);
+		}
+
+		for (DWORD dwIndex = 0; dwIndex < kplPaths.dwCount; dwIndex++)
+		{
+			free(kplPaths.lpsPaths[dwIndex]);
+		}
+		free(kplPaths.lpsPaths);
+		kplPaths = kplFound;
+	}
+
+	bResult = bResult && ((kplPaths.dwCount != 0) || (lpsSearchedKey != NULL));
+
+	FLAGSTABLE ftTable;
+	ftTable.bTable = (kplPaths.dwCount > 1) || (lpsSearchedKey != NULL);
+	ftTable.dwFailedCount = 0;
+
+	if (bResult && ftTable.bTable && (GetOutputFormat() == OUTPUT_FORMAT_TEXT))
+	{
+		OutputPrintf("%-6s%-26s%-26s%-26s%s\n", "#", FLAG_COLUMN_NAMES[0], FLAG_COLUMN_NAMES[1], FLAG_COLUMN_NAMES[2], "Key");
+	}
+
+	// Query like L"REG FLAGS \"HKLM\\SOFTWARE\\Test_key\" QUERY" is run for every key not queried before
+	bResult = bResult && ((kplPaths.dwCount == 0) ||
+		QueryKeyFlags(lpsKeyRoot, (LPCWSTR*)kplPaths.lpsPaths, kplPaths.dwCount, dwJobsCount, NULL, PrintKeyFlags, &ftTable));
+
+	for (DWORD dwIndex = 0; dwIndex < kplPaths.dwCount; dwIndex++)
+	{
+		free(kplPaths.lpsPaths[dwIndex]);
+	}
+	free(kplPaths.lpsPaths);
+
+	// Single key keeps failing on error, table marks failed keys
+	if (!bResult || (!ftTable.bTable && (ftTable.dwFailedCount != 0)))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	return SUCCESS_MESSAGE;
+}
+
+typedef struct _WATCHCONTEXT {
+	WATCHRULESET* lpRuleSet;
+	const PATHTABLE* lpPaths;
+	LPCWSTR lpsRootPath;
+	LPWSTR lpsKeyPath;
+	LPWSTR lpsEvent;
+	ULONGLONG ullEventsCount;
+	ULONGLONG ullRoutedCount;
+} WATCHCONTEXT;
+
+/// <summary>
+///		Match change against rules and route it to sink of first matching rule
+/// </summary>
+/// 
+/// <returns>void</returns>
+void RouteWatchChange(void* lpContext, DWORD dwPathId, BYTE bOperation, const HISTORYVALUE* lpValue)
+{
+	WATCHCONTEXT* lpWatch = (WATCHCONTEXT*)lpContext;
+	LPCWSTR lpsPath = lpWatch->lpPaths->lpsPaths[dwPathId];
+	LPCWSTR lpsValueName = (lpValue == NULL) ? NULL : lpValue->lpsName;
+
+	lpWatch->ullEventsCount++;
+	swprintf_s(lpWatch->lpsKeyPath, HISTORY_MAX_PATH_LENGTH, (lpsPath[0] == L'\0') ? L"%s%s" : L"%s\\%s", lpWatch->lpsRootPath, lpsPath);
+
+	DWORD dwRule = MatchWatchRules(lpWatch->lpRuleSet, lpWatch->lpsKeyPath, lpsValueName);
+	if ((dwRule == WATCH_NO_RULE) || lpWatch->lpRuleSet->lpRules[dwRule].bIgnore)
+	{
+		return;
+	}
+
+	LPCWSTR lpsOperation = L"value-removed";
+	if (bOperation == HISTORY_OP_KEY_ADDED)
+	{
+		lpsOperation = L"key-added";
+	}
+	else if (bOperation == HISTORY_OP_KEY_REMOVED)
+	{
+		lpsOperation = L"key-removed";
+	}
+	else if (bOperation == HISTORY_OP_VALUE_SET)
+	{
+		lpsOperation = L"value-set";
+	}
+
+	SYSTEMTIME stNow;
+	GetLocalTime(&stNow);
+	swprintf_s(lpWatch->lpsEvent, HISTORY_MAX_PATH_LENGTH + HISTORY_MAX_VALUE_NAME_LENGTH + 64, L"%02u:%02u:%02u %s %s%s%s (rule at line %lu)",
+		stNow.wHour, stNow.wMinute, stNow.wSecond, lpsOperation, lpWatch->lpsKeyPath,
+		(lpsValueName == NULL) ? L"" : L" : ", (lpsValueName == NULL) ? L"" : lpsValueName, lpWatch->lpRuleSet->lpRules[dwRule].dwLine);
+
+	if (RouteWatchEvent(lpWatch->lpRuleSet, dwRule, lpWatch->lpsEvent))
+	{
+		lpWatch->ullRoutedCount++;
+	}
+}
+
+/// <summary>
+///		Watch subtree and route changes matching rules to sinks
+/// </summary>
+/// 
+/// <param name="arguments">Arguments values (root, path, rule file, optional notifications count)</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR WatchCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	if (argumentsCount < 3)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	WCHAR lpsRootPath[MAX_KEY_NAME_LENGTH];
+	CHAR lpsRootName[MAX_KEY_NAME_LENGTH];
+	DWORD dwRounds = 0;
+
+	if (argumentsCount > 3)
+	{
+		LPSTR lpsEnd;
+		dwRounds = strtoul(arguments[3], &lpsEnd, 10);
+
+		if ((lpsEnd == arguments[3]) || (*lpsEnd != '\0'))
+		{
+			return FAIL_MESSAGE;
+		}
+	}
+
+	if ((hKeyRoot == NULL) || !WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH) ||
+		(sprintf_s(lpsRootName, MAX_KEY_NAME_LENGTH, "%s\\%s", arguments[0], arguments[1]) < 0) ||
+		!WidenString(lpsRootName, lpsRootPath, MAX_KEY_NAME_LENGTH))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	WATCHRULESET wrsRules;
+	DWORD dwErrorLine;
+	if (!LoadWatchRules(arguments[2], &wrsRules, &dwErrorLine))
+	{
+		OutputPrintf("Invalid rule file %s (line %lu)\n", arguments[2], dwErrorLine);
+		return FAIL_MESSAGE;
+	}
+
+	PATHTABLE ptPaths;
+	WATCHCONTEXT wcContext;
+	ZeroMemory(&ptPaths, sizeof(PATHTABLE));
+	ZeroMemory(&wcContext, sizeof(WATCHCONTEXT));
+	wcContext.lpRuleSet = &wrsRules;
+	wcContext.lpPaths = &ptPaths;
+	wcContext.lpsRootPath = lpsRootPath;
+	wcContext.lpsKeyPath = (LPWSTR)malloc(HISTORY_MAX_PATH_LENGTH * sizeof(WCHAR));
+	wcContext.lpsEvent = (LPWSTR)malloc((HISTORY_MAX_PATH_LENGTH + HISTORY_MAX_VALUE_NAME_LENGTH + 64) * sizeof(WCHAR));
+
+	HKEY hKey;
+	bool bResult = (wcContext.lpsKeyPath != NULL) && (wcContext.lpsEvent != NULL) &&
+		OpenRegKey(hKeyRoot, lpsSubkeyPath, KEY_READ | KEY_NOTIFY, &hKey);
+
+	if (bResult)
+	{
+		OutputPrintf("Watching %s with %lu rules\n", lpsRootName, wrsRules.dwRulesCount);
+		bResult = WatchHistoryChanges(hKey, dwRounds, &ptPaths, RouteWatchChange, &wcContext);
+		CloseRegKey(hKey);
+
+		OutputPrintf("Changes: %llu  Routed: %llu\n", wcContext.ullEventsCount, wcContext.ullRoutedCount);
+		for (DWORD dwRule = 0; dwRule < wrsRules.dwRulesCount; dwRule++)
+		{
+			OutputPrintf("Rule at line %lu: %llu matched\n", wrsRules.lpRules[dwRule].dwLine, wrsRules.lpRules[dwRule].ullMatchedCount);
+		}
+	}
+
+	free(wcContext.lpsKeyPath);
+	free(wcContext.lpsEvent);
+	FreePathTable(&ptPaths);
+	FreeWatchRules(&wrsRules);
+
+	return bResult ? SUCCESS_MESSAGE : FAIL_MESSAGE;
+}
+
+/// <summary>
+///		Observe registry changes
+/// </summary>
+/// 
+/// <param name="arguments">Argumets values</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR NotifyCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	if (argumentsCount < 2)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	// Get hkey name
+	HKEY hKeyRoot = GetHkeyRoot(arguments[0]);
+	WCHAR lpsSubkeyPath[MAX_KEY_NAME_LENGTH];
+	if ((hKeyRoot == NULL) || !WidenString(arguments[1], lpsSubkeyPath, MAX_KEY_NAME_LENGTH))
+	{
+		return FAIL_MESSAGE;
+	}
+
+	// Start notify
+	if (NotifyChange(hKeyRoot, lpsSubkeyPath, TRUE))
+	{
+		return SUCCESS_MESSAGE;
+	}
+	else
+	{
+		return FAIL_MESSAGE;
+	}
+}
+
+LPCSTR ServeRequest(char** argv, int argc);
+
+/// <summary>
+///		Serve commands sent over named pipe, keeping opened keys and their lists warm
+/// </summary>
+/// 
+/// <param name="arguments">Arguments values (pipe name)</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR ServeCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	if (argumentsCount < 1)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	if (!EnableKeyCache())
+	{
+		return FAIL_MESSAGE;
+	}
+
+	// Server returns only when pipe can not be created
+	fprintf(stderr, "Serving on \\\\.\\pipe\\%s\n", arguments[0]);
+	RunQueryServer(arguments[0], ServeRequest);
+	DisableKeyCache();
+
+	return FAIL_MESSAGE;
+}
+
+/// <summary>
+///		Send command to query server and print its output
+/// </summary>
+/// 
+/// <param name="arguments">Arguments values (pipe name, command, command arguments)</param>
+/// <param name="argumentsCount">Arguments count</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR QueryCommand(LPSTR* arguments, DWORD argumentsCount)
+{
+	static CHAR lpsQueryResult[QUERY_MAX_RESULT_LENGTH];
+
+	if (argumentsCount < 2)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	OUTPUTBUFFER obOutput = { 0 };
+	if (!SendQuery(arguments[0], arguments + 1, argumentsCount - 1, &obOutput, lpsQueryResult, QUERY_MAX_RESULT_LENGTH))
+	{
+		FreeOutputBuffer(&obOutput);
+		return FAIL_MESSAGE;
+	}
+
+	fwrite(obOutput.lpsData, sizeof(CHAR), obOutput.cbSize, stdout);
+	FreeOutputBuffer(&obOutput);
+
+	return (lpsQueryResult[0] == '\0') ? FAIL_MESSAGE : lpsQueryResult;
+}
+
+/// <summary>
+///		Parse --memory-budget: size in bytes with optional K, M or G suffix, not less than search needs for its walk and sorter
+/// </summary>
+/// 
+/// <param name="lpsBudget">Budget text</param>
+/// <param name="lpcbBudget">Budget (bytes)</param>
+/// 
+/// <returns>bool</returns>
+static bool ParseMemoryBudget(LPCSTR lpsBudget, SIZE_T* lpcbBudget)
+{
+	if ((*lpsBudget < '0') || (*lpsBudget > '9'))
+	{
+		return false;
+	}
+
+	LPSTR lpsEnd;
+	errno = 0;
+	ULONGLONG ullBudget = strtoull(lpsBudget, &lpsEnd, 10);
+	ULONGLONG ullMultiplier = 1;
+
+	switch (toupper(*lpsEnd))
+	{
+	case 'K':
+		ullMultiplier = 1024;
+		lpsEnd++;
+		break;
+	case 'M':
+		ullMultiplier = 1024 * 1024;
+		lpsEnd++;
+		break;
+	case 'G':
+		ullMultiplier = 1024 * 1024 * 1024;
+		lpsEnd++;
+		break;
+	}
+
+	// SIZE_T has 32 bits in x86 build, so "4G" does not fit there
+	if ((errno == ERANGE) || (*lpsEnd != '\0') || (ullBudget > (SIZE_T)-1 / ullMultiplier) ||
+		(ullBudget * ullMultiplier < SEARCH_MIN_MEMORY_BUDGET))
+	{
+		return false;
+	}
+
+	*lpcbBudget = (SIZE_T)(ullBudget * ullMultiplier);
+	return true;
+}
+
+/// <summary>
+///		Parse decimal option value: --trace-threshold keys count or --progress-interval milliseconds
+/// </summary>
+/// 
+/// <param name="lpsValue">Option value text</param>
+/// <param name="dwMinValue">Smallest accepted value</param>
+/// <param name="lpdwValue">Parsed value</param>
+/// 
+/// <returns>bool</returns>
+static bool ParseOptionNumber(LPCSTR lpsValue, DWORD dwMinValue, DWORD* lpdwValue)
+{
+	// strtoul skips spaces and turns "-1" into huge value, only digits may start number
+	if ((*lpsValue < '0') || (*lpsValue > '9'))
+	{
+		return false;
+	}
+
+	LPSTR lpsEnd;
+	errno = 0;
+	ULONGLONG ullValue = strtoull(lpsValue, &lpsEnd, 10);
+
+	if ((errno == ERANGE) || (*lpsEnd != '\0') || (ullValue < dwMinValue) || (ullValue > MAXDWORD))
+	{
+		return false;
+	}
+
+	*lpdwValue = (DWORD)ullValue;
+	return true;
+}
+
+/// <summary>
+///		Parse --budget: keys per second or CPU percent with "%" suffix, zero is not a budget
+/// </summary>
+/// 
+/// <param name="lpsBudget">Budget text</param>
+/// <param name="lpParams">Throttle settings</param>
+/// 
+/// <returns>bool</returns>
+static bool ParseThrottleBudget(LPCSTR lpsBudget, THROTTLEPARAMS* lpParams)
+{
+	// strtoul skips spaces and accepts signs, only digits may start budget
+	if ((*lpsBudget < '0') || (*lpsBudget > '9'))
+	{
+		return false;
+	}
+
+	LPSTR lpsEnd;
+	errno = 0;
+	ULONGLONG ullBudget = strtoull(lpsBudget, &lpsEnd, 10);
+	bool bPercent = (*lpsEnd == '%');
+
+	if ((errno == ERANGE) || (*(bPercent ? lpsEnd + 1 : lpsEnd) != '\0') || (ullBudget == 0) || (ullBudget > (bPercent ? 100 : MAXDWORD)))
+	{
+		return false;
+	}
+
+	if (bPercent)
+	{
+		lpParams->dwCpuPercent = (DWORD)ullBudget;
+	}
+	else
+	{
+		lpParams->dwKeysPerSecond = (DWORD)ullBudget;
+	}
+
+	return true;
+}
+
+/// <summary>
+///		Remove global options (like --stats) from arguments
+/// </summary>
+/// 
+/// <param name="argv">Argumets values</param>
+/// <param name="argc">Arguments count</param>
+/// <param name="lpOptions">Parsed options</param>
+/// 
+/// <returns>int (arguments count without options; the first invalid option is kept in lpOptions)</returns>
+int ExtractGlobalOptions(char** argv, int argc, GLOBALOPTIONS* lpOptions)
+{
+	ZeroMemory(lpOptions, sizeof(GLOBALOPTIONS));
+	lpOptions->dwTraceThreshold = TRACE_DEFAULT_SUBTREE_THRESHOLD;
+	GetDefaultThrottleParams(&lpOptions->tpBudget);
+	GetDefaultProgressParams(&lpOptions->ppProgress);
+	int iKeptCount = 0;
+
+	for (int iIndex = 0; iIndex < argc; iIndex++)
+	{
+		if (strcmp(argv[iIndex], "--stats") == 0)
+		{
+			lpOptions->bStats = true;
+		}
+		else if (strcmp(argv[iIndex], "--stats=json") == 0)
+		{
+			lpOptions->bStats = true;
+			lpOptions->bStatsJson = true;
+		}
+		else if ((strcmp(argv[iIndex], "--trace") == 0) && (iIndex + 1 < argc))
+		{
+			lpOptions->lpsTraceFileName = argv[++iIndex];
+		}
+		else if ((strcmp(argv[iIndex], "--format") == 0) && (iIndex + 1 < argc))
+		{
+			lpOptions->lpsFormat = argv[++iIndex];
+		}
+		else if ((strcmp(argv[iIndex], "--record") == 0) && (iIndex + 1 < argc))
+		{
+			lpOptions->lpsRecordFileName = argv[++iIndex];
+		}
+		else if ((strcmp(argv[iIndex], "--replay") == 0) && (iIndex + 1 < argc))
+		{
+			lpOptions->lpsReplayFileName = argv[++iIndex];
+		}
+		else if (strcmp(argv[iIndex], "--replay-latency") == 0)
+		{
+			lpOptions->bReplayLatency = true;
+		}
+		else if (strcmp(argv[iIndex], "--progress") == 0)
+		{
+			lpOptions->bProgress = true;
+		}
+		else if ((strcmp(argv[iIndex], "--progress-file") == 0) && (iIndex + 1 < argc))
+		{
+			// Status file replaces stderr lines
+			lpOptions->bProgress = true;
+			lpOptions->ppProgress.lpsStatusFileName = argv[++iIndex];
+			lpOptions->ppProgress.lpOutput = NULL;
+		}
+		else if ((strcmp(argv[iIndex], "--progress-interval") == 0) && (iIndex + 1 < argc))
+		{
+			// Zero interval would keep reporter thread busy
+			lpOptions->bProgress = true;
+			iIndex++;
+			if (!ParseOptionNumber(argv[iIndex], 1, &lpOptions->ppProgress.dwInterval) && (lpOptions->lpsInvalidOption == NULL))
+			{
+				lpOptions->lpsInvalidOption = argv[iIndex - 1];
+				lpOptions->lpsInvalidValue = argv[iIndex];
+			}
+		}
+		else if ((strcmp(argv[iIndex], "--trace-threshold") == 0) && (iIndex + 1 < argc))
+		{
+			// Zero threshold records every subtree
+			iIndex++;
+			if (!ParseOptionNumber(argv[iIndex], 0, &lpOptions->dwTraceThreshold) && (lpOptions->lpsInvalidOption == NULL))
+			{
+				lpOptions->lpsInvalidOption = argv[iIndex - 1];
+				lpOptions->lpsInvalidValue = argv[iIndex];
+			}
+		}
+		else if ((strcmp(argv[iIndex], "--memory-budget") == 0) && (iIndex + 1 < argc))
+		{
+			iIndex++;
+			if (!ParseMemoryBudget(argv[iIndex], &lpOptions->cbMemoryBudget) && (lpOptions->lpsInvalidOption == NULL))
+			{
+				lpOptions->lpsInvalidOption = argv[iIndex - 1];
+				lpOptions->lpsInvalidValue = argv[iIndex];
+			}
+		}
+		else if ((strcmp(argv[iIndex], "--budget") == 0) && (iIndex + 1 < argc))
+		{
+			// "--budget 5000" limits keys per second, "--budget 25%" limits CPU usage
+			iIndex++;
+			if (!ParseThrottleBudget(argv[iIndex], &lpOptions->tpBudget) && (lpOptions->lpsInvalidOption == NULL))
+			{
+				lpOptions->lpsInvalidOption = argv[iIndex - 1];
+				lpOptions->lpsInvalidValue = argv[iIndex];
+			}
+		}
+		else
+		{
+			argv[iKeptCount++] = argv[iIndex];
+		}
+	}
+
+	return iKeptCount;
+}
+
+/// <summary>
+///		Find necessary command
+/// </summary>
+/// 
+/// <param name="argc">Arguments count</param>
+/// <param name="argv">Argumets values</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR ExecuteCommand(char** argv, int argc)
+{
+	if (argc < 2)
+	{
+		return FAIL_MESSAGE;
+	}
+
+	BeginOutputRecords();
+
+	if (strcmp(argv[1], "ADD_KEY") == 0)
+	{
+		return AddKeyCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "ADD_VALUE") == 0)
+	{
+		return AddValueCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "VIEW_VALUE") == 0)
+	{
+		return ViewValueCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "VIEW_FLAGS") == 0)
+	{
+		return ViewFlagsCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "SEARCH_KEY") == 0)
+	{
+		return SearchKeyCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "STATS") == 0)
+	{
+		return StatsCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "INDEX_BUILD") == 0)
+	{
+		return IndexBuildCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "INDEX_SEARCH") == 0)
+	{
+		return IndexSearchCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "HISTORY_SNAPSHOT") == 0)
+	{
+		return HistorySnapshotCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "HISTORY_LOG") == 0)
+	{
+		return HistoryLogCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "HISTORY_AS_OF") == 0)
+	{
+		return HistoryAsOfCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "NOTIFY") == 0)
+	{
+		return NotifyCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "WATCH") == 0)
+	{
+		return WatchCommand(argv + 2, argc - 2);
+	}
+
+	if (strcmp(argv[1], "SERVE") == 0)
+	{
+		return ServeCommand(argv + 2, argc - 2);
+	}
+	if (strcmp(argv[1], "QUERY") == 0)
+	{
+		return QueryCommand(argv + 2, argc - 2);
+	}
+
+	return NULL;
+}
+
+/// <summary>
+///		Execute command received by query server
+/// </summary>
+/// 
+/// <param name="argc">Arguments count</param>
+/// <param name="argv">Argumets values</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR ServeRequest(char** argv, int argc)
+{
+	// Options of server process apply to all clients; format, budget and the rest are
+	// process-wide, so a request can not change them and is refused instead of being run with other options
+	GLOBALOPTIONS goOptions;
+	int iArgumentsCount = ExtractGlobalOptions(argv, argc, &goOptions);
+	if (iArgumentsCount != argc)
+	{
+		OutputPrintf("Global options are not accepted per request, pass them to SERVE\n");
+		return FAIL_MESSAGE;
+	}
+
+	// Commands that block, switch backend or start another server are not served
+	const LPCSTR lpsServedCommands[] = { "ADD_KEY", "ADD_VALUE", "VIEW_VALUE", "VIEW_FLAGS", "SEARCH_KEY", "STATS", "INDEX_SEARCH", "HISTORY_LOG", "HISTORY_AS_OF" };
+	bool bServed = false;
+
+	for (DWORD dwIndex = 0; (argc >= 2) && (dwIndex < sizeof(lpsServedCommands) / sizeof(lpsServedCommands[0])); dwIndex++)
+	{
+		bServed = bServed || (strcmp(argv[1], lpsServedCommands[dwIndex]) == 0);
+	}
+
+	if (!bServed)
+	{
+		return NULL;
+	}
+
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	LPCSTR cmdResult = ExecuteCommand(argv, argc);
+	EndTraceSpan(argv[1], "request", ullTraceStart, NULL);
+
+	return cmdResult;
+}
+
+/// <summary>
+///		Stop throttle and progress started for command
+/// </summary>
+/// 
+/// <param name="bThrottled">Throttle was enabled</param>
+/// <param name="bProgress">Progress was enabled</param>
+/// 
+/// <returns>void</returns>
+static void StopThrottleAndProgress(bool bThrottled, bool bProgress)
+{
+	if (bThrottled)
+	{
+		DisableThrottle();
+	}
+
+	if (bProgress)
+	{
+		DisableProgress();
+	}
+}
+
+/// <summary>
+///		Apply global options and execute command
+/// </summary>
+/// 
+/// <param name="argc">Arguments count</param>
+/// <param name="argv">Argumets values</param>
+/// 
+/// <returns>LPCSTR</returns>
+LPCSTR CommandProcessor(char** argv, int argc)
+{
+	GLOBALOPTIONS goOptions;
+	argc = ExtractGlobalOptions(argv, argc, &goOptions);
+
+	// Checked before recording, replay or anything else is started
+	if (goOptions.lpsInvalidOption != NULL)
+	{
+		fprintf(stderr, "Invalid %s value %s\n", goOptions.lpsInvalidOption, goOptions.lpsInvalidValue);
+		if (strcmp(goOptions.lpsInvalidOption, "--memory-budget") == 0)
+		{
+			fprintf(stderr, "Memory budget is at least %lluK\n", (ULONGLONG)(SEARCH_MIN_MEMORY_BUDGET + 1023) / 1024);
+		}
+		return FAIL_MESSAGE;
+	}
+
+	DWORD dwFormat = OUTPUT_FORMAT_TEXT;
+	if ((goOptions.lpsFormat != NULL) && !ParseOutputFormat(goOptions.lpsFormat, &dwFormat))
+	{
+		fprintf(stderr, "Invalid format %s\n", goOptions.lpsFormat);
+		return FAIL_MESSAGE;
+	}
+
+	SetOutputFormat(dwFormat);
+
+	if ((goOptions.lpsRecordFileName != NULL) && (goOptions.lpsReplayFileName != NULL))
+	{
+		fprintf(stderr, "Can not record and replay at once\n");
+		return FAIL_MESSAGE;
+	}
+
+	// Throttle and progress fail only on their options, so they are started first and recording or replay is not left running
+	bool bThrottled = false;
+	if ((goOptions.tpBudget.dwKeysPerSecond != 0) || (goOptions.tpBudget.dwCpuPercent != 0))
+	{
+		// Progress reporter already prints scanned keys
+		if (goOptions.bProgress)
+		{
+			goOptions.tpBudget.lpProgress = NULL;
+		}
+
+		bThrottled = EnableThrottle(&goOptions.tpBudget);
+		if (!bThrottled)
+		{
+			fprintf(stderr, "Invalid budget\n");
+			return FAIL_MESSAGE;
+		}
+	}
+
+	if (goOptions.bProgress && !EnableProgress(&goOptions.ppProgress))
+	{
+		fprintf(stderr, "Invalid progress interval\n");
+		StopThrottleAndProgress(bThrottled, false);
+		return FAIL_MESSAGE;
+	}
+
+	if (goOptions.lpsReplayFileName != NULL)
+	{
+		if (!LoadRegReplay(goOptions.lpsReplayFileName, goOptions.bReplayLatency))
+		{
+			fprintf(stderr, "Can not load recording %s\n", goOptions.lpsReplayFileName);
+			StopThrottleAndProgress(bThrottled, goOptions.bProgress);
+			return FAIL_MESSAGE;
+		}
+
+		SetRegBackend(GetReplayBackend());
+	}
+
+	if ((goOptions.lpsRecordFileName != NULL) && !StartRegRecording(goOptions.lpsRecordFileName))
 	{
-		printf("%s\n", cmdResult);
+		fprintf(stderr, "Can not start recording %s\n", goOptions.lpsRecordFileName);
+		StopThrottleAndProgress(bThrottled, goOptions.bProgress);
+		return FAIL_MESSAGE;
+	}
+
+	SetResultMemoryBudget(goOptions.cbMemoryBudget);
+
+#ifdef REGISTRY_EDITOR_STATS
+	if (goOptions.bStats)
+	{
+		EnableStats(true);
+	}
+#endif
+
+	if ((goOptions.lpsTraceFileName != NULL) && !StartTrace(goOptions.lpsTraceFileName, goOptions.dwTraceThreshold))
+	{
+		fprintf(stderr, "Can not start trace %s\n", goOptions.lpsTraceFileName);
+	}
+
+	ULONGLONG ullTraceStart = BeginTraceSpan();
+	LPCSTR cmdResult = ExecuteCommand(argv, argc);
+	EndTraceSpan((argc < 2) ? "command" : argv[1], "command", ullTraceStart, NULL);
+
+	if (!FlushOutput())
+	{
+		fprintf(stderr, "Can not write output\n");
+	}
+
+	// Reporter may still estimate walk size, so it is stopped while recorded or replayed backend is set
+	StopThrottleAndProgress(bThrottled, goOptions.bProgress);
+
+	if ((goOptions.lpsRecordFileName != NULL) && !StopRegRecording())
+	{
+		fprintf(stderr, "Can not write recording %s\n", goOptions.lpsRecordFileName);
+	}
+
+	if (goOptions.lpsReplayFileName != NULL)
+	{
+		if (GetReplayMissesCount() != 0)
+		{
+			fprintf(stderr, "%llu calls were not recorded\n", GetReplayMissesCount());
+		}
+
+		SetRegBackend(NULL);
+		FreeRegReplay();
+	}
+
+	if (goOptions.bStats)
+	{
+#ifdef REGISTRY_EDITOR_STATS
+		PrintStats(stderr, goOptions.bStatsJson);
+#else
+		fprintf(stderr, "Statistics are not compiled in (REGISTRY_EDITOR_STATS)\n");
+#endif
+	}
+
+	if (!FlushTrace())
+	{
+		fprintf(stderr, "Can not write trace %s\n", goOptions.lpsTraceFileName);
+	}
+
+	return cmdResult;
+}
+
+/// <summary>
+///		Entry point
+/// </summary>
+/// 
+/// <param name="argc">Arguments count</param>
+/// <param name="argv">Argumets values</param>
+/// 
+/// <returns>int</returns>
+int main(int argc, char** argv)
+{
+	// Arguments are taken from wide command line as UTF-8, so names are not limited to ANSI code page
+	int iWideCount = 0;
+	LPWSTR* lpsWideArguments = CommandLineToArgvW(GetCommandLineW(), &iWideCount);
+	SIZE_T cbArguments = 0;
+
+	for (int iIndex = 0; (lpsWideArguments != NULL) && (iIndex < iWideCount); iIndex++)
+	{
+		cbArguments += wcslen(lpsWideArguments[iIndex]) * TRANSCODE_MAX_UTF8_PER_UTF16 + 1;
+	}
+
+	char** lpsArguments = (lpsWideArguments == NULL) ? NULL : (char**)calloc(iWideCount + 1, sizeof(char*));
+	LPSTR lpsArgumentsText = (lpsArguments == NULL) ? NULL : (LPSTR)malloc(cbArguments);
+
+	if (lpsArgumentsText != NULL)
+	{
+		LPSTR lpsArgument = lpsArgumentsText;
+		for (int iIndex = 0; iIndex < iWideCount; iIndex++)
+		{
+			DWORD cchArgument = (DWORD)wcslen(lpsWideArguments[iIndex]);
+			DWORD cbArgument = Utf16ToUtf8(lpsWideArguments[iIndex], cchArgument, lpsArgument, cchArgument * TRANSCODE_MAX_UTF8_PER_UTF16);
+
+			lpsArgument[cbArgument] = '\0';
+			lpsArguments[iIndex] = lpsArgument;
+			lpsArgument += cbArgument + 1;
+		}
+
+		argv = lpsArguments;
+		argc = iWideCount;
+	}
+
+	SetConsoleOutputCP(CP_UTF8);
+
+	LPCSTR cmdResult = CommandProcessor(argv, argc);
+
+	// Structured output stays parseable, result message goes to stderr
+	FILE* lpResultOutput = (GetOutputFormat() == OUTPUT_FORMAT_TEXT) ? stdout : stderr;
+
+	if (cmdResult == NULL)
+	{
+		fprintf(lpResultOutput, "%s\n", FAIL_MESSAGE);
+	}
+	else
+	{
+		fprintf(lpResultOutput, "%s\n", cmdResult);
 	}
 
+	fflush(lpResultOutput);
 	getchar();
 
+	free(lpsArgumentsText);
+	free(lpsArguments);
+	LocalFree(lpsWideArguments);
+
 	return 0;
 }
 
 ///	ADD_KEY HKEY_LOCAL_MACHINE SOFTWARE\TEST
 /// ADD_VALUE HKEY_LOCAL_MACHINE SOFTWARE\TEST TEST REG_SZ TEST
+/// ADD_VALUE HKEY_LOCAL_MACHINE SOFTWARE\TEST DATA REG_BINARY "de ad be ef"
+/// ADD_VALUE HKEY_LOCAL_MACHINE SOFTWARE\TEST LIST REG_MULTI_SZ FIRST\0SECOND
+/// VIEW_VALUE HKEY_LOCAL_MACHINE SOFTWARE\TEST TEST
 /// VIEW_FLAGS HKEY_LOCAL_MACHINE SOFTWARE\TEST
+/// VIEW_FLAGS HKEY_LOCAL_MACHINE SOFTWARE\TEST SOFTWARE\Classes --jobs 4
+/// VIEW_FLAGS HKEY_LOCAL_MACHINE SOFTWARE --search TEST
+/// VIEW_FLAGS HKEY_LOCAL_MACHINE --keys keys.txt --jobs 16
 /// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST
-/// NOTIFY HKEY_LOCAL_MACHINE SOFTWARE
\ No newline at end of file
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --fuzzy 2
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --stats=json
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --trace search.json --trace-threshold 500
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --budget 5000
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --memory-budget 64M
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --format ndjson
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --record search.rrp
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --replay search.rrp --replay-latency
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --progress
+/// SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST --progress-file progress.json --progress-interval 5000
+/// VIEW_FLAGS HKEY_LOCAL_MACHINE SOFTWARE --search TEST --format csv
+/// STATS HKEY_LOCAL_MACHINE SOFTWARE 20 --budget 25%
+/// STATS HKEY_LOCAL_MACHINE SOFTWARE 20
+/// INDEX_BUILD HKEY_LOCAL_MACHINE SOFTWARE values.idx
+/// INDEX_SEARCH values.idx "Program Files\Common"
+/// HISTORY_SNAPSHOT HKEY_LOCAL_MACHINE SOFTWARE C:\History\Software
+/// HISTORY_LOG C:\History\Software
+/// HISTORY_AS_OF C:\History\Software 2024-05-01T13:00:00 Microsoft\Windows
+/// NOTIFY HKEY_LOCAL_MACHINE SOFTWARE
+/// WATCH HKEY_LOCAL_MACHINE SOFTWARE rules.txt
+/// WATCH HKEY_LOCAL_MACHINE SOFTWARE rules.txt 10
+/// SERVE RegistryEditor
+/// QUERY RegistryEditor SEARCH_KEY HKEY_LOCAL_MACHINE SOFTWARE TEST
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Api/FlagsPool.h"
+#include "TestCheck.h"
+
+const char TEST_REG_EXE_OUTPUT[] =
+	"\r\nHKEY_LOCAL_MACHINE\\SOFTWARE\\Test_key\r\n"
+	"\tREG_KEY_DONT_VIRTUALIZE: CLEAR\r\n"
+	"\tREG_KEY_DONT_SILENT_FAIL: SET\r\n"
+	"\tREG_KEY_RECURSE_FLAG: CLEAR\r\n"
+	"\r\nThe operation completed successfully.\r\n";
+const WCHAR TEST_FLAGS_KEY_ROOT[] = L"HKEY_CURRENT_USER\\RegistryEditorTests";
+const DWORD TEST_ORDER_KEYS_COUNT = 64;
+const DWORD TEST_JOBS_COUNT = 4;
+// Keys past cache bound, so some of them are answered from their own flags
+const DWORD TEST_OVERFLOW_KEYS_COUNT = 100;
+const DWORD TEST_KEY_NAME_LENGTH = 32;
+
+// Stub of reg.exe, earlier keys take longer so later workers finish first
+typedef struct _STUBCHILDRUNNER {
+	volatile LONG lRunningCount;
+	volatile LONG lMaxRunningCount;
+	volatile LONG lRunsCount;
+	bool bSlowFirstKeys;
+	bool bFail;
+} STUBCHILDRUNNER;
+
+typedef struct _FLAGSCHECK {
+	LPCWSTR* lpsSubkeyPaths;
+	DWORD dwNextIndex;
+	DWORD dwOutOfOrderCount;
+	DWORD dwFailedCount;
+	DWORD dwWrongFlagsCount;
+	DWORD dwCachedCount;
+	DWORD dwOwnedCount;
+} FLAGSCHECK;
+
+/// <summary>
+///		Answer with typical reg.exe output, counts children running at once
+/// </summary>
+///
+/// <returns>LPSTR (NULL if stub fails)</returns>
+static LPSTR RunStubChild(void* lpContext, WCHAR* lpsCommand)
+{
+	STUBCHILDRUNNER* lpStub = (STUBCHILDRUNNER*)lpContext;
+	LONG lRunningCount = InterlockedIncrement(&lpStub->lRunningCount);
+	LONG lRunIndex = InterlockedIncrement(&lpStub->lRunsCount) - 1;
+
+	for (LONG lMaxRunningCount = lpStub->lMaxRunningCount; lRunningCount > lMaxRunningCount; lMaxRunningCount = lpStub->lMaxRunningCount)
+	{
+		InterlockedCompareExchange(&lpStub->lMaxRunningCount, lRunningCount, lMaxRunningCount);
+	}
+
+	if (lpStub->bSlowFirstKeys && (lRunIndex < (LONG)TEST_JOBS_COUNT))
+	{
+		Sleep((TEST_JOBS_COUNT - lRunIndex) * 5);
+	}
+
+	LPSTR lpsOutput = lpStub->bFail ? NULL : _strdup(TEST_REG_EXE_OUTPUT);
+
+	InterlockedDecrement(&lpStub->lRunningCount);
+	return lpsOutput;
+}
+
+/// <summary>
+///		Count results that are out of order, failed, cached or owned by pool
+/// </summary>
+///
+/// <returns>void</returns>
+static void CheckFlagsResult(void* lpContext, DWORD dwIndex, const FLAGSRESULT* lpResult)
+{
+	FLAGSCHECK* lpCheck = (FLAGSCHECK*)lpContext;
+
+	if ((dwIndex != lpCheck->dwNextIndex++) || (lpResult->lpsSubkeyPath != lpCheck->lpsSubkeyPaths[dwIndex]))
+	{
+		lpCheck->dwOutOfOrderCount++;
+	}
+
+	if (lpResult->kfFlags == NULL)
+	{
+		lpCheck->dwFailedCount++;
+	}
+	else
+	{
+		// Second flag of stub output is the only one set
+		for (DWORD dwFlagIndex = 0; dwFlagIndex < lpResult->dwFlagsCount; dwFlagIndex++)
+		{
+			LPCSTR lpsValue = lpResult->kfFlags[dwFlagIndex].lpsFlagValue;
+			LPCSTR lpsExpected = (strcmp(lpResult->kfFlags[dwFlagIndex].lpsFlagName, "REG_KEY_DONT_SILENT_FAIL") == 0) ? "SET" : "CLEAR";
+
+			lpCheck->dwWrongFlagsCount += ((lpsValue == NULL) || (strcmp(lpsValue, lpsExpected) != 0)) ? 1 : 0;
+		}
+	}
+
+	lpCheck->dwCachedCount += lpResult->bCached ? 1 : 0;
+	lpCheck->dwOwnedCount += lpResult->bOwned ? 1 : 0;
+}
+
+/// <summary>
+///		Create distinct key names
+/// </summary>
+///
+/// <returns>LPWSTR* (free with FreeTestKeys)</returns>
+static LPWSTR* CreateTestKeys(LPCWSTR lpsPrefix, DWORD dwKeysCount)
+{
+	LPWSTR* lpsKeys = (LPWSTR*)calloc(dwKeysCount, sizeof(LPWSTR));
+
+	for (DWORD dwIndex = 0; (lpsKeys != NULL) && (dwIndex < dwKeysCount); dwIndex++)
+	{
+		lpsKeys[dwIndex] = (LPWSTR)malloc(TEST_KEY_NAME_LENGTH * sizeof(WCHAR));
+		if (lpsKeys[dwIndex] != NULL)
+		{
+			swprintf(lpsKeys[dwIndex], TEST_KEY_NAME_LENGTH, L"%ls%u", lpsPrefix, dwIndex);
+		}
+	}
+
+	return lpsKeys;
+}
+
+/// <summary>
+///		Free key names
+/// </summary>
+///
+/// <returns>void</returns>
+static void FreeTestKeys(LPWSTR* lpsKeys, DWORD dwKeysCount)
+{
+	for (DWORD dwIndex = 0; (lpsKeys != NULL) && (dwIndex < dwKeysCount); dwIndex++)
+	{
+		free(lpsKeys[dwIndex]);
+	}
+	free(lpsKeys);
+}
+
+/// <summary>
+///		Query keys once and count results
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool RunFlagsCheck(LPWSTR* lpsKeys, DWORD dwKeysCount, STUBCHILDRUNNER* lpStub, FLAGSCHECK* lpCheck)
+{
+	CHILDRUNNER crRunner = { RunStubChild, lpStub };
+
+	ZeroMemory(lpCheck, sizeof(FLAGSCHECK));
+	lpCheck->lpsSubkeyPaths = (LPCWSTR*)lpsKeys;
+
+	return QueryKeyFlags(TEST_FLAGS_KEY_ROOT, (LPCWSTR*)lpsKeys, dwKeysCount, TEST_JOBS_COUNT, &crRunner, CheckFlagsResult, lpCheck);
+}
+
+/// <summary>
+///		Results come in order of keys although first keys finish last,
+///		no more children than jobs run at once and keys queried before come from cache
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestResultsInOrder()
+{
+	LPWSTR* lpsKeys = CreateTestKeys(L"Order", TEST_ORDER_KEYS_COUNT);
+	if (!CHECK(lpsKeys != NULL))
+	{
+		return;
+	}
+
+	STUBCHILDRUNNER scStub;
+	ZeroMemory(&scStub, sizeof(STUBCHILDRUNNER));
+	scStub.bSlowFirstKeys = true;
+	FLAGSCHECK fcCheck;
+
+	CHECK(RunFlagsCheck(lpsKeys, TEST_ORDER_KEYS_COUNT, &scStub, &fcCheck));
+	CHECK(fcCheck.dwNextIndex == TEST_ORDER_KEYS_COUNT);
+	CHECK(fcCheck.dwOutOfOrderCount == 0);
+	CHECK((fcCheck.dwFailedCount == 0) && (fcCheck.dwWrongFlagsCount == 0));
+	CHECK((fcCheck.dwCachedCount == 0) && (fcCheck.dwOwnedCount == 0));
+	CHECK(scStub.lRunsCount == (LONG)TEST_ORDER_KEYS_COUNT);
+	CHECK((scStub.lMaxRunningCount >= 1) && (scStub.lMaxRunningCount <= (LONG)TEST_JOBS_COUNT));
+
+	scStub.bSlowFirstKeys = false;
+	CHECK(RunFlagsCheck(lpsKeys, TEST_ORDER_KEYS_COUNT, &scStub, &fcCheck));
+	CHECK((fcCheck.dwNextIndex == TEST_ORDER_KEYS_COUNT) && (fcCheck.dwOutOfOrderCount == 0));
+	CHECK(fcCheck.dwCachedCount == TEST_ORDER_KEYS_COUNT);
+	CHECK(scStub.lRunsCount == (LONG)TEST_ORDER_KEYS_COUNT);
+
+	FreeTestKeys(lpsKeys, TEST_ORDER_KEYS_COUNT);
+}
+
+/// <summary>
+///		Failed queries are reported without flags and are not cached
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestFailedQueriesNotCached()
+{
+	const DWORD dwKeysCount = 8;
+	LPWSTR* lpsKeys = CreateTestKeys(L"Failed", dwKeysCount);
+	if (!CHECK(lpsKeys != NULL))
+	{
+		return;
+	}
+
+	STUBCHILDRUNNER scStub;
+	ZeroMemory(&scStub, sizeof(STUBCHILDRUNNER));
+	scStub.bFail = true;
+	FLAGSCHECK fcCheck;
+
+	CHECK(RunFlagsCheck(lpsKeys, dwKeysCount, &scStub, &fcCheck));
+	CHECK((fcCheck.dwFailedCount == dwKeysCount) && (fcCheck.dwOutOfOrderCount == 0));
+
+	scStub.bFail = false;
+	CHECK(RunFlagsCheck(lpsKeys, dwKeysCount, &scStub, &fcCheck));
+	CHECK((fcCheck.dwFailedCount == 0) && (fcCheck.dwCachedCount == 0));
+	CHECK(scStub.lRunsCount == (LONG)(2 * dwKeysCount));
+
+	FreeTestKeys(lpsKeys, dwKeysCount);
+}
+
+/// <summary>
+///		Cache keeps at most FLAGS_CACHE_MAX_ENTRIES keys, flags of later keys belong to their results.
+///		Runs after other tests, so cache already holds their successful keys
+/// </summary>
+///
+/// <param name="dwCachedBefore">Keys cached by earlier tests</param>
+///
+/// <returns>void</returns>
+static void TestCacheBound(DWORD dwCachedBefore)
+{
+	DWORD dwFreeEntries = FLAGS_CACHE_MAX_ENTRIES - dwCachedBefore;
+	DWORD dwKeysCount = dwFreeEntries + TEST_OVERFLOW_KEYS_COUNT;
+	LPWSTR* lpsKeys = CreateTestKeys(L"Bound", dwKeysCount);
+	if (!CHECK(lpsKeys != NULL))
+	{
+		return;
+	}
+
+	STUBCHILDRUNNER scStub;
+	ZeroMemory(&scStub, sizeof(STUBCHILDRUNNER));
+	FLAGSCHECK fcCheck;
+
+	CHECK(RunFlagsCheck(lpsKeys, dwKeysCount, &scStub, &fcCheck));
+	CHECK((fcCheck.dwOutOfOrderCount == 0) && (fcCheck.dwFailedCount == 0) && (fcCheck.dwWrongFlagsCount == 0));
+	CHECK(fcCheck.dwCachedCount == 0);
+	CHECK(fcCheck.dwOwnedCount == TEST_OVERFLOW_KEYS_COUNT);
+
+	// Second pass finds only keys that fit, the rest run again and are still not stored
+	CHECK(RunFlagsCheck(lpsKeys, dwKeysCount, &scStub, &fcCheck));
+	CHECK(fcCheck.dwCachedCount == dwFreeEntries);
+	CHECK(fcCheck.dwOwnedCount == TEST_OVERFLOW_KEYS_COUNT);
+	CHECK(scStub.lRunsCount == (LONG)(dwKeysCount + TEST_OVERFLOW_KEYS_COUNT));
+
+	FreeTestKeys(lpsKeys, dwKeysCount);
+}
+
+/// <summary>
+///		Check flags pool against stub of reg.exe
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestResultsInOrder();
+	TestFailedQueriesNotCached();
+	TestCacheBound(TEST_ORDER_KEYS_COUNT + 8);
+
+	return FinishTests("FlagsPoolTests");
+}
@@ -0,0 +1,88 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/FuzzyMatch.h"
+#include "TestCheck.h"
+
+const DWORD TEST_TEXT_LENGTH = 16;
+
+/// <summary>
+///		Fold table gives the same case as CharLowerBuffW called for every BMP code unit
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestFoldTable()
+{
+	DWORD dwMismatchCount = 0;
+
+	for (DWORD dwIndex = 0; dwIndex < FUZZY_FOLD_TABLE_SIZE; dwIndex++)
+	{
+		// Halves of surrogate pairs have no case
+		if ((dwIndex >= 0xD800) && (dwIndex <= 0xDFFF))
+		{
+			continue;
+		}
+
+		WCHAR wcExpected = (WCHAR)dwIndex;
+		CharLowerBuffW(&wcExpected, 1);
+
+		if (FoldChar((WCHAR)dwIndex) != wcExpected)
+		{
+			if (dwMismatchCount == 0)
+			{
+				fprintf(stderr, "U+%04X folds to U+%04X, expected U+%04X\n", dwIndex, (DWORD)FoldChar((WCHAR)dwIndex), (DWORD)wcExpected);
+			}
+			dwMismatchCount++;
+		}
+	}
+
+	CHECK(dwMismatchCount == 0);
+	CHECK(FoldChar(L'Q') == L'q');
+	CHECK(FoldChar(L'q') == L'q');
+}
+
+/// <summary>
+///		Text differing from pattern only in case has distance 0, non-ASCII characters included
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestCaseInsensitiveDistance()
+{
+	// A with diaeresis, Cyrillic Zhe, Greek Sigma and ASCII
+	WCHAR lpsPattern[] = { 0x00C4, 0x0416, 0x03A3, L'K', L'e', L'y', L'\0' };
+	WCHAR lpsText[TEST_TEXT_LENGTH];
+	DWORD dwLength = 0;
+	for (; lpsPattern[dwLength] != L'\0'; dwLength++)
+	{
+		lpsText[dwLength] = lpsPattern[dwLength];
+	}
+	lpsText[dwLength] = L'\0';
+	CharLowerBuffW(lpsText, dwLength);
+
+	FUZZYPATTERN fpPattern;
+	if (!CHECK(CompileFuzzyPattern(lpsPattern, &fpPattern)))
+	{
+		return;
+	}
+
+	CHECK(GetFuzzyDistance(&fpPattern, lpsText, dwLength, 2) == 0);
+
+	// One substitution and one deletion
+	lpsText[1] = L'z';
+	CHECK(GetFuzzyDistance(&fpPattern, lpsText, dwLength, 2) == 1);
+	CHECK(GetFuzzyDistance(&fpPattern, lpsText, dwLength - 1, 2) == 2);
+	CHECK(GetFuzzyDistance(&fpPattern, lpsText, dwLength - 1, 1) == 2);
+}
+
+/// <summary>
+///		Check case folding and edit distance of fuzzy search
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestFoldTable();
+	TestCaseInsensitiveDistance();
+
+	return FinishTests("FuzzyMatchTests");
+}
@@ -0,0 +1,211 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Api/RegistryEditor.h"
+#include "../Api/Progress.h"
+#include "../Api/SyntheticTree.h"
+#include "TestCheck.h"
+
+// Fan-out and depth of generated trees
+const DWORD TEST_TREE_SHAPES[][2] = { { 3, 3 }, { 8, 4 }, { 2, 7 }, { 5, 1 } };
+const DWORD TEST_TREE_SHAPES_COUNT = sizeof(TEST_TREE_SHAPES) / sizeof(TEST_TREE_SHAPES[0]);
+
+/// <summary>
+///		Generate synthetic tree of given shape and serve it
+/// </summary>
+///
+/// <returns>SYNTHETICKEY* (NULL on failure, free with FreeSyntheticTree)</returns>
+static SYNTHETICKEY* CreateTestTree(DWORD dwFanOut, DWORD dwDepth, DWORD* lpdwKeysCount)
+{
+	SYNTHETICTREEPARAMS stpParams;
+	GetDefaultSyntheticTreeParams(&stpParams);
+	stpParams.dwFanOut = dwFanOut;
+	stpParams.dwDepth = dwDepth;
+
+	SYNTHETICKEY* lpRoot = GenerateSyntheticTree(&stpParams, lpdwKeysCount);
+	if (lpRoot != NULL)
+	{
+		SetRegBackend(GetSyntheticBackend());
+	}
+
+	return lpRoot;
+}
+
+/// <summary>
+///		Count keys below root the way search walks them
+/// </summary>
+///
+/// <returns>DWORD</returns>
+static DWORD CountWalkedKeys(HKEY hRoot)
+{
+	DWORD dwKeysCount = 0;
+	LPWSTR* lpsKeyNames = SearchRecursive(hRoot, L"", &dwKeysCount);
+
+	for (DWORD dwIndex = 0; (lpsKeyNames != NULL) && (dwIndex < dwKeysCount); dwIndex++)
+	{
+		free(lpsKeyNames[dwIndex]);
+	}
+	free(lpsKeyNames);
+
+	return dwKeysCount;
+}
+
+/// <summary>
+///		Every descent of tree with the same fan-out on every level sees the same counts,
+///		so estimate before walk is exact
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestUniformTreeExact()
+{
+	for (DWORD dwShapeIndex = 0; dwShapeIndex < TEST_TREE_SHAPES_COUNT; dwShapeIndex++)
+	{
+		DWORD dwFanOut = TEST_TREE_SHAPES[dwShapeIndex][0];
+		DWORD dwTreeKeysCount;
+		SYNTHETICKEY* lpRoot = CreateTestTree(dwFanOut, TEST_TREE_SHAPES[dwShapeIndex][1], &dwTreeKeysCount);
+		if (!CHECK(lpRoot != NULL))
+		{
+			continue;
+		}
+
+		HKEY hRoot = GetSyntheticKeyHandle(lpRoot);
+		DWORD dwKeysCount = CountWalkedKeys(hRoot);
+		CHECK(dwKeysCount == dwTreeKeysCount);
+
+		PROGRESSESTIMATE peEstimate;
+		if (CHECK(EstimateWalkSize(hRoot, PROGRESS_DEFAULT_SAMPLES_COUNT, &peEstimate)))
+		{
+			CHECK(peEstimate.ullRootKeysCount == dwFanOut);
+			CHECK(peEstimate.dwBranchesCount == dwFanOut);
+
+			// Branches are alike, each holds equal share of keys below first level
+			double dBranchKeys = (double)(dwKeysCount - dwFanOut) / dwFanOut;
+			for (DWORD dwIndex = 0; dwIndex < peEstimate.dwBranchesCount; dwIndex++)
+			{
+				CHECK(peEstimate.lpdBranchKeys[dwIndex] == dBranchKeys);
+			}
+
+			CHECK(RefineWalkSize(&peEstimate, 0, 0, 0.0) == dwKeysCount);
+			FreeProgressEstimate(&peEstimate);
+		}
+
+		FreeSyntheticTree(lpRoot);
+	}
+
+	SetRegBackend(GetWin32Backend());
+}
+
+/// <summary>
+///		Key without subkeys has nothing to walk
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestEmptyKey()
+{
+	DWORD dwTreeKeysCount;
+	SYNTHETICKEY* lpRoot = CreateTestTree(4, 0, &dwTreeKeysCount);
+	if (!CHECK(lpRoot != NULL))
+	{
+		return;
+	}
+
+	PROGRESSESTIMATE peEstimate;
+	if (CHECK(EstimateWalkSize(GetSyntheticKeyHandle(lpRoot), PROGRESS_DEFAULT_SAMPLES_COUNT, &peEstimate)))
+	{
+		CHECK((peEstimate.ullRootKeysCount == 0) && (peEstimate.dwBranchesCount == 0));
+		CHECK(RefineWalkSize(&peEstimate, 0, 0, 0.0) == 0);
+		FreeProgressEstimate(&peEstimate);
+	}
+
+	FreeSyntheticTree(lpRoot);
+	SetRegBackend(GetWin32Backend());
+}
+
+/// <summary>
+///		Completed branches replace their estimates, branches left are scaled by how far off
+///		completed ones were, and estimate never falls below visited keys
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestRefineWalkSize()
+{
+	double dBranchKeys[] = { 100.0, 100.0 };
+	PROGRESSESTIMATE peEstimate;
+	ZeroMemory(&peEstimate, sizeof(PROGRESSESTIMATE));
+	peEstimate.ullRootKeysCount = 2;
+	peEstimate.lpdBranchKeys = dBranchKeys;
+	peEstimate.dwBranchesCount = 2;
+	peEstimate.dTotalBranchKeys = 200.0;
+
+	CHECK(RefineWalkSize(&peEstimate, 0, 0, 0.0) == 202);
+
+	// First branch matched its estimate, second one is not corrected
+	CHECK(RefineWalkSize(&peEstimate, 102, 100, 100.0) == 202);
+
+	// First branch was twice as large, second one is expected to be larger too
+	ULONGLONG ullLarger = RefineWalkSize(&peEstimate, 202, 200, 100.0);
+	CHECK((ullLarger > 302) && (ullLarger < 402));
+
+	// First branch was half as large
+	ULONGLONG ullSmaller = RefineWalkSize(&peEstimate, 52, 50, 100.0);
+	CHECK((ullSmaller > 102) && (ullSmaller < 152));
+
+	// All branches done, real count replaces estimate
+	CHECK(RefineWalkSize(&peEstimate, 352, 350, 200.0) == 352);
+
+	// Branch being walked outgrew what is left of estimate
+	CHECK(RefineWalkSize(&peEstimate, 500, 100, 100.0) == 500);
+	CHECK(RefineWalkSize(&peEstimate, 1000, 0, 0.0) == 1000);
+}
+
+/// <summary>
+///		Estimate stays exact while walk of uniform tree completes its branches one by one
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestRefineDuringWalk()
+{
+	DWORD dwTreeKeysCount;
+	SYNTHETICKEY* lpRoot = CreateTestTree(6, 4, &dwTreeKeysCount);
+	if (!CHECK(lpRoot != NULL))
+	{
+		return;
+	}
+
+	PROGRESSESTIMATE peEstimate;
+	if (CHECK(EstimateWalkSize(GetSyntheticKeyHandle(lpRoot), PROGRESS_DEFAULT_SAMPLES_COUNT, &peEstimate)))
+	{
+		ULONGLONG ullCompletedKeys = 0;
+		double dCompletedEstimate = 0.0;
+
+		for (DWORD dwIndex = 0; dwIndex < peEstimate.dwBranchesCount; dwIndex++)
+		{
+			ullCompletedKeys += (ULONGLONG)peEstimate.lpdBranchKeys[dwIndex];
+			dCompletedEstimate += peEstimate.lpdBranchKeys[dwIndex];
+
+			ULONGLONG ullVisitedKeys = peEstimate.ullRootKeysCount + ullCompletedKeys;
+			CHECK(RefineWalkSize(&peEstimate, ullVisitedKeys, ullCompletedKeys, dCompletedEstimate) == dwTreeKeysCount);
+		}
+
+		FreeProgressEstimate(&peEstimate);
+	}
+
+	FreeSyntheticTree(lpRoot);
+	SetRegBackend(GetWin32Backend());
+}
+
+/// <summary>
+///		Check walk size estimate of --progress against synthetic trees
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestUniformTreeExact();
+	TestEmptyKey();
+	TestRefineWalkSize();
+	TestRefineDuringWalk();
+
+	return FinishTests("ProgressTests");
+}
@@ -0,0 +1,263 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Api/RegistryEditor.h"
+#include "../Api/QueryServer.h"
+#include "../Api/SyntheticTree.h"
+#include "TestCheck.h"
+
+const DWORD TEST_PIPE_NAME_LENGTH = 64;
+const DWORD TEST_QUERIES_COUNT = 8;
+const char TEST_RESULT[] = "Ok!";
+
+// Query processor has no context argument
+static HKEY g_hTestRoot = NULL;
+static volatile LONG g_lProcessedCount = 0;
+static volatile LONG g_lLastArgumentsCount = 0;
+
+/// <summary>
+///		Free list of key paths
+/// </summary>
+///
+/// <returns>void</returns>
+static void FreeTestKeys(LPWSTR* lpsKeys, DWORD dwKeysCount)
+{
+	for (DWORD dwIndex = 0; (lpsKeys != NULL) && (dwIndex < dwKeysCount); dwIndex++)
+	{
+		free(lpsKeys[dwIndex]);
+	}
+	free(lpsKeys);
+}
+
+/// <summary>
+///		Answer LIST with all key paths of served tree, ARGS with arguments count
+/// </summary>
+///
+/// <returns>LPCSTR (NULL if command is unknown)</returns>
+static LPCSTR ProcessTestQuery(char** argv, int argc)
+{
+	InterlockedIncrement(&g_lProcessedCount);
+	InterlockedExchange(&g_lLastArgumentsCount, argc);
+
+	if ((argc >= 2) && (strcmp(argv[1], "ARGS") == 0))
+	{
+		return TEST_RESULT;
+	}
+
+	if ((argc < 2) || (strcmp(argv[1], "LIST") != 0))
+	{
+		return NULL;
+	}
+
+	DWORD dwKeysCount = 0;
+	LPWSTR* lpsKeyNames = SearchRecursive(g_hTestRoot, L"", &dwKeysCount);
+	if (lpsKeyNames == NULL)
+	{
+		return "Error!";
+	}
+
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+	{
+		OutputWPrintf(L"%ls\n", lpsKeyNames[dwKeyIndex]);
+	}
+
+	FreeTestKeys(lpsKeyNames, dwKeysCount);
+	return TEST_RESULT;
+}
+
+/// <summary>
+///		Start server on pipe name unique for test
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool StartTestServer(LPCSTR lpsSuffix, LPSTR lpsPipeName, QUERYSERVER* lpServer)
+{
+	sprintf_s(lpsPipeName, TEST_PIPE_NAME_LENGTH, "RegistryEditorTests%u%s", GetCurrentProcessId(), lpsSuffix);
+
+	return StartQueryServer(lpsPipeName, ProcessTestQuery, lpServer);
+}
+
+/// <summary>
+///		Read size prefixed message of server
+/// </summary>
+///
+/// <returns>LPSTR (NULL on failure, free with free)</returns>
+static LPSTR ReadTestMessage(HANDLE hPipe, DWORD* lpcbData)
+{
+	DWORD cbRead;
+	if (!ReadFile(hPipe, lpcbData, sizeof(DWORD), &cbRead, NULL) || (cbRead != sizeof(DWORD)))
+	{
+		return NULL;
+	}
+
+	LPSTR lpsData = (LPSTR)malloc(*lpcbData + 1);
+	DWORD cbTotal = 0;
+	for (; (lpsData != NULL) && (cbTotal < *lpcbData); cbTotal += cbRead)
+	{
+		if (!ReadFile(hPipe, lpsData + cbTotal, *lpcbData - cbTotal, &cbRead, NULL) || (cbRead == 0))
+		{
+			break;
+		}
+	}
+
+	if ((lpsData != NULL) && (cbTotal != *lpcbData))
+	{
+		free(lpsData);
+		return NULL;
+	}
+
+	return lpsData;
+}
+
+/// <summary>
+///		Every LIST response over pipe lists all keys of synthetic tree
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestListOverPipe()
+{
+	SYNTHETICTREEPARAMS stpParams;
+	GetDefaultSyntheticTreeParams(&stpParams);
+	stpParams.dwDepth = 3;
+	stpParams.dwFanOut = 4;
+
+	DWORD dwTreeKeysCount;
+	SYNTHETICKEY* lpRoot = GenerateSyntheticTree(&stpParams, &dwTreeKeysCount);
+	if (!CHECK(lpRoot != NULL))
+	{
+		return;
+	}
+
+	SetRegBackend(GetSyntheticBackend());
+	g_hTestRoot = GetSyntheticKeyHandle(lpRoot);
+
+	DWORD dwKeysCount = 0;
+	LPWSTR* lpsKeyNames = SearchRecursive(g_hTestRoot, L"", &dwKeysCount);
+	CHECK((lpsKeyNames != NULL) && (dwKeysCount != 0));
+	FreeTestKeys(lpsKeyNames, dwKeysCount);
+
+	CHAR lpsPipeName[TEST_PIPE_NAME_LENGTH];
+	QUERYSERVER qsServer;
+	if (CHECK(StartTestServer("List", lpsPipeName, &qsServer)))
+	{
+		char lpsCommand[] = "LIST";
+		char* argv[] = { lpsCommand };
+		OUTPUTBUFFER obResponse;
+		ZeroMemory(&obResponse, sizeof(OUTPUTBUFFER));
+		CHAR lpsResult[QUERY_MAX_RESULT_LENGTH];
+
+		for (DWORD dwQueryIndex = 0; dwQueryIndex < TEST_QUERIES_COUNT; dwQueryIndex++)
+		{
+			DWORD dwLinesCount = 0;
+			if (!CHECK(SendQuery(lpsPipeName, argv, 1, &obResponse, lpsResult, QUERY_MAX_RESULT_LENGTH)))
+			{
+				break;
+			}
+
+			for (DWORD dwOffset = 0; dwOffset < obResponse.cbSize; dwOffset++)
+			{
+				dwLinesCount += (obResponse.lpsData[dwOffset] == '\n') ? 1 : 0;
+			}
+
+			CHECK(strcmp(lpsResult, TEST_RESULT) == 0);
+			CHECK(dwLinesCount == dwKeysCount);
+		}
+
+		// Unknown command has empty result
+		char lpsUnknown[] = "UNKNOWN";
+		argv[0] = lpsUnknown;
+		CHECK(SendQuery(lpsPipeName, argv, 1, &obResponse, lpsResult, QUERY_MAX_RESULT_LENGTH) && (lpsResult[0] == '\0'));
+
+		StopQueryServer(&qsServer);
+		FreeOutputBuffer(&obResponse);
+	}
+
+	SetRegBackend(GetWin32Backend());
+	FreeSyntheticTree(lpRoot);
+}
+
+/// <summary>
+///		QUERY_MAX_ARGUMENTS arguments reach processor, one more is rejected by client,
+///		and by server when client does not check
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestArgumentsLimit()
+{
+	CHAR lpsPipeName[TEST_PIPE_NAME_LENGTH];
+	QUERYSERVER qsServer;
+	if (!CHECK(StartTestServer("Args", lpsPipeName, &qsServer)))
+	{
+		return;
+	}
+
+	char lpsCommand[] = "ARGS";
+	char lpsArgument[] = "x";
+	char* argv[QUERY_MAX_ARGUMENTS + 1];
+	argv[0] = lpsCommand;
+	for (DWORD dwIndex = 1; dwIndex <= QUERY_MAX_ARGUMENTS; dwIndex++)
+	{
+		argv[dwIndex] = lpsArgument;
+	}
+
+	OUTPUTBUFFER obResponse;
+	ZeroMemory(&obResponse, sizeof(OUTPUTBUFFER));
+	CHAR lpsResult[QUERY_MAX_RESULT_LENGTH];
+
+	// argv of processor starts with program name
+	CHECK(SendQuery(lpsPipeName, argv, QUERY_MAX_ARGUMENTS, &obResponse, lpsResult, QUERY_MAX_RESULT_LENGTH));
+	CHECK(strcmp(lpsResult, TEST_RESULT) == 0);
+	CHECK(g_lLastArgumentsCount == (LONG)QUERY_MAX_ARGUMENTS + 1);
+	CHECK(!SendQuery(lpsPipeName, argv, QUERY_MAX_ARGUMENTS + 1, &obResponse, lpsResult, QUERY_MAX_RESULT_LENGTH));
+	FreeOutputBuffer(&obResponse);
+
+	// Request framed by hand with one argument over limit
+	WCHAR lpsFullPipeName[MAX_PATH];
+	swprintf(lpsFullPipeName, MAX_PATH, L"\\\\.\\pipe\\%hs", lpsPipeName);
+	HANDLE hPipe = CreateFileW(lpsFullPipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+	if (CHECK(hPipe != INVALID_HANDLE_VALUE))
+	{
+		CHAR lpsRequest[2 * (QUERY_MAX_ARGUMENTS + 1)];
+		DWORD cbRequest = 0;
+		for (DWORD dwIndex = 0; dwIndex <= QUERY_MAX_ARGUMENTS; dwIndex++)
+		{
+			lpsRequest[cbRequest++] = 'x';
+			lpsRequest[cbRequest++] = '\0';
+		}
+
+		LONG lProcessedBefore = g_lProcessedCount;
+		DWORD cbWritten;
+		CHECK(WriteFile(hPipe, &cbRequest, sizeof(DWORD), &cbWritten, NULL) && WriteFile(hPipe, lpsRequest, cbRequest, &cbWritten, NULL));
+
+		DWORD cbOutput = 0;
+		DWORD cbResult = 0;
+		LPSTR lpsOutput = ReadTestMessage(hPipe, &cbOutput);
+		LPSTR lpsServerResult = ReadTestMessage(hPipe, &cbResult);
+
+		CHECK((lpsOutput != NULL) && (cbOutput == 0));
+		CHECK((lpsServerResult != NULL) && (cbResult == sizeof(QUERY_TOO_MANY_ARGUMENTS)) && (strcmp(lpsServerResult, QUERY_TOO_MANY_ARGUMENTS) == 0));
+		CHECK(g_lProcessedCount == lProcessedBefore);
+
+		free(lpsOutput);
+		free(lpsServerResult);
+		CloseHandle(hPipe);
+	}
+
+	StopQueryServer(&qsServer);
+}
+
+/// <summary>
+///		Check query server over named pipes
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestListOverPipe();
+	TestArgumentsLimit();
+
+	return FinishTests("QueryServerTests");
+}
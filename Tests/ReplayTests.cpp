@@ -0,0 +1,436 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Api/RegistryEditor.h"
+#include "../Api/RegistryReplay.h"
+#include "../Api/SyntheticTree.h"
+#include "TestCheck.h"
+
+const DWORD TEST_TRACE_CAPACITY = 1024;
+const DWORD TEST_NAME_LENGTH = 256;
+const DWORD TEST_DATA_SIZE = 1024;
+const ULONGLONG TEST_HASH_INITIAL_VALUE = 14695981039346656037ull;
+const ULONGLONG TEST_HASH_PRIME = 1099511628211ull;
+
+// Trace bytes written by hand, independent of recording side
+typedef struct _TESTTRACE {
+	BYTE lpbData[TEST_TRACE_CAPACITY];
+	DWORD cbSize;
+} TESTTRACE;
+
+/// <summary>
+///		Append LEB128 number to trace
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteTestNumber(TESTTRACE* lpTrace, ULONGLONG ullValue)
+{
+	do
+	{
+		BYTE bPart = (BYTE)(ullValue & 0x7F);
+		ullValue >>= 7;
+		lpTrace->lpbData[lpTrace->cbSize++] = (ullValue != 0) ? (bPart | 0x80) : bPart;
+	} while (ullValue != 0);
+}
+
+/// <summary>
+///		Append size and bytes to trace, strings of test are ASCII so they are UTF-8 too
+/// </summary>
+///
+/// <returns>void</returns>
+static void WriteTestBytes(TESTTRACE* lpTrace, const void* lpData, DWORD cbData)
+{
+	WriteTestNumber(lpTrace, cbData);
+	memcpy(lpTrace->lpbData + lpTrace->cbSize, lpData, cbData);
+	lpTrace->cbSize += cbData;
+}
+
+/// <summary>
+///		Write trace to new temporary file
+/// </summary>
+///
+/// <param name="lpsFileName">Buffer of MAX_PATH characters for file name</param>
+///
+/// <returns>bool</returns>
+static bool SaveTestTrace(const TESTTRACE* lpTrace, LPSTR lpsFileName)
+{
+	CHAR lpsTempPath[MAX_PATH];
+	if ((GetTempPathA(MAX_PATH, lpsTempPath) == 0) || (GetTempFileNameA(lpsTempPath, "rrt", 0, lpsFileName) == 0))
+	{
+		return false;
+	}
+
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "wb") != 0)
+	{
+		return false;
+	}
+
+	bool bResult = fwrite(lpTrace->lpbData, 1, lpTrace->cbSize, lpFile) == lpTrace->cbSize;
+	return (fclose(lpFile) == 0) && bResult;
+}
+
+/// <summary>
+///		Load trace through temporary file
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool LoadTestTrace(const TESTTRACE* lpTrace)
+{
+	CHAR lpsFileName[MAX_PATH];
+	if (!SaveTestTrace(lpTrace, lpsFileName))
+	{
+		return false;
+	}
+
+	bool bResult = LoadRegReplay(lpsFileName, false);
+	DeleteFileA(lpsFileName);
+
+	return bResult;
+}
+
+/// <summary>
+///		Build trace of HKEY_LOCAL_MACHINE\SOFTWARE\Test with one subkey, string value
+///		that has character above BMP and DWORD value queried by name
+/// </summary>
+///
+/// <returns>void</returns>
+static void BuildTestTrace(TESTTRACE* lpTrace)
+{
+	// "A", U+1F600 as surrogate pair and terminating null in UTF-16LE
+	const BYTE lpbPath[] = { 'A', 0, 0x3D, 0xD8, 0x00, 0xDE, 0, 0 };
+	const BYTE lpbVersion[] = { 7, 0, 0, 0 };
+
+	lpTrace->cbSize = 0;
+	WriteTestNumber(lpTrace, REPLAY_MAGIC);
+	WriteTestNumber(lpTrace, REPLAY_VERSION);
+
+	// Key 0 is root, key 1 is its subkey (parent is stored plus one)
+	WriteTestNumber(lpTrace, REPLAY_RECORD_KEY);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestBytes(lpTrace, "HKEY_LOCAL_MACHINE", 18);
+	WriteTestNumber(lpTrace, REPLAY_RECORD_KEY);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestBytes(lpTrace, "SOFTWARE\\Test", 13);
+
+	WriteTestNumber(lpTrace, REPLAY_RECORD_OPEN);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, ERROR_SUCCESS);
+	WriteTestNumber(lpTrace, 0);
+
+	WriteTestNumber(lpTrace, REPLAY_RECORD_QUERY_INFO);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, ERROR_SUCCESS);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, 5);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, 4);
+	WriteTestNumber(lpTrace, sizeof(lpbPath));
+	WriteTestNumber(lpTrace, 0x01D0000000000001ull);
+
+	WriteTestNumber(lpTrace, REPLAY_RECORD_ENUM_KEY);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestNumber(lpTrace, ERROR_SUCCESS);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestBytes(lpTrace, "Child", 5);
+	WriteTestNumber(lpTrace, 42);
+
+	WriteTestNumber(lpTrace, REPLAY_RECORD_ENUM_KEY);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, ERROR_NO_MORE_ITEMS);
+	WriteTestNumber(lpTrace, 0);
+
+	WriteTestNumber(lpTrace, REPLAY_RECORD_ENUM_VALUE);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestNumber(lpTrace, ERROR_SUCCESS);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestNumber(lpTrace, REPLAY_HAS_NAME | REPLAY_HAS_TYPE | REPLAY_HAS_SIZE | REPLAY_HAS_DATA);
+	WriteTestBytes(lpTrace, "Path", 4);
+	WriteTestNumber(lpTrace, REG_SZ);
+	WriteTestBytes(lpTrace, lpbPath, sizeof(lpbPath));
+
+	WriteTestNumber(lpTrace, REPLAY_RECORD_QUERY_VALUE);
+	WriteTestNumber(lpTrace, 1);
+	WriteTestNumber(lpTrace, ERROR_SUCCESS);
+	WriteTestNumber(lpTrace, 0);
+	WriteTestNumber(lpTrace, REPLAY_HAS_NAME | REPLAY_HAS_TYPE | REPLAY_HAS_SIZE | REPLAY_HAS_DATA);
+	WriteTestBytes(lpTrace, "Version", 7);
+	WriteTestNumber(lpTrace, REG_DWORD);
+	WriteTestBytes(lpTrace, lpbVersion, sizeof(lpbVersion));
+}
+
+/// <summary>
+///		Serve hand written trace through replay backend
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestServeTrace()
+{
+	TESTTRACE ttTrace;
+	BuildTestTrace(&ttTrace);
+
+	if (!CHECK(LoadTestTrace(&ttTrace)))
+	{
+		return;
+	}
+
+	const REGBACKEND* lpBackend = GetReplayBackend();
+
+	// Paths are matched case insensitively
+	HKEY hKey = NULL;
+	if (!CHECK(lpBackend->lpfnOpenKey(HKEY_LOCAL_MACHINE, L"software\\TEST", KEY_READ, &hKey) == ERROR_SUCCESS))
+	{
+		FreeRegReplay();
+		return;
+	}
+
+	DWORD dwSubKeysCount = 0, dwMaxSubKeyLength = 0, dwValuesCount = 0;
+	FILETIME ftLastWriteTime = { 0, 0 };
+	CHECK(lpBackend->lpfnQueryInfoKey(hKey, &dwSubKeysCount, &dwMaxSubKeyLength, &dwValuesCount, NULL, NULL, &ftLastWriteTime) == ERROR_SUCCESS);
+	CHECK((dwSubKeysCount == 1) && (dwMaxSubKeyLength == 5) && (dwValuesCount == 1));
+	CHECK((ftLastWriteTime.dwHighDateTime == 0x01D00000) && (ftLastWriteTime.dwLowDateTime == 1));
+
+	WCHAR lpsName[TEST_NAME_LENGTH];
+	DWORD cchName = TEST_NAME_LENGTH;
+	CHECK(lpBackend->lpfnEnumKey(hKey, 0, lpsName, &cchName, &ftLastWriteTime) == ERROR_SUCCESS);
+	CHECK((cchName == 5) && (wcscmp(lpsName, L"Child") == 0) && (ftLastWriteTime.dwLowDateTime == 42));
+
+	cchName = 3;
+	CHECK(lpBackend->lpfnEnumKey(hKey, 0, lpsName, &cchName, NULL) == ERROR_MORE_DATA);
+
+	cchName = TEST_NAME_LENGTH;
+	CHECK(lpBackend->lpfnEnumKey(hKey, 1, lpsName, &cchName, NULL) == ERROR_NO_MORE_ITEMS);
+
+	// UTF-16LE data of trace is served as wide string of this platform
+	const WCHAR lpsExpectedPath[] = L"A\U0001F600";
+	BYTE lpData[TEST_DATA_SIZE];
+	DWORD dwType = REG_NONE, cbData = TEST_DATA_SIZE;
+	cchName = TEST_NAME_LENGTH;
+	CHECK(lpBackend->lpfnEnumValue(hKey, 0, lpsName, &cchName, &dwType, lpData, &cbData) == ERROR_SUCCESS);
+	CHECK((wcscmp(lpsName, L"Path") == 0) && (dwType == REG_SZ));
+	CHECK((cbData == sizeof(lpsExpectedPath)) && (memcmp(lpData, lpsExpectedPath, sizeof(lpsExpectedPath)) == 0));
+
+	cbData = 1;
+	cchName = TEST_NAME_LENGTH;
+	CHECK(lpBackend->lpfnEnumValue(hKey, 0, lpsName, &cchName, NULL, lpData, &cbData) == ERROR_MORE_DATA);
+	CHECK(cbData == sizeof(lpsExpectedPath));
+
+	cchName = TEST_NAME_LENGTH;
+	CHECK(lpBackend->lpfnEnumValue(hKey, 1, lpsName, &cchName, NULL, NULL, NULL) == ERROR_NO_MORE_ITEMS);
+
+	DWORD dwVersion = 0;
+	cbData = sizeof(DWORD);
+	CHECK(lpBackend->lpfnQueryValue(hKey, L"VERSION", &dwType, (LPBYTE)&dwVersion, &cbData) == ERROR_SUCCESS);
+	CHECK((dwType == REG_DWORD) && (cbData == sizeof(DWORD)) && (dwVersion == 7));
+
+	CHECK(GetReplayMissesCount() == 0);
+
+	// Calls missing in trace fail and are counted
+	HKEY hMissingKey = NULL;
+	CHECK(lpBackend->lpfnQueryValue(hKey, L"Missing", NULL, NULL, NULL) == ERROR_FILE_NOT_FOUND);
+	CHECK(lpBackend->lpfnOpenKey(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Other", KEY_READ, &hMissingKey) == ERROR_FILE_NOT_FOUND);
+	CHECK(lpBackend->lpfnOpenKey(HKEY_CURRENT_USER, L"SOFTWARE\\Test", KEY_READ, &hMissingKey) == ERROR_FILE_NOT_FOUND);
+	CHECK(GetReplayMissesCount() == 3);
+
+	CHECK(lpBackend->lpfnCloseKey(hKey) == ERROR_SUCCESS);
+	CHECK(lpBackend->lpfnCloseKey((HKEY)&hKey) == ERROR_INVALID_HANDLE);
+
+	FreeRegReplay();
+	CHECK(GetReplayMissesCount() == 0);
+}
+
+/// <summary>
+///		Reject traces with wrong header, cut records and undefined key ids
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestRejectMalformedTrace()
+{
+	TESTTRACE ttTrace;
+
+	BuildTestTrace(&ttTrace);
+	ttTrace.lpbData[0] ^= 1;
+	CHECK(!LoadTestTrace(&ttTrace));
+
+	// Every cut inside last record leaves it incomplete
+	BuildTestTrace(&ttTrace);
+	DWORD cbFullSize = ttTrace.cbSize;
+	for (DWORD cbCut = 1; cbCut < 4; cbCut++)
+	{
+		ttTrace.cbSize = cbFullSize - cbCut;
+		CHECK(!LoadTestTrace(&ttTrace));
+	}
+
+	ttTrace.cbSize = 0;
+	CHECK(!LoadTestTrace(&ttTrace));
+
+	// Open of key 5 that was never defined
+	BuildTestTrace(&ttTrace);
+	WriteTestNumber(&ttTrace, REPLAY_RECORD_OPEN);
+	WriteTestNumber(&ttTrace, 5);
+	WriteTestNumber(&ttTrace, ERROR_SUCCESS);
+	WriteTestNumber(&ttTrace, 0);
+	CHECK(!LoadTestTrace(&ttTrace));
+
+	// Unknown record type
+	BuildTestTrace(&ttTrace);
+	WriteTestNumber(&ttTrace, 99);
+	CHECK(!LoadTestTrace(&ttTrace));
+
+	CHECK(GetReplayUnknownRoot() == NULL);
+}
+
+/// <summary>
+///		Hash names, types and data of values of every key in list
+/// </summary>
+///
+/// <returns>ULONGLONG (0 if any call failed)</returns>
+static ULONGLONG HashTreeValues(HKEY hRoot, LPWSTR* lpsKeyNames, DWORD dwKeysCount)
+{
+	const REGBACKEND* lpBackend = GetRegBackend();
+	ULONGLONG ullHash = TEST_HASH_INITIAL_VALUE;
+
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+	{
+		HKEY hKey;
+		if (lpBackend->lpfnOpenKey(hRoot, lpsKeyNames[dwKeyIndex], KEY_READ, &hKey) != ERROR_SUCCESS)
+		{
+			return 0;
+		}
+
+		LSTATUS lStatus = ERROR_SUCCESS;
+		for (DWORD dwIndex = 0; lStatus == ERROR_SUCCESS; dwIndex++)
+		{
+			WCHAR lpsName[TEST_NAME_LENGTH];
+			BYTE lpData[TEST_DATA_SIZE];
+			DWORD cchName = TEST_NAME_LENGTH, dwType = REG_NONE, cbData = TEST_DATA_SIZE;
+
+			lStatus = lpBackend->lpfnEnumValue(hKey, dwIndex, lpsName, &cchName, &dwType, lpData, &cbData);
+			if (lStatus != ERROR_SUCCESS)
+			{
+				break;
+			}
+
+			const BYTE* lpbParts[] = { (const BYTE*)lpsName, (const BYTE*)&dwType, lpData };
+			const DWORD cbParts[] = { cchName * (DWORD)sizeof(WCHAR), sizeof(DWORD), cbData };
+			for (DWORD dwPart = 0; dwPart < 3; dwPart++)
+			{
+				for (DWORD dwByte = 0; dwByte < cbParts[dwPart]; dwByte++)
+				{
+					ullHash = (ullHash ^ lpbParts[dwPart][dwByte]) * TEST_HASH_PRIME;
+				}
+			}
+		}
+
+		lpBackend->lpfnCloseKey(hKey);
+
+		if (lStatus != ERROR_NO_MORE_ITEMS)
+		{
+			return 0;
+		}
+	}
+
+	return ullHash;
+}
+
+/// <summary>
+///		Record walk of synthetic tree, replay has to give the same keys and values without misses
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestRecordReplayRoundTrip()
+{
+	SYNTHETICTREEPARAMS stpParams;
+	GetDefaultSyntheticTreeParams(&stpParams);
+	stpParams.dwFanOut = 4;
+	stpParams.dwDepth = 3;
+	stpParams.dwValuesPerKey = 3;
+
+	DWORD dwTreeKeysCount = 0;
+	SYNTHETICKEY* lpRoot = GenerateSyntheticTree(&stpParams, &dwTreeKeysCount);
+	if (!CHECK(lpRoot != NULL))
+	{
+		return;
+	}
+
+	SetRegBackend(GetSyntheticBackend());
+	HKEY hRoot = GetSyntheticKeyHandle(lpRoot);
+
+	CHAR lpsTempPath[MAX_PATH];
+	CHAR lpsFileName[MAX_PATH];
+	CHECK((GetTempPathA(MAX_PATH, lpsTempPath) != 0) && (GetTempFileNameA(lpsTempPath, "rrp", 0, lpsFileName) != 0));
+
+	// Recording wraps synthetic backend, tree root is recorded as unknown root
+	DWORD dwKeysCount = 0;
+	LPWSTR* lpsKeyNames = NULL;
+	ULONGLONG ullValuesHash = 0;
+
+	if (CHECK(StartRegRecording(lpsFileName)))
+	{
+		lpsKeyNames = SearchRecursive(hRoot, L"", &dwKeysCount);
+		ullValuesHash = HashTreeValues(hRoot, lpsKeyNames, dwKeysCount);
+		CHECK(StopRegRecording());
+	}
+
+	CHECK((lpsKeyNames != NULL) && (dwKeysCount + 1 >= dwTreeKeysCount));
+	CHECK(ullValuesHash != 0);
+
+	bool bLoaded = CHECK(LoadRegReplay(lpsFileName, false));
+	DeleteFileA(lpsFileName);
+
+	HKEY hReplayRoot = GetReplayUnknownRoot();
+	if (bLoaded && CHECK(hReplayRoot != NULL))
+	{
+		SetRegBackend(GetReplayBackend());
+
+		DWORD dwReplayedCount = 0;
+		LPWSTR* lpsReplayedKeys = SearchRecursive(hReplayRoot, L"", &dwReplayedCount);
+
+		CHECK(dwReplayedCount == dwKeysCount);
+		DWORD dwMismatchesCount = 0;
+		for (DWORD dwKeyIndex = 0; (dwKeyIndex < dwReplayedCount) && (dwKeyIndex < dwKeysCount); dwKeyIndex++)
+		{
+			dwMismatchesCount += (wcscmp(lpsReplayedKeys[dwKeyIndex], lpsKeyNames[dwKeyIndex]) != 0) ? 1 : 0;
+		}
+		CHECK(dwMismatchesCount == 0);
+
+		CHECK(HashTreeValues(hReplayRoot, lpsReplayedKeys, dwReplayedCount) == ullValuesHash);
+		CHECK(GetReplayMissesCount() == 0);
+
+		for (DWORD dwKeyIndex = 0; dwKeyIndex < dwReplayedCount; dwKeyIndex++)
+		{
+			free(lpsReplayedKeys[dwKeyIndex]);
+		}
+		free(lpsReplayedKeys);
+	}
+
+	SetRegBackend(GetSyntheticBackend());
+	FreeRegReplay();
+
+	for (DWORD dwKeyIndex = 0; dwKeyIndex < dwKeysCount; dwKeyIndex++)
+	{
+		free(lpsKeyNames[dwKeyIndex]);
+	}
+	free(lpsKeyNames);
+	FreeSyntheticTree(lpRoot);
+}
+
+/// <summary>
+///		Check trace reader and replay backend against hand written traces and recorded synthetic tree
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestServeTrace();
+	TestRejectMalformedTrace();
+	TestRecordReplayRoundTrip();
+
+	return FinishTests("ReplayTests");
+}
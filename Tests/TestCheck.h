@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+// Each test program is one translation unit, failed checks are counted per program
+static DWORD g_dwFailedChecksCount = 0;
+
+#define CHECK(bCondition) CheckTest((bCondition), #bCondition, __FILE__, __LINE__)
+
+/// <summary>
+///		Report failed check and count it
+/// </summary>
+///
+/// <returns>bool (passed condition)</returns>
+static bool CheckTest(bool bCondition, LPCSTR lpsCondition, LPCSTR lpsFile, int iLine)
+{
+	if (!bCondition)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", lpsFile, iLine, lpsCondition);
+		g_dwFailedChecksCount++;
+	}
+
+	return bCondition;
+}
+
+/// <summary>
+///		Print summary of test program
+/// </summary>
+///
+/// <returns>int (exit code, 1 if any check failed)</returns>
+static int FinishTests(LPCSTR lpsName)
+{
+	printf("%s: %u failed checks\n", lpsName, g_dwFailedChecksCount);
+	return (g_dwFailedChecksCount == 0) ? 0 : 1;
+}
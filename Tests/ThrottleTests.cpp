@@ -0,0 +1,161 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/Throttle.h"
+#include "TestCheck.h"
+
+// Keys per second and CPU percent (0 is no limit)
+const DWORD TEST_BUDGETS[][2] = { { 2000, 0 }, { 20000, 0 }, { 0, 5 }, { 0, 20 }, { 5000, 25 } };
+const DWORD TEST_BUDGETS_COUNT = sizeof(TEST_BUDGETS) / sizeof(TEST_BUDGETS[0]);
+// Long enough for burst of bucket to be small part of achieved rate
+const ULONGLONG TEST_WALK_TIME = 10000000;
+const ULONGLONG TEST_IDLE_TIME = 10000000;
+
+/// <summary>
+///		Start throttle on simulated clock
+/// </summary>
+///
+/// <returns>void</returns>
+static void InitTestThrottle(DWORD dwKeysPerSecond, DWORD dwCpuPercent, SIMULATEDCLOCK* lpTime, THROTTLECLOCK* lpClock, THROTTLESTATE* lpState)
+{
+	THROTTLEPARAMS tpParams;
+
+	InitSimulatedClock(lpTime, lpClock);
+	GetDefaultThrottleParams(&tpParams);
+	tpParams.dwKeysPerSecond = dwKeysPerSecond;
+	tpParams.dwCpuPercent = dwCpuPercent;
+	InitThrottle(lpState, &tpParams, lpClock);
+}
+
+/// <summary>
+///		Walk that costs 1 us of wall and CPU time per key meets every budget
+///		within burst of the bucket and one batch
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestBudgetRates()
+{
+	for (DWORD dwBudgetIndex = 0; dwBudgetIndex < TEST_BUDGETS_COUNT; dwBudgetIndex++)
+	{
+		SIMULATEDCLOCK scTime;
+		THROTTLECLOCK tcClock;
+		THROTTLESTATE tsState;
+		DWORD dwKeysPerSecond = TEST_BUDGETS[dwBudgetIndex][0];
+		DWORD dwCpuPercent = TEST_BUDGETS[dwBudgetIndex][1];
+		InitTestThrottle(dwKeysPerSecond, dwCpuPercent, &scTime, &tcClock, &tsState);
+
+		DWORD dwBatchSize = tsState.tpParams.dwBatchSize;
+		ULONGLONG ullKeysCount = 0;
+		while (scTime.ullTime < TEST_WALK_TIME)
+		{
+			AdvanceSimulatedClock(&scTime, dwBatchSize, dwBatchSize);
+			tcClock.lpfnSleep(tcClock.lpContext, ConsumeThrottleBudget(&tsState, dwBatchSize));
+			ullKeysCount += dwBatchSize;
+		}
+
+		// Unpaced walk does 1 key per us, CPU budget allows its share of that
+		double dExpectedRate = 1e6;
+		if ((dwKeysPerSecond != 0) && (dwKeysPerSecond < dExpectedRate))
+		{
+			dExpectedRate = dwKeysPerSecond;
+		}
+		if ((dwCpuPercent != 0) && (dwCpuPercent * 1e4 < dExpectedRate))
+		{
+			dExpectedRate = dwCpuPercent * 1e4;
+		}
+
+		double dSeconds = scTime.ullTime / 1e6;
+		double dRate = ullKeysCount / dSeconds;
+		double dMiss = ((dRate > dExpectedRate) ? dRate - dExpectedRate : dExpectedRate - dRate) / dExpectedRate;
+		double dTolerance = THROTTLE_BURST_MILLISECONDS / 1000.0 / dSeconds + (double)dwBatchSize / ullKeysCount;
+
+		if (!CHECK(dMiss <= dTolerance))
+		{
+			fprintf(stderr, "budget %u keys/s, %u%% CPU: %.1f keys/s, expected %.1f\n", dwKeysPerSecond, dwCpuPercent, dRate, dExpectedRate);
+		}
+
+		if (dwCpuPercent != 0)
+		{
+			CHECK(scTime.ullCpuTime * 100.0 / scTime.ullTime <= dwCpuPercent * (1.0 + dTolerance));
+		}
+
+		CHECK(tsState.ullKeysCount == ullKeysCount);
+		CHECK(tsState.ullDelayedTime == scTime.ullSleptTime);
+	}
+}
+
+/// <summary>
+///		Walk without budget is never delayed
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestNoBudgetNoDelay()
+{
+	SIMULATEDCLOCK scTime;
+	THROTTLECLOCK tcClock;
+	THROTTLESTATE tsState;
+	InitTestThrottle(0, 0, &scTime, &tcClock, &tsState);
+
+	ULONGLONG ullDelay = 0;
+	for (DWORD dwBatchIndex = 0; dwBatchIndex < 1000; dwBatchIndex++)
+	{
+		AdvanceSimulatedClock(&scTime, 1, 1);
+		ullDelay += ConsumeThrottleBudget(&tsState, tsState.tpParams.dwBatchSize);
+	}
+
+	CHECK(ullDelay == 0);
+	CHECK(tsState.ullDelayedTime == 0);
+}
+
+/// <summary>
+///		Bucket starts empty, so the first batch already waits its full share
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestFirstBatchPaced()
+{
+	SIMULATEDCLOCK scTime;
+	THROTTLECLOCK tcClock;
+	THROTTLESTATE tsState;
+	InitTestThrottle(1000, 0, &scTime, &tcClock, &tsState);
+
+	// 64 keys at 1000 keys/s take 64 ms
+	ULONGLONG ullDelay = ConsumeThrottleBudget(&tsState, 64);
+	CHECK((ullDelay >= 63999) && (ullDelay <= 64000));
+}
+
+/// <summary>
+///		Idle time refills bucket only up to burst, keys past it wait again
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestIdleRefillLimited()
+{
+	SIMULATEDCLOCK scTime;
+	THROTTLECLOCK tcClock;
+	THROTTLESTATE tsState;
+	InitTestThrottle(1000, 0, &scTime, &tcClock, &tsState);
+
+	DWORD dwBurstKeys = 1000 * THROTTLE_BURST_MILLISECONDS / 1000;
+	AdvanceSimulatedClock(&scTime, TEST_IDLE_TIME, 0);
+
+	CHECK(ConsumeThrottleBudget(&tsState, dwBurstKeys) == 0);
+
+	ULONGLONG ullDelay = ConsumeThrottleBudget(&tsState, 64);
+	CHECK((ullDelay >= 63999) && (ullDelay <= 64000));
+}
+
+/// <summary>
+///		Check token bucket pacing of --budget on simulated clock
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestBudgetRates();
+	TestNoBudgetNoDelay();
+	TestFirstBatchPaced();
+	TestIdleRefillLimited();
+
+	return FinishTests("ThrottleTests");
+}
@@ -0,0 +1,243 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Api/Trace.h"
+#include "TestCheck.h"
+
+const DWORD TEST_WRITERS_COUNT = 4;
+const DWORD TEST_SESSIONS_COUNT = 5;
+const DWORD TEST_FILE_SIZE_LIMIT = 64 * 1024 * 1024;
+
+// Writers record spans until they are stopped, trace is started and flushed under them
+typedef struct _TRACEWRITER {
+	volatile bool* lpbStopping;
+	volatile LONGLONG llSpansCount;
+} TRACEWRITER;
+
+/// <summary>
+///		Read whole trace file as string
+/// </summary>
+///
+/// <returns>LPSTR (NULL on failure, free with free)</returns>
+static LPSTR ReadTestFile(LPCSTR lpsFileName)
+{
+	FILE* lpFile;
+	if (fopen_s(&lpFile, lpsFileName, "rb") != 0)
+	{
+		return NULL;
+	}
+
+	LPSTR lpsData = (LPSTR)malloc(TEST_FILE_SIZE_LIMIT + 1);
+	if (lpsData != NULL)
+	{
+		size_t cbRead = fread(lpsData, 1, TEST_FILE_SIZE_LIMIT, lpFile);
+		lpsData[cbRead] = '\0';
+	}
+
+	fclose(lpFile);
+	return lpsData;
+}
+
+/// <summary>
+///		Count occurrences of text
+/// </summary>
+///
+/// <returns>DWORD</returns>
+static DWORD CountText(LPCSTR lpsData, LPCSTR lpsText)
+{
+	DWORD dwCount = 0;
+	for (LPCSTR lpsFound = strstr(lpsData, lpsText); lpsFound != NULL; lpsFound = strstr(lpsFound + 1, lpsText))
+	{
+		dwCount++;
+	}
+
+	return dwCount;
+}
+
+/// <summary>
+///		Create name of temporary trace file
+/// </summary>
+///
+/// <returns>bool</returns>
+static bool GetTestFileName(LPSTR lpsFileName)
+{
+	CHAR lpsTempPath[MAX_PATH];
+
+	return (GetTempPathA(MAX_PATH, lpsTempPath) != 0) && (GetTempFileNameA(lpsTempPath, "trc", 0, lpsFileName) != 0);
+}
+
+/// <summary>
+///		Status of failed call is written, successful one has none;
+///		long argument keeps its tail and never starts with second half of surrogate pair
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestSpanDetails()
+{
+	CHAR lpsFileName[MAX_PATH];
+	if (!CHECK(GetTestFileName(lpsFileName)) || !CHECK(StartTrace(lpsFileName, 0)))
+	{
+		return;
+	}
+
+	// Tail of TRACE_ARGUMENT_LENGTH - 2 units starts at low surrogate of U+1F600
+	WCHAR lpsArgument[TRACE_ARGUMENT_LENGTH + 16];
+	DWORD cchArgument = 0;
+	while (cchArgument < 16)
+	{
+		lpsArgument[cchArgument++] = L'a';
+	}
+	lpsArgument[cchArgument++] = (WCHAR)0xD83D;
+	lpsArgument[cchArgument++] = (WCHAR)0xDE00;
+	for (DWORD dwIndex = 0; dwIndex < TRACE_ARGUMENT_LENGTH - 3; dwIndex++)
+	{
+		lpsArgument[cchArgument++] = L'b';
+	}
+	lpsArgument[cchArgument] = L'\0';
+
+	EndTraceSpanStatus("failed", "test", BeginTraceSpan(), L"SOFTWARE\\Denied", 5);
+	EndTraceSpan("done", "test", BeginTraceSpan(), L"SOFTWARE\\Allowed");
+	EndTraceSpan("long", "test", BeginTraceSpan(), lpsArgument);
+	CHECK(FlushTrace());
+
+	LPSTR lpsTrace = ReadTestFile(lpsFileName);
+	if (CHECK(lpsTrace != NULL))
+	{
+		CHECK(strstr(lpsTrace, "\"detail\":\"SOFTWARE\\\\Denied\",\"status\":5}") != NULL);
+		CHECK(strstr(lpsTrace, "\"detail\":\"SOFTWARE\\\\Allowed\"}") != NULL);
+		CHECK(CountText(lpsTrace, "\"status\"") == 1);
+
+		// Ellipsis is followed by whole characters only
+		CHAR lpsExpected[TRACE_ARGUMENT_LENGTH + 32] = "\"detail\":\"\xE2\x80\xA6";
+		size_t cchExpected = strlen(lpsExpected);
+		for (DWORD dwIndex = 0; dwIndex < TRACE_ARGUMENT_LENGTH - 3; dwIndex++)
+		{
+			lpsExpected[cchExpected++] = 'b';
+		}
+		lpsExpected[cchExpected++] = '"';
+		lpsExpected[cchExpected] = '\0';
+		CHECK(strstr(lpsTrace, lpsExpected) != NULL);
+
+		free(lpsTrace);
+	}
+
+	remove(lpsFileName);
+}
+
+/// <summary>
+///		Record spans without pause
+/// </summary>
+///
+/// <returns>DWORD</returns>
+static DWORD WINAPI RunTraceWriter(LPVOID lpParameter)
+{
+	TRACEWRITER* lpWriter = (TRACEWRITER*)lpParameter;
+
+	while (!*lpWriter->lpbStopping)
+	{
+		EndTraceSpan("span", "test", BeginTraceSpan(), L"SOFTWARE\\Writer");
+		lpWriter->llSpansCount++;
+	}
+
+	return 0;
+}
+
+/// <summary>
+///		Sessions are started and flushed while threads record spans; every flushed file is complete
+///		and holds no more spans than rings of writers can keep
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestFlushUnderWriters()
+{
+	volatile bool bStopping = false;
+	TRACEWRITER twWriters[TEST_WRITERS_COUNT];
+	HANDLE hThreads[TEST_WRITERS_COUNT];
+	DWORD dwThreadsCount = 0;
+
+	for (DWORD dwIndex = 0; dwIndex < TEST_WRITERS_COUNT; dwIndex++)
+	{
+		twWriters[dwIndex].lpbStopping = &bStopping;
+		twWriters[dwIndex].llSpansCount = 0;
+		hThreads[dwIndex] = CreateThread(NULL, 0, RunTraceWriter, &twWriters[dwIndex], 0, NULL);
+		dwThreadsCount += (hThreads[dwIndex] != NULL) ? 1 : 0;
+	}
+	CHECK(dwThreadsCount == TEST_WRITERS_COUNT);
+
+	CHAR lpsFileName[MAX_PATH];
+	CHECK(GetTestFileName(lpsFileName));
+
+	DWORD dwSessionsWithSpans = 0;
+	for (DWORD dwSession = 0; dwSession < TEST_SESSIONS_COUNT; dwSession++)
+	{
+		if (!CHECK(StartTrace(lpsFileName, 0)))
+		{
+			break;
+		}
+
+		Sleep(2);
+		CHECK(FlushTrace());
+
+		LPSTR lpsTrace = ReadTestFile(lpsFileName);
+		if (CHECK(lpsTrace != NULL))
+		{
+			size_t cchTrace = strlen(lpsTrace);
+			DWORD dwSpansCount = CountText(lpsTrace, "\"name\":\"span\"");
+
+			CHECK((cchTrace >= 4) && (strcmp(lpsTrace + cchTrace - 4, "\n]}\n") == 0));
+			CHECK(dwSpansCount <= TEST_WRITERS_COUNT * TRACE_RING_CAPACITY);
+			dwSessionsWithSpans += (dwSpansCount != 0) ? 1 : 0;
+
+			free(lpsTrace);
+		}
+	}
+
+	// Writers go on recording after last flush, those spans are dropped
+	LONGLONG llSpansBefore = twWriters[0].llSpansCount;
+	while (twWriters[0].llSpansCount == llSpansBefore)
+	{
+		Sleep(1);
+	}
+
+	bStopping = true;
+	for (DWORD dwIndex = 0; dwIndex < TEST_WRITERS_COUNT; dwIndex++)
+	{
+		if (hThreads[dwIndex] != NULL)
+		{
+			WaitForSingleObject(hThreads[dwIndex], INFINITE);
+			CloseHandle(hThreads[dwIndex]);
+		}
+	}
+
+	CHECK(dwSessionsWithSpans != 0);
+
+	// Rings of exited writers are freed by flush, new session does not see their old spans
+	if (CHECK(StartTrace(lpsFileName, 0)))
+	{
+		CHECK(FlushTrace());
+
+		LPSTR lpsTrace = ReadTestFile(lpsFileName);
+		if (CHECK(lpsTrace != NULL))
+		{
+			CHECK(CountText(lpsTrace, "\"name\":\"span\"") == 0);
+			free(lpsTrace);
+		}
+	}
+
+	remove(lpsFileName);
+}
+
+/// <summary>
+///		Check trace rings and their flush
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestSpanDetails();
+	TestFlushUnderWriters();
+
+	return FinishTests("TraceTests");
+}
@@ -0,0 +1,101 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "../Api/ValueCodec.h"
+#include "TestCheck.h"
+
+/// <summary>
+///		Encode number typed for DWORD
+/// </summary>
+///
+/// <returns>bool (false if text is rejected)</returns>
+static bool EncodeTestDword(LPCSTR lpsValue, DWORD* lpdwValue)
+{
+	REGVALUEBUFFER rvbBuffer;
+	InitValueBuffer(&rvbBuffer, NULL, 0);
+
+	if (!EncodeRegValue(REG_DWORD, lpsValue, &rvbBuffer) || (rvbBuffer.cbData != sizeof(DWORD)))
+	{
+		return false;
+	}
+
+	memcpy(lpdwValue, rvbBuffer.lpData, sizeof(DWORD));
+	return true;
+}
+
+/// <summary>
+///		Encode number typed for QWORD
+/// </summary>
+///
+/// <returns>bool (false if text is rejected)</returns>
+static bool EncodeTestQword(LPCSTR lpsValue, ULONGLONG* lpullValue)
+{
+	REGVALUEBUFFER rvbBuffer;
+	InitValueBuffer(&rvbBuffer, NULL, 0);
+
+	if (!EncodeRegValue(REG_QWORD, lpsValue, &rvbBuffer) || (rvbBuffer.cbData != sizeof(ULONGLONG)))
+	{
+		return false;
+	}
+
+	memcpy(lpullValue, rvbBuffer.lpData, sizeof(ULONGLONG));
+	return true;
+}
+
+/// <summary>
+///		Numbers are decimal even with leading zero, hex only behind 0x or 0X
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestNumberBase()
+{
+	DWORD dwValue = 0;
+
+	CHECK(EncodeTestDword("10", &dwValue) && (dwValue == 10));
+	CHECK(EncodeTestDword("010", &dwValue) && (dwValue == 10));
+	CHECK(EncodeTestDword("09", &dwValue) && (dwValue == 9));
+	CHECK(EncodeTestDword("0", &dwValue) && (dwValue == 0));
+	CHECK(EncodeTestDword("  42", &dwValue) && (dwValue == 42));
+	CHECK(EncodeTestDword("0x10", &dwValue) && (dwValue == 16));
+	CHECK(EncodeTestDword("0XfF", &dwValue) && (dwValue == 255));
+	CHECK(EncodeTestDword("0xFFFFFFFF", &dwValue) && (dwValue == 0xFFFFFFFF));
+	CHECK(EncodeTestDword("4294967295", &dwValue) && (dwValue == 0xFFFFFFFF));
+}
+
+/// <summary>
+///		Signs, stray characters, second prefix and numbers past type bound are rejected
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestMalformedNumbers()
+{
+	LPCSTR lpsMalformed[] = { "", " ", "-1", "+1", "1a", "0x", "0x-1", "0x 1", "0x0x10", "0xG", "1 ", "10.5", "4294967296", "0x100000000" };
+	DWORD dwValue;
+
+	for (DWORD dwIndex = 0; dwIndex < sizeof(lpsMalformed) / sizeof(lpsMalformed[0]); dwIndex++)
+	{
+		if (!CHECK(!EncodeTestDword(lpsMalformed[dwIndex], &dwValue)))
+		{
+			fprintf(stderr, "accepted \"%s\"\n", lpsMalformed[dwIndex]);
+		}
+	}
+
+	ULONGLONG ullValue = 0;
+	CHECK(EncodeTestQword("4294967296", &ullValue) && (ullValue == 0x100000000ull));
+	CHECK(EncodeTestQword("0xFFFFFFFFFFFFFFFF", &ullValue) && (ullValue == 0xFFFFFFFFFFFFFFFFull));
+	CHECK(!EncodeTestQword("18446744073709551616", &ullValue));
+}
+
+/// <summary>
+///		Check text encoding of registry values
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestNumberBase();
+	TestMalformedNumbers();
+
+	return FinishTests("ValueCodecTests");
+}
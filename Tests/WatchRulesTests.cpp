@@ -0,0 +1,46 @@
+#include "../Api/Platform.h"
+#include <stdio.h>
+
+#include "../Api/WatchRules.h"
+#include "TestCheck.h"
+
+/// <summary>
+///		Non-ASCII pattern characters added in any order are found again by matcher,
+///		characters of no pattern stay in their own class
+/// </summary>
+///
+/// <returns>void</returns>
+static void TestNonAsciiClasses()
+{
+	// Cyrillic Ya, Zhe, Be and A with diaeresis, table is filled in descending order
+	LPCWSTR lpsPatterns[] = { L"**\\\x044F*", L"**\\\x0436*", L"**\\\x0431\x00E4" };
+	DWORD dwPatternsCount = sizeof(lpsPatterns) / sizeof(lpsPatterns[0]);
+
+	WATCHRULESET wrsRules;
+	InitWatchRules(&wrsRules);
+
+	for (DWORD dwIndex = 0; dwIndex < dwPatternsCount; dwIndex++)
+	{
+		CHECK(AddWatchRule(&wrsRules, false, lpsPatterns[dwIndex], NULL, NULL, dwIndex + 1));
+	}
+
+	CHECK(MatchWatchRules(&wrsRules, L"SOFTWARE\\\x044Fkey", L"Value") == 0);
+	CHECK(MatchWatchRules(&wrsRules, L"SOFTWARE\\\x0436key", L"Value") == 1);
+	CHECK(MatchWatchRules(&wrsRules, L"SOFTWARE\\\x0431\x00E4", L"Value") == 2);
+	CHECK(MatchWatchRules(&wrsRules, L"SOFTWARE\\\x0431\x0436", L"Value") == WATCH_NO_RULE);
+	CHECK(MatchWatchRules(&wrsRules, L"SOFTWARE\\\x4E00key", L"Value") == WATCH_NO_RULE);
+
+	FreeWatchRules(&wrsRules);
+}
+
+/// <summary>
+///		Check pattern matching of watch rules
+/// </summary>
+///
+/// <returns>int (0 if all checks passed)</returns>
+int main()
+{
+	TestNonAsciiClasses();
+
+	return FinishTests("WatchRulesTests");
+}